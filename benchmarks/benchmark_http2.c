@@ -0,0 +1,256 @@
+/*=============================================================================
+ * benchmarks/benchmark_http2: HTTP/1.1 vs HTTP/2 request benchmark.
+ *
+ * Copyright (c) 2014 Andrew Canaday
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *===========================================================================*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "core/ymo_test_proto.h"
+
+#include "yimmo.h"
+#include "ymo_log.h"
+#include "ymo_http.h"
+#include "ymo_proto_http.h"
+#include "ymo_proto_http2.h"
+#include "ymo_http2_hpack.h"
+
+#include "ymo_benchmark.h"
+
+/* Number of requests issued at each depth: */
+#define NO_REQUESTS 1048576
+
+static const char* h1_request =
+    "GET /index.html HTTP/1.1\r\n"
+    "Host: www.example.com\r\n"
+    "Accept: */*\r\n"
+    "\r\n";
+
+/* Concurrent streams (HTTP/2) or pipelined requests (HTTP/1.1): */
+static const size_t depths[] = { 1, 4, 16, 64 };
+
+#define NO_DEPTHS (sizeof(depths)/sizeof(depths[0]))
+
+/* The same request, as an HTTP/2 header block: */
+static uint8_t h2_block[256];
+static size_t h2_block_len;
+
+
+static ymo_status_t http_cb(
+        ymo_http_session_t* session,
+        ymo_http_request_t* request,
+        ymo_http_response_t* response,
+        void* user)
+{
+    ymo_http_response_insert_header(response, "Content-Type", "text/plain");
+    ymo_http_response_set_status(response, YMO_HTTP_OK);
+    ymo_http_response_body_append(response, YMO_BUCKET_FROM_REF("OK", 2));
+    ymo_http_response_finish(response);
+    return YMO_OKAY;
+}
+
+
+static void put_frame_hdr(
+        uint8_t* p, size_t len, uint8_t type, uint8_t flags, uint32_t id)
+{
+    p[0] = (uint8_t)(len >> 16);
+    p[1] = (uint8_t)(len >> 8);
+    p[2] = (uint8_t)len;
+    p[3] = type;
+    p[4] = flags;
+    p[5] = (uint8_t)(id >> 24);
+    p[6] = (uint8_t)(id >> 16);
+    p[7] = (uint8_t)(id >> 8);
+    p[8] = (uint8_t)id;
+}
+
+
+/* Feed r_len bytes to the connection and flush the responses, as the server
+ * would (the connection may switch protocols along the way), returning the
+ * number of write callbacks it took:
+ */
+static size_t run_batch(ymo_test_conn_t* test_conn, char* r_data, size_t r_len)
+{
+    static char junk[65536];
+    ymo_conn_t* conn = test_conn->conn;
+    size_t no_writes = 0;
+    ymo_status_t status;
+
+    while( r_len ) {
+        ssize_t n = conn->proto->vtable.read_cb(
+                conn->proto->data, conn, conn->proto_data, r_data, r_len);
+        ymo_assert(n >= 0);
+        r_data += n;
+        r_len -= n;
+    }
+
+    do {
+        status = conn->proto->vtable.write_cb(
+                conn->proto->data, conn, conn->proto_data,
+                test_conn->fd_send);
+        ++no_writes;
+    } while( status == YMO_WOULDBLOCK );
+    ymo_assert(status == YMO_OKAY);
+
+    while( read(test_conn->fd_read, junk, sizeof(junk)) > 0 ) {}
+    return no_writes;
+}
+
+
+static ymo_test_conn_t* open_conn(ymo_test_server_t* test_server, int h2)
+{
+    ymo_test_conn_t* test_conn = test_conn_create(test_server);
+    if( !test_conn ) {
+        return NULL;
+    }
+
+    test_conn->conn->proto_data = ymo_proto_http_conn_init(
+            test_server->proto_data, test_conn->conn);
+    if( !test_conn->conn->proto_data ) {
+        return NULL;
+    }
+
+    if( h2 ) {
+        /* Preface, plus a connection window big enough for the run: */
+        char preface[YMO_HTTP2_PREFACE_LEN + 2 * YMO_HTTP2_FRAME_HDR_LEN + 4];
+        uint8_t* p = (uint8_t*)preface + YMO_HTTP2_PREFACE_LEN;
+        uint32_t increment = YMO_HTTP2_MAX_WINDOW - YMO_HTTP2_DEFAULT_WINDOW;
+
+        memcpy(preface, YMO_HTTP2_PREFACE, YMO_HTTP2_PREFACE_LEN);
+        put_frame_hdr(p, 0, YMO_HTTP2_SETTINGS, 0, 0);
+        p += YMO_HTTP2_FRAME_HDR_LEN;
+        put_frame_hdr(p, 4, YMO_HTTP2_WINDOW_UPDATE, 0, 0);
+        p += YMO_HTTP2_FRAME_HDR_LEN;
+        p[0] = (uint8_t)(increment >> 24);
+        p[1] = (uint8_t)(increment >> 16);
+        p[2] = (uint8_t)(increment >> 8);
+        p[3] = (uint8_t)increment;
+        run_batch(test_conn, preface, sizeof(preface));
+    }
+    return test_conn;
+}
+
+
+static void close_conn(ymo_test_conn_t* test_conn)
+{
+    ymo_conn_t* conn = test_conn->conn;
+    conn->proto->vtable.conn_cleanup_cb(
+            conn->proto->data, conn, conn->proto_data);
+    test_conn_free(test_conn);
+    YMO_FREE(test_conn);
+}
+
+
+static void report(
+        const char* label, size_t depth, struct timeval test_time)
+{
+    double usec = (double)test_time.tv_sec * USEC_PER_SEC
+        + test_time.tv_usec;
+    printf("  %-8s depth %-3zu: %lu.%06lu (%.1f ns/request)\n",
+            label, depth,
+            (long)test_time.tv_sec, (long)test_time.tv_usec,
+            (usec * 1000.0) / NO_REQUESTS);
+}
+
+
+int main(int argc, char** argv)
+{
+    puts("\n\n*** benchmark_http2: ***");
+    struct timeval test_time;
+    size_t h1_len = strlen(h1_request);
+    size_t d, i, j;
+
+    ymo_log_set_level_by_name("WARNING");
+    printf("  Number of requests: %i\n", NO_REQUESTS);
+
+    ymo_proto_t* proto = ymo_proto_http_create(
+            NULL, &http_cb, NULL, NULL, NULL, NULL, 0);
+    ymo_proto_t* h2_proto = ymo_proto_http2_create(proto);
+    ymo_assert(h2_proto != NULL);
+    ymo_test_server_t* test_server = test_server_create(proto);
+    ymo_assert(test_server != NULL);
+
+    /* GET /index.html, Host: www.example.com, Accept: * / *: */
+    uint8_t* p = h2_block;
+    *p++ = 0x82; /* :method: GET */
+    *p++ = 0x86; /* :scheme: http */
+    p += ymo_hpack_encode_field(p, YMO_HTTP_HID_NONE,
+            ":authority", 10, "www.example.com", 15);
+    *p++ = 0x85; /* :path: /index.html */
+    p += ymo_hpack_encode_field(p, YMO_HTTP_HID_NONE,
+            "accept", 6, "*/*", 3);
+    h2_block_len = (size_t)(p - h2_block);
+
+    puts("\nResults:");
+    for( d = 0; d < NO_DEPTHS; d++ )
+    {
+        size_t depth = depths[d];
+        size_t h2_len = YMO_HTTP2_FRAME_HDR_LEN + h2_block_len;
+        char* r_data = malloc(depth * YMO_MAX(h1_len, h2_len));
+        ymo_assert(r_data != NULL);
+
+        /* HTTP/1.1, pipelined: */
+        for( i = 0; i < depth; i++ ) {
+            memcpy(r_data + (i * h1_len), h1_request, h1_len);
+        }
+
+        ymo_test_conn_t* test_conn = open_conn(test_server, 0);
+        ymo_assert(test_conn != NULL);
+        benchmark_start();
+        for( i = 0; i < NO_REQUESTS / depth; ++i )
+        {
+            run_batch(test_conn, r_data, depth * h1_len);
+        }
+        test_time = benchmark_stop();
+        close_conn(test_conn);
+        report("HTTP/1.1", depth, test_time);
+
+        /* HTTP/2, concurrent streams: */
+        for( i = 0; i < depth; i++ ) {
+            memcpy(r_data + (i * h2_len) + YMO_HTTP2_FRAME_HDR_LEN,
+                    h2_block, h2_block_len);
+        }
+
+        test_conn = open_conn(test_server, 1);
+        ymo_assert(test_conn != NULL);
+        uint32_t stream_id = 1;
+        benchmark_start();
+        for( i = 0; i < NO_REQUESTS / depth; ++i )
+        {
+            for( j = 0; j < depth; j++, stream_id += 2 ) {
+                put_frame_hdr((uint8_t*)r_data + (j * h2_len), h2_block_len,
+                        YMO_HTTP2_HEADERS,
+                        YMO_HTTP2_FLAG_END_HEADERS | YMO_HTTP2_FLAG_END_STREAM,
+                        stream_id);
+            }
+            run_batch(test_conn, r_data, depth * h2_len);
+        }
+        test_time = benchmark_stop();
+        ymo_assert(test_conn->conn->proto == h2_proto);
+        close_conn(test_conn);
+        report("HTTP/2", depth, test_time);
+        free(r_data);
+    }
+
+    ymo_proto_http_cleanup(test_server->proto, test_server->server);
+    ymo_server_free(test_server->server);
+    YMO_FREE(test_server);
+    YMO_FREE(h2_proto);
+    return 0;
+}
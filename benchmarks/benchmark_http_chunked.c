@@ -0,0 +1,306 @@
+/*=============================================================================
+ * benchmarks/benchmark_http_chunked: Chunked transfer coding benchmark.
+ *
+ * Copyright (c) 2014 Andrew Canaday
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *===========================================================================*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "core/ymo_assert.h"
+
+#include "yimmo.h"
+#include "ymo_log.h"
+#include "ymo_alloc.h"
+#include "ymo_util.h"
+#include "ymo_http.h"
+#include "ymo_http_exchange.h"
+#include "ymo_http_parse.h"
+#include "ymo_http_response.h"
+#include "ymo_http_session.h"
+
+#include "ymo_benchmark.h"
+
+/* Encoder: flushes of BUCKETS_PER_FLUSH buckets of BUCKET_SIZE bytes: */
+#define NO_FLUSHES        1000000
+#define BUCKETS_PER_FLUSH 8
+#define BUCKET_SIZE       512
+
+/* Decoder: BODY_SIZE bytes of body, arriving in READ_SIZE reads: */
+#define NO_BODIES  200
+#define BODY_SIZE  (1024 * 1024)
+#define READ_SIZE  (16 * 1024)
+
+static char payload[BUCKET_SIZE];
+static size_t no_bytes;
+
+
+/*---------------------------------------------------------------*
+ * What we're replacing:
+ *---------------------------------------------------------------*/
+
+/* One chunk per bucket, with copied framing: */
+static ymo_bucket_t* legacy_body_get(ymo_http_response_t* response)
+{
+    static char chunk_hdr_buf[8];
+    static const char* chunk_term = "\r\n";
+    ymo_bucket_t* bucket_out = NULL;
+    ymo_bucket_t* current = response->body_head;
+
+    while( current ) {
+        ymo_bucket_t* body_data = current;
+        current = current->next;
+        int no_chars = snprintf(
+                chunk_hdr_buf, 7, "%zx\r\n", body_data->len);
+        ymo_bucket_t* chunk_hdr = YMO_BUCKET_FROM_CPY(
+                chunk_hdr_buf, no_chars);
+        chunk_hdr->next = body_data;
+        body_data->next = YMO_BUCKET_FROM_CPY(chunk_term, 2);
+        if( bucket_out ) {
+            ymo_bucket_append(bucket_out, chunk_hdr);
+        } else {
+            bucket_out = chunk_hdr;
+        }
+    }
+    response->body_head = response->body_tail = NULL;
+    return bucket_out;
+}
+
+
+/* Byte-at-a-time chunk headers and CRLFs: */
+static ssize_t legacy_parse_body(
+        ymo_http_body_cb_t body_cb,
+        ymo_http_session_t* session,
+        ymo_http_exchange_t* exchange,
+        const char* buffer,
+        size_t len)
+{
+    const char* current = buffer;
+
+    do {
+        switch( exchange->state ) {
+            case HTTP_STATE_BODY_CHUNK_HEADER:
+                do {
+                    char c = *current++;
+                    --len;
+                    if( c == '\n' ) {
+                        exchange->state = exchange->body_remain
+                            ? HTTP_STATE_BODY : HTTP_STATE_COMPLETE;
+                        break;
+                    } else if( c != '\r' ) {
+                        exchange->body_remain =
+                            (exchange->body_remain << 4)
+                            | (((c & 0xF) + (c >> 6)) | ((c >> 3) & 0x8));
+                    }
+                } while( len );
+                break;
+            case HTTP_STATE_BODY:
+            {
+                size_t n = YMO_MIN(len, exchange->body_remain);
+                body_cb(session, &exchange->request, &exchange->response,
+                        current, n, session->user_data);
+                len -= n;
+                current += n;
+                exchange->body_remain -= n;
+                if( !exchange->body_remain ) {
+                    exchange->state = HTTP_STATE_BODY_CHUNK_TRAILER;
+                }
+            }
+            break;
+            case HTTP_STATE_BODY_CHUNK_TRAILER:
+                do {
+                    --len;
+                    if( *current++ == '\n' ) {
+                        exchange->state = HTTP_STATE_BODY_CHUNK_HEADER;
+                        break;
+                    }
+                } while( len );
+                break;
+            default:
+                return current - buffer;
+        }
+    } while( len );
+    return current - buffer;
+}
+
+
+/*---------------------------------------------------------------*
+ * Helpers:
+ *---------------------------------------------------------------*/
+static ymo_status_t body_cb(
+        ymo_http_session_t* session,
+        ymo_http_request_t* request,
+        ymo_http_response_t* response,
+        const char* data,
+        size_t len,
+        void* user_data)
+{
+    no_bytes += len;
+    return YMO_OKAY;
+}
+
+
+static void print_result(
+        const char* name, struct timeval test_time, size_t n, const char* unit)
+{
+    double usec = (double)test_time.tv_sec * USEC_PER_SEC
+        + test_time.tv_usec;
+    printf("  %-28s %lu.%06lu (%.1f ns/%s)\n", name,
+            (long)test_time.tv_sec, (long)test_time.tv_usec,
+            (usec * 1000.0) / n, unit);
+}
+
+
+/* Chunked body with chunks of chunk_size bytes: */
+static size_t make_body(char* body, size_t chunk_size)
+{
+    size_t len = 0;
+    for( size_t off = 0; off < BODY_SIZE; off += chunk_size ) {
+        size_t n = YMO_MIN(chunk_size, BODY_SIZE - off);
+        len += sprintf(body + len, "%zx\r\n", n);
+        memset(body + len, 'x', n);
+        len += n;
+        body[len++] = '\r';
+        body[len++] = '\n';
+    }
+    len += sprintf(body + len, "0\r\n\r\n");
+    return len;
+}
+
+
+/* The baseline decoder has to agree with strtoul on every hex digit, in
+ * either case, or its timings aren't comparable:
+ */
+static void check_legacy_hex(void)
+{
+    static const char* sizes[] = {
+        "1234567", "89abcdef", "89ABCDEF", "0",
+    };
+    ymo_http_session_t session;
+    ymo_http_exchange_t* exchange = ymo_http_exchange_create();
+    ymo_assert(exchange != NULL);
+    memset(&session, 0, sizeof(session));
+
+    for( size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++ ) {
+        char hdr[16];
+        size_t len = snprintf(hdr, sizeof(hdr), "%s\r\n", sizes[i]);
+        exchange->state = HTTP_STATE_BODY_CHUNK_HEADER;
+        exchange->body_remain = 0;
+        legacy_parse_body(&body_cb, &session, exchange, hdr, len);
+        ymo_assert(exchange->body_remain == strtoul(sizes[i], NULL, 16));
+    }
+    ymo_http_exchange_free(exchange);
+}
+
+
+/*---------------------------------------------------------------*
+ * Benchmarks:
+ *---------------------------------------------------------------*/
+static void run_encode(int legacy)
+{
+    struct timeval test_time;
+    ymo_http_response_t* r = ymo_http_response_create(NULL);
+    size_t no_buckets = 0;
+    ymo_assert(r != NULL);
+    r->flags = YMO_HTTP_RESPONSE_CHUNKED;
+
+    benchmark_start();
+    for( size_t i = 0; i < NO_FLUSHES; i++ ) {
+        for( size_t b = 0; b < BUCKETS_PER_FLUSH; b++ ) {
+            ymo_http_response_body_append(
+                    r, YMO_BUCKET_FROM_REF(payload, BUCKET_SIZE));
+        }
+        ymo_bucket_t* out = legacy
+            ? legacy_body_get(r) : ymo_http_response_body_get(NULL, r);
+        for( ymo_bucket_t* b = out; b; b = b->next ) {
+            no_buckets++;
+        }
+        ymo_bucket_free_all(out);
+    }
+    test_time = benchmark_stop();
+
+    print_result(legacy ? "per-bucket chunks:" : "coalesced chunk:",
+            test_time, NO_FLUSHES, "flush");
+    printf("  %-28s %zu\n", "  iovecs per flush:", no_buckets / NO_FLUSHES);
+    ymo_http_response_free(r);
+}
+
+
+static void run_decode(size_t chunk_size, int legacy)
+{
+    struct timeval test_time;
+    char name[64];
+    ymo_http_session_t session;
+    char* body = YMO_ALLOC(BODY_SIZE + (BODY_SIZE / chunk_size + 2) * 32);
+    size_t len = make_body(body, chunk_size);
+    ymo_http_exchange_t* exchange = ymo_http_exchange_create();
+    ymo_assert(body && exchange);
+
+    memset(&session, 0, sizeof(session));
+    exchange->request.flags |= YMO_HTTP_REQUEST_CHUNKED;
+    no_bytes = 0;
+
+    benchmark_start();
+    for( size_t i = 0; i < NO_BODIES; i++ ) {
+        exchange->state = HTTP_STATE_BODY_CHUNK_HEADER;
+        exchange->body_remain = 0;
+        exchange->remain = YMO_HTTP_RECV_BUF_SIZE;
+        for( size_t off = 0;
+                off < len && exchange->state != HTTP_STATE_COMPLETE; ) {
+            size_t n = YMO_MIN(READ_SIZE, len - off);
+            ssize_t r = (legacy ? &legacy_parse_body : &ymo_parse_http_body)(
+                    &body_cb, &session, exchange, body + off, n);
+            ymo_assert(r > 0);
+            off += r;
+        }
+        ymo_assert(exchange->state == HTTP_STATE_COMPLETE);
+    }
+    test_time = benchmark_stop();
+
+    ymo_assert(no_bytes == (size_t)NO_BODIES * BODY_SIZE);
+    snprintf(name, sizeof(name), "%s (%zuB chunks):",
+            legacy ? "byte-at-a-time" : "bulk", chunk_size);
+    print_result(name, test_time,
+            NO_BODIES * ((BODY_SIZE + chunk_size - 1) / chunk_size), "chunk");
+
+    ymo_http_exchange_free(exchange);
+    YMO_FREE(body);
+}
+
+
+int main(int argc, char** argv)
+{
+    puts("\n\n*** benchmark_http_chunked: ***");
+    ymo_log_set_level_by_name("WARNING");
+    memset(payload, 'x', sizeof(payload));
+    check_legacy_hex();
+
+    printf("  Encode: %i flushes of %i x %i byte buckets\n",
+            NO_FLUSHES, BUCKETS_PER_FLUSH, BUCKET_SIZE);
+    puts("\nResults (encode):");
+    run_encode(1);
+    run_encode(0);
+
+    printf("\n  Decode: %i x %i byte bodies, in %i byte reads\n",
+            NO_BODIES, BODY_SIZE, READ_SIZE);
+    puts("\nResults (decode):");
+    run_decode(64, 1);
+    run_decode(64, 0);
+    run_decode(4096, 1);
+    run_decode(4096, 0);
+    return 0;
+}
@@ -0,0 +1,192 @@
+/*=============================================================================
+ * benchmarks/benchmark_http_compress: Response compression benchmark.
+ *
+ * Copyright (c) 2014 Andrew Canaday
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *===========================================================================*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "core/ymo_assert.h"
+
+#include "yimmo.h"
+#include "ymo_log.h"
+#include "core/ymo_bucket.h"
+#include "ymo_http.h"
+#include "ymo_http_response.h"
+#include "ymo_http_compress.h"
+
+#include "ymo_benchmark.h"
+
+/* Number of responses compressed for each coding/level: */
+#define NO_ITERATIONS 2000
+
+/* Size of the JSON corpus: */
+#define CORPUS_SIZE 32768
+
+/* Size of each body_append, for streamed responses: */
+#define STREAM_PIECE 2048
+
+static char corpus[CORPUS_SIZE];
+
+static const int levels[] = { 1, 6, 9 };
+
+#define NO_LEVELS (sizeof(levels)/sizeof(levels[0]))
+
+
+/* Build a complete (or streamed) JSON response and compress it, returning
+ * the compressed body length:
+ */
+static size_t compress_response(
+        ymo_http_compress_t* cfg,
+        ymo_http_response_t* response,
+        ymo_http_coding_t coding,
+        int streamed)
+{
+    size_t len = 0;
+    size_t off = 0;
+    ymo_bucket_t* body;
+
+    ymo_http_hdr_table_clear(&response->headers);
+    ymo_http_hdr_table_insert(
+            &response->headers, "Content-Type", "application/json");
+    response->content_len = 0;
+    response->compress_coding = coding;
+    response->compress_pending = 1;
+    response->flags = YMO_HTTP_FLAG_VERSION_1_1
+        | YMO_HTTP_FLAG_REQUEST_KEEPALIVE;
+
+    if( !streamed ) {
+        ymo_http_response_body_append(
+                response, YMO_BUCKET_FROM_REF(corpus, CORPUS_SIZE));
+        response->flags |= YMO_HTTP_RESPONSE_COMPLETE;
+        ymo_assert(ymo_http_compress_start(cfg, response) == YMO_OKAY);
+    } else {
+        ymo_assert(ymo_http_compress_start(cfg, response) == YMO_OKAY);
+        for( off = 0; off < CORPUS_SIZE; off += STREAM_PIECE ) {
+            ymo_http_response_body_append(response,
+                    YMO_BUCKET_FROM_REF(corpus + off, STREAM_PIECE));
+            if( off + STREAM_PIECE >= CORPUS_SIZE ) {
+                response->flags |= YMO_HTTP_RESPONSE_COMPLETE;
+            }
+            ymo_assert(ymo_http_compress_flush(response) == YMO_OKAY);
+            len += ymo_bucket_len_all(response->body_head);
+            ymo_bucket_free_all(response->body_head);
+            response->body_head = response->body_tail = NULL;
+        }
+    }
+
+    body = response->body_head;
+    response->body_head = response->body_tail = NULL;
+    len += ymo_bucket_len_all(body);
+    ymo_bucket_free_all(body);
+    return len;
+}
+
+
+static void print_result(
+        const char* name, int level, size_t len, struct timeval test_time)
+{
+    double usec = (double)test_time.tv_sec * USEC_PER_SEC
+        + test_time.tv_usec;
+    double mb = ((double)CORPUS_SIZE * NO_ITERATIONS) / (1024.0 * 1024.0);
+    printf("  %-8s level %i (%6zu bytes, ratio %5.2f): "
+            "%lu.%06lu (%.1f MB/s)\n",
+            name, level, len, (double)CORPUS_SIZE / (double)len,
+            (long)test_time.tv_sec, (long)test_time.tv_usec,
+            usec ? (mb * USEC_PER_SEC) / usec : 0.0);
+}
+
+
+static void run(
+        ymo_http_compress_t* cfg,
+        ymo_http_response_t* response,
+        int streamed,
+        int pooled)
+{
+    struct timeval test_time;
+    size_t c, l, i;
+
+    for( c = YMO_HTTP_CODING_IDENTITY + 1; c < YMO_HTTP_CODING_MAX; c++ )
+    {
+        if( !ymo_http_coding_available(c) ) {
+            continue;
+        }
+
+        for( l = 0; l < NO_LEVELS; l++ )
+        {
+            size_t len = 0;
+            cfg->level = levels[l];
+
+            benchmark_start();
+            for( i = 0; i < NO_ITERATIONS; ++i )
+            {
+                len = compress_response(cfg, response, c, streamed);
+                if( !pooled ) {
+                    ymo_http_compress_drain(cfg);
+                }
+            }
+            test_time = benchmark_stop();
+            print_result(ymo_http_coding_name(c), levels[l], len, test_time);
+        }
+    }
+}
+
+
+int main(int argc, char** argv)
+{
+    puts("\n\n*** benchmark_http_compress: ***");
+    size_t len = 0;
+    int i;
+
+    ymo_log_set_level_by_name("WARNING");
+    printf("  Number of iterations: %i\n", NO_ITERATIONS);
+    printf("  Corpus size: %i\n", CORPUS_SIZE);
+
+    /* Something resembling an API response: */
+    for( i = 0; len < CORPUS_SIZE; i++ ) {
+        len += snprintf(corpus + len, CORPUS_SIZE - len,
+                "{\"id\":%i,\"name\":\"user-%i\",\"email\":\"user%i@example.com\","
+                "\"active\":%s,\"score\":%i.%02i,\"tags\":[\"t%i\",\"t%i\"]},",
+                i, (i * 7919) % 10007, i, (i % 3) ? "true" : "false",
+                (i * 31) % 1000, i % 100, i % 17, i % 5);
+    }
+
+    ymo_http_compress_t* cfg = ymo_http_compress_create(
+            YMO_HTTP_COMPRESS_LEVEL, 0);
+    if( !cfg ) {
+        puts("  No content codings available; skipping.");
+        return 0;
+    }
+
+    ymo_http_response_t* response = ymo_http_response_create(NULL);
+    ymo_assert(response != NULL);
+
+    puts("\nResults (complete, pooled):");
+    run(cfg, response, 0, 1);
+
+    puts("\nResults (complete, fresh context per response):");
+    run(cfg, response, 0, 0);
+
+    puts("\nResults (streamed, pooled):");
+    run(cfg, response, 1, 1);
+
+    ymo_http_response_free(response);
+    ymo_http_compress_free(cfg);
+    return 0;
+}
+
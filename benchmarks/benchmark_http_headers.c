@@ -0,0 +1,233 @@
+/*=============================================================================
+ * benchmarks/benchmark_http_headers: Header storage memory per connection.
+ *
+ * Copyright (c) 2014 Andrew Canaday
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *===========================================================================*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "core/ymo_assert.h"
+
+#include "yimmo.h"
+#include "ymo_log.h"
+#include "ymo_alloc.h"
+#include "ymo_http.h"
+#include "ymo_http_exchange.h"
+#include "ymo_http_parse.h"
+
+#include "ymo_benchmark.h"
+
+/* Simultaneous connections, each holding one parsed request: */
+#define NO_CONNS      10000
+#define NO_ITERATIONS 50
+
+/* Request head sizes, in bytes, and how often they're seen (out of 50):
+ *   70%: ~500B (plain browser/API requests)
+ *   20%: ~1.5KB (analytics cookies)
+ *    8%: ~4KB (JWTs, SSO cookies)
+ *    2%: ~12KB (everything at once)
+ */
+static const struct {
+    size_t  size;
+    int     weight;
+} mix[] = {
+    {   500, 35 },
+    {  1500, 10 },
+    {  4096,  4 },
+    { 12288,  1 },
+};
+
+#define NO_SIZES (sizeof(mix)/sizeof(mix[0]))
+
+static char* requests[NO_SIZES];
+static size_t request_len[NO_SIZES];
+
+
+/*---------------------------------------------------------------*
+ * Helpers:
+ *---------------------------------------------------------------*/
+
+/* A browser-ish GET, padded out to size bytes with a cookie: */
+static size_t make_request(char* buf, size_t size)
+{
+    size_t len = sprintf(buf,
+            "GET /articles/2023/10/index.html?utm_source=feed HTTP/1.1\r\n"
+            "Host: www.example.com\r\n"
+            "User-Agent: Mozilla/5.0 (X11; Linux x86_64) Firefox/118.0\r\n"
+            "Accept: text/html,application/xhtml+xml\r\n"
+            "Accept-Encoding: gzip, deflate, br\r\n"
+            "Cookie: session=");
+    while( len < size - 4 ) {
+        buf[len] = 'a' + (len % 26);
+        len++;
+    }
+    len += sprintf(buf + len, "\r\n\r\n");
+    return len;
+}
+
+
+/* Index into mix for the i-th connection: */
+static size_t pick(size_t i)
+{
+    int n = (int)(i % 50);
+    for( size_t s = 0; s < NO_SIZES; s++ ) {
+        if( n < mix[s].weight ) {
+            return s;
+        }
+        n -= mix[s].weight;
+    }
+    return 0;
+}
+
+
+/* Parse a complete request head, as ymo_proto_http_read would: */
+static void parse_request(
+        ymo_http_exchange_t* exchange, const char* data, size_t len)
+{
+    exchange->state = HTTP_STATE_REQUEST_METHOD;
+    while( len ) {
+        ssize_t n;
+        switch( exchange->state ) {
+            case HTTP_STATE_CRLF:
+                n = ymo_parse_http_crlf(exchange, data, len);
+                break;
+            case HTTP_STATE_HEADER_NAME:
+            case HTTP_STATE_HEADER_VALUE_LEADING_SPACE:
+            case HTTP_STATE_HEADER_VALUE:
+                n = ymo_parse_http_headers(NULL, exchange, data, len);
+                break;
+            case HTTP_STATE_HEADERS_COMPLETE:
+                return;
+            default:
+                n = ymo_parse_http_request_line(exchange, data, len);
+                break;
+        }
+        ymo_assert(n > 0);
+        data += n;
+        len -= n;
+    }
+    ymo_assert(exchange->state == HTTP_STATE_HEADERS_COMPLETE);
+}
+
+
+/* Bytes held by an exchange (less the hash table entries, which are the
+ * same either way): */
+static size_t exchange_bytes(const ymo_http_exchange_t* exchange)
+{
+    size_t total = sizeof(ymo_http_exchange_t);
+    const ymo_http_hdr_block_t* block = exchange->hdr_blocks;
+    for( ; block; block = block->next ) {
+        total += sizeof(ymo_http_hdr_block_t) + block->size;
+    }
+    return total;
+}
+
+
+/*---------------------------------------------------------------*
+ * Benchmarks:
+ *---------------------------------------------------------------*/
+static void run_memory(ymo_http_exchange_t** exchanges)
+{
+    size_t active = 0;
+    size_t idle = 0;
+
+    for( size_t i = 0; i < NO_CONNS; i++ ) {
+        size_t s = pick(i);
+        parse_request(exchanges[i], requests[s], request_len[s]);
+        active += exchange_bytes(exchanges[i]);
+    }
+    for( size_t i = 0; i < NO_CONNS; i++ ) {
+        ymo_http_exchange_reset(exchanges[i]);
+        idle += exchange_bytes(exchanges[i]);
+    }
+
+    /* What it'd take to accept the same requests with a fixed buffer: */
+    size_t fixed = sizeof(ymo_http_exchange_t)
+        - YMO_HTTP_RECV_BUF_SIZE + YMO_HTTP_HDR_MAX_DEFAULT;
+
+    puts("\nResults (bytes per connection):");
+    printf("  %-28s %zu (rejects %i%%)\n", "fixed recv_buf only:",
+            sizeof(ymo_http_exchange_t),
+            100 - 100 * mix[0].weight / 50);
+    printf("  %-28s %zu\n", "fixed, at hdr_max:", fixed);
+    printf("  %-28s %zu\n", "chained (active):", active / NO_CONNS);
+    printf("  %-28s %zu\n", "chained (idle):", idle / NO_CONNS);
+}
+
+
+static void run_parse(ymo_http_exchange_t* exchange, size_t s)
+{
+    struct timeval test_time;
+    char name[64];
+
+    benchmark_start();
+    for( size_t i = 0; i < NO_ITERATIONS * NO_CONNS / 10; i++ ) {
+        parse_request(exchange, requests[s], request_len[s]);
+        ymo_http_exchange_reset(exchange);
+    }
+    test_time = benchmark_stop();
+
+    double usec = (double)test_time.tv_sec * USEC_PER_SEC
+        + test_time.tv_usec;
+    snprintf(name, sizeof(name), "%zu byte request:", request_len[s]);
+    printf("  %-28s %lu.%06lu (%.1f ns/req; %.1f MB/s)\n", name,
+            (long)test_time.tv_sec, (long)test_time.tv_usec,
+            (usec * 1000.0) / (NO_ITERATIONS * NO_CONNS / 10),
+            ((double)request_len[s] * NO_ITERATIONS * NO_CONNS / 10) / usec);
+}
+
+
+int main(int argc, char** argv)
+{
+    ymo_http_exchange_t** exchanges;
+
+    puts("\n\n*** benchmark_http_headers: ***");
+    ymo_log_set_level_by_name("WARNING");
+    printf("  Connections: %i\n", NO_CONNS);
+    printf("  Header storage: %i bytes, growing to %i\n",
+            YMO_HTTP_RECV_BUF_SIZE, YMO_HTTP_HDR_MAX_DEFAULT);
+
+    for( size_t s = 0; s < NO_SIZES; s++ ) {
+        requests[s] = YMO_ALLOC(mix[s].size + 1);
+        ymo_assert(requests[s] != NULL);
+        request_len[s] = make_request(requests[s], mix[s].size);
+    }
+
+    exchanges = calloc(NO_CONNS, sizeof(ymo_http_exchange_t*));
+    ymo_assert(exchanges != NULL);
+    for( size_t i = 0; i < NO_CONNS; i++ ) {
+        exchanges[i] = ymo_http_exchange_create();
+        ymo_assert(exchanges[i] != NULL);
+    }
+
+    run_memory(exchanges);
+
+    puts("\nResults (parse + reset):");
+    for( size_t s = 0; s < NO_SIZES; s++ ) {
+        run_parse(exchanges[0], s);
+    }
+
+    for( size_t i = 0; i < NO_CONNS; i++ ) {
+        ymo_http_exchange_free(exchanges[i]);
+    }
+    free(exchanges);
+    for( size_t s = 0; s < NO_SIZES; s++ ) {
+        YMO_FREE(requests[s]);
+    }
+    return 0;
+}
@@ -0,0 +1,236 @@
+/*=============================================================================
+ * benchmarks/benchmark_http_idle: Memory held by idle keep-alive connections.
+ *
+ * Copyright (c) 2014 Andrew Canaday
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *===========================================================================*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "core/ymo_test_proto.h"
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif /* __GLIBC__ */
+
+#include "yimmo.h"
+#include "ymo_log.h"
+#include "ymo_http.h"
+#include "ymo_proto_http.h"
+#include "ymo_http_exchange.h"
+#include "ymo_http_session.h"
+
+#include "ymo_benchmark.h"
+
+/* Simultaneous keep-alive connections, at each scale: */
+static const size_t scales[] = { 1000, 10000, 50000 };
+
+#define NO_SCALES (sizeof(scales)/sizeof(scales[0]))
+
+static const char* request =
+    "GET /index.html HTTP/1.1\r\n"
+    "Host: www.example.com\r\n"
+    "User-Agent: benchmark_http_idle\r\n"
+    "Accept: */*\r\n"
+    "\r\n";
+
+static ymo_test_server_t* test_server = NULL;
+
+/* All connections share one socket pair; they take turns with it: */
+static ymo_test_conn_t* wire = NULL;
+
+
+static ymo_status_t http_cb(
+        ymo_http_session_t* session,
+        ymo_http_request_t* request,
+        ymo_http_response_t* response,
+        void* user)
+{
+    ymo_http_response_insert_header(response, "Content-Type", "text/plain");
+    ymo_http_response_set_status(response, YMO_HTTP_OK);
+    ymo_http_response_body_append(response, YMO_BUCKET_FROM_REF("OK", 2));
+    ymo_http_response_finish(response);
+    return YMO_OKAY;
+}
+
+
+/*---------------------------------------------------------------*
+ * Helpers:
+ *---------------------------------------------------------------*/
+
+/* Bytes currently allocated from the heap (0 if we can't tell): */
+static size_t heap_in_use(void)
+{
+#if defined(__GLIBC__) \
+    && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+    return mallinfo2().uordblks;
+#else
+    return 0;
+#endif /* __GLIBC__ >= 2.33 */
+}
+
+
+static int conn_send(ymo_conn_t* conn, const char* data, size_t len)
+{
+    while( len ) {
+        ssize_t n = ymo_proto_http_read(
+                test_server->proto_data, conn, conn->proto_data,
+                (char*)data, len);
+        ymo_assert(n > 0);
+        data += n;
+        len -= n;
+    }
+    return 0;
+}
+
+
+static int conn_flush(ymo_conn_t* conn)
+{
+    static char junk[65536];
+    ymo_status_t status;
+
+    do {
+        status = ymo_proto_http_write(
+                test_server->proto_data, conn, conn->proto_data,
+                wire->fd_send);
+    } while( status == YMO_WOULDBLOCK );
+    ymo_assert(status == YMO_OKAY);
+
+    while( read(wire->fd_read, junk, sizeof(junk)) > 0 ) {}
+    return 0;
+}
+
+
+static ymo_conn_t** open_conns(size_t no_conns)
+{
+    ymo_conn_t** conns = calloc(no_conns, sizeof(ymo_conn_t*));
+    if( !conns ) {
+        return NULL;
+    }
+
+    for( size_t i = 0; i < no_conns; i++ ) {
+        conns[i] = ymo_conn_create(
+                test_server->server, test_server->proto, wire->fd_send,
+                test_server->server->config.loop, ymo_read_cb, ymo_write_cb);
+        if( !conns[i] ) {
+            return NULL;
+        }
+        conns[i]->proto_data = ymo_proto_http_conn_init(
+                test_server->proto_data, conns[i]);
+        if( !conns[i]->proto_data ) {
+            return NULL;
+        }
+    }
+    return conns;
+}
+
+
+static void close_conns(ymo_conn_t** conns, size_t no_conns)
+{
+    for( size_t i = 0; i < no_conns; i++ ) {
+        ymo_proto_http_conn_cleanup(
+                test_server->proto_data, conns[i], conns[i]->proto_data);
+        ymo_conn_free(conns[i]);
+    }
+    free(conns);
+}
+
+
+/*---------------------------------------------------------------*
+ * Benchmarks:
+ *---------------------------------------------------------------*/
+static int run_scale(size_t no_conns)
+{
+    ymo_http_proto_data_t* http_data = test_server->proto_data;
+    size_t r_len = strlen(request);
+    size_t base, connected, idle, partial, pooled;
+    struct timeval test_time;
+
+    base = heap_in_use();
+    ymo_conn_t** conns = open_conns(no_conns);
+    ymo_assert(conns != NULL);
+    connected = heap_in_use();
+
+    /* One keep-alive request on each, round robin: */
+    benchmark_start();
+    for( size_t i = 0; i < no_conns; i++ ) {
+        ymo_assert(!conn_send(conns[i], request, r_len));
+        ymo_assert(!conn_flush(conns[i]));
+    }
+    test_time = benchmark_stop();
+    idle = heap_in_use();
+    pooled = http_data->exchange_pool.len;
+
+    /* The first bytes of the next request on each: */
+    for( size_t i = 0; i < no_conns; i++ ) {
+        ymo_assert(!conn_send(conns[i], request, r_len / 2));
+    }
+    partial = heap_in_use();
+
+    double usec = (double)test_time.tv_sec * USEC_PER_SEC
+        + test_time.tv_usec;
+    printf("\n  %zu connections (%.1f ns/request):\n", no_conns,
+            (usec * 1000.0) / no_conns);
+    if( !base && !connected ) {
+        puts("    (heap statistics unavailable on this platform)");
+    } else {
+        printf("    %-32s %zu\n", "connected:",
+                (connected - base) / no_conns);
+        printf("    %-32s %zu\n", "idle, after a response:",
+                (idle - base) / no_conns);
+        printf("    %-32s %zu\n", "if each held an exchange:",
+                (idle - base) / no_conns + sizeof(ymo_http_exchange_t));
+        printf("    %-32s %zu\n", "mid-request:",
+                (partial - base) / no_conns);
+    }
+    printf("    %-32s %zu x %zu bytes\n", "pooled exchanges (shared):",
+            pooled, sizeof(ymo_http_exchange_t));
+
+    close_conns(conns, no_conns);
+    return 0;
+}
+
+
+int main(int argc, char** argv)
+{
+    puts("\n\n*** benchmark_http_idle: ***");
+    ymo_log_set_level_by_name("WARNING");
+    printf("  sizeof(ymo_conn_t): %zu\n", sizeof(ymo_conn_t));
+    printf("  sizeof(ymo_http_session_t): %zu\n", sizeof(ymo_http_session_t));
+    printf("  sizeof(ymo_http_exchange_t): %zu\n",
+            sizeof(ymo_http_exchange_t));
+
+    ymo_proto_t* proto = ymo_proto_http_create(
+            NULL, &http_cb, NULL, NULL, NULL, NULL, 0);
+    test_server = test_server_create(proto);
+    ymo_assert(test_server != NULL);
+    wire = test_conn_create(test_server);
+    ymo_assert(wire != NULL);
+
+    puts("\nResults (heap bytes per connection):");
+    for( size_t s = 0; s < NO_SCALES; s++ ) {
+        ymo_assert(!run_scale(scales[s]));
+    }
+
+    test_conn_free(wire);
+    YMO_FREE(wire);
+    ymo_proto_http_cleanup(test_server->proto, test_server->server);
+    ymo_server_free(test_server->server);
+    YMO_FREE(test_server);
+    return 0;
+}
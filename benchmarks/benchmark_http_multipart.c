@@ -0,0 +1,177 @@
+/*=============================================================================
+ * benchmarks/benchmark_http_multipart: Multipart upload throughput benchmark.
+ *
+ * Copyright (c) 2014 Andrew Canaday
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *===========================================================================*/
+
+#define _GNU_SOURCE /* memmem */
+#include <fcntl.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "core/ymo_assert.h"
+
+#include "yimmo.h"
+#include "ymo_log.h"
+#include "ymo_alloc.h"
+#include "ymo_http.h"
+
+#include "ymo_benchmark.h"
+
+/* Upload size, in MiB, and the size of the chunks it arrives in: */
+#define UPLOAD_MB  512
+#define CHUNK_SIZE (64 * 1024)
+#define BLOCK_SIZE (1024 * 1024)
+
+#define BOUNDARY "----WebKitFormBoundary7MA4YWxkTrZu0gW"
+
+static const char* head =
+    "--" BOUNDARY "\r\n"
+    "Content-Disposition: form-data; name=\"file\"; filename=\"big.bin\"\r\n"
+    "Content-Type: application/octet-stream\r\n"
+    "\r\n";
+static const char* tail = "\r\n--" BOUNDARY "--\r\n";
+
+/* One MiB of random bytes, uploaded UPLOAD_MB times: */
+static char* block;
+static size_t no_bytes;
+static int null_fd = -1;
+
+
+/*---------------------------------------------------------------*
+ * Callbacks:
+ *---------------------------------------------------------------*/
+static ymo_status_t begin_cb(void* data, ymo_http_part_t* part)
+{
+    if( data ) {
+        part->fd = null_fd;
+    }
+    return YMO_OKAY;
+}
+
+
+static ymo_status_t data_cb(
+        void* data, ymo_http_part_t* part, const char* buf, size_t len)
+{
+    no_bytes += len;
+    return YMO_OKAY;
+}
+
+
+static void end_cb(void* data, ymo_http_part_t* part, ymo_status_t status)
+{
+    ymo_assert(status == YMO_OKAY);
+    no_bytes = part->len;
+}
+
+
+static const ymo_http_multipart_cb_t mp_cb = {
+    NULL, &begin_cb, &data_cb, &end_cb,
+};
+
+
+/*---------------------------------------------------------------*
+ * Helpers:
+ *---------------------------------------------------------------*/
+static void print_result(const char* name, struct timeval test_time)
+{
+    double sec = (double)test_time.tv_sec
+        + (double)test_time.tv_usec / USEC_PER_SEC;
+    printf("  %-28s %lu.%06lu (%.0f MiB/s)\n", name,
+            (long)test_time.tv_sec, (long)test_time.tv_usec,
+            UPLOAD_MB / sec);
+}
+
+
+static void run_multipart(const char* name, void* data)
+{
+    struct timeval test_time;
+    char type[128];
+    ymo_http_multipart_t* mp;
+
+    snprintf(type, sizeof(type), "multipart/form-data; boundary=%s", BOUNDARY);
+    no_bytes = 0;
+
+    benchmark_start();
+    mp = ymo_http_multipart_create(type, &mp_cb, data);
+    ymo_assert(mp != NULL);
+    ymo_assert(ymo_http_multipart_feed(mp, head, strlen(head)) == YMO_OKAY);
+    for( size_t mb = 0; mb < UPLOAD_MB; mb++ ) {
+        for( size_t off = 0; off < BLOCK_SIZE; off += CHUNK_SIZE ) {
+            ymo_assert(ymo_http_multipart_feed(
+                        mp, block + off, CHUNK_SIZE) == YMO_OKAY);
+        }
+    }
+    ymo_assert(ymo_http_multipart_feed(mp, tail, strlen(tail)) == YMO_OKAY);
+    ymo_assert(ymo_http_multipart_finish(mp) == YMO_OKAY);
+    ymo_http_multipart_free(mp);
+    test_time = benchmark_stop();
+
+    ymo_assert(no_bytes == (size_t)UPLOAD_MB * BLOCK_SIZE);
+    print_result(name, test_time);
+}
+
+
+/* For reference: memmem for the delimiter in each chunk (no headers, no
+ * straddling delimiters, no output): */
+static void run_memmem(void)
+{
+    struct timeval test_time;
+    const char* delim = tail;
+    size_t delim_len = strlen(BOUNDARY) + 4;
+    size_t found = 0;
+
+    benchmark_start();
+    for( size_t mb = 0; mb < UPLOAD_MB; mb++ ) {
+        for( size_t off = 0; off < BLOCK_SIZE; off += CHUNK_SIZE ) {
+            found += !!memmem(block + off, CHUNK_SIZE, delim, delim_len);
+        }
+    }
+    test_time = benchmark_stop();
+
+    ymo_assert(found == 0);
+    print_result("memmem (search only):", test_time);
+}
+
+
+int main(int argc, char** argv)
+{
+    puts("\n\n*** benchmark_http_multipart: ***");
+    ymo_log_set_level_by_name("WARNING");
+    printf("  Upload size: %i MiB\n", UPLOAD_MB);
+    printf("  Chunk size: %i bytes\n", CHUNK_SIZE);
+
+    block = YMO_ALLOC(BLOCK_SIZE);
+    ymo_assert(block != NULL);
+    srandom(42);
+    for( size_t i = 0; i < BLOCK_SIZE; i++ ) {
+        block[i] = (char)random();
+    }
+
+    null_fd = open("/dev/null", O_WRONLY);
+    ymo_assert(null_fd >= 0);
+
+    puts("\nResults:");
+    run_memmem();
+    run_multipart("multipart (data_cb):", NULL);
+    run_multipart("multipart (fd: /dev/null):", &null_fd);
+
+    close(null_fd);
+    YMO_FREE(block);
+    return 0;
+}
@@ -0,0 +1,158 @@
+/*=============================================================================
+ * benchmarks/benchmark_http_pipeline: HTTP pipelined request benchmark.
+ *
+ * Copyright (c) 2014 Andrew Canaday
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *===========================================================================*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "core/ymo_test_proto.h"
+
+#include "yimmo.h"
+#include "ymo_log.h"
+#include "ymo_http.h"
+#include "ymo_proto_http.h"
+
+#include "ymo_benchmark.h"
+
+/* Number of requests issued at each depth: */
+#define NO_REQUESTS 1048576
+
+static const char* request =
+    "GET /index.html HTTP/1.1\r\n"
+    "Host: www.example.com\r\n"
+    "Accept: */*\r\n"
+    "\r\n";
+
+static const size_t depths[] = { 1, 4, 16, 64 };
+
+#define NO_DEPTHS (sizeof(depths)/sizeof(depths[0]))
+
+
+static ymo_status_t http_cb(
+        ymo_http_session_t* session,
+        ymo_http_request_t* request,
+        ymo_http_response_t* response,
+        void* user)
+{
+    ymo_http_response_insert_header(response, "Content-Type", "text/plain");
+    ymo_http_response_set_status(response, YMO_HTTP_OK);
+    ymo_http_response_body_append(response, YMO_BUCKET_FROM_REF("OK", 2));
+    ymo_http_response_finish(response);
+    return YMO_OKAY;
+}
+
+
+/* Parse depth pipelined requests and flush the responses, as the server
+ * would, returning the number of write callbacks it took:
+ */
+static size_t run_batch(
+        ymo_test_server_t* test_server,
+        ymo_test_conn_t* test_conn,
+        ymo_http_session_t* session,
+        char* r_data,
+        size_t r_len)
+{
+    static char junk[65536];
+    size_t no_writes = 0;
+    ymo_status_t status;
+
+    while( r_len ) {
+        ssize_t n = ymo_proto_http_read(
+                test_server->proto_data, test_conn->conn,
+                session, r_data, r_len);
+        ymo_assert(n > 0);
+        r_data += n;
+        r_len -= n;
+    }
+
+    do {
+        status = ymo_proto_http_write(
+                test_server->proto_data, test_conn->conn,
+                session, test_conn->fd_send);
+        ++no_writes;
+    } while( status == YMO_WOULDBLOCK );
+    ymo_assert(status == YMO_OKAY);
+
+    while( read(test_conn->fd_read, junk, sizeof(junk)) > 0 ) {}
+    return no_writes;
+}
+
+
+int main(int argc, char** argv)
+{
+    puts("\n\n*** benchmark_http_pipeline: ***");
+    struct timeval test_time;
+    size_t r_len = strlen(request);
+    size_t d, i;
+
+    ymo_log_set_level_by_name("WARNING");
+    printf("  Number of requests: %i\n", NO_REQUESTS);
+
+    ymo_proto_t* proto = ymo_proto_http_create(
+            NULL, &http_cb, NULL, NULL, NULL, NULL, 0);
+    ymo_test_server_t* test_server = test_server_create(proto);
+    ymo_assert(test_server != NULL);
+
+    ymo_test_conn_t* test_conn = test_conn_create(test_server);
+    ymo_assert(test_conn != NULL);
+
+    ymo_http_session_t* session = ymo_proto_http_conn_init(
+            test_server->proto_data, test_conn->conn);
+    ymo_assert(session != NULL);
+    test_conn->conn->proto_data = session;
+
+    puts("\nResults:");
+    for( d = 0; d < NO_DEPTHS; d++ )
+    {
+        size_t depth = depths[d];
+        size_t no_writes = 0;
+        char* r_data = malloc(depth * r_len);
+        ymo_assert(r_data != NULL);
+        for( i = 0; i < depth; i++ ) {
+            memcpy(r_data + (i * r_len), request, r_len);
+        }
+
+        benchmark_start();
+        for( i = 0; i < NO_REQUESTS / depth; ++i )
+        {
+            no_writes += run_batch(
+                    test_server, test_conn, session,
+                    r_data, depth * r_len);
+        }
+        test_time = benchmark_stop();
+
+        double usec = (double)test_time.tv_sec * USEC_PER_SEC
+            + test_time.tv_usec;
+        printf("  depth %-3zu: %lu.%06lu (%.1f ns/request, "
+               "%.2f writes/batch)\n",
+                depth,
+                (long)test_time.tv_sec, (long)test_time.tv_usec,
+                (usec * 1000.0) / NO_REQUESTS,
+                (double)no_writes / (NO_REQUESTS / depth));
+        free(r_data);
+    }
+
+    ymo_proto_http_conn_cleanup(
+            test_server->proto_data, test_conn->conn, session);
+    test_conn_free(test_conn);
+    YMO_FREE(test_conn);
+    return 0;
+}
+
@@ -0,0 +1,334 @@
+/*=============================================================================
+ * benchmarks/benchmark_http_proxy: Reverse proxy overhead and pooling.
+ *
+ * Copyright (c) 2014 Andrew Canaday
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *===========================================================================*/
+
+#define _GNU_SOURCE /* memmem */
+#include <errno.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <ev.h>
+#include "core/ymo_assert.h"
+
+#include "yimmo.h"
+#include "ymo_log.h"
+#include "ymo_http.h"
+#include "core/ymo_net.h"
+#include "core/ymo_server.h"
+
+#include "ymo_benchmark.h"
+
+/* Requests on a single keep-alive client connection: */
+#define NO_SEQUENTIAL 20000
+
+/* ...and with a new upstream connection for each: */
+#define NO_UNPOOLED 5000
+
+/* Concurrent clients, and the requests they share: */
+#define NO_CLIENTS 32
+#define NO_CONCURRENT 100000
+
+#define BODY_SIZE 512
+#define CLIENT_BUF_SIZE 4096
+
+static const char* request =
+    "GET /item/42?fields=all HTTP/1.1\r\n"
+    "Host: www.example.com\r\n"
+    "User-Agent: benchmark_http_proxy\r\n"
+    "Accept: application/json\r\n"
+    "Accept-Encoding: identity\r\n"
+    "\r\n";
+
+static char body[BODY_SIZE];
+static struct ev_loop* loop = NULL;
+static ymo_http_proxy_t* pooled = NULL;
+static ymo_http_proxy_t* unpooled = NULL;
+
+typedef struct client {
+    ev_io   w;
+    int     fd;
+    size_t  len;
+    char    buf[CLIENT_BUF_SIZE];
+} client_t;
+
+static client_t clients[NO_CLIENTS];
+static size_t no_sent;
+static size_t no_done;
+static size_t no_total;
+
+
+/*---------------------------------------------------------------*
+ * Upstream handler:
+ *---------------------------------------------------------------*/
+static ymo_status_t upstream_cb(
+        ymo_http_session_t* session,
+        ymo_http_request_t* request,
+        ymo_http_response_t* response,
+        void* user)
+{
+    ymo_http_response_insert_header(
+            response, "Content-Type", "application/json");
+    ymo_http_response_insert_header(response, "Cache-Control", "no-cache");
+    ymo_http_response_set_status(response, YMO_HTTP_OK);
+    ymo_http_response_body_append(
+            response, YMO_BUCKET_FROM_REF(body, sizeof(body)));
+    ymo_http_response_finish(response);
+    return YMO_OKAY;
+}
+
+
+/*---------------------------------------------------------------*
+ * Proxy handlers:
+ *---------------------------------------------------------------*/
+static ymo_status_t pooled_cb(
+        ymo_http_session_t* session,
+        ymo_http_request_t* request,
+        ymo_http_response_t* response,
+        void* user)
+{
+    return ymo_http_proxy_serve(pooled, request, response);
+}
+
+
+static ymo_status_t unpooled_cb(
+        ymo_http_session_t* session,
+        ymo_http_request_t* request,
+        ymo_http_response_t* response,
+        void* user)
+{
+    return ymo_http_proxy_serve(unpooled, request, response);
+}
+
+
+/*---------------------------------------------------------------*
+ * Helpers:
+ *---------------------------------------------------------------*/
+static double elapsed_usec(void)
+{
+    struct timeval t = benchmark_stop();
+    return (double)t.tv_sec * USEC_PER_SEC + t.tv_usec;
+}
+
+
+static ymo_server_t* server_start(
+        ymo_http_cb_t cb, void* data, int* port)
+{
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+    ymo_server_t* server = ymo_http_simple_init(loop, 0, cb, NULL, data);
+    if( !server
+        || getsockname(server->listen_fd, (struct sockaddr*)&addr, &addr_len)
+        || ymo_server_start(server, loop) ) {
+        return NULL;
+    }
+    *port = ntohs(addr.sin_port);
+    return server;
+}
+
+
+/* Length of a complete response at the front of buf (or 0): */
+static size_t response_len(const char* buf, size_t len)
+{
+    const char* end = memmem(buf, len, "\r\n\r\n", 4);
+    if( !end ) {
+        return 0;
+    }
+
+    const char* cl = memmem(buf, end - buf, "Content-Length: ", 16);
+    size_t head_len = (end - buf) + 4;
+    size_t total = head_len + (cl ? strtoul(cl + 16, NULL, 10) : 0);
+    return (total <= len) ? total : 0;
+}
+
+
+static void client_send(client_t* client)
+{
+    size_t len = strlen(request);
+    if( write(client->fd, request, len) != (ssize_t)len ) {
+        ev_break(loop, EVBREAK_ALL);
+    }
+    ++no_sent;
+}
+
+
+static void client_read_cb(struct ev_loop* loop, ev_io* w, int revents)
+{
+    client_t* client = w->data;
+    ssize_t n = read(client->fd, client->buf + client->len,
+            CLIENT_BUF_SIZE - client->len);
+    if( n <= 0 ) {
+        if( !n || !YMO_IS_BLOCKED(errno) ) {
+            fprintf(stderr, "Client connection closed early\n");
+            ev_break(loop, EVBREAK_ALL);
+        }
+        return;
+    }
+    client->len += n;
+
+    size_t r_len;
+    while( (r_len = response_len(client->buf, client->len)) ) {
+        memmove(client->buf, client->buf + r_len, client->len - r_len);
+        client->len -= r_len;
+        if( ++no_done == no_total ) {
+            ev_break(loop, EVBREAK_ALL);
+            return;
+        }
+        if( no_sent < no_total ) {
+            client_send(client);
+        }
+    }
+}
+
+
+/* Issue no_requests over no_clients connections; return usec elapsed: */
+static double run_clients(int port, size_t no_clients, size_t no_requests)
+{
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    no_sent = no_done = 0;
+    no_total = no_requests;
+    for( size_t i = 0; i < no_clients; i++ ) {
+        client_t* client = &clients[i];
+        int flag = 1;
+        client->len = 0;
+        client->fd = socket(AF_INET, SOCK_STREAM, 0);
+        if( client->fd < 0
+            || connect(client->fd, (struct sockaddr*)&addr, sizeof(addr)) ) {
+            perror("connect");
+            exit(1);
+        }
+        setsockopt(client->fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+        ymo_sock_nonblocking(client->fd);
+        ev_io_init(&client->w, &client_read_cb, client->fd, EV_READ);
+        client->w.data = client;
+        ev_io_start(loop, &client->w);
+    }
+
+    benchmark_start();
+    for( size_t i = 0; i < no_clients && no_sent < no_total; i++ ) {
+        client_send(&clients[i]);
+    }
+    ev_run(loop, 0);
+    double usec = elapsed_usec();
+
+    for( size_t i = 0; i < no_clients; i++ ) {
+        ev_io_stop(loop, &clients[i].w);
+        close(clients[i].fd);
+    }
+    if( no_done != no_total ) {
+        fprintf(stderr, "Only %zu of %zu requests completed\n",
+                no_done, no_total);
+        exit(1);
+    }
+    return usec;
+}
+
+
+static void print_sequential(const char* label, double usec, size_t n)
+{
+    printf("  %-34s%.1f usec/request\n", label, usec / n);
+}
+
+
+static void print_concurrent(const char* label, double usec, size_t n)
+{
+    printf("  %-34s%.0f requests/sec\n",
+            label, (n * (double)USEC_PER_SEC) / usec);
+}
+
+
+static void print_stats(ymo_http_proxy_t* proxy)
+{
+    ymo_http_proxy_stats_t stats;
+    ymo_http_proxy_stats(proxy, 0, &stats);
+    printf("    (upstream requests: %zu; connects: %zu; reused: %zu)\n",
+            stats.requests, stats.connects, stats.reused);
+}
+
+
+/*---------------------------------------------------------------*
+ * Benchmarks:
+ *---------------------------------------------------------------*/
+static int run_proxy(void)
+{
+    int upstream_port, pooled_port, unpooled_port;
+    double usec;
+
+    memset(body, 'x', sizeof(body));
+    ymo_assert(server_start(
+                &upstream_cb, NULL, &upstream_port) != NULL);
+
+    pooled = ymo_http_proxy_create(loop);
+    unpooled = ymo_http_proxy_create(loop);
+    ymo_assert(pooled != NULL && unpooled != NULL);
+    ymo_assert(ymo_http_proxy_add_upstream(
+                pooled, "127.0.0.1", upstream_port, NO_CLIENTS) == YMO_OKAY);
+    ymo_assert(ymo_http_proxy_add_upstream(
+                unpooled, "127.0.0.1", upstream_port, 0) == YMO_OKAY);
+    ymo_assert(server_start(
+                &pooled_cb, NULL, &pooled_port) != NULL);
+    ymo_assert(server_start(
+                &unpooled_cb, NULL, &unpooled_port) != NULL);
+
+    /* Latency, one request at a time: */
+    usec = run_clients(upstream_port, 1, NO_SEQUENTIAL);
+    print_sequential("sequential, direct:", usec, NO_SEQUENTIAL);
+    usec = run_clients(pooled_port, 1, NO_SEQUENTIAL);
+    print_sequential("sequential, proxied:", usec, NO_SEQUENTIAL);
+    print_stats(pooled);
+    usec = run_clients(unpooled_port, 1, NO_UNPOOLED);
+    print_sequential("sequential, proxied (no pool):", usec, NO_UNPOOLED);
+    print_stats(unpooled);
+
+    /* Throughput, with NO_CLIENTS requests in flight: */
+    usec = run_clients(upstream_port, NO_CLIENTS, NO_CONCURRENT);
+    print_concurrent("concurrent, direct:", usec, NO_CONCURRENT);
+    usec = run_clients(pooled_port, NO_CLIENTS, NO_CONCURRENT);
+    print_concurrent("concurrent, proxied:", usec, NO_CONCURRENT);
+    print_stats(pooled);
+
+    ymo_http_proxy_free(pooled);
+    ymo_http_proxy_free(unpooled);
+    return 0;
+}
+
+
+int main(int argc, char** argv)
+{
+    puts("\n\n*** benchmark_http_proxy: ***");
+    ymo_log_set_level_by_name("WARNING");
+    printf("  %i byte responses; %i clients for concurrent runs\n",
+            BODY_SIZE, NO_CLIENTS);
+
+    loop = ev_loop_new(0);
+    ymo_assert(loop != NULL);
+
+    puts("\nResults:");
+    ymo_assert(!run_proxy());
+    return 0;
+}
@@ -0,0 +1,248 @@
+/*=============================================================================
+ * benchmarks/benchmark_http_query: Query string/form decoding benchmark.
+ *
+ * Copyright (c) 2014 Andrew Canaday
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *===========================================================================*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "core/ymo_assert.h"
+
+#include "yimmo.h"
+#include "ymo_log.h"
+#include "ymo_alloc.h"
+#include "ymo_blalloc.h"
+#include "ymo_http.h"
+#include "ymo_http_scan.h"
+
+#include "ymo_benchmark.h"
+
+/* Number of query strings parsed per test: */
+#define NO_ITERATIONS 1000000
+
+/* A typical search/listing query — mostly plain text, a few escapes: */
+static const char* query =
+    "q=how+to+decode+a+query+string+in+c&lang=en-US&page=3&per_page=50"
+    "&sort=relevance&filter=category%3Dbooks%2Cformat%3Dpaperback"
+    "&session=9f8e7d6c5b4a39281706f5e4d3c2b1a0&utm_source=newsletter"
+    "&utm_campaign=spring_sale_2024&redirect=https%3A%2F%2Fexample.com%2F";
+
+/* ...and one with long values (e.g. tokens), where vector scans pay off: */
+static const char* long_query =
+    "access_token=eyJhbGciOiJIUzI1NiIsInR5cCI6IkpXVCJ9.eyJzdWIiOiIxMjM0NTY3"
+    "ODkwIiwibmFtZSI6IkpvaG4gRG9lIiwiaWF0IjoxNTE2MjM5MDIyfQ.SflKxwRJSMeKKF2Q"
+    "T4fwpMeJf36POk6yJV_adQssw5c&state=af0ifjsldkjAf0ifjsldkjAf0ifjsldkj"
+    "&code=SplxlOBeZQQYbYS6WxSbIASplxlOBeZQQYbYS6WxSbIA&scope=openid";
+
+static size_t no_pairs;
+static size_t no_bytes;
+
+
+/*---------------------------------------------------------------*
+ * What we're replacing:
+ *---------------------------------------------------------------*/
+static int hand_hex(char c)
+{
+    if( c >= '0' && c <= '9' ) return c - '0';
+    if( c >= 'a' && c <= 'f' ) return c - 'a' + 10;
+    if( c >= 'A' && c <= 'F' ) return c - 'A' + 10;
+    return -1;
+}
+
+
+static char* hand_decode(const char* s)
+{
+    char* out = malloc(strlen(s) + 1);
+    char* o = out;
+    for( ; *s; s++ ) {
+        if( *s == '+' ) {
+            *o++ = ' ';
+        } else if( *s == '%' && hand_hex(s[1]) >= 0 && hand_hex(s[2]) >= 0 ) {
+            *o++ = (char)(hand_hex(s[1]) << 4 | hand_hex(s[2]));
+            s += 2;
+        } else {
+            *o++ = *s;
+        }
+    }
+    *o = '\0';
+    return out;
+}
+
+
+/* strdup + strtok_r + a malloc per key and value: */
+static void hand_parse(const char* q)
+{
+    char* copy = strdup(q);
+    char* save = NULL;
+    for( char* pair = strtok_r(copy, "&", &save); pair;
+            pair = strtok_r(NULL, "&", &save) ) {
+        char* eq = strchr(pair, '=');
+        if( eq ) {
+            *eq = '\0';
+        }
+        char* key = hand_decode(pair);
+        char* value = hand_decode(eq ? eq + 1 : "");
+        no_bytes += strlen(key) + strlen(value);
+        ++no_pairs;
+        free(key);
+        free(value);
+    }
+    free(copy);
+}
+
+
+/*---------------------------------------------------------------*
+ * Yimmo:
+ *---------------------------------------------------------------*/
+static void iter_parse(const char* q, ymo_blalloc_t* ws)
+{
+    ymo_http_query_iter_t iter;
+    const char* key;
+    const char* value;
+
+    ymo_http_query_iter_init(&iter, q);
+    while( ymo_http_query_next(&iter, ws, &key, &value) > 0 ) {
+        no_bytes += strlen(key) + strlen(value);
+        ++no_pairs;
+    }
+    ymo_blalloc_reset(ws);
+}
+
+
+static ymo_status_t form_cb(
+        void* data, const char* key, const char* value, size_t value_len)
+{
+    no_bytes += strlen(key) + value_len;
+    ++no_pairs;
+    return YMO_OKAY;
+}
+
+
+static void print_result(const char* name, struct timeval test_time)
+{
+    double usec = (double)test_time.tv_sec * USEC_PER_SEC
+        + test_time.tv_usec;
+    printf("  %-28s %lu.%06lu (%.1f ns/query)\n", name,
+            (long)test_time.tv_sec, (long)test_time.tv_usec,
+            (usec * 1000.0) / NO_ITERATIONS);
+}
+
+
+static void run_hand(void)
+{
+    struct timeval test_time;
+
+    no_pairs = 0;
+    benchmark_start();
+    for( size_t i = 0; i < NO_ITERATIONS; ++i ) {
+        hand_parse(query);
+    }
+    test_time = benchmark_stop();
+    ymo_assert(no_pairs == NO_ITERATIONS * 10);
+    print_result("strtok/malloc:", test_time);
+
+    benchmark_start();
+    for( size_t i = 0; i < NO_ITERATIONS; ++i ) {
+        hand_parse(long_query);
+    }
+    test_time = benchmark_stop();
+    print_result("strtok (long values):", test_time);
+}
+
+
+static void run_yimmo(const char* scanner, ymo_blalloc_t* ws)
+{
+    struct timeval test_time;
+    ymo_http_request_t request;
+    ymo_http_form_t form;
+    char form_buf[512];
+
+    ymo_assert(ymo_http_scan_select(scanner) == YMO_OKAY);
+    printf("\nResults (%s):\n", scanner);
+
+    no_pairs = 0;
+    benchmark_start();
+    for( size_t i = 0; i < NO_ITERATIONS; ++i ) {
+        iter_parse(query, ws);
+    }
+    test_time = benchmark_stop();
+    ymo_assert(no_pairs == NO_ITERATIONS * 10);
+    print_result("iterate (all pairs):", test_time);
+
+    benchmark_start();
+    for( size_t i = 0; i < NO_ITERATIONS; ++i ) {
+        iter_parse(long_query, ws);
+    }
+    test_time = benchmark_stop();
+    print_result("iterate (long values):", test_time);
+
+    memset(&request, 0, sizeof(request));
+    request.query = query;
+    request.ws = ws;
+    benchmark_start();
+    for( size_t i = 0; i < NO_ITERATIONS; ++i ) {
+        const char* page = ymo_http_request_query(&request, "page");
+        const char* filter = ymo_http_request_query(&request, "filter");
+        ymo_assert(page && filter);
+        no_bytes += strlen(page) + strlen(filter);
+        ymo_blalloc_reset(ws);
+    }
+    test_time = benchmark_stop();
+    print_result("lookup (2 params):", test_time);
+
+    /* Form bodies, arriving in 64 byte chunks: */
+    size_t len = strlen(query);
+    no_pairs = 0;
+    benchmark_start();
+    for( size_t i = 0; i < NO_ITERATIONS; ++i ) {
+        ymo_http_form_init(&form, form_buf, sizeof(form_buf), &form_cb, NULL);
+        for( size_t off = 0; off < len; off += 64 ) {
+            ymo_http_form_feed(
+                    &form, query + off, (len - off < 64) ? len - off : 64);
+        }
+        ymo_http_form_finish(&form);
+    }
+    test_time = benchmark_stop();
+    ymo_assert(no_pairs == NO_ITERATIONS * 10);
+    print_result("form (64B chunks):", test_time);
+}
+
+
+int main(int argc, char** argv)
+{
+    const ymo_http_scanner_t* scanner;
+
+    puts("\n\n*** benchmark_http_query: ***");
+    ymo_log_set_level_by_name("WARNING");
+    printf("  Number of iterations: %i\n", NO_ITERATIONS);
+    printf("  Query length: %zu (10 pairs)\n", strlen(query));
+
+    ymo_blalloc_t* ws = ymo_blalloc_create(4096);
+    ymo_assert(ws != NULL);
+
+    puts("\nResults (hand-written):");
+    run_hand();
+
+    for( size_t idx = 0; (scanner = ymo_http_scan_impl(idx)); idx++ ) {
+        run_yimmo(scanner->name, ws);
+    }
+
+    ymo_assert(ymo_http_scan_select(NULL) == YMO_OKAY);
+    ymo_blalloc_free(ws);
+    return 0;
+}
@@ -0,0 +1,210 @@
+/*=============================================================================
+ * benchmarks/benchmark_http_response: HTTP response serialization benchmark.
+ *
+ * Copyright (c) 2014 Andrew Canaday
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *===========================================================================*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "core/ymo_assert.h"
+
+#include "yimmo.h"
+#include "ymo_log.h"
+#include "core/ymo_bucket.h"
+#include "ymo_http.h"
+#include "ymo_http_response.h"
+
+#include "ymo_benchmark.h"
+
+#define NO_ITERATIONS 1000000
+
+/* Response header sets, as a handler might set them (name, value pairs): */
+static const char* minimal_hdrs[] = {
+    "Content-Type", "text/plain",
+    NULL,
+};
+
+static const char* typical_hdrs[] = {
+    "Server", "yimmo",
+    "Date", "Tue, 17 Oct 2023 12:00:00 GMT",
+    "Content-Type", "text/html; charset=UTF-8",
+    "Cache-Control", "private, max-age=0",
+    "Vary", "Accept-Encoding",
+    "X-Request-Id", "5b0c1f3e-9a8d-4c2b-8e7f-6a5d4c3b2a19",
+    "Set-Cookie", "session=3f2b9c1e7a4d4e8f9b0a1c2d3e4f5a6b; Path=/; HttpOnly",
+    "Set-Cookie", "theme=dark; Path=/; Max-Age=31536000",
+    NULL,
+};
+
+static const char* large_hdrs[] = {
+    "Server", "yimmo",
+    "Date", "Tue, 17 Oct 2023 12:00:00 GMT",
+    "Content-Type", "application/json",
+    "Content-Security-Policy",
+        "default-src 'self'; script-src 'self' https://cdn.example.com "
+        "https://analytics.example.com; style-src 'self' 'unsafe-inline' "
+        "https://fonts.googleapis.com; img-src 'self' data: https:; "
+        "font-src 'self' https://fonts.gstatic.com; connect-src 'self' "
+        "https://api.example.com wss://ws.example.com; frame-ancestors 'none'",
+    "Strict-Transport-Security", "max-age=63072000; includeSubDomains; preload",
+    "Permissions-Policy",
+        "accelerometer=(), camera=(), geolocation=(), gyroscope=(), "
+        "magnetometer=(), microphone=(), payment=(), usb=()",
+    "Link",
+        "</static/app.3f2b9c1e.css>; rel=preload; as=style, "
+        "</static/app.7a4d4e8f.js>; rel=preload; as=script, "
+        "</static/font.9b0a1c2d.woff2>; rel=preload; as=font; crossorigin",
+    "Set-Cookie", "session=3f2b9c1e7a4d4e8f9b0a1c2d3e4f5a6b; Path=/; Secure; HttpOnly; SameSite=Lax",
+    "Set-Cookie", "csrf=0a1c2d3e4f5a6b3f2b9c1e7a4d4e8f9b; Path=/; Secure; SameSite=Strict",
+    "Set-Cookie", "theme=dark; Path=/; Max-Age=31536000",
+    NULL,
+};
+
+static const struct {
+    const char*        name;
+    ymo_http_status_t  status;
+    const char**       hdrs;
+    const char*        body;
+} corpora[] = {
+    { "minimal", YMO_HTTP_OK,        minimal_hdrs, "OK" },
+    { "typical", YMO_HTTP_OK,        typical_hdrs,
+        "<!DOCTYPE html><html><head><title>OK</title></head>"
+        "<body><p>Everything is fine.</p></body></html>" },
+    { "large",   YMO_HTTP_NOT_FOUND, large_hdrs,
+        "{\"error\":{\"code\":404,\"message\":\"Not Found\","
+        "\"detail\":\"No route matches the requested path.\"}}" },
+};
+
+#define NO_CORPORA (sizeof(corpora)/sizeof(corpora[0]))
+
+
+/* Build a complete response, as a handler would, and serialize it: */
+static size_t serialize_response(
+        ymo_http_response_t* response,
+        ymo_http_status_t status,
+        const char** hdrs,
+        const char* body)
+{
+    size_t len;
+    ymo_http_hdr_table_clear(&response->headers);
+    response->content_len = 0;
+    for( ; *hdrs; hdrs += 2 ) {
+        ymo_http_hdr_table_add(&response->headers, hdrs[0], hdrs[1]);
+    }
+    ymo_http_response_set_status(response, status);
+    ymo_http_response_body_append(
+            response, YMO_BUCKET_FROM_REF(body, strlen(body)));
+    response->flags = YMO_HTTP_FLAG_VERSION_1_1
+        | YMO_HTTP_FLAG_REQUEST_KEEPALIVE | YMO_HTTP_RESPONSE_COMPLETE;
+
+    ymo_bucket_t* head = ymo_http_response_start(NULL, response, NULL);
+    ymo_assert(head != NULL);
+    ymo_bucket_append(head, ymo_http_response_body_get(NULL, response));
+    len = ymo_bucket_len_all(head);
+    ymo_bucket_free_all(head);
+    return len;
+}
+
+
+/* Send the same response, pre-serialized: */
+static size_t serialize_canned(
+        ymo_http_response_t* response, const ymo_http_canned_t* canned)
+{
+    size_t len;
+    response->canned = canned;
+    response->flags = YMO_HTTP_FLAG_VERSION_1_1
+        | YMO_HTTP_FLAG_REQUEST_KEEPALIVE | YMO_HTTP_RESPONSE_COMPLETE;
+
+    ymo_bucket_t* head = ymo_http_response_start(NULL, response, NULL);
+    ymo_assert(head != NULL);
+    len = ymo_bucket_len_all(head);
+    ymo_bucket_free_all(head);
+    return len;
+}
+
+
+static void print_result(
+        const char* name, size_t len, struct timeval test_time)
+{
+    double usec = (double)test_time.tv_sec * USEC_PER_SEC
+        + test_time.tv_usec;
+    printf("  %-8s (%4zu bytes): %lu.%06lu (%.1f ns/response)\n",
+            name, len,
+            (long)test_time.tv_sec, (long)test_time.tv_usec,
+            (usec * 1000.0) / NO_ITERATIONS);
+}
+
+
+int main(int argc, char** argv)
+{
+    puts("\n\n*** benchmark_http_response: ***");
+    struct timeval test_time;
+    size_t i, c;
+    ymo_http_response_t* response = ymo_http_response_create(NULL);
+    ymo_assert(response != NULL);
+
+    ymo_log_set_level_by_name("WARNING");
+    printf("  Number of iterations: %i\n", NO_ITERATIONS);
+
+    puts("\nResults (normal):");
+    for( c = 0; c < NO_CORPORA; c++ )
+    {
+        size_t len = 0;
+
+        benchmark_start();
+        for( i = 0; i < NO_ITERATIONS; ++i )
+        {
+            len = serialize_response(response,
+                    corpora[c].status, corpora[c].hdrs, corpora[c].body);
+        }
+        test_time = benchmark_stop();
+        print_result(corpora[c].name, len, test_time);
+    }
+
+    puts("\nResults (canned):");
+    for( c = 0; c < NO_CORPORA; c++ )
+    {
+        size_t len = 0;
+        const char** hdr;
+        ymo_http_hdr_table_t* hdrs = ymo_http_hdr_table_create();
+        ymo_assert(hdrs != NULL);
+        for( hdr = corpora[c].hdrs; *hdr; hdr += 2 ) {
+            ymo_http_hdr_table_add(hdrs, hdr[0], hdr[1]);
+        }
+        ymo_http_canned_t* canned = ymo_http_canned_create(
+                corpora[c].status, hdrs,
+                corpora[c].body, strlen(corpora[c].body));
+        ymo_assert(canned != NULL);
+        ymo_http_hdr_table_free(hdrs);
+
+        benchmark_start();
+        for( i = 0; i < NO_ITERATIONS; ++i )
+        {
+            len = serialize_canned(response, canned);
+        }
+        test_time = benchmark_stop();
+        print_result(corpora[c].name, len, test_time);
+
+        response->canned = NULL;
+        ymo_http_canned_free(canned);
+    }
+
+    ymo_http_response_free(response);
+    return 0;
+}
+
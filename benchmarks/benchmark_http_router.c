@@ -0,0 +1,197 @@
+/*=============================================================================
+ * benchmarks/benchmark_http_router: URL router benchmark.
+ *
+ * Copyright (c) 2014 Andrew Canaday
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *===========================================================================*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "core/ymo_assert.h"
+
+#include "yimmo.h"
+#include "ymo_log.h"
+#include "ymo_alloc.h"
+#include "ymo_blalloc.h"
+#include "ymo_http.h"
+#include "ymo_http_session.h"
+#include "ymo_http_router.h"
+
+#include "ymo_benchmark.h"
+
+/* Number of lookups per test: */
+#define NO_ITERATIONS 1000000
+
+/* Number of resources; each gets a static route (GET, POST) and a :param
+ * route (GET, PUT):
+ */
+#define NO_RESOURCES 512
+
+#define PATH_MAX_LEN 64
+
+static char static_paths[NO_RESOURCES][PATH_MAX_LEN];
+static char param_paths[NO_RESOURCES][PATH_MAX_LEN];
+
+static size_t no_matched;
+
+
+static ymo_status_t route_cb(
+        ymo_http_session_t* session,
+        ymo_http_request_t* request,
+        ymo_http_response_t* response,
+        void* user)
+{
+    ++no_matched;
+    return YMO_OKAY;
+}
+
+
+/* What we're replacing: a strncmp chain in a single http_cb: */
+static int strcmp_chain(const char* uri)
+{
+    char prefix[PATH_MAX_LEN];
+    for( int i = 0; i < NO_RESOURCES; i++ ) {
+        if( !strcmp(uri, static_paths[i]) ) {
+            return i;
+        }
+    }
+    for( int i = 0; i < NO_RESOURCES; i++ ) {
+        size_t len = snprintf(prefix, sizeof(prefix), "%s/", static_paths[i]);
+        if( !strncmp(uri, prefix, len) && !strchr(uri + len, '/') ) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+
+static void print_result(const char* name, struct timeval test_time)
+{
+    double usec = (double)test_time.tv_sec * USEC_PER_SEC
+        + test_time.tv_usec;
+    printf("  %-28s %lu.%06lu (%.1f ns/lookup)\n", name,
+            (long)test_time.tv_sec, (long)test_time.tv_usec,
+            (usec * 1000.0) / NO_ITERATIONS);
+}
+
+
+static void run(
+        const char* name,
+        ymo_http_router_t* router,
+        ymo_http_session_t* session,
+        ymo_http_request_t* request,
+        char paths[][PATH_MAX_LEN])
+{
+    struct timeval test_time;
+    size_t i;
+
+    no_matched = 0;
+    benchmark_start();
+    for( i = 0; i < NO_ITERATIONS; ++i )
+    {
+        request->uri = paths[(i * 7919) % NO_RESOURCES];
+        ymo_http_router_dispatch(router, NULL, session, request, NULL);
+        ymo_blalloc_reset(request->ws);
+        request->params = NULL;
+        request->no_params = 0;
+    }
+    test_time = benchmark_stop();
+    ymo_assert(no_matched == NO_ITERATIONS);
+    print_result(name, test_time);
+}
+
+
+static void run_chain(const char* name, char paths[][PATH_MAX_LEN])
+{
+    struct timeval test_time;
+    size_t i;
+
+    benchmark_start();
+    for( i = 0; i < NO_ITERATIONS / 10; ++i )
+    {
+        ymo_assert(strcmp_chain(paths[(i * 7919) % NO_RESOURCES]) >= 0);
+    }
+    test_time = benchmark_stop();
+
+    /* Scale to NO_ITERATIONS: */
+    double usec = ((double)test_time.tv_sec * USEC_PER_SEC
+        + test_time.tv_usec) * 10.0;
+    test_time.tv_sec = usec / USEC_PER_SEC;
+    test_time.tv_usec = (long)usec % USEC_PER_SEC;
+    print_result(name, test_time);
+}
+
+
+int main(int argc, char** argv)
+{
+    char pattern[PATH_MAX_LEN];
+    static const char* kinds[] = {
+        "users", "orders", "products", "accounts", "invoices", "teams",
+        "projects", "reports",
+    };
+
+    puts("\n\n*** benchmark_http_router: ***");
+    ymo_log_set_level_by_name("WARNING");
+
+    ymo_http_router_t* router = ymo_http_router_create();
+    ymo_assert(router != NULL);
+    for( int i = 0; i < NO_RESOURCES; i++ )
+    {
+        snprintf(static_paths[i], PATH_MAX_LEN, "/api/v%i/%s/%i/items",
+                i % 4, kinds[i % 8], i);
+        /* Static paths are well under 40 chars; bounding them lets the
+         * suffixed paths fit PATH_MAX_LEN: */
+        snprintf(param_paths[i], PATH_MAX_LEN, "%.40s/item-%i",
+                static_paths[i], i * 31);
+        snprintf(pattern, sizeof(pattern), "%.40s/:item", static_paths[i]);
+        ymo_assert(ymo_http_router_add(router, YMO_HTTP_ROUTE_GET,
+                    static_paths[i], &route_cb) == YMO_OKAY);
+        ymo_assert(ymo_http_router_add(router, YMO_HTTP_ROUTE_POST,
+                    static_paths[i], &route_cb) == YMO_OKAY);
+        ymo_assert(ymo_http_router_add(router,
+                    YMO_HTTP_ROUTE_GET, pattern, &route_cb) == YMO_OKAY);
+        ymo_assert(ymo_http_router_add(router,
+                    YMO_HTTP_ROUTE_PUT, pattern, &route_cb) == YMO_OKAY);
+    }
+    ymo_assert(ymo_http_router_compile(router) == YMO_OKAY);
+
+    printf("  Number of iterations: %i\n", NO_ITERATIONS);
+    printf("  Number of routes: %zu\n", router->no_routes);
+    printf("  Compiled nodes: %zu (%zu bytes)\n", router->no_nodes,
+            router->no_nodes * sizeof(ymo_http_route_node_t));
+
+    ymo_http_session_t* session = YMO_NEW0(ymo_http_session_t);
+    ymo_http_request_t request;
+    memset(&request, 0, sizeof(request));
+    request.method = "GET";
+    request.ws = ymo_blalloc_create(4096);
+    ymo_assert(session != NULL && request.ws != NULL);
+
+    puts("\nResults (router):");
+    run("static:", router, session, &request, static_paths);
+    run("param:", router, session, &request, param_paths);
+
+    puts("\nResults (strcmp chain):");
+    run_chain("static:", static_paths);
+    run_chain("param:", param_paths);
+
+    ymo_blalloc_free(request.ws);
+    YMO_DELETE(ymo_http_session_t, session);
+    ymo_http_router_free(router);
+    return 0;
+}
+
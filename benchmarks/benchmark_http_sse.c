@@ -0,0 +1,317 @@
+/*=============================================================================
+ * benchmarks/benchmark_http_sse: Server-Sent Events fanout.
+ *
+ * Copyright (c) 2014 Andrew Canaday
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *===========================================================================*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include "core/ymo_test_proto.h"
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif /* __GLIBC__ */
+
+#include "yimmo.h"
+#include "ymo_log.h"
+#include "ymo_http.h"
+#include "ymo_proto_http.h"
+#include "ymo_http_sse.h"
+
+#include "ymo_benchmark.h"
+
+/* Subscribers: */
+#define NO_SUBS 100000
+
+/* Events published per round: */
+#define NO_EVENTS 4
+
+/* Connections per socket pair (libev keeps a list of watchers per fd): */
+#define CONNS_PER_WIRE 1000
+#define NO_WIRES ((NO_SUBS + CONNS_PER_WIRE - 1) / CONNS_PER_WIRE)
+
+static const char* request =
+    "GET /events HTTP/1.1\r\n"
+    "Host: www.example.com\r\n"
+    "Accept: text/event-stream\r\n"
+    "\r\n";
+
+static const char* event_data =
+    "{\"symbol\":\"YMO\",\"price\":101.25,\"volume\":1200,"
+    "\"ts\":\"2014-01-01T00:00:00Z\"}";
+
+static ymo_test_server_t* test_server = NULL;
+static ymo_http_sse_hub_t* hub = NULL;
+static ymo_http_sse_channel_t* channel = NULL;
+static ymo_http_response_t* responses[NO_SUBS];
+static size_t no_responses = 0;
+
+/* Connections share socket pairs; they take turns with them: */
+static ymo_test_conn_t* wires[NO_WIRES];
+
+#define WIRE(i) (wires[(i) / CONNS_PER_WIRE])
+
+
+static ymo_status_t http_cb(
+        ymo_http_session_t* session,
+        ymo_http_request_t* request,
+        ymo_http_response_t* response,
+        void* user)
+{
+    responses[no_responses++] = response;
+    return ymo_http_sse_subscribe(channel, request, response);
+}
+
+
+/*---------------------------------------------------------------*
+ * Helpers:
+ *---------------------------------------------------------------*/
+
+/* Bytes currently allocated from the heap (0 if we can't tell): */
+static size_t heap_in_use(void)
+{
+#if defined(__GLIBC__) \
+    && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+    return mallinfo2().uordblks;
+#else
+    return 0;
+#endif /* __GLIBC__ >= 2.33 */
+}
+
+
+static double elapsed_usec(void)
+{
+    struct timeval t = benchmark_stop();
+    return (double)t.tv_sec * USEC_PER_SEC + t.tv_usec;
+}
+
+
+static int conn_send(ymo_conn_t* conn, const char* data, size_t len)
+{
+    while( len ) {
+        ssize_t n = ymo_proto_http_read(
+                test_server->proto_data, conn, conn->proto_data,
+                (char*)data, len);
+        ymo_assert(n > 0);
+        data += n;
+        len -= n;
+    }
+    return 0;
+}
+
+
+/* The alternative: format and copy the event for each subscriber: */
+static void publish_copies(uint64_t id, const char* data)
+{
+    char event[256];
+    for( size_t i = 0; i < NO_SUBS; i++ ) {
+        int len = snprintf(event, sizeof(event),
+                "id: %" PRIu64 "\nevent: tick\ndata: %s\n\n", id, data);
+        ymo_http_response_body_append(
+                responses[i], YMO_BUCKET_FROM_CPY(event, len));
+    }
+}
+
+
+/* Write everything queued on each connection; return the bytes sent: */
+static size_t flush_all(ymo_conn_t** conns)
+{
+    static char junk[65536];
+    size_t total = 0;
+    ssize_t n;
+
+    for( size_t i = 0; i < NO_SUBS; i++ ) {
+        ymo_status_t status;
+        do {
+            status = ymo_proto_http_write(
+                    test_server->proto_data, conns[i], conns[i]->proto_data,
+                    WIRE(i)->fd_send);
+        } while( status == YMO_WOULDBLOCK );
+
+        while( (n = read(WIRE(i)->fd_read, junk, sizeof(junk))) > 0 ) {
+            total += n;
+        }
+    }
+    return total;
+}
+
+
+static ymo_conn_t** open_conns(void)
+{
+    ymo_conn_t** conns = calloc(NO_SUBS, sizeof(ymo_conn_t*));
+    if( !conns ) {
+        return NULL;
+    }
+
+    for( size_t i = 0; i < NO_SUBS; i++ ) {
+        conns[i] = ymo_conn_create(
+                test_server->server, test_server->proto, WIRE(i)->fd_send,
+                test_server->server->config.loop, ymo_read_cb, ymo_write_cb);
+        if( !conns[i] ) {
+            return NULL;
+        }
+        conns[i]->proto_data = ymo_proto_http_conn_init(
+                test_server->proto_data, conns[i]);
+        if( !conns[i]->proto_data ) {
+            return NULL;
+        }
+    }
+    return conns;
+}
+
+
+static void close_conns(ymo_conn_t** conns)
+{
+    for( size_t i = 0; i < NO_SUBS; i++ ) {
+        ymo_proto_http_conn_cleanup(
+                test_server->proto_data, conns[i], conns[i]->proto_data);
+        ymo_conn_free(conns[i]);
+    }
+    free(conns);
+}
+
+
+/*---------------------------------------------------------------*
+ * Benchmarks:
+ *---------------------------------------------------------------*/
+static int run_fanout(void)
+{
+    size_t r_len = strlen(request);
+    size_t d_len = strlen(event_data);
+    double usec;
+
+    ymo_conn_t** conns = open_conns();
+    ymo_assert(conns != NULL);
+
+    /* Subscribe: */
+    benchmark_start();
+    for( size_t i = 0; i < NO_SUBS; i++ ) {
+        ymo_assert(!conn_send(conns[i], request, r_len));
+    }
+    usec = elapsed_usec();
+    ymo_assert(ymo_http_sse_channel_subscribers(channel) == NO_SUBS);
+    flush_all(conns);
+    printf("\n  subscribe:                        %.1f ns/subscriber\n",
+            (usec * 1000.0) / NO_SUBS);
+
+    /* Publish (queue on every response): */
+    size_t heap_before = heap_in_use();
+    benchmark_start();
+    for( size_t e = 0; e < NO_EVENTS; e++ ) {
+        ymo_assert(ymo_http_sse_publish(
+                    channel, "tick", event_data, d_len) == YMO_OKAY);
+    }
+    usec = elapsed_usec();
+    size_t heap_after = heap_in_use();
+    printf("  publish (shared):                 %.2f ms/event "
+            "(%.1f ns/subscriber)\n",
+            usec / (1000.0 * NO_EVENTS),
+            (usec * 1000.0) / (NO_SUBS * NO_EVENTS));
+    if( heap_before || heap_after ) {
+        printf("  heap per subscriber per event:    %zu bytes "
+                "(encoded once: %zu bytes)\n",
+                (heap_after - heap_before) / (NO_SUBS * NO_EVENTS),
+                channel->ring[(channel->ring_head + channel->ring_len - 1)
+                    % channel->ring_max]->len);
+    }
+    flush_all(conns);
+
+    heap_before = heap_in_use();
+    benchmark_start();
+    for( size_t e = 0; e < NO_EVENTS; e++ ) {
+        publish_copies(e + 1, event_data);
+    }
+    usec = elapsed_usec();
+    heap_after = heap_in_use();
+    printf("  publish (copied):                 %.2f ms/event "
+            "(%.1f ns/subscriber)\n",
+            usec / (1000.0 * NO_EVENTS),
+            (usec * 1000.0) / (NO_SUBS * NO_EVENTS));
+    if( heap_before || heap_after ) {
+        printf("  heap per subscriber per event:    %zu bytes\n",
+                (heap_after - heap_before) / (NO_SUBS * NO_EVENTS));
+    }
+
+    /* Send: */
+    benchmark_start();
+    size_t sent = flush_all(conns);
+    usec = elapsed_usec();
+    printf("  write:                            %.1f ns/subscriber "
+            "(%zu bytes each)\n",
+            (usec * 1000.0) / NO_SUBS, sent / NO_SUBS);
+
+    /* Keep-alive ticks, with everyone busy (no-op) and idle (all): */
+    ymo_http_sse_hub_tick(hub);
+    benchmark_start();
+    size_t no_busy = ymo_http_sse_hub_tick(hub);
+    double busy_usec = elapsed_usec();
+    ymo_assert(no_busy == NO_SUBS);
+    flush_all(conns);
+
+    ymo_assert(ymo_http_sse_publish(
+                channel, "tick", event_data, d_len) == YMO_OKAY);
+    benchmark_start();
+    size_t no_idle = ymo_http_sse_hub_tick(hub);
+    usec = elapsed_usec();
+    ymo_assert(no_idle == 0);
+    printf("  keep-alive tick, all idle:        %.2f ms "
+            "(%zu comments)\n", busy_usec / 1000.0, no_busy);
+    printf("  keep-alive tick, none idle:       %.3f ms\n", usec / 1000.0);
+
+    close_conns(conns);
+    ymo_assert(ymo_http_sse_channel_subscribers(channel) == 0);
+    return 0;
+}
+
+
+int main(int argc, char** argv)
+{
+    puts("\n\n*** benchmark_http_sse: ***");
+    ymo_log_set_level_by_name("WARNING");
+    printf("  %i subscribers; %i events of %zu bytes\n",
+            NO_SUBS, NO_EVENTS, strlen(event_data));
+
+    ymo_proto_t* proto = ymo_proto_http_create(
+            NULL, &http_cb, NULL, NULL, NULL, NULL, 0);
+    test_server = test_server_create(proto);
+    ymo_assert(test_server != NULL);
+    for( size_t w = 0; w < NO_WIRES; w++ ) {
+        wires[w] = test_conn_create(test_server);
+        ymo_assert(wires[w] != NULL);
+    }
+
+    hub = ymo_http_sse_hub_create(NULL, 0);
+    ymo_assert(hub != NULL);
+    channel = ymo_http_sse_channel_create(hub, 64);
+    ymo_assert(channel != NULL);
+
+    puts("\nResults:");
+    ymo_assert(!run_fanout());
+
+    ymo_http_sse_hub_free(hub);
+    for( size_t w = 0; w < NO_WIRES; w++ ) {
+        test_conn_free(wires[w]);
+        YMO_FREE(wires[w]);
+    }
+    ymo_proto_http_cleanup(test_server->proto, test_server->server);
+    ymo_server_free(test_server->server);
+    YMO_FREE(test_server);
+    return 0;
+}
@@ -0,0 +1,277 @@
+/*=============================================================================
+ * benchmarks/benchmark_relay: Socket relaying, copied vs spliced.
+ *
+ * Copyright (c) 2014 Andrew Canaday
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *===========================================================================*/
+
+#include <errno.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <signal.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include "core/ymo_assert.h"
+
+#include "yimmo.h"
+#include "ymo_log.h"
+#include "ymo_util.h"
+#include "core/ymo_net.h"
+
+#include "ymo_benchmark.h"
+
+/* Bytes relayed per run, and read (or spliced) at a time: */
+#define RELAY_BYTES (1024UL * 1024 * 1024)
+#define CHUNK_SIZE  (64 * 1024)
+
+typedef enum relay_mode {
+    RELAY_COPY,     /* recv, copy into a bucket, sendmsg */
+    RELAY_REF,      /* recv, reference the buffer, sendmsg */
+    RELAY_SPLICE,   /* splice into a pipe, and out of it */
+} relay_mode_t;
+
+static char chunk[CHUNK_SIZE];
+
+
+/*---------------------------------------------------------------*
+ * Helpers:
+ *---------------------------------------------------------------*/
+
+/* Connected pair of loopback TCP sockets: */
+static int tcp_pair(int fds[2])
+{
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if( listen_fd < 0
+        || bind(listen_fd, (struct sockaddr*)&addr, sizeof(addr))
+        || listen(listen_fd, 1)
+        || getsockname(listen_fd, (struct sockaddr*)&addr, &addr_len) ) {
+        return -1;
+    }
+
+    fds[0] = socket(AF_INET, SOCK_STREAM, 0);
+    if( fds[0] < 0
+        || connect(fds[0], (struct sockaddr*)&addr, sizeof(addr)) ) {
+        return -1;
+    }
+    fds[1] = accept(listen_fd, NULL, NULL);
+    close(listen_fd);
+    return (fds[1] < 0) ? -1 : 0;
+}
+
+
+static void wait_for(int fd, short events)
+{
+    struct pollfd p_fd = { .fd = fd, .events = events };
+    while( poll(&p_fd, 1, -1) < 0 && errno == EINTR );
+}
+
+
+/* Producer: write RELAY_BYTES to fd and exit: */
+static void produce(int fd)
+{
+    size_t sent = 0;
+    while( sent < RELAY_BYTES ) {
+        ssize_t n = write(fd, chunk, YMO_MIN(CHUNK_SIZE, RELAY_BYTES - sent));
+        if( n < 0 ) {
+            _exit(1);
+        }
+        sent += n;
+    }
+    _exit(0);
+}
+
+
+/* Consumer: read fd to EOF and exit: */
+static void consume(int fd)
+{
+    static char buf[CHUNK_SIZE];
+    size_t received = 0;
+    ssize_t n;
+    while( (n = read(fd, buf, sizeof(buf))) > 0 ) {
+        received += n;
+    }
+    _exit(received == RELAY_BYTES ? 0 : 1);
+}
+
+
+/* Send whatever's pending, waiting for the socket as needed: */
+static int relay_flush(int fd, ymo_bucket_t** pending)
+{
+    while( *pending ) {
+        ymo_status_t status = ymo_net_send_buckets(fd, pending);
+        if( status != YMO_OKAY ) {
+            if( !YMO_IS_BLOCKED(status) ) {
+                return -1;
+            }
+            wait_for(fd, POLLOUT);
+        }
+    }
+    return 0;
+}
+
+
+/* Relay in_fd to out_fd until EOF; returns bytes relayed: */
+static size_t relay(relay_mode_t mode, int in_fd, int out_fd)
+{
+    static char buf[CHUNK_SIZE];
+    ymo_pipe_t* pipe = NULL;
+    ymo_bucket_t* pending = NULL;
+    size_t total = 0;
+    ssize_t n;
+
+    if( mode == RELAY_SPLICE && !(pipe = ymo_pipe_create(CHUNK_SIZE)) ) {
+        return 0;
+    }
+
+    for( ;; ) {
+        if( mode == RELAY_SPLICE ) {
+            n = ymo_pipe_fill(pipe, in_fd, CHUNK_SIZE);
+        } else {
+            n = recv(in_fd, buf, sizeof(buf), 0);
+        }
+
+        if( n < 0 ) {
+            if( !YMO_IS_BLOCKED(errno) ) {
+                break;
+            }
+            wait_for(in_fd, POLLIN);
+            continue;
+        }
+        if( !n ) {
+            break;
+        }
+
+        switch( mode ) {
+            case RELAY_COPY:
+                pending = YMO_BUCKET_FROM_CPY(buf, n);
+                break;
+            case RELAY_REF:
+                pending = YMO_BUCKET_FROM_REF(buf, n);
+                break;
+            case RELAY_SPLICE:
+                pending = ymo_bucket_create_pipe(NULL, NULL, pipe, n);
+                break;
+        }
+        if( relay_flush(out_fd, &pending) ) {
+            break;
+        }
+        total += n;
+    }
+
+    ymo_bucket_free_all(pending);
+    ymo_pipe_free(pipe);
+    return total;
+}
+
+
+static double tv_usec(struct timeval tv)
+{
+    return (double)tv.tv_sec * USEC_PER_SEC + tv.tv_usec;
+}
+
+
+/*---------------------------------------------------------------*
+ * Benchmarks:
+ *---------------------------------------------------------------*/
+static int run_relay(const char* label, relay_mode_t mode)
+{
+    int in_fds[2], out_fds[2];
+    struct rusage r_start, r_stop;
+
+    ymo_assert(!tcp_pair(in_fds));
+    ymo_assert(!tcp_pair(out_fds));
+
+    /* (Each side only keeps its own socket, so EOFs get through.) */
+    pid_t producer = fork();
+    if( !producer ) {
+        close(in_fds[1]);
+        close(out_fds[0]);
+        close(out_fds[1]);
+        produce(in_fds[0]);
+    }
+    pid_t consumer = fork();
+    if( !consumer ) {
+        close(in_fds[0]);
+        close(in_fds[1]);
+        close(out_fds[0]);
+        consume(out_fds[1]);
+    }
+    close(in_fds[0]);
+    close(out_fds[1]);
+    ymo_sock_nonblocking(in_fds[1]);
+    ymo_sock_nonblocking(out_fds[0]);
+
+    /* Only the relay (this process) counts towards CPU time: */
+    getrusage(RUSAGE_SELF, &r_start);
+    benchmark_start();
+    size_t total = relay(mode, in_fds[1], out_fds[0]);
+    struct timeval elapsed = benchmark_stop();
+    getrusage(RUSAGE_SELF, &r_stop);
+    close(in_fds[1]);
+    close(out_fds[0]);
+
+    int p_status, c_status;
+    waitpid(producer, &p_status, 0);
+    waitpid(consumer, &c_status, 0);
+    ymo_assert(total == RELAY_BYTES);
+    ymo_assert(WIFEXITED(p_status) && !WEXITSTATUS(p_status));
+    ymo_assert(WIFEXITED(c_status) && !WEXITSTATUS(c_status));
+
+    double wall = tv_usec(elapsed);
+    double user = tv_usec(r_stop.ru_utime) - tv_usec(r_start.ru_utime);
+    double sys = tv_usec(r_stop.ru_stime) - tv_usec(r_start.ru_stime);
+    double mb = (double)RELAY_BYTES / (1024 * 1024);
+    printf("  %-10s%8.0f MB/sec; CPU: %5.1f%% (%.0f user, %.0f sys usec/MB)\n",
+            label, mb * USEC_PER_SEC / wall, 100.0 * (user + sys) / wall,
+            user / mb, sys / mb);
+    return 0;
+}
+
+
+int main(int argc, char** argv)
+{
+    puts("\n\n*** benchmark_relay: ***");
+    ymo_log_set_level_by_name("WARNING");
+    signal(SIGPIPE, SIG_IGN);
+    memset(chunk, 'x', sizeof(chunk));
+    printf("  %lu MB over loopback TCP, %i KB at a time\n",
+            RELAY_BYTES / (1024 * 1024), CHUNK_SIZE / 1024);
+
+    puts("\nResults:");
+    ymo_assert(!run_relay("copy:", RELAY_COPY));
+    ymo_assert(!run_relay("ref:", RELAY_REF));
+
+    ymo_pipe_t* pipe = ymo_pipe_create(0);
+    if( pipe ) {
+        ymo_pipe_free(pipe);
+        ymo_assert(!run_relay("splice:", RELAY_SPLICE));
+    } else {
+        printf("  %-10s(unavailable: %s)\n", "splice:", strerror(errno));
+    }
+    return 0;
+}
@@ -20,6 +20,7 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include "core/ymo_assert.h"
 
 #include "yimmo.h"
@@ -84,8 +85,10 @@ int main(int argc, char** argv)
         printf("  total headers in bytes: %zu\n", hdr_bytes);
         printf("  ymo_oitrie size in bytes: %zu\n", ymo_oitrie_sizeof(oitrie));
         printf("  hdr_table size in bytes: %zu\n", sizeof(ymo_http_hdr_table_t) +
-                ((NO_HEADERS-YMO_HDR_TABLE_POOL_SIZE)
-                 * sizeof(ymo_http_hdr_table_node_t)));
+                ((table->items != table->inline_items)
+                 ? table->capacity * (sizeof(ymo_http_hdr_table_node_t)
+                     + 2 * sizeof(ymo_http_hdr_slot_t))
+                 : 0));
         puts("\nResults:");
         printf("%s", "  ymo_oitrie...");
         benchmark_start();
@@ -100,6 +103,36 @@ int main(int argc, char** argv)
                 (long)test_time.tv_sec, (long)test_time.tv_usec, hdr_id);
     }
 
+    /*--------- STD HEADER IDS: ------------*/
+    {
+        ymo_http_hdr_id_t hdr_id = 0;
+        printf("%s", "  ymo_http_hdr_std_id...");
+        benchmark_start();
+        for( i = 0; i < NO_ITERATIONS; ++i )
+        {
+            hdr = HEADERS[rand() % NO_HEADERS];
+            hdr_id = ymo_http_hdr_std_id(hdr, strlen(hdr));
+        }
+        test_time = benchmark_stop();
+        printf("%lu.%06lu (last id: %i)\n",
+                (long)test_time.tv_sec, (long)test_time.tv_usec, (int)hdr_id);
+    }
+
+    /*--------- HASH (UNVERIFIED): ---------*/
+    {
+        ymo_http_hdr_id_t hdr_id = 0;
+        printf("%s", "  header name hash...");
+        benchmark_start();
+        for( i = 0; i < NO_ITERATIONS; ++i )
+        {
+            hdr = HEADERS[rand() % NO_HEADERS];
+            hdr_id = YMO_HDR_HASH_FN(hdr, NULL);
+        }
+        test_time = benchmark_stop();
+        printf("%lu.%06lu (last id: %i)\n",
+                (long)test_time.tv_sec, (long)test_time.tv_usec, (int)hdr_id);
+    }
+
     /*------------- HDR TABLE: ------------*/
     {
         const char* val;
@@ -40,6 +40,7 @@ AC_DEFUN([YMO_CHECK_FEATURES],[
     AC_CHECK_HEADERS([stdarg.h stdbool.h stddef.h])
     AC_CHECK_HEADERS([sys/socket.h sys/time.h])
     AC_CHECK_HEADERS([netinet/in.h])
+    AC_CHECK_HEADERS([immintrin.h arm_neon.h])
 
 
     ##-----------------------------
@@ -105,6 +106,19 @@ AC_DEFUN([YMO_CHECK_FEATURES],[
     AX_GCC_FUNC_ATTRIBUTE([weakref])
     AX_GCC_FUNC_ATTRIBUTE([fallthrough])
 
+    # Used for runtime SIMD dispatch (x86):
+    AC_CACHE_CHECK([for __builtin_cpu_supports],
+        [ymo_cv_builtin_cpu_supports],[
+        AC_LINK_IFELSE([AC_LANG_PROGRAM([[]],
+                [[return __builtin_cpu_supports("avx2");]])],
+            [ymo_cv_builtin_cpu_supports=yes],
+            [ymo_cv_builtin_cpu_supports=no])
+    ])
+    AS_IF([test "x$ymo_cv_builtin_cpu_supports" = "xyes"],[
+        AC_DEFINE([HAVE_BUILTIN_CPU_SUPPORTS],[1],
+            [Define to 1 if the compiler provides __builtin_cpu_supports])
+    ])
+
 
     ##-----------------------------
     ##       Function Checks:
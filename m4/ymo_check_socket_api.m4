@@ -97,11 +97,24 @@ AC_DEFUN([YMO_CHECK_SOCKET_API],
   ])
 
   # Sendfile support
+  AC_CHECK_HEADERS([sys/sendfile.h])
   AC_CHECK_DECLS([sendfile],[],[],
           [
           #include <sys/types.h>
           #include <sys/socket.h>
           #include <sys/uio.h>
+          #ifdef HAVE_SYS_SENDFILE_H
+          #include <sys/sendfile.h>
+          #endif
+          ])
+
+  # Splice support (zero-copy socket relaying through a pipe):
+  AC_CHECK_DECLS([splice],[],[],
+          [
+          #ifndef _GNU_SOURCE
+          #define _GNU_SOURCE
+          #endif
+          #include <fcntl.h>
           ])
 
   ## (This is probably way-overkill):
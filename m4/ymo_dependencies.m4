@@ -78,5 +78,31 @@ AC_DEFUN([YMO_CHECK_DEPENDENCIES],[
             YMO_ERROR([libyaml is required for build!])
         ])
     ])
+
+
+    ##-----------------------------
+    ##    Optional Libraries:
+    ##-----------------------------
+    YMO_BOX([Checking for optional libraries])
+
+    ## HTTP response compression (any or all of these):
+    PKG_CHECK_MODULES([ZLIB], [zlib], [
+        AC_DEFINE([HAVE_ZLIB],[1],[Build gzip/deflate response compression])
+        YMO_ENABLED([gzip/deflate compression])
+    ],[
+        YMO_DISABLED([gzip/deflate compression])
+    ])
+    PKG_CHECK_MODULES([BROTLI], [libbrotlienc], [
+        AC_DEFINE([HAVE_BROTLI],[1],[Build brotli response compression])
+        YMO_ENABLED([brotli compression])
+    ],[
+        YMO_DISABLED([brotli compression])
+    ])
+    PKG_CHECK_MODULES([ZSTD], [libzstd], [
+        AC_DEFINE([HAVE_ZSTD],[1],[Build zstd response compression])
+        YMO_ENABLED([zstd compression])
+    ],[
+        YMO_DISABLED([zstd compression])
+    ])
 ])
 
@@ -27,24 +27,82 @@
 #include <assert.h>
 #include <stdio.h>
 #include <fcntl.h>
+#include <errno.h>
+#include <sys/stat.h>
 
 #include "yimmo.h"
 #include "ymo_log.h"
 #include "ymo_bucket.h"
 #include "ymo_alloc.h"
 
-#if YMO_BUCKET_FROM_FILE == YM_BUCKET_MMAP
+#if YMO_BUCKET_FROM_FILE == YMO_BUCKET_MMAP
 #include <sys/mman.h>
 #endif /* ymo_bucket_from_file mmap */
 
 
+/*---------------------------------------------------------------*
+ * Bucket Cache:
+ *---------------------------------------------------------------*/
+#if YMO_BUCKET_CACHE_SIZE > 0
+/* Every response is at least a bucket or two, so freed buckets are kept on
+ * a per-thread free list (buckets are freed on the loop thread, but may be
+ * created on others, e.g. by WSGI workers):
+ */
+static _Thread_local ymo_bucket_t* bucket_cache = NULL;
+static _Thread_local size_t bucket_cache_len = 0;
+#endif /* YMO_BUCKET_CACHE_SIZE */
+
+
+static inline ymo_bucket_t* bucket_alloc(void)
+{
+#if YMO_BUCKET_CACHE_SIZE > 0
+    ymo_bucket_t* bucket = bucket_cache;
+    if( bucket ) {
+        bucket_cache = bucket->next;
+        bucket_cache_len--;
+        return bucket;
+    }
+#endif /* YMO_BUCKET_CACHE_SIZE */
+    return YMO_NEW(ymo_bucket_t);
+}
+
 
+static inline void bucket_release(ymo_bucket_t* bucket)
+{
+#if YMO_BUCKET_CACHE_SIZE > 0
+    if( bucket_cache_len < YMO_BUCKET_CACHE_SIZE ) {
+        bucket->next = bucket_cache;
+        bucket_cache = bucket;
+        bucket_cache_len++;
+        return;
+    }
+#endif /* YMO_BUCKET_CACHE_SIZE */
+    YMO_DELETE(ymo_bucket_t, bucket);
+}
+
+
+void ymo_bucket_cache_clear(void)
+{
+#if YMO_BUCKET_CACHE_SIZE > 0
+    while( bucket_cache ) {
+        ymo_bucket_t* next = bucket_cache->next;
+        YMO_DELETE(ymo_bucket_t, bucket_cache);
+        bucket_cache = next;
+    }
+    bucket_cache_len = 0;
+#endif /* YMO_BUCKET_CACHE_SIZE */
+}
+
+
+/*---------------------------------------------------------------*
+ * Buckets:
+ *---------------------------------------------------------------*/
 ymo_bucket_t* ymo_bucket_create(
         ymo_bucket_t* restrict prev, ymo_bucket_t* restrict next,
         char* buf, size_t buf_len,
         const char* data, size_t len)
 {
-    ymo_bucket_t* bucket = YMO_NEW(ymo_bucket_t);
+    ymo_bucket_t* bucket = bucket_alloc();
     if( bucket ) {
         bucket->buf = buf;
         bucket->buf_len = buf_len;
@@ -53,9 +111,8 @@ ymo_bucket_t* ymo_bucket_create(
         bucket->bytes_sent = 0;
         bucket->next = (prev && prev->next) ? prev->next : next;
         bucket->cleanup_cb = NULL;
-#if YMO_BUCKET_FROM_FILE == YMO_BUCKET_SENDFILE
         bucket->fd = -1;
-#endif /* YMO_BUCKET_SENDFILE */
+        bucket->offset = 0;
 
         if( prev ) {
             prev->next = bucket;
@@ -69,7 +126,7 @@ ymo_bucket_t* ymo_bucket_create_cpy(
         ymo_bucket_t* restrict prev, ymo_bucket_t* restrict next,
         const char* buf, size_t buf_len)
 {
-    ymo_bucket_t* bucket = YMO_NEW(ymo_bucket_t);
+    ymo_bucket_t* bucket = bucket_alloc();
     if( bucket ) {
         if( buf && buf_len ) {
             bucket->buf = YMO_ALLOC(buf_len);
@@ -84,9 +141,8 @@ ymo_bucket_t* ymo_bucket_create_cpy(
         bucket->bytes_sent = 0;
         bucket->next = (prev && prev->next) ? prev->next : next;
         bucket->cleanup_cb = NULL;
-#if YMO_BUCKET_FROM_FILE == YMO_BUCKET_SENDFILE
         bucket->fd = -1;
-#endif /* YMO_BUCKET_SENDFILE */
+        bucket->offset = 0;
 
         if( prev ) {
             prev->next = bucket;
@@ -96,6 +152,33 @@ ymo_bucket_t* ymo_bucket_create_cpy(
 }
 
 
+ymo_bucket_t* ymo_bucket_create_file(
+        ymo_bucket_t* restrict prev, ymo_bucket_t* restrict next,
+        int fd, off_t offset, size_t len, ymo_bucket_free_fn cleanup_cb)
+{
+    ymo_bucket_t* bucket = ymo_bucket_create(
+            prev, next, NULL, 0, NULL, len);
+    if( bucket ) {
+        bucket->fd = fd;
+        bucket->offset = offset;
+        bucket->cleanup_cb = cleanup_cb;
+    }
+    return bucket;
+}
+
+
+void ymo_bucket_close_fd(ymo_bucket_t* bucket)
+{
+    if( bucket->fd >= 0 ) {
+        if( close(bucket->fd) ) {
+            ymo_log_warning("Failed to close file: %s", strerror(errno));
+        }
+        bucket->fd = -1;
+    }
+    return;
+}
+
+
 #if YMO_BUCKET_FROM_FILE == YMO_BUCKET_FSTREAM
 /* TODO: this should use flags + sendfile, where available */
 ymo_bucket_t* ymo_bucket_from_file(
@@ -143,7 +226,7 @@ ymo_bucket_t* ymo_bucket_from_file(
 static void bucket_unmap(ymo_bucket_t* bucket)
 {
     ymo_log_debug("Freeing mmap'd bucket: %p", (void*)bucket);
-    int rc = munmap(bucket->data, bucket->len+1);
+    int rc = munmap((void*)bucket->data, bucket->len);
 
     if( rc < 0 ) {
         ymo_log_error("Error unmapping bucket: %s", strerror(errno));
@@ -199,9 +282,10 @@ ymo_bucket_t* ymo_bucket_from_file(
     if( f_mem != MAP_FAILED ) {
         ymo_log_debug("Created map of size %zu at %p from file %s",
                 (size_t)f_info.st_size, f_mem, filepath);
+        close(fd);
         f_bucket->data = f_mem;
-        f_bucket->len = f_info.st_size-1;
-        f_bucket->dealloc = &bucket_unmap;
+        f_bucket->len = f_info.st_size;
+        f_bucket->cleanup_cb = &bucket_unmap;
         return f_bucket;
     } else {
         f_err = errno;
@@ -211,6 +295,9 @@ ymo_bucket_t* ymo_bucket_from_file(
 
 
 bucket_file_fail:
+    if( fd >= 0 ) {
+        close(fd);
+    }
     YMO_DELETE(ymo_bucket_t, f_bucket);
     return YMO_ERROR_PTR(f_err);
 }
@@ -219,52 +306,36 @@ bucket_file_fail:
 #endif /* YMO_BUCKET_FROM_FILE mmap */
 
 #if YMO_BUCKET_FROM_FILE == YMO_BUCKET_SENDFILE
-static void ymo_bucket_close_fd(ymo_bucket_t* bucket)
-{
-    if( bucket->fd >= 0 ) {
-        int rc = 0;
-        if( (rc = close(bucket->fd)) ) {
-            ymo_log_warning("Failed to close file: %s", strerror(errno));
-        }
-        bucket->fd = -1;
-    }
-    return;
-}
-
-
 ymo_bucket_t* ymo_bucket_from_file(
         ymo_bucket_t* restrict prev, ymo_bucket_t* restrict next,
         const char* filepath)
 {
-    /* Create bucket: */
-    ymo_bucket_t* f_bucket = ymo_bucket_create(
-            NULL, NULL,
-            NULL, 0,
-            NULL, 0);
-
-    if( !f_bucket ) {
-        return YMO_ERROR_PTR(ENOMEM);
+    int f_err = 0;
+    int fd = open(filepath, O_RDONLY | O_CLOEXEC);
+    if( fd < 0 ) {
+        f_err = errno;
+        goto bucket_sendfile_fail;
     }
 
-    int f_err = 0;
-    f_bucket->fd = open(filepath, O_RDONLY | O_NONBLOCK);
-    if( f_bucket->fd >= 0 ) {
-        struct stat f_info;
-        if( fstat(f_bucket->fd, &f_info) < 0 ) {
-            f_err = errno;
-            goto bucket_sendfile_fail;
-        }
+    struct stat f_info;
+    if( fstat(fd, &f_info) < 0 ) {
+        f_err = errno;
+        close(fd);
+        goto bucket_sendfile_fail;
+    }
 
-        f_bucket->len = f_info.st_size;
-        f_bucket->cleanup_cb = &ymo_bucket_close_fd;
+    ymo_bucket_t* f_bucket = ymo_bucket_create_file(
+            prev, next, fd, 0, f_info.st_size, &ymo_bucket_close_fd);
+    if( f_bucket ) {
         return f_bucket;
     }
-    f_err = errno;
+
+    f_err = ENOMEM;
+    close(fd);
 
 bucket_sendfile_fail:
     ymo_log_error("Unable to send file \"%s\": %s",
             filepath, strerror(f_err));
-    YMO_DELETE(ymo_bucket_t, f_bucket);
     return YMO_ERROR_PTR(f_err);
 }
 
@@ -326,7 +397,7 @@ void ymo_bucket_free(ymo_bucket_t* bucket)
     }
 
     YMO_FREE(bucket->buf);
-    YMO_DELETE(ymo_bucket_t, bucket);
+    bucket_release(bucket);
     return;
 }
 
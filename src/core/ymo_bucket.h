@@ -32,10 +32,11 @@
 #define YMO_BUCKET_FSTREAM   0  /* TODO: switch to unbuffered IO */
 #define YMO_BUCKET_MMAP      1
 #define YMO_BUCKET_SENDFILE  2
-#define YMO_BUCKET_FROM_FILE YMO_BUCKET_FSTREAM
+#define YMO_BUCKET_FROM_FILE YMO_BUCKET_SENDFILE
 
 #include "yimmo_config.h"
 #include <stddef.h>
+#include <sys/types.h>
 #include "yimmo.h"
 
 
@@ -50,9 +51,8 @@ struct ymo_bucket {
     char*               buf;        /* Optional pointer to managed memory */
     size_t              buf_len;    /* Length of the managed memory */
     size_t              bytes_sent; /* Total number of bytes sent */
-#if YMO_BUCKET_FROM_FILE == YMO_BUCKET_SENDFILE
-    int                 fd;         /* TODO: HAVE_DECL_SENDFILE? */
-#endif /* YMO_BUCKET_SENDFILE */
+    int                 fd;         /* File to send from, or -1 */
+    off_t               offset;     /* File offset (or YMO_PIPE_OFFSET) */
     ymo_bucket_t*       next;       /* Next bucket in the chain */
     ymo_bucket_free_fn  cleanup_cb; /* Cleanup callback */
 };
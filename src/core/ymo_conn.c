@@ -104,6 +104,9 @@ ymo_conn_t* ymo_conn_create(
         conn->user = NULL;
         conn->toq = NULL;
         conn->state = YMO_CONN_OPEN;
+#if YMO_ENABLE_TLS
+        conn->ssl = NULL;
+#endif /* YMO_ENABLE_TLS */
 
         bsat_timeout_init(&(conn->idle_timeout));
         conn->idle_timeout.data = conn;
@@ -27,11 +27,13 @@
 #include <string.h>
 #include <assert.h>
 
-#if HAVE_DECL_SENDFILE
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/uio.h>
-#endif /* HAVE_DECL_SENDFILE */
+
+#if HAVE_SYS_SENDFILE_H
+#include <sys/sendfile.h>
+#endif /* HAVE_SYS_SENDFILE_H */
 
 #if YMO_ENABLE_TLS
 #include <openssl/bio.h>
@@ -46,6 +48,7 @@
 #include "ymo_net.h"
 #include "ymo_conn.h"
 #include "ymo_alloc.h"
+#include "ymo_pipe.h"
 
 #define YMO_TRACE_NET 0
 #  if defined(YMO_TRACE_NET) && YMO_TRACE_NET == 1
@@ -54,11 +57,27 @@
 #  define YMO_NET_TRACE(fmt, ...)
 #endif /* YMO_TRACE_NET */
 
-
-#if YMO_BUCKET_FROM_FILE == YMO_BUCKET_SENDFILE
+/* Size of the buffer used to send file buckets, when they can't be sent
+ * using sendfile (i.e. over TLS or where sendfile is unavailable):
+ */
+#define YMO_NET_FILE_BUF_SIZE 16384
 
 static ymo_status_t ymo_net_bucket_sendfile(int fd, ymo_bucket_t** head_p);
-#endif /* YMO_BUCKET_FROM_FILE */
+
+
+#if !HAVE_SYS_SENDFILE_H || YMO_ENABLE_TLS
+/* Read up to len unsent bytes from a file bucket into buf: */
+static ssize_t ymo_net_file_read(
+        const ymo_bucket_t* f_bucket, char* buf, size_t len)
+{
+    off_t offset = f_bucket->offset + (off_t)f_bucket->bytes_sent;
+    ssize_t n;
+    do {
+        n = pread(f_bucket->fd, buf, len, offset);
+    } while( n < 0 && errno == EINTR );
+    return n;
+}
+#endif /* !HAVE_SYS_SENDFILE_H || YMO_ENABLE_TLS */
 
 
 ymo_status_t ymo_net_send_buckets(int fd, ymo_bucket_t** head_p)
@@ -71,14 +90,15 @@ do_send:
     i = 0;
     to_send = 0;
     current = *head_p;
-#if YMO_BUCKET_FROM_FILE == YMO_BUCKET_SENDFILE
-    /* HACK: for now, we just check the FIRST bucket in the chain for an
-     *       fd (see note below on how this works).
-     */
+
+    /* File buckets are sent on their own (see below): */
     if( current && current->fd >= 0 ) {
-        return ymo_net_bucket_sendfile(fd, head_p);
+        ymo_status_t status = ymo_net_bucket_sendfile(fd, head_p);
+        if( status != YMO_OKAY || !*head_p ) {
+            return status;
+        }
+        goto do_send;
     }
-#endif /* YMO_BUCKET_SENDFILE */
 
     struct msghdr out_msg;
     struct iovec out_vec[YMO_BUCKET_MAX_IOVEC];
@@ -89,18 +109,13 @@ do_send:
     /* Add all our buckets to the iovec: */
     while( current && i < YMO_BUCKET_MAX_IOVEC )
     {
-#if YMO_BUCKET_FROM_FILE == YMO_BUCKET_SENDFILE
-        /* HACK: *just for now*, we do sendmsg/sendfile separately (rather than
-         *       user headers/footers)...
-         *
-         *       So, we sendfile for the first bucket in a chain and break
-         *       on a bucket mid-chain (so it'll be first on next
-         *       invocation).
+        /* We sendmsg up to a file bucket and sendfile from there on the
+         * next pass (rather than using headers/trailers), so a file bucket
+         * mid-chain ends the gather:
          */
         if( current->fd >= 0 ) {
             break;
         }
-#endif /* YMO_BUCKET_SENDFILE */
 
         /* Skip empty buckets: */
         if( current->len ) {
@@ -115,6 +130,16 @@ do_send:
 
     out_msg.msg_iovlen = i;
 
+    /* Nothing but empty buckets ahead of a file bucket: */
+    if( !to_send && current ) {
+        while( *head_p != current ) {
+            ymo_bucket_t* empty = *head_p;
+            *head_p = empty->next;
+            ymo_bucket_free(empty);
+        }
+        goto do_send;
+    }
+
     /* Perform the send: */
     ssize_t bytes_sent = 0;
     if( to_send > 0 ) {
@@ -185,15 +210,40 @@ ymo_status_t ymo_net_send_buckets_tls(SSL* ssl, int fd, ymo_bucket_t** head)
     size_t bytes_sent = 0;
 
     do {
-        int send_rc = SSL_write_ex(ssl,
-                (const char*)(cur->data + cur->bytes_sent),
-                cur->len - cur->bytes_sent,
-                &bytes_sent);
+        const char* data = cur->data + cur->bytes_sent;
+        size_t len = cur->len - cur->bytes_sent;
+
+        /* File buckets are read into a buffer a piece at a time. SSL_write
+         * retries may see a different buffer address, but always the same
+         * data (see SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER in ymo_tls.c):
+         */
+        char f_buf[YMO_NET_FILE_BUF_SIZE];
+        if( cur->fd >= 0 ) {
+            /* (Pipe data can't be read again, should SSL_write retry.) */
+            if( YMO_BUCKET_IS_PIPE(cur) ) {
+                status = ENOTSUP;
+                break;
+            }
+
+            ssize_t n = ymo_net_file_read(
+                    cur, f_buf, YMO_MIN(len, sizeof(f_buf)));
+            if( n <= 0 ) {
+                status = (n < 0) ? errno : EIO;
+                break;
+            }
+            data = f_buf;
+            len = (size_t)n;
+        }
+
+        int send_rc = SSL_write_ex(ssl, data, len, &bytes_sent);
 
         if( send_rc > 0 ) {
             cur->bytes_sent += bytes_sent;
 
             if( cur->bytes_sent < cur->len ) {
+                if( cur->fd >= 0 ) {
+                    continue;
+                }
                 status = EAGAIN;
                 break;
             }
@@ -224,51 +274,56 @@ ymo_status_t ymo_net_send_buckets_tls(SSL* ssl, int fd, ymo_bucket_t** head)
 
 #endif /* YMO_ENABLE_TLS */
 
-#if YMO_BUCKET_FROM_FILE == YMO_BUCKET_SENDFILE
+/* Send the file (or pipe) bucket at the head of the chain, freeing it once
+ * sent:
+ */
 static ymo_status_t ymo_net_bucket_sendfile(int fd, ymo_bucket_t** head_p)
 {
     ymo_bucket_t* f_bucket = *head_p;
 
-    off_t len_remain = (f_bucket->len - f_bucket->bytes_sent);
-    off_t send_len = YMO_MIN(len_remain,YMO_NET_SENDFILE_MAX);
-    off_t len = send_len;
-    errno = 0;
-    int rc = sendfile(
-            f_bucket->fd, fd,
-            f_bucket->bytes_sent, &len,
-            NULL, 0);
-
-    if( rc == -1 ) {
-        int s_err = errno;
-        YMO_NET_TRACE("Failed to send fd %i to socket: %i (%s)",
-                f_bucket->fd, fd, strerror(s_err));
-        return s_err;
-    }
-
-    if( !len ) {
-        len = send_len;
-    }
+    while( f_bucket->bytes_sent < f_bucket->len ) {
+        size_t remain = f_bucket->len - f_bucket->bytes_sent;
+        ssize_t n;
 
-    if( len < len_remain ) {
-        YMO_NET_TRACE("Sent %zu bytes to %i", (size_t)len, fd);
-        f_bucket->bytes_sent += len;
-        return YMO_WOULDBLOCK;
-    }
+        if( YMO_BUCKET_IS_PIPE(f_bucket) ) {
+            n = ymo_pipe_send(f_bucket, fd, remain, f_bucket->next != NULL);
+        } else {
+#if HAVE_SYS_SENDFILE_H
+            off_t offset = f_bucket->offset + (off_t)f_bucket->bytes_sent;
+            n = sendfile(fd, f_bucket->fd, &offset, remain);
+#else
+            char f_buf[YMO_NET_FILE_BUF_SIZE];
+            n = ymo_net_file_read(
+                    f_bucket, f_buf, YMO_MIN(remain, sizeof(f_buf)));
+            if( n > 0 ) {
+                n = send(fd, f_buf, (size_t)n, YMO_SEND_FLAGS);
+            }
+#endif /* HAVE_SYS_SENDFILE_H */
+        }
 
-    YMO_NET_TRACE("Sent %zu bytes to %i. File sent!", (size_t)len, fd);
-    ymo_bucket_t* next = f_bucket->next;
-    ymo_bucket_free(f_bucket);
+        if( n < 0 ) {
+            if( errno == EINTR ) {
+                continue;
+            }
+            YMO_NET_TRACE("Failed to send fd %i to socket: %i (%s)",
+                    f_bucket->fd, fd, strerror(errno));
+            return errno;
+        }
 
-    *head_p = next;
+        /* The file is shorter than it was when the bucket was created: */
+        if( n == 0 ) {
+            ymo_log_warning("Unexpected EOF sending fd %i to socket %i",
+                    f_bucket->fd, fd);
+            return EIO;
+        }
 
-    if( next ) {
-        YMO_NET_TRACE("%i: %lu/%lu bytes remain in next bucket",
-                fd, (next->len - next->bytes_sent), next->len);
-        return YMO_WOULDBLOCK;
+        YMO_NET_TRACE("Sent %zu bytes from fd %i to %i",
+                (size_t)n, f_bucket->fd, fd);
+        f_bucket->bytes_sent += (size_t)n;
     }
+
+    *head_p = f_bucket->next;
+    ymo_bucket_free(f_bucket);
     return YMO_OKAY;
 }
 
-
-#endif /* YMO_BUCKET_SENDFILE */
-
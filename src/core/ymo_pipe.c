@@ -0,0 +1,195 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2014 Andrew Canaday
+ *
+ *  This file is part of libyimmo (sometimes referred to as "yimmo" or "ymo").
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *===========================================================================*/
+
+
+#define _GNU_SOURCE /* splice, pipe2, F_SETPIPE_SZ */
+#include "yimmo_config.h"
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+
+#include "yimmo.h"
+#include "ymo_util.h"
+#include "ymo_alloc.h"
+#include "ymo_net.h"
+#include "ymo_pipe.h"
+
+
+/*---------------------------------------------------------------*
+ * Pipes:
+ *---------------------------------------------------------------*/
+ymo_pipe_t* ymo_pipe_create(size_t size)
+{
+#if HAVE_DECL_SPLICE
+    int fds[2];
+    if( pipe2(fds, O_NONBLOCK | O_CLOEXEC) ) {
+        return NULL;
+    }
+
+    ymo_pipe_t* pipe = YMO_NEW(ymo_pipe_t);
+    if( !pipe ) {
+        close(fds[0]);
+        close(fds[1]);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    /* The kernel rounds the size up (and may refuse to go past
+     * /proc/sys/fs/pipe-max-size, in which case we keep the default):
+     */
+    int p_size = -1;
+#ifdef F_SETPIPE_SZ
+    if( size ) {
+        p_size = fcntl(fds[1], F_SETPIPE_SZ, (int)size);
+    }
+    if( p_size < 0 ) {
+        p_size = fcntl(fds[1], F_GETPIPE_SZ);
+    }
+#endif /* F_SETPIPE_SZ */
+
+    pipe->fd_r = fds[0];
+    pipe->fd_w = fds[1];
+    pipe->size = (p_size > 0) ? (size_t)p_size : YMO_PIPE_SIZE_DEFAULT;
+    pipe->len = 0;
+    pipe->refs = 1;
+    return pipe;
+#else
+    errno = ENOTSUP;
+    return NULL;
+#endif /* HAVE_DECL_SPLICE */
+}
+
+
+#if HAVE_DECL_SPLICE
+/* splice(2) says EAGAIN for an empty socket and a full pipe alike. Pipe
+ * capacity is counted in pages, too, so a pipe can fill up short of size:
+ */
+static int pipe_full(const ymo_pipe_t* pipe)
+{
+    struct pollfd p_fd = { .fd = pipe->fd_w, .events = POLLOUT };
+    return poll(&p_fd, 1, 0) == 0;
+}
+
+
+#endif /* HAVE_DECL_SPLICE */
+
+ssize_t ymo_pipe_fill(ymo_pipe_t* pipe, int fd, size_t len)
+{
+#if HAVE_DECL_SPLICE
+    if( pipe->len >= pipe->size ) {
+        errno = ENOBUFS;
+        return -1;
+    }
+
+    ssize_t n;
+    len = YMO_MIN(len, pipe->size - pipe->len);
+    do {
+        n = splice(fd, NULL, pipe->fd_w, NULL, len,
+                SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    } while( n < 0 && errno == EINTR );
+
+    if( n > 0 ) {
+        pipe->len += (size_t)n;
+    } else if( n < 0 && YMO_IS_BLOCKED(errno) && pipe_full(pipe) ) {
+        errno = ENOBUFS;
+    }
+    return n;
+#else
+    errno = ENOTSUP;
+    return -1;
+#endif /* HAVE_DECL_SPLICE */
+}
+
+
+ssize_t ymo_pipe_send(ymo_bucket_t* bucket, int fd, size_t len, int more)
+{
+#if HAVE_DECL_SPLICE
+    ymo_pipe_t* pipe = (ymo_pipe_t*)bucket->buf;
+    unsigned int flags = SPLICE_F_MOVE | SPLICE_F_NONBLOCK;
+    if( more ) {
+        flags |= SPLICE_F_MORE;
+    }
+
+    ssize_t n = splice(pipe->fd_r, NULL, fd, NULL, len, flags);
+    if( n > 0 ) {
+        pipe->len -= (size_t)n;
+    }
+    return n;
+#else
+    errno = ENOTSUP;
+    return -1;
+#endif /* HAVE_DECL_SPLICE */
+}
+
+
+size_t ymo_pipe_len(const ymo_pipe_t* pipe)
+{
+    return pipe->len;
+}
+
+
+int ymo_pipe_write_fd(const ymo_pipe_t* pipe)
+{
+    return pipe->fd_w;
+}
+
+
+void ymo_pipe_free(ymo_pipe_t* pipe)
+{
+    if( pipe && !--pipe->refs ) {
+        close(pipe->fd_r);
+        close(pipe->fd_w);
+        YMO_DELETE(ymo_pipe_t, pipe);
+    }
+}
+
+
+/*---------------------------------------------------------------*
+ * Pipe Buckets:
+ *---------------------------------------------------------------*/
+
+/* Pipe buckets keep a reference to their pipe in buf (cleared before the
+ * bucket is freed, so the pipe isn't):
+ */
+static void pipe_bucket_free(ymo_bucket_t* bucket)
+{
+    ymo_pipe_free((ymo_pipe_t*)bucket->buf);
+    bucket->buf = NULL;
+    bucket->fd = -1;
+}
+
+
+ymo_bucket_t* ymo_bucket_create_pipe(
+        ymo_bucket_t* restrict prev, ymo_bucket_t* restrict next,
+        ymo_pipe_t* pipe, size_t len)
+{
+    ymo_bucket_t* bucket = ymo_bucket_create_file(
+            prev, next, pipe->fd_r, YMO_PIPE_OFFSET, len, &pipe_bucket_free);
+    if( bucket ) {
+        bucket->buf = (char*)pipe;
+        pipe->refs++;
+    }
+    return bucket;
+}
+
+
@@ -0,0 +1,89 @@
+/*=============================================================================
+ * libyimmo: Lightweight socket server framework
+ *
+ * Copyright (c) 2014 Andrew Canaday
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *===========================================================================*/
+
+
+
+/** Pipes
+ * =======
+ *
+ * Internals for zero-copy relaying (see :c:func:`ymo_pipe_create`).
+ *
+ * A pipe bucket is a file bucket whose ``fd`` is the read end of a pipe and
+ * whose ``offset`` is :c:macro:`YMO_PIPE_OFFSET`. Its ``buf`` field holds a
+ * reference to the pipe (cleared before the bucket is freed).
+ */
+
+#ifndef YMO_PIPE_H
+#define YMO_PIPE_H
+
+#include "yimmo_config.h"
+#include <stddef.h>
+#include <sys/types.h>
+#include "yimmo.h"
+#include "ymo_bucket.h"
+
+
+/**---------------------------------------------------------------
+ * Definitions
+ *---------------------------------------------------------------*/
+
+/** Default pipe capacity. */
+#ifndef YMO_PIPE_SIZE_DEFAULT
+#define YMO_PIPE_SIZE_DEFAULT 65536
+#endif /* YMO_PIPE_SIZE_DEFAULT */
+
+/** File offset which marks a file bucket as a pipe bucket. */
+#define YMO_PIPE_OFFSET ((off_t)-1)
+
+/** True if the (file) bucket is a pipe bucket. */
+#define YMO_BUCKET_IS_PIPE(b) ((b)->offset == YMO_PIPE_OFFSET)
+
+
+/**---------------------------------------------------------------
+ * Data Structures
+ *---------------------------------------------------------------*/
+
+struct ymo_pipe {
+    int     fd_r;       /* Read end */
+    int     fd_w;       /* Write end */
+    size_t  size;       /* Capacity */
+    size_t  len;        /* Bytes in the pipe */
+    int     refs;
+};
+
+
+/**---------------------------------------------------------------
+ * Functions
+ *---------------------------------------------------------------*/
+
+/** Move up to ``len`` bytes from the pipe bucket at ``bucket`` to the
+ * socket, ``fd``.
+ *
+ * :param bucket: a pipe bucket
+ * :param fd: socket to send to
+ * :param len: most bytes to send
+ * :param more: nonzero if more data follows (i.e. ``SPLICE_F_MORE``)
+ * :returns: bytes sent, or -1 with errno set
+ */
+ssize_t ymo_pipe_send(ymo_bucket_t* bucket, int fd, size_t len, int more);
+
+#endif /* YMO_PIPE_H */
+
+
@@ -132,7 +132,7 @@ ymo_status_t ymo_server_init(ymo_server_t* server)
     listen_addr.sin_addr.s_addr = INADDR_ANY;
 
     /* Configure SSL, if enabled: */
-    if( server->config.cert_path && server->config.key_path ) {
+    if( YMO_TLS_CONFIGURED(&server->config) ) {
         ymo_log_notice("TLS enabled: ✅");
         if( (status = ymo_init_ssl_ctx(server)) ) {
             ymo_log_fatal("SSL context initialization failed.");
@@ -226,6 +226,84 @@ ymo_status_t ymo_server_pre_fork(ymo_server_t* server)
 }
 
 
+ymo_status_t ymo_server_add_alpn(
+        ymo_server_t* server,
+        const char* alpn_id,
+        ymo_proto_t* proto)
+{
+#if YMO_ENABLE_TLS
+    size_t id_len = alpn_id ? strlen(alpn_id) : 0;
+    if( !proto || !id_len || id_len > 255 ) {
+        return EINVAL;
+    }
+
+    /* The ALPN map is baked into the SSL context at init: */
+    if( server->state != YMO_SERVER_CREATED ) {
+        return EBUSY;
+    }
+
+    if( server->no_alpn >= YMO_TLS_ALPN_MAX ) {
+        return ENOBUFS;
+    }
+
+    /* Secondary protocols are initialized once, when first mapped: */
+    int proto_init = (proto != server->proto);
+    for( size_t i = 0; i < server->no_alpn; i++ )
+    {
+        if( server->alpn[i].proto == proto ) {
+            proto_init = 0;
+        }
+    }
+
+    if( proto_init ) {
+        ymo_status_t proto_status = proto->vtable.init_cb(proto, server);
+        if( proto_status != YMO_OKAY ) {
+            return proto_status;
+        }
+    }
+
+    ymo_tls_alpn_t* alpn = &server->alpn[server->no_alpn++];
+    memcpy(alpn->id, alpn_id, id_len);
+    alpn->id_len = (unsigned char)id_len;
+    alpn->proto = proto;
+    ymo_log_info("%s:%i ALPN \"%s\" → %s",
+            server->proto->name, server->config.port, alpn_id, proto->name);
+    return YMO_OKAY;
+#else
+    return ENOTSUP;
+#endif /* YMO_ENABLE_TLS */
+}
+
+
+ymo_status_t ymo_server_tls_reload(ymo_server_t* server)
+{
+#if YMO_ENABLE_TLS
+    if( !YMO_TLS_CONFIGURED(&server->config) ) {
+        return EINVAL;
+    }
+
+    /* Reload threads are only ever started (and joined) on the loop: */
+    if( server->state == YMO_SERVER_STARTED
+        || server->state == YMO_SERVER_STOP_GRACEFUL ) {
+        ev_async_send(server->config.loop, &server->w_tls_request);
+        return YMO_OKAY;
+    }
+
+    /* No loop to hand off to yet; just rebuild in place: */
+    SSL_CTX* ctx = ymo_tls_ctx_create(server);
+    if( !ctx ) {
+        return errno;
+    }
+
+    SSL_CTX_free(server->ssl_ctx);
+    server->ssl_ctx = ctx;
+    return YMO_OKAY;
+#else
+    return ENOTSUP;
+#endif /* YMO_ENABLE_TLS */
+}
+
+
 ymo_status_t ymo_server_start(ymo_server_t* server, struct ev_loop* loop)
 {
     ymo_log_info("%s:%i server starting...",
@@ -259,6 +337,15 @@ ymo_status_t ymo_server_start(ymo_server_t* server, struct ev_loop* loop)
 
     ev_io_start(server->config.loop, &server->w_accept);
 
+#if YMO_ENABLE_TLS
+    if( server->ssl_ctx ) {
+        ymo_status_t tls_status = ymo_tls_reload_start(server);
+        if( tls_status ) {
+            return tls_status;
+        }
+    }
+#endif /* YMO_ENABLE_TLS */
+
     ymo_log_info("%s:%i accept cb start OK...",
             server->proto->name, server->config.port);
 
@@ -329,10 +416,29 @@ void ymo_server_free(ymo_server_t* server)
     }
 
 #if YMO_ENABLE_TLS
+    /* Clean up any secondary protocols initialized for ALPN: */
+    for( size_t i = 0; i < server->no_alpn; i++ )
+    {
+        ymo_proto_t* proto = server->alpn[i].proto;
+        int proto_cleanup = (proto != server->proto);
+        for( size_t j = 0; j < i; j++ )
+        {
+            if( server->alpn[j].proto == proto ) {
+                proto_cleanup = 0;
+            }
+        }
+
+        if( proto_cleanup && proto->vtable.cleanup_cb ) {
+            proto->vtable.cleanup_cb(proto, server);
+        }
+    }
+
+    ymo_tls_reload_stop(server);
     if( server->ssl_ctx ) {
         SSL_CTX_free(server->ssl_ctx);
     }
 #endif /* YMO_ENABLE_TLS */
+    ymo_bucket_cache_clear();
     ymo_log_notice("%i: freeing server object", my_pid);
     YMO_DELETE(ymo_server_t, server);
 }
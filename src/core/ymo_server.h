@@ -59,6 +59,7 @@
 #include <bsat.h>
 
 #if YMO_ENABLE_TLS
+#include <stdatomic.h>
 #include <openssl/ssl.h>
 #endif /* YMO_ENABLE_TLS */
 
@@ -70,6 +71,21 @@
  *  Types
  *---------------------------------------------------------------*/
 
+#ifndef YMO_TLS_ALPN_MAX
+/** Maximum number of ALPN identifiers which may be mapped to protocols. */
+#  define YMO_TLS_ALPN_MAX 4
+#endif /* YMO_TLS_ALPN_MAX */
+
+/** ALPN identifier → protocol mapping (see :c:func:`ymo_server_add_alpn`). */
+typedef struct ymo_tls_alpn {
+    unsigned char        id[256];  /* ALPN protocol identifier */
+    unsigned char        id_len;   /* Length of id (ALPN ids are 1-255 bytes) */
+    ymo_proto_t*         proto;    /* Protocol used when id is negotiated */
+} ymo_tls_alpn_t;
+
+/** Maximum number of TLS files watched for changes (certs, keys, OCSP). */
+#define YMO_TLS_WATCH_MAX 6
+
 /** Internal structure used to manage a yimmo server. */
 struct ymo_server {
     struct ev_io         w_accept;                           /* EV IO watcher for events on accept socket */
@@ -83,6 +99,18 @@ struct ymo_server {
     size_t               no_conn;
 #if YMO_ENABLE_TLS
     SSL_CTX*             ssl_ctx;        /* Optional SSL context */
+    ymo_tls_alpn_t       alpn[YMO_TLS_ALPN_MAX]; /* ALPN → protocol map */
+    size_t               no_alpn;        /* Number of alpn entries in use */
+    _Atomic(SSL_CTX*)    ssl_ctx_next;   /* New context built by the reload thread */
+    atomic_int           tls_reload;     /* Reload thread state */
+    pthread_t            tls_reload_thread;
+    int                  tls_reload_joinable;
+    ev_async             w_tls_swap;     /* Swaps in ssl_ctx_next on the loop */
+    ev_async             w_tls_request;  /* Reload requests from other threads */
+    ev_signal            w_tls_signal;   /* Optional reload signal watcher */
+    ev_timer             w_tls_delay;    /* Debounces file change notifications */
+    ev_stat              w_tls_stat[YMO_TLS_WATCH_MAX]; /* File watchers */
+    size_t               no_tls_stat;
 #endif /* YMO_ENABLE_TLS */
     pthread_mutex_t*     accept_mutex;
 };
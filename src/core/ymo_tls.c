@@ -0,0 +1,669 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2014 Andrew Canaday
+ *
+ *  This file is part of libyimmo (sometimes referred to as "yimmo" or "ymo").
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *===========================================================================*/
+
+#include "yimmo_config.h"
+
+#if YMO_ENABLE_TLS
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+#include <openssl/ocsp.h>
+
+#include "yimmo.h"
+#include "ymo_alloc.h"
+#include "ymo_log.h"
+#include "ymo_server.h"
+#include "ymo_conn.h"
+#include "ymo_net.h"
+#include "ymo_tls.h"
+
+/*---------------------------------------------------------------*
+ *  Types:
+ *---------------------------------------------------------------*/
+
+/* OCSP response to be stapled for a single certificate: */
+typedef struct ymo_tls_staple {
+    X509*           cert; /* Certificate the response is for (owned by ctx) */
+    unsigned char*  der;  /* DER-encoded OCSP response */
+    size_t          len;  /* Length of der */
+} ymo_tls_staple_t;
+
+/* Per-SSL_CTX data. Freed via ex_data when the context is freed: */
+typedef struct ymo_tls_ctx_data {
+    ymo_tls_staple_t  staple[2]; /* One per cert type (ECDSA, RSA) */
+    size_t            no_staple;
+} ymo_tls_ctx_data_t;
+
+
+/* Reload thread states (ymo_server_t.tls_reload): */
+#define YMO_TLS_RELOAD_IDLE  0 /* No rebuild in progress */
+#define YMO_TLS_RELOAD_BUSY  1 /* Rebuild in progress */
+#define YMO_TLS_RELOAD_AGAIN 2 /* Rebuild in progress; run again after */
+
+#ifndef YMO_TLS_WATCH_DELAY
+/** Seconds to wait after the last file change before reloading (cert and
+ * key files are rarely replaced at exactly the same time).
+ */
+#  define YMO_TLS_WATCH_DELAY 1.0
+#endif /* YMO_TLS_WATCH_DELAY */
+
+
+/*---------------------------------------------------------------*
+ *  Prototypes:
+ *---------------------------------------------------------------*/
+static void ymo_tls_ctx_index_init(void);
+static void ymo_tls_ctx_data_free(
+        void* parent, void* ptr, CRYPTO_EX_DATA* ad,
+        int idx, long argl, void* argp);
+static ymo_status_t ymo_tls_ctx_use_pair(
+        SSL_CTX* ctx, const char* cert_path, const char* key_path,
+        X509** cert_out);
+static ymo_status_t ymo_tls_ctx_add_staple(
+        ymo_tls_ctx_data_t* ctx_data, X509* cert, const char* ocsp_path);
+static int ymo_tls_ocsp_cb(SSL* ssl, void* arg);
+static int ymo_tls_alpn_select_cb(
+        SSL* ssl,
+        const unsigned char** out, unsigned char* outlen,
+        const unsigned char* in, unsigned int inlen,
+        void* arg);
+
+static void* ymo_tls_reload_thread(void* data);
+static void ymo_tls_swap_cb(struct ev_loop* loop, ev_async* w, int revents);
+static void ymo_tls_request_cb(struct ev_loop* loop, ev_async* w, int revents);
+static void ymo_tls_signal_cb(struct ev_loop* loop, ev_signal* w, int revents);
+static void ymo_tls_stat_cb(struct ev_loop* loop, ev_stat* w, int revents);
+static void ymo_tls_delay_cb(struct ev_loop* loop, ev_timer* w, int revents);
+
+static pthread_once_t ymo_tls_once = PTHREAD_ONCE_INIT;
+static int ymo_tls_ctx_idx = -1;
+
+
+/*---------------------------------------------------------------*
+ *  Yimmo Server TLS Functions:
+ *---------------------------------------------------------------*/
+SSL_CTX* ymo_tls_ctx_create(ymo_server_t* server)
+{
+    const ymo_server_config_t* config = &server->config;
+    ymo_status_t status = EINVAL;
+    X509* cert = NULL;
+
+    pthread_once(&ymo_tls_once, &ymo_tls_ctx_index_init);
+    if( ymo_tls_ctx_idx < 0 ) {
+        return YMO_ERROR_PTR(ENOMEM);
+    }
+
+    SSL_CTX* ctx = SSL_CTX_new(TLS_server_method());
+    if( !ctx ) {
+        ymo_log_warning("Unable to create SSL context: %s", strerror(errno));
+        return YMO_ERROR_PTR(ENOMEM);
+    }
+
+    ymo_tls_ctx_data_t* ctx_data = YMO_NEW0(ymo_tls_ctx_data_t);
+    if( !ctx_data ) {
+        status = ENOMEM;
+        goto tls_ctx_bail;
+    }
+
+    if( !SSL_CTX_set_ex_data(ctx, ymo_tls_ctx_idx, ctx_data) ) {
+        YMO_DELETE(ymo_tls_ctx_data_t, ctx_data);
+        status = ENOMEM;
+        goto tls_ctx_bail;
+    }
+
+    SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+    SSL_CTX_set_options(ctx,
+            SSL_OP_NO_COMPRESSION | SSL_OP_CIPHER_SERVER_PREFERENCE);
+#ifdef SSL_OP_NO_RENEGOTIATION
+    SSL_CTX_set_options(ctx, SSL_OP_NO_RENEGOTIATION);
+#endif /* SSL_OP_NO_RENEGOTIATION */
+
+    /* File buckets are re-read into a stack buffer when a write is retried: */
+    SSL_CTX_set_mode(ctx, SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+
+    /* Key exchange groups (X25519 first, by default): */
+    const char* groups = config->tls_groups
+        ? config->tls_groups : YMO_TLS_DEFAULT_GROUPS;
+    if( !SSL_CTX_set1_groups_list(ctx, groups) ) {
+        ymo_log_error("Invalid TLS groups: %s", groups);
+        ERR_print_errors_fp(stderr);
+        goto tls_ctx_bail;
+    }
+
+    /* Prefer ECDSA signatures/suites when both cert types are present: */
+    if( !SSL_CTX_set1_sigalgs_list(ctx, YMO_TLS_DEFAULT_SIGALGS)
+        || !SSL_CTX_set_cipher_list(ctx, YMO_TLS_DEFAULT_CIPHERS) ) {
+        ymo_log_error("%s", "Unable to set TLS signature algorithms/ciphers");
+        ERR_print_errors_fp(stderr);
+        goto tls_ctx_bail;
+    }
+
+    /* ECDSA cert/key: */
+    if( config->ecdsa_cert_path && config->ecdsa_key_path ) {
+        status = ymo_tls_ctx_use_pair(ctx,
+                config->ecdsa_cert_path, config->ecdsa_key_path, &cert);
+        if( status ) {
+            goto tls_ctx_bail;
+        }
+
+        if( config->ecdsa_ocsp_path ) {
+            status = ymo_tls_ctx_add_staple(
+                    ctx_data, cert, config->ecdsa_ocsp_path);
+            if( status ) {
+                goto tls_ctx_bail;
+            }
+        }
+    }
+
+    /* RSA (or legacy, single) cert/key: */
+    if( config->cert_path && config->key_path ) {
+        status = ymo_tls_ctx_use_pair(ctx,
+                config->cert_path, config->key_path, &cert);
+        if( status ) {
+            goto tls_ctx_bail;
+        }
+
+        if( config->ocsp_path ) {
+            status = ymo_tls_ctx_add_staple(
+                    ctx_data, cert, config->ocsp_path);
+            if( status ) {
+                goto tls_ctx_bail;
+            }
+        }
+    }
+
+    if( !cert ) {
+        ymo_log_error("%s", "No TLS certificate/key pair configured");
+        status = EINVAL;
+        goto tls_ctx_bail;
+    }
+
+    if( ctx_data->no_staple ) {
+        SSL_CTX_set_tlsext_status_cb(ctx, &ymo_tls_ocsp_cb);
+    }
+
+    if( server->no_alpn ) {
+        SSL_CTX_set_alpn_select_cb(ctx, &ymo_tls_alpn_select_cb, server);
+    }
+    return ctx;
+
+tls_ctx_bail:
+    /* NOTE: ctx_data (if set) is freed via ymo_tls_ctx_data_free: */
+    SSL_CTX_free(ctx);
+    return YMO_ERROR_PTR(status);
+}
+
+
+ymo_status_t ymo_init_ssl_ctx(ymo_server_t* server)
+{
+    ymo_log_notice("Configuring SSL context for port: %i", server->config.port);
+
+    SSL_CTX* ctx = ymo_tls_ctx_create(server);
+    if( !ctx ) {
+        return errno;
+    }
+
+    server->ssl_ctx = ctx;
+    return YMO_OKAY;
+}
+
+
+ymo_proto_t* ymo_tls_alpn_proto(ymo_server_t* server, SSL* ssl)
+{
+    const unsigned char* id = NULL;
+    unsigned int id_len = 0;
+
+    SSL_get0_alpn_selected(ssl, &id, &id_len);
+    if( !id_len ) {
+        return NULL;
+    }
+
+    for( size_t i = 0; i < server->no_alpn; i++ )
+    {
+        const ymo_tls_alpn_t* alpn = &server->alpn[i];
+        if( alpn->id_len == id_len && !memcmp(alpn->id, id, id_len) ) {
+            return alpn->proto;
+        }
+    }
+    return NULL;
+}
+
+
+/*---------------------------------------------------------------*
+ *  TLS Reload:
+ *---------------------------------------------------------------*/
+ymo_status_t ymo_tls_reload_start(ymo_server_t* server)
+{
+    struct ev_loop* loop = server->config.loop;
+
+    ev_async_init(&server->w_tls_swap, &ymo_tls_swap_cb);
+    server->w_tls_swap.data = server;
+    ev_async_start(loop, &server->w_tls_swap);
+
+    ev_async_init(&server->w_tls_request, &ymo_tls_request_cb);
+    server->w_tls_request.data = server;
+    ev_async_start(loop, &server->w_tls_request);
+
+    if( server->config.tls_reload_signal ) {
+        ev_signal_init(&server->w_tls_signal, &ymo_tls_signal_cb,
+                server->config.tls_reload_signal);
+        server->w_tls_signal.data = server;
+        ev_signal_start(loop, &server->w_tls_signal);
+        ymo_log_info("%s:%i TLS reload on signal %i",
+                server->proto->name, server->config.port,
+                server->config.tls_reload_signal);
+    }
+
+    if( server->config.flags & YMO_SERVER_TLS_WATCH ) {
+        const char* paths[YMO_TLS_WATCH_MAX] = {
+            server->config.cert_path,
+            server->config.key_path,
+            server->config.ecdsa_cert_path,
+            server->config.ecdsa_key_path,
+            server->config.ocsp_path,
+            server->config.ecdsa_ocsp_path,
+        };
+
+        ev_timer_init(&server->w_tls_delay, &ymo_tls_delay_cb,
+                0.0, YMO_TLS_WATCH_DELAY);
+        server->w_tls_delay.data = server;
+
+        for( size_t i = 0; i < YMO_TLS_WATCH_MAX; i++ )
+        {
+            if( !paths[i] ) {
+                continue;
+            }
+
+            ev_stat* w_stat = &server->w_tls_stat[server->no_tls_stat++];
+            ev_stat_init(w_stat, &ymo_tls_stat_cb, paths[i], 0.0);
+            w_stat->data = server;
+            ev_stat_start(loop, w_stat);
+            ymo_log_info("%s:%i watching TLS file: %s",
+                    server->proto->name, server->config.port, paths[i]);
+        }
+    }
+    return YMO_OKAY;
+}
+
+
+ymo_status_t ymo_tls_reload_request(ymo_server_t* server)
+{
+    int state = atomic_load(&server->tls_reload);
+
+    /* If a rebuild is in flight, flag it to run again. Else, start one: */
+    while( 1 ) {
+        if( state == YMO_TLS_RELOAD_IDLE ) {
+            if( atomic_compare_exchange_weak(
+                    &server->tls_reload, &state, YMO_TLS_RELOAD_BUSY) ) {
+                break;
+            }
+        } else if( atomic_compare_exchange_weak(
+                &server->tls_reload, &state, YMO_TLS_RELOAD_AGAIN) ) {
+            return YMO_OKAY;
+        }
+    }
+
+    /* The previous reload thread (if any) has finished; reap it. (Only the
+     * loop thread starts and joins reload threads; see w_tls_request.)
+     */
+    if( server->tls_reload_joinable ) {
+        pthread_join(server->tls_reload_thread, NULL);
+        server->tls_reload_joinable = 0;
+    }
+
+    int rc = pthread_create(&server->tls_reload_thread, NULL,
+            &ymo_tls_reload_thread, server);
+    if( rc ) {
+        ymo_log_error("Unable to start TLS reload thread: %s", strerror(rc));
+        atomic_store(&server->tls_reload, YMO_TLS_RELOAD_IDLE);
+        return rc;
+    }
+
+    server->tls_reload_joinable = 1;
+    return YMO_OKAY;
+}
+
+
+void ymo_tls_reload_stop(ymo_server_t* server)
+{
+    struct ev_loop* loop = server->config.loop;
+
+    if( loop ) {
+        ev_async_stop(loop, &server->w_tls_swap);
+        ev_async_stop(loop, &server->w_tls_request);
+        ev_signal_stop(loop, &server->w_tls_signal);
+        ev_timer_stop(loop, &server->w_tls_delay);
+        for( size_t i = 0; i < server->no_tls_stat; i++ )
+        {
+            ev_stat_stop(loop, &server->w_tls_stat[i]);
+        }
+    }
+    server->no_tls_stat = 0;
+
+    if( server->tls_reload_joinable ) {
+        pthread_join(server->tls_reload_thread, NULL);
+        server->tls_reload_joinable = 0;
+    }
+
+    SSL_CTX* ctx = atomic_exchange(&server->ssl_ctx_next, NULL);
+    if( ctx ) {
+        SSL_CTX_free(ctx);
+    }
+}
+
+
+/* Build a new context off-loop; hand it to the loop via w_tls_swap: */
+static void* ymo_tls_reload_thread(void* data)
+{
+    ymo_server_t* server = data;
+    int state;
+
+    do {
+        ymo_log_notice("%s:%i rebuilding TLS context",
+                server->proto->name, server->config.port);
+
+        SSL_CTX* ctx = ymo_tls_ctx_create(server);
+        if( ctx ) {
+            /* If the loop hasn't picked up a prior context, replace it: */
+            SSL_CTX* stale = atomic_exchange(&server->ssl_ctx_next, ctx);
+            if( stale ) {
+                SSL_CTX_free(stale);
+            }
+            ev_async_send(server->config.loop, &server->w_tls_swap);
+        } else {
+            ymo_log_error("%s:%i TLS reload failed (%s); "
+                    "keeping current context",
+                    server->proto->name, server->config.port,
+                    strerror(errno));
+        }
+
+        state = YMO_TLS_RELOAD_BUSY;
+        if( atomic_compare_exchange_strong(
+                &server->tls_reload, &state, YMO_TLS_RELOAD_IDLE) ) {
+            break;
+        }
+
+        /* Another reload was requested while we were busy: */
+        atomic_store(&server->tls_reload, YMO_TLS_RELOAD_BUSY);
+    } while( 1 );
+
+    return NULL;
+}
+
+
+/* Invoked on the server loop to swap in a freshly built context: */
+static void ymo_tls_swap_cb(struct ev_loop* loop, ev_async* w, int revents)
+{
+    ymo_server_t* server = w->data;
+    SSL_CTX* ctx = atomic_exchange(&server->ssl_ctx_next, NULL);
+    if( !ctx ) {
+        return;
+    }
+
+    /* Every SSL holds a reference to the SSL_CTX it was created from, so
+     * connections accepted before the swap keep the old context alive
+     * until they're freed. Here, we just drop the server's reference:
+     */
+    SSL_CTX* ctx_old = server->ssl_ctx;
+    server->ssl_ctx = ctx;
+    if( ctx_old ) {
+        SSL_CTX_free(ctx_old);
+    }
+
+    ymo_log_notice("%s:%i TLS context reloaded",
+            server->proto->name, server->config.port);
+}
+
+
+/* Invoked on the server loop for ymo_server_tls_reload: */
+static void ymo_tls_request_cb(struct ev_loop* loop, ev_async* w, int revents)
+{
+    ymo_tls_reload_request(w->data);
+}
+
+
+static void ymo_tls_signal_cb(struct ev_loop* loop, ev_signal* w, int revents)
+{
+    ymo_tls_reload_request(w->data);
+}
+
+
+static void ymo_tls_stat_cb(struct ev_loop* loop, ev_stat* w, int revents)
+{
+    ymo_server_t* server = w->data;
+    TLS_TRACE("TLS file changed: %s", w->path);
+    ev_timer_again(loop, &server->w_tls_delay);
+}
+
+
+static void ymo_tls_delay_cb(struct ev_loop* loop, ev_timer* w, int revents)
+{
+    ev_timer_stop(loop, w);
+    ymo_tls_reload_request(w->data);
+}
+
+
+/*---------------------------------------------------------------*
+ *  Utility:
+ *---------------------------------------------------------------*/
+static void ymo_tls_ctx_index_init(void)
+{
+    ymo_tls_ctx_idx = SSL_CTX_get_ex_new_index(
+            0, NULL, NULL, NULL, &ymo_tls_ctx_data_free);
+}
+
+
+static void ymo_tls_ctx_data_free(
+        void* parent, void* ptr, CRYPTO_EX_DATA* ad,
+        int idx, long argl, void* argp)
+{
+    ymo_tls_ctx_data_t* ctx_data = ptr;
+    if( !ctx_data ) {
+        return;
+    }
+
+    for( size_t i = 0; i < ctx_data->no_staple; i++ )
+    {
+        YMO_FREE(ctx_data->staple[i].der);
+    }
+    YMO_DELETE(ymo_tls_ctx_data_t, ctx_data);
+}
+
+
+static ymo_status_t ymo_tls_ctx_use_pair(
+        SSL_CTX* ctx, const char* cert_path, const char* key_path,
+        X509** cert_out)
+{
+    if( SSL_CTX_use_certificate_chain_file(ctx, cert_path) <= 0 ) {
+        ymo_log_error("Unable to load TLS certificate: %s", cert_path);
+        ERR_print_errors_fp(stderr);
+        return EINVAL;
+    }
+
+    if( SSL_CTX_use_PrivateKey_file(ctx, key_path, SSL_FILETYPE_PEM) <= 0 ) {
+        ymo_log_error("Unable to load TLS private key: %s", key_path);
+        ERR_print_errors_fp(stderr);
+        return EINVAL;
+    }
+
+    if( !SSL_CTX_check_private_key(ctx) ) {
+        ymo_log_error("TLS private key does not match certificate: %s",
+                cert_path);
+        ERR_print_errors_fp(stderr);
+        return EINVAL;
+    }
+
+    ymo_log_notice("Loaded TLS certificate: %s", cert_path);
+    *cert_out = SSL_CTX_get0_certificate(ctx);
+    return YMO_OKAY;
+}
+
+
+static ymo_status_t ymo_tls_ctx_add_staple(
+        ymo_tls_ctx_data_t* ctx_data, X509* cert, const char* ocsp_path)
+{
+    ymo_status_t status = YMO_OKAY;
+    unsigned char* der = NULL;
+    struct stat f_stat;
+
+    int fd = open(ocsp_path, O_RDONLY | O_CLOEXEC);
+    if( fd < 0 ) {
+        status = errno;
+        ymo_log_error("Unable to open OCSP response %s: %s",
+                ocsp_path, strerror(status));
+        return status;
+    }
+
+    if( fstat(fd, &f_stat) ) {
+        status = errno;
+        goto staple_close_and_bail;
+    }
+
+    if( f_stat.st_size <= 0 ) {
+        status = EINVAL;
+        goto staple_close_and_bail;
+    }
+
+    size_t len = (size_t)f_stat.st_size;
+    der = YMO_ALLOC(len);
+    if( !der ) {
+        status = ENOMEM;
+        goto staple_close_and_bail;
+    }
+
+    size_t total = 0;
+    while( total < len ) {
+        ssize_t n = read(fd, der + total, len - total);
+        if( n <= 0 ) {
+            status = (n < 0) ? errno : EINVAL;
+            goto staple_close_and_bail;
+        }
+        total += (size_t)n;
+    }
+    close(fd);
+
+    /* Make sure it's a well-formed, successful response: */
+    const unsigned char* p = der;
+    OCSP_RESPONSE* response = d2i_OCSP_RESPONSE(NULL, &p, (long)len);
+    if( !response
+        || OCSP_response_status(response) != OCSP_RESPONSE_STATUS_SUCCESSFUL ) {
+        ymo_log_error("Invalid OCSP response: %s", ocsp_path);
+        OCSP_RESPONSE_free(response);
+        YMO_FREE(der);
+        return EINVAL;
+    }
+    OCSP_RESPONSE_free(response);
+
+    ymo_tls_staple_t* staple = &ctx_data->staple[ctx_data->no_staple++];
+    staple->cert = cert;
+    staple->der = der;
+    staple->len = len;
+    ymo_log_notice("Loaded OCSP response: %s", ocsp_path);
+    return YMO_OKAY;
+
+staple_close_and_bail:
+    ymo_log_error("Unable to read OCSP response %s: %s",
+            ocsp_path, strerror(status));
+    close(fd);
+    if( der ) {
+        YMO_FREE(der);
+    }
+    return status;
+}
+
+
+static int ymo_tls_ocsp_cb(SSL* ssl, void* arg)
+{
+    ymo_tls_ctx_data_t* ctx_data = SSL_CTX_get_ex_data(
+            SSL_get_SSL_CTX(ssl), ymo_tls_ctx_idx);
+    X509* cert = SSL_get_certificate(ssl);
+
+    if( !ctx_data || !cert ) {
+        return SSL_TLSEXT_ERR_NOACK;
+    }
+
+    for( size_t i = 0; i < ctx_data->no_staple; i++ )
+    {
+        const ymo_tls_staple_t* staple = &ctx_data->staple[i];
+        if( staple->cert != cert ) {
+            continue;
+        }
+
+        /* OpenSSL takes ownership of the response buffer: */
+        unsigned char* der = OPENSSL_memdup(staple->der, staple->len);
+        if( !der ) {
+            return SSL_TLSEXT_ERR_NOACK;
+        }
+
+        if( !SSL_set_tlsext_status_ocsp_resp(ssl, der, (long)staple->len) ) {
+            OPENSSL_free(der);
+            return SSL_TLSEXT_ERR_NOACK;
+        }
+        return SSL_TLSEXT_ERR_OK;
+    }
+
+    return SSL_TLSEXT_ERR_NOACK;
+}
+
+
+/* Select the first server-preferred ALPN id that the client offered: */
+static int ymo_tls_alpn_select_cb(
+        SSL* ssl,
+        const unsigned char** out, unsigned char* outlen,
+        const unsigned char* in, unsigned int inlen,
+        void* arg)
+{
+    ymo_server_t* server = arg;
+    const unsigned char* end = in + inlen;
+
+    for( size_t i = 0; i < server->no_alpn; i++ )
+    {
+        const ymo_tls_alpn_t* alpn = &server->alpn[i];
+        const unsigned char* p = in;
+
+        while( p < end ) {
+            unsigned char len = *p++;
+            if( len > (size_t)(end - p) ) {
+                /* Malformed client list: */
+                return SSL_TLSEXT_ERR_NOACK;
+            }
+
+            if( len == alpn->id_len && !memcmp(p, alpn->id, len) ) {
+                *out = p;
+                *outlen = len;
+                return SSL_TLSEXT_ERR_OK;
+            }
+            p += len;
+        }
+    }
+
+    return SSL_TLSEXT_ERR_NOACK;
+}
+
+
+#endif /* YMO_ENABLE_TLS */
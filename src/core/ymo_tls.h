@@ -25,6 +25,13 @@
  * ============
  *
  *
+ * SSL context construction (certificates, key exchange groups, OCSP
+ * stapling, and ALPN) lives in ``ymo_tls.c``. The per-connection helpers
+ * below are inlined into ``ymo_server.c``.
+ *
+ * When both an ECDSA and an RSA certificate are configured, the context
+ * prefers ECDSA and falls back to RSA for clients which don't support it.
+ *
  * .. note::
  *
  *    This header is a temporary measure to tidy up ymo_server/ymo_conn
@@ -35,6 +42,11 @@
 #ifndef YMO_TLS_H
 #define YMO_TLS_H
 
+/** True if the server config contains at least one cert/key pair. */
+#define YMO_TLS_CONFIGURED(cfg) \
+    (((cfg)->cert_path && (cfg)->key_path) \
+     || ((cfg)->ecdsa_cert_path && (cfg)->ecdsa_key_path))
+
 #if YMO_ENABLE_TLS
 #include <openssl/bio.h>
 #include <openssl/ssl.h>
@@ -47,44 +59,101 @@
                             conn->state == YMO_CONN_TLS_HANDSHAKE \
                             ))
 
+#ifndef YMO_TLS_TRACE
+#  define YMO_TLS_TRACE 0
+#endif /* YMO_TLS_TRACE */
+
+#if defined(YMO_TLS_TRACE) && YMO_TLS_TRACE == 1
+# define TLS_TRACE(fmt, ...) ymo_log_trace(fmt, __VA_ARGS__);
+#else
+# define TLS_TRACE(fmt, ...)
+#endif /* YMO_TLS_TRACE */
+
+#ifndef YMO_TLS_DEFAULT_GROUPS
+/** Default key exchange groups, in order of preference. */
+#  define YMO_TLS_DEFAULT_GROUPS "X25519:P-256:P-384"
+#endif /* YMO_TLS_DEFAULT_GROUPS */
+
+#ifndef YMO_TLS_DEFAULT_SIGALGS
+/** Default signature algorithms. ECDSA is listed first so that, when both
+ * an ECDSA and an RSA certificate are configured, ECDSA is used for any
+ * client that supports it.
+ */
+#  define YMO_TLS_DEFAULT_SIGALGS \
+        "ECDSA+SHA256:ECDSA+SHA384:ECDSA+SHA512:ed25519:" \
+        "RSA-PSS+SHA256:RSA-PSS+SHA384:RSA-PSS+SHA512:" \
+        "RSA+SHA256:RSA+SHA384:RSA+SHA512"
+#endif /* YMO_TLS_DEFAULT_SIGALGS */
+
+#ifndef YMO_TLS_DEFAULT_CIPHERS
+/** Default TLS 1.2 cipher list (TLS 1.3 suites are left at the OpenSSL
+ * defaults).
+ */
+#  define YMO_TLS_DEFAULT_CIPHERS \
+        "ECDHE-ECDSA-AES128-GCM-SHA256:ECDHE-ECDSA-CHACHA20-POLY1305:" \
+        "ECDHE-ECDSA-AES256-GCM-SHA384:ECDHE-RSA-AES128-GCM-SHA256:" \
+        "ECDHE-RSA-CHACHA20-POLY1305:ECDHE-RSA-AES256-GCM-SHA384"
+#endif /* YMO_TLS_DEFAULT_CIPHERS */
+
 /*---------------------------------------------------------------*
- *  Yimmo Server TLS Functions (HACK/POC):
+ *  Yimmo Server TLS Functions:
  *---------------------------------------------------------------*/
-static ymo_status_t ymo_init_ssl_ctx(ymo_server_t* server)
-{
-    ymo_log_notice("Configuring SSL context for port: %i", server->config.port);
 
-    const SSL_METHOD* method;
-    method = TLS_server_method();
+/** Build a new SSL context from the server's TLS configuration.
+ *
+ * The context is configured with:
+ *
+ * - the ECDSA and/or RSA certificate chains and keys
+ * - the preferred key exchange groups (X25519, by default)
+ * - OCSP staples loaded from the configured DER files (if any)
+ * - an ALPN select callback for any :c:func:`ymo_server_add_alpn` entries
+ *
+ * :param server: server whose config is used to build the context
+ * :returns: a new SSL_CTX on success; NULL with errno set on failure
+ */
+SSL_CTX* ymo_tls_ctx_create(ymo_server_t* server);
 
-    server->ssl_ctx = SSL_CTX_new(method);
-    if( !server->ssl_ctx ) {
-        ymo_log_warning("Unable to create SSL context: %s", strerror(errno));
-        return errno;
-    }
+/** Create the initial SSL context for the server.
+ *
+ * :param server: the server to configure
+ * :returns: YMO_OKAY on success; appropriate errno on failure
+ */
+ymo_status_t ymo_init_ssl_ctx(ymo_server_t* server);
 
-    int rc = SSL_CTX_use_certificate_file(
-            server->ssl_ctx,
-            server->config.cert_path,
-            SSL_FILETYPE_PEM);
-    ymo_log_notice("Cert config rc: %i", rc);
-    if( rc <= 0 ) {
-        ERR_print_errors_fp(stderr);
-        return EINVAL;
-    }
+/** Return the protocol mapped to the ALPN identifier negotiated on ``ssl``,
+ * if any.
+ *
+ * :param server: the server which owns the connection
+ * :param ssl: an SSL object whose handshake has completed
+ * :returns: the mapped protocol or NULL if ALPN was not negotiated
+ */
+ymo_proto_t* ymo_tls_alpn_proto(ymo_server_t* server, SSL* ssl);
 
-    rc = SSL_CTX_use_PrivateKey_file(
-            server->ssl_ctx,
-            server->config.key_path,
-            SSL_FILETYPE_PEM);
-    ymo_log_notice("Key config rc: %i", rc);
-    if( rc <= 0 ) {
-        ERR_print_errors_fp(stderr);
-        return EINVAL;
-    }
+/** Start the TLS reload watchers (async swap, reload signal, and — if
+ * ``YMO_SERVER_TLS_WATCH`` is set — cert/key file watchers).
+ *
+ * :param server: a server with an SSL context, being started on its loop
+ * :returns: YMO_OKAY on success; appropriate errno on failure
+ */
+ymo_status_t ymo_tls_reload_start(ymo_server_t* server);
 
-    return YMO_OKAY;
-}
+/** Schedule a background rebuild of the server's SSL context.
+ *
+ * If a rebuild is already in progress, another is run once it completes.
+ * Must be invoked on the server loop (other threads go through
+ * ``w_tls_request``; see :c:func:`ymo_server_tls_reload`).
+ *
+ * :param server: a server with TLS enabled
+ * :returns: YMO_OKAY on success; appropriate errno on failure
+ */
+ymo_status_t ymo_tls_reload_request(ymo_server_t* server);
+
+/** Stop the reload watchers, wait on any in-progress rebuild, and release
+ * any context which was built but not yet swapped in.
+ *
+ * :param server: the server being freed
+ */
+void ymo_tls_reload_stop(ymo_server_t* server);
 
 
 static inline ymo_status_t ymo_init_ssl(
@@ -105,8 +174,8 @@ static inline ymo_status_t ymo_init_ssl(
             ymo_log_warning("Failed to set the SSL fd for %i", client_fd);
             return EPROTO;
         } else {
-            SERVER_TRACE("TLS state: HANDSHAKE (conn: %p, fd: %i)",
-                    (void*)conn, conn->id, NULL);
+            TLS_TRACE("TLS state: HANDSHAKE (conn: %p, fd: %i)",
+                    (void*)conn, conn->fd);
             conn->state = YMO_CONN_TLS_HANDSHAKE;
         }
     }
@@ -117,8 +186,8 @@ static inline ymo_status_t ymo_init_ssl(
 
 static inline ymo_status_t ymo_server_ssl_handshake(ymo_conn_t* conn)
 {
-    SERVER_TRACE("Do TLS HANDSHAKE (conn: %p, fd: %i)",
-            (void*)conn, conn->id, NULL);
+    TLS_TRACE("Do TLS HANDSHAKE (conn: %p, fd: %i)",
+            (void*)conn, conn->fd);
     ERR_clear_error();
 
     /* If we haven't completed the SSL handshake, let's try now: */
@@ -127,9 +196,19 @@ static inline ymo_status_t ymo_server_ssl_handshake(ymo_conn_t* conn)
         accept_rc = SSL_accept(conn->ssl);
 
         if( accept_rc == 1 ) {
-            SERVER_TRACE("TLS state: ESTABLISHED (conn: %p, fd: %i)",
-                    (void*)conn, conn->id, NULL);
+            TLS_TRACE("TLS state: ESTABLISHED (conn: %p, fd: %i)",
+                    (void*)conn, conn->fd);
             conn->state = YMO_CONN_TLS_ESTABLISHED;
+
+            /* Hand off to the ALPN-negotiated protocol, if it differs: */
+            ymo_proto_t* alpn_proto = ymo_tls_alpn_proto(conn->server, conn->ssl);
+            if( alpn_proto && alpn_proto != conn->proto ) {
+                TLS_TRACE("ALPN: %s → %s (conn: %p)",
+                        conn->proto->name, alpn_proto->name, (void*)conn);
+                if( ymo_conn_transition_proto(conn, alpn_proto) ) {
+                    return ECONNABORTED;
+                }
+            }
             return YMO_OKAY;
         }
 
@@ -201,6 +280,8 @@ static inline ssize_t ymo_server_ssl_read(
 
 
 #define ymo_init_ssl_ctx(s) (YMO_OKAY)
+#define ymo_tls_reload_start(s) (YMO_OKAY)
+#define ymo_tls_reload_stop(s)
 #define ymo_init_ssl(s, c, fd) (YMO_OKAY)
 
 #endif /* YMO_ENABLE_TLS */
@@ -0,0 +1,327 @@
+/*=============================================================================
+ * libyimmo: Lightweight socket server framework
+ *
+ *  Copyright (c) 2014 Andrew Canaday
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *===========================================================================*/
+
+/** ymo_http_hdr_gen
+ * ==================
+ *
+ * Build-time generator for the standard HTTP header id table.
+ *
+ * Given the list of header names in ``ymo_std_http.c``, this emits:
+ *
+ * - ``-h``: ``ymo_http_hdr_ids.h`` — one ``YMO_HTTP_HID_*`` constant per
+ *   standard header (dense, starting at 1, in list order).
+ * - ``-c``: ``ymo_http_hdr_ids.c`` — the id → name table and
+ *   ``ymo_http_hdr_std_id``, a perfect hash over the list in the form of a
+ *   ``switch`` on length, followed by nested ``switch`` statements on
+ *   whichever character positions best partition each group. A candidate id
+ *   is always verified by a full (case-insensitive) string compare.
+ *
+ * The output doesn't depend on the host hash function or word size, so the
+ * generated files are distributed with the source and only rebuilt when the
+ * header list changes.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+
+#include "ymo_std_http.h"
+
+#define HDR_NAME_MAX 64
+
+/* Folded character, as used by the generated code (YMO_HTTP_HDR_FOLD): */
+#define HDR_FOLD(c) ((unsigned char)((c) | 0x20))
+
+typedef struct hdr_info {
+    const char*  name;
+    size_t       len;
+    size_t       id;
+    char         macro[HDR_NAME_MAX+1];
+} hdr_info_t;
+
+static hdr_info_t* hdrs = NULL;
+static size_t no_hdrs = 0;
+
+
+/*---------------------------------------------------------------*
+ *  Utility:
+ *---------------------------------------------------------------*/
+static int cmp_by_len(const void* a, const void* b)
+{
+    const hdr_info_t* h_a = *(const hdr_info_t**)a;
+    const hdr_info_t* h_b = *(const hdr_info_t**)b;
+    if( h_a->len != h_b->len ) {
+        return (h_a->len < h_b->len) ? -1 : 1;
+    }
+    return strcasecmp(h_a->name, h_b->name);
+}
+
+
+static size_t sort_pos = 0;
+static int cmp_by_pos(const void* a, const void* b)
+{
+    const hdr_info_t* h_a = *(const hdr_info_t**)a;
+    const hdr_info_t* h_b = *(const hdr_info_t**)b;
+    int c_a = HDR_FOLD(h_a->name[sort_pos]);
+    int c_b = HDR_FOLD(h_b->name[sort_pos]);
+    return c_a - c_b;
+}
+
+
+static void print_ch(unsigned char c)
+{
+    if( isalnum(c) || c == '-' ) {
+        printf("'%c'", c);
+    } else {
+        printf("0x%02x", c);
+    }
+}
+
+
+static void indent(int depth)
+{
+    printf("%*s", depth * 4, "");
+}
+
+
+/*---------------------------------------------------------------*
+ *  Perfect hash (decision tree) emission:
+ *---------------------------------------------------------------*/
+/* Number of distinct (folded) characters at pos within the group: */
+static size_t no_classes(hdr_info_t** group, size_t n, size_t pos)
+{
+    unsigned char seen[256];
+    size_t count = 0;
+    memset(seen, 0, sizeof(seen));
+    for( size_t i = 0; i < n; i++ ) {
+        unsigned char c = HDR_FOLD(group[i]->name[pos]);
+        if( !seen[c] ) {
+            seen[c] = 1;
+            count++;
+        }
+    }
+    return count;
+}
+
+
+/* Emit a switch which narrows the group (all the same length) down to a
+ * single candidate id, recursing on any partition which isn't a singleton.
+ */
+static void emit_group(hdr_info_t** group, size_t n, size_t len, int depth)
+{
+    size_t best_pos = 0;
+    size_t best_classes = 0;
+
+    if( n == 1 ) {
+        indent(depth);
+        printf("id = YMO_HTTP_HID_%s;\n", group[0]->macro);
+        return;
+    }
+
+    for( size_t pos = 0; pos < len; pos++ ) {
+        size_t classes = no_classes(group, n, pos);
+        if( classes > best_classes ) {
+            best_classes = classes;
+            best_pos = pos;
+        }
+    }
+
+    /* Names are unique, so this can only happen for duplicates: */
+    if( best_classes < 2 ) {
+        fprintf(stderr, "Duplicate header: \"%s\"\n", group[0]->name);
+        exit(EXIT_FAILURE);
+    }
+
+    sort_pos = best_pos;
+    qsort(group, n, sizeof(hdr_info_t*), &cmp_by_pos);
+
+    indent(depth);
+    printf("switch( YMO_HTTP_HDR_FOLD(hdr[%zu]) ) {\n", best_pos);
+    for( size_t i = 0; i < n; ) {
+        unsigned char c = HDR_FOLD(group[i]->name[best_pos]);
+        size_t j = i;
+        while( j < n && HDR_FOLD(group[j]->name[best_pos]) == c ) {
+            j++;
+        }
+
+        indent(depth+1);
+        printf("case ");
+        print_ch(c);
+        printf(":\n");
+        emit_group(group + i, j - i, len, depth+2);
+        indent(depth+2);
+        printf("break;\n");
+        i = j;
+    }
+    indent(depth+1);
+    printf("default:\n");
+    indent(depth+2);
+    printf("return YMO_HTTP_HID_NONE;\n");
+    indent(depth);
+    printf("}\n");
+}
+
+
+/*---------------------------------------------------------------*
+ *  Output:
+ *---------------------------------------------------------------*/
+static void emit_preamble(const char* file_name)
+{
+    printf(
+"/*=============================================================================\n"
+" * libyimmo: %s\n"
+" *\n"
+" * GENERATED by ymo_http_hdr_gen from extra/ymo_std_http.c — DO NOT EDIT.\n"
+" *\n"
+" * To add a standard header, add it to ymo_common_http_headers in\n"
+" * extra/ymo_std_http.c and rebuild.\n"
+" *\n"
+" *===========================================================================*/\n"
+"\n", file_name);
+}
+
+
+static void emit_header(void)
+{
+    size_t max_len = 0;
+
+    emit_preamble("ymo_http_hdr_ids.h");
+    printf("#ifndef YMO_HTTP_HDR_IDS_H\n");
+    printf("#define YMO_HTTP_HDR_IDS_H\n\n");
+
+    for( size_t i = 0; i < no_hdrs; i++ ) {
+        printf("#define YMO_HTTP_HID_%-40s %4zu  /* \"%s\" */\n",
+                hdrs[i].macro, hdrs[i].id, hdrs[i].name);
+        if( hdrs[i].len > max_len ) {
+            max_len = hdrs[i].len;
+        }
+    }
+
+    printf("\n/** Number of standard header ids (i.e. largest standard id). */\n");
+    printf("#define YMO_HTTP_HID_STD_MAX %zu\n\n", no_hdrs);
+    printf("/** Length of the longest standard header name. */\n");
+    printf("#define YMO_HTTP_HDR_STD_LEN_MAX %zu\n\n", max_len);
+    printf("#endif /* YMO_HTTP_HDR_IDS_H */\n\n");
+}
+
+
+static void emit_source(void)
+{
+    hdr_info_t** sorted = calloc(no_hdrs, sizeof(hdr_info_t*));
+    if( !sorted ) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+
+    for( size_t i = 0; i < no_hdrs; i++ ) {
+        sorted[i] = &hdrs[i];
+    }
+    qsort(sorted, no_hdrs, sizeof(hdr_info_t*), &cmp_by_len);
+
+    emit_preamble("ymo_http_hdr_ids.c");
+    printf("#include \"yimmo_config.h\"\n\n");
+    printf("#include <stddef.h>\n");
+    printf("#include <strings.h>\n\n");
+    printf("#include \"yimmo.h\"\n");
+    printf("#include \"ymo_http_hdr_table.h\"\n\n");
+
+    printf("const ymo_http_hdr_std_t ymo_http_hdr_std[YMO_HTTP_HID_STD_MAX+1] = {\n");
+    printf("    { NULL, 0 },\n");
+    for( size_t i = 0; i < no_hdrs; i++ ) {
+        printf("    { \"%s\", %zu },\n", hdrs[i].name, hdrs[i].len);
+    }
+    printf("};\n\n\n");
+
+    printf("ymo_http_hdr_id_t ymo_http_hdr_std_id(const char* hdr, size_t len)\n");
+    printf("{\n");
+    printf("    ymo_http_hdr_id_t id;\n\n");
+    printf("    switch( len ) {\n");
+    for( size_t i = 0; i < no_hdrs; ) {
+        size_t len = sorted[i]->len;
+        size_t j = i;
+        while( j < no_hdrs && sorted[j]->len == len ) {
+            j++;
+        }
+
+        printf("        case %zu:\n", len);
+        emit_group(sorted + i, j - i, len, 3);
+        printf("            break;\n");
+        i = j;
+    }
+    printf("        default:\n");
+    printf("            return YMO_HTTP_HID_NONE;\n");
+    printf("    }\n\n");
+    printf("    /* Only a few characters were inspected to get here: */\n");
+    printf("    if( !strncasecmp(hdr, ymo_http_hdr_std[id].name, len) ) {\n");
+    printf("        return id;\n");
+    printf("    }\n");
+    printf("    return YMO_HTTP_HID_NONE;\n");
+    printf("}\n\n\n");
+
+    free(sorted);
+}
+
+
+/*---------------------------------------------------------------*
+ *  Main:
+ *---------------------------------------------------------------*/
+int main(int argc, char** argv)
+{
+    if( argc != 2 || (strcmp(argv[1], "-h") && strcmp(argv[1], "-c")) ) {
+        fprintf(stderr, "Usage: %s -h|-c\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    no_hdrs = ymo_no_common_http_headers;
+    hdrs = calloc(no_hdrs, sizeof(hdr_info_t));
+    if( !hdrs ) {
+        perror("calloc");
+        return EXIT_FAILURE;
+    }
+
+    for( size_t i = 0; i < no_hdrs; i++ ) {
+        const char* name = ymo_common_http_headers[i];
+        size_t len = strlen(name);
+        if( !len || len > HDR_NAME_MAX ) {
+            fprintf(stderr, "Bad header name: \"%s\"\n", name);
+            return EXIT_FAILURE;
+        }
+
+        hdrs[i].name = name;
+        hdrs[i].len = len;
+        hdrs[i].id = i+1;
+        for( size_t j = 0; j < len; j++ ) {
+            char c = name[j];
+            hdrs[i].macro[j] = (c == '-') ? '_' : (char)toupper(c);
+        }
+    }
+
+    if( !strcmp(argv[1], "-h") ) {
+        emit_header();
+    } else {
+        emit_source();
+    }
+
+    free(hdrs);
+    return EXIT_SUCCESS;
+}
+
@@ -23,7 +23,6 @@
 #include <stdlib.h>
 
 #include "ymo_std_http.h"
-#include "ymo_http_hdr_table.h"
 
 const char* ymo_std_request_headers[] = {
     "Accept",
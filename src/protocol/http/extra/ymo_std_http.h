@@ -25,6 +25,8 @@
 #ifndef YMO_STD_HTTP_HDR_H
 #define YMO_STD_HTTP_HDR_H
 
+#include <stddef.h>
+
 /** List of standard HTTP header names.
  * TODO: PROBABLY NOT NECESSARY
  */
@@ -69,6 +69,8 @@
 #define YMO_HTTP_RESPONSE_COMPLETE      (1<<26)
 #define YMO_HTTP_RESPONSE_CHUNKED       (1<<27)
 #define YMO_HTTP_RESPONSE_CHUNK_TERM    (1<<28)
+#define YMO_HTTP_RESPONSE_QUEUED        (1<<29)
+#define YMO_HTTP_RESPONSE_NO_BODY       (1<<30)
 
 
 /**---------------------------------------------------------------
@@ -85,10 +87,9 @@
  *    *with the exception of the* ``Set-Cookie`` *header* which has its own
  *    grammar (outlined in RFC 6265, `section 4.1.1 — Set-Cookie Syntax <RFC-6265-4.1.1>`_).
  *
- *    At this time, the library uses a crude trick to accommodate this: it
- *    checks to see if the header being set is ``Set-Cookie`` and, if so, it
- *    adds another node to the header table, rather than concatenating the
- *    values.
+ *    To accommodate this, ``Set-Cookie`` values are never concatenated:
+ *    each one is kept as a separate header table entry (and serialized as a
+ *    separate header line), whether it was set using insert or add.
  *
  *    This works out okay for *setting* cookies, but it also means
  *    that once a cookie has been inserted into a header table as part of
@@ -146,9 +147,6 @@ typedef struct ymo_http_hdr_table ymo_http_hdr_table_t;
 /** HTTP header table node type. */
 typedef struct ymo_http_hdr_table_node ymo_http_hdr_table_node_t;
 
-/** HTTP header table node pool type (when enabled). */
-typedef struct ymo_http_hdr_table_pool ymo_http_hdr_table_pool_t;
-
 /** HTTP header table node pointer — used by :c:func:`ymo_http_hdr_table_next`
  * as a cursor for iterating over tables.  */
 typedef ymo_http_hdr_table_node_t* ymo_http_hdr_ptr_t;
@@ -208,7 +206,8 @@ const char* ymo_http_hdr_table_get(
         const ymo_http_hdr_table_t* table, const char* hdr);
 
 /**
- * Iterate over all of the headers in a header table.
+ * Iterate over all of the headers in a header table, in the order they were
+ * first added.
  *
  * :param table: a pointer to the header table to query
  * :param cur: a cursor used to traverse the header table.
@@ -251,6 +250,27 @@ ymo_http_hdr_ptr_t ymo_http_hdr_table_next(
         const char** value
         );
 
+/**
+ * Iterate over the individual values of a (possibly repeated) header field,
+ * in the order they were added.
+ *
+ * Where :c:func:`ymo_http_hdr_table_get` returns the combined value of a
+ * repeated header (e.g. ``"a,b"``), this yields each one separately (``"a"``,
+ * then ``"b"``).
+ *
+ * :param table: a pointer to the header table to query
+ * :param hdr: the header field name
+ * :param cur: a cursor used to traverse the values
+ *     (This is set to ``NULL`` on the first invocation).
+ * :param value: the header field *value* is stored here
+ * :returns: the next cursor or ``NULL`` once there are no more values.
+ */
+ymo_http_hdr_ptr_t ymo_http_hdr_table_next_value(
+        const ymo_http_hdr_table_t* table,
+        const char* hdr,
+        ymo_http_hdr_ptr_t cur,
+        const char** value);
+
 
 /** Remove all the entries from the hash table.
  */
@@ -260,45 +280,43 @@ void ymo_http_hdr_table_clear(ymo_http_hdr_table_t* table);
  */
 void ymo_http_hdr_table_free(ymo_http_hdr_table_t* table);
 
-/*
- * .. todo::
- *   This should be adaptive (or at least configurable).
+/** Number of entries a header table can hold before it spills to the heap.
+ * Must be a power of two.
  */
-#ifndef YMO_HDR_TABLE_BUCKET_SIZE
-#  define YMO_HDR_TABLE_BUCKET_SIZE 8
-#endif /* YMO_HDR_TABLE_BUCKET_SIZE */
-
-#ifndef YMO_HDR_TABLE_POOL_SIZE
-#  define YMO_HDR_TABLE_POOL_SIZE   4
-#endif /* YMO_HDR_TABLE_POOL_SIZE */
+#ifndef YMO_HDR_TABLE_INLINE_SIZE
+#  define YMO_HDR_TABLE_INLINE_SIZE 16
+#endif /* YMO_HDR_TABLE_INLINE_SIZE */
 
 #ifndef YMO_HDR_TABLE_MASK
 #  define YMO_HDR_TABLE_MASK        0x7fff
 #endif /* YMO_HDR_TABLE_MASK */
 
+/* Header table index slot: 1 + offset of the first entry for a given header
+ * name (0 means empty). */
+typedef uint16_t ymo_http_hdr_slot_t;
 
+/* One entry per header field line, stored in arrival order. */
 struct ymo_http_hdr_table_node {
     ymo_http_hdr_id_t          h_id;
     ymo_http_hdr_flags_t       flags;
     const char*                hdr;
     const char*                value;
     size_t                     hdr_len;
-    ymo_http_hdr_table_node_t* next;
-    char*                      buffer;
+    char*                      buffer;  /* joined values (first entry only) */
+    ymo_http_hdr_slot_t        next;    /* next entry with the same name */
 };
 
-#if YMO_HDR_TABLE_POOL_SIZE
-struct ymo_http_hdr_table_pool {
-    ymo_http_hdr_table_node_t* head;
-    ymo_http_hdr_table_node_t  items[YMO_HDR_TABLE_POOL_SIZE];
-};
-#endif /* YMO_HDR_TABLE_POOL_SIZE */
-
+/* Headers are kept in a contiguous array, in the order they were added, with
+ * a small open-addressed index (h_id → first entry) alongside. Both start out
+ * inline and move to the heap if the table outgrows them.
+ */
 struct ymo_http_hdr_table {
-    ymo_http_hdr_table_node_t* bucket[YMO_HDR_TABLE_BUCKET_SIZE];
-#if YMO_HDR_TABLE_POOL_SIZE
-    ymo_http_hdr_table_pool_t  pool;
-#endif /* YMO_HDR_TABLE_POOL_SIZE */
+    ymo_http_hdr_table_node_t* items;
+    ymo_http_hdr_slot_t*       index;
+    size_t                     count;
+    size_t                     capacity; /* index has 2x as many slots */
+    ymo_http_hdr_table_node_t  inline_items[YMO_HDR_TABLE_INLINE_SIZE];
+    ymo_http_hdr_slot_t        inline_index[2*YMO_HDR_TABLE_INLINE_SIZE];
 };
 
 
@@ -328,9 +346,9 @@ struct ymo_http_hdr_table {
  *    |  Request (byte 2) | Response (byte 3) |
  *    +-------------------+-------------------+
  *    | 0 1 2 3 4 5 6 7 8 | 0 1 2 3 4 5 6 7 8 |
- *    | B                 | R R R S C         |
- *    | T                 | D D D T T         |
- *    | E                 | R S C E Q         |
+ *    | B                 | R R R S C R N     |
+ *    | T                 | D D D T T D O     |
+ *    | E                 | R S C E Q Q B     |
  *    | C                 |       C           |
  *    +-------------------+-------------------+
  *
@@ -350,6 +368,9 @@ struct ymo_http_hdr_table {
  * - ``RDS``  Response data started
  * - ``RDC``  Response data complete
  * - ``STEC`` Send transfer-encoding chunked
+ * - ``CTQ``  Chunked terminator queued
+ * - ``RDQ``  Response data queued (all of it is in the send buffer)
+ * - ``NOB``  No body is sent (response to ``HEAD``)
  *
  */
 typedef uint32_t ymo_http_flags_t;
@@ -371,6 +392,29 @@ typedef struct ymo_http_exchange ymo_http_exchange_t;
  */
 typedef struct ymo_http_session ymo_http_session_t;
 
+/** Opaque struct used to hold spooled request bodies (see
+ * :c:func:`ymo_http_set_body_spool`).
+ */
+typedef struct ymo_http_body ymo_http_body_t;
+
+/** Opaque struct used to represent streaming multipart parsers (see
+ * :c:func:`ymo_http_multipart_create`).
+ */
+typedef struct ymo_http_multipart ymo_http_multipart_t;
+
+/** Opaque struct used to represent URL routers (see
+ * :c:func:`ymo_http_router_create`).
+ */
+typedef struct ymo_http_router ymo_http_router_t;
+
+/** Route parameter, captured from the request path (see
+ * :c:func:`ymo_http_request_param`).
+ */
+typedef struct ymo_http_param {
+    const char*  name;
+    const char*  value;
+} ymo_http_param_t;
+
 
 /** Enum type used to indicate parsed HTTP method.
  */
@@ -386,6 +430,22 @@ YMO_ENUM8_TYPEDEF(ymo_http_method) {
     YMO_HTTP_METH_OTHER,
 } YMO_ENUM8_AS(ymo_http_method_t);
 
+/** Method masks, used to restrict routes (see
+ * :c:func:`ymo_http_router_add`).
+ */
+typedef enum ymo_http_route_method {
+    YMO_HTTP_ROUTE_OPTIONS = 1 << YMO_HTTP_METH_OPTIONS,
+    YMO_HTTP_ROUTE_GET     = 1 << YMO_HTTP_METH_GET,
+    YMO_HTTP_ROUTE_HEAD    = 1 << YMO_HTTP_METH_HEAD,
+    YMO_HTTP_ROUTE_POST    = 1 << YMO_HTTP_METH_POST,
+    YMO_HTTP_ROUTE_PUT     = 1 << YMO_HTTP_METH_PUT,
+    YMO_HTTP_ROUTE_DELETE  = 1 << YMO_HTTP_METH_DELETE,
+    YMO_HTTP_ROUTE_TRACE   = 1 << YMO_HTTP_METH_TRACE,
+    YMO_HTTP_ROUTE_CONNECT = 1 << YMO_HTTP_METH_CONNECT,
+    YMO_HTTP_ROUTE_OTHER   = 1 << YMO_HTTP_METH_OTHER, /* PATCH, etc */
+    YMO_HTTP_ROUTE_ANY     = (1 << (YMO_HTTP_METH_OTHER + 1)) - 1,
+} ymo_http_route_method_t;
+
 /** Convenience enums for HTTP status codes.
  *
  */
@@ -441,13 +501,327 @@ struct ymo_http_request {
     const char*           fragment;         /* URI fragment, *as received* */
     ymo_http_hdr_table_t  headers;          /* Request headers */
     ymo_blalloc_t*        ws;               /* Request workspace */
+    const ymo_http_param_t* params;         /* Route params, if routed */
+    size_t                no_params;        /* Number of route params */
     char*                 body;             /* Optionally buffered body data */
+    ymo_http_body_t*      body_spool;       /* Spooled body data, if enabled */
+    ymo_http_multipart_t* multipart;        /* Multipart parser, if attached */
     size_t                body_received;    /* Body data received */
     size_t                content_length;   /* Content-length, per client */
     ymo_http_flags_t      flags;            /* Request flags */
     void*                 user;             /* Arbitrary, per-request, user-data */
 };
 
+/** Copy up to ``len`` bytes of request body data, starting at ``offset``,
+ * into ``buf``.
+ *
+ * This works for buffered and spooled bodies alike — i.e. whether the body
+ * is in ``request->body`` or has been spilled to a file — so handlers can
+ * consume large bodies a piece at a time, without a contiguous copy.
+ * ``request->body_received`` is the number of bytes available.
+ *
+ * :returns: number of bytes copied (0 at the end of the received data), or
+ *           -1 with ``errno`` set on failure.
+ */
+ssize_t ymo_http_request_body_pread(
+        const ymo_http_request_t* request,
+        void* buf,
+        size_t len,
+        size_t offset);
+
+/** Get the value of a route parameter (see :c:func:`ymo_http_router_add`).
+ *
+ * :param request: a request dispatched by a router
+ * :param name: param name, as given in the route pattern (``"*"`` for an
+ *     unnamed wildcard)
+ * :returns: the captured value (allocated from the request workspace), or
+ *     NULL if there's no such param.
+ */
+const char* ymo_http_request_param(
+        const ymo_http_request_t* request, const char* name);
+
+/** Query Strings and Forms
+ * ........................
+ *
+ * ``request->query`` is left exactly as received. The functions below
+ * decode it on demand — only the pairs (or the single value) a handler
+ * actually asks for are decoded, into the request workspace, so there's
+ * nothing to free.
+ *
+ * Decoding is lenient, in the manner of browsers: ``+`` is a space, valid
+ * ``%XX`` escapes are decoded, and malformed escapes are passed through
+ * as-is.
+ *
+ * URL-encoded (``application/x-www-form-urlencoded``) bodies can be parsed
+ * incrementally, from a ``body_cb``, with :c:type:`ymo_http_form_t`.
+ */
+
+/** Percent-decode ``len`` bytes of ``src`` into ``dst``. ``dst`` must have
+ * room for ``len`` bytes; it may be the same as ``src`` (decoding in place).
+ * The result is *not* NUL-terminated.
+ *
+ * :param form: if nonzero, decode ``+`` as a space (for query strings and
+ *     form data — *not* paths).
+ * :returns: the decoded length.
+ */
+size_t ymo_http_url_decode(char* dst, const char* src, size_t len, int form);
+
+/** Query string iterator (see :c:func:`ymo_http_query_next`). */
+typedef struct ymo_http_query_iter {
+    const char* p;
+    const char* end;
+} ymo_http_query_iter_t;
+
+/** Begin iterating over the ``key=value`` pairs in ``query`` (typically
+ * ``request->query``; NULL is treated as empty).
+ */
+void ymo_http_query_iter_init(ymo_http_query_iter_t* iter, const char* query);
+
+/** Decode the next pair from a query string. Empty pairs are skipped; a pair
+ * with no ``=`` has an empty value.
+ *
+ * .. code-block:: c
+ *
+ *    ymo_http_query_iter_t iter;
+ *    const char* key;
+ *    const char* value;
+ *
+ *    ymo_http_query_iter_init(&iter, request->query);
+ *    while( ymo_http_query_next(&iter, request->ws, &key, &value) > 0 ) {
+ *        ...
+ *    }
+ *
+ * :param ws: workspace for the decoded key and value (usually
+ *     ``request->ws``)
+ * :returns: 1 if ``key`` and ``value`` were set; 0 at the end of the query
+ *     string; -1 with ``errno`` set to ``ENOMEM`` if the workspace is full.
+ */
+int ymo_http_query_next(
+        ymo_http_query_iter_t* iter,
+        ymo_blalloc_t* ws,
+        const char** key,
+        const char** value);
+
+/** Get the (decoded) value of the first query parameter named ``name``.
+ *
+ * Keys are compared without decoding them and only the matching value is
+ * decoded, so this is cheaper than iterating when a handler only needs a
+ * parameter or two.
+ *
+ * :returns: the value (allocated from the request workspace — ``""`` if
+ *     the parameter has no ``=``), or NULL if there's no such parameter or
+ *     the workspace is full (``errno`` is ``ENOENT`` or ``ENOMEM``,
+ *     respectively).
+ */
+const char* ymo_http_request_query(
+        ymo_http_request_t* request, const char* name);
+
+/** Form field callback (see :c:type:`ymo_http_form_t`).
+ *
+ * ``key`` and ``value`` are decoded, NUL-terminated, and only valid for the
+ * duration of the callback. ``value_len`` is provided for values that
+ * contain (decoded) NUL bytes.
+ *
+ * :returns: ``YMO_OKAY`` to continue parsing; any other value stops the
+ *     parser and is returned from :c:func:`ymo_http_form_feed` or
+ *     :c:func:`ymo_http_form_finish`.
+ */
+typedef ymo_status_t (*ymo_http_form_cb_t)(
+        void* data, const char* key, const char* value, size_t value_len);
+
+/** Streaming ``application/x-www-form-urlencoded`` parser.
+ *
+ * Body data can be fed to the parser in chunks of any size (e.g. as it
+ * arrives in a ``body_cb``); fields are passed to the callback as each one
+ * is completed. The parser doesn't allocate: fields are decoded into a
+ * buffer supplied by the caller, which bounds the size of a single field
+ * (key and value, decoded, plus two bytes).
+ *
+ * .. code-block:: c
+ *
+ *    static ymo_status_t my_body_cb(
+ *            ymo_http_session_t* session,
+ *            ymo_http_request_t* request,
+ *            ymo_http_response_t* response,
+ *            const char* data,
+ *            size_t len,
+ *            void* user_data)
+ *    {
+ *        ymo_http_form_t* form = request->user;
+ *        if( !form ) {
+ *            form = ymo_blalloc(request->ws, alignof(ymo_http_form_t),
+ *                    sizeof(ymo_http_form_t));
+ *            char* buf = ymo_blalloc(request->ws, 1, 1024);
+ *            if( !form || !buf ) {
+ *                return ENOMEM;
+ *            }
+ *            ymo_http_form_init(form, buf, 1024, &my_field_cb, NULL);
+ *            request->user = form;
+ *        }
+ *        return ymo_http_form_feed(form, data, len);
+ *    }
+ *
+ * ...and call :c:func:`ymo_http_form_finish` from the ``http_cb`` to
+ * flush the last field.
+ */
+typedef struct ymo_http_form {
+    ymo_http_form_cb_t  cb;
+    void*               data;
+    char*               buf;      /* Decoded key, NUL, value, NUL */
+    size_t              buf_len;
+    size_t              len;      /* Bytes used in buf */
+    size_t              key_len;  /* Key length, or SIZE_MAX before '=' */
+    uint8_t             pct;      /* Bytes of a pending %XX escape seen */
+    char                pct_hi;   /* ...and the first hex digit, if any */
+} ymo_http_form_t;
+
+/** Initialize a form parser.
+ *
+ * :param buf: field buffer (e.g. from ``request->ws``)
+ * :param buf_len: size of ``buf``
+ * :param cb: callback invoked once per field
+ * :param data: passed to ``cb``
+ */
+void ymo_http_form_init(
+        ymo_http_form_t* form,
+        char* buf,
+        size_t buf_len,
+        ymo_http_form_cb_t cb,
+        void* data);
+
+/** Feed body data to a form parser.
+ *
+ * :returns: ``YMO_OKAY`` on success; ``EFBIG`` if a field doesn't fit the
+ *     field buffer; or the first non-``YMO_OKAY`` callback return value.
+ */
+ymo_status_t ymo_http_form_feed(
+        ymo_http_form_t* form, const char* data, size_t len);
+
+/** Flush the last field (if any) at the end of the body and reset the
+ * parser.
+ *
+ * :returns: as for :c:func:`ymo_http_form_feed`.
+ */
+ymo_status_t ymo_http_form_finish(ymo_http_form_t* form);
+
+/** Multipart Bodies
+ * .................
+ *
+ * ``multipart/form-data`` (and other ``multipart`` types) bodies can be parsed
+ * as they arrive, without holding the whole request in memory: feed each
+ * ``body_cb`` chunk to a :c:type:`ymo_http_multipart_t`, which passes the
+ * headers and data of each part to a set of callbacks — or writes part data
+ * straight to a file descriptor.
+ *
+ * Boundaries are located with a Boyer-Moore-Horspool search, so most body
+ * bytes are never examined individually.
+ */
+
+/** A single part of a multipart body. */
+typedef struct ymo_http_part {
+    const char*  name;          /* Content-Disposition name, or NULL */
+    const char*  filename;      /* Content-Disposition filename, or NULL */
+    const char*  content_type;  /* Part Content-Type, or NULL */
+    int          fd;            /* If >= 0, part data is written here */
+    size_t       len;           /* Part data received so far */
+    void*        user;          /* Arbitrary, per-part, user data */
+} ymo_http_part_t;
+
+/** Multipart callbacks. Any of them may be NULL.
+ *
+ * - ``header_cb`` is invoked for each part header field, as it's parsed.
+ * - ``begin_cb`` is invoked once the part headers are complete (``name``,
+ *   ``filename``, and ``content_type`` are set). To have the part data
+ *   written to a file, set ``part->fd`` here.
+ * - ``data_cb`` is invoked with each piece of part data (unless
+ *   ``part->fd`` was set).
+ * - ``end_cb`` is invoked at the end of each part for which ``begin_cb``
+ *   was invoked: with ``YMO_OKAY`` if the part is complete, or with the
+ *   error that stopped the parser (``ECONNABORTED`` if the parser was freed
+ *   before the body was complete). It's the place to close ``part->fd``.
+ *
+ * Header strings are valid until the end of the part. Non-``YMO_OKAY``
+ * returns stop the parser.
+ */
+typedef struct ymo_http_multipart_cb {
+    ymo_status_t (*header_cb)(void* data, ymo_http_part_t* part,
+            const char* name, const char* value);
+    ymo_status_t (*begin_cb)(void* data, ymo_http_part_t* part);
+    ymo_status_t (*data_cb)(void* data, ymo_http_part_t* part,
+            const char* buf, size_t len);
+    void (*end_cb)(void* data, ymo_http_part_t* part, ymo_status_t status);
+} ymo_http_multipart_cb_t;
+
+/** Create a multipart parser.
+ *
+ * :param content_type: the request ``Content-Type`` (which must be
+ *     a ``multipart`` type, with a ``boundary`` parameter)
+ * :param cb: callbacks (copied)
+ * :param data: passed to the callbacks
+ * :returns: a new parser, or NULL with ``errno`` set to ``EINVAL`` (not a
+ *     multipart content type, or a bad boundary) or ``ENOMEM``.
+ */
+ymo_http_multipart_t* ymo_http_multipart_create(
+        const char* content_type,
+        const ymo_http_multipart_cb_t* cb,
+        void* data);
+
+/** Feed body data to a multipart parser.
+ *
+ * :returns: ``YMO_OKAY`` on success; ``EBADMSG`` if the body is malformed;
+ *     ``EFBIG`` if a part's headers exceed 2KiB; an error from ``write``;
+ *     or the first non-``YMO_OKAY`` callback return value. Errors are
+ *     sticky: once one is returned, the parser returns it for any further
+ *     input.
+ */
+ymo_status_t ymo_http_multipart_feed(
+        ymo_http_multipart_t* mp, const char* data, size_t len);
+
+/** Signal the end of the body.
+ *
+ * :returns: ``YMO_OKAY`` if the closing boundary was seen; ``EBADMSG`` if
+ *     the body was truncated; otherwise, any error previously returned by
+ *     :c:func:`ymo_http_multipart_feed`.
+ */
+ymo_status_t ymo_http_multipart_finish(ymo_http_multipart_t* mp);
+
+/** Free a multipart parser (see ``end_cb``, above). */
+void ymo_http_multipart_free(ymo_http_multipart_t* mp);
+
+/** Create a multipart parser for ``request`` (from its ``Content-Type``)
+ * and attach it as ``request->multipart``. The parser is freed along with
+ * the request — including if the connection closes mid-upload.
+ *
+ * .. code-block:: c
+ *
+ *    static ymo_status_t my_body_cb(
+ *            ymo_http_session_t* session,
+ *            ymo_http_request_t* request,
+ *            ymo_http_response_t* response,
+ *            const char* data,
+ *            size_t len,
+ *            void* user_data)
+ *    {
+ *        if( !request->multipart ) {
+ *            ymo_status_t status = ymo_http_request_multipart(
+ *                    request, &my_upload_cb, NULL);
+ *            if( status != YMO_OKAY ) {
+ *                return status;
+ *            }
+ *        }
+ *        return ymo_http_multipart_feed(request->multipart, data, len);
+ *    }
+ *
+ * ...and call :c:func:`ymo_http_multipart_finish` from the ``http_cb``.
+ *
+ * :returns: ``YMO_OKAY`` on success; ``EBUSY`` if a parser is already
+ *     attached; or as for :c:func:`ymo_http_multipart_create`.
+ */
+ymo_status_t ymo_http_request_multipart(
+        ymo_http_request_t* request,
+        const ymo_http_multipart_cb_t* cb,
+        void* data);
+
 /** Responses
  * ...........
  */
@@ -541,6 +915,579 @@ void ymo_http_response_finish(ymo_http_response_t* response);
  */
 int ymo_http_response_finished(const ymo_http_response_t* response);
 
+/** Flow Control
+ * ..............
+ *
+ * :c:func:`ymo_http_response_body_append` never refuses data, so a handler
+ * streaming a large (or endless) body can get arbitrarily far ahead of a
+ * slow client. To produce only as fast as the client reads, check
+ * :c:func:`ymo_http_response_writable` before appending, and resume from a
+ * drain callback:
+ *
+ * .. code-block:: c
+ *
+ *    static ymo_status_t produce(
+ *            ymo_http_session_t* session,
+ *            ymo_http_response_t* response,
+ *            void* user_data)
+ *    {
+ *        my_stream_t* stream = user_data;
+ *        while( ymo_http_response_writable(response) ) {
+ *            if( !my_stream_next(stream, response) ) {
+ *                ymo_http_response_finish(response);
+ *                break;
+ *            }
+ *        }
+ *        return YMO_OKAY;
+ *    }
+ *
+ *    // In the http callback:
+ *    ymo_http_response_on_drain(response, &produce, stream);
+ *    return produce(session, response, stream);
+ *
+ * Queued output is counted from the time data is appended until it's been
+ * written to the socket (for HTTP/2: until it's been framed, subject to
+ * flow control). For HTTP/1.x, it includes output from earlier pipelined
+ * responses which hasn't gone out yet.
+ */
+
+/** Default queued byte count at which a response stops being writable. */
+#define YMO_HTTP_HIGH_WATER_DEFAULT (64 * 1024)
+
+/** Default queued byte count at which the drain callback is invoked. */
+#define YMO_HTTP_LOW_WATER_DEFAULT  (16 * 1024)
+
+/** Drain callback.
+ *
+ * Invoked once each time queued output falls to the low-water mark after
+ * having reached the high-water mark (i.e. after the response became
+ * unwritable), until the response is finished.
+ *
+ * :param session: The client HTTP session
+ * :param response: The response which has drained
+ * :param user_data: As passed to :c:func:`ymo_http_response_on_drain`
+ * :returns: ``YMO_OKAY`` on success; an ``errno`` value to close the
+ *     connection (HTTP/1.x) or reset the stream (HTTP/2).
+ */
+typedef ymo_status_t (*ymo_http_drain_cb_t)(
+        ymo_http_session_t* session,
+        ymo_http_response_t* response,
+        void* user_data);
+
+/** Set the high and low water marks for a response (see
+ * :c:macro:`YMO_HTTP_HIGH_WATER_DEFAULT` and
+ * :c:macro:`YMO_HTTP_LOW_WATER_DEFAULT`).
+ *
+ * :param response: the HTTP response object to modify
+ * :param high: queued byte count at which the response is no longer writable
+ * :param low: queued byte count at which the drain callback is invoked
+ *     (clamped to ``high``)
+ */
+void ymo_http_response_set_watermarks(
+        ymo_http_response_t* response, size_t high, size_t low);
+
+/** :returns: the number of bytes appended to the response (or ahead of it)
+ *     which haven't been sent yet.
+ */
+size_t ymo_http_response_queued(const ymo_http_response_t* response);
+
+/** :returns: true if queued output is below the response's high-water mark;
+ *     false otherwise.
+ */
+int ymo_http_response_writable(const ymo_http_response_t* response);
+
+/** Set the callback invoked when queued output drains to the low-water
+ * mark. Pass a NULL ``drain_cb`` to clear it.
+ *
+ * :param response: the HTTP response object to modify
+ * :param drain_cb: callback to invoke
+ * :param user_data: passed to ``drain_cb``
+ */
+void ymo_http_response_on_drain(
+        ymo_http_response_t* response,
+        ymo_http_drain_cb_t drain_cb,
+        void* user_data);
+
+/** Compression
+ * .............
+ *
+ * When compression is enabled for the protocol (see
+ * :c:func:`ymo_http_set_compression`), response bodies are compressed on the
+ * way out — ``br``, ``zstd``, ``gzip``, or ``deflate``, depending on what
+ * the client accepts and what libyimmo_http was built with. Responses are
+ * left alone if they:
+ *
+ * - are to ``HEAD`` requests, or have status ``1xx``, ``204``, ``206``, or
+ *   ``304``,
+ * - already have a ``Content-Encoding`` or ``Transfer-Encoding``,
+ * - have a ``Content-Type`` that's already compressed (images, video,
+ *   archives, etc) or missing, or ``Cache-Control: no-transform``,
+ * - are complete and smaller than the minimum size,
+ * - are streamed (i.e. not finished before the headers are sent) with an
+ *   application-supplied ``Content-Length``,
+ * - contain file buckets (see :c:func:`ymo_bucket_create_file`).
+ *
+ * ``Vary: Accept-Encoding`` is added to responses which *could* have been
+ * compressed.
+ */
+
+/** Use the protocol default compression level for this response. */
+#define YMO_HTTP_COMPRESS_DEFAULT (-1)
+
+/** Override the compression level for a single response (e.g. per route):
+ * ``0`` disables compression; ``1``–``9`` are as for zlib (and are used
+ * as-is for brotli quality and zstd level).
+ *
+ * Must be called before the response headers are sent (i.e. from the
+ * :c:type:`ymo_http_cb_t` invocation, or before the first body append).
+ * Has no effect if compression isn't enabled on the protocol.
+ */
+void ymo_http_response_set_compression(
+        ymo_http_response_t* response, int level);
+
+/** Canned Responses
+ * ..................
+ *
+ * For hot, unchanging endpoints (health checks, load-balancer probes, fixed
+ * error payloads), a complete response can be serialized *once* and sent
+ * from :c:type:`ymo_http_cb_t` by reference — no header table, no
+ * ``Content-Length`` formatting, no body copy:
+ *
+ * .. code-block:: c
+ *
+ *    static ymo_http_canned_t* health_ok;
+ *
+ *    // At startup:
+ *    ymo_http_hdr_table_t* hdrs = ymo_http_hdr_table_create();
+ *    ymo_http_hdr_table_insert(hdrs, "Content-Type", "application/json");
+ *    health_ok = ymo_http_canned_create(
+ *            YMO_HTTP_OK, hdrs, "{\"ok\":true}", 11);
+ *    ymo_http_hdr_table_free(hdrs);
+ *
+ *    // In the http callback:
+ *    return ymo_http_response_send_canned(response, health_ok);
+ *
+ * ``Connection`` is still chosen per-request (keep-alive vs close, HTTP/1.0
+ * vs 1.1): every variant is pre-serialized, too. Server-generated ``Date``
+ * and ``Server`` headers (see :c:type:`ymo_http_proto_flags_t`) are
+ * spliced in at send time, unless the canned headers include them.
+ */
+
+/** Opaque, immutable, pre-serialized HTTP response. */
+typedef struct ymo_http_canned ymo_http_canned_t;
+
+/** Serialize a complete response (status line, headers, and body) for
+ * later use with :c:func:`ymo_http_response_send_canned`.
+ *
+ * ``headers`` may not contain ``Content-Length``, ``Transfer-Encoding``, or
+ * ``Connection`` — they're generated.
+ *
+ * Responses with status ``1xx``, ``204``, or ``304`` are serialized without
+ * ``Content-Length`` or a body (``body`` is ignored). Responses to ``HEAD``
+ * requests are sent without the body.
+ *
+ * :param status: the integer HTTP status code
+ * :param headers: response headers (copied; may be NULL)
+ * :param body: response body (copied; may be NULL if ``body_len`` is 0)
+ * :param body_len: length of ``body``
+ * :returns: a new canned response on success; NULL with errno set on failure
+ */
+ymo_http_canned_t* ymo_http_canned_create(
+        ymo_http_status_t status,
+        ymo_http_hdr_table_t* headers,
+        const char* body,
+        size_t body_len);
+
+/** Free a canned response.
+ *
+ * .. warning::
+ *    Responses reference the canned data until they've been sent, so it
+ *    must outlive the server(s) using it (typically, program lifetime).
+ */
+void ymo_http_canned_free(ymo_http_canned_t* canned);
+
+/** Send a canned response and mark ``response`` finished. Any headers or
+ * body data already added to ``response`` are ignored.
+ *
+ * :param response: the HTTP response object to send
+ * :param canned: the canned response to send (may be shared by any number of
+ *     responses/threads)
+ * :returns: YMO_OKAY on success; EINVAL if ``canned`` is NULL
+ */
+ymo_status_t ymo_http_response_send_canned(
+        ymo_http_response_t* response, const ymo_http_canned_t* canned);
+
+
+/** Static Files
+ * ..............
+ *
+ * A static file handler maps a URL prefix onto a directory:
+ *
+ * .. code-block:: c
+ *
+ *    // At startup (one per thread/event loop):
+ *    ymo_http_static_t* assets = ymo_http_static_create("/assets", "./www");
+ *
+ *    // In the http callback:
+ *    ymo_status_t status = ymo_http_static_serve(assets, request, response);
+ *    if( status != ENOENT ) {
+ *        return status;
+ *    }
+ *    // ...not under /assets: handle the request some other way...
+ *
+ * Files are sent from open file descriptors (via ``sendfile(2)``, where
+ * available). The handler:
+ *
+ * - rejects paths containing ``..`` segments (after percent-decoding),
+ * - keeps an LRU cache of open descriptors and ``stat`` data, revalidated
+ *   against the filesystem at an interval (see
+ *   :c:func:`ymo_http_static_set_cache`),
+ * - sends ``ETag``, ``Last-Modified`` and ``Accept-Ranges``, and answers
+ *   ``If-None-Match`` / ``If-Modified-Since`` with ``304``,
+ * - honors single and multiple byte ranges (``206``, ``multipart/byteranges``),
+ *   subject to ``If-Range``,
+ * - serves precompressed ``.br``, ``.zst`` or ``.gz`` siblings of a file
+ *   when the client accepts that encoding,
+ * - serves ``index.html`` for directories (redirecting to add a trailing
+ *   ``/``, if needed).
+ *
+ * Only ``GET`` and ``HEAD`` are allowed. Symbolic links within the root
+ * are followed.
+ *
+ * .. warning::
+ *    Handlers aren't thread-safe: create one per thread/event loop.
+ */
+
+/** Opaque static file handler. */
+typedef struct ymo_http_static ymo_http_static_t;
+
+/** Create a static file handler.
+ *
+ * :param prefix: URL prefix to serve (e.g. ``"/static"``; ``"/"`` for all)
+ * :param root: document root directory
+ * :returns: a new handler on success; NULL with errno set on failure
+ */
+ymo_http_static_t* ymo_http_static_create(const char* prefix, const char* root);
+
+/** Set the open file cache size and revalidation interval.
+ *
+ * :param max_files: maximum number of cached files (including negative
+ *     entries)
+ * :param revalidate: seconds before a cached entry is re-checked against
+ *     the filesystem (0: check every request)
+ * :returns: YMO_OKAY on success; EINVAL if ``max_files`` is 0; ENOMEM
+ */
+ymo_status_t ymo_http_static_set_cache(
+        ymo_http_static_t* handler, size_t max_files, unsigned int revalidate);
+
+/** Enable or disable serving precompressed siblings (enabled by default).
+ */
+void ymo_http_static_set_precompressed(ymo_http_static_t* handler, int flag);
+
+/** Serve a request from the handler's document root.
+ *
+ * :param handler: the static file handler
+ * :param request: the HTTP request
+ * :param response: the HTTP response (finished on return, unless ENOENT)
+ * :returns: YMO_OKAY if a response was issued (including error responses,
+ *     e.g. 404, 405); ENOENT if the request path is outside of the
+ *     handler's prefix, in which case ``response`` is untouched.
+ */
+ymo_status_t ymo_http_static_serve(
+        ymo_http_static_t* handler,
+        ymo_http_request_t* request,
+        ymo_http_response_t* response);
+
+/** :c:type:`ymo_http_cb_t` which serves everything from the
+ * :c:type:`ymo_http_static_t` passed as ``user_data`` (404, outside of the
+ * prefix).
+ */
+ymo_status_t ymo_http_static_cb(
+        ymo_http_session_t* session,
+        ymo_http_request_t* request,
+        ymo_http_response_t* response,
+        void* user_data);
+
+/** Free a static file handler and close its cached files. */
+void ymo_http_static_free(ymo_http_static_t* handler);
+
+
+/** Server-Sent Events
+ * ....................
+ *
+ * An SSE hub holds any number of channels, each with its own subscribers,
+ * event ids, and replay buffer:
+ *
+ * .. code-block:: c
+ *
+ *    // At startup (one per thread/event loop):
+ *    ymo_http_sse_hub_t* hub = ymo_http_sse_hub_create(loop, 15.0);
+ *    ymo_http_sse_channel_t* news = ymo_http_sse_channel_create(hub, 256);
+ *
+ *    // In the http callback:
+ *    return ymo_http_sse_subscribe(news, request, response);
+ *
+ *    // Whenever there's something to say:
+ *    ymo_http_sse_publish(news, "headline", data, data_len);
+ *
+ * Each published event is formatted once (``id``, ``event``, and one
+ * ``data`` line per line of data) and the same bytes are queued, by
+ * reference, on every subscriber's response. Events are numbered per
+ * channel, starting at 1; the last ``replay`` of them are kept so that a
+ * client which reconnects with ``Last-Event-ID`` gets what it missed.
+ *
+ * Subscribers which haven't been sent anything for ``keepalive`` seconds get
+ * a comment line, so intermediaries don't time the stream out. This is
+ * driven by one timer per hub, not per connection: the hub keeps its
+ * subscribers in order of last write and only visits the idle ones.
+ *
+ * A subscriber whose response goes over its high water mark (see
+ * :c:func:`ymo_http_response_writable`) is cut off — its response is
+ * finished — rather than queueing without bound. The client reconnects and
+ * catches up from the replay buffer.
+ *
+ * SSE responses aren't compressed (the encoded event is shared), and
+ * HTTP/1.0 clients, which can't receive a streamed response, get a ``505``.
+ *
+ * .. warning::
+ *    Hubs aren't thread-safe: create one per thread/event loop.
+ */
+
+/** Opaque SSE hub: channels plus the keep-alive timer. */
+typedef struct ymo_http_sse_hub ymo_http_sse_hub_t;
+
+/** Opaque SSE channel. */
+typedef struct ymo_http_sse_channel ymo_http_sse_channel_t;
+
+/** Create an SSE hub.
+ *
+ * :param loop: event loop to run the keep-alive timer on
+ * :param keepalive: seconds of silence after which subscribers are sent a
+ *     comment (0, for none)
+ * :returns: a new hub on success; NULL with errno set on failure
+ */
+ymo_http_sse_hub_t* ymo_http_sse_hub_create(
+        struct ev_loop* loop, double keepalive);
+
+/** Free a hub and all of its channels (see
+ * :c:func:`ymo_http_sse_channel_free`).
+ */
+void ymo_http_sse_hub_free(ymo_http_sse_hub_t* hub);
+
+/** Create a channel.
+ *
+ * :param hub: the hub the channel belongs to
+ * :param replay: number of events to keep for ``Last-Event-ID`` replay
+ * :returns: a new channel on success; NULL with errno set on failure
+ */
+ymo_http_sse_channel_t* ymo_http_sse_channel_create(
+        ymo_http_sse_hub_t* hub, size_t replay);
+
+/** Set the reconnection time sent to new subscribers (the SSE ``retry``
+ * field), in milliseconds. 0 (the default) leaves it to the client.
+ */
+void ymo_http_sse_channel_set_retry(
+        ymo_http_sse_channel_t* channel, unsigned int retry_ms);
+
+/** :returns: the number of subscribers to a channel. */
+size_t ymo_http_sse_channel_subscribers(
+        const ymo_http_sse_channel_t* channel);
+
+/** Free a channel, finishing its subscribers' responses. */
+void ymo_http_sse_channel_free(ymo_http_sse_channel_t* channel);
+
+/** Start an event stream on ``response`` and subscribe it to ``channel``.
+ *
+ * Sets the status and headers, sends the ``retry`` field (if set) and any
+ * events after the request's ``Last-Event-ID`` which are still in the replay
+ * buffer. The subscription ends when the response is freed (e.g. the client
+ * disconnects) or the channel is freed.
+ *
+ * :param channel: the channel to subscribe to
+ * :param request: the HTTP request
+ * :param response: the HTTP response
+ * :returns: ``YMO_WOULDBLOCK`` on success (return it from the http callback);
+ *     ``YMO_OKAY`` if an error response was issued instead (HTTP/1.0);
+ *     ``ENOMEM``
+ */
+ymo_status_t ymo_http_sse_subscribe(
+        ymo_http_sse_channel_t* channel,
+        ymo_http_request_t* request,
+        ymo_http_response_t* response);
+
+/** Publish an event to every subscriber of a channel.
+ *
+ * :param channel: the channel to publish to
+ * :param event: event type (the SSE ``event`` field), or NULL for the
+ *     default (``"message"``)
+ * :param data: event data; line breaks (CR, LF, or CRLF) split it into
+ *     multiple ``data`` lines
+ * :param len: length of ``data``
+ * :returns: ``YMO_OKAY`` on success; ``EINVAL`` if ``event`` contains a line
+ *     break; ``ENOMEM``
+ */
+ymo_status_t ymo_http_sse_publish(
+        ymo_http_sse_channel_t* channel,
+        const char* event,
+        const char* data,
+        size_t len);
+
+
+/** Reverse Proxy
+ * ...............
+ *
+ * A reverse proxy relays requests to a set of upstream HTTP/1.1 servers,
+ * over nonblocking connections on the same event loop as the server:
+ *
+ * .. code-block:: c
+ *
+ *    // At startup (one per thread/event loop):
+ *    ymo_http_proxy_t* api = ymo_http_proxy_create(loop);
+ *    ymo_http_proxy_add_upstream(api, "10.0.0.10", 8080, 32);
+ *    ymo_http_proxy_add_upstream(api, "10.0.0.11", 8080, 32);
+ *
+ *    // In the http callback:
+ *    return ymo_http_proxy_serve(api, request, response);
+ *
+ * Each request goes to the upstream with the fewest requests in flight
+ * (ties go round-robin), on an idle keep-alive connection from that
+ * upstream's pool, if there is one. Connections go back to the pool once
+ * the upstream response has been read, up to ``max_idle`` per upstream.
+ * A request which fails on a pooled connection before any response arrives
+ * (i.e. the upstream closed it while it was idle) is retried on a new
+ * connection, if its method is idempotent.
+ *
+ * Request headers are forwarded from the parsed header table, less
+ * hop-by-hop fields (``Connection``, ``Keep-Alive``, ``Transfer-Encoding``,
+ * ``TE``, ``Upgrade``, and the like, and whatever ``Connection`` lists),
+ * and with the client address appended to ``X-Forwarded-For``. The request
+ * body is sent as-is from the request buffer or spool (see
+ * :c:func:`ymo_http_set_body_spool`), without another copy.
+ *
+ * Upstream responses are relayed as they arrive: headers are passed through
+ * (again, less hop-by-hop fields) without copying, and body data is handed
+ * to the client as it's read. When the client falls behind (see
+ * :c:func:`ymo_http_response_writable`), the proxy stops reading from the
+ * upstream until it drains. Responses aren't compressed by yimmo: whatever
+ * content-coding the upstream applied is passed along.
+ *
+ * Large response bodies (with a ``Content-Length`` of at least
+ * :c:macro:`YMO_HTTP_PROXY_SPLICE_DEFAULT` bytes; see
+ * :c:func:`ymo_http_proxy_set_splice`) bound for plain — i.e. not TLS —
+ * HTTP/1.1 clients are relayed through a pipe with ``splice(2)``, so the
+ * payload never gets copied into user space (see :c:func:`ymo_pipe_create`).
+ * The proxy stops reading from the upstream while the pipe is full, too.
+ *
+ * If the upstream can't be reached, or fails before sending a response
+ * head, the client gets a ``502`` (``504``, if it timed out). If it fails
+ * partway through the body, the client connection is closed.
+ *
+ * .. note::
+ *    Upgrades (e.g. WebSockets) aren't proxied.
+ *
+ * .. warning::
+ *    Proxies aren't thread-safe: create one per thread/event loop.
+ */
+
+/** Opaque reverse proxy. */
+typedef struct ymo_http_proxy ymo_http_proxy_t;
+
+/** Default seconds of upstream inactivity before a request times out. */
+#define YMO_HTTP_PROXY_TIMEOUT_DEFAULT 30.0
+
+/** Default smallest response body relayed with ``splice(2)``. */
+#define YMO_HTTP_PROXY_SPLICE_DEFAULT 65536
+
+/** Per-upstream proxy statistics. */
+typedef struct ymo_http_proxy_stats {
+    size_t  requests;    /* Requests sent */
+    size_t  connects;    /* Connections opened */
+    size_t  reused;      /* Requests sent on pooled connections */
+    size_t  retries;     /* Requests retried after a stale connection */
+    size_t  errors;      /* Requests which failed */
+    size_t  outstanding; /* Requests in flight */
+    size_t  idle;        /* Pooled connections */
+    size_t  spliced;     /* Response body bytes relayed via splice */
+} ymo_http_proxy_stats_t;
+
+/** Create a reverse proxy.
+ *
+ * :param loop: event loop to run upstream connections on (i.e. the
+ *     server's)
+ * :returns: a new proxy on success; NULL with errno set on failure
+ */
+ymo_http_proxy_t* ymo_http_proxy_create(struct ev_loop* loop);
+
+/** Add an upstream server.
+ *
+ * The address is resolved right away (i.e. this may block).
+ *
+ * :param proxy: the proxy
+ * :param host: upstream host name or address
+ * :param port: upstream port
+ * :param max_idle: most idle connections to keep open to the upstream
+ * :returns: YMO_OKAY on success; EINVAL if ``host`` can't be resolved;
+ *     ENOMEM
+ */
+ymo_status_t ymo_http_proxy_add_upstream(
+        ymo_http_proxy_t* proxy,
+        const char* host,
+        int port,
+        size_t max_idle);
+
+/** Set the seconds of upstream inactivity (connecting, or waiting on
+ * response data) after which a request fails with ``504``, and after which
+ * idle pooled connections are closed.
+ */
+void ymo_http_proxy_set_timeout(ymo_http_proxy_t* proxy, double timeout);
+
+/** Set the smallest upstream response body (by ``Content-Length``) which
+ * is relayed to the client with ``splice(2)``, rather than read and sent
+ * back out. Pass 0 to turn splicing off (it's always off where
+ * ``splice(2)`` isn't available).
+ */
+void ymo_http_proxy_set_splice(ymo_http_proxy_t* proxy, size_t min_len);
+
+/** Get the statistics for an upstream.
+ *
+ * :param proxy: the proxy
+ * :param upstream: upstream index (in the order they were added)
+ * :param stats: filled in on success
+ * :returns: YMO_OKAY on success; EINVAL if there's no such upstream
+ */
+ymo_status_t ymo_http_proxy_stats(
+        const ymo_http_proxy_t* proxy,
+        size_t upstream,
+        ymo_http_proxy_stats_t* stats);
+
+/** Relay a request to an upstream.
+ *
+ * :param proxy: the proxy
+ * :param request: the HTTP request (with its body, if any)
+ * :param response: the HTTP response
+ * :returns: ``YMO_WOULDBLOCK`` if the request is on its way (return it from
+ *     the http callback); ``YMO_OKAY`` if an error response was issued
+ *     instead (e.g. ``502``, with no upstreams); ``ENOMEM``
+ */
+ymo_status_t ymo_http_proxy_serve(
+        ymo_http_proxy_t* proxy,
+        ymo_http_request_t* request,
+        ymo_http_response_t* response);
+
+/** :c:type:`ymo_http_cb_t` which relays everything to the
+ * :c:type:`ymo_http_proxy_t` passed as ``user_data``.
+ */
+ymo_status_t ymo_http_proxy_cb(
+        ymo_http_session_t* session,
+        ymo_http_request_t* request,
+        ymo_http_response_t* response,
+        void* user_data);
+
+/** Free a proxy, closing its upstream connections. Requests still in
+ * flight fail as though their upstream had.
+ */
+void ymo_http_proxy_free(ymo_http_proxy_t* proxy);
+
 
 /**---------------------------------------------------------------
  * Sessions
@@ -554,6 +1501,24 @@ void ymo_http_session_set_userdata(ymo_http_session_t* session, void* data);
  */
 void* ymo_http_session_get_userdata(const ymo_http_session_t* session);
 
+/** Stop reading from the session's connection.
+ *
+ * Use this to push back on a client when a body consumer (e.g. a
+ * ``body_cb`` handing data off elsewhere) falls behind: once the socket
+ * buffers fill, TCP flow control throttles the sender. Data which has
+ * already been received is still delivered.
+ *
+ * .. note::
+ *
+ *    For HTTP/2, this pauses every stream on the connection.
+ *    The server idle timeout still applies while paused.
+ */
+void ymo_http_session_pause(ymo_http_session_t* session);
+
+/** Resume reading from a session paused by :c:func:`ymo_http_session_pause`.
+ */
+void ymo_http_session_resume(ymo_http_session_t* session);
+
 
 /**---------------------------------------------------------------
  * Callbacks
@@ -654,12 +1619,27 @@ typedef struct ymo_http_upgrade_handler {
 } ymo_http_upgrade_handler_t;
 
 
-/** Yimmo has no HTTP/2 support, at the moment. This callback can be used to
- * reject an upgrade exchange for h2c over HTTP/1.0 or HTTP/1.1.
+/** Upgrade handler which declines h2c upgrades, so that the request is
+ * served over HTTP/1.x (see :c:func:`ymo_http2_upgrade_handler` to accept
+ * them).
  */
 ymo_http_upgrade_handler_t* ymo_http2_no_upgrade_handler(void);
 
+/** Enumeration type used to pass HTTP protocol flags to
+ * :c:func:`ymo_proto_http_create`.
+ *
+ * The ``Date`` header is formatted at most once per second (by an
+ * ``ev_periodic`` on the server's loop) and copied into each response head.
+ * Neither header is added to a response which has set it explicitly.
+ */
+typedef enum ymo_http_proto_flags {
+    YMO_HTTP_PROTO_DATE   = 0x01, /* add a "Date" header to every response */
+    YMO_HTTP_PROTO_SERVER = 0x02, /* add "Server: YMO_HTTP_SERVER_NAME" */
+} ymo_http_proto_flags_t;
+
 /** Used to create a new HTTP protocol endpoint.
+ *
+ * :param flags: bitwise-or of :c:type:`ymo_http_proto_flags_t` values
  */
 ymo_proto_t* ymo_proto_http_create(
         ymo_http_session_init_cb_t session_init,
@@ -667,7 +1647,183 @@ ymo_proto_t* ymo_proto_http_create(
         ymo_http_header_cb_t header_callback,
         ymo_http_body_cb_t body_cb,
         ymo_http_session_cleanup_cb_t session_cleanup,
-        void* data);
+        void* data,
+        ymo_http_proto_flags_t flags);
+
+/** Spool request bodies, instead of buffering them in a fixed-size
+ * (``YMO_HTTP_MAX_BODY``) heap buffer.
+ *
+ * Bodies of up to ``mem_max`` bytes are held in memory (and are available
+ * as ``request->body``, as usual). Larger bodies are spilled to an unlinked
+ * temporary file and ``request->body`` is ``NULL``; use
+ * :c:func:`ymo_http_request_body_pread` to read them. Requests whose body
+ * exceeds ``body_max`` are failed with ``413``.
+ *
+ * Only applies to protocol objects created without a ``body_cb``.
+ *
+ * :param http_proto: protocol object from :c:func:`ymo_proto_http_create`
+ * :param mem_max: largest body to hold in memory
+ * :param body_max: largest body to accept
+ *
+ * :returns: ``YMO_OKAY`` on success; ``EINVAL`` if ``body_max`` is 0 or the
+ *           protocol has a user ``body_cb``.
+ */
+ymo_status_t ymo_http_set_body_spool(
+        ymo_proto_t* http_proto, size_t mem_max, size_t body_max);
+
+/** Set the most memory a single request's line and headers may use.
+ *
+ * Header storage starts out at ``YMO_HTTP_RECV_BUF_SIZE`` bytes per
+ * connection and grows, in blocks, as large requests require (e.g. for big
+ * cookies or bearer tokens). Extra blocks are released once the request has
+ * been handled. Requests needing more than ``hdr_max`` bytes are failed with
+ * ``413``. The default is 16KiB.
+ *
+ * :param http_proto: protocol object from :c:func:`ymo_proto_http_create`
+ * :param hdr_max: header storage limit, in bytes
+ *
+ * :returns: ``YMO_OKAY`` on success; ``EINVAL`` if ``hdr_max`` is less than
+ *           ``YMO_HTTP_RECV_BUF_SIZE``.
+ */
+ymo_status_t ymo_http_set_max_header_size(
+        ymo_proto_t* http_proto, size_t hdr_max);
+
+/** Compress responses, for clients which accept it (see
+ * :ref:`Compression`).
+ *
+ * Encoder state is pooled per protocol object (i.e. per loop), so
+ * responses don't pay for allocating and initializing it each time.
+ *
+ * :param http_proto: protocol object from :c:func:`ymo_proto_http_create`
+ * :param level: default level, ``1``–``9`` (zlib scale); ``0`` disables
+ *     compression
+ * :param min_size: complete responses smaller than this are sent as-is
+ *
+ * :returns: ``YMO_OKAY`` on success; ``ENOTSUP`` if libyimmo_http was built
+ *     without zlib, brotli, or zstd; ``EINVAL`` for a bad level.
+ */
+ymo_status_t ymo_http_set_compression(
+        ymo_proto_t* http_proto, int level, size_t min_size);
+
+/** Response cache counters (see :c:func:`ymo_http_cache_stats`). */
+typedef struct ymo_http_cache_stats {
+    uint64_t  hits;       /* Answered from a fresh entry */
+    uint64_t  stale;      /* Answered from an expired entry, being refreshed */
+    uint64_t  misses;     /* Handed to the handler */
+    uint64_t  collapsed;  /* Waited on another request's miss */
+    uint64_t  stores;     /* Responses stored */
+    uint64_t  evictions;  /* Entries evicted to stay within budget */
+    size_t    entries;    /* Current number of entries */
+    size_t    bytes;      /* Current size */
+} ymo_http_cache_stats_t;
+
+/** Cache responses to ``GET`` requests in memory, and answer repeat
+ * requests without invoking ``http_cb`` (see :ref:`Microcache`).
+ *
+ * Requests are keyed on ``Host``, path, query, the negotiated
+ * content-coding (if compression is enabled), and the values of the request
+ * headers named in ``vary``. Requests with a body or an ``Authorization``
+ * header always go to the handler.
+ *
+ * A response is stored if it's complete by the time its headers are sent
+ * and it has a heuristically cacheable status (``200``, ``301``, ``404``,
+ * etc), no ``Set-Cookie``, no file buckets, and no ``Vary`` on headers
+ * outside the key. Its TTL comes from ``Cache-Control`` (``s-maxage``, then
+ * ``max-age``), else ``ttl``; ``no-store``, ``no-cache``, ``private``, or a
+ * TTL of 0 prevent caching.
+ *
+ * Concurrent misses for the same key are collapsed: one request goes to the
+ * handler and the others wait for its response. While an expired entry is
+ * being refreshed, other requests get the expired copy.
+ *
+ * Calling this again changes the settings and drops stored entries.
+ *
+ * :param http_proto: protocol object from :c:func:`ymo_proto_http_create`
+ * :param max_bytes: memory budget for stored responses; ``0`` disables the
+ *     cache
+ * :param ttl: TTL, in seconds, for responses without a ``max-age``
+ * :param vary: comma-separated request header names to include in the key
+ *     (e.g. ``"Accept-Language, Origin"``), or ``NULL``
+ *
+ * :returns: ``YMO_OKAY`` on success; ``EINVAL`` if ``vary`` names more than
+ *     8 headers; ``ENOMEM``.
+ */
+ymo_status_t ymo_http_set_cache(
+        ymo_proto_t* http_proto,
+        size_t max_bytes,
+        unsigned int ttl,
+        const char* vary);
+
+/** Copy the response cache counters into ``stats``.
+ *
+ * :returns: ``YMO_OKAY`` on success; ``EINVAL`` if the cache isn't enabled.
+ */
+ymo_status_t ymo_http_cache_stats(
+        ymo_proto_t* http_proto, ymo_http_cache_stats_t* stats);
+
+/** Create a URL router (see :ref:`Routing`).
+ *
+ * :returns: a new router, or NULL with errno set on failure.
+ */
+ymo_http_router_t* ymo_http_router_create(void);
+
+/** Add a route.
+ *
+ * Patterns are matched against the request path (``request->uri``) and are
+ * made of:
+ *
+ * - static text, matched exactly (case-sensitive);
+ * - ``:name`` segments, which match one non-empty path segment;
+ * - a final ``*`` or ``*name`` segment, which matches the rest of the path.
+ *
+ * e.g. ``"/users/:id/posts/:post"``. Static segments take precedence over
+ * ``:param``, and ``:param`` over ``*``. Captured values are available to
+ * ``cb`` via :c:func:`ymo_http_request_param`.
+ *
+ * :param router: router from :c:func:`ymo_http_router_create`
+ * :param methods: bitwise-or of :c:type:`ymo_http_route_method_t` values
+ *     (``HEAD`` requests fall back on ``GET`` routes)
+ * :param pattern: route pattern, starting with ``/``
+ * :param cb: handler for matching requests
+ *
+ * :returns: ``YMO_OKAY`` on success; ``EINVAL`` for a bad pattern (or more
+ *     than 16 params); ``EEXIST`` if the pattern
+ *     is already routed for one of ``methods``; ``EBUSY`` if the router has
+ *     been compiled; ``ENOMEM``.
+ */
+ymo_status_t ymo_http_router_add(
+        ymo_http_router_t* router,
+        unsigned int methods,
+        const char* pattern,
+        ymo_http_cb_t cb);
+
+/** Compile the routes added so far into their lookup form. No more routes
+ * can be added afterward. (:c:func:`ymo_http_set_router` compiles the
+ * router if this hasn't been called).
+ *
+ * :returns: ``YMO_OKAY`` on success; ``ENOMEM``.
+ */
+ymo_status_t ymo_http_router_compile(ymo_http_router_t* router);
+
+/** Free a router which was never passed to :c:func:`ymo_http_set_router`. */
+void ymo_http_router_free(ymo_http_router_t* router);
+
+/** Route requests for ``http_proto`` (and any HTTP/2 protocol object
+ * created from it) with ``router``.
+ *
+ * Matching requests go to the route callback; requests which match no route
+ * go to the protocol's ``http_cb`` or, if it's NULL, get a ``404``. Requests
+ * for a path which is routed, but not for the request method, get a
+ * ``405`` with an ``Allow`` header.
+ *
+ * The protocol object takes ownership of the router. (Requests in flight
+ * may refer to it, so it can't be replaced).
+ *
+ * :returns: ``YMO_OKAY`` on success; ``EBUSY`` if a router is already set;
+ *     ``ENOMEM`` if the router couldn't be compiled.
+ */
+ymo_status_t ymo_http_set_router(
+        ymo_proto_t* http_proto, ymo_http_router_t* router);
 
 /** Used to add an upgrade handler to the internal upgrade handler chain.
  */
@@ -675,6 +1831,29 @@ ymo_status_t ymo_http_add_upgrade_handler(
         ymo_proto_t* proto,
         ymo_http_upgrade_handler_t* upgrade_handler);
 
+/** Create an HTTP/2 protocol object which shares the callbacks and settings
+ * of the given HTTP/1.x protocol object. Handlers see each stream as an
+ * ordinary request/response pair.
+ *
+ * Once created, ``http_proto`` also accepts HTTP/2 with prior knowledge
+ * (i.e. connections which open with the HTTP/2 connection preface). To
+ * support h2c upgrades, add :c:func:`ymo_http2_upgrade_handler`; for TLS,
+ * register the result with :c:func:`ymo_server_add_alpn` as ``"h2"``.
+ *
+ * :param http_proto: protocol object from :c:func:`ymo_proto_http_create`
+ * :returns: a new protocol object, or NULL (with errno set) on failure
+ */
+ymo_proto_t* ymo_proto_http2_create(ymo_proto_t* http_proto);
+
+/** Upgrade handler which switches ``Upgrade: h2c`` requests to the given
+ * HTTP/2 protocol object. The upgrade request itself is answered on stream 1.
+ *
+ * .. note::
+ *    Only requests without a body are upgraded; the rest are served over
+ *    HTTP/1.1.
+ */
+ymo_http_upgrade_handler_t* ymo_http2_upgrade_handler(ymo_proto_t* h2_proto);
+
 
 /**---------------------------------------------------------------
  * Quickstart
@@ -683,7 +1862,8 @@ ymo_status_t ymo_http_add_upgrade_handler(
 /** Create a server by
  *
  * - invoking :c:func:`ymo_proto_http_create` to create a new, buffered, HTTP
- *     protocol object with the given port and handler callback.
+ *     protocol object with the given port and handler callback (with
+ *     automatic ``Date`` headers enabled).
  * - passing that proto object to :c:func:`ymo_server_create`, along with the
  *     default :c:type:`ymo_serfer_config_t`.
  *
@@ -18,6 +18,8 @@
  *
  *===========================================================================*/
 
+#include <ctype.h>
+
 #include "ymo_log.h"
 #include "core/ymo_tap.h"
 
@@ -439,6 +441,252 @@ static int test_collisions()
 }
 
 
+static int test_std_ids(void)
+{
+    char buf[YMO_HTTP_HDR_STD_LEN_MAX+1];
+
+    ymo_assert(ymo_http_hdr_std_id("Not-A-Standard-Header", 21) == YMO_HTTP_HID_NONE);
+    ymo_assert(ymo_http_hdr_std_id("", 0) == YMO_HTTP_HID_NONE);
+    ymo_assert(ymo_http_hdr_std_id("content-length", 14) == YMO_HTTP_HID_CONTENT_LENGTH);
+    ymo_assert(ymo_http_hdr_std_id("CONNECTION", 10) == YMO_HTTP_HID_CONNECTION);
+
+    for( ymo_http_hdr_id_t id = 1; id <= YMO_HTTP_HID_STD_MAX; id++ )
+    {
+        const char* name = ymo_http_hdr_std[id].name;
+        size_t len = ymo_http_hdr_std[id].len;
+        ymo_assert(len == strlen(name));
+        ymo_assert(ymo_http_hdr_std_id(name, len) == id);
+
+        /* Case-insensitive: */
+        for( size_t i = 0; i < len; i++ ) {
+            buf[i] = (char)toupper((unsigned char)name[i]);
+        }
+        buf[len] = '\0';
+        ymo_assert(ymo_http_hdr_std_id(buf, len) == id);
+
+        for( size_t i = 0; i < len; i++ ) {
+            buf[i] = (char)tolower((unsigned char)name[i]);
+        }
+        ymo_assert(ymo_http_hdr_std_id(buf, len) == id);
+        ymo_assert(ymo_http_hdr_id(buf, len) == id);
+
+        /* Same length, one character off — never this id: */
+        for( size_t i = 0; i < len; i++ ) {
+            char c = buf[i];
+            buf[i] = '_';
+            ymo_assert(ymo_http_hdr_std_id(buf, len) != id);
+            buf[i] = c;
+        }
+
+        /* Prefixes don't match, either: */
+        ymo_assert(ymo_http_hdr_std_id(name, len-1) != id);
+    }
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int test_std_id_lookup(void)
+{
+    ymo_http_hdr_table_t* table = ymo_http_hdr_table_create();
+
+    ymo_http_hdr_table_insert(table, "content-length", "42");
+    ymo_assert_str_eq("42", ymo_http_hdr_table_get(table, "Content-Length"));
+    ymo_assert_str_eq("42", ymo_http_hdr_table_get_id(
+                table, YMO_HTTP_HID_CONTENT_LENGTH));
+
+    /* Standard ids are never confused with hashed ones: */
+    ymo_assert(ymo_http_hdr_id("X-Not-Standard", 14) & YMO_HTTP_HID_HASHED);
+    ymo_assert(!(ymo_http_hdr_id("Connection", 10) & YMO_HTTP_HID_HASHED));
+
+    /* Names needn't be NUL-terminated (e.g. slices of a request buffer): */
+    ymo_assert(ymo_http_hdr_id("X-Not-Standard: 1", 14)
+            == ymo_http_hdr_id("X-Not-Standard", 14));
+
+    ymo_http_hdr_table_free(table);
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int test_hash_collision(void)
+{
+    /* These two collide under the 283/5 hash: */
+    const char* hdr_a = "X-Foo-AAR";
+    const char* hdr_b = "X-Foo-CNA";
+    ymo_assert(ymo_http_hdr_id(hdr_a, 9) == ymo_http_hdr_id(hdr_b, 9));
+
+    ymo_http_hdr_table_t* table = ymo_http_hdr_table_create();
+
+    ymo_http_hdr_table_add(table, hdr_a, "a");
+    ymo_assert_str_eq(NULL, ymo_http_hdr_table_get(table, hdr_b));
+
+    ymo_http_hdr_table_add(table, hdr_b, "b");
+    ymo_assert_str_eq("a", ymo_http_hdr_table_get(table, hdr_a));
+    ymo_assert_str_eq("b", ymo_http_hdr_table_get(table, hdr_b));
+    ymo_assert_str_eq("a", ymo_http_hdr_table_get(table, "x-foo-aar"));
+
+    ymo_http_hdr_table_insert(table, hdr_b, "B");
+    ymo_assert_str_eq("a", ymo_http_hdr_table_get(table, hdr_a));
+    ymo_assert_str_eq("B", ymo_http_hdr_table_get(table, hdr_b));
+
+    ymo_http_hdr_table_free(table);
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int test_iteration_order(void)
+{
+    static const char* names[] = {
+        "Host", "X-Custom-B", "Accept", "X-Custom-A", "Cookie", "User-Agent",
+    };
+    size_t no_names = sizeof(names)/sizeof(names[0]);
+    ymo_http_hdr_table_t* table = ymo_http_hdr_table_create();
+
+    for( size_t i = 0; i < no_names; i++ ) {
+        ymo_http_hdr_table_add(table, names[i], names[i]);
+    }
+    /* Repeats are reported with (and at the position of) the first: */
+    ymo_http_hdr_table_add(table, "accept", "*/*");
+
+    const char* hdr_name;
+    const char* hdr_value;
+    size_t name_len;
+    size_t i = 0;
+    ymo_http_hdr_ptr_t iter = ymo_http_hdr_table_next(
+            table, NULL, &hdr_name, &name_len, &hdr_value);
+    while( iter )
+    {
+        ymo_assert(i < no_names);
+        ymo_assert(name_len == strlen(names[i]));
+        ymo_assert(!strncmp(hdr_name, names[i], name_len));
+        if( i == 2 ) {
+            ymo_assert_str_eq(hdr_value, "Accept,*/*");
+        } else {
+            ymo_assert_str_eq(hdr_value, names[i]);
+        }
+        i++;
+        iter = ymo_http_hdr_table_next(
+                table, iter, &hdr_name, &name_len, &hdr_value);
+    }
+    ymo_assert(i == no_names);
+
+    ymo_http_hdr_table_free(table);
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int test_growth(void)
+{
+    size_t no_hdrs = sizeof(LOTS_OF_HEADERS)/sizeof(const char*);
+    ymo_http_hdr_table_t* table = ymo_http_hdr_table_create();
+
+    /* Twice, to make sure clear resets the table to its inline storage: */
+    for( int pass = 0; pass < 2; pass++ ) {
+        for( size_t i = 0; i < no_hdrs; i++ ) {
+            ymo_assert(ymo_http_hdr_table_insert(
+                        table, LOTS_OF_HEADERS[i], LOTS_OF_HEADERS[i]) != 0);
+        }
+        ymo_assert(table->count == no_hdrs);
+        ymo_assert(table->items != table->inline_items);
+
+        for( size_t i = 0; i < no_hdrs; i++ ) {
+            ymo_assert_str_eq(LOTS_OF_HEADERS[i],
+                    ymo_http_hdr_table_get(table, LOTS_OF_HEADERS[i]));
+        }
+
+        const char* hdr_name;
+        const char* hdr_value;
+        size_t name_len;
+        size_t i = 0;
+        ymo_http_hdr_ptr_t iter = ymo_http_hdr_table_next(
+                table, NULL, &hdr_name, &name_len, &hdr_value);
+        while( iter ) {
+            ymo_assert(hdr_name == LOTS_OF_HEADERS[i++]);
+            iter = ymo_http_hdr_table_next(
+                    table, iter, &hdr_name, &name_len, &hdr_value);
+        }
+        ymo_assert(i == no_hdrs);
+
+        ymo_http_hdr_table_clear(table);
+        ymo_assert(table->count == 0);
+        ymo_assert(table->items == table->inline_items);
+        ymo_assert_str_eq(NULL, ymo_http_hdr_table_get(table, "Host"));
+    }
+
+    ymo_http_hdr_table_free(table);
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int test_multi_value(void)
+{
+    const char* value;
+    ymo_http_hdr_ptr_t iter;
+    ymo_http_hdr_table_t* table = ymo_http_hdr_table_create();
+
+    ymo_http_hdr_table_add(table, "Via", "1.1 a");
+    ymo_http_hdr_table_add(table, "Host", "example.com");
+    ymo_http_hdr_table_add(table, "via", "1.1 b");
+    ymo_http_hdr_table_add(table, "VIA", "1.1 c");
+    ymo_assert_str_eq("1.1 a,1.1 b,1.1 c", ymo_http_hdr_table_get(table, "Via"));
+
+    /* Each value, individually: */
+    iter = ymo_http_hdr_table_next_value(table, "Via", NULL, &value);
+    ymo_assert(iter != NULL);
+    ymo_assert_str_eq(value, "1.1 a");
+    iter = ymo_http_hdr_table_next_value(table, "Via", iter, &value);
+    ymo_assert(iter != NULL);
+    ymo_assert_str_eq(value, "1.1 b");
+    iter = ymo_http_hdr_table_next_value(table, "Via", iter, &value);
+    ymo_assert(iter != NULL);
+    ymo_assert_str_eq(value, "1.1 c");
+    ymo_assert(!ymo_http_hdr_table_next_value(table, "Via", iter, &value));
+    ymo_assert(!ymo_http_hdr_table_next_value(table, "Date", NULL, &value));
+
+    /* Insert replaces *all* of the values: */
+    ymo_http_hdr_table_insert(table, "Via", "1.1 d");
+    ymo_assert_str_eq("1.1 d", ymo_http_hdr_table_get(table, "Via"));
+    iter = ymo_http_hdr_table_next_value(table, "Via", NULL, &value);
+    ymo_assert_str_eq(value, "1.1 d");
+    ymo_assert(!ymo_http_hdr_table_next_value(table, "Via", iter, &value));
+
+    ymo_http_hdr_table_free(table);
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int test_set_cookie(void)
+{
+    const char* hdr_name;
+    const char* hdr_value;
+    size_t name_len;
+    size_t no_cookies = 0;
+    ymo_http_hdr_table_t* table = ymo_http_hdr_table_create();
+
+    ymo_http_hdr_table_add(table, "Set-Cookie", "a=1");
+    ymo_http_hdr_table_insert(table, "Content-Type", "text/plain");
+    ymo_http_hdr_table_add(table, "Set-Cookie", "b=2; Path=/");
+    ymo_http_hdr_table_insert(table, "Set-Cookie", "c=3");
+
+    /* Never joined, never replaced; each is reported on its own: */
+    ymo_http_hdr_ptr_t iter = ymo_http_hdr_table_next(
+            table, NULL, &hdr_name, &name_len, &hdr_value);
+    while( iter ) {
+        if( !strncasecmp(hdr_name, "Set-Cookie", name_len) ) {
+            const char* expect[] = { "a=1", "b=2; Path=/", "c=3" };
+            ymo_assert(no_cookies < 3);
+            ymo_assert_str_eq(hdr_value, expect[no_cookies]);
+            no_cookies++;
+        }
+        iter = ymo_http_hdr_table_next(
+                table, iter, &hdr_name, &name_len, &hdr_value);
+    }
+    ymo_assert(no_cookies == 3);
+
+    ymo_http_hdr_table_free(table);
+    YMO_TAP_PASS(__func__);
+}
+
+
 YMO_TAP_RUN(YMO_TAP_NO_INIT(),
         YMO_TAP_TEST_FN(test_add_and_get),
         YMO_TAP_TEST_FN(test_insert_and_get),
@@ -446,6 +694,13 @@ YMO_TAP_RUN(YMO_TAP_NO_INIT(),
         YMO_TAP_TEST_FN(test_clear),
         YMO_TAP_TEST_FN(test_iteration),
         YMO_TAP_TEST_FN(test_collisions),
+        YMO_TAP_TEST_FN(test_std_ids),
+        YMO_TAP_TEST_FN(test_std_id_lookup),
+        YMO_TAP_TEST_FN(test_hash_collision),
+        YMO_TAP_TEST_FN(test_iteration_order),
+        YMO_TAP_TEST_FN(test_growth),
+        YMO_TAP_TEST_FN(test_multi_value),
+        YMO_TAP_TEST_FN(test_set_cookie),
         YMO_TAP_TEST_END()
         )
 
@@ -0,0 +1,749 @@
+/*=============================================================================
+ * test/test_http2: HTTP/2 protocol tests
+ *
+ * Copyright (c) 2014 Andrew Canaday
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *===========================================================================*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "yimmo_config.h"
+#include "yimmo.h"
+#include "ymo_log.h"
+#include "core/ymo_tap.h"
+#include "core/ymo_proto.h"
+#include "core/ymo_test_proto.h"
+
+#include "ymo_http_test.h"
+
+#include "ymo_http.h"
+#include "ymo_proto_http.h"
+#include "ymo_http_exchange.h"
+#include "ymo_proto_http2.h"
+#include "ymo_http2_hpack.h"
+
+#define MAX_FRAMES 32
+#define IO_BUF_SIZE 8192
+
+typedef struct test_frame {
+    uint8_t         type;
+    uint8_t         flags;
+    uint32_t        id;
+    const uint8_t*  payload;
+    size_t          len;
+} test_frame_t;
+
+static ymo_proto_t* h2_proto = NULL;
+static ymo_test_conn_t* test_conn = NULL;
+
+/* Client side: */
+static uint8_t out[IO_BUF_SIZE];
+static size_t out_len;
+static uint8_t in[IO_BUF_SIZE];
+static size_t in_len;
+static test_frame_t frames[MAX_FRAMES];
+static size_t no_frames;
+static ymo_hpack_decoder_t client_dec;
+static char fields[1024];
+static size_t fields_len;
+
+/* Server side: */
+static struct {
+    int   called;
+    char  uri[128];
+    char  query[128];
+    char  version[16];
+    char  host[128];
+    size_t cookie_len;
+    int   no_drains;
+} r_info;
+
+
+/*---------------------------------------------------------------*
+ * Handler:
+ *---------------------------------------------------------------*/
+
+/* Stream "4567" once "0123" is on the wire, then finish: */
+static ymo_status_t drain_cb(
+        ymo_http_session_t* session,
+        ymo_http_response_t* response,
+        void* user_data)
+{
+    if( r_info.no_drains++ ) {
+        ymo_http_response_finish(response);
+    } else {
+        ymo_http_response_body_append(
+                response, YMO_BUCKET_FROM_REF("4567", 4));
+    }
+    return YMO_OKAY;
+}
+
+
+static ymo_status_t http_cb(
+        ymo_http_session_t* session,
+        ymo_http_request_t* request,
+        ymo_http_response_t* response,
+        void* user)
+{
+    const char* host = ymo_http_hdr_table_get_id(
+            &request->headers, YMO_HTTP_HID_HOST);
+    const char* cookie = ymo_http_hdr_table_get_id(
+            &request->headers, YMO_HTTP_HID_COOKIE);
+    r_info.called++;
+    strcpy(r_info.uri, request->uri);
+    strcpy(r_info.query, request->query ? request->query : "");
+    strcpy(r_info.version, request->version);
+    strcpy(r_info.host, host ? host : "");
+    r_info.cookie_len = cookie ? strlen(cookie) : 0;
+
+    ymo_http_response_insert_header(response, "Content-Type", "text/plain");
+    ymo_http_response_set_status(response, YMO_HTTP_OK);
+    if( request->body_received ) {
+        ymo_http_response_body_append(response, YMO_BUCKET_FROM_CPY(
+                    request->body, request->body_received));
+    } else if( !strcmp(request->uri, "/big") ) {
+        ymo_http_response_body_append(
+                response, YMO_BUCKET_FROM_REF("0123456789", 10));
+    } else if( !strcmp(request->uri, "/drain") ) {
+        ymo_http_response_set_watermarks(response, 4, 0);
+        ymo_http_response_on_drain(response, &drain_cb, NULL);
+        ymo_http_response_body_append(
+                response, YMO_BUCKET_FROM_REF("0123", 4));
+        return YMO_OKAY;
+    } else if( !strcmp(request->uri, "/file") ) {
+        /* The same, from a file: */
+        FILE* tmp = tmpfile();
+        fputs("0123456789", tmp);
+        fflush(tmp);
+        ymo_http_response_body_append(response, ymo_bucket_create_file(
+                    NULL, NULL, dup(fileno(tmp)), 0, 10,
+                    &ymo_bucket_close_fd));
+        fclose(tmp);
+    } else {
+        ymo_http_response_body_append(response, YMO_BUCKET_FROM_REF("OK", 2));
+    }
+    ymo_http_response_finish(response);
+    return YMO_OKAY;
+}
+
+
+/*---------------------------------------------------------------*
+ * Client Utility:
+ *---------------------------------------------------------------*/
+static void put_frame(
+        uint8_t type, uint8_t flags, uint32_t id,
+        const void* payload, size_t len)
+{
+    uint8_t* p = out + out_len;
+    p[0] = (uint8_t)(len >> 16);
+    p[1] = (uint8_t)(len >> 8);
+    p[2] = (uint8_t)len;
+    p[3] = type;
+    p[4] = flags;
+    p[5] = (uint8_t)(id >> 24);
+    p[6] = (uint8_t)(id >> 16);
+    p[7] = (uint8_t)(id >> 8);
+    p[8] = (uint8_t)id;
+    if( len ) {
+        memcpy(p + YMO_HTTP2_FRAME_HDR_LEN, payload, len);
+    }
+    out_len += YMO_HTTP2_FRAME_HDR_LEN + len;
+}
+
+
+static void put_preface(void)
+{
+    memcpy(out + out_len, YMO_HTTP2_PREFACE, YMO_HTTP2_PREFACE_LEN);
+    out_len += YMO_HTTP2_PREFACE_LEN;
+    put_frame(YMO_HTTP2_SETTINGS, 0, 0, NULL, 0);
+}
+
+
+/* HEADERS for "<method> <path>", with an optional content-length: */
+static void put_request(
+        uint32_t id, uint8_t flags,
+        const char* method, const char* path, const char* content_length)
+{
+    uint8_t block[512];
+    uint8_t* p = block;
+    p += ymo_hpack_encode_field(p, YMO_HTTP_HID_NONE,
+            ":method", 7, method, strlen(method));
+    *p++ = 0x86; /* :scheme: http */
+    p += ymo_hpack_encode_field(p, YMO_HTTP_HID_NONE,
+            ":authority", 10, "example.com", 11);
+    p += ymo_hpack_encode_field(p, YMO_HTTP_HID_NONE,
+            ":path", 5, path, strlen(path));
+    if( content_length ) {
+        p += ymo_hpack_encode_field(p, YMO_HTTP_HID_CONTENT_LENGTH,
+                "content-length", 14, content_length, strlen(content_length));
+    }
+    put_frame(YMO_HTTP2_HEADERS, YMO_HTTP2_FLAG_END_HEADERS | flags, id,
+            block, (size_t)(p - block));
+}
+
+
+/* Hand the first len bytes of client output to the connection, as the
+ * server would:
+ */
+static void client_send_len(size_t len)
+{
+    http_conn_send(test_conn, (const char*)out, len, 0);
+    memmove(out, out + len, out_len - len);
+    out_len -= len;
+}
+
+
+static void client_send(void)
+{
+    client_send_len(out_len);
+}
+
+
+/* Flush the connection and read what it sent: */
+static void client_recv(void)
+{
+    in_len = http_conn_recv(test_conn, (char*)in, sizeof(in));
+}
+
+
+/* Split the input into frames, starting at offset: */
+static void parse_frames(size_t offset)
+{
+    const uint8_t* p = in + offset;
+    const uint8_t* end = in + in_len;
+    no_frames = 0;
+    while( end - p >= YMO_HTTP2_FRAME_HDR_LEN && no_frames < MAX_FRAMES ) {
+        test_frame_t* f = &frames[no_frames++];
+        f->len = ((size_t)p[0] << 16) | ((size_t)p[1] << 8) | p[2];
+        f->type = p[3];
+        f->flags = p[4];
+        f->id = ((uint32_t)(p[5] & 0x7f) << 24) | ((uint32_t)p[6] << 16)
+            | ((uint32_t)p[7] << 8) | p[8];
+        f->payload = p + YMO_HTTP2_FRAME_HDR_LEN;
+        p += YMO_HTTP2_FRAME_HDR_LEN + f->len;
+    }
+}
+
+
+static ymo_status_t field_cb(
+        void* data,
+        ymo_http_hdr_id_t h_id,
+        const char* name,
+        size_t name_len,
+        const char* value,
+        size_t value_len)
+{
+    fields_len += snprintf(fields + fields_len, sizeof(fields) - fields_len,
+            "%.*s: %.*s\n", (int)name_len, name, (int)value_len, value);
+    return YMO_OKAY;
+}
+
+
+/* Decode a HEADERS frame into fields, returning the status: */
+static ymo_status_t decode_headers(const test_frame_t* f)
+{
+    fields_len = 0;
+    fields[0] = '\0';
+    return ymo_hpack_decode(&client_dec, f->payload, f->len, &field_cb, NULL);
+}
+
+
+static void open_conn(void)
+{
+    test_conn = http_conn_open();
+    ymo_hpack_decoder_init(&client_dec);
+}
+
+
+static void close_conn(void)
+{
+    http_conn_close(test_conn);
+    test_conn = NULL;
+    ymo_hpack_decoder_clear(&client_dec);
+}
+
+
+/*---------------------------------------------------------------*
+ * Tests:
+ *---------------------------------------------------------------*/
+static int test_prior_knowledge(void)
+{
+    open_conn();
+    put_preface();
+    put_request(1, YMO_HTTP2_FLAG_END_STREAM, "GET", "/h2?x=1#frag", NULL);
+    client_send();
+    ymo_assert(test_conn->conn->proto == h2_proto);
+    ymo_assert(r_info.called == 1);
+    ymo_assert_str_eq(r_info.uri, "/h2");
+    ymo_assert_str_eq(r_info.query, "x=1");
+    ymo_assert_str_eq(r_info.version, "HTTP/2");
+    ymo_assert_str_eq(r_info.host, "example.com");
+
+    client_recv();
+    parse_frames(0);
+    ymo_assert(no_frames == 4);
+    ymo_assert(frames[0].type == YMO_HTTP2_SETTINGS);
+    ymo_assert(!(frames[0].flags & YMO_HTTP2_FLAG_ACK));
+    ymo_assert(frames[1].type == YMO_HTTP2_SETTINGS);
+    ymo_assert(frames[1].flags & YMO_HTTP2_FLAG_ACK);
+
+    ymo_assert(frames[2].type == YMO_HTTP2_HEADERS);
+    ymo_assert(frames[2].id == 1);
+    ymo_assert(frames[2].flags & YMO_HTTP2_FLAG_END_HEADERS);
+    ymo_assert(!(frames[2].flags & YMO_HTTP2_FLAG_END_STREAM));
+    ymo_assert(decode_headers(&frames[2]) == YMO_OKAY);
+    ymo_assert_str_eq(fields,
+            ":status: 200\n"
+            "content-type: text/plain\n"
+            "content-length: 2\n");
+
+    ymo_assert(frames[3].type == YMO_HTTP2_DATA);
+    ymo_assert(frames[3].id == 1);
+    ymo_assert(frames[3].flags & YMO_HTTP2_FLAG_END_STREAM);
+    ymo_assert(frames[3].len == 2);
+    ymo_assert(!memcmp(frames[3].payload, "OK", 2));
+    close_conn();
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int test_multiplexed(void)
+{
+    open_conn();
+    put_preface();
+    put_request(1, YMO_HTTP2_FLAG_END_STREAM, "GET", "/a", NULL);
+    put_request(3, YMO_HTTP2_FLAG_END_STREAM, "GET", "/b", NULL);
+    put_request(5, YMO_HTTP2_FLAG_END_STREAM, "GET", "/c", NULL);
+    client_send();
+    ymo_assert(r_info.called == 3);
+
+    client_recv();
+    parse_frames(0);
+    ymo_assert(no_frames == 8);
+
+    /* Every stream gets its HEADERS and a final DATA frame: */
+    for( uint32_t id = 1; id <= 5; id += 2 ) {
+        int got_headers = 0;
+        int got_end = 0;
+        for( size_t i = 2; i < no_frames; i++ ) {
+            if( frames[i].id != id ) {
+                continue;
+            }
+            if( frames[i].type == YMO_HTTP2_HEADERS ) {
+                got_headers = 1;
+            } else if( frames[i].type == YMO_HTTP2_DATA ) {
+                ymo_assert(got_headers);
+                got_end = frames[i].flags & YMO_HTTP2_FLAG_END_STREAM;
+            }
+        }
+        ymo_assert(got_headers && got_end);
+    }
+    close_conn();
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int test_post_body(void)
+{
+    open_conn();
+    put_preface();
+    put_request(1, 0, "POST", "/echo", "10");
+    put_frame(YMO_HTTP2_DATA, 0, 1, "hello", 5);
+    client_send();
+    ymo_assert(r_info.called == 0);
+
+    put_frame(YMO_HTTP2_DATA, YMO_HTTP2_FLAG_END_STREAM, 1, "world", 5);
+    client_send();
+    ymo_assert(r_info.called == 1);
+
+    client_recv();
+    parse_frames(0);
+    ymo_assert(no_frames == 4);
+    ymo_assert(frames[3].type == YMO_HTTP2_DATA);
+    ymo_assert(frames[3].len == 10);
+    ymo_assert(!memcmp(frames[3].payload, "helloworld", 10));
+    close_conn();
+    YMO_TAP_PASS(__func__);
+}
+
+
+/* Send a 10 byte response body through a 4 byte window: */
+static int flow_control(const char* path)
+{
+    /* SETTINGS_INITIAL_WINDOW_SIZE = 4: */
+    const uint8_t settings[] = { 0, 4, 0, 0, 0, 4 };
+    const uint8_t increment[] = { 0, 0, 0, 100 };
+
+    open_conn();
+    memcpy(out, YMO_HTTP2_PREFACE, YMO_HTTP2_PREFACE_LEN);
+    out_len = YMO_HTTP2_PREFACE_LEN;
+    put_frame(YMO_HTTP2_SETTINGS, 0, 0, settings, sizeof(settings));
+    put_request(1, YMO_HTTP2_FLAG_END_STREAM, "GET", path, NULL);
+    client_send();
+
+    client_recv();
+    parse_frames(0);
+    ymo_assert(no_frames == 4);
+    ymo_assert(frames[2].type == YMO_HTTP2_HEADERS);
+    ymo_assert(frames[3].type == YMO_HTTP2_DATA);
+    ymo_assert(frames[3].len == 4);
+    ymo_assert(!memcmp(frames[3].payload, "0123", 4));
+    ymo_assert(!(frames[3].flags & YMO_HTTP2_FLAG_END_STREAM));
+
+    put_frame(YMO_HTTP2_WINDOW_UPDATE, 0, 1, increment, sizeof(increment));
+    client_send();
+    client_recv();
+    parse_frames(0);
+    ymo_assert(no_frames == 1);
+    ymo_assert(frames[0].type == YMO_HTTP2_DATA);
+    ymo_assert(frames[0].flags & YMO_HTTP2_FLAG_END_STREAM);
+    ymo_assert(frames[0].len == 6);
+    ymo_assert(!memcmp(frames[0].payload, "456789", 6));
+    close_conn();
+    return YMO_TAP_STATUS_PASS;
+}
+
+
+static int test_flow_control(void)
+{
+    ymo_assert(flow_control("/big") == YMO_TAP_STATUS_PASS);
+    YMO_TAP_PASS(__func__);
+}
+
+
+/* File buckets are split across DATA frames, too: */
+static int test_file_flow_control(void)
+{
+    ymo_assert(flow_control("/file") == YMO_TAP_STATUS_PASS);
+    YMO_TAP_PASS(__func__);
+}
+
+
+/* Streams are called back for more as their DATA frames go out: */
+static int test_drain(void)
+{
+    open_conn();
+    put_preface();
+    put_request(1, YMO_HTTP2_FLAG_END_STREAM, "GET", "/drain", NULL);
+    client_send();
+    ymo_assert(r_info.called == 1);
+    ymo_assert(r_info.no_drains == 0);
+
+    client_recv();
+    parse_frames(0);
+    ymo_assert(r_info.no_drains == 2);
+    ymo_assert(no_frames == 6);
+    ymo_assert(frames[2].type == YMO_HTTP2_HEADERS);
+    ymo_assert(frames[3].type == YMO_HTTP2_DATA);
+    ymo_assert(frames[3].len == 4);
+    ymo_assert(!memcmp(frames[3].payload, "0123", 4));
+    ymo_assert(frames[4].type == YMO_HTTP2_DATA);
+    ymo_assert(frames[4].len == 4);
+    ymo_assert(!memcmp(frames[4].payload, "4567", 4));
+    ymo_assert(!(frames[4].flags & YMO_HTTP2_FLAG_END_STREAM));
+    ymo_assert(frames[5].type == YMO_HTTP2_DATA);
+    ymo_assert(frames[5].len == 0);
+    ymo_assert(frames[5].flags & YMO_HTTP2_FLAG_END_STREAM);
+    close_conn();
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int test_h2c_upgrade(void)
+{
+    const char* upgrade =
+        "GET /up HTTP/1.1\r\n"
+        "Host: example.com\r\n"
+        "Connection: Upgrade, HTTP2-Settings\r\n"
+        "Upgrade: h2c\r\n"
+        "HTTP2-Settings: AAMAAABkAAQAAP__\r\n"
+        "\r\n";
+
+    open_conn();
+    out_len = strlen(upgrade);
+    memcpy(out, upgrade, out_len);
+    client_send();
+    ymo_assert(r_info.called == 0);
+
+    /* 101, then the server preface and the response on stream 1: */
+    client_recv();
+    ymo_assert(test_conn->conn->proto == h2_proto);
+    ymo_assert(r_info.called == 1);
+    ymo_assert_str_eq(r_info.uri, "/up");
+    ymo_assert_str_eq(r_info.version, "HTTP/2");
+    ymo_assert(!strncmp((char*)in, "HTTP/1.1 101 ", 13));
+
+    const char* body = strstr((char*)in, "\r\n\r\n");
+    ymo_assert(body != NULL);
+    size_t offset = (size_t)(body + 4 - (char*)in);
+    if( offset == in_len ) {
+        client_recv();
+        offset = 0;
+    }
+    parse_frames(offset);
+    ymo_assert(no_frames >= 3);
+    ymo_assert(frames[0].type == YMO_HTTP2_SETTINGS);
+    ymo_assert(frames[1].type == YMO_HTTP2_HEADERS);
+    ymo_assert(frames[1].id == 1);
+    ymo_assert(frames[2].type == YMO_HTTP2_DATA);
+    ymo_assert(frames[2].flags & YMO_HTTP2_FLAG_END_STREAM);
+
+    /* The client preface follows: */
+    put_preface();
+    put_request(3, YMO_HTTP2_FLAG_END_STREAM, "GET", "/next", NULL);
+    client_send();
+    ymo_assert(r_info.called == 2);
+    client_recv();
+    parse_frames(0);
+    ymo_assert(no_frames == 3);
+    ymo_assert(frames[0].type == YMO_HTTP2_SETTINGS);
+    ymo_assert(frames[0].flags & YMO_HTTP2_FLAG_ACK);
+    ymo_assert(frames[1].id == 3);
+    close_conn();
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int test_ping(void)
+{
+    open_conn();
+    put_preface();
+    put_frame(YMO_HTTP2_PING, 0, 0, "yimmo!!!", 8);
+    client_send();
+    client_recv();
+    parse_frames(0);
+    ymo_assert(no_frames == 3);
+    ymo_assert(frames[2].type == YMO_HTTP2_PING);
+    ymo_assert(frames[2].flags & YMO_HTTP2_FLAG_ACK);
+    ymo_assert(frames[2].len == 8);
+    ymo_assert(!memcmp(frames[2].payload, "yimmo!!!", 8));
+    close_conn();
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int test_large_headers(void)
+{
+    uint8_t block[6144];
+    char value[2048];
+    uint8_t* p = block;
+
+    memset(value, 'c', sizeof(value));
+    p += ymo_hpack_encode_field(p, YMO_HTTP_HID_NONE,
+            ":method", 7, "GET", 3);
+    *p++ = 0x86; /* :scheme: http */
+    p += ymo_hpack_encode_field(p, YMO_HTTP_HID_NONE,
+            ":authority", 10, "example.com", 11);
+    p += ymo_hpack_encode_field(p, YMO_HTTP_HID_NONE,
+            ":path", 5, "/large", 6);
+
+    /* Two crumbs, rejoined with "; ", and a long token: */
+    p += ymo_hpack_encode_field(p, YMO_HTTP_HID_COOKIE,
+            "cookie", 6, value, 2000);
+    p += ymo_hpack_encode_field(p, YMO_HTTP_HID_COOKIE,
+            "cookie", 6, value, 2000);
+    p += ymo_hpack_encode_field(p, YMO_HTTP_HID_AUTHORIZATION,
+            "authorization", 13, value, 1500);
+
+    open_conn();
+    put_preface();
+    put_frame(YMO_HTTP2_HEADERS,
+            YMO_HTTP2_FLAG_END_HEADERS | YMO_HTTP2_FLAG_END_STREAM, 1,
+            block, (size_t)(p - block));
+    client_send();
+    ymo_assert(r_info.called == 1);
+    ymo_assert_str_eq(r_info.uri, "/large");
+    ymo_assert(r_info.cookie_len == 4002);
+
+    /* SETTINGS_MAX_HEADER_LIST_SIZE is the header storage limit: */
+    client_recv();
+    parse_frames(0);
+    ymo_assert(no_frames == 4);
+    ymo_assert(frames[0].type == YMO_HTTP2_SETTINGS);
+    ymo_assert(frames[0].len == 18);
+    ymo_assert(frames[0].payload[13]
+            == YMO_HTTP2_SETTINGS_MAX_HEADER_LIST_SIZE);
+    ymo_assert(((uint32_t)frames[0].payload[14] << 24
+                | (uint32_t)frames[0].payload[15] << 16
+                | (uint32_t)frames[0].payload[16] << 8
+                | (uint32_t)frames[0].payload[17])
+            == YMO_HTTP_HDR_MAX_DEFAULT);
+    ymo_assert(frames[2].type == YMO_HTTP2_HEADERS);
+    ymo_assert(decode_headers(&frames[2]) == YMO_OKAY);
+    ymo_assert(!strncmp(fields, ":status: 200\n", 13));
+    close_conn();
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int test_goaway_on_protocol_error(void)
+{
+    open_conn();
+    put_preface();
+    put_frame(YMO_HTTP2_DATA, 0, 0, "oops", 4);
+    client_send();
+    client_recv();
+    parse_frames(0);
+    ymo_assert(no_frames == 3);
+    ymo_assert(frames[2].type == YMO_HTTP2_GOAWAY);
+    ymo_assert(frames[2].len == 8);
+    ymo_assert(frames[2].payload[7] == YMO_HTTP2_PROTOCOL_ERROR);
+    ymo_assert(test_conn->conn->state == YMO_CONN_SHUTDOWN);
+    close_conn();
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int test_preface_requires_settings(void)
+{
+    /* The first frame after the client preface must be SETTINGS: */
+    open_conn();
+    memcpy(out, YMO_HTTP2_PREFACE, YMO_HTTP2_PREFACE_LEN);
+    out_len = YMO_HTTP2_PREFACE_LEN;
+    put_frame(YMO_HTTP2_PING, 0, 0, "yimmo!!!", 8);
+    client_send();
+    client_recv();
+    parse_frames(0);
+    ymo_assert(no_frames == 2);
+    ymo_assert(frames[1].type == YMO_HTTP2_GOAWAY);
+    ymo_assert(frames[1].payload[7] == YMO_HTTP2_PROTOCOL_ERROR);
+    ymo_assert(test_conn->conn->state == YMO_CONN_SHUTDOWN);
+    close_conn();
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int test_idle_priority_error(void)
+{
+    /* A self-dependent PRIORITY on an idle stream is a connection error,
+     * since RST_STREAM can't be sent for idle streams:
+     */
+    uint8_t priority[5] = { 0x00, 0x00, 0x00, 0x05, 0x0f };
+    open_conn();
+    put_preface();
+    put_frame(YMO_HTTP2_PRIORITY, 0, 5, priority, sizeof(priority));
+    client_send();
+    client_recv();
+    parse_frames(0);
+    ymo_assert(no_frames == 3);
+    ymo_assert(frames[2].type == YMO_HTTP2_GOAWAY);
+    ymo_assert(frames[2].payload[7] == YMO_HTTP2_PROTOCOL_ERROR);
+    close_conn();
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int test_idle_buffers(void)
+{
+    uint8_t block[512];
+    uint8_t* p = block;
+    p += ymo_hpack_encode_field(p, YMO_HTTP_HID_NONE,
+            ":method", 7, "GET", 3);
+    *p++ = 0x86; /* :scheme: http */
+    p += ymo_hpack_encode_field(p, YMO_HTTP_HID_NONE,
+            ":authority", 10, "example.com", 11);
+    p += ymo_hpack_encode_field(p, YMO_HTTP_HID_NONE,
+            ":path", 5, "/idle", 5);
+    size_t block_len = (size_t)(p - block);
+    size_t half = block_len / 2;
+
+    open_conn();
+    put_preface();
+    client_send();
+    ymo_http2_session_t* s = test_conn->conn->proto_data;
+    ymo_assert(test_conn->conn->proto == h2_proto);
+    ymo_assert(s->f_buf == NULL);
+    ymo_assert(s->hdr_block == NULL);
+
+    /* A header block split over HEADERS + CONTINUATION... */
+    put_frame(YMO_HTTP2_HEADERS, YMO_HTTP2_FLAG_END_STREAM, 1, block, half);
+    client_send();
+    ymo_assert(s->hdr_block != NULL);
+
+    /* ...the last of which arrives in pieces: */
+    put_frame(YMO_HTTP2_CONTINUATION, YMO_HTTP2_FLAG_END_HEADERS, 1,
+            block + half, block_len - half);
+    client_send_len(out_len - 2);
+    ymo_assert(s->f_buf != NULL);
+    ymo_assert(r_info.called == 0);
+
+    /* Once the request is in, neither buffer is held: */
+    client_send();
+    ymo_assert(r_info.called == 1);
+    ymo_assert_str_eq(r_info.uri, "/idle");
+    ymo_assert(s->f_buf == NULL);
+    ymo_assert(s->hdr_block == NULL);
+
+    client_recv();
+    parse_frames(0);
+    ymo_assert(no_frames == 4);
+    ymo_assert(frames[3].type == YMO_HTTP2_DATA);
+    ymo_assert(!memcmp(frames[3].payload, "OK", 2));
+    close_conn();
+    YMO_TAP_PASS(__func__);
+}
+
+
+/*---------------------------------------------------------------*
+ * Setup/Cleanup:
+ *---------------------------------------------------------------*/
+static int setup_suite(void)
+{
+    ymo_proto_t* proto = ymo_proto_http_create(
+            NULL, &http_cb, NULL, NULL, NULL, NULL, 0);
+    h2_proto = ymo_proto_http2_create(proto);
+    ymo_http_add_upgrade_handler(proto, ymo_http2_upgrade_handler(h2_proto));
+    test_server = test_server_create(proto);
+    return 0;
+}
+
+
+static int setup_test(void)
+{
+    memset(&r_info, 0, sizeof(r_info));
+    out_len = in_len = no_frames = 0;
+    return 0;
+}
+
+
+static int cleanup(void)
+{
+    ymo_proto_http_cleanup(test_server->proto, test_server->server);
+    ymo_server_free(test_server->server);
+    YMO_FREE(test_server);
+    YMO_FREE(h2_proto);
+    return 0;
+}
+
+
+YMO_TAP_RUN(&setup_suite, &setup_test, &cleanup,
+        YMO_TAP_TEST_FN(test_prior_knowledge),
+        YMO_TAP_TEST_FN(test_multiplexed),
+        YMO_TAP_TEST_FN(test_post_body),
+        YMO_TAP_TEST_FN(test_flow_control),
+        YMO_TAP_TEST_FN(test_file_flow_control),
+        YMO_TAP_TEST_FN(test_drain),
+        YMO_TAP_TEST_FN(test_h2c_upgrade),
+        YMO_TAP_TEST_FN(test_ping),
+        YMO_TAP_TEST_FN(test_large_headers),
+        YMO_TAP_TEST_FN(test_goaway_on_protocol_error),
+        YMO_TAP_TEST_FN(test_preface_requires_settings),
+        YMO_TAP_TEST_FN(test_idle_priority_error),
+        YMO_TAP_TEST_FN(test_idle_buffers),
+        YMO_TAP_TEST_END()
+        )
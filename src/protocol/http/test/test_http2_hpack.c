@@ -0,0 +1,321 @@
+/*=============================================================================
+ * test/test_http2_hpack: HPACK encoder/decoder tests
+ *
+ * Copyright (c) 2014 Andrew Canaday
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *===========================================================================*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "yimmo_config.h"
+#include "yimmo.h"
+#include "ymo_log.h"
+#include "core/ymo_tap.h"
+
+#include "ymo_http.h"
+#include "ymo_http_hdr_table.h"
+#include "ymo_http2_hpack.h"
+
+#define FIELDS_MAX 1024
+
+static ymo_hpack_decoder_t dec;
+static uint8_t block[512];
+static char fields_buf[FIELDS_MAX];
+static char* fields = fields_buf;
+static size_t fields_len;
+
+
+/* Accumulate "name: value\n" for each field: */
+static ymo_status_t field_cb(
+        void* data,
+        ymo_http_hdr_id_t h_id,
+        const char* name,
+        size_t name_len,
+        const char* value,
+        size_t value_len)
+{
+    int n = snprintf(fields + fields_len, FIELDS_MAX - fields_len,
+            "%.*s: %.*s\n", (int)name_len, name, (int)value_len, value);
+    fields_len += n;
+    if( data ) {
+        *(ymo_http_hdr_id_t*)data = h_id;
+    }
+    return YMO_OKAY;
+}
+
+
+static size_t from_hex(const char* hex)
+{
+    size_t len = 0;
+    while( hex[0] && hex[1] ) {
+        unsigned int b;
+        sscanf(hex, "%2x", &b);
+        block[len++] = (uint8_t)b;
+        hex += 2;
+    }
+    return len;
+}
+
+
+static ymo_status_t decode_hex(const char* hex)
+{
+    size_t len = from_hex(hex);
+    fields_len = 0;
+    fields[0] = '\0';
+    return ymo_hpack_decode(&dec, block, len, &field_cb, NULL);
+}
+
+
+/* Each test starts with an empty dynamic table: */
+static int setup_test(void)
+{
+    ymo_hpack_decoder_clear(&dec);
+    ymo_hpack_decoder_init(&dec);
+    return 0;
+}
+
+
+static int cleanup(void)
+{
+    ymo_hpack_decoder_clear(&dec);
+    return 0;
+}
+
+
+/*-------------------------------------------------------------*
+ * RFC 7541, Appendix C:
+ *-------------------------------------------------------------*/
+static int test_rfc_c3_requests(void)
+{
+    /* C.3.1 */
+    ymo_assert(decode_hex(
+                "828684410f7777772e6578616d706c652e636f6d") == YMO_OKAY);
+    ymo_assert_str_eq(fields,
+            ":method: GET\n"
+            ":scheme: http\n"
+            ":path: /\n"
+            ":authority: www.example.com\n");
+    ymo_assert(dec.size == 57);
+
+    /* C.3.2 */
+    ymo_assert(decode_hex("828684be58086e6f2d6361636865") == YMO_OKAY);
+    ymo_assert_str_eq(fields,
+            ":method: GET\n"
+            ":scheme: http\n"
+            ":path: /\n"
+            ":authority: www.example.com\n"
+            "cache-control: no-cache\n");
+    ymo_assert(dec.size == 110);
+
+    /* C.3.3 */
+    ymo_assert(decode_hex(
+                "828785bf400a637573746f6d2d6b65790c637573746f6d2d76616c7565")
+            == YMO_OKAY);
+    ymo_assert_str_eq(fields,
+            ":method: GET\n"
+            ":scheme: https\n"
+            ":path: /index.html\n"
+            ":authority: www.example.com\n"
+            "custom-key: custom-value\n");
+    ymo_assert(dec.size == 164);
+    ymo_assert(dec.count == 3);
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int test_rfc_c4_requests_huffman(void)
+{
+    /* C.4.1 */
+    ymo_assert(decode_hex(
+                "828684418cf1e3c2e5f23a6ba0ab90f4ff") == YMO_OKAY);
+    ymo_assert_str_eq(fields,
+            ":method: GET\n"
+            ":scheme: http\n"
+            ":path: /\n"
+            ":authority: www.example.com\n");
+
+    /* C.4.2 */
+    ymo_assert(decode_hex("828684be5886a8eb10649cbf") == YMO_OKAY);
+    ymo_assert_str_eq(fields,
+            ":method: GET\n"
+            ":scheme: http\n"
+            ":path: /\n"
+            ":authority: www.example.com\n"
+            "cache-control: no-cache\n");
+
+    /* C.4.3 */
+    ymo_assert(decode_hex(
+                "828785bf408825a849e95ba97d7f8925a849e95bb8e8b4bf")
+            == YMO_OKAY);
+    ymo_assert_str_eq(fields,
+            ":method: GET\n"
+            ":scheme: https\n"
+            ":path: /index.html\n"
+            ":authority: www.example.com\n"
+            "custom-key: custom-value\n");
+    ymo_assert(dec.size == 164);
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int test_rfc_c6_responses_eviction(void)
+{
+    /* Appendix C.5/C.6 assume SETTINGS_HEADER_TABLE_SIZE = 256: */
+    ymo_assert(decode_hex("3fe101") == YMO_OKAY);
+    ymo_assert(dec.max_size == 256);
+
+    /* C.6.1 */
+    ymo_assert(decode_hex(
+                "488264025885aec3771a4b6196d07abe941054d444a8200595040b8166"
+                "e082a62d1bff6e919d29ad171863c78f0b97c8e9ae82ae43d3")
+            == YMO_OKAY);
+    ymo_assert_str_eq(fields,
+            ":status: 302\n"
+            "cache-control: private\n"
+            "date: Mon, 21 Oct 2013 20:13:21 GMT\n"
+            "location: https://www.example.com\n");
+    ymo_assert(dec.size == 222);
+
+    /* C.6.2 (evicts ":status: 302") */
+    ymo_assert(decode_hex("4883640effc1c0bf") == YMO_OKAY);
+    ymo_assert_str_eq(fields,
+            ":status: 307\n"
+            "cache-control: private\n"
+            "date: Mon, 21 Oct 2013 20:13:21 GMT\n"
+            "location: https://www.example.com\n");
+    ymo_assert(dec.size == 222);
+
+    /* C.6.3 (evicts everything but the new entries) */
+    ymo_assert(decode_hex(
+                "88c16196d07abe941054d444a8200595040b8166e084a62d1bffc05a83"
+                "9bd9ab77ad94e7821dd7f2e6c7b335dfdfcd5b3960d5af27087f3672c1"
+                "ab270fb5291f9587316065c003ed4ee5b1063d5007")
+            == YMO_OKAY);
+    ymo_assert_str_eq(fields,
+            ":status: 200\n"
+            "cache-control: private\n"
+            "date: Mon, 21 Oct 2013 20:13:22 GMT\n"
+            "location: https://www.example.com\n"
+            "content-encoding: gzip\n"
+            "set-cookie: foo=ASDJKHQKBZXOQWEOPIUAXQWEOIU; "
+            "max-age=3600; version=1\n");
+    ymo_assert(dec.size == 215);
+    ymo_assert(dec.count == 3);
+    YMO_TAP_PASS(__func__);
+}
+
+
+/*-------------------------------------------------------------*
+ * Errors:
+ *-------------------------------------------------------------*/
+static int test_malformed(void)
+{
+    /* Index 0: */
+    ymo_assert(decode_hex("80") == EBADMSG);
+
+    /* Index past the end of the (empty) dynamic table: */
+    ymo_assert(decode_hex("be") == EBADMSG);
+
+    /* Truncated integer and string: */
+    ymo_assert(decode_hex("ff") == EBADMSG);
+    ymo_assert(decode_hex("400a6375") == EBADMSG);
+
+    /* Size update after a field, or over the limit: */
+    ymo_assert(decode_hex("823f00") == EBADMSG);
+    ymo_assert(decode_hex("3fe17f") == EBADMSG);
+
+    /* Huffman: padding longer than 7 bits ("a" + 11 bits): */
+    ymo_assert(decode_hex("400161" "821fff") == EBADMSG);
+
+    /* Huffman: padding which isn't a prefix of EOS ("a" + 000): */
+    ymo_assert(decode_hex("400161" "8118") == EBADMSG);
+
+    /* Huffman: EOS: */
+    ymo_assert(decode_hex("400161" "84fffffffc") == EBADMSG);
+
+    /* Still usable after all that: */
+    ymo_assert(decode_hex("82") == YMO_OKAY);
+    ymo_assert_str_eq(fields, ":method: GET\n");
+    YMO_TAP_PASS(__func__);
+}
+
+
+/*-------------------------------------------------------------*
+ * Encoder:
+ *-------------------------------------------------------------*/
+static int test_encode_int(void)
+{
+    uint8_t buf[8];
+
+    /* RFC 7541, C.1.1 - C.1.3: */
+    ymo_assert(ymo_hpack_encode_int(buf, 0x00, 5, 10) == 1);
+    ymo_assert(buf[0] == 0x0a);
+    ymo_assert(ymo_hpack_encode_int(buf, 0x00, 5, 1337) == 3);
+    ymo_assert(buf[0] == 0x1f && buf[1] == 0x9a && buf[2] == 0x0a);
+    ymo_assert(ymo_hpack_encode_int(buf, 0x80, 7, 42) == 1);
+    ymo_assert(buf[0] == 0xaa);
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int test_encode_round_trip(void)
+{
+    ymo_http_hdr_id_t h_id = YMO_HTTP_HID_NONE;
+    uint8_t* p = block;
+
+    p += ymo_hpack_encode_status(p, 200);
+    ymo_assert(block[0] == 0x88);
+    p += ymo_hpack_encode_status(p, 418);
+    p += ymo_hpack_encode_field(p, YMO_HTTP_HID_NONE,
+            "Content-Type", 12, "text/plain", 10);
+    p += ymo_hpack_encode_field(p, YMO_HTTP_HID_NONE,
+            "X-Custom-Header", 15, "Some Value", 10);
+
+    /* No dynamic table insertions: */
+    fields_len = 0;
+    ymo_assert(ymo_hpack_decode(&dec, block, (size_t)(p - block),
+                &field_cb, &h_id) == YMO_OKAY);
+    ymo_assert_str_eq(fields,
+            ":status: 200\n"
+            ":status: 418\n"
+            "content-type: text/plain\n"
+            "x-custom-header: Some Value\n");
+    ymo_assert(dec.count == 0);
+    ymo_assert(h_id == YMO_HTTP_HID_NONE);
+
+    /* Standard ids are passed through: */
+    p = block;
+    p += ymo_hpack_encode_field(p, YMO_HTTP_HID_NONE,
+            "User-Agent", 10, "curl", 4);
+    ymo_assert(ymo_hpack_decode(&dec, block, (size_t)(p - block),
+                &field_cb, &h_id) == YMO_OKAY);
+    ymo_assert(h_id == YMO_HTTP_HID_USER_AGENT);
+    YMO_TAP_PASS(__func__);
+}
+
+
+YMO_TAP_RUN(NULL, &setup_test, &cleanup,
+        YMO_TAP_TEST_FN(test_rfc_c3_requests),
+        YMO_TAP_TEST_FN(test_rfc_c4_requests_huffman),
+        YMO_TAP_TEST_FN(test_rfc_c6_responses_eviction),
+        YMO_TAP_TEST_FN(test_malformed),
+        YMO_TAP_TEST_FN(test_encode_int),
+        YMO_TAP_TEST_FN(test_encode_round_trip),
+        YMO_TAP_TEST_END()
+        )
+
+
@@ -0,0 +1,367 @@
+/*=============================================================================
+ * test/test_http_body: Spooled request body tests
+ *
+ * Copyright (c) 2014 Andrew Canaday
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *===========================================================================*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "yimmo_config.h"
+#include "yimmo.h"
+#include "ymo_log.h"
+#include "core/ymo_tap.h"
+#include "core/ymo_proto.h"
+#include "core/ymo_test_proto.h"
+
+#include "ymo_http_test.h"
+
+#include "ymo_http.h"
+#include "ymo_proto_http.h"
+#include "ymo_http_body.h"
+
+#define BODY_MEM_MAX 64
+#define BODY_MAX     1024
+#define IO_BUF_SIZE  8192
+
+static ymo_test_conn_t* test_conn = NULL;
+
+static char in[IO_BUF_SIZE];
+static size_t in_len;
+
+/* Server side: */
+static struct {
+    int     called;
+    int     in_memory;   /* request->body was set */
+    int     spilled;     /* body was written out to a file */
+    char    body[BODY_MAX];
+    size_t  body_len;
+} r_info;
+
+
+/*---------------------------------------------------------------*
+ * Handler:
+ *---------------------------------------------------------------*/
+static ymo_status_t http_cb(
+        ymo_http_session_t* session,
+        ymo_http_request_t* request,
+        ymo_http_response_t* response,
+        void* user)
+{
+    r_info.called++;
+    r_info.in_memory = (request->body != NULL);
+    r_info.spilled = request->body_spool
+        && ymo_http_body_spilled(request->body_spool);
+
+    /* Read the body back a few bytes at a time: */
+    size_t offset = 0;
+    ssize_t n;
+    while( (n = ymo_http_request_body_pread(
+                    request, r_info.body + offset, 7, offset)) > 0 ) {
+        offset += n;
+    }
+    r_info.body_len = offset;
+
+    ymo_http_response_set_status(response, YMO_HTTP_OK);
+    ymo_http_response_body_append(response, YMO_BUCKET_FROM_REF("OK", 2));
+    ymo_http_response_finish(response);
+    return YMO_OKAY;
+}
+
+
+/*---------------------------------------------------------------*
+ * Utilities:
+ *---------------------------------------------------------------*/
+/* A POST with a content-length and a patterned body of body_len bytes: */
+static size_t put_post(char* buf, size_t body_len)
+{
+    size_t len = sprintf(buf,
+            "POST /upload HTTP/1.1\r\n"
+            "Host: example.com\r\n"
+            "Content-Length: %zu\r\n"
+            "\r\n", body_len);
+    for( size_t i = 0; i < body_len; i++ ) {
+        buf[len++] = 'a' + (i % 26);
+    }
+    return len;
+}
+
+
+static int body_matches(size_t body_len)
+{
+    if( r_info.body_len != body_len ) {
+        return 0;
+    }
+    for( size_t i = 0; i < body_len; i++ ) {
+        if( r_info.body[i] != 'a' + (i % 26) ) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+
+/*---------------------------------------------------------------*
+ * Tests:
+ *---------------------------------------------------------------*/
+static int test_body_in_memory(void)
+{
+    char req[256];
+    size_t len = put_post(req, 10);
+
+    test_conn = http_conn_open();
+    http_conn_send(test_conn, req, len, len);
+    ymo_assert(r_info.called == 1);
+    ymo_assert(r_info.in_memory);
+    ymo_assert(!r_info.spilled);
+    ymo_assert(body_matches(10));
+
+    in_len = http_conn_recv(test_conn, in, sizeof(in));
+    ymo_assert(!strncmp(in, "HTTP/1.1 200 OK\r\n", 17));
+    http_conn_close(test_conn);
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int test_body_spill(void)
+{
+    char req[1024];
+    size_t len = put_post(req, 500);
+
+    test_conn = http_conn_open();
+    http_conn_send(test_conn, req, len, 37);
+    ymo_assert(r_info.called == 1);
+    ymo_assert(!r_info.in_memory);
+    ymo_assert(r_info.spilled);
+    ymo_assert(body_matches(500));
+    http_conn_close(test_conn);
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int test_body_chunked_spill(void)
+{
+    char req[1024];
+    size_t len = sprintf(req,
+            "POST /upload HTTP/1.1\r\n"
+            "Host: example.com\r\n"
+            "Transfer-Encoding: chunked\r\n"
+            "\r\n");
+
+    /* 4 x 50 byte chunks: */
+    for( size_t c = 0; c < 4; c++ ) {
+        len += sprintf(req + len, "32\r\n");
+        for( size_t i = 0; i < 50; i++ ) {
+            req[len++] = 'a' + ((c * 50 + i) % 26);
+        }
+        len += sprintf(req + len, "\r\n");
+    }
+    len += sprintf(req + len, "0\r\n\r\n");
+
+    test_conn = http_conn_open();
+    http_conn_send(test_conn, req, len, 16);
+    ymo_assert(r_info.called == 1);
+    ymo_assert(r_info.spilled);
+    ymo_assert(body_matches(200));
+    http_conn_close(test_conn);
+    YMO_TAP_PASS(__func__);
+}
+
+
+/* Extensions, odd chunk sizes, and trailers, split at every offset; the
+ * next request on the connection must still parse:
+ */
+static int test_body_chunked_framing(void)
+{
+    char req[1024];
+    char next[256];
+    size_t next_len = put_post(next, 20);
+    size_t len = sprintf(req,
+            "POST /upload HTTP/1.1\r\n"
+            "Host: example.com\r\n"
+            "Transfer-Encoding: chunked\r\n"
+            "\r\n");
+    static const char* sizes[] = {
+        "1A", "001;name=value", "9 ;a;b=\"c\"", "6", NULL,
+    };
+
+    size_t offset = 0;
+    for( size_t c = 0; sizes[c]; c++ ) {
+        size_t chunk_len = strtoul(sizes[c], NULL, 16);
+        len += sprintf(req + len, "%s\r\n", sizes[c]);
+        for( size_t i = 0; i < chunk_len; i++ ) {
+            req[len++] = 'a' + (offset++ % 26);
+        }
+        len += sprintf(req + len, "\r\n");
+    }
+    len += sprintf(req + len,
+            "0;last\r\n"
+            "X-Checksum: 1234\r\n"
+            "X-Empty:\r\n"
+            "\r\n");
+
+    for( size_t chunk = 1; chunk <= len; chunk++ ) {
+        memset(&r_info, 0, sizeof(r_info));
+        test_conn = http_conn_open();
+        http_conn_send(test_conn, req, len, chunk);
+        ymo_assert(r_info.called == 1);
+        ymo_assert(body_matches(offset));
+
+        http_conn_send(test_conn, next, next_len, next_len);
+        ymo_assert(r_info.called == 2);
+        ymo_assert(body_matches(20));
+        http_conn_close(test_conn);
+    }
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int test_body_chunked_malformed(void)
+{
+    static const struct {
+        const char* body;
+        const char* status;
+    } cases[] = {
+        { "zz\r\n", "400" },                   /* Not hex */
+        { ";ext\r\n", "400" },                 /* No digits */
+        { "5\r\nabcdeXY0\r\n\r\n", "400" },     /* No CRLF after data */
+        { "5\r\nabcde\rX", "400" },             /* CR, but no LF */
+        { "5\n", "400" },                       /* Bare LF */
+        { "11111111111111111\r\n", "413" },    /* Overflow */
+        { NULL, NULL },
+    };
+
+    for( size_t c = 0; cases[c].body; c++ ) {
+        char req[256];
+        size_t len = sprintf(req,
+                "POST /upload HTTP/1.1\r\n"
+                "Host: example.com\r\n"
+                "Transfer-Encoding: chunked\r\n"
+                "\r\n%s", cases[c].body);
+
+        memset(&r_info, 0, sizeof(r_info));
+        test_conn = http_conn_open();
+        http_conn_send(test_conn, req, len, len);
+        ymo_assert(r_info.called == 0);
+
+        in_len = http_conn_recv(test_conn, in, sizeof(in));
+        if( strncmp(in + 9, cases[c].status, 3) ) {
+            printf("# %zu: %.12s\n", c, in);
+            ymo_assert_test_fail(cases[c].body);
+        }
+        http_conn_close(test_conn);
+    }
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int test_body_too_large(void)
+{
+    char req[256];
+    size_t len = sprintf(req,
+            "POST /upload HTTP/1.1\r\n"
+            "Host: example.com\r\n"
+            "Content-Length: %i\r\n"
+            "\r\n", BODY_MAX + 1);
+
+    test_conn = http_conn_open();
+    http_conn_send(test_conn, req, len, len);
+    ymo_assert(r_info.called == 0);
+
+    in_len = http_conn_recv(test_conn, in, sizeof(in));
+    ymo_assert(!strncmp(in, "HTTP/1.1 413 ", 13));
+    http_conn_close(test_conn);
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int test_body_keepalive(void)
+{
+    char req[2048];
+    size_t len = put_post(req, 300);
+    len += put_post(req + len, 20);
+
+    test_conn = http_conn_open();
+    http_conn_send(test_conn, req, len, len);
+    ymo_assert(r_info.called == 2);
+    ymo_assert(r_info.in_memory);
+    ymo_assert(!r_info.spilled);
+    ymo_assert(body_matches(20));
+    http_conn_close(test_conn);
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int test_pause_resume(void)
+{
+    test_conn = http_conn_open();
+    ymo_http_session_t* session = test_conn->conn->proto_data;
+
+    ymo_http_session_resume(session);
+    ymo_assert(ev_is_active(&test_conn->conn->w_read));
+    ymo_http_session_pause(session);
+    ymo_assert(!ev_is_active(&test_conn->conn->w_read));
+    http_conn_close(test_conn);
+    YMO_TAP_PASS(__func__);
+}
+
+
+/*---------------------------------------------------------------*
+ * Setup/Cleanup:
+ *---------------------------------------------------------------*/
+static int setup_suite(void)
+{
+    ymo_proto_t* proto = ymo_proto_http_create(
+            NULL, &http_cb, NULL, NULL, NULL, NULL, 0);
+    if( ymo_http_set_body_spool(proto, BODY_MEM_MAX, BODY_MAX) ) {
+        return -1;
+    }
+    test_server = test_server_create(proto);
+    return 0;
+}
+
+
+static int setup_test(void)
+{
+    memset(&r_info, 0, sizeof(r_info));
+    in_len = 0;
+    return 0;
+}
+
+
+static int cleanup(void)
+{
+    ymo_proto_http_cleanup(test_server->proto, test_server->server);
+    ymo_server_free(test_server->server);
+    YMO_FREE(test_server);
+    return 0;
+}
+
+
+YMO_TAP_RUN(&setup_suite, &setup_test, &cleanup,
+        YMO_TAP_TEST_FN(test_body_in_memory),
+        YMO_TAP_TEST_FN(test_body_spill),
+        YMO_TAP_TEST_FN(test_body_chunked_spill),
+        YMO_TAP_TEST_FN(test_body_chunked_framing),
+        YMO_TAP_TEST_FN(test_body_chunked_malformed),
+        YMO_TAP_TEST_FN(test_body_too_large),
+        YMO_TAP_TEST_FN(test_body_keepalive),
+        YMO_TAP_TEST_FN(test_pause_resume),
+        YMO_TAP_TEST_END()
+        )
+
@@ -0,0 +1,423 @@
+/*=============================================================================
+ * test/test_http_cache: Response microcache tests
+ *
+ * Copyright (c) 2014 Andrew Canaday
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *===========================================================================*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "yimmo_config.h"
+#include "yimmo.h"
+#include "ymo_log.h"
+#include "core/ymo_tap.h"
+#include "core/ymo_proto.h"
+#include "core/ymo_test_proto.h"
+
+#include "ymo_http_test.h"
+
+#include "ymo_http.h"
+#include "ymo_proto_http.h"
+#include "ymo_http_cache.h"
+
+#define CACHE_MAX   65536
+#define IO_BUF_SIZE 16384
+
+
+/* Client side: */
+typedef struct client {
+    ymo_test_conn_t* test_conn;
+    char             in[IO_BUF_SIZE];
+    size_t           in_len;
+} client_t;
+
+static client_t c1;
+static client_t c2;
+
+/* Server side: */
+static struct {
+    size_t                calls;          /* Handler invocations */
+    const char*           cache_control;  /* Cache-Control, or NULL */
+    const char*           vary;           /* Vary, or NULL */
+    int                   async;          /* Don't finish the response */
+    ymo_http_status_t     status;
+    ymo_http_response_t*  response;       /* Last response */
+} r_info;
+
+
+/*---------------------------------------------------------------*
+ * Handler:
+ *---------------------------------------------------------------*/
+static ymo_status_t http_cb(
+        ymo_http_session_t* session,
+        ymo_http_request_t* request,
+        ymo_http_response_t* response,
+        void* user)
+{
+    static char body[IO_BUF_SIZE];
+    size_t body_len;
+
+    ++r_info.calls;
+    ymo_http_response_set_status(response, r_info.status);
+    ymo_http_response_insert_header(response, "Content-Type", "text/plain");
+    if( r_info.cache_control ) {
+        ymo_http_response_insert_header(
+                response, "Cache-Control", r_info.cache_control);
+    }
+    if( r_info.vary ) {
+        ymo_http_response_insert_header(response, "Vary", r_info.vary);
+    }
+
+    /* Body: uri, query, and the call number (so we can tell them apart): */
+    body_len = snprintf(body, sizeof(body), "%s?%s #%zu",
+            request->uri, request->query ? request->query : "",
+            r_info.calls);
+    ymo_http_response_body_append(
+            response, YMO_BUCKET_FROM_CPY(body, body_len));
+
+    r_info.response = response;
+    if( !r_info.async ) {
+        ymo_http_response_finish(response);
+    }
+    return YMO_OKAY;
+}
+
+
+/*---------------------------------------------------------------*
+ * Utilities:
+ *---------------------------------------------------------------*/
+static void open_conn(client_t* c)
+{
+    c->test_conn = http_conn_open();
+    c->in_len = 0;
+    c->in[0] = '\0';
+}
+
+
+static void close_conn(client_t* c)
+{
+    http_conn_close(c->test_conn);
+    c->test_conn = NULL;
+}
+
+
+static void client_send(client_t* c, const char* path, const char* hdrs)
+{
+    char req[1024];
+    size_t len = snprintf(req, sizeof(req),
+            "GET %s HTTP/1.1\r\n"
+            "Host: example.com\r\n"
+            "%s"
+            "\r\n", path, hdrs ? hdrs : "");
+    http_conn_send(c->test_conn, req, len, 0);
+}
+
+
+/* Flush the connection; return whatever it sent: */
+static const char* client_recv(client_t* c)
+{
+    c->in_len = http_conn_recv(c->test_conn, c->in, sizeof(c->in));
+    return c->in;
+}
+
+
+/* Issue a request on c1 and return the response body: */
+static const char* get(const char* path, const char* hdrs)
+{
+    client_send(&c1, path, hdrs);
+    const char* body = strstr(client_recv(&c1), "\r\n\r\n");
+    return body ? body + 4 : "";
+}
+
+
+/* Issue a request on c1 and compare the response body: */
+static int get_eq(const char* path, const char* hdrs, const char* expected)
+{
+    const char* body = get(path, hdrs);
+    if( strcmp(body, expected) ) {
+        printf("# %s: expected \"%s\"; got \"%s\"\n",
+                path, expected, body);
+        return 0;
+    }
+    return 1;
+}
+
+
+static ymo_http_cache_stats_t stats(void)
+{
+    ymo_http_cache_stats_t s;
+    memset(&s, 0, sizeof(s));
+    ymo_http_cache_stats(test_server->proto, &s);
+    return s;
+}
+
+
+/*---------------------------------------------------------------*
+ * Tests:
+ *---------------------------------------------------------------*/
+static int test_cache_hit(void)
+{
+    ymo_assert(get_eq("/a", NULL, "/a? #1"));
+    ymo_assert(get_eq("/a", NULL, "/a? #1"));
+    ymo_assert(!strncmp(c1.in, "HTTP/1.1 200 OK\r\n", 17));
+    ymo_assert(strstr(c1.in, "Content-Length: 6\r\n") != NULL);
+    ymo_assert(strstr(c1.in, "Cache-Control: max-age=60\r\n") != NULL);
+
+    /* Different query, different entry: */
+    ymo_assert(get_eq("/a?x=1", NULL, "/a?x=1 #2"));
+    ymo_assert(get_eq("/a?x=1", NULL, "/a?x=1 #2"));
+    ymo_assert(r_info.calls == 2);
+
+    ymo_http_cache_stats_t s = stats();
+    ymo_assert(s.hits == 2);
+    ymo_assert(s.misses == 2);
+    ymo_assert(s.stores == 2);
+    ymo_assert(s.entries == 2);
+    ymo_assert(s.bytes > 0 && s.bytes <= CACHE_MAX);
+
+    /* Authorization bypasses the cache: */
+    ymo_assert(get_eq(
+                "/a", "Authorization: Basic Zm9vOmJhcg==\r\n", "/a? #3"));
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int test_cache_control(void)
+{
+    /* Not cacheable: */
+    r_info.cache_control = "private, max-age=60";
+    ymo_assert(get_eq("/b", NULL, "/b? #1"));
+    ymo_assert(get_eq("/b", NULL, "/b? #2"));
+
+    r_info.cache_control = "max-age=0";
+    ymo_assert(get_eq("/c", NULL, "/c? #3"));
+    ymo_assert(get_eq("/c", NULL, "/c? #4"));
+
+    r_info.cache_control = NULL;
+    r_info.status = YMO_HTTP_INTERNAL_SERVER_ERROR;
+    get("/d", NULL);
+    get("/d", NULL);
+    ymo_assert(r_info.calls == 6);
+
+    /* s-maxage wins; default TTL applies without either: */
+    r_info.status = YMO_HTTP_OK;
+    r_info.cache_control = "max-age=0, s-maxage=30";
+    ymo_assert(get_eq("/e", NULL, "/e? #7"));
+    ymo_assert(get_eq("/e", NULL, "/e? #7"));
+
+    r_info.cache_control = "public";
+    ymo_assert(get_eq("/f", NULL, "/f? #8"));
+    ymo_assert(get_eq("/f", NULL, "/f? #8"));
+    ymo_assert(stats().stores == 2);
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int test_cache_vary(void)
+{
+    /* Keyed: */
+    r_info.vary = "Accept-Language";
+    ymo_assert(get_eq("/v", "Accept-Language: en\r\n", "/v? #1"));
+    ymo_assert(get_eq("/v", "Accept-Language: fr\r\n", "/v? #2"));
+    ymo_assert(get_eq("/v", "Accept-Language: en\r\n", "/v? #1"));
+    ymo_assert(get_eq("/v", "accept-language: fr\r\n", "/v? #2"));
+
+    /* Not keyed: */
+    r_info.vary = "Cookie";
+    ymo_assert(get_eq("/w", NULL, "/w? #3"));
+    ymo_assert(get_eq("/w", NULL, "/w? #4"));
+
+    r_info.vary = "*";
+    ymo_assert(get_eq("/x", NULL, "/x? #5"));
+    ymo_assert(get_eq("/x", NULL, "/x? #6"));
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int test_cache_collapse(void)
+{
+    open_conn(&c2);
+
+    /* The first request misses and the second waits on it: */
+    r_info.async = 1;
+    client_send(&c1, "/slow", NULL);
+    client_send(&c2, "/slow", NULL);
+    ymo_assert(r_info.calls == 1);
+    ymo_assert(stats().collapsed == 1);
+    ymo_assert(!strlen(client_recv(&c2)));
+
+    ymo_http_response_finish(r_info.response);
+    ymo_assert(strstr(client_recv(&c1), "\r\n\r\n/slow? #1") != NULL);
+    ymo_assert(strstr(client_recv(&c2), "\r\n\r\n/slow? #1") != NULL);
+    ymo_assert(r_info.calls == 1);
+
+    /* If it isn't cacheable, the waiter goes to the handler after all: */
+    r_info.cache_control = "no-store";
+    client_send(&c1, "/slow2", NULL);
+    client_send(&c2, "/slow2", NULL);
+    ymo_assert(r_info.calls == 2);
+    ymo_http_response_finish(r_info.response);
+    ymo_assert(strstr(client_recv(&c1), "\r\n\r\n/slow2? #2") != NULL);
+    ymo_assert(r_info.calls == 3);
+    ymo_http_response_finish(r_info.response);
+    ymo_assert(strstr(client_recv(&c2), "\r\n\r\n/slow2? #3") != NULL);
+
+    /* ...and for a while after that, requests aren't collapsed: */
+    client_send(&c1, "/slow2", NULL);
+    client_send(&c2, "/slow2", NULL);
+    ymo_assert(r_info.calls == 5);
+    ymo_assert(stats().collapsed == 2);
+    ymo_http_response_finish(r_info.response);
+    client_recv(&c2);
+    close_conn(&c2);
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int test_cache_abandon(void)
+{
+    open_conn(&c2);
+
+    /* The connection filling the entry goes away; the waiter takes over: */
+    r_info.async = 1;
+    client_send(&c1, "/gone", NULL);
+    client_send(&c2, "/gone", NULL);
+    ymo_assert(r_info.calls == 1);
+    close_conn(&c1);
+    ymo_assert(r_info.calls == 2);
+
+    ymo_http_response_finish(r_info.response);
+    ymo_assert(strstr(client_recv(&c2), "\r\n\r\n/gone? #2") != NULL);
+
+    /* ...and the response it generated was stored: */
+    open_conn(&c1);
+    ymo_assert(get_eq("/gone", NULL, "/gone? #2"));
+
+    /* Waiters can go away, too: */
+    client_send(&c1, "/gone2", NULL);
+    client_send(&c2, "/gone2", NULL);
+    close_conn(&c2);
+    ymo_http_response_finish(r_info.response);
+    ymo_assert(strstr(client_recv(&c1), "\r\n\r\n/gone2? #3") != NULL);
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int test_cache_stale(void)
+{
+    ymo_http_cache_t* cache =
+        ((ymo_http_proto_data_t*)test_server->proto_data)->cache;
+
+    ymo_assert(get_eq("/s", NULL, "/s? #1"));
+    cache->lru_head->expires = 0;
+
+    /* One request refreshes it; meanwhile, others get the old copy: */
+    open_conn(&c2);
+    r_info.async = 1;
+    client_send(&c1, "/s", NULL);
+    ymo_assert(r_info.calls == 2);
+    client_send(&c2, "/s", NULL);
+    ymo_assert(strstr(client_recv(&c2), "\r\n\r\n/s? #1") != NULL);
+    ymo_assert(stats().stale == 1);
+
+    ymo_http_response_finish(r_info.response);
+    ymo_assert(strstr(client_recv(&c1), "\r\n\r\n/s? #2") != NULL);
+    client_send(&c2, "/s", NULL);
+    ymo_assert(strstr(client_recv(&c2), "\r\n\r\n/s? #2") != NULL);
+    ymo_assert(stats().hits == 1);
+    close_conn(&c2);
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int test_cache_evict(void)
+{
+    char path[32];
+    for( int i = 0; i < 256; i++ ) {
+        snprintf(path, sizeof(path), "/evict/%i", i);
+        get(path, NULL);
+    }
+
+    ymo_http_cache_stats_t s = stats();
+    ymo_assert(s.stores == 256);
+    ymo_assert(s.evictions > 0);
+    ymo_assert(s.entries == 256 - s.evictions);
+    ymo_assert(s.bytes <= CACHE_MAX);
+
+    /* Most recent is still there; the oldest isn't: */
+    ymo_assert(get_eq("/evict/255", NULL, "/evict/255? #256"));
+    ymo_assert(get_eq("/evict/0", NULL, "/evict/0? #257"));
+    YMO_TAP_PASS(__func__);
+}
+
+
+/*---------------------------------------------------------------*
+ * Setup/Cleanup:
+ *---------------------------------------------------------------*/
+static int setup_suite(void)
+{
+    ymo_proto_t* proto = ymo_proto_http_create(
+            NULL, &http_cb, NULL, NULL, NULL, NULL, 0);
+    if( ymo_http_set_cache(proto, CACHE_MAX, 10, "Accept-Language") ) {
+        return -1;
+    }
+    test_server = test_server_create(proto);
+    return 0;
+}
+
+
+static int setup_test(void)
+{
+    memset(&r_info, 0, sizeof(r_info));
+    r_info.status = YMO_HTTP_OK;
+    r_info.cache_control = "max-age=60";
+
+    /* Start each test with an empty cache: */
+    ymo_http_cache_t* cache =
+        ((ymo_http_proto_data_t*)test_server->proto_data)->cache;
+    ymo_http_cache_purge(cache);
+    memset(&cache->stats, 0, sizeof(cache->stats));
+    if( c1.test_conn ) {
+        close_conn(&c1);
+    }
+    open_conn(&c1);
+    return 0;
+}
+
+
+static int cleanup(void)
+{
+    close_conn(&c1);
+    ymo_proto_http_cleanup(test_server->proto, test_server->server);
+    ymo_server_free(test_server->server);
+    YMO_FREE(test_server);
+    return 0;
+}
+
+
+YMO_TAP_RUN(&setup_suite, &setup_test, &cleanup,
+        YMO_TAP_TEST_FN(test_cache_hit),
+        YMO_TAP_TEST_FN(test_cache_control),
+        YMO_TAP_TEST_FN(test_cache_vary),
+        YMO_TAP_TEST_FN(test_cache_collapse),
+        YMO_TAP_TEST_FN(test_cache_abandon),
+        YMO_TAP_TEST_FN(test_cache_stale),
+        YMO_TAP_TEST_FN(test_cache_evict),
+        YMO_TAP_TEST_END()
+        )
+
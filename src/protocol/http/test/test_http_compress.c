@@ -0,0 +1,428 @@
+/*=============================================================================
+ * test/test_http_compress: Response compression tests
+ *
+ * Copyright (c) 2014 Andrew Canaday
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *===========================================================================*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "yimmo_config.h"
+#include "yimmo.h"
+#include "ymo_log.h"
+#include "core/ymo_tap.h"
+#include "core/ymo_proto.h"
+#include "core/ymo_test_proto.h"
+
+#include "ymo_http_test.h"
+
+#include "ymo_http.h"
+#include "ymo_proto_http.h"
+#include "ymo_http_compress.h"
+
+#define IO_BUF_SIZE 65536
+#define MIN_SIZE    64
+
+static ymo_test_conn_t* test_conn = NULL;
+
+static char in[IO_BUF_SIZE];
+static size_t in_len;
+static char body[IO_BUF_SIZE];
+static size_t body_len;
+static char payload[8192];
+
+/* Server side: */
+static struct {
+    const char*           type;     /* Content-Type, or NULL */
+    size_t                len;      /* Bytes of payload to send */
+    int                   level;    /* Compression level override */
+    int                   set_cl;   /* Set Content-Length ourselves */
+    int                   stream;   /* Don't finish the response */
+    ymo_http_response_t*  response;
+} r_info;
+
+
+/*---------------------------------------------------------------*
+ * Handler:
+ *---------------------------------------------------------------*/
+static ymo_status_t http_cb(
+        ymo_http_session_t* session,
+        ymo_http_request_t* request,
+        ymo_http_response_t* response,
+        void* user)
+{
+    static char cl[32];
+
+    ymo_http_response_set_status(response, YMO_HTTP_OK);
+    if( r_info.type ) {
+        ymo_http_response_insert_header(
+                response, "Content-Type", r_info.type);
+    }
+    if( r_info.set_cl ) {
+        snprintf(cl, sizeof(cl), "%zu", r_info.len);
+        ymo_http_response_insert_header(response, "Content-Length", cl);
+    }
+    if( r_info.level != YMO_HTTP_COMPRESS_DEFAULT ) {
+        ymo_http_response_set_compression(response, r_info.level);
+    }
+
+    ymo_http_response_body_append(
+            response, YMO_BUCKET_FROM_REF(payload, r_info.len));
+    r_info.response = response;
+    if( !r_info.stream ) {
+        ymo_http_response_finish(response);
+    }
+    return YMO_OKAY;
+}
+
+
+/*---------------------------------------------------------------*
+ * Utilities:
+ *---------------------------------------------------------------*/
+static void client_send(const char* method, const char* accept)
+{
+    char req[512];
+    size_t len = snprintf(req, sizeof(req),
+            "%s /data HTTP/1.1\r\n"
+            "Host: example.com\r\n"
+            "%s%s%s"
+            "\r\n", method,
+            accept ? "Accept-Encoding: " : "",
+            accept ? accept : "",
+            accept ? "\r\n" : "");
+    http_conn_send(test_conn, req, len, 0);
+}
+
+
+/* Issue a complete request/response on a fresh connection: */
+static void get(const char* method, const char* accept)
+{
+    test_conn = http_conn_open();
+    client_send(method, accept);
+    in_len += http_conn_recv(test_conn, in + in_len, sizeof(in) - in_len);
+    http_conn_close(test_conn);
+}
+
+
+/* Extract the response body (de-chunking, if need be) into body: */
+static int get_body(void)
+{
+    char value[64];
+    const char* p = strstr(in, "\r\n\r\n");
+    if( !p ) {
+        return 0;
+    }
+    p += 4;
+
+    const char* end = in + in_len;
+    body_len = 0;
+    if( !http_header(in, "Transfer-Encoding", value, sizeof(value)) ) {
+        body_len = (size_t)(end - p);
+        memcpy(body, p, body_len);
+        return 1;
+    }
+
+    while( p < end ) {
+        char* chunk;
+        size_t chunk_len = strtoul(p, &chunk, 16);
+        chunk += 2;
+        if( !chunk_len ) {
+            return 1;
+        }
+        memcpy(body + body_len, chunk, chunk_len);
+        body_len += chunk_len;
+        p = chunk + chunk_len + 2;
+    }
+    return 0;
+}
+
+
+#ifdef HAVE_ZLIB
+/* Inflate body, and compare it against the payload: */
+static int body_inflates_to(size_t len)
+{
+    static char out[sizeof(payload)];
+    z_stream z;
+    memset(&z, 0, sizeof(z));
+    if( inflateInit2(&z, MAX_WBITS + 32) != Z_OK ) {
+        return 0;
+    }
+    z.next_in = (Bytef*)body;
+    z.avail_in = (uInt)body_len;
+    z.next_out = (Bytef*)out;
+    z.avail_out = sizeof(out);
+    int rc = inflate(&z, Z_FINISH);
+    size_t out_len = sizeof(out) - z.avail_out;
+    inflateEnd(&z);
+    return rc == Z_STREAM_END && out_len == len && !memcmp(out, payload, len);
+}
+#else
+static int body_inflates_to(size_t len)
+{
+    return 0;
+}
+#endif /* HAVE_ZLIB */
+
+
+/*---------------------------------------------------------------*
+ * Tests:
+ *---------------------------------------------------------------*/
+static int test_accept_q(void)
+{
+    ymo_assert(ymo_http_accept_q("gzip", "gzip") == 1000);
+    ymo_assert(ymo_http_accept_q("GZIP", "gzip") == 1000);
+    ymo_assert(ymo_http_accept_q("br;q=0.5, gzip", "br") == 500);
+    ymo_assert(ymo_http_accept_q("br ; q=0.25 ,gzip", "br") == 250);
+    ymo_assert(ymo_http_accept_q("gzip;q=0", "gzip") == 0);
+    ymo_assert(ymo_http_accept_q("gzip;q=0.000", "gzip") == 0);
+    ymo_assert(ymo_http_accept_q("deflate", "gzip") == 0);
+    ymo_assert(ymo_http_accept_q("*;q=0.1", "gzip") == 100);
+    ymo_assert(ymo_http_accept_q("*, gzip;q=0", "gzip") == 0);
+    ymo_assert(ymo_http_accept_q("gzip;q=2", "gzip") == 0);
+    ymo_assert(ymo_http_accept_q("", "gzip") == 0);
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int test_compressible_type(void)
+{
+    ymo_assert(ymo_http_compressible_type("text/html"));
+    ymo_assert(ymo_http_compressible_type("text/plain; charset=utf-8"));
+    ymo_assert(ymo_http_compressible_type("application/json"));
+    ymo_assert(ymo_http_compressible_type("Application/JSON;charset=utf-8"));
+    ymo_assert(ymo_http_compressible_type("application/problem+json"));
+    ymo_assert(ymo_http_compressible_type("application/atom+xml"));
+    ymo_assert(ymo_http_compressible_type("image/svg+xml"));
+    ymo_assert(!ymo_http_compressible_type("text/event-stream"));
+    ymo_assert(!ymo_http_compressible_type("image/png"));
+    ymo_assert(!ymo_http_compressible_type("application/zip"));
+    ymo_assert(!ymo_http_compressible_type("application/json-seq-ish"));
+    ymo_assert(!ymo_http_compressible_type("font/woff2"));
+    ymo_assert(!ymo_http_compressible_type(NULL));
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int test_compress_gzip(void)
+{
+    char value[64];
+    if( !ymo_http_coding_available(YMO_HTTP_CODING_GZIP) ) {
+        YMO_TAP_PASS(__func__);
+    }
+
+    get("GET", "gzip, deflate");
+    ymo_assert(!strncmp(in, "HTTP/1.1 200 OK\r\n", 17));
+    ymo_assert(http_header(in, "Content-Encoding", value, sizeof(value)));
+    ymo_assert_str_eq(value, "gzip");
+    ymo_assert(http_header(in, "Vary", value, sizeof(value)));
+    ymo_assert_str_eq(value, "Accept-Encoding");
+    ymo_assert(http_header(in, "Content-Length", value, sizeof(value)));
+    ymo_assert(get_body());
+    ymo_assert((size_t)atoi(value) == body_len);
+    ymo_assert(body_len < r_info.len / 4);
+    ymo_assert(body_inflates_to(r_info.len));
+
+    /* deflate (zlib wrapper): */
+    in_len = 0;
+    get("GET", "deflate");
+    ymo_assert(http_header(in, "Content-Encoding", value, sizeof(value)));
+    ymo_assert_str_eq(value, "deflate");
+    ymo_assert(get_body());
+    ymo_assert(body_inflates_to(r_info.len));
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int test_compress_negotiate(void)
+{
+    char value[64];
+
+    /* q-values beat server preference: */
+    get("GET", "br;q=0.5, zstd;q=0.5, gzip");
+    ymo_assert(http_header(in, "Content-Encoding", value, sizeof(value)));
+    ymo_assert_str_eq(value, "gzip");
+
+    /* Equal weights go to the server's preference: */
+    in_len = 0;
+    get("GET", "gzip, zstd, br");
+    ymo_assert(http_header(in, "Content-Encoding", value, sizeof(value)));
+    ymo_assert_str_eq(value, ymo_http_coding_name(
+                ymo_http_coding_available(YMO_HTTP_CODING_BR)
+                ? YMO_HTTP_CODING_BR
+                : ymo_http_coding_available(YMO_HTTP_CODING_ZSTD)
+                ? YMO_HTTP_CODING_ZSTD : YMO_HTTP_CODING_GZIP));
+
+    /* Nothing acceptable: */
+    in_len = 0;
+    get("GET", "compress, gzip;q=0, *;q=0");
+    ymo_assert(!http_header(in, "Content-Encoding", value, sizeof(value)));
+    ymo_assert(http_header(in, "Vary", value, sizeof(value)));
+    ymo_assert(get_body());
+    ymo_assert(body_len == r_info.len);
+
+    /* No Accept-Encoding at all: */
+    in_len = 0;
+    get("GET", NULL);
+    ymo_assert(!http_header(in, "Content-Encoding", value, sizeof(value)));
+    ymo_assert(http_header(in, "Vary", value, sizeof(value)));
+
+    /* HEAD: */
+    in_len = 0;
+    get("HEAD", "gzip");
+    ymo_assert(!http_header(in, "Content-Encoding", value, sizeof(value)));
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int test_compress_skip(void)
+{
+    char value[64];
+
+    /* Too small: */
+    r_info.len = MIN_SIZE - 1;
+    get("GET", "gzip");
+    ymo_assert(!http_header(in, "Content-Encoding", value, sizeof(value)));
+    ymo_assert(get_body());
+    ymo_assert(body_len == MIN_SIZE - 1);
+
+    /* Already compressed type: */
+    in_len = 0;
+    r_info.len = sizeof(payload);
+    r_info.type = "image/png";
+    get("GET", "gzip");
+    ymo_assert(!http_header(in, "Content-Encoding", value, sizeof(value)));
+    ymo_assert(!http_header(in, "Vary", value, sizeof(value)));
+
+    /* Per-response override: */
+    in_len = 0;
+    r_info.type = "application/json";
+    r_info.level = 0;
+    get("GET", "gzip");
+    ymo_assert(!http_header(in, "Content-Encoding", value, sizeof(value)));
+    ymo_assert(get_body());
+    ymo_assert(body_len == sizeof(payload));
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int test_compress_content_length(void)
+{
+    char value[64];
+    if( !ymo_http_coding_available(YMO_HTTP_CODING_GZIP) ) {
+        YMO_TAP_PASS(__func__);
+    }
+
+    r_info.set_cl = 1;
+    r_info.level = 9;
+    get("GET", "gzip");
+    ymo_assert(http_header(in, "Content-Encoding", value, sizeof(value)));
+    ymo_assert(http_header(in, "Content-Length", value, sizeof(value)));
+    ymo_assert(get_body());
+    ymo_assert((size_t)atoi(value) == body_len);
+    ymo_assert(body_inflates_to(r_info.len));
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int test_compress_stream(void)
+{
+    char value[64];
+    if( !ymo_http_coding_available(YMO_HTTP_CODING_GZIP) ) {
+        YMO_TAP_PASS(__func__);
+    }
+
+    /* The first piece is sent (and flushed) before we finish: */
+    r_info.stream = 1;
+    r_info.len = 1024;
+    test_conn = http_conn_open();
+    client_send("GET", "gzip");
+    in_len += http_conn_recv(test_conn, in + in_len, sizeof(in) - in_len);
+    ymo_assert(http_header(in, "Content-Encoding", value, sizeof(value)));
+    ymo_assert(http_header(in, "Transfer-Encoding", value, sizeof(value)));
+    ymo_assert(!http_header(in, "Content-Length", value, sizeof(value)));
+    ymo_assert(strstr(in, "\r\n\r\n")[4] != '0');
+
+    /* Then the rest: */
+    ymo_http_response_body_append(r_info.response,
+            YMO_BUCKET_FROM_REF(payload + 1024, sizeof(payload) - 1024));
+    ymo_http_response_finish(r_info.response);
+    in_len += http_conn_recv(test_conn, in + in_len, sizeof(in) - in_len);
+    ymo_assert(get_body());
+    ymo_assert(body_inflates_to(sizeof(payload)));
+    http_conn_close(test_conn);
+    YMO_TAP_PASS(__func__);
+}
+
+
+/*---------------------------------------------------------------*
+ * Setup/Cleanup:
+ *---------------------------------------------------------------*/
+static int setup_suite(void)
+{
+    /* Something JSON-ish: */
+    size_t len = 0;
+    for( int i = 0; len < sizeof(payload); i++ ) {
+        len += snprintf(payload + len, sizeof(payload) - len,
+                "{\"id\":%i,\"name\":\"item-%i\",\"tags\":[\"a\",\"b\"]},",
+                i, i * 7);
+    }
+
+    ymo_proto_t* proto = ymo_proto_http_create(
+            NULL, &http_cb, NULL, NULL, NULL, NULL, 0);
+    ymo_status_t status = ymo_http_set_compression(
+            proto, YMO_HTTP_COMPRESS_LEVEL, MIN_SIZE);
+    if( status != YMO_OKAY && status != ENOTSUP ) {
+        return -1;
+    }
+    test_server = test_server_create(proto);
+    return 0;
+}
+
+
+static int setup_test(void)
+{
+    memset(&r_info, 0, sizeof(r_info));
+    r_info.type = "application/json";
+    r_info.len = sizeof(payload);
+    r_info.level = YMO_HTTP_COMPRESS_DEFAULT;
+    in_len = 0;
+    body_len = 0;
+    return 0;
+}
+
+
+static int cleanup(void)
+{
+    ymo_proto_http_cleanup(test_server->proto, test_server->server);
+    ymo_server_free(test_server->server);
+    YMO_FREE(test_server);
+    return 0;
+}
+
+
+YMO_TAP_RUN(&setup_suite, &setup_test, &cleanup,
+        YMO_TAP_TEST_FN(test_accept_q),
+        YMO_TAP_TEST_FN(test_compressible_type),
+        YMO_TAP_TEST_FN(test_compress_gzip),
+        YMO_TAP_TEST_FN(test_compress_negotiate),
+        YMO_TAP_TEST_FN(test_compress_skip),
+        YMO_TAP_TEST_FN(test_compress_content_length),
+        YMO_TAP_TEST_FN(test_compress_stream),
+        YMO_TAP_TEST_END()
+        )
+
@@ -0,0 +1,273 @@
+/*=============================================================================
+ * test/test_http_drain: Tests for response flow control.
+ *
+ * Copyright (c) 2014 Andrew Canaday
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *===========================================================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "yimmo_config.h"
+#include "yimmo.h"
+#include "ymo_log.h"
+#include "core/ymo_tap.h"
+#include "core/ymo_proto.h"
+#include "core/ymo_test_proto.h"
+
+#include "ymo_http_test.h"
+
+#include "ymo_http.h"
+#include "ymo_proto_http.h"
+
+#define HIGH_WATER  16384
+#define LOW_WATER   4096
+#define PIECE_LEN   1024
+#define BODY_LEN    (1024 * 1024)
+#define SOCK_BUF    4096
+#define MAX_WRITES  100000
+
+static const char* req_stream =
+    "GET /stream HTTP/1.1\r\n"
+    "Host: example.com\r\n"
+    "\r\n";
+
+static const char* req_stream_1_0 =
+    "GET /stream HTTP/1.0\r\n"
+    "Host: example.com\r\n"
+    "\r\n";
+
+static ymo_test_conn_t* test_conn = NULL;
+static char piece[PIECE_LEN];
+
+/* Producer state: */
+static struct {
+    size_t        produced;
+    size_t        max_queued;
+    int           no_drains;
+    int           unwritable;
+    ymo_status_t  drain_status;
+} p_info;
+
+/* Client side: */
+static size_t no_recv;
+static char tail[8];
+
+
+/*---------------------------------------------------------------*
+ * Handlers:
+ *---------------------------------------------------------------*/
+
+/* Append pieces while the response is writable: */
+static ymo_status_t produce(
+        ymo_http_session_t* session,
+        ymo_http_response_t* response,
+        void* user_data)
+{
+    while( ymo_http_response_writable(response) ) {
+        if( p_info.produced == BODY_LEN ) {
+            ymo_http_response_finish(response);
+            return YMO_OKAY;
+        }
+
+        ymo_http_response_body_append(
+                response, YMO_BUCKET_FROM_REF(piece, PIECE_LEN));
+        p_info.produced += PIECE_LEN;
+        p_info.max_queued = YMO_MAX(
+                p_info.max_queued, ymo_http_response_queued(response));
+    }
+    p_info.unwritable++;
+    return YMO_OKAY;
+}
+
+
+static ymo_status_t on_drain(
+        ymo_http_session_t* session,
+        ymo_http_response_t* response,
+        void* user_data)
+{
+    p_info.no_drains++;
+    if( p_info.drain_status != YMO_OKAY ) {
+        return p_info.drain_status;
+    }
+    return produce(session, response, user_data);
+}
+
+
+static ymo_status_t http_cb(
+        ymo_http_session_t* session,
+        ymo_http_request_t* request,
+        ymo_http_response_t* response,
+        void* user)
+{
+    ymo_http_response_insert_header(
+            response, "Content-Type", "application/octet-stream");
+    ymo_http_response_set_status(response, YMO_HTTP_OK);
+    ymo_http_response_set_compression(response, 0);
+    ymo_http_response_set_watermarks(response, HIGH_WATER, LOW_WATER);
+    ymo_http_response_on_drain(response, &on_drain, NULL);
+    return produce(session, response, NULL);
+}
+
+
+/*---------------------------------------------------------------*
+ * Utilities:
+ *---------------------------------------------------------------*/
+static void open_conn(void)
+{
+    int sock_buf = SOCK_BUF;
+    test_conn = http_conn_open();
+    setsockopt(test_conn->fd_send, SOL_SOCKET, SO_SNDBUF,
+            &sock_buf, sizeof(sock_buf));
+    setsockopt(test_conn->fd_read, SOL_SOCKET, SO_RCVBUF,
+            &sock_buf, sizeof(sock_buf));
+}
+
+
+/* Read whatever's available, keeping a count and the last few bytes: */
+static void client_drain(void)
+{
+    char buf[SOCK_BUF];
+    ssize_t n;
+    while( (n = read(test_conn->fd_read, buf, sizeof(buf))) > 0 ) {
+        no_recv += n;
+        if( n >= (ssize_t)sizeof(tail) ) {
+            memcpy(tail, buf + n - sizeof(tail), sizeof(tail));
+        } else {
+            memmove(tail, tail + n, sizeof(tail) - n);
+            memcpy(tail + sizeof(tail) - n, buf, n);
+        }
+    }
+}
+
+
+/* Alternate write callbacks and client reads, as a slow client would,
+ * until the connection has nothing left to send:
+ */
+static ymo_status_t run_writes(void)
+{
+    ymo_status_t status;
+    size_t no_writes = 0;
+    do {
+        status = ymo_proto_http_write(
+                test_server->proto_data, test_conn->conn,
+                test_conn->conn->proto_data, test_conn->fd_send);
+        client_drain();
+    } while( status == YMO_WOULDBLOCK && ++no_writes < MAX_WRITES );
+    return status;
+}
+
+
+/*---------------------------------------------------------------*
+ * Tests:
+ *---------------------------------------------------------------*/
+static int test_drain_stream(void)
+{
+    open_conn();
+    http_conn_send(test_conn, req_stream, strlen(req_stream), 0);
+
+    /* The handler stops at the high water mark: */
+    ymo_assert(p_info.produced == HIGH_WATER);
+    ymo_assert(p_info.unwritable == 1);
+    ymo_assert(p_info.no_drains == 0);
+
+    /* ...and is called back for more as the client reads: */
+    ymo_assert(run_writes() == YMO_OKAY);
+    ymo_assert(p_info.produced == BODY_LEN);
+    ymo_assert(p_info.no_drains > 1);
+    ymo_assert(p_info.max_queued <= HIGH_WATER + PIECE_LEN);
+    ymo_assert(no_recv > BODY_LEN);
+    ymo_assert(!memcmp(tail + 3, "0\r\n\r\n", 5));
+    http_conn_close(test_conn);
+
+    printf("# %i drain callbacks; at most %zu bytes queued\n",
+            p_info.no_drains, p_info.max_queued);
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int test_drain_error(void)
+{
+    open_conn();
+    http_conn_send(test_conn, req_stream, strlen(req_stream), 0);
+    ymo_assert(p_info.produced == HIGH_WATER);
+
+    /* A drain callback error is the write callback's error: */
+    p_info.drain_status = ECANCELED;
+    ymo_assert(run_writes() == ECANCELED);
+    ymo_assert(p_info.no_drains == 1);
+    http_conn_close(test_conn);
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int test_unstreamed(void)
+{
+    /* HTTP/1.0 bodies are sent in one go, so they're always writable: */
+    open_conn();
+    http_conn_send(test_conn, req_stream_1_0, strlen(req_stream_1_0), 0);
+    ymo_assert(p_info.produced == BODY_LEN);
+    ymo_assert(p_info.unwritable == 0);
+    ymo_assert(p_info.max_queued == BODY_LEN);
+
+    ymo_assert(run_writes() == YMO_OKAY);
+    ymo_assert(p_info.no_drains == 0);
+    ymo_assert(no_recv > BODY_LEN);
+    http_conn_close(test_conn);
+    YMO_TAP_PASS(__func__);
+}
+
+
+/*---------------------------------------------------------------*
+ * Setup/Cleanup:
+ *---------------------------------------------------------------*/
+static int setup_suite(void)
+{
+    memset(piece, 'x', sizeof(piece));
+    ymo_proto_t* proto = ymo_proto_http_create(
+            NULL, &http_cb, NULL, NULL, NULL, NULL, 0);
+    test_server = test_server_create(proto);
+    return 0;
+}
+
+
+static int setup_test(void)
+{
+    memset(&p_info, 0, sizeof(p_info));
+    memset(tail, 0, sizeof(tail));
+    no_recv = 0;
+    return 0;
+}
+
+
+static int cleanup(void)
+{
+    ymo_proto_http_cleanup(test_server->proto, test_server->server);
+    ymo_server_free(test_server->server);
+    YMO_FREE(test_server);
+    return 0;
+}
+
+
+YMO_TAP_RUN(&setup_suite, &setup_test, &cleanup,
+        YMO_TAP_TEST_FN(test_drain_stream),
+        YMO_TAP_TEST_FN(test_drain_error),
+        YMO_TAP_TEST_FN(test_unstreamed),
+        YMO_TAP_TEST_END()
+        )
@@ -0,0 +1,315 @@
+/*=============================================================================
+ * test/test_http_headers: Tests for large request line/header handling.
+ *
+ * Copyright (c) 2014 Andrew Canaday
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *===========================================================================*/
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "yimmo_config.h"
+#include "yimmo.h"
+#include "ymo_log.h"
+#include "core/ymo_tap.h"
+#include "core/ymo_proto.h"
+#include "core/ymo_test_proto.h"
+
+#include "ymo_http_test.h"
+
+#include "ymo_http.h"
+#include "ymo_proto_http.h"
+#include "ymo_http_exchange.h"
+#include "ymo_http_session.h"
+
+#define IO_BUF_SIZE  8192
+#define REQ_BUF_SIZE (32 * 1024)
+#define NO_PAD_HDRS  40
+
+static ymo_test_conn_t* test_conn = NULL;
+
+static char in[IO_BUF_SIZE];
+static size_t in_len;
+
+/* Expected values, filled in by put_request: */
+static char uri[2048];
+static char query[512];
+static char cookie[REQ_BUF_SIZE];
+static char bearer[2048];
+
+/* Server side: */
+static struct {
+    int     called;
+    int     matched;  /* Every value in the request was as expected */
+    int     grew;     /* Overflow blocks were in use */
+    ymo_http_exchange_t* exchange;
+} r_info;
+
+
+/*---------------------------------------------------------------*
+ * Handler:
+ *---------------------------------------------------------------*/
+static int hdr_matches(
+        ymo_http_request_t* request, const char* name, const char* expected)
+{
+    const char* value = ymo_http_hdr_table_get(&request->headers, name);
+    return value && !strcmp(value, expected);
+}
+
+
+static ymo_status_t http_cb(
+        ymo_http_session_t* session,
+        ymo_http_request_t* request,
+        ymo_http_response_t* response,
+        void* user)
+{
+    char name[32];
+    char value[64];
+
+    r_info.called++;
+    r_info.exchange = session->exchange;
+    r_info.grew = (session->exchange->hdr_blocks != NULL);
+    r_info.matched = !strcmp(request->method, "GET")
+        && !strcmp(request->uri, uri)
+        && !strcmp(request->query, query)
+        && !strcmp(request->version, "HTTP/1.1")
+        && hdr_matches(request, "Host", "example.com")
+        && hdr_matches(request, "Cookie", cookie)
+        && hdr_matches(request, "Authorization", bearer);
+
+    for( int i = 0; i < NO_PAD_HDRS && r_info.matched; i++ ) {
+        snprintf(name, sizeof(name), "X-Pad-%i", i);
+        snprintf(value, sizeof(value), "pad-value-%i-0123456789abcdef", i);
+        r_info.matched = hdr_matches(request, name, value);
+    }
+
+    ymo_http_response_set_status(response, YMO_HTTP_OK);
+    ymo_http_response_body_append(response, YMO_BUCKET_FROM_REF("OK", 2));
+    ymo_http_response_finish(response);
+    return YMO_OKAY;
+}
+
+
+/*---------------------------------------------------------------*
+ * Utilities:
+ *---------------------------------------------------------------*/
+static void fill(char* buf, size_t len, const char* prefix)
+{
+    size_t n = strlen(prefix);
+    memcpy(buf, prefix, n);
+    for( size_t i = n; i < len; i++ ) {
+        buf[i] = 'A' + (i % 26);
+    }
+    buf[len] = '\0';
+}
+
+
+/* A GET with a long URI, a cookie of cookie_len bytes, a bearer token,
+ * and a handful of short headers: */
+static size_t put_request(char* buf, size_t cookie_len)
+{
+    fill(uri, 1500, "/");
+    fill(query, 300, "q=");
+    fill(cookie, cookie_len, "session=");
+    fill(bearer, 1200, "Bearer ");
+
+    size_t len = sprintf(buf,
+            "GET %s?%s HTTP/1.1\r\n"
+            "Host: example.com\r\n"
+            "Cookie: %s\r\n"
+            "Authorization: %s\r\n",
+            uri, query, cookie, bearer);
+    for( int i = 0; i < NO_PAD_HDRS; i++ ) {
+        len += sprintf(buf + len,
+                "X-Pad-%i: pad-value-%i-0123456789abcdef\r\n", i, i);
+    }
+    len += sprintf(buf + len, "\r\n");
+    return len;
+}
+
+
+/* Once the response has been sent, its exchange is back in the pool: */
+static int exchange_is_small(void)
+{
+    ymo_http_proto_data_t* http_data = test_server->proto_data;
+    ymo_http_exchange_t* exchange = http_data->exchange_pool.idle;
+    return exchange
+        && exchange == r_info.exchange
+        && exchange->hdr_blocks == NULL
+        && exchange->hdr_size == YMO_HTTP_RECV_BUF_SIZE
+        && exchange->recv_current == exchange->recv_buf;
+}
+
+
+/*---------------------------------------------------------------*
+ * Tests:
+ *---------------------------------------------------------------*/
+static int test_headers_small(void)
+{
+    const char* req =
+        "GET /small HTTP/1.1\r\n"
+        "Host: example.com\r\n"
+        "\r\n";
+
+    test_conn = http_conn_open();
+    ymo_assert(http_conn_send(test_conn, req, strlen(req), 4096) == 0);
+    in_len = http_conn_recv(test_conn, in, sizeof(in));
+    ymo_assert(r_info.called == 1);
+    ymo_assert(!r_info.grew);
+    ymo_assert(!strncmp(in, "HTTP/1.1 200 ", 13));
+    ymo_assert(exchange_is_small());
+    http_conn_close(test_conn);
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int test_headers_large(void)
+{
+    static char req[REQ_BUF_SIZE];
+    size_t len = put_request(req, 3000);
+    ymo_assert(len > 4 * YMO_HTTP_RECV_BUF_SIZE);
+
+    /* Every read size, on one keep-alive connection: */
+    test_conn = http_conn_open();
+    for( size_t chunk = 1; chunk <= len; chunk++ ) {
+        memset(&r_info, 0, sizeof(r_info));
+        ymo_assert(http_conn_send(test_conn, req, len, chunk) == 0);
+        in_len = http_conn_recv(test_conn, in, sizeof(in));
+        if( r_info.called != 1 || !r_info.matched || !r_info.grew ) {
+            printf("# chunk=%zu: called=%i, matched=%i, grew=%i\n",
+                    chunk, r_info.called, r_info.matched, r_info.grew);
+            ymo_assert_test_fail("large request not parsed intact");
+        }
+        ymo_assert(!strncmp(in, "HTTP/1.1 200 ", 13));
+
+        /* ...and back down to recv_buf once it's been handled: */
+        ymo_assert(exchange_is_small());
+    }
+    http_conn_close(test_conn);
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int test_headers_one_large_value(void)
+{
+    static char req[REQ_BUF_SIZE];
+    static const size_t chunks[] = { 1, 7, 512, 4096, REQ_BUF_SIZE };
+
+    /* Half the limit, in a single value: */
+    size_t len = put_request(req, YMO_HTTP_HDR_MAX_DEFAULT / 2);
+
+    test_conn = http_conn_open();
+    for( size_t i = 0; i < sizeof(chunks)/sizeof(chunks[0]); i++ ) {
+        memset(&r_info, 0, sizeof(r_info));
+        ymo_assert(http_conn_send(test_conn, req, len, chunks[i]) == 0);
+        in_len = http_conn_recv(test_conn, in, sizeof(in));
+        ymo_assert(r_info.called == 1);
+        ymo_assert(r_info.matched);
+        ymo_assert(!strncmp(in, "HTTP/1.1 200 ", 13));
+        ymo_assert(exchange_is_small());
+    }
+    http_conn_close(test_conn);
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int test_headers_too_large(void)
+{
+    static char req[REQ_BUF_SIZE];
+    size_t len = put_request(req, YMO_HTTP_HDR_MAX_DEFAULT);
+
+    test_conn = http_conn_open();
+    http_conn_send(test_conn, req, len, 4096);
+    in_len = http_conn_recv(test_conn, in, sizeof(in));
+    ymo_assert(r_info.called == 0);
+    ymo_assert(!strncmp(in, "HTTP/1.1 413 ", 13));
+    http_conn_close(test_conn);
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int test_headers_max_setting(void)
+{
+    static char req[REQ_BUF_SIZE];
+    size_t len = put_request(req, 3000);
+
+    ymo_assert(ymo_http_set_max_header_size(
+                test_server->proto, YMO_HTTP_RECV_BUF_SIZE - 1) == EINVAL);
+
+    /* Under the lowered limit, the same request fails: */
+    ymo_assert(ymo_http_set_max_header_size(
+                test_server->proto, 4096) == YMO_OKAY);
+    test_conn = http_conn_open();
+    http_conn_send(test_conn, req, len, 512);
+    in_len = http_conn_recv(test_conn, in, sizeof(in));
+    ymo_assert(r_info.called == 0);
+    ymo_assert(!strncmp(in, "HTTP/1.1 413 ", 13));
+    http_conn_close(test_conn);
+
+    /* ...and succeeds once it's raised again: */
+    ymo_assert(ymo_http_set_max_header_size(
+                test_server->proto, YMO_HTTP_HDR_MAX_DEFAULT) == YMO_OKAY);
+    test_conn = http_conn_open();
+    ymo_assert(http_conn_send(test_conn, req, len, 512) == 0);
+    in_len = http_conn_recv(test_conn, in, sizeof(in));
+    ymo_assert(r_info.called == 1);
+    ymo_assert(r_info.matched);
+    ymo_assert(!strncmp(in, "HTTP/1.1 200 ", 13));
+    http_conn_close(test_conn);
+    YMO_TAP_PASS(__func__);
+}
+
+
+/*---------------------------------------------------------------*
+ * Setup/Cleanup:
+ *---------------------------------------------------------------*/
+static int setup_suite(void)
+{
+    ymo_proto_t* proto = ymo_proto_http_create(
+            NULL, &http_cb, NULL, NULL, NULL, NULL, 0);
+    test_server = test_server_create(proto);
+    return 0;
+}
+
+
+static int setup_test(void)
+{
+    memset(&r_info, 0, sizeof(r_info));
+    in_len = 0;
+    return 0;
+}
+
+
+static int cleanup(void)
+{
+    ymo_proto_http_cleanup(test_server->proto, test_server->server);
+    ymo_server_free(test_server->server);
+    YMO_FREE(test_server);
+    return 0;
+}
+
+
+YMO_TAP_RUN(&setup_suite, &setup_test, &cleanup,
+        YMO_TAP_TEST_FN(test_headers_small),
+        YMO_TAP_TEST_FN(test_headers_large),
+        YMO_TAP_TEST_FN(test_headers_one_large_value),
+        YMO_TAP_TEST_FN(test_headers_too_large),
+        YMO_TAP_TEST_FN(test_headers_max_setting),
+        YMO_TAP_TEST_END()
+        )
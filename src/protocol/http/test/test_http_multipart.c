@@ -0,0 +1,432 @@
+/*=============================================================================
+ * test/test_http_multipart: Streaming multipart parser tests
+ *
+ * Copyright (c) 2014 Andrew Canaday
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *===========================================================================*/
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "yimmo_config.h"
+#include "yimmo.h"
+#include "ymo_log.h"
+#include "core/ymo_tap.h"
+#include "core/ymo_proto.h"
+#include "core/ymo_test_proto.h"
+
+#include "ymo_http_test.h"
+
+#include "ymo_http.h"
+#include "ymo_proto_http.h"
+#include "ymo_http_multipart.h"
+
+#define IO_BUF_SIZE 8192
+#define OUT_MAX     4096
+
+#define CONTENT_TYPE "multipart/form-data; boundary=XyZ-boundary"
+
+static ymo_test_conn_t* test_conn = NULL;
+
+/* Parts, rendered as "[name|filename|type]data(status);": */
+static char out[OUT_MAX];
+static size_t out_len;
+static size_t no_headers;
+static int fail_begin;
+static int use_fd;
+static int cb_err;
+
+/* Server side: */
+static struct {
+    int           called;
+    ymo_status_t  finish;
+} r_info;
+
+
+/*---------------------------------------------------------------*
+ * Callbacks:
+ *---------------------------------------------------------------*/
+static ymo_status_t header_cb(
+        void* data, ymo_http_part_t* part, const char* name, const char* value)
+{
+    ++no_headers;
+    return YMO_OKAY;
+}
+
+
+static ymo_status_t begin_cb(void* data, ymo_http_part_t* part)
+{
+    if( fail_begin ) {
+        return EPERM;
+    }
+
+    if( use_fd ) {
+        FILE* f = tmpfile();
+        if( !f ) {
+            return errno;
+        }
+        part->fd = dup(fileno(f));
+        fclose(f);
+    }
+
+    out_len += snprintf(out + out_len, sizeof(out) - out_len, "[%s|%s|%s]",
+            part->name ? part->name : "-",
+            part->filename ? part->filename : "-",
+            part->content_type ? part->content_type : "-");
+    return YMO_OKAY;
+}
+
+
+static ymo_status_t data_cb(
+        void* data, ymo_http_part_t* part, const char* buf, size_t len)
+{
+    if( out_len + len >= sizeof(out) ) {
+        return ENOBUFS;
+    }
+    memcpy(out + out_len, buf, len);
+    out_len += len;
+    out[out_len] = '\0';
+    return YMO_OKAY;
+}
+
+
+static void end_cb(void* data, ymo_http_part_t* part, ymo_status_t status)
+{
+    if( part->fd >= 0 ) {
+        if( out_len + part->len >= sizeof(out)
+                || pread(part->fd, out + out_len, part->len, 0)
+                != (ssize_t)part->len ) {
+            cb_err = 1;
+        } else {
+            out_len += part->len;
+        }
+        close(part->fd);
+    }
+    out_len += snprintf(out + out_len, sizeof(out) - out_len, "(%i);", status);
+}
+
+
+static const ymo_http_multipart_cb_t mp_cb = {
+    &header_cb, &begin_cb, &data_cb, &end_cb,
+};
+
+
+/*---------------------------------------------------------------*
+ * Helpers:
+ *---------------------------------------------------------------*/
+
+/* Feed body to a new parser in chunk_len pieces: */
+static ymo_status_t parse(const char* body, size_t len, size_t chunk_len)
+{
+    ymo_status_t status = YMO_OKAY;
+    ymo_http_multipart_t* mp = ymo_http_multipart_create(
+            CONTENT_TYPE, &mp_cb, NULL);
+    if( !mp ) {
+        return errno;
+    }
+
+    out[0] = '\0';
+    out_len = 0;
+    no_headers = 0;
+    for( size_t i = 0; i < len && !status; i += chunk_len ) {
+        status = ymo_http_multipart_feed(
+                mp, body + i, YMO_MIN(chunk_len, len - i));
+    }
+    if( !status ) {
+        status = ymo_http_multipart_finish(mp);
+    }
+    ymo_http_multipart_free(mp);
+    return status;
+}
+
+
+/* Parse at every chunk size and compare the output against expected: */
+static int parse_eq(const char* body, const char* expected)
+{
+    size_t len = strlen(body);
+    for( size_t chunk = 1; chunk <= len; chunk++ ) {
+        ymo_status_t status = parse(body, len, chunk);
+        if( status != YMO_OKAY || strcmp(out, expected) ) {
+            printf("# chunk %zu: status %i: \"%s\"\n", chunk, status, out);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+
+/*---------------------------------------------------------------*
+ * Server:
+ *---------------------------------------------------------------*/
+static ymo_status_t http_cb(
+        ymo_http_session_t* session,
+        ymo_http_request_t* request,
+        ymo_http_response_t* response,
+        void* user)
+{
+    r_info.called++;
+    r_info.finish = request->multipart
+        ? ymo_http_multipart_finish(request->multipart) : EINVAL;
+
+    ymo_http_response_set_status(response, YMO_HTTP_OK);
+    ymo_http_response_finish(response);
+    return YMO_OKAY;
+}
+
+
+static ymo_status_t body_cb(
+        ymo_http_session_t* session,
+        ymo_http_request_t* request,
+        ymo_http_response_t* response,
+        const char* data,
+        size_t len,
+        void* user_data)
+{
+    if( !request->multipart ) {
+        ymo_status_t status = ymo_http_request_multipart(
+                request, &mp_cb, NULL);
+        if( status != YMO_OKAY ) {
+            return status;
+        }
+        if( ymo_http_request_multipart(request, &mp_cb, NULL) != EBUSY ) {
+            return EINVAL;
+        }
+    }
+    return ymo_http_multipart_feed(request->multipart, data, len);
+}
+
+
+/*---------------------------------------------------------------*
+ * Tests:
+ *---------------------------------------------------------------*/
+static int test_multipart_parts(void)
+{
+    static const char* body =
+        "This is the preamble.\r\n"
+        "--XyZ-boundary\r\n"
+        "Content-Disposition: form-data; name=\"title\"\r\n"
+        "\r\n"
+        "Hello, world\r\n"
+        "--XyZ-boundary  \r\n"
+        "content-disposition: form-data; name=upload; "
+        "filename=\"a \\\"b\\\".txt\"\r\n"
+        "Content-Type:  text/plain \r\n"
+        "\r\n"
+        "line 1\r\nline 2\r\n\r\n"
+        "--XyZ-boundary\n"
+        "Content-Disposition: form-data; name=\"empty\"\r\n"
+        "\r\n"
+        "\r\n"
+        "--XyZ-boundary--\r\n"
+        "This is the epilogue.\r\n";
+    static const char* expected =
+        "[title|-|-]Hello, world(0);"
+        "[upload|a \"b\".txt|text/plain]line 1\r\nline 2\r\n(0);"
+        "[empty|-|-](0);";
+
+    ymo_assert(parse_eq(body, expected));
+    ymo_assert(no_headers == 4);
+    YMO_TAP_PASS(__func__);
+}
+
+
+/* Data which resembles the delimiter, at every chunk boundary: */
+static int test_multipart_near_misses(void)
+{
+    static const char* body =
+        "--XyZ-boundary\r\n"
+        "Content-Disposition: form-data; name=\"x\"\r\n"
+        "\r\n"
+        "\r\r\n\r\n-\r\n--\r\n--XyZ\r\n--XyZ-boundar\r\r\n--XyZ-boundar"
+        "--XyZ-boundary\r\n"
+        "-boundary\r\n\r\n"
+        "\r\n--XyZ-boundary\r\n\r\n"
+        "\r\n--XyZ-boundary--";
+    static const char* expected =
+        "[x|-|-]"
+        "\r\r\n\r\n-\r\n--\r\n--XyZ\r\n--XyZ-boundar\r\r\n--XyZ-boundar"
+        "--XyZ-boundary\r\n"
+        "-boundary\r\n\r\n(0);"
+        "[-|-|-](0);";
+
+    ymo_assert(parse_eq(body, expected));
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int test_multipart_fd(void)
+{
+    char body[OUT_MAX];
+    char expected[OUT_MAX];
+    size_t len = sprintf(body,
+            "--XyZ-boundary\r\n"
+            "Content-Disposition: form-data; name=f; filename=data.bin\r\n"
+            "\r\n");
+    size_t e_len = sprintf(expected, "[f|data.bin|-]");
+
+    /* Binary data, with a few CRs, NULs, and dashes thrown in: */
+    for( size_t i = 0; i < 1024; i++ ) {
+        char c = (char)((i * 7919) >> 3);
+        body[len++] = expected[e_len++] = c;
+    }
+    len += sprintf(body + len, "\r\n--XyZ-boundary--\r\n");
+    e_len += sprintf(expected + e_len, "(0);");
+
+    use_fd = 1;
+    for( size_t chunk = 1; chunk < len; chunk += 97 ) {
+        ymo_assert(parse(body, len, chunk) == YMO_OKAY);
+        ymo_assert(out_len == e_len && !memcmp(out, expected, e_len));
+    }
+    ymo_assert(!cb_err);
+    use_fd = 0;
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int test_multipart_errors(void)
+{
+    char body[OUT_MAX];
+
+    /* Content types: */
+    errno = 0;
+    ymo_assert(ymo_http_multipart_create(NULL, &mp_cb, NULL) == NULL);
+    ymo_assert(errno == EINVAL);
+    ymo_assert(!ymo_http_multipart_create("text/plain", &mp_cb, NULL));
+    ymo_assert(!ymo_http_multipart_create("multipart/mixed", &mp_cb, NULL));
+    ymo_assert(!ymo_http_multipart_create(
+                "multipart/mixed; boundary=", &mp_cb, NULL));
+    ymo_assert(!ymo_http_multipart_create(
+                "multipart/mixed; boundary=\"abc", &mp_cb, NULL));
+    ymo_http_multipart_t* mp = ymo_http_multipart_create(
+            "Multipart/Mixed; charset=utf-8; BOUNDARY=\"a b\"", &mp_cb, NULL);
+    ymo_assert(mp != NULL);
+    ymo_assert(mp->delim_len == 7 && !memcmp(mp->delim, "\r\n--a b", 7));
+    ymo_http_multipart_free(mp);
+
+    /* Truncated: */
+    strcpy(body, "--XyZ-boundary\r\n\r\npartial");
+    ymo_assert(parse(body, strlen(body), 5) == EBADMSG);
+    ymo_assert(!strcmp(out, "[-|-|-]partial(74);"));
+    ymo_assert(parse("", 0, 1) == EBADMSG);
+
+    /* Garbage after a boundary; no colon in a header: */
+    strcpy(body, "--XyZ-boundary!\r\n\r\n--XyZ-boundary--");
+    ymo_assert(parse(body, strlen(body), 64) == EBADMSG);
+    strcpy(body, "--XyZ-boundary\r\nNope\r\n\r\n--XyZ-boundary--");
+    ymo_assert(parse(body, strlen(body), 64) == EBADMSG);
+
+    /* Headers too large: */
+    size_t len = sprintf(body, "--XyZ-boundary\r\nX-Big: ");
+    memset(body + len, 'x', YMO_HTTP_MULTIPART_HDR_MAX);
+    len += YMO_HTTP_MULTIPART_HDR_MAX;
+    ymo_assert(parse(body, len, 512) == EFBIG);
+
+    /* Callback errors stop the parser, and stick: */
+    strcpy(body, "--XyZ-boundary\r\n\r\ndata\r\n--XyZ-boundary--");
+    fail_begin = 1;
+    mp = ymo_http_multipart_create(CONTENT_TYPE, &mp_cb, NULL);
+    ymo_assert(ymo_http_multipart_feed(mp, body, strlen(body)) == EPERM);
+    ymo_assert(ymo_http_multipart_feed(mp, "x", 1) == EPERM);
+    ymo_assert(ymo_http_multipart_finish(mp) == EPERM);
+    ymo_http_multipart_free(mp);
+    fail_begin = 0;
+
+    /* Freed mid-part: */
+    out_len = 0;
+    mp = ymo_http_multipart_create(CONTENT_TYPE, &mp_cb, NULL);
+    ymo_assert(ymo_http_multipart_feed(mp, body, 20) == YMO_OKAY);
+    ymo_http_multipart_free(mp);
+    ymo_assert(strstr(out, "(103);") != NULL);
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int test_multipart_request(void)
+{
+    char req[1024];
+    const char* body =
+        "--XyZ-boundary\r\n"
+        "Content-Disposition: form-data; name=\"a\"\r\n"
+        "\r\n"
+        "1\r\n"
+        "--XyZ-boundary--\r\n";
+    size_t len = sprintf(req,
+            "POST /upload HTTP/1.1\r\n"
+            "Host: example.com\r\n"
+            "Content-Type: " CONTENT_TYPE "\r\n"
+            "Content-Length: %zu\r\n"
+            "\r\n%s", strlen(body), body);
+
+    out_len = 0;
+    test_conn = http_conn_open();
+    http_conn_send(test_conn, req, len, 13);
+    ymo_assert(r_info.called == 1);
+    ymo_assert(r_info.finish == YMO_OKAY);
+    ymo_assert(!strcmp(out, "[a|-|-]1(0);"));
+
+    /* A second upload, abandoned mid-part; the parser goes with the
+     * connection: */
+    out_len = 0;
+    http_conn_send(test_conn, req, len - 20, len);
+    http_conn_close(test_conn);
+    ymo_assert(r_info.called == 1);
+    if( strcmp(out, "[a|-|-]1(103);") ) {
+        printf("# \"%s\"\n", out);
+        ymo_assert_test_fail("abandoned upload");
+    }
+    YMO_TAP_PASS(__func__);
+}
+
+
+/*---------------------------------------------------------------*
+ * Setup/Cleanup:
+ *---------------------------------------------------------------*/
+static int setup_suite(void)
+{
+    test_server = test_server_create(ymo_proto_http_create(
+                NULL, &http_cb, NULL, &body_cb, NULL, NULL, 0));
+    return 0;
+}
+
+
+static int setup_test(void)
+{
+    memset(&r_info, 0, sizeof(r_info));
+    out[0] = '\0';
+    out_len = 0;
+    return 0;
+}
+
+
+static int cleanup(void)
+{
+    ymo_proto_http_cleanup(test_server->proto, test_server->server);
+    ymo_server_free(test_server->server);
+    YMO_FREE(test_server);
+    return 0;
+}
+
+
+YMO_TAP_RUN(&setup_suite, &setup_test, &cleanup,
+        YMO_TAP_TEST_FN(test_multipart_parts),
+        YMO_TAP_TEST_FN(test_multipart_near_misses),
+        YMO_TAP_TEST_FN(test_multipart_fd),
+        YMO_TAP_TEST_FN(test_multipart_errors),
+        YMO_TAP_TEST_FN(test_multipart_request),
+        YMO_TAP_TEST_END()
+        )
@@ -38,6 +38,157 @@
 #include "ymo_proto_http.h"
 
 
+#define MAX_URI_LEN       128
+#define MAX_REQUEST_SIZE  1024
+#define MAX_RESPONSE_SIZE 1024
+
+
+/*-------------------------------------------------------------*
+ * Responses:
+ *-------------------------------------------------------------*/
+
+static const char* TEST_HTTP_200 =
+    "HTTP/1.1 200 OK\r\n"
+    "content-type: text/plain\r\n"
+    "Content-Length: 2\r\n"
+    "\r\n"
+    "OK";
+
+static const char* TEST_HTTP_400 =
+    "HTTP/1.1 400 Bad Request\r\n"
+    "Connection: Close\r\n"
+    "Content-Length: 0\r\n"
+    "\r\n";
+
+static const char* TEST_HTTP_501 =
+    "HTTP/1.1 501 Not Implemented\r\n"
+    "Connection: Close\r\n"
+    "Content-Length: 0\r\n"
+    "\r\n";
+
+
+/*---------------------------------------------------------------*
+ * Request Info:
+ *---------------------------------------------------------------*/
+/* Sent by http_ok_cb for "/canned", if set: */
+ymo_http_canned_t* test_canned = NULL;
+
+struct {
+    int                   called;
+    char                  uri[MAX_URI_LEN];
+    char                  response_data[MAX_RESPONSE_SIZE+1];
+    ssize_t               bytes_sent;
+    ymo_http_hdr_table_t  headers;
+} r_info;
+
+static ymo_status_t http_ok_cb(
+        ymo_http_session_t* session,
+        ymo_http_request_t* request,
+        ymo_http_response_t* response,
+        void* user)
+{
+    r_info.called = 1;
+    strcpy(r_info.uri, request->uri);
+    if( test_canned && !strcmp(request->uri, "/canned") ) {
+        return ymo_http_response_send_canned(response, test_canned);
+    }
+
+    ymo_http_response_insert_header(response, "content-type", "text/plain");
+    ymo_http_response_set_status_str(response, "200 OK");
+    ymo_bucket_t* content = YMO_BUCKET_FROM_REF("OK", 2);
+
+    ymo_http_response_body_append(response, content);
+    ymo_http_response_finish(response);
+    return YMO_OKAY;
+}
+
+
+/*-------------------------------------------------------------*
+ * Utility:
+ *-------------------------------------------------------------*/
+
+static void init_r_info(void)
+{
+    memset(&r_info, 0, sizeof(r_info));
+    ymo_http_hdr_table_init(&r_info.headers);
+    return;
+}
+
+
+static void reset_r_info(void)
+{
+    ymo_http_hdr_table_clear(&r_info.headers);
+    init_r_info();
+    return;
+}
+
+
+/* Return an HTTP protocol object that has no data and only
+ * registers a HTTP complete callback handler:
+ */
+static ymo_proto_t* get_proto_http(ymo_http_cb_t http_cb)
+{
+    if( http_cb == NULL ) {
+        http_cb = &http_ok_cb;
+    }
+
+    return ymo_proto_http_create(
+            NULL, http_cb, NULL, NULL, NULL, NULL, 0);
+}
+
+
+static ssize_t make_request(const char* r_data)
+{
+    /* Create a client socket/connection: */
+    ymo_test_conn_t* test_conn = http_conn_open();
+    if( !test_conn ) {
+        return -1;
+    }
+    ymo_http_session_t* session = test_conn->conn->proto_data;
+
+    /* We'll test the parser by instantiating a protocol object
+     * and invoking it's read callback, as if we were the
+     * server:
+     */
+    char request_buf[MAX_REQUEST_SIZE];
+    strncpy(request_buf, r_data, MAX_REQUEST_SIZE);
+    size_t r_len = strlen(request_buf);
+    ssize_t r_val = 0;
+
+    /* As the server does, keep parsing until the input is consumed (i.e.
+     * pipelined requests):
+     */
+    do {
+        ssize_t n = ymo_proto_http_read(
+                test_server->proto_data, test_conn->conn,
+                session, request_buf + r_val, r_len - r_val);
+        if( n <= 0 ) {
+            r_val = (n < 0) ? n : r_val;
+            break;
+        }
+        r_val += n;
+    } while( (size_t)r_val < r_len );
+
+
+    /* If all went okay, send the response by faking a write-ready event: */
+    if( r_val >= 0 ) {
+        ymo_proto_http_write(
+                test_server->proto_data,
+                test_conn->conn,
+                session, test_conn->fd_send);
+
+        r_info.bytes_sent = read(
+                test_conn->fd_read, r_info.response_data,
+                sizeof(r_info.response_data));
+    } else {
+        ymo_log_warning("Not writing due to: %s", strerror(r_val));
+    }
+
+    /* Free the test protocol and return: */
+    http_conn_close(test_conn);
+    return r_val;
+}
+
 
 /*-------------------------------------------------------------*
  * Tests:
@@ -115,6 +266,95 @@ static int request_basic_1_1(void)
 }
 
 
+/*============
+ * Pipelining:
+ *------------*/
+static int request_pipelined(void)
+{
+    const char* r_data =
+        "GET /p-1 HTTP/1.1\r\n\r\n"
+        "GET /canned HTTP/1.1\r\n\r\n"
+        "GET /p-3 HTTP/1.1\r\n\r\n";
+    static const char* expected =
+        "HTTP/1.1 200 OK\r\n"
+        "content-type: text/plain\r\n"
+        "Content-Length: 2\r\n"
+        "\r\n"
+        "OK"
+        "HTTP/1.1 200 OK\r\n"
+        "Content-Type: text/plain\r\n"
+        "Content-Length: 6\r\n"
+        "\r\n"
+        "canned"
+        "HTTP/1.1 200 OK\r\n"
+        "content-type: text/plain\r\n"
+        "Content-Length: 2\r\n"
+        "\r\n"
+        "OK";
+
+    ssize_t r_val = make_request(r_data);
+
+    /* All three responses should go out with a single write callback: */
+    ymo_assert(r_val == (ssize_t)strlen(r_data));
+    ymo_assert_str_eq(r_info.uri, "/p-3");
+    ymo_assert(r_info.bytes_sent == (ssize_t)strlen(expected));
+    ymo_assert_str_eq(r_info.response_data, expected);
+    YMO_TAP_PASS(__func__);
+}
+
+
+/*============
+ * Canned:
+ *------------*/
+static int request_canned(void)
+{
+    static const char* expected_1_1 =
+        "HTTP/1.1 200 OK\r\n"
+        "Content-Type: text/plain\r\n"
+        "Content-Length: 6\r\n"
+        "\r\n"
+        "canned";
+
+    static const char* expected_1_1_close =
+        "HTTP/1.1 200 OK\r\n"
+        "Content-Type: text/plain\r\n"
+        "Content-Length: 6\r\n"
+        "Connection: close\r\n"
+        "\r\n"
+        "canned";
+
+    static const char* expected_1_0_keepalive =
+        "HTTP/1.1 200 OK\r\n"
+        "Content-Type: text/plain\r\n"
+        "Content-Length: 6\r\n"
+        "Connection: Keep-alive\r\n"
+        "\r\n"
+        "canned";
+
+    make_request("GET /canned HTTP/1.1\r\n\r\n");
+    ymo_assert(r_info.called == 1);
+    ymo_assert_str_eq(r_info.response_data, expected_1_1);
+
+    reset_r_info();
+    make_request("GET /canned HTTP/1.1\r\nConnection: close\r\n\r\n");
+    ymo_assert_str_eq(r_info.response_data, expected_1_1_close);
+
+    reset_r_info();
+    make_request("GET /canned HTTP/1.0\r\nConnection: keep-alive\r\n\r\n");
+    ymo_assert_str_eq(r_info.response_data, expected_1_0_keepalive);
+
+    /* HEAD: no body, but the same Content-Length: */
+    reset_r_info();
+    make_request("HEAD /canned HTTP/1.1\r\n\r\n");
+    ymo_assert_str_eq(r_info.response_data,
+            "HTTP/1.1 200 OK\r\n"
+            "Content-Type: text/plain\r\n"
+            "Content-Length: 6\r\n"
+            "\r\n");
+    YMO_TAP_PASS(__func__);
+}
+
+
 /*============
  * 4xx:
  *------------*/
@@ -205,6 +445,13 @@ static int test_400_on_bad_header_field(void)
 
 
 #if 0
+static const char* TEST_HTTP_413 =
+    "HTTP/1.1 413 Request Entity Too Large\r\n"
+    "Connection: Close\r\n"
+    "Content-Length: 0\r\n"
+    "\r\n";
+
+
 static int test_400_on_header_field_trailing_space(void)
 {
     const char* r_data =
@@ -275,6 +522,12 @@ static int setup_suite(void)
     test_server = test_server_create(http_proto);
     ymo_assert(test_server != NULL);
 
+    ymo_http_hdr_table_t* hdrs = ymo_http_hdr_table_create();
+    ymo_http_hdr_table_insert(hdrs, "Content-Type", "text/plain");
+    test_canned = ymo_http_canned_create(YMO_HTTP_OK, hdrs, "canned", 6);
+    ymo_http_hdr_table_free(hdrs);
+    ymo_assert(test_canned != NULL);
+
     init_r_info();
     return 0;
 }
@@ -291,9 +544,10 @@ static int setup_test(void)
 
 static int cleanup(void)
 {
-    ymo_proto_http_cleanup(test_server->proto_data, test_server->server);
+    ymo_proto_http_cleanup(test_server->proto, test_server->server);
     ymo_server_free(test_server->server);
     YMO_FREE(test_server);
+    ymo_http_canned_free(test_canned);
     return 0;
 }
 
@@ -301,6 +555,8 @@ static int cleanup(void)
 YMO_TAP_RUN(&setup_suite, &setup_test, &cleanup,
         YMO_TAP_TEST_FN(request_basic_1_0),
         YMO_TAP_TEST_FN(request_basic_1_1),
+        YMO_TAP_TEST_FN(request_canned),
+        YMO_TAP_TEST_FN(request_pipelined),
         YMO_TAP_TEST_FN(expect_100_continue),
         YMO_TAP_TEST_FN(eagain_on_incomplete_request),
         YMO_TAP_TEST_FN(test_400_on_bad_method),
@@ -0,0 +1,376 @@
+/*=============================================================================
+ * test/test_http_pool: Tests for exchange/response recycling.
+ *
+ * Copyright (c) 2014 Andrew Canaday
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *===========================================================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "yimmo_config.h"
+#include "yimmo.h"
+#include "ymo_log.h"
+#include "core/ymo_tap.h"
+#include "core/ymo_proto.h"
+#include "core/ymo_test_proto.h"
+
+#include "ymo_http_test.h"
+
+#include "ymo_http.h"
+#include "ymo_proto_http.h"
+#include "ymo_http_exchange.h"
+#include "ymo_http_session.h"
+
+#define IO_BUF_SIZE  16384
+#define NO_REQUESTS  100
+#define NO_PIPELINED (YMO_HTTP_EXCHANGE_POOL_MAX + 8)
+
+static const char* req_get =
+    "GET /index.html HTTP/1.1\r\n"
+    "Host: example.com\r\n"
+    "User-Agent: test_http_pool\r\n"
+    "Accept: */*\r\n"
+    "\r\n";
+
+static const char* req_close =
+    "GET /index.html HTTP/1.1\r\n"
+    "Host: example.com\r\n"
+    "Connection: close\r\n"
+    "\r\n";
+
+
+/*---------------------------------------------------------------*
+ * Allocation counting:
+ *
+ * With glibc, the allocator can be replaced by defining malloc & co in
+ * the executable; these count calls and hand off to the real thing.
+ *---------------------------------------------------------------*/
+#if defined(__GLIBC__)
+#define HAVE_ALLOC_COUNT 1
+
+extern void* __libc_malloc(size_t n);
+extern void* __libc_calloc(size_t c, size_t n);
+extern void* __libc_realloc(void* p, size_t n);
+extern void __libc_free(void* p);
+
+static size_t no_allocs = 0;
+
+void* malloc(size_t n)
+{
+    ++no_allocs;
+    return __libc_malloc(n);
+}
+
+
+void* calloc(size_t c, size_t n)
+{
+    ++no_allocs;
+    return __libc_calloc(c, n);
+}
+
+
+void* realloc(void* p, size_t n)
+{
+    ++no_allocs;
+    return __libc_realloc(p, n);
+}
+
+
+void free(void* p)
+{
+    __libc_free(p);
+}
+#else
+#define HAVE_ALLOC_COUNT 0
+static size_t no_allocs = 0;
+#endif /* __GLIBC__ */
+
+static ymo_test_conn_t* test_conn = NULL;
+
+static char in[IO_BUF_SIZE];
+static size_t in_len;
+
+/* Server side (the exchange that handled each request): */
+static struct {
+    int                   called;
+    ymo_http_exchange_t*  exchange[NO_PIPELINED];
+} r_info;
+
+
+/*---------------------------------------------------------------*
+ * Handler:
+ *---------------------------------------------------------------*/
+static ymo_status_t http_cb(
+        ymo_http_session_t* session,
+        ymo_http_request_t* request,
+        ymo_http_response_t* response,
+        void* user)
+{
+    if( r_info.called < NO_PIPELINED ) {
+        r_info.exchange[r_info.called] = session->exchange;
+    }
+    r_info.called++;
+    ymo_http_response_insert_header(response, "Content-Type", "text/plain");
+    ymo_http_response_set_status(response, YMO_HTTP_OK);
+    ymo_http_response_body_append(response, YMO_BUCKET_FROM_REF("OK", 2));
+    ymo_http_response_finish(response);
+    return YMO_OKAY;
+}
+
+
+/*---------------------------------------------------------------*
+ * Utilities:
+ *---------------------------------------------------------------*/
+static int round_trip(const char* req)
+{
+    r_info.called = 0;
+    http_conn_send(test_conn, req, strlen(req), 0);
+    in_len = http_conn_recv(test_conn, in, sizeof(in));
+    return r_info.called == 1 && !strncmp(in, "HTTP/1.1 200 OK\r\n", 17);
+}
+
+
+static int count_responses(void)
+{
+    int count = 0;
+    for( const char* p = in; (p = strstr(p, "HTTP/1.1 200 OK\r\n")); p++ ) {
+        count++;
+    }
+    return count;
+}
+
+
+static ymo_http_exchange_pool_t* get_pool(void)
+{
+    ymo_http_proto_data_t* http_data = test_server->proto_data;
+    return &http_data->exchange_pool;
+}
+
+
+static int in_pool(const ymo_http_exchange_t* exchange)
+{
+    const ymo_http_exchange_t* idle = get_pool()->idle;
+    for( ; idle; idle = idle->next ) {
+        if( idle == exchange ) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+/*---------------------------------------------------------------*
+ * Tests:
+ *---------------------------------------------------------------*/
+static int test_keepalive_no_alloc(void)
+{
+    test_conn = http_conn_open();
+
+    /* Warm up: */
+    for( int i = 0; i < 3; i++ ) {
+        ymo_assert(round_trip(req_get));
+    }
+
+    size_t allocs_before = no_allocs;
+    for( int i = 0; i < NO_REQUESTS; i++ ) {
+        ymo_assert(round_trip(req_get));
+    }
+    size_t allocs = no_allocs - allocs_before;
+
+    /* Handled by the same (recycled) exchange each time: */
+    ymo_http_exchange_t* exchange = r_info.exchange[0];
+    ymo_assert(round_trip(req_get));
+    ymo_assert(r_info.exchange[0] == exchange);
+    ymo_assert(in_pool(exchange));
+    http_conn_close(test_conn);
+
+    printf("# %zu allocations for %i keep-alive requests\n",
+            allocs, NO_REQUESTS);
+    if( HAVE_ALLOC_COUNT ) {
+        ymo_assert(allocs == 0);
+    }
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int test_pipelined(void)
+{
+    static char req[NO_PIPELINED * 128];
+    size_t req_len = 0;
+    for( int i = 0; i < 8; i++ ) {
+        req_len += sprintf(req + req_len, "%s", req_get);
+    }
+
+    /* Each request queued behind the others keeps its own exchange: */
+    test_conn = http_conn_open();
+    http_conn_send(test_conn, req, req_len, 0);
+    ymo_assert(r_info.called == 8);
+    for( int i = 1; i < 8; i++ ) {
+        ymo_assert(r_info.exchange[i] != r_info.exchange[i-1]);
+        ymo_assert(!in_pool(r_info.exchange[i]));
+    }
+
+    /* ...until its response has gone out: */
+    in_len = http_conn_recv(test_conn, in, sizeof(in));
+    ymo_assert(count_responses() == 8);
+    for( int i = 0; i < 8; i++ ) {
+        ymo_assert(in_pool(r_info.exchange[i]));
+    }
+
+    /* Once warm, that's allocation-free, too: */
+    memset(&r_info, 0, sizeof(r_info));
+    size_t allocs_before = no_allocs;
+    http_conn_send(test_conn, req, req_len, 0);
+    in_len = http_conn_recv(test_conn, in, sizeof(in));
+    size_t allocs = no_allocs - allocs_before;
+    ymo_assert(r_info.called == 8);
+    ymo_assert(count_responses() == 8);
+    http_conn_close(test_conn);
+
+    printf("# %zu allocations for 8 pipelined requests\n", allocs);
+    if( HAVE_ALLOC_COUNT ) {
+        ymo_assert(allocs == 0);
+    }
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int test_pool_max(void)
+{
+    static char req[NO_PIPELINED * 128];
+    size_t req_len = 0;
+    for( int i = 0; i < NO_PIPELINED; i++ ) {
+        req_len += sprintf(req + req_len, "%s", req_get);
+    }
+
+    /* More in flight than the pool holds: */
+    test_conn = http_conn_open();
+    http_conn_send(test_conn, req, req_len, 0);
+    in_len = http_conn_recv(test_conn, in, sizeof(in));
+    ymo_assert(r_info.called == NO_PIPELINED);
+    ymo_assert(count_responses() == NO_PIPELINED);
+    ymo_assert(get_pool()->len == YMO_HTTP_EXCHANGE_POOL_MAX);
+    http_conn_close(test_conn);
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int test_across_conns(void)
+{
+    /* An exchange freed by one connection is picked up by the next: */
+    test_conn = http_conn_open();
+    ymo_assert(round_trip(req_get));
+    ymo_http_exchange_t* exchange = r_info.exchange[0];
+    http_conn_close(test_conn);
+    ymo_assert(get_pool()->idle == exchange);
+
+    test_conn = http_conn_open();
+    ymo_assert(round_trip(req_get));
+    ymo_assert(r_info.exchange[0] == exchange);
+    http_conn_close(test_conn);
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int test_idle(void)
+{
+    ymo_http_session_t* session;
+    size_t half = strlen(req_get) / 2;
+
+    /* Idle connections don't hold on to an exchange: */
+    test_conn = http_conn_open();
+    session = test_conn->conn->proto_data;
+    ymo_assert(session->exchange == NULL);
+    ymo_assert(round_trip(req_get));
+    ymo_assert(session->exchange == NULL);
+
+    /* ...but pick one up on the first byte of the next request: */
+    r_info.called = 0;
+    http_conn_send(test_conn, req_get, half, 0);
+    ymo_assert(session->exchange != NULL);
+    ymo_assert(!in_pool(session->exchange));
+    ymo_assert(r_info.called == 0);
+
+    /* ...and hand it back once the response is out: */
+    http_conn_send(test_conn, req_get + half, strlen(req_get) - half, 0);
+    ymo_assert(r_info.called == 1);
+    ymo_assert(session->exchange == NULL);
+    in_len = http_conn_recv(test_conn, in, sizeof(in));
+    ymo_assert(count_responses() == 1);
+    ymo_assert(in_pool(r_info.exchange[0]));
+    http_conn_close(test_conn);
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int test_close(void)
+{
+    char req[256];
+    size_t req_len = sprintf(req, "%s%s", req_close, req_get);
+
+    /* Nothing after "Connection: close" is handled: */
+    test_conn = http_conn_open();
+    http_conn_send(test_conn, req, req_len, 0);
+    ymo_assert(r_info.called == 1);
+    in_len = http_conn_recv(test_conn, in, sizeof(in));
+    ymo_assert(count_responses() == 1);
+    ymo_assert(in_pool(r_info.exchange[0]));
+    http_conn_close(test_conn);
+    YMO_TAP_PASS(__func__);
+}
+
+
+/*---------------------------------------------------------------*
+ * Setup/Cleanup:
+ *---------------------------------------------------------------*/
+static int setup_suite(void)
+{
+    ymo_proto_t* proto = ymo_proto_http_create(
+            NULL, &http_cb, NULL, NULL, NULL, NULL, 0);
+    test_server = test_server_create(proto);
+    return 0;
+}
+
+
+static int setup_test(void)
+{
+    memset(&r_info, 0, sizeof(r_info));
+    in_len = 0;
+    return 0;
+}
+
+
+static int cleanup(void)
+{
+    ymo_proto_http_cleanup(test_server->proto, test_server->server);
+    ymo_server_free(test_server->server);
+    YMO_FREE(test_server);
+    return 0;
+}
+
+
+YMO_TAP_RUN(&setup_suite, &setup_test, &cleanup,
+        YMO_TAP_TEST_FN(test_keepalive_no_alloc),
+        YMO_TAP_TEST_FN(test_pipelined),
+        YMO_TAP_TEST_FN(test_pool_max),
+        YMO_TAP_TEST_FN(test_across_conns),
+        YMO_TAP_TEST_FN(test_idle),
+        YMO_TAP_TEST_FN(test_close),
+        YMO_TAP_TEST_END()
+        )
@@ -0,0 +1,768 @@
+/*=============================================================================
+ * test/test_http_proxy: Tests for the reverse proxy.
+ *
+ * Copyright (c) 2014 Andrew Canaday
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *===========================================================================*/
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "yimmo_config.h"
+#include "yimmo.h"
+#include "ymo_log.h"
+#include "core/ymo_tap.h"
+#include "core/ymo_proto.h"
+#include "core/ymo_test_proto.h"
+
+#include "ymo_http_test.h"
+
+#include "ymo_http.h"
+#include "ymo_proto_http.h"
+#include "ymo_http_response.h"
+#include "ymo_http_proxy.h"
+
+#define NO_CONNS 2
+#define NO_RESPONSES 8
+#define NO_UPSTREAMS 2
+#define RECV_BUF_SIZE (512 * 1024)
+#define PUMP_MAX 100
+
+static const char* req_get =
+    "GET /a/b?x=1 HTTP/1.1\r\n"
+    "Host: example.com\r\n"
+    "Connection: keep-alive, X-Hop\r\n"
+    "Keep-Alive: timeout=5\r\n"
+    "TE: trailers\r\n"
+    "X-Hop: drop me\r\n"
+    "X-Custom: keep me\r\n"
+    "X-Forwarded-For: 10.0.0.1\r\n"
+    "\r\n";
+
+static const char* req_plain =
+    "GET /plain HTTP/1.1\r\n"
+    "Host: example.com\r\n"
+    "\r\n";
+
+static const char* req_post =
+    "POST /form HTTP/1.1\r\n"
+    "Host: example.com\r\n"
+    "Content-Length: 7\r\n"
+    "Expect: 100-continue\r\n"
+    "\r\n"
+    "a=1&b=2";
+
+static const char* req_chunked =
+    "PUT /put HTTP/1.1\r\n"
+    "Host: example.com\r\n"
+    "Transfer-Encoding: chunked\r\n"
+    "\r\n"
+    "3\r\nabc\r\n"
+    "2\r\nde\r\n"
+    "0\r\n\r\n";
+
+static const char* rsp_hello =
+    "HTTP/1.1 200 OK\r\n"
+    "Content-Length: 5\r\n"
+    "Connection: keep-alive\r\n"
+    "Keep-Alive: timeout=5\r\n"
+    "X-Up:  yes \r\n"
+    "\r\n"
+    "hello";
+
+static ymo_test_conn_t* conns[NO_CONNS];
+static ymo_http_response_t* responses[NO_RESPONSES];
+static size_t no_responses;
+static char recv_buf[RECV_BUF_SIZE];
+static size_t recv_len;
+
+static ymo_http_proxy_t* proxy = NULL;
+static int listen_fds[NO_UPSTREAMS] = { -1, -1 };
+static int ports[NO_UPSTREAMS];
+
+
+/*---------------------------------------------------------------*
+ * Handler:
+ *---------------------------------------------------------------*/
+static ymo_status_t http_cb(
+        ymo_http_session_t* session,
+        ymo_http_request_t* request,
+        ymo_http_response_t* response,
+        void* user)
+{
+    responses[no_responses++] = response;
+    ymo_http_response_set_watermarks(response, 16 * 1024, 4 * 1024);
+    return ymo_http_proxy_serve(proxy, request, response);
+}
+
+
+/*---------------------------------------------------------------*
+ * Utilities:
+ *---------------------------------------------------------------*/
+
+/* The tests write to clients themselves: */
+static void client_write_cb(struct ev_loop* loop, ev_io* w, int revents)
+{
+    ev_io_stop(loop, w);
+}
+
+
+static struct ev_loop* test_loop(void)
+{
+    return test_server->server->config.loop;
+}
+
+
+/* Run the loop until nothing else is ready: */
+static void pump(void)
+{
+    for( size_t i = 0; i < PUMP_MAX; i++ ) {
+        ev_run(test_loop(), EVRUN_NOWAIT);
+    }
+}
+
+
+static ymo_test_conn_t* open_conn(const char* request)
+{
+    ymo_test_conn_t* test_conn = http_conn_open();
+    ev_set_cb(&test_conn->conn->w_write, &client_write_cb);
+    http_conn_send(test_conn, request, strlen(request), 0);
+    return test_conn;
+}
+
+
+/* Flush the connection and return what it sent (recv_len bytes): */
+static const char* client_recv(ymo_test_conn_t* test_conn)
+{
+    recv_len = http_conn_recv(test_conn, recv_buf, sizeof(recv_buf));
+    return recv_buf;
+}
+
+
+static int listen_port(int* port)
+{
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    int flag = 1;
+
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag));
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if( bind(fd, (struct sockaddr*)&addr, sizeof(addr))
+        || listen(fd, 16)
+        || getsockname(fd, (struct sockaddr*)&addr, &addr_len) ) {
+        close(fd);
+        return -1;
+    }
+    *port = ntohs(addr.sin_port);
+    return fd;
+}
+
+
+/* Accept the proxy's next upstream connection: */
+static int upstream_accept(size_t upstream)
+{
+    pump();
+    int fd = accept(listen_fds[upstream], NULL, NULL);
+    if( fd >= 0 ) {
+        ymo_sock_nonblocking(fd);
+    }
+    return fd;
+}
+
+
+/* Whatever the proxy has sent upstream, so far: */
+static const char* upstream_recv(int fd)
+{
+    ssize_t n;
+    pump();
+    recv_len = 0;
+    while( recv_len < RECV_BUF_SIZE - 1
+            && (n = read(fd, recv_buf + recv_len,
+                    RECV_BUF_SIZE - 1 - recv_len)) > 0 ) {
+        recv_len += n;
+    }
+    recv_buf[recv_len] = '\0';
+    return recv_buf;
+}
+
+
+static void upstream_send(int fd, const char* data)
+{
+    ssize_t n = write(fd, data, strlen(data));
+    (void)n;
+    pump();
+}
+
+
+static ymo_http_proxy_stats_t stats_of(size_t upstream)
+{
+    ymo_http_proxy_stats_t stats;
+    memset(&stats, 0, sizeof(stats));
+    ymo_http_proxy_stats(proxy, upstream, &stats);
+    return stats;
+}
+
+
+/*---------------------------------------------------------------*
+ * Tests:
+ *---------------------------------------------------------------*/
+static int test_forward(void)
+{
+    conns[0] = open_conn(req_get);
+    ymo_assert(no_responses == 1);
+    ymo_assert(responses[0]->proxy_conn != NULL);
+
+    int fd = upstream_accept(0);
+    ymo_assert(fd >= 0);
+
+    /* Hop-by-hop fields (including those named by Connection) are dropped;
+     * the client address isn't IP, so X-Forwarded-For is passed as-is:
+     */
+    const char* out = upstream_recv(fd);
+    ymo_assert(!strncmp(out, "GET /a/b?x=1 HTTP/1.1\r\n", 23));
+    ymo_assert(strstr(out, "\r\nHost: example.com\r\n") != NULL);
+    ymo_assert(strstr(out, "\r\nX-Custom: keep me\r\n") != NULL);
+    ymo_assert(strstr(out, "\r\nX-Forwarded-For: 10.0.0.1\r\n") != NULL);
+    ymo_assert(strstr(out, "Connection") == NULL);
+    ymo_assert(strstr(out, "Keep-Alive") == NULL);
+    ymo_assert(strstr(out, "TE:") == NULL);
+    ymo_assert(strstr(out, "X-Hop") == NULL);
+    ymo_assert(strstr(out, "Content-Length") == NULL);
+    ymo_assert(!strcmp(out + recv_len - 4, "\r\n\r\n"));
+
+    upstream_send(fd, rsp_hello);
+    ymo_assert(responses[0]->proxy_conn == NULL);
+    out = client_recv(conns[0]);
+    ymo_assert(!strncmp(out, "HTTP/1.1 200 OK\r\n", 17));
+    ymo_assert(strstr(out, "\r\nX-Up: yes\r\n") != NULL);
+    ymo_assert(strstr(out, "\r\nContent-Length: 5\r\n") != NULL);
+    ymo_assert(strstr(out, "Keep-Alive") == NULL);
+    ymo_assert(!strcmp(out + recv_len - 9, "\r\n\r\nhello"));
+
+    /* The connection went back to the pool: */
+    ymo_http_proxy_stats_t stats = stats_of(0);
+    ymo_assert(stats.requests == 1);
+    ymo_assert(stats.connects == 1);
+    ymo_assert(stats.outstanding == 0);
+    ymo_assert(stats.idle == 1);
+
+    http_conn_close(conns[0]);
+    close(fd);
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int test_reuse(void)
+{
+    conns[0] = open_conn(req_plain);
+    int fd = upstream_accept(0);
+    ymo_assert(fd >= 0);
+    upstream_recv(fd);
+    upstream_send(fd, rsp_hello);
+    client_recv(conns[0]);
+    http_conn_close(conns[0]);
+
+    /* The next request goes out on the same upstream connection: */
+    conns[0] = open_conn(req_plain);
+    const char* out = upstream_recv(fd);
+    ymo_assert(!strncmp(out, "GET /plain HTTP/1.1\r\n", 21));
+    upstream_send(fd, rsp_hello);
+    out = client_recv(conns[0]);
+    ymo_assert(!strcmp(out + recv_len - 5, "hello"));
+
+    ymo_http_proxy_stats_t stats = stats_of(0);
+    ymo_assert(stats.requests == 2);
+    ymo_assert(stats.connects == 1);
+    ymo_assert(stats.reused == 1);
+    ymo_assert(stats.idle == 1);
+
+    /* Upstreams closing idle connections empty the pool: */
+    close(fd);
+    pump();
+    ymo_assert(stats_of(0).idle == 0);
+
+    http_conn_close(conns[0]);
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int test_chunked(void)
+{
+    conns[0] = open_conn(req_plain);
+    int fd = upstream_accept(0);
+    ymo_assert(fd >= 0);
+    upstream_recv(fd);
+
+    /* Chunks split across reads (the head goes out first): */
+    upstream_send(fd,
+            "HTTP/1.1 200 OK\r\n"
+            "Transfer-Encoding: chunked\r\n"
+            "Trailer: X-Sum\r\n"
+            "\r\n"
+            "5\r\nhel");
+    const char* out = client_recv(conns[0]);
+    ymo_assert(!strncmp(out, "HTTP/1.1 200 OK\r\n", 17));
+    ymo_assert(strstr(out, "Trailer") == NULL);
+    ymo_assert(strstr(out, "\r\nTransfer-Encoding: Chunked\r\n") != NULL);
+    ymo_assert(strstr(out, "hel") != NULL);
+    ymo_assert(!ymo_http_response_finished(responses[0]));
+
+    upstream_send(fd, "lo\r\n6;ext=1\r\n world\r\n0\r");
+    out = client_recv(conns[0]);
+    ymo_assert(strstr(out, "lo") != NULL);
+    ymo_assert(strstr(out, " world") != NULL);
+    ymo_assert(!ymo_http_response_finished(responses[0]));
+
+    upstream_send(fd, "\nX-Sum: 11\r\n\r\n");
+    out = client_recv(conns[0]);
+    ymo_assert(!strcmp(out, "0\r\n\r\n"));
+    ymo_assert(stats_of(0).idle == 1);
+
+    http_conn_close(conns[0]);
+    close(fd);
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int test_request_body(void)
+{
+    conns[0] = open_conn(req_post);
+    int fd = upstream_accept(0);
+    ymo_assert(fd >= 0);
+
+    /* Expect is handled here; the body goes as received: */
+    const char* out = upstream_recv(fd);
+    ymo_assert(!strncmp(out, "POST /form HTTP/1.1\r\n", 21));
+    ymo_assert(strstr(out, "Expect") == NULL);
+    ymo_assert(strstr(out, "\r\nContent-Length: 7\r\n") != NULL);
+    ymo_assert(!strcmp(out + recv_len - 11, "\r\n\r\na=1&b=2"));
+    upstream_send(fd, rsp_hello);
+    client_recv(conns[0]);
+    http_conn_close(conns[0]);
+
+    /* Chunked request bodies are sent de-chunked: */
+    conns[0] = open_conn(req_chunked);
+    out = upstream_recv(fd);
+    ymo_assert(!strncmp(out, "PUT /put HTTP/1.1\r\n", 19));
+    ymo_assert(strstr(out, "Transfer-Encoding") == NULL);
+    ymo_assert(strstr(out, "\r\nContent-Length: 5\r\n") != NULL);
+    ymo_assert(!strcmp(out + recv_len - 9, "\r\n\r\nabcde"));
+    upstream_send(fd, rsp_hello);
+    out = client_recv(conns[0]);
+    ymo_assert(!strncmp(out, "HTTP/1.1 200 OK\r\n", 17));
+    ymo_assert(stats_of(0).reused == 1);
+
+    http_conn_close(conns[0]);
+    close(fd);
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int test_balance(void)
+{
+    ymo_assert(ymo_http_proxy_add_upstream(
+                proxy, "127.0.0.1", ports[1], 4) == YMO_OKAY);
+
+    /* One request in flight on each upstream: */
+    conns[0] = open_conn(req_plain);
+    conns[1] = open_conn(req_plain);
+    ymo_assert(stats_of(0).outstanding == 1);
+    ymo_assert(stats_of(1).outstanding == 1);
+
+    int fd0 = upstream_accept(0);
+    int fd1 = upstream_accept(1);
+    ymo_assert(fd0 >= 0 && fd1 >= 0);
+    upstream_recv(fd0);
+    upstream_recv(fd1);
+
+    /* The least busy upstream gets the next one: */
+    upstream_send(fd1, rsp_hello);
+    client_recv(conns[1]);
+    http_conn_close(conns[1]);
+    conns[1] = open_conn(req_plain);
+    ymo_assert(stats_of(0).requests == 1);
+    ymo_assert(stats_of(1).requests == 2);
+    ymo_assert(stats_of(1).reused == 1);
+
+    ymo_assert(!strncmp(upstream_recv(fd1), "GET /plain ", 11));
+    upstream_send(fd0, rsp_hello);
+    upstream_send(fd1, rsp_hello);
+    ymo_assert(strstr(client_recv(conns[0]), "hello") != NULL);
+    ymo_assert(strstr(client_recv(conns[1]), "hello") != NULL);
+
+    http_conn_close(conns[0]);
+    http_conn_close(conns[1]);
+    close(fd0);
+    close(fd1);
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int test_retry(void)
+{
+    conns[0] = open_conn(req_plain);
+    int fd = upstream_accept(0);
+    ymo_assert(fd >= 0);
+    upstream_recv(fd);
+    upstream_send(fd, rsp_hello);
+    client_recv(conns[0]);
+    http_conn_close(conns[0]);
+    ymo_assert(stats_of(0).idle == 1);
+
+    /* The upstream closes the pooled connection just as it's reused: */
+    close(fd);
+    conns[0] = open_conn(req_plain);
+    fd = upstream_accept(0);
+    ymo_assert(fd >= 0);
+    ymo_assert(!strncmp(upstream_recv(fd), "GET /plain ", 11));
+    upstream_send(fd, rsp_hello);
+    const char* out = client_recv(conns[0]);
+    ymo_assert(!strncmp(out, "HTTP/1.1 200 OK\r\n", 17));
+
+    ymo_http_proxy_stats_t stats = stats_of(0);
+    ymo_assert(stats.retries == 1);
+    ymo_assert(stats.connects == 2);
+    ymo_assert(stats.errors == 0);
+
+    http_conn_close(conns[0]);
+    close(fd);
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int test_bad_gateway(void)
+{
+    /* Nobody listening: */
+    int port;
+    int fd = listen_port(&port);
+    ymo_assert(fd >= 0);
+    close(fd);
+
+    ymo_http_proxy_free(proxy);
+    proxy = ymo_http_proxy_create(test_loop());
+    ymo_assert(ymo_http_proxy_add_upstream(
+                proxy, "127.0.0.1", port, 4) == YMO_OKAY);
+
+    conns[0] = open_conn(req_plain);
+    pump();
+    const char* out = client_recv(conns[0]);
+    ymo_assert(!strncmp(out, "HTTP/1.1 502 Bad Gateway\r\n", 26));
+    ymo_assert(stats_of(0).errors == 1);
+    ymo_assert(stats_of(0).outstanding == 0);
+    http_conn_close(conns[0]);
+
+    /* Malformed upstream responses are, too: */
+    ymo_http_proxy_free(proxy);
+    proxy = ymo_http_proxy_create(test_loop());
+    ymo_assert(ymo_http_proxy_add_upstream(
+                proxy, "127.0.0.1", ports[0], 4) == YMO_OKAY);
+    conns[0] = open_conn(req_plain);
+    fd = upstream_accept(0);
+    ymo_assert(fd >= 0);
+    upstream_recv(fd);
+    upstream_send(fd, "HTTP/1.1 200 OK\r\n folded: no\r\n\r\n");
+    out = client_recv(conns[0]);
+    ymo_assert(!strncmp(out, "HTTP/1.1 502 Bad Gateway\r\n", 26));
+    http_conn_close(conns[0]);
+    close(fd);
+
+    ymo_assert(ymo_http_proxy_add_upstream(
+                proxy, "no such host.invalid", 80, 4) == EINVAL);
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int test_timeout(void)
+{
+    ymo_http_proxy_set_timeout(proxy, 0.05);
+    conns[0] = open_conn(req_plain);
+    int fd = upstream_accept(0);
+    ymo_assert(fd >= 0);
+    upstream_recv(fd);
+
+    /* The upstream never answers: */
+    for( size_t i = 0; i < PUMP_MAX && responses[0]->proxy_conn; i++ ) {
+        ev_run(test_loop(), EVRUN_ONCE);
+    }
+    const char* out = client_recv(conns[0]);
+    ymo_assert(!strncmp(out, "HTTP/1.1 504 Gateway Timeout\r\n", 30));
+    ymo_assert(stats_of(0).errors == 1);
+    ymo_assert(stats_of(0).idle == 0);
+
+    http_conn_close(conns[0]);
+    close(fd);
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int test_truncated(void)
+{
+    conns[0] = open_conn(req_plain);
+    int fd = upstream_accept(0);
+    ymo_assert(fd >= 0);
+    upstream_recv(fd);
+
+    /* Before anything has gone to the client, it's a clean 502: */
+    upstream_send(fd, "HTTP/1.1 200 OK\r\nContent-Length: 10\r\n\r\nhel");
+    close(fd);
+    pump();
+    ymo_assert(ymo_http_response_finished(responses[0]));
+    ymo_assert(stats_of(0).errors == 1);
+    const char* out = client_recv(conns[0]);
+    ymo_assert(!strncmp(out, "HTTP/1.1 502 Bad Gateway\r\n", 26));
+    ymo_assert(strstr(out, "hel") == NULL);
+    http_conn_close(conns[0]);
+
+    /* After, the client sees the connection close before the body is done: */
+    conns[0] = open_conn(req_plain);
+    fd = upstream_accept(0);
+    ymo_assert(fd >= 0);
+    upstream_recv(fd);
+    upstream_send(fd, "HTTP/1.1 200 OK\r\nContent-Length: 10\r\n\r\nhel");
+    out = client_recv(conns[0]);
+    ymo_assert(!strncmp(out, "HTTP/1.1 200 OK\r\n", 17));
+    ymo_assert(!strcmp(out + recv_len - 3, "hel"));
+
+    close(fd);
+    pump();
+    ymo_assert(ymo_http_response_finished(responses[1]));
+    ymo_assert(stats_of(0).errors == 2);
+    out = client_recv(conns[0]);
+    ymo_assert(recv_len == 0);
+
+    char buf[16];
+    ymo_assert(read(conns[0]->fd_read, buf, sizeof(buf)) == 0);
+    http_conn_close(conns[0]);
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int test_backpressure(void)
+{
+    static char body[128 * 1024];
+    memset(body, 'x', sizeof(body));
+
+    /* (Bodies are read and copied, here; see test_splice.) */
+    ymo_http_proxy_set_splice(proxy, 0);
+
+    conns[0] = open_conn(req_plain);
+    int fd = upstream_accept(0);
+    ymo_assert(fd >= 0);
+    upstream_recv(fd);
+
+    /* Keep the socket buffers (between the upstream and proxy) small: */
+    int buf_size = 16 * 1024;
+    setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &buf_size, sizeof(buf_size));
+    setsockopt(responses[0]->proxy_conn->fd, SOL_SOCKET, SO_RCVBUF,
+            &buf_size, sizeof(buf_size));
+
+    char head[128];
+    snprintf(head, sizeof(head),
+            "HTTP/1.1 200 OK\r\nContent-Length: %zu\r\n\r\n", sizeof(body));
+    upstream_send(fd, head);
+
+    /* The client doesn't read, so the proxy stops reading, too: */
+    size_t sent = 0;
+    ssize_t n;
+    while( (n = write(fd, body + sent, sizeof(body) - sent)) > 0 ) {
+        sent += n;
+        pump();
+    }
+    ymo_assert(responses[0]->proxy_conn != NULL);
+    ymo_assert(responses[0]->proxy_conn->paused);
+    ymo_assert(sent < sizeof(body));
+    ymo_assert(ymo_http_response_queued(responses[0]) >= 16 * 1024);
+
+    /* Reading resumes as the client drains: */
+    size_t total = 0;
+    for( size_t i = 0; i < PUMP_MAX * 10 && responses[0]->proxy_conn; i++ ) {
+        client_recv(conns[0]);
+        total += recv_len;
+        pump();
+        if( sent < sizeof(body)
+            && (n = write(fd, body + sent, sizeof(body) - sent)) > 0 ) {
+            sent += n;
+        }
+    }
+    client_recv(conns[0]);
+    total += recv_len;
+    ymo_assert(sent == sizeof(body));
+    ymo_assert(total == strlen(head) + sizeof(body));
+    ymo_assert(stats_of(0).idle == 1);
+
+    http_conn_close(conns[0]);
+    close(fd);
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int test_splice(void)
+{
+    static char body[256 * 1024];
+    static char out[RECV_BUF_SIZE];
+    size_t out_len = 0;
+    for( size_t i = 0; i < sizeof(body); i++ ) {
+        body[i] = 'a' + (i % 26);
+    }
+
+    conns[0] = open_conn(req_plain);
+    int fd = upstream_accept(0);
+    ymo_assert(fd >= 0);
+    upstream_recv(fd);
+
+    /* Let the pipe fill up before the client falls behind: */
+    ymo_http_response_set_watermarks(responses[0], 1024 * 1024, 512 * 1024);
+
+    /* Body data read along with the head is copied; the rest is spliced: */
+    char head[128];
+    int head_len = snprintf(head, sizeof(head),
+            "HTTP/1.1 200 OK\r\nContent-Length: %zu\r\n\r\n", sizeof(body));
+    size_t sent = 1024;
+    ymo_assert(write(fd, head, head_len) == head_len);
+    ymo_assert(write(fd, body, sent) == (ssize_t)sent);
+    pump();
+
+    /* The client doesn't read, so the pipe fills up: */
+    ssize_t n;
+    for( size_t i = 0; i < PUMP_MAX && !responses[0]->proxy_conn->pipe_wait;
+            i++ ) {
+        if( (n = write(fd, body + sent, sizeof(body) - sent)) > 0 ) {
+            sent += n;
+        }
+        pump();
+    }
+    ymo_assert(responses[0]->proxy_conn != NULL);
+    ymo_assert(responses[0]->proxy_conn->pipe_wait);
+    ymo_assert(!responses[0]->proxy_conn->paused);
+    ymo_assert(!ev_is_active(&responses[0]->proxy_conn->w_read));
+
+    /* Reading resumes as the pipe drains: */
+    for( size_t i = 0; i < PUMP_MAX * 10 && responses[0]->proxy_conn; i++ ) {
+        client_recv(conns[0]);
+        memcpy(out + out_len, recv_buf, recv_len);
+        out_len += recv_len;
+        pump();
+        if( sent < sizeof(body)
+            && (n = write(fd, body + sent, sizeof(body) - sent)) > 0 ) {
+            sent += n;
+        }
+    }
+    client_recv(conns[0]);
+    memcpy(out + out_len, recv_buf, recv_len);
+    out_len += recv_len;
+
+    ymo_assert(out_len > (size_t)head_len);
+    ymo_assert(strstr(out, "Content-Length: 262144\r\n") != NULL);
+    char* out_body = strstr(out, "\r\n\r\n") + 4;
+    ymo_assert(out_len - (out_body - out) == sizeof(body));
+    ymo_assert(!memcmp(out_body, body, sizeof(body)));
+
+    ymo_http_proxy_stats_t stats = stats_of(0);
+    ymo_assert(stats.spliced == sizeof(body) - 1024);
+    ymo_assert(stats.idle == 1);
+
+    http_conn_close(conns[0]);
+    close(fd);
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int test_client_gone(void)
+{
+    conns[0] = open_conn(req_plain);
+    int fd = upstream_accept(0);
+    ymo_assert(fd >= 0);
+    upstream_recv(fd);
+    upstream_send(fd, "HTTP/1.1 200 OK\r\nContent-Length: 10\r\n\r\nhel");
+    client_recv(conns[0]);
+
+    /* The upstream connection can't be reused: */
+    http_conn_close(conns[0]);
+    ymo_http_proxy_stats_t stats = stats_of(0);
+    ymo_assert(stats.outstanding == 0);
+    ymo_assert(stats.idle == 0);
+    ymo_assert(proxy->active == NULL);
+
+    char buf[16];
+    ymo_assert(read(fd, buf, sizeof(buf)) == 0);
+    close(fd);
+    YMO_TAP_PASS(__func__);
+}
+
+
+/*---------------------------------------------------------------*
+ * Setup/Cleanup:
+ *---------------------------------------------------------------*/
+static int setup_suite(void)
+{
+    ymo_proto_t* proto = ymo_proto_http_create(
+            NULL, &http_cb, NULL, NULL, NULL, NULL, 0);
+    test_server = test_server_create(proto);
+    for( size_t i = 0; i < NO_UPSTREAMS; i++ ) {
+        listen_fds[i] = listen_port(&ports[i]);
+    }
+    return 0;
+}
+
+
+static int setup_test(void)
+{
+    /* Fresh proxy (one upstream) for each test: */
+    ymo_http_proxy_free(proxy);
+    proxy = ymo_http_proxy_create(test_loop());
+    ymo_http_proxy_add_upstream(proxy, "127.0.0.1", ports[0], 4);
+    no_responses = 0;
+    return 0;
+}
+
+
+static int cleanup(void)
+{
+    ymo_http_proxy_free(proxy);
+    for( size_t i = 0; i < NO_UPSTREAMS; i++ ) {
+        close(listen_fds[i]);
+    }
+    ymo_proto_http_cleanup(test_server->proto, test_server->server);
+    ymo_server_free(test_server->server);
+    YMO_FREE(test_server);
+    return 0;
+}
+
+
+YMO_TAP_RUN(&setup_suite, &setup_test, &cleanup,
+        YMO_TAP_TEST_FN(test_forward),
+        YMO_TAP_TEST_FN(test_reuse),
+        YMO_TAP_TEST_FN(test_chunked),
+        YMO_TAP_TEST_FN(test_request_body),
+        YMO_TAP_TEST_FN(test_balance),
+        YMO_TAP_TEST_FN(test_retry),
+        YMO_TAP_TEST_FN(test_bad_gateway),
+        YMO_TAP_TEST_FN(test_timeout),
+        YMO_TAP_TEST_FN(test_truncated),
+        YMO_TAP_TEST_FN(test_backpressure),
+        YMO_TAP_TEST_FN(test_splice),
+        YMO_TAP_TEST_FN(test_client_gone),
+        YMO_TAP_TEST_END()
+        )
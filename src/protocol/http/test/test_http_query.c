@@ -0,0 +1,281 @@
+/*=============================================================================
+ * test/test_http_query: Query string and form decoding tests
+ *
+ * Copyright (c) 2014 Andrew Canaday
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *===========================================================================*/
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "yimmo_config.h"
+#include "yimmo.h"
+#include "ymo_log.h"
+#include "ymo_blalloc.h"
+#include "core/ymo_tap.h"
+
+#include "ymo_http.h"
+#include "ymo_http_scan.h"
+
+#define OUT_MAX 512
+
+/* Long enough to cover the vector block and tail paths: */
+#define LONG_PLAIN "abcdefghijklmnopqrstuvwxyz0123456789-_.~ABCDEFGHIJ"
+
+static ymo_blalloc_t* ws = NULL;
+
+
+/*---------------------------------------------------------------*
+ * Helpers:
+ *---------------------------------------------------------------*/
+
+/* Decode src, and compare the result against expected: */
+static int decode_eq(const char* src, int form, const char* expected)
+{
+    char dst[OUT_MAX];
+    size_t len = ymo_http_url_decode(dst, src, strlen(src), form);
+    dst[len] = '\0';
+    if( len != strlen(expected) || memcmp(dst, expected, len) ) {
+        printf("# decode(\"%s\"): got \"%s\", expected \"%s\"\n",
+                src, dst, expected);
+        return 0;
+    }
+
+    /* In place, too: */
+    char tmp[OUT_MAX];
+    strcpy(tmp, src);
+    len = ymo_http_url_decode(tmp, tmp, strlen(tmp), form);
+    return len == strlen(expected) && !memcmp(tmp, expected, len);
+}
+
+
+/* Render every pair in query as "key=value;": */
+static int iter_eq(const char* query, const char* expected)
+{
+    char out[OUT_MAX];
+    size_t len = 0;
+    const char* key;
+    const char* value;
+    ymo_http_query_iter_t iter;
+
+    out[0] = '\0';
+    ymo_http_query_iter_init(&iter, query);
+    while( ymo_http_query_next(&iter, ws, &key, &value) > 0 ) {
+        len += snprintf(out + len, sizeof(out) - len, "%s=%s;", key, value);
+    }
+    ymo_blalloc_reset(ws);
+
+    if( strcmp(out, expected) ) {
+        printf("# iter(\"%s\"): got \"%s\", expected \"%s\"\n",
+                query ? query : "(null)", out, expected);
+        return 0;
+    }
+    return 1;
+}
+
+
+static char form_out[OUT_MAX];
+static size_t form_out_len;
+static int form_fail_at;
+
+static ymo_status_t form_cb(
+        void* data, const char* key, const char* value, size_t value_len)
+{
+    if( form_fail_at && !--form_fail_at ) {
+        return EPERM;
+    }
+    ymo_assert(strlen(value) == value_len);
+    form_out_len += snprintf(form_out + form_out_len,
+            sizeof(form_out) - form_out_len, "%s=%s;", key, value);
+    return YMO_OKAY;
+}
+
+
+/* Feed body to a form parser in chunk_len pieces: */
+static ymo_status_t form_parse(
+        const char* body, size_t chunk_len, char* buf, size_t buf_len)
+{
+    ymo_http_form_t form;
+    ymo_status_t status;
+    size_t len = strlen(body);
+
+    form_out[0] = '\0';
+    form_out_len = 0;
+    ymo_http_form_init(&form, buf, buf_len, &form_cb, NULL);
+    for( size_t i = 0; i < len; i += chunk_len ) {
+        size_t n = (len - i < chunk_len) ? len - i : chunk_len;
+        if( (status = ymo_http_form_feed(&form, body + i, n)) ) {
+            return status;
+        }
+    }
+    return ymo_http_form_finish(&form);
+}
+
+
+/*---------------------------------------------------------------*
+ * Tests:
+ *---------------------------------------------------------------*/
+static int test_url_decode(void)
+{
+    const ymo_http_scanner_t* scanner;
+
+    for( size_t idx = 0; (scanner = ymo_http_scan_impl(idx)); idx++ )
+    {
+        ymo_assert(ymo_http_scan_select(scanner->name) == YMO_OKAY);
+        ymo_assert(decode_eq("", 1, ""));
+        ymo_assert(decode_eq("plain", 1, "plain"));
+        ymo_assert(decode_eq("a+b", 1, "a b"));
+        ymo_assert(decode_eq("a+b", 0, "a+b"));
+        ymo_assert(decode_eq("%41%62%2f%2F", 1, "Ab//"));
+        ymo_assert(decode_eq("100%", 1, "100%"));
+        ymo_assert(decode_eq("%4", 1, "%4"));
+        ymo_assert(decode_eq("%zz%4g", 1, "%zz%4g"));
+        ymo_assert(decode_eq("%25%32%35", 1, "%25"));
+        ymo_assert(decode_eq("k=v&x", 1, "k=v&x"));
+        ymo_assert(decode_eq(
+                    LONG_PLAIN "%20" LONG_PLAIN "+" LONG_PLAIN, 1,
+                    LONG_PLAIN " " LONG_PLAIN " " LONG_PLAIN));
+    }
+    ymo_assert(ymo_http_scan_select(NULL) == YMO_OKAY);
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int test_query_iter(void)
+{
+    ymo_assert(iter_eq(NULL, ""));
+    ymo_assert(iter_eq("", ""));
+    ymo_assert(iter_eq("a=1", "a=1;"));
+    ymo_assert(iter_eq("a=1&&b=hello+world&", "a=1;b=hello world;"));
+    ymo_assert(iter_eq("flag&x=", "flag=;x=;"));
+    ymo_assert(iter_eq("%3D=%26&k=a=b", "==&;k=a=b;"));
+    ymo_assert(iter_eq("=v&q=%zz", "=v;q=%zz;"));
+    ymo_assert(iter_eq("long=" LONG_PLAIN "%21", "long=" LONG_PLAIN "!;"));
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int test_request_query(void)
+{
+    ymo_http_request_t request;
+    const char* value;
+
+    memset(&request, 0, sizeof(request));
+    request.ws = ws;
+    request.query = "id=7&first+name=J%C3%B6rg&flag&id=8&a%26b=%3D";
+
+    value = ymo_http_request_query(&request, "id");
+    ymo_assert(value && !strcmp(value, "7"));
+    value = ymo_http_request_query(&request, "first name");
+    ymo_assert(value && !strcmp(value, "J\xc3\xb6rg"));
+    value = ymo_http_request_query(&request, "flag");
+    ymo_assert(value && !strcmp(value, ""));
+    value = ymo_http_request_query(&request, "a&b");
+    ymo_assert(value && !strcmp(value, "="));
+
+    /* Prefixes and extensions of a key don't match: */
+    errno = 0;
+    ymo_assert(ymo_http_request_query(&request, "i") == NULL);
+    ymo_assert(errno == ENOENT);
+    ymo_assert(ymo_http_request_query(&request, "idx") == NULL);
+    ymo_assert(ymo_http_request_query(&request, "first") == NULL);
+
+    request.query = NULL;
+    ymo_assert(ymo_http_request_query(&request, "id") == NULL);
+    ymo_blalloc_reset(ws);
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int test_form_chunks(void)
+{
+    static const char* body =
+        "name=J%C3%B6rg+Doe&&empty=&flag&eq=a=b&pct=100%&bad=%zz"
+        "&" LONG_PLAIN "=%2" "5x&last=%41";
+    static const char* expected =
+        "name=J\xc3\xb6rg Doe;empty=;flag=;eq=a=b;pct=100%;bad=%zz;"
+        LONG_PLAIN "=%x;last=A;";
+    const ymo_http_scanner_t* scanner;
+    char buf[128];
+
+    for( size_t idx = 0; (scanner = ymo_http_scan_impl(idx)); idx++ )
+    {
+        ymo_assert(ymo_http_scan_select(scanner->name) == YMO_OKAY);
+
+        /* Every chunk size, so escapes and separators land on every
+         * chunk boundary: */
+        for( size_t chunk = 1; chunk <= strlen(body); chunk++ ) {
+            ymo_assert(form_parse(body, chunk, buf, sizeof(buf)) == YMO_OKAY);
+            if( strcmp(form_out, expected) ) {
+                printf("# chunk %zu (%s): \"%s\"\n",
+                        chunk, scanner->name, form_out);
+                ymo_assert(0);
+            }
+        }
+    }
+    ymo_assert(ymo_http_scan_select(NULL) == YMO_OKAY);
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int test_form_limits(void)
+{
+    char buf[8];
+
+    /* key + NUL + value + NUL must fit: */
+    ymo_assert(form_parse("abc=def", 3, buf, sizeof(buf)) == YMO_OKAY);
+    ymo_assert(!strcmp(form_out, "abc=def;"));
+    ymo_assert(form_parse("abc=defg", 3, buf, sizeof(buf)) == EFBIG);
+    ymo_assert(form_parse("abcdefgh", 3, buf, sizeof(buf)) == EFBIG);
+    ymo_assert(form_parse("abcdefg=", 8, buf, sizeof(buf)) == EFBIG);
+
+    /* ...but only one field at a time: */
+    ymo_assert(form_parse("a=1&bb=22&ccc=333", 5, buf, sizeof(buf))
+            == YMO_OKAY);
+    ymo_assert(!strcmp(form_out, "a=1;bb=22;ccc=333;"));
+
+    /* Callback errors stop the parser: */
+    form_fail_at = 2;
+    ymo_assert(form_parse("a=1&b=2&c=3", 64, buf, sizeof(buf)) == EPERM);
+    ymo_assert(!strcmp(form_out, "a=1;"));
+    form_fail_at = 0;
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int setup_suite(void)
+{
+    ws = ymo_blalloc_create(4096);
+    return ws == NULL;
+}
+
+
+static int cleanup(void)
+{
+    ymo_blalloc_free(ws);
+    return 0;
+}
+
+
+YMO_TAP_RUN(&setup_suite, NULL, &cleanup,
+        YMO_TAP_TEST_FN(test_url_decode),
+        YMO_TAP_TEST_FN(test_query_iter),
+        YMO_TAP_TEST_FN(test_request_query),
+        YMO_TAP_TEST_FN(test_form_chunks),
+        YMO_TAP_TEST_FN(test_form_limits),
+        YMO_TAP_TEST_END()
+        )
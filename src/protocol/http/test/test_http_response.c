@@ -18,10 +18,13 @@
  *
  *===========================================================================*/
 #include <stdio.h>
+#include <string.h>
+#include <errno.h>
 
 #include "yimmo.h"
 #include "core/ymo_tap.h"
 
+#include "core/ymo_bucket.h"
 #include "ymo_http_response.h"
 
 /*-------------------------------------------------------------*
@@ -58,12 +61,410 @@ static int add_headers()
 }
 
 
+/* Serialize a fresh response with the given status and headers: */
+static ymo_bucket_t* serialize(
+        ymo_http_status_t status, const char** hdrs, size_t no_hdrs,
+        const ymo_http_auto_hdrs_t* auto_hdrs)
+{
+    ymo_http_response_t* r = ymo_http_response_create(NULL);
+    if( !r ) {
+        return NULL;
+    }
+
+    for( size_t i = 0; i < no_hdrs; i += 2 ) {
+        ymo_http_response_insert_header(r, hdrs[i], hdrs[i+1]);
+    }
+    ymo_http_response_set_status(r, status);
+    r->flags |= YMO_HTTP_RESPONSE_COMPLETE;
+
+    ymo_bucket_t* head = ymo_http_response_start(NULL, r, auto_hdrs);
+    ymo_http_response_free(r);
+    return head;
+}
+
+
+static int serialize_status_lines(void)
+{
+    const char* hdrs[] = {
+        "Server", "ymo_http_response",
+        "Content-Type", "text/plain",
+    };
+
+    ymo_bucket_t* head = serialize(YMO_HTTP_NOT_FOUND, hdrs, 4, NULL);
+    ymo_assert(head != NULL);
+    ymo_assert(head->len == sizeof(
+                "HTTP/1.1 404 Not Found\r\n"
+                "Server: ymo_http_response\r\n"
+                "Content-Type: text/plain\r\n"
+                "Content-Length: 0\r\n"
+                "\r\n")-1);
+    ymo_assert(!strncmp(head->data,
+                "HTTP/1.1 404 Not Found\r\n"
+                "Server: ymo_http_response\r\n"
+                "Content-Type: text/plain\r\n"
+                "Content-Length: 0\r\n"
+                "\r\n", head->len));
+    ymo_bucket_free_all(head);
+
+    /* The reason phrase is optional for codes we don't know: */
+    head = serialize(299, NULL, 0, NULL);
+    ymo_assert(head != NULL);
+    ymo_assert(head->len == sizeof("HTTP/1.1 299 \r\nContent-Length: 0\r\n\r\n")-1);
+    ymo_assert(!strncmp(head->data,
+                "HTTP/1.1 299 \r\nContent-Length: 0\r\n\r\n", head->len));
+    ymo_bucket_free_all(head);
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int serialize_large_headers(void)
+{
+    /* Comfortably more than the old 1KB send buffer: */
+    static char names[64][16];
+    static char value[256];
+    const char* hdrs[128];
+    size_t expect_len = sizeof("HTTP/1.1 200 OK\r\n")-1
+        + sizeof("Content-Length: 0\r\n")-1 + 2;
+
+    memset(value, 'v', sizeof(value)-1);
+    for( size_t i = 0; i < 64; i++ ) {
+        snprintf(names[i], sizeof(names[i]), "X-Header-%zu", i);
+        hdrs[2*i] = names[i];
+        hdrs[2*i+1] = value;
+        expect_len += strlen(names[i]) + sizeof(value)-1 + 4;
+    }
+
+    ymo_bucket_t* head = serialize(YMO_HTTP_OK, hdrs, 128, NULL);
+    ymo_assert(head != NULL);
+    ymo_assert(head->len == expect_len);
+    ymo_assert(!strncmp(head->data, "HTTP/1.1 200 OK\r\nX-Header-0: vvv", 32));
+    ymo_assert(!strncmp(head->data + head->len - 4, "\r\n\r\n", 4));
+    ymo_bucket_free_all(head);
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int auto_hdrs_date(void)
+{
+    ymo_http_auto_hdrs_t auto_hdrs;
+    memset(&auto_hdrs, 0, sizeof(auto_hdrs));
+
+    /* RFC 9110 §5.6.7 example: */
+    ymo_http_auto_hdrs_set_date(&auto_hdrs, 784111777);
+    ymo_assert(auto_hdrs.date_len == YMO_HTTP_DATE_HDR_LEN);
+    ymo_assert_str_eq(auto_hdrs.date, "Date: Sun, 06 Nov 1994 08:49:37 GMT\r\n");
+
+    ymo_http_auto_hdrs_set_date(&auto_hdrs, 0);
+    ymo_assert_str_eq(auto_hdrs.date, "Date: Thu, 01 Jan 1970 00:00:00 GMT\r\n");
+
+    ymo_http_auto_hdrs_set_date(&auto_hdrs, 951825599);
+    ymo_assert_str_eq(auto_hdrs.date, "Date: Tue, 29 Feb 2000 11:59:59 GMT\r\n");
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int serialize_auto_hdrs(void)
+{
+    static const char server_hdr[] = "Server: yimmo\r\n";
+    const char* hdrs[] = {
+        "Date", "Mon, 01 Jan 2024 00:00:00 GMT",
+    };
+    ymo_http_auto_hdrs_t auto_hdrs;
+    memset(&auto_hdrs, 0, sizeof(auto_hdrs));
+    ymo_http_auto_hdrs_set_date(&auto_hdrs, 784111777);
+    auto_hdrs.server = server_hdr;
+    auto_hdrs.server_len = sizeof(server_hdr)-1;
+
+    /* Appended after the response's own headers: */
+    ymo_bucket_t* head = serialize(YMO_HTTP_OK, NULL, 0, &auto_hdrs);
+    ymo_assert(head != NULL);
+    ymo_assert(head->len == sizeof(
+                "HTTP/1.1 200 OK\r\n"
+                "Content-Length: 0\r\n"
+                "Date: Sun, 06 Nov 1994 08:49:37 GMT\r\n"
+                "Server: yimmo\r\n"
+                "\r\n")-1);
+    ymo_assert(!strncmp(head->data,
+                "HTTP/1.1 200 OK\r\n"
+                "Content-Length: 0\r\n"
+                "Date: Sun, 06 Nov 1994 08:49:37 GMT\r\n"
+                "Server: yimmo\r\n"
+                "\r\n", head->len));
+    ymo_bucket_free_all(head);
+
+    /* ...unless the response has set them itself: */
+    head = serialize(YMO_HTTP_OK, hdrs, 2, &auto_hdrs);
+    ymo_assert(head != NULL);
+    ymo_assert(head->len == sizeof(
+                "HTTP/1.1 200 OK\r\n"
+                "Date: Mon, 01 Jan 2024 00:00:00 GMT\r\n"
+                "Content-Length: 0\r\n"
+                "Server: yimmo\r\n"
+                "\r\n")-1);
+    ymo_assert(!strncmp(head->data,
+                "HTTP/1.1 200 OK\r\n"
+                "Date: Mon, 01 Jan 2024 00:00:00 GMT\r\n"
+                "Content-Length: 0\r\n"
+                "Server: yimmo\r\n"
+                "\r\n", head->len));
+    ymo_bucket_free_all(head);
+
+    /* ...or it's an interim response: */
+    ymo_bucket_t* expect = serialize(YMO_HTTP_CONTINUE, NULL, 0, NULL);
+    head = serialize(YMO_HTTP_CONTINUE, NULL, 0, &auto_hdrs);
+    ymo_assert(head != NULL && expect != NULL);
+    ymo_assert(head->len == expect->len);
+    ymo_assert(!strncmp(head->data, expect->data, head->len));
+    ymo_bucket_free_all(expect);
+    ymo_bucket_free_all(head);
+    YMO_TAP_PASS(__func__);
+}
+
+
+/* Concatenate a bucket chain (NUL-terminated) for comparison: */
+static size_t flatten(const ymo_bucket_t* bucket, char* buf, size_t buf_len)
+{
+    size_t len = 0;
+    for( ; bucket; bucket = bucket->next ) {
+        if( len + bucket->len >= buf_len ) {
+            break;
+        }
+        memcpy(buf + len, bucket->data, bucket->len);
+        len += bucket->len;
+    }
+    buf[len] = '\0';
+    return len;
+}
+
+
+static int canned_variants(void)
+{
+    char buf[512];
+    ymo_http_hdr_table_t* hdrs = ymo_http_hdr_table_create();
+    ymo_http_hdr_table_insert(hdrs, "Content-Type", "application/json");
+    ymo_http_canned_t* canned = ymo_http_canned_create(
+            YMO_HTTP_OK, hdrs, "{\"ok\":true}", 11);
+    ymo_assert(canned != NULL);
+
+    ymo_http_response_t* r = ymo_http_response_create(NULL);
+    ymo_assert(r != NULL);
+    r->canned = canned;
+
+    /* HTTP/1.1, keep-alive: */
+    r->flags = YMO_HTTP_FLAG_VERSION_1_1 | YMO_HTTP_FLAG_REQUEST_KEEPALIVE;
+    ymo_bucket_t* out = ymo_http_response_start(NULL, r, NULL);
+    ymo_assert(out != NULL);
+    ymo_assert(out->next == NULL);
+    flatten(out, buf, sizeof(buf));
+    ymo_assert_str_eq(buf,
+            "HTTP/1.1 200 OK\r\n"
+            "Content-Type: application/json\r\n"
+            "Content-Length: 11\r\n"
+            "\r\n"
+            "{\"ok\":true}");
+    ymo_bucket_free_all(out);
+
+    /* HTTP/1.1, close: */
+    r->flags = YMO_HTTP_FLAG_VERSION_1_1;
+    out = ymo_http_response_start(NULL, r, NULL);
+    ymo_assert(out != NULL);
+    flatten(out, buf, sizeof(buf));
+    ymo_assert_str_eq(buf,
+            "HTTP/1.1 200 OK\r\n"
+            "Content-Type: application/json\r\n"
+            "Content-Length: 11\r\n"
+            "Connection: close\r\n"
+            "\r\n"
+            "{\"ok\":true}");
+    ymo_bucket_free_all(out);
+
+    /* HTTP/1.0, keep-alive: */
+    r->flags = YMO_HTTP_FLAG_REQUEST_KEEPALIVE;
+    out = ymo_http_response_start(NULL, r, NULL);
+    ymo_assert(out != NULL);
+    flatten(out, buf, sizeof(buf));
+    ymo_assert_str_eq(buf,
+            "HTTP/1.1 200 OK\r\n"
+            "Content-Type: application/json\r\n"
+            "Content-Length: 11\r\n"
+            "Connection: Keep-alive\r\n"
+            "\r\n"
+            "{\"ok\":true}");
+    ymo_bucket_free_all(out);
+
+    /* Server-generated headers are spliced in before the final CRLF: */
+    ymo_http_auto_hdrs_t auto_hdrs;
+    memset(&auto_hdrs, 0, sizeof(auto_hdrs));
+    ymo_http_auto_hdrs_set_date(&auto_hdrs, 784111777);
+    r->flags = YMO_HTTP_FLAG_VERSION_1_1 | YMO_HTTP_FLAG_REQUEST_KEEPALIVE;
+    out = ymo_http_response_start(NULL, r, &auto_hdrs);
+    ymo_assert(out != NULL);
+    flatten(out, buf, sizeof(buf));
+    ymo_assert_str_eq(buf,
+            "HTTP/1.1 200 OK\r\n"
+            "Content-Type: application/json\r\n"
+            "Content-Length: 11\r\n"
+            "Date: Sun, 06 Nov 1994 08:49:37 GMT\r\n"
+            "\r\n"
+            "{\"ok\":true}");
+    ymo_bucket_free_all(out);
+
+    /* HEAD: the head only, with or without server-generated headers: */
+    r->flags = YMO_HTTP_FLAG_VERSION_1_1 | YMO_HTTP_FLAG_REQUEST_KEEPALIVE
+        | YMO_HTTP_RESPONSE_NO_BODY;
+    out = ymo_http_response_start(NULL, r, NULL);
+    ymo_assert(out != NULL);
+    flatten(out, buf, sizeof(buf));
+    ymo_assert_str_eq(buf,
+            "HTTP/1.1 200 OK\r\n"
+            "Content-Type: application/json\r\n"
+            "Content-Length: 11\r\n"
+            "\r\n");
+    ymo_bucket_free_all(out);
+
+    out = ymo_http_response_start(NULL, r, &auto_hdrs);
+    ymo_assert(out != NULL);
+    flatten(out, buf, sizeof(buf));
+    ymo_assert_str_eq(buf,
+            "HTTP/1.1 200 OK\r\n"
+            "Content-Type: application/json\r\n"
+            "Content-Length: 11\r\n"
+            "Date: Sun, 06 Nov 1994 08:49:37 GMT\r\n"
+            "\r\n");
+    ymo_bucket_free_all(out);
+
+    r->canned = NULL;
+    ymo_http_response_free(r);
+    ymo_http_canned_free(canned);
+    ymo_http_hdr_table_free(hdrs);
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int canned_invalid(void)
+{
+    ymo_http_hdr_table_t* hdrs = ymo_http_hdr_table_create();
+
+    /* No body, no headers, unknown (but valid) status: */
+    ymo_http_canned_t* canned = ymo_http_canned_create(299, NULL, NULL, 0);
+    ymo_assert(canned != NULL);
+    ymo_assert(canned->variant[YMO_HTTP_CANNED_CONN_NONE].len == sizeof(
+                "HTTP/1.1 299 \r\nContent-Length: 0\r\n\r\n")-1);
+    ymo_assert(!strncmp(canned->variant[YMO_HTTP_CANNED_CONN_NONE].data,
+                "HTTP/1.1 299 \r\nContent-Length: 0\r\n\r\n",
+                canned->variant[YMO_HTTP_CANNED_CONN_NONE].len));
+    ymo_http_canned_free(canned);
+
+    /* No Content-Length or body for 1xx, 204, or 304: */
+    static const struct {
+        ymo_http_status_t status;
+        const char*       expected;
+    } no_body[] = {
+        { YMO_HTTP_CONTINUE, "HTTP/1.1 100 Continue\r\n\r\n" },
+        { YMO_HTTP_NO_CONTENT, "HTTP/1.1 204 No Content\r\n\r\n" },
+        { YMO_HTTP_NOT_MODIFIED, "HTTP/1.1 304 Not Modified\r\n\r\n" },
+    };
+    for( size_t i = 0; i < sizeof(no_body)/sizeof(no_body[0]); i++ ) {
+        canned = ymo_http_canned_create(no_body[i].status, NULL, "hello", 5);
+        ymo_assert(canned != NULL);
+        ymo_assert(canned->variant[YMO_HTTP_CANNED_CONN_NONE].len
+                == strlen(no_body[i].expected));
+        ymo_assert(!strncmp(canned->variant[YMO_HTTP_CANNED_CONN_NONE].data,
+                    no_body[i].expected, strlen(no_body[i].expected)));
+        ymo_http_canned_free(canned);
+    }
+
+    /* Generated headers may not be supplied: */
+    ymo_http_hdr_table_insert(hdrs, "content-length", "5");
+    errno = 0;
+    ymo_assert(ymo_http_canned_create(YMO_HTTP_OK, hdrs, "hello", 5) == NULL);
+    ymo_assert(errno == EINVAL);
+    ymo_http_hdr_table_clear(hdrs);
+
+    ymo_http_hdr_table_insert(hdrs, "Connection", "close");
+    errno = 0;
+    ymo_assert(ymo_http_canned_create(YMO_HTTP_OK, hdrs, NULL, 0) == NULL);
+    ymo_assert(errno == EINVAL);
+
+    /* Body length without a body: */
+    errno = 0;
+    ymo_assert(ymo_http_canned_create(YMO_HTTP_OK, NULL, NULL, 5) == NULL);
+    ymo_assert(errno == EINVAL);
+
+    ymo_http_hdr_table_free(hdrs);
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int chunked_body(void)
+{
+    char buf[512];
+    char big[300];
+    ymo_http_response_t* r = ymo_http_response_create(NULL);
+    ymo_assert(r != NULL);
+
+    /* Pending buckets are coalesced into one chunk: */
+    r->flags = YMO_HTTP_RESPONSE_CHUNKED;
+    ymo_http_response_body_append(r, YMO_BUCKET_FROM_REF("Hello", 5));
+    ymo_http_response_body_append(r, YMO_BUCKET_FROM_REF(", ", 2));
+    ymo_http_response_body_append(r, YMO_BUCKET_FROM_REF("world", 5));
+    ymo_bucket_t* out = ymo_http_response_body_get(NULL, r);
+    ymo_assert(out != NULL);
+    ymo_assert(ymo_bucket_len_all(out) == 17);
+    flatten(out, buf, sizeof(buf));
+    ymo_assert_str_eq(buf, "c\r\nHello, world\r\n");
+    ymo_bucket_free_all(out);
+    ymo_assert(r->body_head == NULL && r->body_tail == NULL);
+
+    /* Nothing pending; or nothing but empty buckets: */
+    errno = 0;
+    ymo_assert(ymo_http_response_body_get(NULL, r) == NULL);
+    ymo_http_response_body_append(r, YMO_BUCKET_FROM_REF("", 0));
+    ymo_assert(ymo_http_response_body_get(NULL, r) == NULL);
+    ymo_assert(errno == 0);
+
+    memset(big, 'x', sizeof(big));
+    ymo_http_response_body_append(r, YMO_BUCKET_FROM_REF(big, sizeof(big)));
+    out = ymo_http_response_body_get(NULL, r);
+    ymo_assert(out != NULL);
+    ymo_assert(out->len == 5 && !memcmp(out->data, "12c\r\n", 5));
+    ymo_bucket_free_all(out);
+
+    /* The terminal chunk goes out with the last of the body: */
+    r->flags |= YMO_HTTP_RESPONSE_COMPLETE;
+    ymo_http_response_body_append(r, YMO_BUCKET_FROM_REF("!", 1));
+    out = ymo_http_response_body_get(NULL, r);
+    ymo_assert(out != NULL);
+    flatten(out, buf, sizeof(buf));
+    ymo_assert_str_eq(buf, "1\r\n!\r\n0\r\n\r\n");
+    ymo_assert(r->flags & YMO_HTTP_RESPONSE_CHUNK_TERM);
+    ymo_bucket_free_all(out);
+
+    /* Unchunked bodies pass straight through: */
+    r->flags = 0;
+    ymo_bucket_t* body = YMO_BUCKET_FROM_REF("plain", 5);
+    ymo_http_response_body_append(r, body);
+    ymo_assert(ymo_http_response_body_get(NULL, r) == body);
+    ymo_bucket_free_all(body);
+
+    ymo_http_response_free(r);
+    YMO_TAP_PASS(__func__);
+}
+
+
 /*-------------------------------------------------------------*
  * Main:
  *-------------------------------------------------------------*/
 YMO_TAP_RUN(YMO_TAP_NO_INIT(),
         YMO_TAP_TEST_FN(create_response),
         YMO_TAP_TEST_FN(add_headers),
+        YMO_TAP_TEST_FN(serialize_status_lines),
+        YMO_TAP_TEST_FN(serialize_large_headers),
+        YMO_TAP_TEST_FN(auto_hdrs_date),
+        YMO_TAP_TEST_FN(serialize_auto_hdrs),
+        YMO_TAP_TEST_FN(canned_variants),
+        YMO_TAP_TEST_FN(canned_invalid),
+        YMO_TAP_TEST_FN(chunked_body),
         YMO_TAP_TEST_END()
         )
 
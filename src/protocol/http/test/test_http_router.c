@@ -0,0 +1,336 @@
+/*=============================================================================
+ * test/test_http_router: URL router tests
+ *
+ * Copyright (c) 2014 Andrew Canaday
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *===========================================================================*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "yimmo_config.h"
+#include "yimmo.h"
+#include "ymo_log.h"
+#include "core/ymo_tap.h"
+#include "core/ymo_proto.h"
+#include "core/ymo_test_proto.h"
+
+#include "ymo_http_test.h"
+
+#include "ymo_http.h"
+#include "ymo_proto_http.h"
+#include "ymo_http_router.h"
+
+#define IO_BUF_SIZE 8192
+#define NO_MANY     1024
+
+static char in[IO_BUF_SIZE];
+static size_t in_len;
+
+
+/*---------------------------------------------------------------*
+ * Handlers:
+ *---------------------------------------------------------------*/
+
+/* Respond with the handler name and the route params, e.g. "user id=7": */
+static ymo_status_t respond(
+        const char* name,
+        ymo_http_request_t* request,
+        ymo_http_response_t* response)
+{
+    char body[512];
+    size_t len = snprintf(body, sizeof(body), "%s", name);
+    for( size_t i = 0; i < request->no_params; i++ ) {
+        len += snprintf(body + len, sizeof(body) - len, " %s=%s",
+                request->params[i].name, request->params[i].value);
+    }
+
+    ymo_http_response_set_status(response, YMO_HTTP_OK);
+    ymo_http_response_body_append(
+            response, YMO_BUCKET_FROM_CPY(body, len));
+    ymo_http_response_finish(response);
+    return YMO_OKAY;
+}
+
+#define ROUTE_HANDLER(name) \
+    static ymo_status_t name##_cb( \
+            ymo_http_session_t* session, \
+            ymo_http_request_t* request, \
+            ymo_http_response_t* response, \
+            void* user) \
+    { \
+        return respond(#name, request, response); \
+    }
+
+ROUTE_HANDLER(root)
+ROUTE_HANDLER(users)
+ROUTE_HANDLER(me)
+ROUTE_HANDLER(user)
+ROUTE_HANDLER(create)
+ROUTE_HANDLER(post)
+ROUTE_HANDLER(static)
+ROUTE_HANDLER(backtrack)
+ROUTE_HANDLER(exact)
+ROUTE_HANDLER(many)
+ROUTE_HANDLER(fallback)
+
+
+/*---------------------------------------------------------------*
+ * Utilities:
+ *---------------------------------------------------------------*/
+/* Issue a request on a fresh connection; return the response body: */
+static const char* request(const char* method, const char* path)
+{
+    char req[512];
+    size_t len = snprintf(req, sizeof(req),
+            "%s %s HTTP/1.1\r\n"
+            "Host: example.com\r\n"
+            "\r\n", method, path);
+
+    ymo_test_conn_t* test_conn = http_conn_open();
+    http_conn_send(test_conn, req, len, 0);
+    in_len = http_conn_recv(test_conn, in, sizeof(in));
+    http_conn_close(test_conn);
+
+    const char* body = strstr(in, "\r\n\r\n");
+    return body ? body + 4 : "";
+}
+
+
+/* Issue a request and compare the response body: */
+static int route_eq(const char* method, const char* path, const char* expected)
+{
+    const char* body = request(method, path);
+    if( strcmp(body, expected) ) {
+        printf("# %s %s: expected \"%s\"; got \"%s\"\n",
+                method, path, expected, body);
+        return 0;
+    }
+    return 1;
+}
+
+
+/*---------------------------------------------------------------*
+ * Tests:
+ *---------------------------------------------------------------*/
+static int test_router_static(void)
+{
+    ymo_assert(route_eq("GET", "/", "root"));
+    ymo_assert(route_eq("GET", "/users", "users"));
+    ymo_assert(route_eq("GET", "/users/me", "me"));
+
+    /* Matches are exact; everything else falls back on http_cb: */
+    ymo_assert(route_eq("GET", "/users/", "fallback"));
+    ymo_assert(route_eq("GET", "/usersx", "fallback"));
+    ymo_assert(route_eq("GET", "/Users", "fallback"));
+    ymo_assert(route_eq("GET", "/nope", "fallback"));
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int test_router_params(void)
+{
+    /* Static segments win over params: */
+    ymo_assert(route_eq("GET", "/users/7", "user id=7"));
+    ymo_assert(route_eq("GET", "/users/mean", "user id=mean"));
+    ymo_assert(route_eq("GET", "/users/7/posts/hello-world",
+                "post id=7 slug=hello-world"));
+
+    /* Params don't match empty segments: */
+    ymo_assert(route_eq("GET", "/users//posts/x", "fallback"));
+    ymo_assert(route_eq("GET", "/users/7/posts/", "fallback"));
+
+    /* The query isn't part of the path: */
+    ymo_assert(route_eq("GET", "/users/7?x=1", "user id=7"));
+
+    /* Lookup by name: */
+    ymo_http_param_t params[] = { { "id", "7" }, { "slug", "x" } };
+    ymo_http_request_t req = { .params = params, .no_params = 2 };
+    ymo_assert_str_eq(ymo_http_request_param(&req, "slug"), "x");
+    ymo_assert(ymo_http_request_param(&req, "nope") == NULL);
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int test_router_wildcard(void)
+{
+    ymo_assert(route_eq("GET", "/static/css/site.css",
+                "static path=css/site.css"));
+    ymo_assert(route_eq("GET", "/static/", "static path="));
+
+    /* Backtracking: the static branch fails part way; the param matches: */
+    ymo_assert(route_eq("GET", "/a/b/d", "exact"));
+    ymo_assert(route_eq("GET", "/a/b/c", "backtrack x=b"));
+    ymo_assert(route_eq("GET", "/a/bb/c", "backtrack x=bb"));
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int test_router_methods(void)
+{
+    ymo_assert(route_eq("GET", "/users/7", "user id=7"));
+    ymo_assert(route_eq("DELETE", "/users/7", "user id=7"));
+    ymo_assert(route_eq("POST", "/users", "create"));
+
+    /* HEAD falls back on GET (without a body): */
+    request("HEAD", "/users");
+    ymo_assert(!strncmp(in, "HTTP/1.1 200 OK\r\n", 17));
+    ymo_assert(strstr(in, "\r\nContent-Length: 5\r\n") != NULL);
+    ymo_assert(in_len > 4 && !strcmp(in + in_len - 4, "\r\n\r\n"));
+
+    /* Path matched, method didn't: */
+    request("PUT", "/users");
+    ymo_assert(!strncmp(in, "HTTP/1.1 405 Method Not Allowed\r\n", 33));
+    ymo_assert(strstr(in, "\r\nAllow: GET, HEAD, POST\r\n") != NULL);
+
+    request("PATCH", "/users/7");
+    ymo_assert(!strncmp(in, "HTTP/1.1 405 Method Not Allowed\r\n", 33));
+    ymo_assert(strstr(in, "\r\nAllow: GET, HEAD, DELETE\r\n") != NULL);
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int test_router_add(void)
+{
+    ymo_http_router_t* router = ymo_http_router_create();
+    ymo_assert(router != NULL);
+
+    /* Bad patterns: */
+    ymo_assert(ymo_http_router_add(
+                router, YMO_HTTP_ROUTE_GET, "users", &users_cb) == EINVAL);
+    ymo_assert(ymo_http_router_add(
+                router, YMO_HTTP_ROUTE_GET, "/a/:/b", &users_cb) == EINVAL);
+    ymo_assert(ymo_http_router_add(
+                router, YMO_HTTP_ROUTE_GET, "/a/*/b", &users_cb) == EINVAL);
+    ymo_assert(ymo_http_router_add(router, 0, "/a", &users_cb) == EINVAL);
+    ymo_assert(ymo_http_router_add(
+                router, YMO_HTTP_ROUTE_GET,
+                "/:a/:b/:c/:d/:e/:f/:g/:h/:i/:j/:k/:l/:m/:n/:o/:p/:q",
+                &users_cb) == EINVAL);
+
+    /* ':' and '*' are only special at the start of a segment: */
+    ymo_assert(ymo_http_router_add(
+                router, YMO_HTTP_ROUTE_GET, "/a:b*c", &users_cb) == YMO_OKAY);
+
+    /* Overlapping methods: */
+    ymo_assert(ymo_http_router_add(router,
+                YMO_HTTP_ROUTE_GET | YMO_HTTP_ROUTE_POST, "/x/:id",
+                &users_cb) == YMO_OKAY);
+    ymo_assert(ymo_http_router_add(
+                router, YMO_HTTP_ROUTE_POST, "/x/:other",
+                &users_cb) == EEXIST);
+    ymo_assert(ymo_http_router_add(
+                router, YMO_HTTP_ROUTE_PUT, "/x/:other",
+                &users_cb) == YMO_OKAY);
+
+    ymo_assert(ymo_http_router_compile(router) == YMO_OKAY);
+    ymo_assert(ymo_http_router_add(
+                router, YMO_HTTP_ROUTE_GET, "/y", &users_cb) == EBUSY);
+    ymo_assert(router->no_routes == 3);
+
+    /* One router per protocol: */
+    ymo_assert(ymo_http_set_router(test_server->proto, router) == EBUSY);
+    ymo_http_router_free(router);
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int test_router_many(void)
+{
+    char path[64];
+    char expected[64];
+    for( int i = 0; i < NO_MANY; i += 97 ) {
+        snprintf(path, sizeof(path), "/api/v%i/item%i/%i", i % 3, i, i * 7);
+        snprintf(expected, sizeof(expected), "many id=%i", i * 7);
+        ymo_assert(route_eq("GET", path, expected));
+    }
+    ymo_assert(route_eq("GET", "/api/v1/item1", "fallback"));
+    YMO_TAP_PASS(__func__);
+}
+
+
+/*---------------------------------------------------------------*
+ * Setup/Cleanup:
+ *---------------------------------------------------------------*/
+static int setup_suite(void)
+{
+    static const struct {
+        unsigned int   methods;
+        const char*    pattern;
+        ymo_http_cb_t  cb;
+    } routes[] = {
+        { YMO_HTTP_ROUTE_GET, "/", &root_cb },
+        { YMO_HTTP_ROUTE_GET, "/users", &users_cb },
+        { YMO_HTTP_ROUTE_POST, "/users", &create_cb },
+        { YMO_HTTP_ROUTE_GET, "/users/me", &me_cb },
+        { YMO_HTTP_ROUTE_GET | YMO_HTTP_ROUTE_DELETE, "/users/:id", &user_cb },
+        { YMO_HTTP_ROUTE_GET, "/users/:id/posts/:slug", &post_cb },
+        { YMO_HTTP_ROUTE_GET, "/static/*path", &static_cb },
+        { YMO_HTTP_ROUTE_GET, "/a/:x/c", &backtrack_cb },
+        { YMO_HTTP_ROUTE_GET, "/a/b/d", &exact_cb },
+    };
+
+    ymo_proto_t* proto = ymo_proto_http_create(
+            NULL, &fallback_cb, NULL, NULL, NULL, NULL, 0);
+    ymo_http_router_t* router = ymo_http_router_create();
+    if( !router ) {
+        return -1;
+    }
+
+    for( size_t i = 0; i < sizeof(routes)/sizeof(routes[0]); i++ ) {
+        if( ymo_http_router_add(router, routes[i].methods,
+                    routes[i].pattern, routes[i].cb) ) {
+            return -1;
+        }
+    }
+
+    char pattern[64];
+    for( int i = 0; i < NO_MANY; i++ ) {
+        snprintf(pattern, sizeof(pattern), "/api/v%i/item%i/:id", i % 3, i);
+        if( ymo_http_router_add(
+                    router, YMO_HTTP_ROUTE_GET, pattern, &many_cb) ) {
+            return -1;
+        }
+    }
+
+    if( ymo_http_set_router(proto, router) ) {
+        return -1;
+    }
+    test_server = test_server_create(proto);
+    return 0;
+}
+
+
+static int cleanup(void)
+{
+    ymo_proto_http_cleanup(test_server->proto, test_server->server);
+    ymo_server_free(test_server->server);
+    YMO_FREE(test_server);
+    return 0;
+}
+
+
+YMO_TAP_RUN(&setup_suite, NULL, &cleanup,
+        YMO_TAP_TEST_FN(test_router_static),
+        YMO_TAP_TEST_FN(test_router_params),
+        YMO_TAP_TEST_FN(test_router_wildcard),
+        YMO_TAP_TEST_FN(test_router_methods),
+        YMO_TAP_TEST_FN(test_router_add),
+        YMO_TAP_TEST_FN(test_router_many),
+        YMO_TAP_TEST_END()
+        )
+
@@ -0,0 +1,307 @@
+/*=============================================================================
+ * test/test_http_scan: vectorized HTTP scanner tests
+ *
+ * Copyright (c) 2014 Andrew Canaday
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *===========================================================================*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "yimmo_config.h"
+#include "yimmo.h"
+#include "ymo_log.h"
+#include "core/ymo_tap.h"
+
+#include "ymo_http.h"
+#include "ymo_http_exchange.h"
+#include "ymo_http_parse.h"
+#include "ymo_http_scan.h"
+
+#define SCAN_BUF_MAX 96
+
+static const char* TEST_REQUEST =
+    "GET /some/longish/path/to/a/resource.html?q=simd&page=2#frag HTTP/1.1\r\n"
+    "Host: www.example.com\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64) Gecko/20100101 Firefox/118.0\r\n"
+    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\n"
+    "Accept-Language: en-US,en;q=0.5\r\n"
+    "X-Tabbed-Value: a\tb\r\n"
+    "Connection: keep-alive\r\n"
+    "\r\n";
+
+
+/*-------------------------------------------------------------*
+ * Reference implementations:
+ *-------------------------------------------------------------*/
+static int is_uri_stop(uint8_t c)
+{
+    return c <= ' ' || c == '#' || c == '?' || c == 0x7f;
+}
+
+
+static int is_hdr_name_stop(uint8_t c)
+{
+    return !((c >= '0' && c <= '9')
+            || (c >= 'A' && c <= 'Z')
+            || (c >= 'a' && c <= 'z')
+            || c == '-');
+}
+
+
+static int is_hdr_value_stop(uint8_t c)
+{
+    return (c < ' ' && c != '\t') || c == 0x7f;
+}
+
+
+static int is_query_stop(uint8_t c)
+{
+    return !c || c == '%' || c == '&' || c == '+' || c == '=';
+}
+
+
+static int is_path_stop(uint8_t c)
+{
+    return !c || c == '%' || c == '/';
+}
+
+
+static size_t ref_scan(const char* buf, size_t len, int (*is_stop)(uint8_t))
+{
+    size_t i;
+    for( i = 0; i < len && !is_stop((uint8_t)buf[i]); i++ );
+    return i;
+}
+
+
+/* Feed the request to the parser in chunk_len pieces, as the protocol read
+ * callback would:
+ */
+static ymo_status_t parse_chunked(
+        ymo_http_exchange_t* exchange, const char* r_data, size_t chunk_len)
+{
+    const char* end = r_data + strlen(r_data);
+
+    exchange->state = HTTP_STATE_REQUEST_METHOD;
+    while( r_data < end ) {
+        size_t len = YMO_MIN(chunk_len, (size_t)(end - r_data));
+        do {
+            ssize_t n;
+            switch( exchange->state ) {
+                case HTTP_STATE_REQUEST_METHOD:
+                case HTTP_STATE_REQUEST_URI_PATH:
+                case HTTP_STATE_REQUEST_QUERY:
+                case HTTP_STATE_REQUEST_FRAGMENT:
+                case HTTP_STATE_REQUEST_VERSION:
+                    n = ymo_parse_http_request_line(exchange, r_data, len);
+                    break;
+                case HTTP_STATE_CRLF:
+                    n = ymo_parse_http_crlf(exchange, r_data, len);
+                    break;
+                case HTTP_STATE_HEADER_NAME:
+                case HTTP_STATE_HEADER_VALUE_LEADING_SPACE:
+                case HTTP_STATE_HEADER_VALUE:
+                    n = ymo_parse_http_headers(NULL, exchange, r_data, len);
+                    break;
+                case HTTP_STATE_HEADERS_COMPLETE:
+                    return YMO_OKAY;
+                default:
+                    return EINVAL;
+            }
+
+            if( n < 0 ) {
+                return errno;
+            }
+            r_data += n;
+            len -= n;
+        } while( len );
+    }
+    return exchange->state == HTTP_STATE_HEADERS_COMPLETE ? YMO_OKAY : EAGAIN;
+}
+
+
+/*-------------------------------------------------------------*
+ * Tests:
+ *-------------------------------------------------------------*/
+static int test_scan_matches_reference(void)
+{
+    const ymo_http_scanner_t* scanner;
+    char buf[SCAN_BUF_MAX];
+    size_t idx;
+
+    for( idx = 0; (scanner = ymo_http_scan_impl(idx)); idx++ )
+    {
+        ymo_log_debug("Checking \"%s\" scanner", scanner->name);
+        srand(0x59);
+
+        /* Mostly printable, with the occasional stop byte, at every
+         * length/offset so we hit every block/tail boundary: */
+        for( int trial = 0; trial < 64; trial++ ) {
+            for( size_t i = 0; i < SCAN_BUF_MAX; i++ ) {
+                buf[i] = (rand() % 48) ? (char)('a' + rand() % 26)
+                    : (char)(rand() & 0xff);
+            }
+
+            for( size_t off = 0; off < 8; off++ ) {
+                for( size_t len = 0; len + off <= SCAN_BUF_MAX; len++ ) {
+                    const char* p = buf + off;
+                    size_t r_uri = scanner->uri(p, len);
+                    size_t r_name = scanner->hdr_name(p, len);
+                    size_t r_value = scanner->hdr_value(p, len);
+                    size_t r_query = scanner->query(p, len);
+                    size_t r_path = scanner->path(p, len);
+
+                    /* The scalar scanner never skips anything: */
+                    if( !strcmp(scanner->name, "scalar") ) {
+                        ymo_assert(r_uri == 0);
+                        ymo_assert(r_name == 0);
+                        ymo_assert(r_value == 0);
+                        ymo_assert(r_query == 0);
+                        ymo_assert(r_path == 0);
+                        continue;
+                    }
+                    ymo_assert(r_uri == ref_scan(p, len, is_uri_stop));
+                    ymo_assert(r_name == ref_scan(p, len, is_hdr_name_stop));
+                    ymo_assert(r_value == ref_scan(p, len, is_hdr_value_stop));
+                    ymo_assert(r_query == ref_scan(p, len, is_query_stop));
+                    ymo_assert(r_path == ref_scan(p, len, is_path_stop));
+                }
+            }
+        }
+    }
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int test_scan_every_byte(void)
+{
+    const ymo_http_scanner_t* scanner;
+    char buf[SCAN_BUF_MAX];
+    size_t idx;
+
+    for( idx = 0; (scanner = ymo_http_scan_impl(idx)); idx++ )
+    {
+        if( !strcmp(scanner->name, "scalar") ) {
+            continue;
+        }
+
+        /* Every byte value, at every position in the block: */
+        for( int c = 0; c < 256; c++ ) {
+            for( size_t pos = 0; pos < 40; pos++ ) {
+                memset(buf, 'x', sizeof(buf));
+                buf[pos] = (char)c;
+                size_t len = sizeof(buf);
+                size_t expect;
+
+                expect = is_uri_stop((uint8_t)c) ? pos : len;
+                ymo_assert(scanner->uri(buf, len) == expect);
+                expect = is_hdr_name_stop((uint8_t)c) ? pos : len;
+                ymo_assert(scanner->hdr_name(buf, len) == expect);
+                expect = is_hdr_value_stop((uint8_t)c) ? pos : len;
+                ymo_assert(scanner->hdr_value(buf, len) == expect);
+                expect = is_query_stop((uint8_t)c) ? pos : len;
+                ymo_assert(scanner->query(buf, len) == expect);
+                expect = is_path_stop((uint8_t)c) ? pos : len;
+                ymo_assert(scanner->path(buf, len) == expect);
+            }
+        }
+    }
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int test_parse_split_input(void)
+{
+    const ymo_http_scanner_t* scanner;
+    size_t idx;
+    size_t r_len = strlen(TEST_REQUEST);
+
+    ymo_http_exchange_t* exchange = ymo_http_exchange_create();
+    ymo_assert(exchange != NULL);
+
+    for( idx = 0; (scanner = ymo_http_scan_impl(idx)); idx++ )
+    {
+        ymo_assert(ymo_http_scan_select(scanner->name) == YMO_OKAY);
+        ymo_assert_str_eq(ymo_http_scan_name(), scanner->name);
+
+        for( size_t chunk_len = 1; chunk_len <= r_len; chunk_len++ ) {
+            ymo_http_exchange_reset(exchange);
+            ymo_assert(parse_chunked(
+                        exchange, TEST_REQUEST, chunk_len) == YMO_OKAY);
+
+            ymo_http_request_t* request = &exchange->request;
+            ymo_assert_str_eq(request->method, "GET");
+            ymo_assert_str_eq(request->uri,
+                    "/some/longish/path/to/a/resource.html");
+            ymo_assert_str_eq(request->query, "q=simd&page=2");
+            ymo_assert_str_eq(request->fragment, "frag");
+            ymo_assert_str_eq(request->version, "HTTP/1.1");
+            ymo_assert_str_eq(
+                    ymo_http_hdr_table_get(&request->headers, "host"),
+                    "www.example.com");
+            ymo_assert_str_eq(
+                    ymo_http_hdr_table_get(&request->headers, "user-agent"),
+                    "Mozilla/5.0 (X11; Linux x86_64) Gecko/20100101 Firefox/118.0");
+            ymo_assert_str_eq(
+                    ymo_http_hdr_table_get(&request->headers, "x-tabbed-value"),
+                    "a\tb");
+            ymo_assert(request->flags & YMO_HTTP_FLAG_REQUEST_KEEPALIVE);
+        }
+    }
+
+    ymo_http_exchange_free(exchange);
+    ymo_assert(ymo_http_scan_select("not-a-scanner") == ENOTSUP);
+    ymo_assert(ymo_http_scan_select(NULL) == YMO_OKAY);
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int test_parse_bad_header_name(void)
+{
+    const ymo_http_scanner_t* scanner;
+    size_t idx;
+    const char* r_data =
+        "GET / HTTP/1.1\r\n"
+        "Some-Long-Header-Name-Over-Sixteen-Bytes@Bad: nope\r\n"
+        "\r\n";
+
+    ymo_http_exchange_t* exchange = ymo_http_exchange_create();
+    ymo_assert(exchange != NULL);
+
+    for( idx = 0; (scanner = ymo_http_scan_impl(idx)); idx++ )
+    {
+        ymo_assert(ymo_http_scan_select(scanner->name) == YMO_OKAY);
+        ymo_http_exchange_reset(exchange);
+        ymo_assert(parse_chunked(
+                    exchange, r_data, strlen(r_data)) == EBADMSG);
+    }
+
+    ymo_http_exchange_free(exchange);
+    ymo_assert(ymo_http_scan_select(NULL) == YMO_OKAY);
+    YMO_TAP_PASS(__func__);
+}
+
+
+YMO_TAP_RUN(YMO_TAP_NO_INIT(),
+        YMO_TAP_TEST_FN(test_scan_matches_reference),
+        YMO_TAP_TEST_FN(test_scan_every_byte),
+        YMO_TAP_TEST_FN(test_parse_split_input),
+        YMO_TAP_TEST_FN(test_parse_bad_header_name),
+        YMO_TAP_TEST_END()
+        )
+
+
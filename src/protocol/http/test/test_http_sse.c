@@ -0,0 +1,332 @@
+/*=============================================================================
+ * test/test_http_sse: Tests for Server-Sent Events.
+ *
+ * Copyright (c) 2014 Andrew Canaday
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *===========================================================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "yimmo_config.h"
+#include "yimmo.h"
+#include "ymo_log.h"
+#include "core/ymo_tap.h"
+#include "core/ymo_proto.h"
+#include "core/ymo_test_proto.h"
+
+#include "ymo_http_test.h"
+
+#include "ymo_http.h"
+#include "ymo_proto_http.h"
+#include "ymo_http_response.h"
+#include "ymo_http_sse.h"
+
+#define NO_CONNS 3
+#define RECV_BUF_SIZE 65536
+
+static const char* req_news =
+    "GET /news HTTP/1.1\r\n"
+    "Host: example.com\r\n"
+    "Accept: text/event-stream\r\n"
+    "\r\n";
+
+static const char* req_sports =
+    "GET /sports HTTP/1.1\r\n"
+    "Host: example.com\r\n"
+    "\r\n";
+
+static const char* req_replay =
+    "GET /news HTTP/1.1\r\n"
+    "Host: example.com\r\n"
+    "Last-Event-ID: 4\r\n"
+    "\r\n";
+
+static const char* req_1_0 =
+    "GET /news HTTP/1.0\r\n"
+    "Host: example.com\r\n"
+    "\r\n";
+
+static ymo_test_conn_t* conns[NO_CONNS];
+static ymo_http_response_t* responses[NO_CONNS];
+static size_t no_responses;
+static char recv_buf[RECV_BUF_SIZE];
+
+static ymo_http_sse_hub_t* hub = NULL;
+static ymo_http_sse_channel_t* news = NULL;
+static ymo_http_sse_channel_t* sports = NULL;
+
+
+/*---------------------------------------------------------------*
+ * Handler:
+ *---------------------------------------------------------------*/
+static ymo_status_t http_cb(
+        ymo_http_session_t* session,
+        ymo_http_request_t* request,
+        ymo_http_response_t* response,
+        void* user)
+{
+    responses[no_responses++] = response;
+    return ymo_http_sse_subscribe(
+            strcmp(request->uri, "/sports") ? news : sports,
+            request, response);
+}
+
+
+/*---------------------------------------------------------------*
+ * Utilities:
+ *---------------------------------------------------------------*/
+static ymo_test_conn_t* open_conn(const char* request)
+{
+    ymo_test_conn_t* test_conn = http_conn_open();
+    http_conn_send(test_conn, request, strlen(request), 0);
+    return test_conn;
+}
+
+
+/* Flush the connection and return what it sent: */
+static const char* client_recv(ymo_test_conn_t* test_conn)
+{
+    http_conn_recv(test_conn, recv_buf, sizeof(recv_buf));
+    return recv_buf;
+}
+
+
+/*---------------------------------------------------------------*
+ * Tests:
+ *---------------------------------------------------------------*/
+static int test_subscribe(void)
+{
+    conns[0] = open_conn(req_news);
+    ymo_assert(no_responses == 1);
+    ymo_assert(ymo_http_sse_channel_subscribers(news) == 1);
+
+    const char* out = client_recv(conns[0]);
+    ymo_assert(!strncmp(out, "HTTP/1.1 200 OK\r\n", 17));
+    ymo_assert(strstr(out, "Content-Type: text/event-stream\r\n") != NULL);
+    ymo_assert(strstr(out, "Cache-Control: no-cache\r\n") != NULL);
+    ymo_assert(strstr(out, "Transfer-Encoding: Chunked\r\n") != NULL);
+    ymo_assert(strstr(out, "\r\n\r\n3\r\n:\n\n\r\n") != NULL);
+
+    /* Line breaks split data lines: */
+    ymo_assert(ymo_http_sse_publish(
+                news, "headline", "one\ntwo\r\nthree\rfour", 19) == YMO_OKAY);
+    out = client_recv(conns[0]);
+    ymo_assert(strstr(out,
+                "id: 1\n"
+                "event: headline\n"
+                "data: one\n"
+                "data: two\n"
+                "data: three\n"
+                "data: four\n"
+                "\n") != NULL);
+
+    ymo_assert(ymo_http_sse_publish(news, NULL, "", 0) == YMO_OKAY);
+    out = client_recv(conns[0]);
+    ymo_assert(strstr(out, "\r\nid: 2\ndata: \n\n\r\n") != NULL);
+
+    ymo_assert(ymo_http_sse_publish(news, "bad\nname", "x", 1) == EINVAL);
+
+    http_conn_close(conns[0]);
+    ymo_assert(ymo_http_sse_channel_subscribers(news) == 0);
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int test_fanout(void)
+{
+    for( size_t i = 0; i < NO_CONNS; i++ ) {
+        conns[i] = open_conn(req_news);
+        client_recv(conns[i]);
+    }
+    ymo_assert(ymo_http_sse_channel_subscribers(news) == NO_CONNS);
+
+    /* One copy of the encoded event, queued on every response: */
+    ymo_assert(ymo_http_sse_publish(news, NULL, "hello", 5) == YMO_OKAY);
+    ymo_assert(news->ring_len == 1);
+    ymo_assert(news->ring[0]->refs == NO_CONNS + 1);
+    for( size_t i = 0; i < NO_CONNS; i++ ) {
+        ymo_assert(responses[i]->body_tail->data == news->ring[0]->data);
+    }
+
+    for( size_t i = 0; i < NO_CONNS; i++ ) {
+        const char* out = client_recv(conns[i]);
+        ymo_assert(strstr(out, "id: 1\ndata: hello\n\n") != NULL);
+    }
+    ymo_assert(news->ring[0]->refs == 1);
+
+    for( size_t i = 0; i < NO_CONNS; i++ ) {
+        http_conn_close(conns[i]);
+    }
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int test_replay(void)
+{
+    char data[2] = "0";
+    ymo_http_sse_channel_set_retry(news, 2500);
+    for( size_t i = 1; i <= 6; i++ ) {
+        data[0] = '0' + i;
+        ymo_assert(ymo_http_sse_publish(news, NULL, data, 1) == YMO_OKAY);
+    }
+
+    /* The ring holds events 3-6: */
+    conns[0] = open_conn(req_replay);
+    const char* out = client_recv(conns[0]);
+    ymo_assert(strstr(out, "retry: 2500\n\n") != NULL);
+    ymo_assert(strstr(out, "id: 4\n") == NULL);
+    ymo_assert(strstr(out, "id: 5\ndata: 5\n\n") != NULL);
+    ymo_assert(strstr(out, "id: 6\ndata: 6\n\n") != NULL);
+    http_conn_close(conns[0]);
+
+    /* Fresh subscribers only get new events: */
+    conns[0] = open_conn(req_news);
+    out = client_recv(conns[0]);
+    ymo_assert(strstr(out, "id: ") == NULL);
+    http_conn_close(conns[0]);
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int test_keepalive(void)
+{
+    conns[0] = open_conn(req_news);
+    conns[1] = open_conn(req_sports);
+    client_recv(conns[0]);
+    client_recv(conns[1]);
+
+    /* Both just got their first write: */
+    ymo_assert(ymo_http_sse_hub_tick(hub) == 0);
+
+    /* Then nothing, for a whole tick: */
+    ymo_assert(ymo_http_sse_hub_tick(hub) == 2);
+    ymo_assert(!strcmp(client_recv(conns[0]), "3\r\n:\n\n\r\n"));
+    ymo_assert(!strcmp(client_recv(conns[1]), "3\r\n:\n\n\r\n"));
+
+    /* Only the idle subscriber is visited: */
+    ymo_assert(ymo_http_sse_publish(sports, NULL, "goal", 4) == YMO_OKAY);
+    ymo_assert(hub->k_tail == responses[1]->sse_sub);
+    ymo_assert(ymo_http_sse_hub_tick(hub) == 1);
+    ymo_assert(!strcmp(client_recv(conns[0]), "3\r\n:\n\n\r\n"));
+    ymo_assert(strstr(client_recv(conns[1]), "data: goal\n") != NULL);
+
+    http_conn_close(conns[0]);
+    http_conn_close(conns[1]);
+    ymo_assert(hub->k_head == NULL && hub->k_tail == NULL);
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int test_slow_subscriber(void)
+{
+    char data[1024];
+    memset(data, 'x', sizeof(data));
+    conns[0] = open_conn(req_news);
+    conns[1] = open_conn(req_news);
+    client_recv(conns[1]);
+
+    /* conns[0] never reads; it's cut off at the high water mark: */
+    size_t i;
+    for( i = 0; i < 128 && ymo_http_sse_channel_subscribers(news) == 2; i++ ) {
+        ymo_assert(ymo_http_sse_publish(
+                    news, NULL, data, sizeof(data)) == YMO_OKAY);
+        client_recv(conns[1]);
+    }
+    ymo_assert(ymo_http_sse_channel_subscribers(news) == 1);
+    ymo_assert(responses[0]->sse_sub == NULL);
+    ymo_assert(ymo_http_response_finished(responses[0]));
+    ymo_assert(i * sizeof(data) > YMO_HTTP_HIGH_WATER_DEFAULT);
+    ymo_assert(responses[1]->sse_sub != NULL);
+
+    http_conn_close(conns[0]);
+    http_conn_close(conns[1]);
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int test_channel_free(void)
+{
+    conns[0] = open_conn(req_sports);
+    client_recv(conns[0]);
+    ymo_http_sse_channel_free(sports);
+    sports = NULL;
+
+    /* The stream is finished: */
+    const char* out = client_recv(conns[0]);
+    ymo_assert(!strcmp(out, "0\r\n\r\n"));
+    http_conn_close(conns[0]);
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int test_http_1_0(void)
+{
+    conns[0] = open_conn(req_1_0);
+    ymo_assert(ymo_http_sse_channel_subscribers(news) == 0);
+    const char* out = client_recv(conns[0]);
+    ymo_assert(strstr(out, " 505 HTTP Version Not Supported\r\n") != NULL);
+    http_conn_close(conns[0]);
+    YMO_TAP_PASS(__func__);
+}
+
+
+/*---------------------------------------------------------------*
+ * Setup/Cleanup:
+ *---------------------------------------------------------------*/
+static int setup_suite(void)
+{
+    ymo_proto_t* proto = ymo_proto_http_create(
+            NULL, &http_cb, NULL, NULL, NULL, NULL, 0);
+    test_server = test_server_create(proto);
+    return 0;
+}
+
+
+static int setup_test(void)
+{
+    /* Fresh hub for each test: */
+    ymo_http_sse_hub_free(hub);
+    hub = ymo_http_sse_hub_create(NULL, 0);
+    news = ymo_http_sse_channel_create(hub, 4);
+    sports = ymo_http_sse_channel_create(hub, 0);
+    no_responses = 0;
+    return 0;
+}
+
+
+static int cleanup(void)
+{
+    ymo_http_sse_hub_free(hub);
+    ymo_proto_http_cleanup(test_server->proto, test_server->server);
+    ymo_server_free(test_server->server);
+    YMO_FREE(test_server);
+    return 0;
+}
+
+
+YMO_TAP_RUN(&setup_suite, &setup_test, &cleanup,
+        YMO_TAP_TEST_FN(test_subscribe),
+        YMO_TAP_TEST_FN(test_fanout),
+        YMO_TAP_TEST_FN(test_replay),
+        YMO_TAP_TEST_FN(test_keepalive),
+        YMO_TAP_TEST_FN(test_slow_subscriber),
+        YMO_TAP_TEST_FN(test_channel_free),
+        YMO_TAP_TEST_FN(test_http_1_0),
+        YMO_TAP_TEST_END()
+        )
@@ -0,0 +1,467 @@
+/*=============================================================================
+ * test/test_http_static: Static file handler tests
+ *
+ * Copyright (c) 2014 Andrew Canaday
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *===========================================================================*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/stat.h>
+
+#include "yimmo_config.h"
+#include "yimmo.h"
+#include "ymo_log.h"
+#include "core/ymo_tap.h"
+#include "core/ymo_proto.h"
+#include "core/ymo_test_proto.h"
+
+#include "ymo_http_test.h"
+
+#include "ymo_http.h"
+#include "ymo_proto_http.h"
+#include "ymo_http_static.h"
+
+#define IO_BUF_SIZE 8192
+
+#define HELLO     "Hello, world!\n"
+#define HELLO_LEN (sizeof(HELLO)-1)
+
+static ymo_http_static_t* handler = NULL;
+static char root[PATH_MAX];
+
+static char in[IO_BUF_SIZE];
+static size_t in_len;
+
+
+/*---------------------------------------------------------------*
+ * Handler:
+ *---------------------------------------------------------------*/
+static ymo_status_t http_cb(
+        ymo_http_session_t* session,
+        ymo_http_request_t* request,
+        ymo_http_response_t* response,
+        void* user)
+{
+    ymo_status_t status = ymo_http_static_serve(handler, request, response);
+    if( status == ENOENT ) {
+        /* Not ours: */
+        ymo_http_response_set_status(response, YMO_HTTP_GONE);
+        ymo_http_response_finish(response);
+        return YMO_OKAY;
+    }
+    return status;
+}
+
+
+/*---------------------------------------------------------------*
+ * Utilities:
+ *---------------------------------------------------------------*/
+static void put_file(const char* name, const char* data)
+{
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", root, name);
+    FILE* f = fopen(path, "w");
+    fputs(data, f);
+    fclose(f);
+}
+
+
+static void rm_file(const char* name)
+{
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", root, name);
+    remove(path);
+}
+
+
+/* Issue a request (with extra header lines) and read the response: */
+static void get(const char* method, const char* path, const char* headers)
+{
+    char req[1024];
+    size_t len = snprintf(req, sizeof(req),
+            "%s %s HTTP/1.1\r\n"
+            "Host: example.com\r\n"
+            "%s"
+            "\r\n", method, path, headers ? headers : "");
+
+    ymo_test_conn_t* test_conn = http_conn_open();
+    http_conn_send(test_conn, req, len, 0);
+    in_len = http_conn_recv(test_conn, in, sizeof(in));
+    http_conn_close(test_conn);
+}
+
+
+static int status_is(int status)
+{
+    char line[32];
+    snprintf(line, sizeof(line), "HTTP/1.1 %i ", status);
+    return !strncmp(in, line, strlen(line));
+}
+
+
+static const char* body(void)
+{
+    const char* p = strstr(in, "\r\n\r\n");
+    return p ? p + 4 : "";
+}
+
+
+/*---------------------------------------------------------------*
+ * Tests:
+ *---------------------------------------------------------------*/
+static int test_static_path(void)
+{
+    char path[64];
+    ymo_assert(ymo_http_static_path(path, sizeof(path), "/a//./b/") == 3);
+    ymo_assert_str_eq(path, "a/b");
+    ymo_assert(ymo_http_static_path(path, sizeof(path), "/%61%2Fb") == 3);
+    ymo_assert_str_eq(path, "a/b");
+    ymo_assert(ymo_http_static_path(path, sizeof(path), "/") == 0);
+    ymo_assert(ymo_http_static_path(path, sizeof(path), "/a/../b") < 0);
+    ymo_assert(ymo_http_static_path(path, sizeof(path), "/%2e%2E/b") < 0);
+    ymo_assert(ymo_http_static_path(path, sizeof(path), "/a%2F..") < 0);
+    ymo_assert(ymo_http_static_path(path, sizeof(path), "/a%00b") < 0);
+    ymo_assert(ymo_http_static_path(path, sizeof(path), "/a%zz") < 0);
+    ymo_assert(ymo_http_static_path(path, 4, "/abcd") < 0);
+    ymo_assert(errno == ENAMETOOLONG);
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int test_static_ranges(void)
+{
+    ymo_http_static_range_t r[YMO_HTTP_STATIC_MAX_RANGES];
+    ymo_assert(ymo_http_static_ranges(r, "bytes=0-4", 14) == 1);
+    ymo_assert(r[0].first == 0 && r[0].last == 4);
+    ymo_assert(ymo_http_static_ranges(r, "bytes=-6", 14) == 1);
+    ymo_assert(r[0].first == 8 && r[0].last == 13);
+    ymo_assert(ymo_http_static_ranges(r, "bytes=10-", 14) == 1);
+    ymo_assert(r[0].first == 10 && r[0].last == 13);
+    ymo_assert(ymo_http_static_ranges(r, "bytes=0-99", 14) == 1);
+    ymo_assert(r[0].last == 13);
+    ymo_assert(ymo_http_static_ranges(r, "bytes=0-1, 7-11", 14) == 2);
+    ymo_assert(r[1].first == 7 && r[1].last == 11);
+    ymo_assert(ymo_http_static_ranges(r, "bytes=20-30", 14) == 0);
+    ymo_assert(ymo_http_static_ranges(r, "bytes=20-30,0-0", 14) == 1);
+    ymo_assert(ymo_http_static_ranges(r, "bytes=5-4", 14) == -1);
+    ymo_assert(ymo_http_static_ranges(r, "lines=1-2", 14) == -1);
+    ymo_assert(ymo_http_static_ranges(r, "bytes=a-b", 14) == -1);
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int test_static_get(void)
+{
+    char value[128];
+    get("GET", "/static/hello.txt", NULL);
+    ymo_assert(status_is(200));
+    ymo_assert(http_header(in, "Content-Length", value, sizeof(value)));
+    ymo_assert_str_eq(value, "14");
+    ymo_assert(http_header(in, "Content-Type", value, sizeof(value)));
+    ymo_assert_str_eq(value, "text/plain; charset=utf-8");
+    ymo_assert(http_header(in, "ETag", value, sizeof(value)));
+    ymo_assert(http_header(in, "Last-Modified", value, sizeof(value)));
+    ymo_assert(http_header(in, "Accept-Ranges", value, sizeof(value)));
+    ymo_assert_str_eq(body(), HELLO);
+
+    /* HEAD gets the headers, only: */
+    get("HEAD", "/static/hello.txt", NULL);
+    ymo_assert(status_is(200));
+    ymo_assert(http_header(in, "Content-Length", value, sizeof(value)));
+    ymo_assert_str_eq(value, "14");
+    ymo_assert_str_eq(body(), "");
+
+    get("GET", "/static/missing.txt", NULL);
+    ymo_assert(status_is(404));
+    get("POST", "/static/hello.txt", NULL);
+    ymo_assert(status_is(405));
+    get("GET", "/other/hello.txt", NULL);
+    ymo_assert(status_is(410));
+    get("GET", "/statichello.txt", NULL);
+    ymo_assert(status_is(410));
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int test_static_traversal(void)
+{
+    get("GET", "/static/../secret.txt", NULL);
+    ymo_assert(status_is(400));
+    get("GET", "/static/%2e%2e/secret.txt", NULL);
+    ymo_assert(status_is(400));
+    get("GET", "/static/sub/%2E%2E%2Fhello.txt", NULL);
+    ymo_assert(status_is(400));
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int test_static_conditional(void)
+{
+    char etag[64];
+    char last_modified[64];
+    char hdrs[256];
+
+    get("GET", "/static/hello.txt", NULL);
+    ymo_assert(http_header(in, "ETag", etag, sizeof(etag)));
+    ymo_assert(http_header(in, "Last-Modified",
+            last_modified, sizeof(last_modified)));
+
+    snprintf(hdrs, sizeof(hdrs), "If-None-Match: \"x\", W/%s\r\n", etag);
+    get("GET", "/static/hello.txt", hdrs);
+    ymo_assert(status_is(304));
+    ymo_assert_str_eq(body(), "");
+
+    get("GET", "/static/hello.txt", "If-None-Match: \"nope\"\r\n");
+    ymo_assert(status_is(200));
+
+    snprintf(hdrs, sizeof(hdrs), "If-Modified-Since: %s\r\n", last_modified);
+    get("GET", "/static/hello.txt", hdrs);
+    ymo_assert(status_is(304));
+
+    get("GET", "/static/hello.txt",
+            "If-Modified-Since: Sun, 06 Nov 1994 08:49:37 GMT\r\n");
+    ymo_assert(status_is(200));
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int test_static_range(void)
+{
+    char value[128];
+    char hdrs[256];
+
+    get("GET", "/static/hello.txt", "Range: bytes=0-4\r\n");
+    ymo_assert(status_is(206));
+    ymo_assert(http_header(in, "Content-Range", value, sizeof(value)));
+    ymo_assert_str_eq(value, "bytes 0-4/14");
+    ymo_assert_str_eq(body(), "Hello");
+
+    get("GET", "/static/hello.txt", "Range: bytes=-7\r\n");
+    ymo_assert(status_is(206));
+    ymo_assert_str_eq(body(), "world!\n");
+
+    get("GET", "/static/hello.txt", "Range: bytes=100-\r\n");
+    ymo_assert(status_is(416));
+    ymo_assert(http_header(in, "Content-Range", value, sizeof(value)));
+    ymo_assert_str_eq(value, "bytes */14");
+
+    /* Stale If-Range: the whole thing. */
+    get("GET", "/static/hello.txt",
+            "Range: bytes=0-4\r\nIf-Range: \"stale\"\r\n");
+    ymo_assert(status_is(200));
+    ymo_assert_str_eq(body(), HELLO);
+
+    get("GET", "/static/hello.txt", NULL);
+    ymo_assert(http_header(in, "ETag", value, sizeof(value)));
+    snprintf(hdrs, sizeof(hdrs), "Range: bytes=7-11\r\nIf-Range: %s\r\n",
+            value);
+    get("GET", "/static/hello.txt", hdrs);
+    ymo_assert(status_is(206));
+    ymo_assert_str_eq(body(), "world");
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int test_static_multi_range(void)
+{
+    char value[128];
+    get("GET", "/static/hello.txt", "Range: bytes=0-4,7-11\r\n");
+    ymo_assert(status_is(206));
+    ymo_assert(http_header(in, "Content-Type", value, sizeof(value)));
+    ymo_assert(!strncmp(value, "multipart/byteranges; boundary=", 31));
+
+    char boundary[64];
+    snprintf(boundary, sizeof(boundary), "%s", value + 31);
+
+    char expected[512];
+    snprintf(expected, sizeof(expected),
+            "\r\n--%s\r\n"
+            "Content-Type: text/plain; charset=utf-8\r\n"
+            "Content-Range: bytes 0-4/14\r\n"
+            "\r\n"
+            "Hello"
+            "\r\n--%s\r\n"
+            "Content-Type: text/plain; charset=utf-8\r\n"
+            "Content-Range: bytes 7-11/14\r\n"
+            "\r\n"
+            "world"
+            "\r\n--%s--\r\n",
+            boundary, boundary, boundary);
+    ymo_assert_str_eq(body(), expected);
+
+    ymo_assert(http_header(in, "Content-Length", value, sizeof(value)));
+    ymo_assert((size_t)atoi(value) == strlen(expected));
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int test_static_precompressed(void)
+{
+    char value[128];
+    get("GET", "/static/app.js", "Accept-Encoding: gzip, br;q=0\r\n");
+    ymo_assert(status_is(200));
+    ymo_assert(http_header(in, "Content-Encoding", value, sizeof(value)));
+    ymo_assert_str_eq(value, "gzip");
+    ymo_assert(http_header(in, "Content-Type", value, sizeof(value)));
+    ymo_assert_str_eq(value, "text/javascript; charset=utf-8");
+    ymo_assert(http_header(in, "Vary", value, sizeof(value)));
+    ymo_assert_str_eq(body(), "<gzipped js>");
+
+    get("GET", "/static/app.js", "Accept-Encoding: br, gzip\r\n");
+    ymo_assert(http_header(in, "Content-Encoding", value, sizeof(value)));
+    ymo_assert_str_eq(value, "br");
+    ymo_assert_str_eq(body(), "<brotli js>");
+
+    get("GET", "/static/app.js", "Accept-Encoding: gzip;q=0, deflate\r\n");
+    ymo_assert(!http_header(in, "Content-Encoding", value, sizeof(value)));
+    ymo_assert_str_eq(body(), "<js>");
+
+    get("GET", "/static/app.js", NULL);
+    ymo_assert(!http_header(in, "Content-Encoding", value, sizeof(value)));
+    ymo_assert_str_eq(body(), "<js>");
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int test_static_index(void)
+{
+    char value[128];
+    get("GET", "/static/sub", NULL);
+    ymo_assert(status_is(301));
+    ymo_assert(http_header(in, "Location", value, sizeof(value)));
+    ymo_assert_str_eq(value, "/static/sub/");
+
+    get("GET", "/static/sub/", NULL);
+    ymo_assert(status_is(200));
+    ymo_assert(http_header(in, "Content-Type", value, sizeof(value)));
+    ymo_assert_str_eq(value, "text/html; charset=utf-8");
+    ymo_assert_str_eq(body(), "<html/>");
+
+    get("GET", "/static/", NULL);
+    ymo_assert(status_is(404));
+    YMO_TAP_PASS(__func__);
+}
+
+
+static int test_static_revalidate(void)
+{
+    ymo_assert(ymo_http_static_set_cache(handler, 2, 0) == YMO_OKAY);
+
+    put_file("changing.txt", "before");
+    get("GET", "/static/changing.txt", NULL);
+    ymo_assert_str_eq(body(), "before");
+
+    /* Replaced (new inode): */
+    rm_file("changing.txt");
+    put_file("changing.txt", "after!!");
+    get("GET", "/static/changing.txt", NULL);
+    ymo_assert_str_eq(body(), "after!!");
+
+    /* Removed: */
+    rm_file("changing.txt");
+    get("GET", "/static/changing.txt", NULL);
+    ymo_assert(status_is(404));
+
+    /* Evictions: */
+    get("GET", "/static/hello.txt", NULL);
+    ymo_assert_str_eq(body(), HELLO);
+    get("GET", "/static/app.js", NULL);
+    ymo_assert_str_eq(body(), "<js>");
+    get("GET", "/static/sub/", NULL);
+    ymo_assert_str_eq(body(), "<html/>");
+
+    ymo_assert(ymo_http_static_set_cache(
+                handler, YMO_HTTP_STATIC_CACHE_SIZE,
+                YMO_HTTP_STATIC_REVALIDATE) == YMO_OKAY);
+    YMO_TAP_PASS(__func__);
+}
+
+
+/*---------------------------------------------------------------*
+ * Setup/Cleanup:
+ *---------------------------------------------------------------*/
+static int setup_suite(void)
+{
+    const char* tmp = getenv("TMPDIR");
+    snprintf(root, sizeof(root), "%s/test_http_static.XXXXXX",
+            (tmp && *tmp) ? tmp : "/tmp");
+    if( !mkdtemp(root) ) {
+        return -1;
+    }
+
+    char sub[PATH_MAX];
+    snprintf(sub, sizeof(sub), "%s/sub", root);
+    mkdir(sub, 0700);
+    put_file("hello.txt", HELLO);
+    put_file("app.js", "<js>");
+    put_file("app.js.gz", "<gzipped js>");
+    put_file("app.js.br", "<brotli js>");
+    put_file("sub/index.html", "<html/>");
+
+    handler = ymo_http_static_create("/static/", root);
+    if( !handler ) {
+        return -1;
+    }
+
+    ymo_proto_t* proto = ymo_proto_http_create(
+            NULL, &http_cb, NULL, NULL, NULL, NULL, 0);
+    test_server = test_server_create(proto);
+    return 0;
+}
+
+
+static int setup_test(void)
+{
+    in_len = 0;
+    return 0;
+}
+
+
+static int cleanup(void)
+{
+    ymo_http_static_free(handler);
+    rm_file("hello.txt");
+    rm_file("app.js");
+    rm_file("app.js.gz");
+    rm_file("app.js.br");
+    rm_file("sub/index.html");
+    rm_file("sub");
+    rmdir(root);
+
+    ymo_proto_http_cleanup(test_server->proto, test_server->server);
+    ymo_server_free(test_server->server);
+    YMO_FREE(test_server);
+    return 0;
+}
+
+
+YMO_TAP_RUN(&setup_suite, &setup_test, &cleanup,
+        YMO_TAP_TEST_FN(test_static_path),
+        YMO_TAP_TEST_FN(test_static_ranges),
+        YMO_TAP_TEST_FN(test_static_get),
+        YMO_TAP_TEST_FN(test_static_traversal),
+        YMO_TAP_TEST_FN(test_static_conditional),
+        YMO_TAP_TEST_FN(test_static_range),
+        YMO_TAP_TEST_FN(test_static_multi_range),
+        YMO_TAP_TEST_FN(test_static_precompressed),
+        YMO_TAP_TEST_FN(test_static_index),
+        YMO_TAP_TEST_FN(test_static_revalidate),
+        YMO_TAP_TEST_END()
+        )
+
@@ -21,8 +21,10 @@
 #ifndef YMO_HTTP_TEST_H
 #define YMO_HTTP_TEST_H
 
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/socket.h>
@@ -30,6 +32,9 @@
 
 #include "core/ymo_tap.h"
 #include "yimmo.h"
+#include "ymo_attrs.h"
+#include "ymo_log.h"
+#include "ymo_util.h"
 #include "core/ymo_net.h"
 #include "core/ymo_proto.h"
 
@@ -40,169 +45,115 @@
 #include "ymo_proto_http.h"
 #include "ymo_http_response.h"
 
-#ifndef MAX_URI_LEN
-#  define MAX_URI_LEN       128
-#endif
-
-#ifndef MAX_REQUEST_SIZE
-#  define MAX_REQUEST_SIZE  1024
-#endif
-
-#ifndef MAX_RESPONSE_SIZE
-#  define MAX_RESPONSE_SIZE 1024
-#endif
-
-
-/*-------------------------------------------------------------*
- * Responses:
- *-------------------------------------------------------------*/
-
-static const char* TEST_HTTP_200 =
-    "HTTP/1.1 200 OK\r\n"
-    "content-type: text/plain\r\n"
-    "Content-Length: 2\r\n"
-    "\r\n"
-    "OK";
-
-static const char* TEST_HTTP_400 =
-    "HTTP/1.1 400 Bad Request\r\n"
-    "Content-Length: 0\r\n"
-    "Connection: Close\r\n"
-    "\r\n";
-
-static const char* TEST_HTTP_413 =
-    "HTTP/1.1 413 Request Entity Too Large\r\n"
-    "Content-Length: 0\r\n"
-    "Connection: Close\r\n"
-    "\r\n";
-
-static const char* TEST_HTTP_501 =
-    "HTTP/1.1 501 Not Implemented\r\n"
-    "Content-Length: 0\r\n"
-    "Connection: Close\r\n"
-    "\r\n";
-
 
 /*---------------------------------------------------------------*
- * Request Info:
+ * Connections:
+ *
+ * Test connections are driven through the protocol vtable, so they keep
+ * working after a connection changes protocols (e.g. h2c upgrade).
  *---------------------------------------------------------------*/
 ymo_test_server_t* test_server = NULL;
 
-struct {
-    int                   called;
-    char                  uri[MAX_URI_LEN];
-    char                  response_data[MAX_RESPONSE_SIZE+1];
-    ssize_t               bytes_sent;
-    ymo_http_hdr_table_t  headers;
-} r_info;
-
-static ymo_status_t http_ok_cb(
-        ymo_http_session_t* session,
-        ymo_http_request_t* request,
-        ymo_http_response_t* response,
-        void* user)
+/* Create a client connection with an HTTP session attached: */
+YMO_FUNC_UNUSED static ymo_test_conn_t* http_conn_open(void)
 {
-    r_info.called = 1;
-    strcpy(r_info.uri, request->uri);
-    ymo_http_response_insert_header(response, "content-type", "text/plain");
-    ymo_http_response_set_status_str(response, "200 OK");
-    ymo_bucket_t* content = YMO_BUCKET_FROM_REF("OK", 2);
-
-    ymo_http_response_body_append(response, content);
-    ymo_http_response_finish(response);
-    return YMO_OKAY;
-}
-
-
-/*-------------------------------------------------------------*
- * Utility:
- *
- * TODO: tidy these and move to reusable header.
- *-------------------------------------------------------------*/
+    ymo_test_conn_t* test_conn = test_conn_create(test_server);
+    if( !test_conn ) {
+        ymo_log_fatal(
+                "Unable to initialize test connection: %s",
+                strerror(errno));
+        return NULL;
+    }
 
-static void init_r_info(void)
-{
-    memset(&r_info, 0, sizeof(r_info));
-    ymo_http_hdr_table_init(&r_info.headers);
-    return;
+    test_conn->conn->proto_data = ymo_proto_http_conn_init(
+            test_server->proto_data, test_conn->conn);
+    if( !test_conn->conn->proto_data ) {
+        ymo_log_fatal(
+                "Unable to init session: %s", strerror(errno));
+    }
+    return test_conn;
 }
 
 
-static void reset_r_info(void)
+YMO_FUNC_UNUSED static void http_conn_close(ymo_test_conn_t* test_conn)
 {
-    ymo_http_hdr_table_clear(&r_info.headers);
-    init_r_info();
-    return;
+    ymo_proto_t* proto = test_conn->conn->proto;
+    proto->vtable.conn_cleanup_cb(
+            proto->data, test_conn->conn, test_conn->conn->proto_data);
+    test_conn_free(test_conn);
+    YMO_FREE(test_conn);
 }
 
 
-/* Return an HTTP protocol object that has no data and only
- * registers a HTTP complete callback handler:
+/* Hand len bytes of client data to the connection, at most chunk bytes at
+ * a time (or all at once, if chunk is 0), as the server would.
+ *
+ * A read callback returning 0 has handed the connection to another protocol
+ * (e.g. HTTP/2 prior knowledge); the rest goes to the new one.
+ *
+ * Returns 0 once all of it is consumed, or -1 if a read callback fails.
  */
-static ymo_proto_t* get_proto_http(ymo_http_cb_t http_cb)
+YMO_FUNC_UNUSED static ssize_t http_conn_send(
+        ymo_test_conn_t* test_conn, const char* data, size_t len, size_t chunk)
 {
-    if( http_cb == NULL ) {
-        http_cb = &http_ok_cb;
+    while( len ) {
+        ymo_proto_t* proto = test_conn->conn->proto;
+        ssize_t n = proto->vtable.read_cb(
+                proto->data, test_conn->conn, test_conn->conn->proto_data,
+                (char*)data, chunk ? YMO_MIN(len, chunk) : len);
+        if( n < 0 ) {
+            return n;
+        }
+        data += n;
+        len -= n;
     }
-
-    return ymo_proto_http_create(
-            NULL, http_cb, NULL, NULL, NULL, NULL);
+    return 0;
 }
 
 
-static ssize_t make_request(const char* r_data)
+/* Flush the connection, reading what it sends into buf as we go. The
+ * result is NUL-terminated; returns the number of bytes read.
+ */
+YMO_FUNC_UNUSED static size_t http_conn_recv(
+        ymo_test_conn_t* test_conn, char* buf, size_t buf_len)
 {
-    /* Create a client socket/connection: */
-    ymo_test_conn_t* test_conn = test_conn_create(test_server);
-    if( !test_conn ) {
-        ymo_log_fatal(
-                "Unable to initialize test connection: %s",
-                strerror(errno));
-        return -1;
-    }
+    ymo_status_t status;
+    size_t r_len = 0;
+    ssize_t n;
+
+    do {
+        ymo_proto_t* proto = test_conn->conn->proto;
+        status = proto->vtable.write_cb(
+                proto->data, test_conn->conn, test_conn->conn->proto_data,
+                test_conn->fd_send);
+        while( r_len < buf_len - 1
+                && (n = read(test_conn->fd_read, buf + r_len,
+                        buf_len - 1 - r_len)) > 0 ) {
+            r_len += n;
+        }
+    } while( status == YMO_WOULDBLOCK );
+
+    buf[r_len] = '\0';
+    return r_len;
+}
 
-    ymo_http_session_t* session = ymo_proto_http_conn_init(
-            test_server->proto_data, test_conn->conn);
 
-    if( !session ) {
-        ymo_log_fatal(
-                "Unable to init session: %s", strerror(errno));
-    }
-    test_conn->conn->proto_data = session;
-
-    /* We'll test the parser by instantiating a protocol object
-     * and invoking it's read callback, as if we were the
-     * server:
-     */
-    char request_buf[MAX_REQUEST_SIZE];
-    strncpy(request_buf, r_data, MAX_REQUEST_SIZE);
-    ssize_t r_val = ymo_proto_http_read(
-            test_server->proto_data, test_conn->conn,
-            session, request_buf, strlen(request_buf));
-
-
-    /* If all went okay, send the response by faking a write-ready event: */
-    if( r_val >= 0 ) {
-        ymo_proto_http_write(
-                test_server->proto_data,
-                test_conn->conn,
-                session, test_conn->fd_send);
-
-        r_info.bytes_sent = read(
-                test_conn->fd_read, r_info.response_data,
-                sizeof(r_info.response_data));
-    } else {
-        ymo_log_warning("Not writing due to: %s", strerror(r_val));
+/* Copy the value of the named header in response into value: */
+YMO_FUNC_UNUSED static int http_header(
+        const char* response, const char* name, char* value, size_t len)
+{
+    char match[64];
+    snprintf(match, sizeof(match), "\r\n%s: ", name);
+    const char* p = strstr(response, match);
+    const char* end_hdrs = strstr(response, "\r\n\r\n");
+    if( !p || p > end_hdrs ) {
+        return 0;
     }
-
-    /* Free the test protocol and return: */
-    ymo_proto_http_conn_cleanup(
-            test_server->proto_data, test_conn->conn, session);
-    test_conn_free(test_conn);
-    YMO_FREE(test_conn);
-    return r_val;
+    p += strlen(match);
+    const char* end = strstr(p, "\r\n");
+    snprintf(value, len, "%.*s", (int)(end - p), p);
+    return 1;
 }
 
 
 #endif /* YMO_HTTP_TEST_H */
-
@@ -0,0 +1,698 @@
+/*=============================================================================
+ *
+ * Copyright (c) 2014 Andrew Canaday
+ *
+ * This file is part of libyimmo (sometimes referred to as "yimmo" or "ymo").
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *===========================================================================*/
+
+#include "yimmo_config.h"
+
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+#include "yimmo.h"
+#include "ymo_log.h"
+#include "ymo_alloc.h"
+#include "ymo_http2_hpack.h"
+#include "ymo_http_hdr_table.h"
+
+/*---------------------------------------------------------------*
+ *  Static Table (RFC 7541, Appendix A):
+ *---------------------------------------------------------------*/
+#define HPACK_ENTRY(n, v, id) { n, sizeof(n)-1, v, sizeof(v)-1, id }
+
+static const struct {
+    const char*        name;
+    size_t             name_len;
+    const char*        value;
+    size_t             value_len;
+    ymo_http_hdr_id_t  h_id;
+} hpack_static[YMO_HPACK_STATIC_LEN+1] = {
+    HPACK_ENTRY("", "", YMO_HTTP_HID_NONE),
+    HPACK_ENTRY(":authority", "", YMO_HTTP_HID_NONE),
+    HPACK_ENTRY(":method", "GET", YMO_HTTP_HID_NONE),
+    HPACK_ENTRY(":method", "POST", YMO_HTTP_HID_NONE),
+    HPACK_ENTRY(":path", "/", YMO_HTTP_HID_NONE),
+    HPACK_ENTRY(":path", "/index.html", YMO_HTTP_HID_NONE),
+    HPACK_ENTRY(":scheme", "http", YMO_HTTP_HID_NONE),
+    HPACK_ENTRY(":scheme", "https", YMO_HTTP_HID_NONE),
+    HPACK_ENTRY(":status", "200", YMO_HTTP_HID_NONE),
+    HPACK_ENTRY(":status", "204", YMO_HTTP_HID_NONE),
+    HPACK_ENTRY(":status", "206", YMO_HTTP_HID_NONE),
+    HPACK_ENTRY(":status", "304", YMO_HTTP_HID_NONE),
+    HPACK_ENTRY(":status", "400", YMO_HTTP_HID_NONE),
+    HPACK_ENTRY(":status", "404", YMO_HTTP_HID_NONE),
+    HPACK_ENTRY(":status", "500", YMO_HTTP_HID_NONE),
+    HPACK_ENTRY("accept-charset", "", YMO_HTTP_HID_ACCEPT_CHARSET),
+    HPACK_ENTRY("accept-encoding", "gzip, deflate",
+            YMO_HTTP_HID_ACCEPT_ENCODING),
+    HPACK_ENTRY("accept-language", "", YMO_HTTP_HID_ACCEPT_LANGUAGE),
+    HPACK_ENTRY("accept-ranges", "", YMO_HTTP_HID_ACCEPT_RANGES),
+    HPACK_ENTRY("accept", "", YMO_HTTP_HID_ACCEPT),
+    HPACK_ENTRY("access-control-allow-origin", "",
+            YMO_HTTP_HID_ACCESS_CONTROL_ALLOW_ORIGIN),
+    HPACK_ENTRY("age", "", YMO_HTTP_HID_AGE),
+    HPACK_ENTRY("allow", "", YMO_HTTP_HID_ALLOW),
+    HPACK_ENTRY("authorization", "", YMO_HTTP_HID_AUTHORIZATION),
+    HPACK_ENTRY("cache-control", "", YMO_HTTP_HID_CACHE_CONTROL),
+    HPACK_ENTRY("content-disposition", "",
+            YMO_HTTP_HID_CONTENT_DISPOSITION),
+    HPACK_ENTRY("content-encoding", "", YMO_HTTP_HID_CONTENT_ENCODING),
+    HPACK_ENTRY("content-language", "", YMO_HTTP_HID_CONTENT_LANGUAGE),
+    HPACK_ENTRY("content-length", "", YMO_HTTP_HID_CONTENT_LENGTH),
+    HPACK_ENTRY("content-location", "", YMO_HTTP_HID_CONTENT_LOCATION),
+    HPACK_ENTRY("content-range", "", YMO_HTTP_HID_CONTENT_RANGE),
+    HPACK_ENTRY("content-type", "", YMO_HTTP_HID_CONTENT_TYPE),
+    HPACK_ENTRY("cookie", "", YMO_HTTP_HID_COOKIE),
+    HPACK_ENTRY("date", "", YMO_HTTP_HID_DATE),
+    HPACK_ENTRY("etag", "", YMO_HTTP_HID_ETAG),
+    HPACK_ENTRY("expect", "", YMO_HTTP_HID_EXPECT),
+    HPACK_ENTRY("expires", "", YMO_HTTP_HID_EXPIRES),
+    HPACK_ENTRY("from", "", YMO_HTTP_HID_FROM),
+    HPACK_ENTRY("host", "", YMO_HTTP_HID_HOST),
+    HPACK_ENTRY("if-match", "", YMO_HTTP_HID_IF_MATCH),
+    HPACK_ENTRY("if-modified-since", "", YMO_HTTP_HID_IF_MODIFIED_SINCE),
+    HPACK_ENTRY("if-none-match", "", YMO_HTTP_HID_IF_NONE_MATCH),
+    HPACK_ENTRY("if-range", "", YMO_HTTP_HID_IF_RANGE),
+    HPACK_ENTRY("if-unmodified-since", "",
+            YMO_HTTP_HID_IF_UNMODIFIED_SINCE),
+    HPACK_ENTRY("last-modified", "", YMO_HTTP_HID_LAST_MODIFIED),
+    HPACK_ENTRY("link", "", YMO_HTTP_HID_LINK),
+    HPACK_ENTRY("location", "", YMO_HTTP_HID_LOCATION),
+    HPACK_ENTRY("max-forwards", "", YMO_HTTP_HID_MAX_FORWARDS),
+    HPACK_ENTRY("proxy-authenticate", "", YMO_HTTP_HID_PROXY_AUTHENTICATE),
+    HPACK_ENTRY("proxy-authorization", "",
+            YMO_HTTP_HID_PROXY_AUTHORIZATION),
+    HPACK_ENTRY("range", "", YMO_HTTP_HID_RANGE),
+    HPACK_ENTRY("referer", "", YMO_HTTP_HID_REFERER),
+    HPACK_ENTRY("refresh", "", YMO_HTTP_HID_REFRESH),
+    HPACK_ENTRY("retry-after", "", YMO_HTTP_HID_RETRY_AFTER),
+    HPACK_ENTRY("server", "", YMO_HTTP_HID_SERVER),
+    HPACK_ENTRY("set-cookie", "", YMO_HTTP_HID_SET_COOKIE),
+    HPACK_ENTRY("strict-transport-security", "",
+            YMO_HTTP_HID_STRICT_TRANSPORT_SECURITY),
+    HPACK_ENTRY("transfer-encoding", "", YMO_HTTP_HID_TRANSFER_ENCODING),
+    HPACK_ENTRY("user-agent", "", YMO_HTTP_HID_USER_AGENT),
+    HPACK_ENTRY("vary", "", YMO_HTTP_HID_VARY),
+    HPACK_ENTRY("via", "", YMO_HTTP_HID_VIA),
+    HPACK_ENTRY("www-authenticate", "", YMO_HTTP_HID_WWW_AUTHENTICATE),
+};
+
+/* Static table name index, by standard header id (0 if there isn't one).
+ * This is what makes the encoder cheap: no string compares.
+ */
+static const uint8_t hpack_static_name[YMO_HTTP_HID_STD_MAX+1] = {
+    [YMO_HTTP_HID_ACCEPT_CHARSET] = 15,
+    [YMO_HTTP_HID_ACCEPT_ENCODING] = 16,
+    [YMO_HTTP_HID_ACCEPT_LANGUAGE] = 17,
+    [YMO_HTTP_HID_ACCEPT_RANGES] = 18,
+    [YMO_HTTP_HID_ACCEPT] = 19,
+    [YMO_HTTP_HID_ACCESS_CONTROL_ALLOW_ORIGIN] = 20,
+    [YMO_HTTP_HID_AGE] = 21,
+    [YMO_HTTP_HID_ALLOW] = 22,
+    [YMO_HTTP_HID_AUTHORIZATION] = 23,
+    [YMO_HTTP_HID_CACHE_CONTROL] = 24,
+    [YMO_HTTP_HID_CONTENT_DISPOSITION] = 25,
+    [YMO_HTTP_HID_CONTENT_ENCODING] = 26,
+    [YMO_HTTP_HID_CONTENT_LANGUAGE] = 27,
+    [YMO_HTTP_HID_CONTENT_LENGTH] = 28,
+    [YMO_HTTP_HID_CONTENT_LOCATION] = 29,
+    [YMO_HTTP_HID_CONTENT_RANGE] = 30,
+    [YMO_HTTP_HID_CONTENT_TYPE] = 31,
+    [YMO_HTTP_HID_COOKIE] = 32,
+    [YMO_HTTP_HID_DATE] = 33,
+    [YMO_HTTP_HID_ETAG] = 34,
+    [YMO_HTTP_HID_EXPECT] = 35,
+    [YMO_HTTP_HID_EXPIRES] = 36,
+    [YMO_HTTP_HID_FROM] = 37,
+    [YMO_HTTP_HID_HOST] = 38,
+    [YMO_HTTP_HID_IF_MATCH] = 39,
+    [YMO_HTTP_HID_IF_MODIFIED_SINCE] = 40,
+    [YMO_HTTP_HID_IF_NONE_MATCH] = 41,
+    [YMO_HTTP_HID_IF_RANGE] = 42,
+    [YMO_HTTP_HID_IF_UNMODIFIED_SINCE] = 43,
+    [YMO_HTTP_HID_LAST_MODIFIED] = 44,
+    [YMO_HTTP_HID_LINK] = 45,
+    [YMO_HTTP_HID_LOCATION] = 46,
+    [YMO_HTTP_HID_MAX_FORWARDS] = 47,
+    [YMO_HTTP_HID_PROXY_AUTHENTICATE] = 48,
+    [YMO_HTTP_HID_PROXY_AUTHORIZATION] = 49,
+    [YMO_HTTP_HID_RANGE] = 50,
+    [YMO_HTTP_HID_REFERER] = 51,
+    [YMO_HTTP_HID_REFRESH] = 52,
+    [YMO_HTTP_HID_RETRY_AFTER] = 53,
+    [YMO_HTTP_HID_SERVER] = 54,
+    [YMO_HTTP_HID_SET_COOKIE] = 55,
+    [YMO_HTTP_HID_STRICT_TRANSPORT_SECURITY] = 56,
+    [YMO_HTTP_HID_TRANSFER_ENCODING] = 57,
+    [YMO_HTTP_HID_USER_AGENT] = 58,
+    [YMO_HTTP_HID_VARY] = 59,
+    [YMO_HTTP_HID_VIA] = 60,
+    [YMO_HTTP_HID_WWW_AUTHENTICATE] = 61,
+};
+
+
+/*---------------------------------------------------------------*
+ *  Huffman Code (RFC 7541, Appendix B):
+ *---------------------------------------------------------------*/
+
+/* The HPACK Huffman code is canonical, so rather than a decode tree we
+ * keep the symbols ordered by (code length, symbol) and, for each code
+ * length, the first code of that length and where its symbols start.
+ */
+#define HUFF_LEN_MIN 5
+#define HUFF_LEN_MAX 30
+#define HUFF_EOS     256
+
+/* Symbols, ordered by code length, then value: */
+static const uint16_t huff_sym[257] = {
+     48,  49,  50,  97,  99, 101, 105, 111, 115, 116,  32,  37,
+     45,  46,  47,  51,  52,  53,  54,  55,  56,  57,  61,  65,
+     95,  98, 100, 102, 103, 104, 108, 109, 110, 112, 114, 117,
+     58,  66,  67,  68,  69,  70,  71,  72,  73,  74,  75,  76,
+     77,  78,  79,  80,  81,  82,  83,  84,  85,  86,  87,  89,
+    106, 107, 113, 118, 119, 120, 121, 122,  38,  42,  44,  59,
+     88,  90,  33,  34,  40,  41,  63,  39,  43, 124,  35,  62,
+      0,  36,  64,  91,  93, 126,  94, 125,  60,  96, 123,  92,
+    195, 208, 128, 130, 131, 162, 184, 194, 224, 226, 153, 161,
+    167, 172, 176, 177, 179, 209, 216, 217, 227, 229, 230, 129,
+    132, 133, 134, 136, 146, 154, 156, 160, 163, 164, 169, 170,
+    173, 178, 181, 185, 186, 187, 189, 190, 196, 198, 228, 232,
+    233,   1, 135, 137, 138, 139, 140, 141, 143, 147, 149, 150,
+    151, 152, 155, 157, 158, 165, 166, 168, 174, 175, 180, 182,
+    183, 188, 191, 197, 231, 239,   9, 142, 144, 145, 148, 159,
+    171, 206, 215, 225, 236, 237, 199, 207, 234, 235, 192, 193,
+    200, 201, 202, 205, 210, 213, 218, 219, 238, 240, 242, 243,
+    255, 203, 204, 211, 212, 214, 221, 222, 223, 241, 244, 245,
+    246, 247, 248, 250, 251, 252, 253, 254,   2,   3,   4,   5,
+      6,   7,   8,  11,  12,  14,  15,  16,  17,  18,  19,  20,
+     21,  23,  24,  25,  26,  27,  28,  29,  30,  31, 127, 220,
+    249,  10,  13,  22, 256,
+};
+
+/* First (i.e. lowest) code of each length: */
+static const uint32_t huff_first[HUFF_LEN_MAX+1] = {
+    0x00000000, 0x00000000, 0x00000000, 0x00000000,
+    0x00000000, 0x00000000, 0x00000014, 0x0000005c,
+    0x000000f8, 0x00000000, 0x000003f8, 0x000007fa,
+    0x00000ffa, 0x00001ff8, 0x00003ffc, 0x00007ffc,
+    0x00000000, 0x00000000, 0x00000000, 0x0007fff0,
+    0x000fffe6, 0x001fffdc, 0x003fffd2, 0x007fffd8,
+    0x00ffffea, 0x01ffffec, 0x03ffffe0, 0x07ffffde,
+    0x0fffffe2, 0x00000000, 0x3ffffffc,
+};
+
+/* Number of codes of each length: */
+static const uint16_t huff_count[HUFF_LEN_MAX+1] = {
+      0,   0,   0,   0,   0,  10,  26,  32,
+      6,   0,   5,   3,   2,   6,   2,   3,
+      0,   0,   0,   3,   8,  13,  26,  29,
+     12,   4,  15,  19,  29,   0,   4,
+};
+
+/* Offset into huff_sym of the first symbol of each length: */
+static const uint16_t huff_offset[HUFF_LEN_MAX+1] = {
+      0,   0,   0,   0,   0,   0,  10,  36,
+     68,   0,  74,  79,  82,  84,  90,  92,
+      0,   0,   0,  95,  98, 106, 119, 145,
+    174, 186, 190, 205, 224,   0, 253,
+};
+
+
+/* Decode a Huffman-coded string. Returns the decoded length, -1 if the input
+ * is malformed, or -2 if the output doesn't fit in out_len bytes.
+ */
+static ssize_t huff_decode(
+        const uint8_t* in, size_t len, char* out, size_t out_len)
+{
+    const uint8_t* end = in + len;
+    uint64_t bits = 0;  /* Left-aligned bit buffer */
+    unsigned nbits = 0;
+    size_t n = 0;
+
+    for( ;; )
+    {
+        while( nbits <= 56 && in < end ) {
+            bits |= (uint64_t)(*in++) << (56 - nbits);
+            nbits += 8;
+        }
+
+        if( !nbits ) {
+            break;
+        }
+
+        unsigned l;
+        uint32_t code = 0;
+        for( l = HUFF_LEN_MIN; l <= HUFF_LEN_MAX && l <= nbits; l++ )
+        {
+            code = (uint32_t)(bits >> (64 - l));
+            if( code - huff_first[l] < huff_count[l] ) {
+                break;
+            }
+        }
+
+        if( l > HUFF_LEN_MAX || l > nbits ) {
+            /* Whatever's left has to be padding: fewer than 8 bits, all of
+             * them set (i.e. a prefix of EOS). */
+            if( nbits < 8 && bits == (~(uint64_t)0 << (64 - nbits)) ) {
+                break;
+            }
+            return -1;
+        }
+
+        uint16_t sym = huff_sym[huff_offset[l] + (code - huff_first[l])];
+        if( sym == HUFF_EOS ) {
+            return -1;
+        }
+
+        if( n == out_len ) {
+            return -2;
+        }
+        out[n++] = (char)sym;
+        bits <<= l;
+        nbits -= l;
+    }
+    return (ssize_t)n;
+}
+
+
+/*---------------------------------------------------------------*
+ *  Dynamic Table:
+ *---------------------------------------------------------------*/
+#define ENTRY_SIZE(e) ((e)->name_len + (e)->value_len + YMO_HPACK_ENTRY_OVERHEAD)
+
+static inline size_t dyn_oldest(const ymo_hpack_decoder_t* dec)
+{
+    return (dec->newest + YMO_HPACK_DYNAMIC_MAX + 1 - dec->count)
+        % YMO_HPACK_DYNAMIC_MAX;
+}
+
+
+static void dyn_evict(ymo_hpack_decoder_t* dec, size_t max_size)
+{
+    while( dec->count && dec->size > max_size )
+    {
+        ymo_hpack_entry_t* entry = &dec->entries[dyn_oldest(dec)];
+        dec->size -= ENTRY_SIZE(entry);
+        YMO_FREE(entry->name);
+        entry->name = NULL;
+        --dec->count;
+    }
+}
+
+
+static ymo_status_t dyn_insert(
+        ymo_hpack_decoder_t* dec,
+        ymo_http_hdr_id_t h_id,
+        const char* name,
+        size_t name_len,
+        const char* value,
+        size_t value_len)
+{
+    size_t entry_size = name_len + value_len + YMO_HPACK_ENTRY_OVERHEAD;
+
+    /* An entry larger than the table just empties it (RFC 7541 §4.4): */
+    if( entry_size > dec->max_size ) {
+        dyn_evict(dec, 0);
+        return YMO_OKAY;
+    }
+
+    /* Copy first: the name may be a reference to an entry we're about
+     * to evict.
+     */
+    char* buf = YMO_ALLOC(name_len + value_len + 1);
+    if( !buf ) {
+        return ENOMEM;
+    }
+    memcpy(buf, name, name_len);
+    memcpy(buf + name_len, value, value_len);
+
+    dyn_evict(dec, dec->max_size - entry_size);
+    dec->newest = (dec->newest + 1) % YMO_HPACK_DYNAMIC_MAX;
+    ymo_hpack_entry_t* entry = &dec->entries[dec->newest];
+    entry->name = buf;
+    entry->name_len = name_len;
+    entry->value = buf + name_len;
+    entry->value_len = value_len;
+    entry->h_id = h_id;
+    dec->size += entry_size;
+    ++dec->count;
+    return YMO_OKAY;
+}
+
+
+/* Look up an index in the combined static/dynamic address space: */
+static ymo_status_t table_get(
+        const ymo_hpack_decoder_t* dec,
+        size_t idx,
+        ymo_http_hdr_id_t* h_id,
+        const char** name,
+        size_t* name_len,
+        const char** value,
+        size_t* value_len)
+{
+    if( !idx ) {
+        return EBADMSG;
+    }
+
+    if( idx <= YMO_HPACK_STATIC_LEN ) {
+        *h_id = hpack_static[idx].h_id;
+        *name = hpack_static[idx].name;
+        *name_len = hpack_static[idx].name_len;
+        *value = hpack_static[idx].value;
+        *value_len = hpack_static[idx].value_len;
+        return YMO_OKAY;
+    }
+
+    idx -= YMO_HPACK_STATIC_LEN + 1;
+    if( idx >= dec->count ) {
+        return EBADMSG;
+    }
+
+    const ymo_hpack_entry_t* entry = &dec->entries[
+        (dec->newest + YMO_HPACK_DYNAMIC_MAX - idx) % YMO_HPACK_DYNAMIC_MAX];
+    *h_id = entry->h_id;
+    *name = entry->name;
+    *name_len = entry->name_len;
+    *value = entry->value;
+    *value_len = entry->value_len;
+    return YMO_OKAY;
+}
+
+
+/*---------------------------------------------------------------*
+ *  Decoder:
+ *---------------------------------------------------------------*/
+void ymo_hpack_decoder_init(ymo_hpack_decoder_t* dec)
+{
+    dec->newest = YMO_HPACK_DYNAMIC_MAX - 1;
+    dec->count = 0;
+    dec->size = 0;
+    dec->max_size = YMO_HTTP2_HPACK_TABLE_SIZE;
+}
+
+
+void ymo_hpack_decoder_clear(ymo_hpack_decoder_t* dec)
+{
+    dyn_evict(dec, 0);
+}
+
+
+/* Integer with an n-bit prefix (RFC 7541 §5.1). *p < end, on entry. */
+static ymo_status_t decode_int(
+        const uint8_t** p, const uint8_t* end, int n, size_t* value)
+{
+    size_t mask = (1 << n) - 1;
+    size_t v = *(*p)++ & mask;
+    unsigned shift = 0;
+
+    if( v < mask ) {
+        *value = v;
+        return YMO_OKAY;
+    }
+
+    while( *p < end )
+    {
+        uint8_t b = *(*p)++;
+        v += (size_t)(b & 0x7f) << shift;
+        if( !(b & 0x80) ) {
+            *value = v;
+            return YMO_OKAY;
+        }
+
+        shift += 7;
+        if( shift > 28 ) {
+            break;
+        }
+    }
+    return EBADMSG;
+}
+
+
+/* String literal (RFC 7541 §5.2). Raw strings are returned by reference;
+ * Huffman-coded strings are decoded into buf. If buf is too small, *str is
+ * set to NULL and *len to the space required (at least).
+ */
+static ymo_status_t decode_str(
+        const uint8_t** p,
+        const uint8_t* end,
+        char* buf,
+        size_t buf_len,
+        const char** str,
+        size_t* len)
+{
+    size_t str_len;
+
+    if( *p >= end ) {
+        return EBADMSG;
+    }
+
+    int huffman = (**p & 0x80);
+    if( decode_int(p, end, 7, &str_len) != YMO_OKAY
+        || str_len > (size_t)(end - *p) ) {
+        return EBADMSG;
+    }
+
+    const uint8_t* data = *p;
+    *p += str_len;
+
+    if( !huffman ) {
+        *str = (const char*)data;
+        *len = str_len;
+        return YMO_OKAY;
+    }
+
+    ssize_t n = huff_decode(data, str_len, buf, buf_len);
+    if( n == -1 ) {
+        return EBADMSG;
+    }
+
+    if( n == -2 ) {
+        *str = NULL;
+        *len = buf_len + 1;
+    } else {
+        *str = buf;
+        *len = (size_t)n;
+    }
+    return YMO_OKAY;
+}
+
+
+ymo_status_t ymo_hpack_decode(
+        ymo_hpack_decoder_t* dec,
+        const uint8_t* in,
+        size_t len,
+        ymo_hpack_field_cb_t cb,
+        void* data)
+{
+    const uint8_t* p = in;
+    const uint8_t* end = in + len;
+    ymo_status_t r_val = YMO_OKAY;
+    ymo_status_t status;
+    int fields_seen = 0;
+
+    while( p < end )
+    {
+        ymo_http_hdr_id_t h_id = YMO_HTTP_HID_NONE;
+        const char* name;
+        size_t name_len;
+        const char* value;
+        size_t value_len;
+        size_t idx;
+        uint8_t b = *p;
+
+        /* Indexed header field: */
+        if( b & 0x80 ) {
+            if( decode_int(&p, end, 7, &idx) != YMO_OKAY
+                || table_get(dec, idx, &h_id,
+                    &name, &name_len, &value, &value_len) != YMO_OKAY ) {
+                return EBADMSG;
+            }
+
+            fields_seen = 1;
+            status = cb(data, h_id, name, name_len, value, value_len);
+            if( status != YMO_OKAY ) {
+                return status;
+            }
+            continue;
+        }
+
+        /* Dynamic table size update (only ahead of the first field): */
+        if( (b & 0xe0) == 0x20 ) {
+            if( fields_seen
+                || decode_int(&p, end, 5, &idx) != YMO_OKAY
+                || idx > YMO_HTTP2_HPACK_TABLE_SIZE ) {
+                return EBADMSG;
+            }
+            dec->max_size = idx;
+            dyn_evict(dec, idx);
+            continue;
+        }
+
+        /* Literal header field, with or without incremental indexing: */
+        int indexing = ((b & 0xc0) == 0x40);
+        if( decode_int(&p, end, indexing ? 6 : 4, &idx) != YMO_OKAY ) {
+            return EBADMSG;
+        }
+
+        size_t buf_used = 0;
+        if( idx ) {
+            if( table_get(dec, idx, &h_id,
+                        &name, &name_len, &value, &value_len) != YMO_OKAY ) {
+                return EBADMSG;
+            }
+        } else {
+            if( decode_str(&p, end, dec->str_buf, sizeof(dec->str_buf),
+                        &name, &name_len) != YMO_OKAY ) {
+                return EBADMSG;
+            }
+            if( name == dec->str_buf ) {
+                buf_used = name_len;
+            }
+            if( name ) {
+                h_id = ymo_http_hdr_std_id(name, name_len);
+            }
+        }
+
+        if( decode_str(&p, end,
+                    dec->str_buf + buf_used, sizeof(dec->str_buf) - buf_used,
+                    &value, &value_len) != YMO_OKAY ) {
+            return EBADMSG;
+        }
+
+        fields_seen = 1;
+        if( name && value ) {
+            status = cb(data, h_id, name, name_len, value, value_len);
+            if( status != YMO_OKAY ) {
+                return status;
+            }
+        } else {
+            ymo_log_debug("HPACK: skipping oversized field (%zu/%zu bytes)",
+                    name_len, value_len);
+            r_val = E2BIG;
+        }
+
+        /* NOTE: the field is emitted first, because insertion can evict the
+         * entry its name refers to. If either string was too big to decode,
+         * the entry is definitely too big for the table — inserting it just
+         * empties the table:
+         */
+        if( indexing ) {
+            if( name && value ) {
+                status = dyn_insert(
+                        dec, h_id, name, name_len, value, value_len);
+                if( status != YMO_OKAY ) {
+                    return status;
+                }
+            } else {
+                dyn_evict(dec, 0);
+            }
+        }
+    }
+    return r_val;
+}
+
+
+/*---------------------------------------------------------------*
+ *  Encoder:
+ *---------------------------------------------------------------*/
+size_t ymo_hpack_encode_int(
+        uint8_t* dst, uint8_t flags, int n, size_t value)
+{
+    size_t mask = (1 << n) - 1;
+    uint8_t* p = dst;
+
+    if( value < mask ) {
+        *p++ = flags | (uint8_t)value;
+        return 1;
+    }
+
+    *p++ = flags | (uint8_t)mask;
+    value -= mask;
+    while( value >= 0x80 )
+    {
+        *p++ = (uint8_t)(0x80 | (value & 0x7f));
+        value >>= 7;
+    }
+    *p++ = (uint8_t)value;
+    return (size_t)(p - dst);
+}
+
+
+size_t ymo_hpack_encode_status(uint8_t* dst, ymo_http_status_t status)
+{
+    uint8_t idx = 0;
+    switch( status ) {
+        case 200: idx = 8; break;
+        case 204: idx = 9; break;
+        case 206: idx = 10; break;
+        case 304: idx = 11; break;
+        case 400: idx = 12; break;
+        case 404: idx = 13; break;
+        case 500: idx = 14; break;
+        default: break;
+    }
+
+    if( idx ) {
+        dst[0] = 0x80 | idx;
+        return 1;
+    }
+
+    /* Literal without indexing, name ":status" (index 8): */
+    dst[0] = 0x08;
+    dst[1] = 3;
+    dst[2] = (uint8_t)('0' + (status / 100) % 10);
+    dst[3] = (uint8_t)('0' + (status / 10) % 10);
+    dst[4] = (uint8_t)('0' + status % 10);
+    return 5;
+}
+
+
+size_t ymo_hpack_encode_field(
+        uint8_t* dst,
+        ymo_http_hdr_id_t h_id,
+        const char* name,
+        size_t name_len,
+        const char* value,
+        size_t value_len)
+{
+    uint8_t* p = dst;
+
+    if( h_id == YMO_HTTP_HID_NONE ) {
+        h_id = ymo_http_hdr_std_id(name, name_len);
+    }
+
+    uint8_t idx = (h_id && h_id <= YMO_HTTP_HID_STD_MAX)
+        ? hpack_static_name[h_id] : 0;
+    if( idx ) {
+        p += ymo_hpack_encode_int(p, 0x00, 4, idx);
+    } else {
+        *p++ = 0x00;
+        p += ymo_hpack_encode_int(p, 0x00, 7, name_len);
+        for( size_t i = 0; i < name_len; i++ )
+        {
+            char c = name[i];
+            *p++ = (c >= 'A' && c <= 'Z') ? (uint8_t)(c | 0x20) : (uint8_t)c;
+        }
+    }
+
+    p += ymo_hpack_encode_int(p, 0x00, 7, value_len);
+    memcpy(p, value, value_len);
+    p += value_len;
+    return (size_t)(p - dst);
+}
@@ -0,0 +1,165 @@
+/*=============================================================================
+ *
+ * Copyright (c) 2014 Andrew Canaday
+ *
+ * This file is part of libyimmo (sometimes referred to as "yimmo" or "ymo").
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *===========================================================================*/
+
+
+
+#ifndef YMO_HTTP2_HPACK_H
+#define YMO_HTTP2_HPACK_H
+#include "yimmo_config.h"
+#include <stddef.h>
+#include <stdint.h>
+#include "yimmo.h"
+#include "ymo_http.h"
+
+/** HPACK
+ * ======
+ *
+ * Header compression for :ref:`HTTP/2` (RFC 7541).
+ *
+ * - The **decoder** is complete: static and dynamic tables, Huffman-coded
+ *   strings, and dynamic table size updates.
+ * - The **encoder** only uses the static table: fully indexed fields for
+ *   the common ``:status`` codes and "literal without indexing" (with an
+ *   indexed name, where the static table has one) for everything else.
+ *   It never inserts into the peer's dynamic table, so it needs no
+ *   per-connection state, and it doesn't Huffman-code.
+ */
+
+/**---------------------------------------------------------------
+ * Types
+ *---------------------------------------------------------------*/
+
+/** Number of entries in the HPACK static table. */
+#define YMO_HPACK_STATIC_LEN 61
+
+/** Per-entry dynamic table overhead, per RFC 7541 §4.1. */
+#define YMO_HPACK_ENTRY_OVERHEAD 32
+
+/** Maximum number of entries the dynamic table can hold. */
+#define YMO_HPACK_DYNAMIC_MAX \
+    (YMO_HTTP2_HPACK_TABLE_SIZE / YMO_HPACK_ENTRY_OVERHEAD)
+
+/** Dynamic table entry. Name and value share a single allocation. */
+typedef struct ymo_hpack_entry {
+    char*              name;
+    size_t             name_len;
+    const char*        value;
+    size_t             value_len;
+    ymo_http_hdr_id_t  h_id;   /* Standard id, if known; else NONE */
+} ymo_hpack_entry_t;
+
+/** HPACK decoder state (one per connection). */
+typedef struct ymo_hpack_decoder {
+    ymo_hpack_entry_t  entries[YMO_HPACK_DYNAMIC_MAX]; /* Ring buffer */
+    size_t             newest;   /* Ring index of the most recent entry */
+    size_t             count;    /* Number of entries */
+    size_t             size;     /* Table size, per RFC 7541 §4.1 */
+    size_t             max_size; /* Size limit, per the last size update */
+    char               str_buf[YMO_HTTP2_HPACK_TABLE_SIZE]; /* Huffman */
+} ymo_hpack_decoder_t;
+
+/** Decoded header field callback.
+ *
+ * The name and value are only valid for the duration of the callback and
+ * are *not* ``NUL``-terminated.
+ *
+ * :param data: user data passed to :c:func:`ymo_hpack_decode`
+ * :param h_id: standard header id, if known (else ``YMO_HTTP_HID_NONE``)
+ * :param name: header field name (lowercase, for well-behaved peers)
+ * :param value: header field value
+ * :returns: ``YMO_OKAY`` to continue decoding; anything else stops it.
+ */
+typedef ymo_status_t (*ymo_hpack_field_cb_t)(
+        void* data,
+        ymo_http_hdr_id_t h_id,
+        const char* name,
+        size_t name_len,
+        const char* value,
+        size_t value_len);
+
+/**---------------------------------------------------------------
+ * Decoder
+ *---------------------------------------------------------------*/
+
+/** Initialize a decoder with an empty dynamic table. */
+void ymo_hpack_decoder_init(ymo_hpack_decoder_t* dec);
+
+/** Free all of the dynamic table entries held by ``dec``. */
+void ymo_hpack_decoder_clear(ymo_hpack_decoder_t* dec);
+
+/** Decode a complete header block, invoking ``cb`` once per field, in order.
+ *
+ * The dynamic table is updated as the block is decoded, so every header
+ * block received on a connection has to be passed in, in order, even if
+ * the fields themselves are going to be discarded.
+ *
+ * :returns: ``YMO_OKAY`` on success; ``EBADMSG`` if the block is malformed
+ *     (an HTTP/2 ``COMPRESSION_ERROR``); ``E2BIG`` if the block is valid,
+ *     but a Huffman-coded string was too large to decode (the rest of the
+ *     block is still processed, but ``cb`` is not invoked for that field);
+ *     or the first non-zero status returned by ``cb``.
+ */
+ymo_status_t ymo_hpack_decode(
+        ymo_hpack_decoder_t* dec,
+        const uint8_t* in,
+        size_t len,
+        ymo_hpack_field_cb_t cb,
+        void* data);
+
+/**---------------------------------------------------------------
+ * Encoder
+ *---------------------------------------------------------------*/
+
+/** Upper bound on the encoded size of a single header field. */
+#define YMO_HPACK_FIELD_MAX(name_len, value_len) \
+    (11 + (name_len) + (value_len))
+
+/** Encode an integer with an ``n``-bit prefix (RFC 7541 §5.1).
+ *
+ * :param dst: output buffer (at least 6 bytes)
+ * :param flags: high-order bits to set in the first byte
+ * :returns: the number of bytes written.
+ */
+size_t ymo_hpack_encode_int(
+        uint8_t* dst, uint8_t flags, int n, size_t value);
+
+/** Encode a ``:status`` pseudo-header.
+ *
+ * :returns: the number of bytes written (at most 5).
+ */
+size_t ymo_hpack_encode_status(uint8_t* dst, ymo_http_status_t status);
+
+/** Encode a header field as a "literal without indexing" (lowercasing the
+ * name, where it's not in the static table).
+ *
+ * :param dst: output buffer (see :c:macro:`YMO_HPACK_FIELD_MAX`)
+ * :param h_id: the standard id for ``name``, if known (else computed)
+ * :returns: the number of bytes written.
+ */
+size_t ymo_hpack_encode_field(
+        uint8_t* dst,
+        ymo_http_hdr_id_t h_id,
+        const char* name,
+        size_t name_len,
+        const char* value,
+        size_t value_len);
+
+#endif /* YMO_HTTP2_HPACK_H */
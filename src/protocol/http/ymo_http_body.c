@@ -0,0 +1,276 @@
+/*=============================================================================
+ *
+ * Copyright (c) 2014 Andrew Canaday
+ *
+ * This file is part of libyimmo (sometimes referred to as "yimmo" or "ymo").
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *===========================================================================*/
+
+#include "yimmo_config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "yimmo.h"
+#include "ymo_log.h"
+#include "ymo_alloc.h"
+#include "ymo_util.h"
+#include "ymo_http_body.h"
+
+/*---------------------------------------------------------------*
+ *  Declarations
+ *---------------------------------------------------------------*/
+
+/* Initial buffer size for bodies of unknown length: */
+#define BODY_MEM_INIT 4096
+
+#ifndef P_tmpdir
+#  define P_tmpdir "/tmp"
+#endif /* P_tmpdir */
+
+
+/*---------------------------------------------------------------*
+ *  Spill Files:
+ *---------------------------------------------------------------*/
+static const char* spill_dir(void)
+{
+    const char* dir = getenv("TMPDIR");
+    return (dir && *dir) ? dir : P_tmpdir;
+}
+
+
+/* Open an anonymous (unlinked) file to spill body data to: */
+static int spill_open(void)
+{
+    const char* dir = spill_dir();
+    int fd;
+
+#ifdef O_TMPFILE
+    fd = open(dir, O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+    if( fd >= 0 ) {
+        return fd;
+    }
+#endif /* O_TMPFILE */
+
+#ifdef MFD_CLOEXEC
+    fd = memfd_create("ymo_http_body", MFD_CLOEXEC);
+    if( fd >= 0 ) {
+        return fd;
+    }
+#endif /* MFD_CLOEXEC */
+
+    char path[PATH_MAX];
+    if( snprintf(path, sizeof(path), "%s/ymo_http_body.XXXXXX", dir)
+            >= (int)sizeof(path) ) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+
+    fd = mkstemp(path);
+    if( fd >= 0 ) {
+        unlink(path);
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+    return fd;
+}
+
+
+static ymo_status_t spill_write(int fd, const char* data, size_t len)
+{
+    while( len ) {
+        ssize_t n = write(fd, data, len);
+        if( n < 0 ) {
+            if( errno == EINTR ) {
+                continue;
+            }
+            return errno;
+        }
+        data += n;
+        len -= (size_t)n;
+    }
+    return YMO_OKAY;
+}
+
+
+/* Move the in-memory body data out to a file: */
+static ymo_status_t body_spill(ymo_http_body_t* body)
+{
+    int fd = spill_open();
+    if( fd < 0 ) {
+        ymo_status_t status = errno;
+        ymo_log_warning("Failed to create body spill file in %s: %s",
+                spill_dir(), strerror(status));
+        return status;
+    }
+
+    ymo_status_t status = spill_write(fd, body->mem, body->len);
+    if( status != YMO_OKAY ) {
+        ymo_log_warning("Failed to spill request body: %s",
+                strerror(status));
+        close(fd);
+        return status;
+    }
+
+    ymo_log_debug("Spilled %zu byte request body to fd %i", body->len, fd);
+    YMO_FREE(body->mem);
+    body->mem = NULL;
+    body->mem_size = 0;
+    body->fd = fd;
+    return YMO_OKAY;
+}
+
+
+/* Make room for at least len more bytes in memory: */
+static ymo_status_t body_grow(ymo_http_body_t* body, size_t len)
+{
+    size_t need = body->len + len;
+    size_t mem_size = body->mem_size ? body->mem_size : BODY_MEM_INIT;
+    while( mem_size < need ) {
+        mem_size *= 2;
+    }
+    mem_size = YMO_MIN(mem_size, body->mem_max);
+
+    char* mem = YMO_ALLOC(mem_size);
+    if( !mem ) {
+        return ENOMEM;
+    }
+
+    if( body->mem ) {
+        memcpy(mem, body->mem, body->len);
+        YMO_FREE(body->mem);
+    }
+    body->mem = mem;
+    body->mem_size = mem_size;
+    return YMO_OKAY;
+}
+
+
+/*---------------------------------------------------------------*
+ *  Body Spool:
+ *---------------------------------------------------------------*/
+ymo_http_body_t* ymo_http_body_create(size_t mem_max, size_t max, size_t hint)
+{
+    ymo_http_body_t* body = YMO_NEW0(ymo_http_body_t);
+    if( !body ) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    body->mem_max = YMO_MIN(mem_max, max);
+    body->max = max;
+    body->fd = -1;
+
+    /* If we know how much is coming and it fits, allocate it up front: */
+    if( hint && hint <= body->mem_max ) {
+        body->mem = YMO_ALLOC(hint);
+        if( !body->mem ) {
+            YMO_DELETE(ymo_http_body_t, body);
+            errno = ENOMEM;
+            return NULL;
+        }
+        body->mem_size = hint;
+    }
+    return body;
+}
+
+
+ymo_status_t ymo_http_body_write(
+        ymo_http_body_t* body, const char* data, size_t len)
+{
+    ymo_status_t status;
+
+    if( len > body->max - body->len ) {
+        ymo_log_debug("Request body exceeds %zu bytes", body->max);
+        return EFBIG;
+    }
+
+    if( body->fd < 0 ) {
+        if( body->len + len <= body->mem_size ) {
+            memcpy(body->mem + body->len, data, len);
+            body->len += len;
+            return YMO_OKAY;
+        }
+
+        if( body->len + len <= body->mem_max ) {
+            status = body_grow(body, len);
+        } else {
+            status = body_spill(body);
+        }
+
+        if( status != YMO_OKAY ) {
+            return status;
+        }
+        return ymo_http_body_write(body, data, len);
+    }
+
+    status = spill_write(body->fd, data, len);
+    if( status == YMO_OKAY ) {
+        body->len += len;
+    } else {
+        ymo_log_warning("Failed to write request body: %s",
+                strerror(status));
+    }
+    return status;
+}
+
+
+ssize_t ymo_http_body_pread(
+        const ymo_http_body_t* body, void* buf, size_t len, size_t offset)
+{
+    if( offset >= body->len ) {
+        return 0;
+    }
+    len = YMO_MIN(len, body->len - offset);
+
+    if( body->fd < 0 ) {
+        memcpy(buf, body->mem + offset, len);
+        return (ssize_t)len;
+    }
+
+    ssize_t n;
+    do {
+        n = pread(body->fd, buf, len, (off_t)offset);
+    } while( n < 0 && errno == EINTR );
+    return n;
+}
+
+
+int ymo_http_body_spilled(const ymo_http_body_t* body)
+{
+    return body->fd >= 0;
+}
+
+
+void ymo_http_body_free(ymo_http_body_t* body)
+{
+    if( body ) {
+        if( body->fd >= 0 ) {
+            close(body->fd);
+        }
+        if( body->mem ) {
+            YMO_FREE(body->mem);
+        }
+    }
+    YMO_DELETE(ymo_http_body_t, body);
+    return;
+}
+
@@ -0,0 +1,102 @@
+/*=============================================================================
+ *
+ * Copyright (c) 2014 Andrew Canaday
+ *
+ * This file is part of libyimmo (sometimes referred to as "yimmo" or "ymo").
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *===========================================================================*/
+
+
+
+#ifndef YMO_HTTP_BODY_H
+#define YMO_HTTP_BODY_H
+#include "yimmo_config.h"
+#include <stddef.h>
+#include <sys/types.h>
+#include "yimmo.h"
+#include "ymo_http.h"
+
+/** Request Body Spool
+ * ====================
+ *
+ * Storage for request bodies received in spooled mode (see
+ * :c:func:`ymo_http_set_body_spool`).
+ *
+ * Body data is kept in a contiguous heap buffer until it exceeds the
+ * spool's memory threshold, at which point the buffer is written out to an
+ * unlinked temporary file and freed. Subsequent data is appended to the
+ * file. The file is opened with ``O_TMPFILE`` where available, falling back
+ * to ``memfd_create`` and, failing that, ``mkstemp`` + ``unlink`` — i.e. it
+ * never has a name visible to other processes (for long) and disappears
+ * when the spool is freed.
+ *
+ * Spill files are created in ``$TMPDIR`` (or ``P_tmpdir``).
+ */
+
+/**---------------------------------------------------------------
+ * Types
+ *---------------------------------------------------------------*/
+
+struct ymo_http_body {
+    char*   mem;      /* In-memory body data (until spilled) */
+    size_t  mem_size; /* Allocated size of mem */
+    size_t  mem_max;  /* Spill threshold */
+    size_t  max;      /* Maximum body size */
+    size_t  len;      /* Bytes stored */
+    size_t  r_off;    /* Sequential read offset */
+    int     fd;       /* Spill file, or -1 */
+};
+
+
+/**---------------------------------------------------------------
+ * Functions
+ *---------------------------------------------------------------*/
+
+/** Create a new body spool.
+ *
+ * :param mem_max: bytes to hold in memory before spilling to a file
+ * :param max: maximum body size
+ * :param hint: expected body size (e.g. content-length), or 0 if unknown
+ *
+ * :returns: a new spool, or ``NULL`` with ``errno`` set on failure.
+ */
+ymo_http_body_t* ymo_http_body_create(size_t mem_max, size_t max, size_t hint);
+
+/** Append ``len`` bytes of body data to the spool.
+ *
+ * :returns: ``YMO_OKAY`` on success; ``EFBIG`` if the body would exceed the
+ *           spool's maximum; ``ENOMEM`` or an I/O error, otherwise.
+ */
+ymo_status_t ymo_http_body_write(
+        ymo_http_body_t* body, const char* data, size_t len);
+
+/** Copy up to ``len`` bytes, starting at ``offset``, into ``buf``.
+ *
+ * :returns: the number of bytes copied (0 at the end of the stored data),
+ *           or -1 with ``errno`` set on failure.
+ */
+ssize_t ymo_http_body_pread(
+        const ymo_http_body_t* body, void* buf, size_t len, size_t offset);
+
+/** Non-zero if the spool has been written out to a file. */
+int ymo_http_body_spilled(const ymo_http_body_t* body);
+
+/** Free the spool, its buffer, and its spill file (if any). */
+void ymo_http_body_free(ymo_http_body_t* body);
+
+#endif /* YMO_HTTP_BODY_H */
+
+
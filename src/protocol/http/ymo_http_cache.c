@@ -0,0 +1,822 @@
+/*=============================================================================
+ *
+ * Copyright (c) 2014 Andrew Canaday
+ *
+ * This file is part of libyimmo (sometimes referred to as "yimmo" or "ymo").
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *===========================================================================*/
+
+#include "yimmo_config.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+#include "yimmo.h"
+#include "ymo_log.h"
+#include "ymo_alloc.h"
+#include "core/ymo_net.h"
+#include "ymo_http_cache.h"
+#include "ymo_http_hdr_table.h"
+#include "ymo_http_response.h"
+#include "ymo_http_session.h"
+#include "ymo_proto_http.h"
+
+/*---------------------------------------------------------------*
+ *  Declarations
+ *---------------------------------------------------------------*/
+
+#define CACHE_OWS(c) ((c) == ' ' || (c) == '\t')
+
+#define CACHE_TABLE_MASK (YMO_HTTP_CACHE_TABLE_SIZE - 1)
+
+/* Key byte used in place of a content-coding, if none was negotiated: */
+#define CACHE_NO_CODING 0xff
+
+/* Bytes charged for an entry, aside from its object: */
+#define CACHE_ENTRY_SIZE(e) (sizeof(ymo_http_cache_entry_t) + (e)->key_len)
+
+
+/*---------------------------------------------------------------*
+ *  Utility:
+ *---------------------------------------------------------------*/
+static uint32_t cache_hash(const char* key, size_t len)
+{
+    /* FNV-1a: */
+    uint32_t hash = 2166136261u;
+    for( size_t i = 0; i < len; i++ ) {
+        hash = (hash ^ (uint8_t)key[i]) * 16777619u;
+    }
+    return hash;
+}
+
+
+/* Call fn for each comma-separated token in value (stopping if it returns
+ * non-zero, which is then returned):
+ */
+static int cache_each_token(
+        const char* value,
+        int (*fn)(const char* token, size_t len, void* data),
+        void* data)
+{
+    const char* p = value;
+    while( *p )
+    {
+        while( CACHE_OWS(*p) || *p == ',' ) {
+            ++p;
+        }
+        const char* start = p;
+        while( *p && *p != ',' ) {
+            ++p;
+        }
+        const char* end = p;
+        while( end > start && CACHE_OWS(end[-1]) ) {
+            --end;
+        }
+        if( end > start ) {
+            int rc = fn(start, (size_t)(end - start), data);
+            if( rc ) {
+                return rc;
+            }
+        }
+    }
+    return 0;
+}
+
+
+/* Append len bytes and a NUL to the key, if they fit: */
+static int key_append(char* key, size_t* key_len, const char* s, size_t len)
+{
+    if( *key_len + len + 1 > YMO_HTTP_CACHE_KEY_MAX ) {
+        return 0;
+    }
+    memcpy(key + *key_len, s, len);
+    *key_len += len;
+    key[(*key_len)++] = '\0';
+    return 1;
+}
+
+
+static int key_append_str(char* key, size_t* key_len, const char* s)
+{
+    return s ? key_append(key, key_len, s, strlen(s))
+             : key_append(key, key_len, "", 0);
+}
+
+
+/* Build the cache key for a request (0, if it's too long): */
+static size_t cache_key(
+        const ymo_http_cache_t* cache,
+        const ymo_http_request_t* request,
+        const ymo_http_response_t* response,
+        char* key)
+{
+    size_t key_len = 0;
+    char coding = (char)(response->compress_pending
+            ? response->compress_coding : CACHE_NO_CODING);
+
+    if( !key_append_str(key, &key_len, request->method)
+        || !key_append_str(key, &key_len, ymo_http_hdr_table_get_id(
+                &request->headers, YMO_HTTP_HID_HOST))
+        || !key_append_str(key, &key_len, request->uri)
+        || !key_append_str(key, &key_len, request->query)
+        || !key_append(key, &key_len, &coding, 1) ) {
+        return 0;
+    }
+
+    for( size_t i = 0; i < cache->no_vary; i++ ) {
+        if( !key_append_str(key, &key_len, ymo_http_hdr_table_get(
+                        &request->headers, cache->vary[i])) ) {
+            return 0;
+        }
+    }
+    return key_len;
+}
+
+
+/*---------------------------------------------------------------*
+ *  Objects:
+ *---------------------------------------------------------------*/
+static void obj_unref(ymo_http_cache_obj_t* obj)
+{
+    if( obj && --obj->refs == 0 ) {
+        ymo_http_canned_free(obj->canned);
+        YMO_DELETE(ymo_http_cache_obj_t, obj);
+    }
+    return;
+}
+
+
+/* Answer a request from a cached object: */
+static void obj_send(ymo_http_cache_obj_t* obj, ymo_http_response_t* response)
+{
+    obj->refs++;
+    response->cache_obj = obj;
+    ymo_http_response_send_canned(response, obj->canned);
+    return;
+}
+
+
+/* Headers which are regenerated for each response, rather than stored: */
+static int obj_skip_header(const char* hdr, size_t hdr_len)
+{
+    switch( ymo_http_hdr_id(hdr, hdr_len) ) {
+        case YMO_HTTP_HID_CONTENT_LENGTH:
+        case YMO_HTTP_HID_CONNECTION:
+        case YMO_HTTP_HID_DATE:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+
+/* Snapshot a complete response as a canned one: */
+static ymo_http_cache_obj_t* obj_create(
+        const ymo_http_cache_t* cache, ymo_http_response_t* response)
+{
+    const char* hdr;
+    size_t hdr_len;
+    const char* value;
+    size_t body_len = 0;
+    size_t head_len = 0;
+    const ymo_bucket_t* b;
+
+    for( b = response->body_head; b; b = b->next ) {
+        body_len += b->len;
+    }
+
+    ymo_http_hdr_table_t* hdrs = ymo_http_hdr_table_create();
+    if( !hdrs ) {
+        return NULL;
+    }
+
+    ymo_http_hdr_ptr_t iter = ymo_http_hdr_table_next(
+            &response->headers, NULL, &hdr, &hdr_len, &value);
+    while( iter ) {
+        if( !obj_skip_header(hdr, hdr_len) ) {
+            ymo_http_hdr_table_add_precompute(hdrs,
+                    ymo_http_hdr_id(hdr, hdr_len), hdr, hdr_len, value);
+            head_len += hdr_len + strlen(value) + 4;
+        }
+        iter = ymo_http_hdr_table_next(
+                &response->headers, iter, &hdr, &hdr_len, &value);
+    }
+
+    /* Canned responses hold one copy per Connection variant: */
+    size_t max_obj = cache->max_bytes / YMO_HTTP_CACHE_OBJ_SHARE;
+    if( YMO_HTTP_CANNED_NO_VARIANTS * (head_len + body_len) > max_obj ) {
+        ymo_http_hdr_table_free(hdrs);
+        return NULL;
+    }
+
+    /* The body is usually a single bucket; otherwise, flatten it: */
+    const char* body = NULL;
+    char* body_buf = NULL;
+    if( response->body_head && !response->body_head->next ) {
+        body = response->body_head->data;
+    } else if( body_len ) {
+        body = body_buf = YMO_ALLOC(body_len);
+        if( !body_buf ) {
+            ymo_http_hdr_table_free(hdrs);
+            return NULL;
+        }
+        char* p = body_buf;
+        for( b = response->body_head; b; b = b->next ) {
+            memcpy(p, b->data, b->len);
+            p += b->len;
+        }
+    }
+
+    ymo_http_cache_obj_t* obj = NULL;
+    ymo_http_canned_t* canned = ymo_http_canned_create(
+            response->status, hdrs, body, body_len);
+    ymo_http_hdr_table_free(hdrs);
+    YMO_FREE(body_buf);
+    if( !canned ) {
+        return NULL;
+    }
+
+    obj = YMO_NEW0(ymo_http_cache_obj_t);
+    if( !obj ) {
+        ymo_http_canned_free(canned);
+        return NULL;
+    }
+    obj->canned = canned;
+    obj->refs = 1;
+    obj->size = sizeof(ymo_http_cache_obj_t) + sizeof(ymo_http_canned_t);
+    for( int v = 0; v < YMO_HTTP_CANNED_NO_VARIANTS; v++ ) {
+        obj->size += canned->variant[v].len;
+    }
+    return obj;
+}
+
+
+/*---------------------------------------------------------------*
+ *  Cacheability:
+ *---------------------------------------------------------------*/
+typedef struct cache_control {
+    int       no_store;
+    long long max_age;   /* -1, if absent */
+    long long s_maxage;  /* -1, if absent */
+} cache_control_t;
+
+
+static long long directive_seconds(const char* p, size_t len)
+{
+    long long n = 0;
+    if( len && *p == '"' ) {
+        ++p;
+        len -= (len > 1 && p[len-2] == '"') ? 2 : 1;
+    }
+    if( !len ) {
+        return 0;
+    }
+    for( size_t i = 0; i < len; i++ ) {
+        if( p[i] < '0' || p[i] > '9' ) {
+            return 0;
+        }
+        if( n < 0x7fffffffLL ) {
+            n = n * 10 + (p[i] - '0');
+        }
+    }
+    return n;
+}
+
+
+static int cache_control_directive(const char* token, size_t len, void* data)
+{
+    cache_control_t* cc = data;
+    const char* eq = memchr(token, '=', len);
+    size_t name_len = eq ? (size_t)(eq - token) : len;
+    const char* arg = eq ? eq + 1 : NULL;
+    size_t arg_len = eq ? len - name_len - 1 : 0;
+
+    if( (name_len == 8 && !strncasecmp(token, "no-store", 8))
+        || (name_len == 8 && !strncasecmp(token, "no-cache", 8))
+        || (name_len == 7 && !strncasecmp(token, "private", 7)) ) {
+        cc->no_store = 1;
+    } else if( arg && name_len == 7 && !strncasecmp(token, "max-age", 7) ) {
+        cc->max_age = directive_seconds(arg, arg_len);
+    } else if( arg && name_len == 8 && !strncasecmp(token, "s-maxage", 8) ) {
+        cc->s_maxage = directive_seconds(arg, arg_len);
+    }
+    return 0;
+}
+
+
+typedef struct vary_ctx {
+    const ymo_http_cache_t*       cache;
+    const ymo_http_cache_entry_t* entry;
+} vary_ctx_t;
+
+
+/* Non-zero if the key doesn't cover a Vary token: */
+static int vary_unkeyed(const char* token, size_t len, void* data)
+{
+    vary_ctx_t* ctx = data;
+    if( len == 1 && *token == '*' ) {
+        return 1;
+    }
+
+    if( ctx->entry->coded && len == 15
+        && !strncasecmp(token, "Accept-Encoding", 15) ) {
+        return 0;
+    }
+
+    for( size_t i = 0; i < ctx->cache->no_vary; i++ ) {
+        if( strlen(ctx->cache->vary[i]) == len
+            && !strncasecmp(token, ctx->cache->vary[i], len) ) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+
+/* RFC 9111 §4.2.2: */
+static int status_cacheable(ymo_http_status_t status)
+{
+    switch( status ) {
+        case YMO_HTTP_OK:
+        case YMO_HTTP_NON_AUTHORITATIVE_INFORMATION:
+        case YMO_HTTP_NO_CONTENT:
+        case YMO_HTTP_MULTIPLE_CHOICES:
+        case YMO_HTTP_MOVED_PERMANENTLY:
+        case YMO_HTTP_NOT_FOUND:
+        case YMO_HTTP_METHOD_NOT_ALLOWED:
+        case YMO_HTTP_GONE:
+        case YMO_HTTP_REQUEST_URI_TOO_LONG:
+        case YMO_HTTP_NOT_IMPLEMENTED:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+
+/* TTL for a response (0, if it can't be cached): */
+static long long cache_ttl(
+        const ymo_http_cache_t* cache,
+        const ymo_http_cache_entry_t* entry,
+        ymo_http_response_t* response)
+{
+    const ymo_http_hdr_table_t* hdrs = &response->headers;
+
+    if( !(response->flags & YMO_HTTP_RESPONSE_COMPLETE)
+        || response->canned || response->proto_new
+        || !status_cacheable(response->status)
+        || ymo_http_hdr_table_get_id(hdrs, YMO_HTTP_HID_SET_COOKIE)
+        || ymo_http_hdr_table_get_id(hdrs, YMO_HTTP_HID_TRANSFER_ENCODING) ) {
+        return 0;
+    }
+
+    for( const ymo_bucket_t* b = response->body_head; b; b = b->next ) {
+        if( b->fd >= 0 ) {
+            return 0;
+        }
+    }
+
+    const char* vary = ymo_http_hdr_table_get_id(hdrs, YMO_HTTP_HID_VARY);
+    vary_ctx_t vary_ctx = { .cache = cache, .entry = entry };
+    if( vary && cache_each_token(vary, &vary_unkeyed, &vary_ctx) ) {
+        return 0;
+    }
+
+    cache_control_t cc = { .no_store = 0, .max_age = -1, .s_maxage = -1 };
+    const char* value = ymo_http_hdr_table_get_id(
+            hdrs, YMO_HTTP_HID_CACHE_CONTROL);
+    if( value ) {
+        cache_each_token(value, &cache_control_directive, &cc);
+    }
+
+    if( cc.no_store ) {
+        return 0;
+    } else if( cc.s_maxage >= 0 ) {
+        return cc.s_maxage;
+    } else if( cc.max_age >= 0 ) {
+        return cc.max_age;
+    }
+    return cache->ttl;
+}
+
+
+/*---------------------------------------------------------------*
+ *  Entries:
+ *---------------------------------------------------------------*/
+static void lru_unlink(ymo_http_cache_t* cache, ymo_http_cache_entry_t* entry)
+{
+    if( entry->lru_prev ) {
+        entry->lru_prev->lru_next = entry->lru_next;
+    } else if( cache->lru_head == entry ) {
+        cache->lru_head = entry->lru_next;
+    }
+
+    if( entry->lru_next ) {
+        entry->lru_next->lru_prev = entry->lru_prev;
+    } else if( cache->lru_tail == entry ) {
+        cache->lru_tail = entry->lru_prev;
+    }
+    entry->lru_prev = entry->lru_next = NULL;
+}
+
+
+static void lru_push(ymo_http_cache_t* cache, ymo_http_cache_entry_t* entry)
+{
+    entry->lru_prev = NULL;
+    entry->lru_next = cache->lru_head;
+    if( cache->lru_head ) {
+        cache->lru_head->lru_prev = entry;
+    } else {
+        cache->lru_tail = entry;
+    }
+    cache->lru_head = entry;
+}
+
+
+static void entry_set_obj(
+        ymo_http_cache_entry_t* entry, ymo_http_cache_obj_t* obj)
+{
+    ymo_http_cache_t* cache = entry->cache;
+    if( entry->obj ) {
+        cache->stats.bytes -= entry->obj->size;
+        obj_unref(entry->obj);
+    }
+    entry->obj = obj;
+    if( obj ) {
+        cache->stats.bytes += obj->size;
+    }
+}
+
+
+static ymo_http_cache_entry_t* entry_find(
+        ymo_http_cache_t* cache, const char* key, size_t len, uint32_t hash)
+{
+    ymo_http_cache_entry_t* entry = cache->table[hash & CACHE_TABLE_MASK];
+    while( entry ) {
+        if( entry->hash == hash && entry->key_len == len
+            && !memcmp(entry->key, key, len) ) {
+            return entry;
+        }
+        entry = entry->h_next;
+    }
+    return NULL;
+}
+
+
+static ymo_http_cache_entry_t* entry_create(
+        ymo_http_cache_t* cache, const char* key, size_t len, uint32_t hash)
+{
+    ymo_http_cache_entry_t* entry = YMO_NEW0(ymo_http_cache_entry_t);
+    if( !entry ) {
+        return NULL;
+    }
+
+    entry->key = YMO_ALLOC(len);
+    if( !entry->key ) {
+        YMO_DELETE(ymo_http_cache_entry_t, entry);
+        return NULL;
+    }
+    memcpy(entry->key, key, len);
+    entry->key_len = len;
+    entry->hash = hash;
+    entry->cache = cache;
+
+    ymo_http_cache_entry_t** slot = &cache->table[hash & CACHE_TABLE_MASK];
+    entry->h_next = *slot;
+    *slot = entry;
+    cache->stats.entries++;
+    cache->stats.bytes += CACHE_ENTRY_SIZE(entry);
+    return entry;
+}
+
+
+/* Remove an entry which isn't filling (i.e. has no waiters): */
+static void entry_free(ymo_http_cache_t* cache, ymo_http_cache_entry_t* entry)
+{
+    ymo_http_cache_entry_t** slot = &cache->table[entry->hash & CACHE_TABLE_MASK];
+    while( *slot != entry ) {
+        slot = &(*slot)->h_next;
+    }
+    *slot = entry->h_next;
+
+    lru_unlink(cache, entry);
+    entry_set_obj(entry, NULL);
+    cache->stats.entries--;
+    cache->stats.bytes -= CACHE_ENTRY_SIZE(entry);
+    YMO_FREE(entry->key);
+    YMO_DELETE(ymo_http_cache_entry_t, entry);
+}
+
+
+/* Evict least-recently used entries until we're within budget: */
+static void cache_trim(ymo_http_cache_t* cache)
+{
+    while( cache->stats.bytes > cache->max_bytes && cache->lru_tail ) {
+        entry_free(cache, cache->lru_tail);
+        cache->stats.evictions++;
+    }
+}
+
+
+/* Hand a request which was waiting on an entry to the handler: */
+static void waiter_dispatch(
+        ymo_http_cache_t* cache, ymo_http_response_t* waiter)
+{
+    ymo_http_request_t* request = waiter->cache_request;
+    waiter->cache_request = NULL;
+    waiter->cache_next = NULL;
+
+    ymo_status_t status = ymo_proto_http_dispatch(
+            cache->http_data, waiter->session, request, waiter);
+    if( status != YMO_OKAY && !YMO_IS_BLOCKED(status) ) {
+        ymo_http_response_issue(
+                waiter, ymo_proto_http_error_status(request, status));
+    }
+}
+
+
+/* The response filling an entry went away before it could be stored: let
+ * the first waiter (if any) take over.
+ */
+static void entry_abandon(ymo_http_cache_t* cache, ymo_http_cache_entry_t* entry)
+{
+    ymo_http_response_t* waiter = entry->waiters;
+    if( waiter ) {
+        entry->waiters = waiter->cache_next;
+        waiter_dispatch(cache, waiter);
+        return;
+    }
+
+    entry->filling = 0;
+    if( entry->obj ) {
+        lru_push(cache, entry);
+    } else {
+        entry_free(cache, entry);
+    }
+}
+
+
+/*---------------------------------------------------------------*
+ *  Cache:
+ *---------------------------------------------------------------*/
+static int vary_add(const char* token, size_t len, void* data)
+{
+    ymo_http_cache_t* cache = data;
+    if( cache->no_vary == YMO_HTTP_CACHE_VARY_MAX ) {
+        return EINVAL;
+    }
+
+    char* name = YMO_ALLOC(len + 1);
+    if( !name ) {
+        return ENOMEM;
+    }
+    memcpy(name, token, len);
+    name[len] = '\0';
+    cache->vary[cache->no_vary++] = name;
+    return 0;
+}
+
+
+ymo_status_t ymo_http_cache_configure(
+        ymo_http_cache_t* cache,
+        size_t max_bytes,
+        unsigned int ttl,
+        const char* vary)
+{
+    /* Existing keys may no longer make sense: */
+    ymo_http_cache_purge(cache);
+    for( size_t i = 0; i < cache->no_vary; i++ ) {
+        YMO_FREE(cache->vary[i]);
+    }
+    cache->no_vary = 0;
+
+    int rc = vary ? cache_each_token(vary, &vary_add, cache) : 0;
+    if( rc ) {
+        for( size_t i = 0; i < cache->no_vary; i++ ) {
+            YMO_FREE(cache->vary[i]);
+        }
+        cache->no_vary = 0;
+        cache->max_bytes = 0;
+        return rc;
+    }
+
+    cache->max_bytes = max_bytes;
+    cache->ttl = ttl;
+    return YMO_OKAY;
+}
+
+
+ymo_http_cache_t* ymo_http_cache_create(
+        size_t max_bytes,
+        unsigned int ttl,
+        const char* vary,
+        const struct ymo_http_proto_data* http_data)
+{
+    ymo_http_cache_t* cache = YMO_NEW0(ymo_http_cache_t);
+    if( !cache ) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    cache->http_data = http_data;
+
+    ymo_status_t status = ymo_http_cache_configure(
+            cache, max_bytes, ttl, vary);
+    if( status != YMO_OKAY ) {
+        YMO_DELETE(ymo_http_cache_t, cache);
+        errno = status;
+        return NULL;
+    }
+    return cache;
+}
+
+
+void ymo_http_cache_purge(ymo_http_cache_t* cache)
+{
+    if( !cache ) {
+        return;
+    }
+
+    while( cache->lru_tail ) {
+        entry_free(cache, cache->lru_tail);
+    }
+}
+
+
+ymo_http_cache_result_t ymo_http_cache_lookup(
+        ymo_http_cache_t* cache,
+        ymo_http_request_t* request,
+        ymo_http_response_t* response)
+{
+    char key[YMO_HTTP_CACHE_KEY_MAX];
+
+    if( !cache || !cache->max_bytes
+        || strcmp(request->method, "GET")
+        || request->content_length
+        || ymo_http_hdr_table_get_id(
+            &request->headers, YMO_HTTP_HID_AUTHORIZATION) ) {
+        return YMO_HTTP_CACHE_BYPASS;
+    }
+
+    size_t key_len = cache_key(cache, request, response, key);
+    if( !key_len ) {
+        return YMO_HTTP_CACHE_BYPASS;
+    }
+
+    time_t now = time(NULL);
+    uint32_t hash = cache_hash(key, key_len);
+    ymo_http_cache_entry_t* entry = entry_find(cache, key, key_len, hash);
+
+    if( entry ) {
+        /* Fresh, or being refreshed: */
+        if( entry->obj && (entry->filling || now < entry->expires) ) {
+            if( now < entry->expires ) {
+                cache->stats.hits++;
+            } else {
+                cache->stats.stale++;
+            }
+            if( !entry->filling ) {
+                lru_unlink(cache, entry);
+                lru_push(cache, entry);
+            }
+            obj_send(entry->obj, response);
+            return YMO_HTTP_CACHE_HIT;
+        }
+
+        /* Someone else is already generating it: */
+        if( entry->filling ) {
+            ymo_http_response_t** tail = &entry->waiters;
+            while( *tail ) {
+                tail = &(*tail)->cache_next;
+            }
+            *tail = response;
+            response->cache_entry = entry;
+            response->cache_request = request;
+            cache->stats.collapsed++;
+            return YMO_HTTP_CACHE_WAIT;
+        }
+
+        cache->stats.misses++;
+        if( entry->pass && now < entry->expires ) {
+            return YMO_HTTP_CACHE_BYPASS;
+        }
+
+        /* Expired: refill it (the old object, if any, is served meanwhile): */
+        lru_unlink(cache, entry);
+    } else {
+        cache->stats.misses++;
+        entry = entry_create(cache, key, key_len, hash);
+        if( !entry ) {
+            return YMO_HTTP_CACHE_BYPASS;
+        }
+    }
+
+    entry->filling = 1;
+    entry->pass = 0;
+    entry->coded = response->compress_pending;
+    response->cache_entry = entry;
+    return YMO_HTTP_CACHE_MISS;
+}
+
+
+void ymo_http_cache_store(ymo_http_response_t* response)
+{
+    ymo_http_cache_entry_t* entry = response->cache_entry;
+    if( !entry || response->cache_request ) {
+        return;
+    }
+
+    ymo_http_cache_t* cache = entry->cache;
+    ymo_http_cache_obj_t* obj = NULL;
+    response->cache_entry = NULL;
+    entry->filling = 0;
+
+    long long ttl = cache->max_bytes ? cache_ttl(cache, entry, response) : 0;
+    if( ttl > 0 ) {
+        obj = obj_create(cache, response);
+    }
+
+    time_t now = time(NULL);
+    ymo_http_response_t* waiter = entry->waiters;
+    entry->waiters = NULL;
+
+    if( obj ) {
+        entry_set_obj(entry, obj);
+        entry->expires = now + (time_t)ttl;
+        cache->stats.stores++;
+        lru_push(cache, entry);
+
+        while( waiter ) {
+            ymo_http_response_t* next = waiter->cache_next;
+            waiter->cache_entry = NULL;
+            waiter->cache_request = NULL;
+            waiter->cache_next = NULL;
+            obj_send(obj, waiter);
+            waiter = next;
+        }
+        cache_trim(cache);
+        return;
+    }
+
+    /* Not cacheable; stop collapsing requests for it, for a while: */
+    ymo_log_debug("Response for %p not cacheable", (void*)response);
+    entry_set_obj(entry, NULL);
+    entry->pass = 1;
+    entry->expires = now + (cache->ttl ? cache->ttl : YMO_HTTP_CACHE_PASS_TTL);
+    lru_push(cache, entry);
+
+    while( waiter ) {
+        ymo_http_response_t* next = waiter->cache_next;
+        waiter->cache_entry = NULL;
+        waiter_dispatch(cache, waiter);
+        waiter = next;
+    }
+    cache_trim(cache);
+}
+
+
+void ymo_http_cache_release(ymo_http_response_t* response)
+{
+    obj_unref(response->cache_obj);
+    response->cache_obj = NULL;
+
+    ymo_http_cache_entry_t* entry = response->cache_entry;
+    if( !entry ) {
+        return;
+    }
+    response->cache_entry = NULL;
+
+    /* Waiting: just leave the queue. */
+    if( response->cache_request ) {
+        ymo_http_response_t** w = &entry->waiters;
+        while( *w && *w != response ) {
+            w = &(*w)->cache_next;
+        }
+        if( *w ) {
+            *w = response->cache_next;
+        }
+        response->cache_request = NULL;
+        response->cache_next = NULL;
+        return;
+    }
+
+    entry_abandon(entry->cache, entry);
+}
+
+
@@ -0,0 +1,202 @@
+/*=============================================================================
+ *
+ * Copyright (c) 2014 Andrew Canaday
+ *
+ * This file is part of libyimmo (sometimes referred to as "yimmo" or "ymo").
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *===========================================================================*/
+
+
+
+#ifndef YMO_HTTP_CACHE_H
+#define YMO_HTTP_CACHE_H
+#include "yimmo_config.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "yimmo.h"
+#include "ymo_http.h"
+
+struct ymo_http_proto_data;
+
+/** Microcache
+ * ============
+ *
+ * Internals for the response cache (see :c:func:`ymo_http_set_cache`).
+ *
+ * Entries are kept in a chained hash table, keyed on the request method,
+ * ``Host``, path, query, negotiated content-coding, and the values of the
+ * configured ``Vary`` headers. Each entry is in one of three states:
+ *
+ * - **filling:** a request missed and its response is being generated.
+ *   Other requests for the same key wait on the entry (they're parked, as if
+ *   the handler had returned ``YMO_WOULDBLOCK``) and are answered from it
+ *   once it's stored. If the entry already has an (expired) object, they're
+ *   answered with that, instead.
+ * - **stored:** the entry holds a cached object, which is fresh until
+ *   ``expires``.
+ * - **pass:** the last response for the key wasn't cacheable. Requests go
+ *   straight to the handler (without collapsing) until ``expires``.
+ *
+ * Cached objects are canned responses (see :c:type:`ymo_http_canned_t`):
+ * immutable and sent by reference. Every response which sends one holds a
+ * reference, so objects can be replaced or evicted while in flight.
+ *
+ * Stored and pass entries are on an LRU list, which is trimmed to the byte
+ * budget each time an object is stored. Entries which are filling aren't
+ * evictable.
+ */
+
+/**---------------------------------------------------------------
+ * Definitions
+ *---------------------------------------------------------------*/
+
+/** Number of hash table buckets. Must be a power of two. */
+#define YMO_HTTP_CACHE_TABLE_SIZE 4096
+
+/** Longest cache key. Requests with longer keys aren't cached. */
+#define YMO_HTTP_CACHE_KEY_MAX 2048
+
+/** Maximum number of request headers the key can vary on. */
+#define YMO_HTTP_CACHE_VARY_MAX 8
+
+/** Largest object stored, as a fraction of the byte budget. */
+#define YMO_HTTP_CACHE_OBJ_SHARE 8
+
+/** Seconds to stop collapsing requests for a key whose response wasn't
+ * cacheable, if the cache has no default TTL.
+ */
+#define YMO_HTTP_CACHE_PASS_TTL 2
+
+
+/**---------------------------------------------------------------
+ * Types
+ *---------------------------------------------------------------*/
+
+typedef struct ymo_http_cache_obj ymo_http_cache_obj_t;
+typedef struct ymo_http_cache_entry ymo_http_cache_entry_t;
+
+/** Cached response (shared by every response which sends it). */
+struct ymo_http_cache_obj {
+    ymo_http_canned_t*       canned;
+    size_t                   size;       /* Bytes charged to the budget */
+    int                      refs;
+};
+
+/** Cache entry. */
+struct ymo_http_cache_entry {
+    struct ymo_http_cache*   cache;
+    char*                    key;
+    size_t                   key_len;
+    uint32_t                 hash;
+    ymo_http_cache_obj_t*    obj;        /* Current object, if any */
+    time_t                   expires;    /* Object/pass expiry */
+    uint8_t                  filling;    /* A miss is being generated */
+    uint8_t                  pass;       /* Not cacheable, for now */
+    uint8_t                  coded;      /* Key includes a content-coding */
+    ymo_http_response_t*     waiters;    /* Collapsed requests */
+    ymo_http_cache_entry_t*  h_next;     /* Hash chain */
+    ymo_http_cache_entry_t*  lru_prev;   /* More recently used */
+    ymo_http_cache_entry_t*  lru_next;   /* Less recently used */
+};
+
+/** Per-protocol response cache. */
+typedef struct ymo_http_cache {
+    size_t                   max_bytes;  /* 0, if disabled */
+    unsigned int             ttl;        /* Default TTL */
+    const struct ymo_http_proto_data* http_data; /* To dispatch waiters */
+    size_t                   no_vary;
+    char*                    vary[YMO_HTTP_CACHE_VARY_MAX];
+    ymo_http_cache_entry_t*  table[YMO_HTTP_CACHE_TABLE_SIZE];
+    ymo_http_cache_entry_t*  lru_head;
+    ymo_http_cache_entry_t*  lru_tail;
+    ymo_http_cache_stats_t   stats;
+} ymo_http_cache_t;
+
+/** Result of :c:func:`ymo_http_cache_lookup`. */
+typedef enum ymo_http_cache_result {
+    YMO_HTTP_CACHE_BYPASS, /* Not cacheable: invoke the handler */
+    YMO_HTTP_CACHE_MISS,   /* Invoke the handler; the response is stored */
+    YMO_HTTP_CACHE_HIT,    /* Response is complete */
+    YMO_HTTP_CACHE_WAIT,   /* Response is parked until the entry fills */
+} ymo_http_cache_result_t;
+
+
+/**---------------------------------------------------------------
+ * Functions
+ *---------------------------------------------------------------*/
+
+/** Create a response cache.
+ *
+ * :param max_bytes: byte budget
+ * :param ttl: default TTL, in seconds, for responses without ``max-age``
+ * :param vary: comma-separated request headers to key on, or NULL
+ * :param http_data: protocol data, used to dispatch requests which stop
+ *     waiting
+ * :returns: a new cache, or NULL with errno set (``EINVAL`` if ``vary``
+ *     names too many headers).
+ */
+ymo_http_cache_t* ymo_http_cache_create(
+        size_t max_bytes,
+        unsigned int ttl,
+        const char* vary,
+        const struct ymo_http_proto_data* http_data);
+
+/** Change the settings of an existing cache (see
+ * :c:func:`ymo_http_set_cache`). Stored entries are dropped.
+ *
+ * :returns: ``YMO_OKAY`` on success; ``EINVAL`` if ``vary`` names too many
+ *     headers (in which case, the cache is disabled); ``ENOMEM``.
+ */
+ymo_status_t ymo_http_cache_configure(
+        ymo_http_cache_t* cache,
+        size_t max_bytes,
+        unsigned int ttl,
+        const char* vary);
+
+/** Drop every entry which isn't being filled. */
+void ymo_http_cache_purge(ymo_http_cache_t* cache);
+
+/** Look a request up, before invoking the handler (and after content-coding
+ * negotiation).
+ *
+ * On a hit, the response is complete (and holds a reference to the cached
+ * object). On a miss, the response is the one which will fill the entry. On
+ * ``YMO_HTTP_CACHE_WAIT``, the request must be kept (as for a handler which
+ * returns ``YMO_WOULDBLOCK``) until the response is finished.
+ */
+ymo_http_cache_result_t ymo_http_cache_lookup(
+        ymo_http_cache_t* cache,
+        ymo_http_request_t* request,
+        ymo_http_response_t* response);
+
+/** Store a response which filled an entry (no-op for any other response),
+ * once its headers and body are final — i.e. just before the response is
+ * serialized. Uncacheable responses (see :c:func:`ymo_http_set_cache`)
+ * aren't stored, and requests waiting on them are handed to the handler.
+ */
+void ymo_http_cache_store(ymo_http_response_t* response);
+
+/** Release a response's hold on the cache: its cached object reference, its
+ * place in a wait list, or (if it was filling an entry) the entry itself.
+ */
+void ymo_http_cache_release(ymo_http_response_t* response);
+
+#endif /* YMO_HTTP_CACHE_H */
+
+
+
@@ -0,0 +1,935 @@
+/*=============================================================================
+ *
+ * Copyright (c) 2014 Andrew Canaday
+ *
+ * This file is part of libyimmo (sometimes referred to as "yimmo" or "ymo").
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *===========================================================================*/
+
+#include "yimmo_config.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+#include "yimmo.h"
+#include "ymo_log.h"
+#include "ymo_alloc.h"
+#include "ymo_http_compress.h"
+#include "ymo_http_response.h"
+
+/*---------------------------------------------------------------*
+ *  Declarations
+ *---------------------------------------------------------------*/
+
+#define COMPRESS_OWS(c) ((c) == ' ' || (c) == '\t')
+
+/* Size of the stack buffer used to read file buckets: */
+#define COMPRESS_FILE_BUF_SIZE 16384
+
+/* Encoder operations (mapped onto each library's equivalent): */
+typedef enum compress_op {
+    COMPRESS_PROCESS,
+    COMPRESS_FLUSH,
+    COMPRESS_FINISH,
+} compress_op_t;
+
+/* Compressed output, as it's produced: */
+typedef struct compress_out {
+    ymo_bucket_t* head;
+    ymo_bucket_t* tail;
+    char*         buf;   /* Current output buffer */
+    size_t        len;   /* Bytes used in buf */
+} compress_out_t;
+
+static const char* coding_names[YMO_HTTP_CODING_MAX] = {
+    "identity",
+    "br",
+    "zstd",
+    "gzip",
+    "deflate",
+};
+
+/* Compressible media types, other than text/ and +json/+xml suffixes: */
+static const char* compressible_types[] = {
+    "application/json",
+    "application/javascript",
+    "application/x-javascript",
+    "application/ecmascript",
+    "application/xml",
+    "application/x-www-form-urlencoded",
+    "application/graphql-response+json",
+    "application/wasm",
+    "application/x-ndjson",
+    "application/vnd.ms-fontobject",
+    "font/ttf",
+    "font/otf",
+    "image/svg+xml",
+    "image/x-icon",
+    "image/vnd.microsoft.icon",
+    "image/bmp",
+    NULL,
+};
+
+
+/*---------------------------------------------------------------*
+ *  Negotiation:
+ *---------------------------------------------------------------*/
+
+/* Parse a q-value ("1", "0.5", "0.125", ...) into thousandths: */
+static int parse_q(const char* p, const char* end)
+{
+    if( p == end || (*p != '0' && *p != '1') ) {
+        return -1;
+    }
+
+    int q = (*p++ - '0') * 1000;
+    if( p < end && *p == '.' ) {
+        ++p;
+        int scale = 100;
+        while( p < end && *p >= '0' && *p <= '9' ) {
+            q += (*p++ - '0') * scale;
+            scale /= 10;
+        }
+    }
+    return (p == end && q <= 1000) ? q : -1;
+}
+
+
+int ymo_http_accept_q(const char* value, const char* coding)
+{
+    size_t coding_len = strlen(coding);
+    int wildcard = 0;
+    const char* p = value;
+
+    while( *p )
+    {
+        while( COMPRESS_OWS(*p) || *p == ',' ) {
+            ++p;
+        }
+        if( !*p ) {
+            break;
+        }
+
+        const char* token = p;
+        while( *p && *p != ',' && *p != ';' && !COMPRESS_OWS(*p) ) {
+            ++p;
+        }
+        size_t token_len = (size_t)(p - token);
+
+        /* Parameters (we only care about q): */
+        int q = 1000;
+        while( *p && *p != ',' ) {
+            if( *p++ != ';' ) {
+                continue;
+            }
+            while( COMPRESS_OWS(*p) ) {
+                ++p;
+            }
+            if( (*p == 'q' || *p == 'Q') && p[1] == '=' ) {
+                const char* q_val = p + 2;
+                p = q_val;
+                while( *p && *p != ',' && *p != ';' && !COMPRESS_OWS(*p) ) {
+                    ++p;
+                }
+                q = parse_q(q_val, p);
+                if( q < 0 ) {
+                    q = 0;
+                }
+            }
+        }
+
+        if( token_len == coding_len
+                && !strncasecmp(token, coding, coding_len) ) {
+            return q;
+        }
+        if( token_len == 1 && *token == '*' ) {
+            wildcard = q;
+        }
+    }
+    return wildcard;
+}
+
+
+const char* ymo_http_coding_name(ymo_http_coding_t coding)
+{
+    return (coding < YMO_HTTP_CODING_MAX) ? coding_names[coding] : NULL;
+}
+
+
+int ymo_http_coding_available(ymo_http_coding_t coding)
+{
+    switch( coding ) {
+#ifdef HAVE_BROTLI
+        case YMO_HTTP_CODING_BR:
+            return 1;
+#endif /* HAVE_BROTLI */
+#ifdef HAVE_ZSTD
+        case YMO_HTTP_CODING_ZSTD:
+            return 1;
+#endif /* HAVE_ZSTD */
+#ifdef HAVE_ZLIB
+        case YMO_HTTP_CODING_GZIP:
+        case YMO_HTTP_CODING_DEFLATE:
+            return 1;
+#endif /* HAVE_ZLIB */
+        default:
+            return 0;
+    }
+}
+
+
+int ymo_http_compressible_type(const char* content_type)
+{
+    if( !content_type ) {
+        return 0;
+    }
+
+    /* Media type, sans parameters: */
+    size_t len = strcspn(content_type, "; \t");
+    if( len >= 5 && !strncasecmp(content_type, "text/", 5) ) {
+        /* Except for event streams, which are meant to be consumed as
+         * they're sent: */
+        return !(len == 17
+                && !strncasecmp(content_type, "text/event-stream", 17));
+    }
+
+    if( len > 5 && (!strncasecmp(content_type + len - 5, "+json", 5)
+                || !strncasecmp(content_type + len - 4, "+xml", 4)) ) {
+        return 1;
+    }
+
+    for( const char** t = compressible_types; *t; t++ ) {
+        if( strlen(*t) == len && !strncasecmp(content_type, *t, len) ) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+void ymo_http_compress_negotiate(
+        const ymo_http_compress_t* cfg,
+        const ymo_http_request_t* request,
+        ymo_http_response_t* response)
+{
+    if( !cfg || !cfg->level || !strcmp(request->method, "HEAD") ) {
+        return;
+    }
+
+    response->compress_pending = 1;
+    response->compress_coding = YMO_HTTP_CODING_IDENTITY;
+
+    const char* accept = ymo_http_hdr_table_get_id(
+            &request->headers, YMO_HTTP_HID_ACCEPT_ENCODING);
+    if( !accept ) {
+        return;
+    }
+
+    /* Highest q wins; ties go to the earlier (preferred) coding: */
+    int best_q = 0;
+    for( int c = YMO_HTTP_CODING_IDENTITY + 1; c < YMO_HTTP_CODING_MAX; c++ )
+    {
+        if( !ymo_http_coding_available(c) ) {
+            continue;
+        }
+
+        int q = ymo_http_accept_q(accept, coding_names[c]);
+        if( q > best_q ) {
+            best_q = q;
+            response->compress_coding = c;
+        }
+    }
+}
+
+
+/*---------------------------------------------------------------*
+ *  Encoders:
+ *---------------------------------------------------------------*/
+static ymo_status_t encoder_init(ymo_http_compressor_t* compressor)
+{
+    switch( compressor->coding ) {
+#ifdef HAVE_ZLIB
+        case YMO_HTTP_CODING_GZIP:
+        case YMO_HTTP_CODING_DEFLATE:
+            {
+                /* gzip wrapper (+16) or zlib wrapper (HTTP "deflate"): */
+                int w_bits = (compressor->coding == YMO_HTTP_CODING_GZIP)
+                    ? (MAX_WBITS + 16) : MAX_WBITS;
+                memset(&compressor->ctx.z, 0, sizeof(z_stream));
+                int rc = deflateInit2(&compressor->ctx.z, compressor->level,
+                        Z_DEFLATED, w_bits, 8, Z_DEFAULT_STRATEGY);
+                return (rc == Z_OK) ? YMO_OKAY
+                       : (rc == Z_MEM_ERROR) ? ENOMEM : EINVAL;
+            }
+#endif /* HAVE_ZLIB */
+#ifdef HAVE_BROTLI
+        case YMO_HTTP_CODING_BR:
+            compressor->ctx.br = BrotliEncoderCreateInstance(NULL, NULL, NULL);
+            if( !compressor->ctx.br ) {
+                return ENOMEM;
+            }
+            BrotliEncoderSetParameter(compressor->ctx.br,
+                    BROTLI_PARAM_QUALITY, (uint32_t)compressor->level);
+            BrotliEncoderSetParameter(compressor->ctx.br,
+                    BROTLI_PARAM_LGWIN, YMO_HTTP_COMPRESS_BROTLI_LGWIN);
+            return YMO_OKAY;
+#endif /* HAVE_BROTLI */
+#ifdef HAVE_ZSTD
+        case YMO_HTTP_CODING_ZSTD:
+            compressor->ctx.zstd = ZSTD_createCCtx();
+            if( !compressor->ctx.zstd ) {
+                return ENOMEM;
+            }
+            ZSTD_CCtx_setParameter(compressor->ctx.zstd,
+                    ZSTD_c_compressionLevel, compressor->level);
+            return YMO_OKAY;
+#endif /* HAVE_ZSTD */
+        default:
+            return ENOTSUP;
+    }
+}
+
+
+/* Prepare a pooled encoder for a new stream at the given level: */
+static ymo_status_t encoder_reset(
+        ymo_http_compressor_t* compressor, int level)
+{
+    switch( compressor->coding ) {
+#ifdef HAVE_ZLIB
+        case YMO_HTTP_CODING_GZIP:
+        case YMO_HTTP_CODING_DEFLATE:
+            if( deflateReset(&compressor->ctx.z) != Z_OK ) {
+                return EINVAL;
+            }
+            if( level != compressor->level
+                    && deflateParams(&compressor->ctx.z,
+                        level, Z_DEFAULT_STRATEGY) != Z_OK ) {
+                return EINVAL;
+            }
+            break;
+#endif /* HAVE_ZLIB */
+#ifdef HAVE_BROTLI
+        case YMO_HTTP_CODING_BR:
+            /* No reset in the brotli API; we pool the allocation, at least: */
+            BrotliEncoderDestroyInstance(compressor->ctx.br);
+            compressor->level = level;
+            return encoder_init(compressor);
+#endif /* HAVE_BROTLI */
+#ifdef HAVE_ZSTD
+        case YMO_HTTP_CODING_ZSTD:
+            ZSTD_CCtx_reset(compressor->ctx.zstd, ZSTD_reset_session_only);
+            if( level != compressor->level ) {
+                ZSTD_CCtx_setParameter(compressor->ctx.zstd,
+                        ZSTD_c_compressionLevel, level);
+            }
+            break;
+#endif /* HAVE_ZSTD */
+        default:
+            return ENOTSUP;
+    }
+    compressor->level = level;
+    return YMO_OKAY;
+}
+
+
+static void encoder_free(ymo_http_compressor_t* compressor)
+{
+    switch( compressor->coding ) {
+#ifdef HAVE_ZLIB
+        case YMO_HTTP_CODING_GZIP:
+        case YMO_HTTP_CODING_DEFLATE:
+            deflateEnd(&compressor->ctx.z);
+            break;
+#endif /* HAVE_ZLIB */
+#ifdef HAVE_BROTLI
+        case YMO_HTTP_CODING_BR:
+            BrotliEncoderDestroyInstance(compressor->ctx.br);
+            break;
+#endif /* HAVE_BROTLI */
+#ifdef HAVE_ZSTD
+        case YMO_HTTP_CODING_ZSTD:
+            ZSTD_freeCCtx(compressor->ctx.zstd);
+            break;
+#endif /* HAVE_ZSTD */
+        default:
+            break;
+    }
+}
+
+
+/* Make sure there's room in the current output buffer (moving a full one
+ * onto the output list):
+ */
+static ymo_status_t out_reserve(compress_out_t* out)
+{
+    if( out->buf && out->len < YMO_HTTP_COMPRESS_OUT_SIZE ) {
+        return YMO_OKAY;
+    }
+
+    if( out->buf ) {
+        ymo_bucket_t* bucket = ymo_bucket_create(out->tail, NULL,
+                out->buf, YMO_HTTP_COMPRESS_OUT_SIZE, out->buf, out->len);
+        if( !bucket ) {
+            return ENOMEM;
+        }
+        if( !out->head ) {
+            out->head = bucket;
+        }
+        out->tail = bucket;
+    }
+
+    out->buf = YMO_ALLOC(YMO_HTTP_COMPRESS_OUT_SIZE);
+    out->len = 0;
+    return out->buf ? YMO_OKAY : ENOMEM;
+}
+
+
+/* Move the final (partial) output buffer onto the output list: */
+static ymo_status_t out_close(compress_out_t* out)
+{
+    if( !out->buf ) {
+        return YMO_OKAY;
+    }
+
+    if( !out->len ) {
+        YMO_FREE(out->buf);
+        out->buf = NULL;
+        return YMO_OKAY;
+    }
+
+    ymo_bucket_t* bucket = ymo_bucket_create(out->tail, NULL,
+            out->buf, YMO_HTTP_COMPRESS_OUT_SIZE, out->buf, out->len);
+    if( !bucket ) {
+        return ENOMEM;
+    }
+    if( !out->head ) {
+        out->head = bucket;
+    }
+    out->tail = bucket;
+    out->buf = NULL;
+    return YMO_OKAY;
+}
+
+
+/* Run in_len bytes of input through the encoder: */
+static ymo_status_t encoder_run(
+        ymo_http_compressor_t* compressor,
+        const char* in, size_t in_len,
+        compress_op_t op,
+        compress_out_t* out)
+{
+    ymo_status_t status;
+
+    switch( compressor->coding ) {
+#ifdef HAVE_ZLIB
+        case YMO_HTTP_CODING_GZIP:
+        case YMO_HTTP_CODING_DEFLATE:
+            {
+                static const int z_flush[] = {
+                    Z_NO_FLUSH, Z_SYNC_FLUSH, Z_FINISH
+                };
+                z_stream* z = &compressor->ctx.z;
+                z->next_in = (Bytef*)in;
+                z->avail_in = (uInt)in_len;
+                for( ;; ) {
+                    if( (status = out_reserve(out)) != YMO_OKAY ) {
+                        return status;
+                    }
+                    size_t avail = YMO_HTTP_COMPRESS_OUT_SIZE - out->len;
+                    z->next_out = (Bytef*)(out->buf + out->len);
+                    z->avail_out = (uInt)avail;
+                    int rc = deflate(z, z_flush[op]);
+                    out->len += avail - z->avail_out;
+
+                    if( rc == Z_STREAM_ERROR ) {
+                        return EINVAL;
+                    }
+                    if( op == COMPRESS_FINISH ) {
+                        if( rc == Z_STREAM_END ) {
+                            break;
+                        }
+                    } else if( !z->avail_in && z->avail_out ) {
+                        break;
+                    }
+                }
+                return YMO_OKAY;
+            }
+#endif /* HAVE_ZLIB */
+#ifdef HAVE_BROTLI
+        case YMO_HTTP_CODING_BR:
+            {
+                static const BrotliEncoderOperation br_op[] = {
+                    BROTLI_OPERATION_PROCESS,
+                    BROTLI_OPERATION_FLUSH,
+                    BROTLI_OPERATION_FINISH,
+                };
+                const uint8_t* next_in = (const uint8_t*)in;
+                size_t avail_in = in_len;
+                for( ;; ) {
+                    if( (status = out_reserve(out)) != YMO_OKAY ) {
+                        return status;
+                    }
+                    size_t avail = YMO_HTTP_COMPRESS_OUT_SIZE - out->len;
+                    size_t avail_out = avail;
+                    uint8_t* next_out = (uint8_t*)(out->buf + out->len);
+                    if( !BrotliEncoderCompressStream(compressor->ctx.br,
+                                br_op[op], &avail_in, &next_in,
+                                &avail_out, &next_out, NULL) ) {
+                        return EINVAL;
+                    }
+                    out->len += avail - avail_out;
+
+                    if( !avail_in
+                            && !BrotliEncoderHasMoreOutput(compressor->ctx.br)
+                            && (op != COMPRESS_FINISH
+                                || BrotliEncoderIsFinished(compressor->ctx.br)) ) {
+                        break;
+                    }
+                }
+                return YMO_OKAY;
+            }
+#endif /* HAVE_BROTLI */
+#ifdef HAVE_ZSTD
+        case YMO_HTTP_CODING_ZSTD:
+            {
+                static const ZSTD_EndDirective zstd_op[] = {
+                    ZSTD_e_continue, ZSTD_e_flush, ZSTD_e_end,
+                };
+                ZSTD_inBuffer zin = { in, in_len, 0 };
+                for( ;; ) {
+                    if( (status = out_reserve(out)) != YMO_OKAY ) {
+                        return status;
+                    }
+                    ZSTD_outBuffer zout = {
+                        out->buf + out->len,
+                        YMO_HTTP_COMPRESS_OUT_SIZE - out->len,
+                        0
+                    };
+                    size_t remain = ZSTD_compressStream2(
+                            compressor->ctx.zstd, &zout, &zin, zstd_op[op]);
+                    out->len += zout.pos;
+
+                    if( ZSTD_isError(remain) ) {
+                        return EINVAL;
+                    }
+                    if( op == COMPRESS_PROCESS ) {
+                        if( zin.pos == zin.size && zout.pos < zout.size ) {
+                            break;
+                        }
+                    } else if( !remain ) {
+                        break;
+                    }
+                }
+                return YMO_OKAY;
+            }
+#endif /* HAVE_ZSTD */
+        default:
+            return ENOTSUP;
+    }
+}
+
+
+/* Run a single input bucket through the encoder: */
+static ymo_status_t encoder_bucket(
+        ymo_http_compressor_t* compressor,
+        const ymo_bucket_t* bucket,
+        compress_out_t* out)
+{
+    if( bucket->fd < 0 ) {
+        return encoder_run(compressor,
+                bucket->data, bucket->len, COMPRESS_PROCESS, out);
+    }
+
+    char buf[COMPRESS_FILE_BUF_SIZE];
+    size_t done = 0;
+    while( done < bucket->len )
+    {
+        size_t r_len = YMO_MIN(bucket->len - done, sizeof(buf));
+        ssize_t n = pread(bucket->fd, buf, r_len, bucket->offset + done);
+        if( n < 0 && errno == EINTR ) {
+            continue;
+        }
+        if( n <= 0 ) {
+            return n ? errno : EIO;
+        }
+
+        ymo_status_t status = encoder_run(
+                compressor, buf, (size_t)n, COMPRESS_PROCESS, out);
+        if( status != YMO_OKAY ) {
+            return status;
+        }
+        done += (size_t)n;
+    }
+    return YMO_OKAY;
+}
+
+
+/*---------------------------------------------------------------*
+ *  Compressor Pool:
+ *---------------------------------------------------------------*/
+static ymo_http_compressor_t* compressor_acquire(
+        ymo_http_compress_t* cfg, ymo_http_coding_t coding, int level)
+{
+    ymo_http_compressor_t* compressor = cfg->pool[coding];
+    if( compressor ) {
+        cfg->pool[coding] = compressor->next;
+        cfg->pool_len[coding]--;
+        compressor->next = NULL;
+
+        if( encoder_reset(compressor, level) == YMO_OKAY ) {
+            return compressor;
+        }
+
+        /* Shouldn't happen, but start fresh if it does: */
+        encoder_free(compressor);
+        YMO_DELETE(ymo_http_compressor_t, compressor);
+    }
+
+    compressor = YMO_NEW0(ymo_http_compressor_t);
+    if( !compressor ) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    compressor->cfg = cfg;
+    compressor->coding = coding;
+    compressor->level = level;
+
+    ymo_status_t status = encoder_init(compressor);
+    if( status != YMO_OKAY ) {
+        YMO_DELETE(ymo_http_compressor_t, compressor);
+        errno = status;
+        return NULL;
+    }
+    return compressor;
+}
+
+
+void ymo_http_compress_release(ymo_http_compressor_t* compressor)
+{
+    if( !compressor ) {
+        return;
+    }
+
+    ymo_bucket_free_all(compressor->in_head);
+    compressor->in_head = compressor->in_tail = NULL;
+
+    ymo_http_compress_t* cfg = compressor->cfg;
+    if( cfg->pool_len[compressor->coding] < YMO_HTTP_COMPRESS_POOL_MAX ) {
+        compressor->next = cfg->pool[compressor->coding];
+        cfg->pool[compressor->coding] = compressor;
+        cfg->pool_len[compressor->coding]++;
+        return;
+    }
+
+    encoder_free(compressor);
+    YMO_DELETE(ymo_http_compressor_t, compressor);
+}
+
+
+/*---------------------------------------------------------------*
+ *  Settings:
+ *---------------------------------------------------------------*/
+ymo_http_compress_t* ymo_http_compress_create(int level, size_t min_size)
+{
+    int available = 0;
+    for( int c = YMO_HTTP_CODING_IDENTITY + 1; c < YMO_HTTP_CODING_MAX; c++ ) {
+        available |= ymo_http_coding_available(c);
+    }
+    if( !available ) {
+        errno = ENOTSUP;
+        return NULL;
+    }
+
+    ymo_http_compress_t* cfg = YMO_NEW0(ymo_http_compress_t);
+    if( !cfg ) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    cfg->level = level;
+    cfg->min_size = min_size;
+    return cfg;
+}
+
+
+void ymo_http_compress_drain(ymo_http_compress_t* cfg)
+{
+    if( !cfg ) {
+        return;
+    }
+
+    for( int c = 0; c < YMO_HTTP_CODING_MAX; c++ )
+    {
+        ymo_http_compressor_t* compressor = cfg->pool[c];
+        while( compressor ) {
+            ymo_http_compressor_t* next = compressor->next;
+            encoder_free(compressor);
+            YMO_DELETE(ymo_http_compressor_t, compressor);
+            compressor = next;
+        }
+        cfg->pool[c] = NULL;
+        cfg->pool_len[c] = 0;
+    }
+}
+
+
+void ymo_http_compress_free(ymo_http_compress_t* cfg)
+{
+    ymo_http_compress_drain(cfg);
+    YMO_DELETE(ymo_http_compress_t, cfg);
+}
+
+
+/*---------------------------------------------------------------*
+ *  Filter:
+ *---------------------------------------------------------------*/
+
+/* Non-zero if the (comma-separated) header value lists token: */
+static int has_token(const char* value, const char* token)
+{
+    size_t token_len = strlen(token);
+    const char* p = value;
+    while( *p )
+    {
+        while( COMPRESS_OWS(*p) || *p == ',' ) {
+            ++p;
+        }
+        const char* start = p;
+        while( *p && *p != ',' && !COMPRESS_OWS(*p) ) {
+            ++p;
+        }
+        if( (size_t)(p - start) == token_len
+                && !strncasecmp(start, token, token_len) ) {
+            return 1;
+        }
+        while( *p && *p != ',' ) {
+            ++p;
+        }
+    }
+    return 0;
+}
+
+
+/* Can this response be compressed (regardless of what the client accepts)? */
+static int compress_eligible(
+        const ymo_http_response_t* response, int complete)
+{
+    const ymo_http_hdr_table_t* hdrs = &response->headers;
+    ymo_http_status_t status = response->status;
+
+    if( response->canned || response->proto_new
+            || status < 200
+            || status == YMO_HTTP_NO_CONTENT
+            || status == YMO_HTTP_PARTIAL_CONTENT
+            || status == YMO_HTTP_NOT_MODIFIED ) {
+        return 0;
+    }
+
+    /* Already encoded, or framed by the application: */
+    if( ymo_http_hdr_table_get_id(hdrs, YMO_HTTP_HID_CONTENT_ENCODING)
+            || ymo_http_hdr_table_get_id(
+                hdrs, YMO_HTTP_HID_TRANSFER_ENCODING) ) {
+        return 0;
+    }
+
+    /* A Content-Length we can't rewrite: */
+    if( !complete && ymo_http_hdr_table_get_id(
+                hdrs, YMO_HTTP_HID_CONTENT_LENGTH) ) {
+        return 0;
+    }
+
+    const char* cache_control = ymo_http_hdr_table_get_id(
+            hdrs, YMO_HTTP_HID_CACHE_CONTROL);
+    if( cache_control && has_token(cache_control, "no-transform") ) {
+        return 0;
+    }
+
+    if( !ymo_http_compressible_type(ymo_http_hdr_table_get_id(
+                    hdrs, YMO_HTTP_HID_CONTENT_TYPE)) ) {
+        return 0;
+    }
+
+    /* Files are better served by sendfile (or precompressed siblings): */
+    for( const ymo_bucket_t* b = response->body_head; b; b = b->next ) {
+        if( b->fd >= 0 ) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+
+ymo_status_t ymo_http_compress_start(
+        ymo_http_compress_t* cfg, ymo_http_response_t* response)
+{
+    if( !response->compress_pending ) {
+        return YMO_OKAY;
+    }
+    response->compress_pending = 0;
+
+    int complete = (response->flags & YMO_HTTP_RESPONSE_COMPLETE);
+    int level = (response->compress_level == YMO_HTTP_COMPRESS_DEFAULT)
+        ? cfg->level : response->compress_level;
+    if( level <= 0 || !compress_eligible(response, complete) ) {
+        return YMO_OKAY;
+    }
+
+    /* Too small to bother? */
+    if( complete ) {
+        size_t body_len = ymo_bucket_len_all(response->body_head);
+        if( body_len < cfg->min_size ) {
+            return YMO_OKAY;
+        }
+    }
+
+    /* The representation varies, even if this client gets identity: */
+    const char* vary = ymo_http_hdr_table_get_id(
+            &response->headers, YMO_HTTP_HID_VARY);
+    if( !vary || !(has_token(vary, "*")
+                || has_token(vary, "Accept-Encoding")) ) {
+        ymo_http_hdr_table_add_precompute(&response->headers,
+                YMO_HTTP_HID_VARY, "Vary", sizeof("Vary")-1,
+                "Accept-Encoding");
+    }
+
+    ymo_http_coding_t coding = response->compress_coding;
+    if( coding == YMO_HTTP_CODING_IDENTITY ) {
+        return YMO_OKAY;
+    }
+
+    ymo_http_compressor_t* compressor = compressor_acquire(cfg, coding, level);
+    if( !compressor ) {
+        return errno;
+    }
+
+    ymo_http_hdr_table_insert_precompute(&response->headers,
+            YMO_HTTP_HID_CONTENT_ENCODING,
+            "Content-Encoding", sizeof("Content-Encoding")-1,
+            coding_names[coding]);
+
+    /* Hand the body so far to the compressor: */
+    compressor->in_head = response->body_head;
+    compressor->in_tail = response->body_tail;
+    response->body_head = response->body_tail = NULL;
+    response->compressor = compressor;
+
+    if( !complete ) {
+        return YMO_OKAY;
+    }
+
+    ymo_status_t status = ymo_http_compress_flush(response);
+    if( status != YMO_OKAY ) {
+        return status;
+    }
+
+    /* Fix up any application-supplied content length: */
+    if( ymo_http_hdr_table_get_id(
+                &response->headers, YMO_HTTP_HID_CONTENT_LENGTH) ) {
+        sprintf(response->content_len_str, "%zu",
+                ymo_bucket_len_all(response->body_head));
+        ymo_http_hdr_table_insert_precompute(&response->headers,
+                YMO_HTTP_HID_CONTENT_LENGTH,
+                "Content-Length", sizeof("Content-Length")-1,
+                response->content_len_str);
+    }
+    return YMO_OKAY;
+}
+
+
+void ymo_http_compress_queue(
+        ymo_http_compressor_t* compressor, ymo_bucket_t* body_data)
+{
+    if( compressor->in_head ) {
+        compressor->in_tail = ymo_bucket_append(
+                compressor->in_tail, body_data);
+    } else {
+        compressor->in_head = body_data;
+        compressor->in_tail = ymo_bucket_append(NULL, body_data);
+    }
+}
+
+
+ymo_status_t ymo_http_compress_flush(ymo_http_response_t* response)
+{
+    ymo_http_compressor_t* compressor = response->compressor;
+    if( !compressor ) {
+        return YMO_OKAY;
+    }
+
+    int complete = (response->flags & YMO_HTTP_RESPONSE_COMPLETE);
+    if( !compressor->in_head && !complete ) {
+        return YMO_OKAY;
+    }
+
+    ymo_status_t status = YMO_OKAY;
+    compress_out_t out = { NULL, NULL, NULL, 0 };
+
+    /* Consume input a bucket at a time, releasing it as we go: */
+    while( compressor->in_head )
+    {
+        ymo_bucket_t* bucket = compressor->in_head;
+        compressor->in_head = bucket->next;
+        bucket->next = NULL;
+
+        status = encoder_bucket(compressor, bucket, &out);
+        ymo_bucket_free(bucket);
+        if( status != YMO_OKAY ) {
+            goto flush_bail;
+        }
+    }
+    compressor->in_tail = NULL;
+
+    status = encoder_run(compressor, NULL, 0,
+            complete ? COMPRESS_FINISH : COMPRESS_FLUSH, &out);
+    if( status != YMO_OKAY || (status = out_close(&out)) != YMO_OKAY ) {
+        goto flush_bail;
+    }
+
+    if( out.head ) {
+        if( response->body_head ) {
+            ymo_bucket_append(response->body_tail, out.head);
+        } else {
+            response->body_head = out.head;
+        }
+        response->body_tail = out.tail;
+    }
+
+    if( complete ) {
+        response->compressor = NULL;
+        ymo_http_compress_release(compressor);
+    }
+    return YMO_OKAY;
+
+flush_bail:
+    ymo_log_debug("Compression failed for %p: %s",
+            (void*)response, strerror(status));
+    if( out.buf ) {
+        YMO_FREE(out.buf);
+    }
+    ymo_bucket_free_all(out.head);
+
+    /* The encoder state is suspect; don't pool it: */
+    response->compressor = NULL;
+    ymo_bucket_free_all(compressor->in_head);
+    encoder_free(compressor);
+    YMO_DELETE(ymo_http_compressor_t, compressor);
+    return status;
+}
+
+
@@ -0,0 +1,222 @@
+/*=============================================================================
+ *
+ * Copyright (c) 2014 Andrew Canaday
+ *
+ * This file is part of libyimmo (sometimes referred to as "yimmo" or "ymo").
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *===========================================================================*/
+
+
+
+#ifndef YMO_HTTP_COMPRESS_H
+#define YMO_HTTP_COMPRESS_H
+#include "yimmo_config.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif /* HAVE_ZLIB */
+
+#ifdef HAVE_BROTLI
+#include <brotli/encode.h>
+#endif /* HAVE_BROTLI */
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif /* HAVE_ZSTD */
+
+#include "yimmo.h"
+#include "core/ymo_bucket.h"
+#include "ymo_http.h"
+
+/** Compression
+ * =============
+ *
+ * Response compression filter (see :c:func:`ymo_http_set_compression`).
+ *
+ * The filter sits between :c:func:`ymo_http_response_body_append` and the
+ * protocol write callbacks:
+ *
+ * 1. Before the user callback is invoked, the request ``Accept-Encoding`` is
+ *    matched against the available codings
+ *    (:c:func:`ymo_http_compress_negotiate`).
+ * 2. When the response headers are about to be serialized,
+ *    :c:func:`ymo_http_compress_start` decides whether to compress at all
+ *    (status, ``Content-Type``, length, existing ``Content-Encoding``, etc).
+ *    If so, a compressor is taken from the protocol's pool and the body data
+ *    appended so far is handed to it.
+ * 3. From then on, appended body data is queued on the compressor.
+ *    :c:func:`ymo_http_compress_flush` runs it through the encoder before
+ *    each write, using a sync flush (so streamed responses aren't held up)
+ *    or, once the response is complete, finishing the stream and returning
+ *    the compressor to the pool.
+ *
+ * Output is produced in ``YMO_HTTP_COMPRESS_OUT_SIZE`` buckets and input
+ * buckets are released as they're consumed, so memory use per response is
+ * bounded by the encoder state, plus whatever the application has queued.
+ *
+ * Encoder state (~256KB for zlib at the default settings) is kept in a
+ * per-protocol (and so, per-loop) free list, rather than being allocated
+ * for each response.
+ */
+
+/**---------------------------------------------------------------
+ * Definitions
+ *---------------------------------------------------------------*/
+
+/** Default compression level (zlib scale). */
+#define YMO_HTTP_COMPRESS_LEVEL 6
+
+/** Default minimum body length, for complete responses. */
+#define YMO_HTTP_COMPRESS_MIN_SIZE 256
+
+/** Size of each compressed output bucket. */
+#define YMO_HTTP_COMPRESS_OUT_SIZE 8192
+
+/** Maximum number of idle compressors kept, per coding. */
+#define YMO_HTTP_COMPRESS_POOL_MAX 32
+
+/** Brotli window size (log2), to bound encoder memory. */
+#define YMO_HTTP_COMPRESS_BROTLI_LGWIN 18
+
+
+/**---------------------------------------------------------------
+ * Types
+ *---------------------------------------------------------------*/
+
+/** Content codings, in order of server preference. */
+typedef enum ymo_http_coding {
+    YMO_HTTP_CODING_IDENTITY = 0,
+    YMO_HTTP_CODING_BR,
+    YMO_HTTP_CODING_ZSTD,
+    YMO_HTTP_CODING_GZIP,
+    YMO_HTTP_CODING_DEFLATE,
+    YMO_HTTP_CODING_MAX,
+} ymo_http_coding_t;
+
+typedef struct ymo_http_compressor ymo_http_compressor_t;
+
+/** Per-protocol compression settings and compressor pool. */
+typedef struct ymo_http_compress {
+    int                     level;       /* Default level; 0 to disable */
+    size_t                  min_size;    /* Don't compress smaller bodies */
+    ymo_http_compressor_t*  pool[YMO_HTTP_CODING_MAX];
+    size_t                  pool_len[YMO_HTTP_CODING_MAX];
+} ymo_http_compress_t;
+
+/** Encoder state for a single response. */
+struct ymo_http_compressor {
+    ymo_http_compress_t*    cfg;
+    ymo_http_coding_t       coding;
+    int                     level;
+    ymo_bucket_t*           in_head;     /* Queued (raw) body data */
+    ymo_bucket_t*           in_tail;
+    ymo_http_compressor_t*  next;        /* Pool free list */
+    union {
+#ifdef HAVE_ZLIB
+        z_stream            z;
+#endif /* HAVE_ZLIB */
+#ifdef HAVE_BROTLI
+        BrotliEncoderState* br;
+#endif /* HAVE_BROTLI */
+#ifdef HAVE_ZSTD
+        ZSTD_CCtx*          zstd;
+#endif /* HAVE_ZSTD */
+        void*               none;
+    } ctx;
+};
+
+
+/**---------------------------------------------------------------
+ * Functions
+ *---------------------------------------------------------------*/
+
+/** Weight given to a content coding by an ``Accept-Encoding`` value.
+ *
+ * :param value: the ``Accept-Encoding`` header value
+ * :param coding: content coding name (e.g. ``"gzip"``)
+ * :returns: the q-value, in thousandths (0–1000); 0 if the coding isn't
+ *     acceptable (including via ``*``).
+ */
+int ymo_http_accept_q(const char* value, const char* coding);
+
+/** Content coding name (e.g. ``"gzip"``). */
+const char* ymo_http_coding_name(ymo_http_coding_t coding);
+
+/** Non-zero if the coding is compiled in. */
+int ymo_http_coding_available(ymo_http_coding_t coding);
+
+/** Non-zero if a ``Content-Type`` is worth compressing (text, JSON, XML,
+ * JavaScript, SVG, etc — i.e. not already-compressed media or archives).
+ */
+int ymo_http_compressible_type(const char* content_type);
+
+/** Create compression settings.
+ *
+ * :returns: a new instance, or NULL with errno set (``ENOTSUP`` if no
+ *     codings are compiled in).
+ */
+ymo_http_compress_t* ymo_http_compress_create(int level, size_t min_size);
+
+/** Free any idle (pooled) compressors. */
+void ymo_http_compress_drain(ymo_http_compress_t* cfg);
+
+/** Free compression settings and any pooled compressors. */
+void ymo_http_compress_free(ymo_http_compress_t* cfg);
+
+/** Pick a content coding for the response, based on the request's
+ * ``Accept-Encoding`` (no-op if ``cfg`` is NULL or disabled).
+ */
+void ymo_http_compress_negotiate(
+        const ymo_http_compress_t* cfg,
+        const ymo_http_request_t* request,
+        ymo_http_response_t* response);
+
+/** Decide whether or not to compress the response, once its headers and
+ * (possibly partial) body are in hand. If compressing, sets
+ * ``Content-Encoding``, moves the existing body onto a compressor and, if
+ * the response is complete, compresses it (updating any application-supplied
+ * ``Content-Length``).
+ *
+ * Adds ``Vary: Accept-Encoding`` to eligible responses, whether compressed
+ * or not. Only evaluated once per response.
+ *
+ * :returns: YMO_OKAY on success (whether or not compression is used);
+ *     ENOMEM or EINVAL on encoder failure.
+ */
+ymo_status_t ymo_http_compress_start(
+        ymo_http_compress_t* cfg, ymo_http_response_t* response);
+
+/** Queue raw body data on an active compressor. */
+void ymo_http_compress_queue(
+        ymo_http_compressor_t* compressor, ymo_bucket_t* body_data);
+
+/** Compress any queued body data onto the response body. If the response
+ * is complete, the stream is finished and the compressor is released.
+ *
+ * :returns: YMO_OKAY on success (or if the response isn't compressed);
+ *     ENOMEM, EINVAL, or EIO (file bucket read) on failure.
+ */
+ymo_status_t ymo_http_compress_flush(ymo_http_response_t* response);
+
+/** Return a response's compressor to the pool (discarding queued data). */
+void ymo_http_compress_release(ymo_http_compressor_t* compressor);
+
+#endif /* YMO_HTTP_COMPRESS_H */
+
+
+
@@ -20,6 +20,7 @@
 
 #include "yimmo_config.h"
 
+#include <errno.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <string.h>
@@ -27,8 +28,10 @@
 #include "yimmo.h"
 #include "ymo_log.h"
 #include "ymo_alloc.h"
+#include "ymo_util.h"
 #include "ymo_http_exchange.h"
 #include "ymo_http_hdr_table.h"
+#include "ymo_http_body.h"
 
 const char* ymo_http_state_names[] = {
     "HTTP_STATE_CONNECTED",
@@ -44,36 +47,107 @@ const char* ymo_http_state_names[] = {
     "HTTP_STATE_HEADERS_COMPLETE",
     "HTTP_STATE_EXPECT",
     "HTTP_STATE_BODY_CHUNK_HEADER",
+    "HTTP_STATE_BODY_CHUNK_EXT",
     "HTTP_STATE_BODY",
+    "HTTP_STATE_BODY_CHUNK_CR",
+    "HTTP_STATE_BODY_CHUNK_LF",
     "HTTP_STATE_BODY_CHUNK_TRAILER",
+    "HTTP_STATE_BODY_TRAILER_FIELD",
     "HTTP_STATE_COMPLETE",
 };
 
 
+/* Release the request body (buffered or spooled) and multipart parser: */
+static void exchange_body_free(ymo_http_request_t* request)
+{
+    if( request->multipart ) {
+        ymo_http_multipart_free(request->multipart);
+        request->multipart = NULL;
+    }
+
+    if( request->body_spool ) {
+        ymo_http_body_free(request->body_spool);
+        request->body_spool = NULL;
+    } else if( request->body ) {
+        YMO_FREE(request->body);
+    }
+    request->body = NULL;
+}
+
+
+/* Release overflow header blocks, returning to recv_buf: */
+static void exchange_hdr_free(ymo_http_exchange_t* exchange)
+{
+    ymo_http_hdr_block_t* block = exchange->hdr_blocks;
+    while( block ) {
+        ymo_http_hdr_block_t* next = block->next;
+        YMO_FREE(block);
+        block = next;
+    }
+    exchange->hdr_blocks = NULL;
+    exchange->hdr_size = YMO_HTTP_RECV_BUF_SIZE;
+    exchange->recv_current = exchange->recv_buf;
+    exchange->remain = YMO_HTTP_RECV_BUF_SIZE;
+}
+
+
+/* Free the exchange itself (see ymo_http_exchange_free): */
+static void exchange_destroy(ymo_http_exchange_t* exchange)
+{
+    ymo_http_hdr_table_clear(&exchange->request.headers);
+
+    if( exchange->request.ws ) {
+        ymo_blalloc_free(exchange->request.ws);
+    }
+
+    exchange_body_free(&exchange->request);
+    exchange_hdr_free(exchange);
+    ymo_http_response_clear(&exchange->response);
+    YMO_FREE(exchange->response.head_buf);
+    YMO_DELETE(ymo_http_exchange_t, exchange);
+}
+
+
 ymo_http_exchange_t* ymo_http_exchange_create(void)
 {
     ymo_http_exchange_t* exchange = YMO_NEW0(ymo_http_exchange_t);
-    if( exchange ) {
-        ymo_http_exchange_reset(exchange);
-        ymo_http_hdr_table_init(&exchange->request.headers);
-
-        exchange->request.ws = ymo_blalloc_create(YMO_HTTP_REQ_WS_SIZE);
-        if( !exchange->request.ws ) {
-            ymo_http_exchange_free(exchange);
-            exchange = NULL;
-            errno = ENOMEM;
-        }
-
-        exchange->h_id = YMO_HTTP_HDR_HASH_INIT();
-        exchange->request.content_length = 0;
-        exchange->recv_current = exchange->recv_buf;
-        exchange->request.method = exchange->recv_buf;
-        exchange->state = HTTP_STATE_CONNECTED;
-        exchange->remain = YMO_HTTP_RECV_BUF_SIZE;
-    } else {
+    if( !exchange ) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    ymo_http_hdr_table_init(&exchange->request.headers);
+    ymo_http_hdr_table_init(&exchange->response.headers);
+    exchange->response.embedded = 1;
+    ymo_http_exchange_reset(exchange);
+
+    exchange->request.ws = ymo_blalloc_create(YMO_HTTP_REQ_WS_SIZE);
+    if( !exchange->request.ws ) {
+        exchange_destroy(exchange);
         errno = ENOMEM;
+        return NULL;
     }
 
+    exchange->hdr_max = YMO_HTTP_HDR_MAX_DEFAULT;
+    return exchange;
+}
+
+
+ymo_http_exchange_t* ymo_http_exchange_acquire(
+        ymo_http_exchange_pool_t* pool)
+{
+    ymo_http_exchange_t* exchange = pool ? pool->idle : NULL;
+    if( exchange ) {
+        pool->idle = exchange->next;
+        pool->len--;
+        exchange->next = NULL;
+        return exchange;
+    }
+
+    exchange = ymo_http_exchange_create();
+    if( exchange ) {
+        exchange->pool = pool;
+    }
     return exchange;
 }
 
@@ -92,6 +166,9 @@ void ymo_http_exchange_reset(ymo_http_exchange_t* exchange)
     exchange->request.content_length = 0;
     exchange->request.body_received = 0;
     exchange->request.flags = 0;
+    exchange->request.params = NULL;
+    exchange->request.no_params = 0;
+    exchange_body_free(&exchange->request);
     ymo_http_hdr_table_clear(&exchange->request.headers);
 
     if( exchange->request.ws ) {
@@ -100,15 +177,67 @@ void ymo_http_exchange_reset(ymo_http_exchange_t* exchange)
 
     /* ymo_http_exchange_t: */
     exchange->hdr_name = exchange->hdr_value = NULL;
-    exchange->h_id = YMO_HTTP_HDR_HASH_INIT();
+    exchange->h_id = YMO_HTTP_HID_NONE;
     exchange->state = HTTP_STATE_CONNECTED;
     exchange->next_state = 0;
-    exchange->recv_current = exchange->recv_buf;
-    exchange->remain = YMO_HTTP_RECV_BUF_SIZE;
+    exchange_hdr_free(exchange);
+
+    /* The response keeps its head buffer: */
+    ymo_http_response_clear(&exchange->response);
     return;
 }
 
 
+char* ymo_http_exchange_grow(
+        ymo_http_exchange_t* exchange, const char* keep, size_t need)
+{
+    size_t keep_len = keep ? (size_t)(exchange->recv_current - keep) : 0;
+    ymo_http_hdr_block_t* last = exchange->hdr_blocks;
+    size_t last_size = last ? last->size : YMO_HTTP_RECV_BUF_SIZE;
+    size_t avail = (exchange->hdr_max > exchange->hdr_size)
+        ? exchange->hdr_max - exchange->hdr_size : 0;
+
+    /* If the token fills the newest block on its own (e.g. a huge cookie)
+     * nothing else points into it, so replace it rather than leaving a
+     * stale copy behind: */
+    int replace = last && keep == last->data;
+    if( replace ) {
+        avail += last->size;
+    }
+
+    /* Double the last block, within whatever's left of hdr_max: */
+    size_t size = YMO_MIN(YMO_MAX(2 * last_size, keep_len + need), avail);
+    if( size < keep_len + need ) {
+        ymo_log_debug("Request headers exceed %zu bytes", exchange->hdr_max);
+        return YMO_ERROR_PTR(EFBIG);
+    }
+
+    ymo_http_hdr_block_t* block = YMO_ALLOC(
+            sizeof(ymo_http_hdr_block_t) + size);
+    if( !block ) {
+        return YMO_ERROR_PTR(ENOMEM);
+    }
+
+    if( keep_len ) {
+        memcpy(block->data, keep, keep_len);
+    }
+
+    if( replace ) {
+        exchange->hdr_blocks = last->next;
+        exchange->hdr_size -= last->size;
+        YMO_FREE(last);
+    }
+
+    block->size = size;
+    block->next = exchange->hdr_blocks;
+    exchange->hdr_blocks = block;
+    exchange->hdr_size += size;
+    exchange->recv_current = block->data + keep_len;
+    exchange->remain = size - keep_len;
+    return block->data;
+}
+
+
 ymo_http_flags_t ymo_http_request_flags(const ymo_http_exchange_t* exchange)
 {
     return exchange->request.flags;
@@ -117,18 +246,39 @@ ymo_http_flags_t ymo_http_request_flags(const ymo_http_exchange_t* exchange)
 
 void ymo_http_exchange_free(ymo_http_exchange_t* exchange)
 {
-    if( exchange ) {
-        ymo_http_hdr_table_clear(&exchange->request.headers);
-
-        if( exchange->request.ws ) {
-            ymo_blalloc_free(exchange->request.ws);
-        }
+    if( !exchange ) {
+        return;
+    }
 
-        if( exchange->request.body ) {
-            YMO_FREE(exchange->request.body);
-        }
+    ymo_http_exchange_pool_t* pool = exchange->pool;
+    if( pool && pool->len < pool->max ) {
+        ymo_http_exchange_reset(exchange);
+        exchange->next = pool->idle;
+        pool->idle = exchange;
+        pool->len++;
+        return;
     }
-    YMO_DELETE(ymo_http_exchange_t, exchange);
+    exchange_destroy(exchange);
     return;
 }
 
+
+void ymo_http_exchange_pool_init(
+        ymo_http_exchange_pool_t* pool, size_t max)
+{
+    pool->max = max;
+}
+
+
+void ymo_http_exchange_pool_drain(ymo_http_exchange_pool_t* pool)
+{
+    ymo_http_exchange_t* exchange = pool->idle;
+    while( exchange ) {
+        ymo_http_exchange_t* next = exchange->next;
+        exchange_destroy(exchange);
+        exchange = next;
+    }
+    pool->idle = NULL;
+    pool->len = 0;
+    pool->max = 0;
+}
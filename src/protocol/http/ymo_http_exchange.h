@@ -27,16 +27,53 @@
 #include "yimmo_config.h"
 #include "yimmo.h"
 #include "ymo_http.h"
+#include "ymo_http_response.h"
 
 /** Exchange
  * ==========
  *
+ * The request line and headers are copied into header storage owned by the
+ * exchange, and the request strings point into it. Storage starts out as
+ * the ``recv_buf`` embedded in the exchange. When that fills up, a new
+ * block (twice the size of the last one) is chained on, up to a total of
+ * ``hdr_max`` bytes. Strings already parsed stay put: only the token being
+ * parsed when space runs out is copied to the new block (and if that token
+ * is all the newest block holds, the block is replaced rather than left
+ * behind). The chain is freed when the exchange is reset, so idle
+ * keep-alive connections only hold ``recv_buf``.
+ *
+ * The response is embedded in the exchange, too. Once a request has been
+ * handed to the application, its exchange belongs to the response (which
+ * may be queued behind others, or still being sent) and the session takes
+ * another for the next request. When the response has been sent, the
+ * exchange goes back to the protocol's :c:type:`ymo_http_exchange_pool_t`
+ * — workspace, header table, and response head buffer intact — so that a
+ * steady stream of keep-alive requests doesn't touch the allocator.
+ */
+
+/**---------------------------------------------------------------
+ * Definitions
+ *---------------------------------------------------------------*/
+
+/** Default limit on header storage per request (see
+ * :c:func:`ymo_http_set_max_header_size`).
  */
+#define YMO_HTTP_HDR_MAX_DEFAULT (16 * 1024)
+
+/** Maximum number of idle exchanges kept by a protocol for reuse. */
+#define YMO_HTTP_EXCHANGE_POOL_MAX 64
 
 /**---------------------------------------------------------------
  * Types
  *---------------------------------------------------------------*/
 
+/** Overflow block of header storage. */
+typedef struct ymo_http_hdr_block {
+    struct ymo_http_hdr_block*  next;  /* Previous (smaller) block */
+    size_t                      size;
+    char                        data[];
+} ymo_http_hdr_block_t;
+
 /** Enum type used to track HTTP exchange parse state.
  */
 YMO_ENUM8_TYPEDEF(http_state) {
@@ -52,9 +89,13 @@ YMO_ENUM8_TYPEDEF(http_state) {
     HTTP_STATE_HEADER_VALUE,
     HTTP_STATE_HEADERS_COMPLETE,
     HTTP_STATE_EXPECT,
-    HTTP_STATE_BODY_CHUNK_HEADER,
+    HTTP_STATE_BODY_CHUNK_HEADER,    /* chunk-size */
+    HTTP_STATE_BODY_CHUNK_EXT,       /* chunk extensions, up to CR */
     HTTP_STATE_BODY,
-    HTTP_STATE_BODY_CHUNK_TRAILER,
+    HTTP_STATE_BODY_CHUNK_CR,        /* CRLF after chunk data */
+    HTTP_STATE_BODY_CHUNK_LF,        /* LF of any chunk framing line */
+    HTTP_STATE_BODY_CHUNK_TRAILER,   /* start of a trailer line */
+    HTTP_STATE_BODY_TRAILER_FIELD,   /* rest of a trailer field line */
     HTTP_STATE_COMPLETE,
 } YMO_ENUM8_AS(http_state_t);
 
@@ -91,16 +132,29 @@ struct ymo_http_exchange {
     http_state_t  state;
     http_state_t  next_state;
     char*         recv_current;
-    size_t        remain;
+    size_t        remain;     /* Bytes left in the current block */
+    size_t        hdr_size;   /* Header storage allocated (all blocks) */
+    size_t        hdr_max;    /* ...and its limit */
+    ymo_http_hdr_block_t* hdr_blocks; /* Overflow blocks, newest first */
     char          recv_buf[YMO_HTTP_RECV_BUF_SIZE];
 
-    /* Response:
-     *
-     * (TODO: just add this to the exchange and skip the malloc/free).
-     */
-    ymo_http_response_t* response;
+    /* Response: */
+    ymo_http_response_t  response;
+
+    /* Recycling: */
+    struct ymo_http_exchange_pool*  pool;  /* Returned here when freed */
+    struct ymo_http_exchange*       next;  /* Next idle exchange */
 };
 
+/** Per-protocol free list of idle exchanges. A protocol only services one
+ * loop, so there's no locking.
+ */
+typedef struct ymo_http_exchange_pool {
+    ymo_http_exchange_t*  idle;
+    size_t                len;
+    size_t                max;  /* 0 while the protocol is shut down */
+} ymo_http_exchange_pool_t;
+
 /**---------------------------------------------------------------
  * Functions
  *---------------------------------------------------------------*/
@@ -111,16 +165,56 @@ struct ymo_http_exchange {
  */
 ymo_http_exchange_t* ymo_http_exchange_create(void);
 
+/** Take an exchange from the pool, or create one if it's empty.
+ *
+ * :param pool: pool to draw from (and return to, when freed); may be NULL
+ * :returns: a reset exchange, or NULL on failure.
+ */
+ymo_http_exchange_t* ymo_http_exchange_acquire(
+        ymo_http_exchange_pool_t* pool);
+
 /** Reset an HTTP exchange struct to handle a new incoming exchange
  */
 void ymo_http_exchange_reset(ymo_http_exchange_t* exchange);
 
-/** Free an http exchange object.
+/** Chain a new header storage block onto the exchange.
+ *
+ * The partial token from ``keep`` up to ``exchange->recv_current`` is moved
+ * to the new block, which has room for at least ``need`` more bytes;
+ * ``recv_current`` and ``remain`` are updated to match.
+ *
+ * :param exchange: exchange whose header storage is full (or too small)
+ * :param keep: start of the token being parsed, or NULL
+ * :param need: additional bytes required
+ * :returns: the new location of ``keep`` (or of ``recv_current``, if
+ *     ``keep`` is NULL), or NULL with errno set to ``EFBIG`` if the
+ *     exchange would exceed ``hdr_max`` or ``ENOMEM``.
+ */
+char* ymo_http_exchange_grow(
+        ymo_http_exchange_t* exchange, const char* keep, size_t need);
+
+/** Free an http exchange object, or - if it came from a pool with room to
+ * spare - reset it and return it to the pool.
  *
  * :param exchange: exchange to free
  */
 void ymo_http_exchange_free(ymo_http_exchange_t* exchange);
 
+/** Initialize an exchange pool.
+ *
+ * :param pool: pool to initialize
+ * :param max: maximum number of idle exchanges to keep
+ */
+void ymo_http_exchange_pool_init(
+        ymo_http_exchange_pool_t* pool, size_t max);
+
+/** Free any idle exchanges and stop pooling (until the next
+ * :c:func:`ymo_http_exchange_pool_init`).
+ *
+ * :param pool: pool to drain
+ */
+void ymo_http_exchange_pool_drain(ymo_http_exchange_pool_t* pool);
+
 /** Used to get common HTTP exchange traits
  *
  * :param exchange: the HTTP exchange instance to query
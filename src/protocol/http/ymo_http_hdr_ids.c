@@ -0,0 +1,692 @@
+/*=============================================================================
+ * libyimmo: ymo_http_hdr_ids.c
+ *
+ * GENERATED by ymo_http_hdr_gen from extra/ymo_std_http.c — DO NOT EDIT.
+ *
+ * To add a standard header, add it to ymo_common_http_headers in
+ * extra/ymo_std_http.c and rebuild.
+ *
+ *===========================================================================*/
+
+#include "yimmo_config.h"
+
+#include <stddef.h>
+#include <strings.h>
+
+#include "yimmo.h"
+#include "ymo_http_hdr_table.h"
+
+const ymo_http_hdr_std_t ymo_http_hdr_std[YMO_HTTP_HID_STD_MAX+1] = {
+    { NULL, 0 },
+    { "A-IM", 4 },
+    { "Accept", 6 },
+    { "Accept-CH", 9 },
+    { "Accept-Charset", 14 },
+    { "Accept-Datetime", 15 },
+    { "Accept-Encoding", 15 },
+    { "Accept-Language", 15 },
+    { "Accept-Patch", 12 },
+    { "Accept-Ranges", 13 },
+    { "Access-Control-Allow-Credentials", 32 },
+    { "Access-Control-Allow-Headers", 28 },
+    { "Access-Control-Allow-Methods", 28 },
+    { "Access-Control-Allow-Origin", 27 },
+    { "Access-Control-Expose-Headers", 29 },
+    { "Access-Control-Max-Age", 22 },
+    { "Access-Control-Request-Headers", 30 },
+    { "Access-Control-Request-Method", 29 },
+    { "Age", 3 },
+    { "Allow", 5 },
+    { "Alt-Svc", 7 },
+    { "Alternate-Protocol", 18 },
+    { "Authorization", 13 },
+    { "Cache-Control", 13 },
+    { "Client-Date", 11 },
+    { "Client-Peer", 11 },
+    { "Client-Response-Num", 19 },
+    { "Connection", 10 },
+    { "Content-Disposition", 19 },
+    { "Content-Encoding", 16 },
+    { "Content-Language", 16 },
+    { "Content-Length", 14 },
+    { "Content-Location", 16 },
+    { "Content-MD5", 11 },
+    { "Content-Range", 13 },
+    { "Content-Security-Policy", 23 },
+    { "Content-Security-Policy-Report-Only", 35 },
+    { "Content-Type", 12 },
+    { "Cookie", 6 },
+    { "DNT", 3 },
+    { "Date", 4 },
+    { "Delta-Base", 10 },
+    { "ETag", 4 },
+    { "Expect", 6 },
+    { "Expect-CT", 9 },
+    { "Expires", 7 },
+    { "Field", 5 },
+    { "Forwarded", 9 },
+    { "From", 4 },
+    { "Front-End-Https", 15 },
+    { "HTTP", 4 },
+    { "HTTP2-Settings", 14 },
+    { "Host", 4 },
+    { "IM", 2 },
+    { "If-Match", 8 },
+    { "If-Modified-Since", 17 },
+    { "If-None-Match", 13 },
+    { "If-Range", 8 },
+    { "If-Unmodified-Since", 19 },
+    { "Keep-Alive", 10 },
+    { "Last-Modified", 13 },
+    { "Link", 4 },
+    { "Location", 8 },
+    { "Max-Forwards", 12 },
+    { "NEL", 3 },
+    { "Origin", 6 },
+    { "P3P", 3 },
+    { "Permissions-Policy", 18 },
+    { "Pragma", 6 },
+    { "Prefer", 6 },
+    { "Preference-Applied", 18 },
+    { "Proxy-Authenticate", 18 },
+    { "Proxy-Authorization", 19 },
+    { "Proxy-Connection", 16 },
+    { "Public-Key-Pins", 15 },
+    { "Range", 5 },
+    { "Referer", 7 },
+    { "Refresh", 7 },
+    { "Report-To", 9 },
+    { "Retry-After", 11 },
+    { "Save-Data", 9 },
+    { "Sec-WebSocket-Extensions", 24 },
+    { "Sec-WebSocket-Key", 17 },
+    { "Sec-WebSocket-Protocol", 22 },
+    { "Sec-WebSocket-Version", 21 },
+    { "Server", 6 },
+    { "Set-Cookie", 10 },
+    { "Status", 6 },
+    { "Strict-Transport-Security", 25 },
+    { "TE", 2 },
+    { "Timing-Allow-Origin", 19 },
+    { "Tk", 2 },
+    { "Trailer", 7 },
+    { "Transfer-Encoding", 17 },
+    { "Upgrade", 7 },
+    { "Upgrade-Insecure-Requests", 25 },
+    { "User-Agent", 10 },
+    { "Vary", 4 },
+    { "Via", 3 },
+    { "WWW-Authenticate", 16 },
+    { "Warning", 7 },
+    { "X-ATT-DeviceId", 14 },
+    { "X-Aspnet-Version", 16 },
+    { "X-Content-Duration", 18 },
+    { "X-Content-Security-Policy", 25 },
+    { "X-Content-Type-Options", 22 },
+    { "X-Correlation-ID", 16 },
+    { "X-Csrf-Token", 12 },
+    { "X-Forwarded-For", 15 },
+    { "X-Forwarded-Host", 16 },
+    { "X-Forwarded-Proto", 17 },
+    { "X-Frame-Options", 15 },
+    { "X-Http-Method-Override", 22 },
+    { "X-Permitted-Cross-Domain-Policies", 33 },
+    { "X-Pingback", 10 },
+    { "X-Powered-By", 12 },
+    { "X-Redirect-By", 13 },
+    { "X-Request-ID", 12 },
+    { "X-Requested-With", 16 },
+    { "X-Robots-Tag", 12 },
+    { "X-UA-Compatible", 15 },
+    { "X-UIDH", 6 },
+    { "X-Wap-Profile", 13 },
+    { "X-WebKit-CSP", 12 },
+    { "X-XSS-Protection", 16 },
+};
+
+
+ymo_http_hdr_id_t ymo_http_hdr_std_id(const char* hdr, size_t len)
+{
+    ymo_http_hdr_id_t id;
+
+    switch( len ) {
+        case 2:
+            switch( YMO_HTTP_HDR_FOLD(hdr[1]) ) {
+                case 'e':
+                    id = YMO_HTTP_HID_TE;
+                    break;
+                case 'k':
+                    id = YMO_HTTP_HID_TK;
+                    break;
+                case 'm':
+                    id = YMO_HTTP_HID_IM;
+                    break;
+                default:
+                    return YMO_HTTP_HID_NONE;
+            }
+            break;
+        case 3:
+            switch( YMO_HTTP_HDR_FOLD(hdr[0]) ) {
+                case 'a':
+                    id = YMO_HTTP_HID_AGE;
+                    break;
+                case 'd':
+                    id = YMO_HTTP_HID_DNT;
+                    break;
+                case 'n':
+                    id = YMO_HTTP_HID_NEL;
+                    break;
+                case 'p':
+                    id = YMO_HTTP_HID_P3P;
+                    break;
+                case 'v':
+                    id = YMO_HTTP_HID_VIA;
+                    break;
+                default:
+                    return YMO_HTTP_HID_NONE;
+            }
+            break;
+        case 4:
+            switch( YMO_HTTP_HDR_FOLD(hdr[0]) ) {
+                case 'a':
+                    id = YMO_HTTP_HID_A_IM;
+                    break;
+                case 'd':
+                    id = YMO_HTTP_HID_DATE;
+                    break;
+                case 'e':
+                    id = YMO_HTTP_HID_ETAG;
+                    break;
+                case 'f':
+                    id = YMO_HTTP_HID_FROM;
+                    break;
+                case 'h':
+                    switch( YMO_HTTP_HDR_FOLD(hdr[1]) ) {
+                        case 'o':
+                            id = YMO_HTTP_HID_HOST;
+                            break;
+                        case 't':
+                            id = YMO_HTTP_HID_HTTP;
+                            break;
+                        default:
+                            return YMO_HTTP_HID_NONE;
+                    }
+                    break;
+                case 'l':
+                    id = YMO_HTTP_HID_LINK;
+                    break;
+                case 'v':
+                    id = YMO_HTTP_HID_VARY;
+                    break;
+                default:
+                    return YMO_HTTP_HID_NONE;
+            }
+            break;
+        case 5:
+            switch( YMO_HTTP_HDR_FOLD(hdr[0]) ) {
+                case 'a':
+                    id = YMO_HTTP_HID_ALLOW;
+                    break;
+                case 'f':
+                    id = YMO_HTTP_HID_FIELD;
+                    break;
+                case 'r':
+                    id = YMO_HTTP_HID_RANGE;
+                    break;
+                default:
+                    return YMO_HTTP_HID_NONE;
+            }
+            break;
+        case 6:
+            switch( YMO_HTTP_HDR_FOLD(hdr[2]) ) {
+                case 'a':
+                    switch( YMO_HTTP_HDR_FOLD(hdr[0]) ) {
+                        case 'p':
+                            id = YMO_HTTP_HID_PRAGMA;
+                            break;
+                        case 's':
+                            id = YMO_HTTP_HID_STATUS;
+                            break;
+                        default:
+                            return YMO_HTTP_HID_NONE;
+                    }
+                    break;
+                case 'c':
+                    id = YMO_HTTP_HID_ACCEPT;
+                    break;
+                case 'e':
+                    id = YMO_HTTP_HID_PREFER;
+                    break;
+                case 'i':
+                    id = YMO_HTTP_HID_ORIGIN;
+                    break;
+                case 'o':
+                    id = YMO_HTTP_HID_COOKIE;
+                    break;
+                case 'p':
+                    id = YMO_HTTP_HID_EXPECT;
+                    break;
+                case 'r':
+                    id = YMO_HTTP_HID_SERVER;
+                    break;
+                case 'u':
+                    id = YMO_HTTP_HID_X_UIDH;
+                    break;
+                default:
+                    return YMO_HTTP_HID_NONE;
+            }
+            break;
+        case 7:
+            switch( YMO_HTTP_HDR_FOLD(hdr[0]) ) {
+                case 'a':
+                    id = YMO_HTTP_HID_ALT_SVC;
+                    break;
+                case 'e':
+                    id = YMO_HTTP_HID_EXPIRES;
+                    break;
+                case 'r':
+                    switch( YMO_HTTP_HDR_FOLD(hdr[3]) ) {
+                        case 'e':
+                            id = YMO_HTTP_HID_REFERER;
+                            break;
+                        case 'r':
+                            id = YMO_HTTP_HID_REFRESH;
+                            break;
+                        default:
+                            return YMO_HTTP_HID_NONE;
+                    }
+                    break;
+                case 't':
+                    id = YMO_HTTP_HID_TRAILER;
+                    break;
+                case 'u':
+                    id = YMO_HTTP_HID_UPGRADE;
+                    break;
+                case 'w':
+                    id = YMO_HTTP_HID_WARNING;
+                    break;
+                default:
+                    return YMO_HTTP_HID_NONE;
+            }
+            break;
+        case 8:
+            switch( YMO_HTTP_HDR_FOLD(hdr[3]) ) {
+                case 'a':
+                    id = YMO_HTTP_HID_LOCATION;
+                    break;
+                case 'm':
+                    id = YMO_HTTP_HID_IF_MATCH;
+                    break;
+                case 'r':
+                    id = YMO_HTTP_HID_IF_RANGE;
+                    break;
+                default:
+                    return YMO_HTTP_HID_NONE;
+            }
+            break;
+        case 9:
+            switch( YMO_HTTP_HDR_FOLD(hdr[0]) ) {
+                case 'a':
+                    id = YMO_HTTP_HID_ACCEPT_CH;
+                    break;
+                case 'e':
+                    id = YMO_HTTP_HID_EXPECT_CT;
+                    break;
+                case 'f':
+                    id = YMO_HTTP_HID_FORWARDED;
+                    break;
+                case 'r':
+                    id = YMO_HTTP_HID_REPORT_TO;
+                    break;
+                case 's':
+                    id = YMO_HTTP_HID_SAVE_DATA;
+                    break;
+                default:
+                    return YMO_HTTP_HID_NONE;
+            }
+            break;
+        case 10:
+            switch( YMO_HTTP_HDR_FOLD(hdr[0]) ) {
+                case 'c':
+                    id = YMO_HTTP_HID_CONNECTION;
+                    break;
+                case 'd':
+                    id = YMO_HTTP_HID_DELTA_BASE;
+                    break;
+                case 'k':
+                    id = YMO_HTTP_HID_KEEP_ALIVE;
+                    break;
+                case 's':
+                    id = YMO_HTTP_HID_SET_COOKIE;
+                    break;
+                case 'u':
+                    id = YMO_HTTP_HID_USER_AGENT;
+                    break;
+                case 'x':
+                    id = YMO_HTTP_HID_X_PINGBACK;
+                    break;
+                default:
+                    return YMO_HTTP_HID_NONE;
+            }
+            break;
+        case 11:
+            switch( YMO_HTTP_HDR_FOLD(hdr[7]) ) {
+                case '-':
+                    id = YMO_HTTP_HID_CONTENT_MD5;
+                    break;
+                case 'd':
+                    id = YMO_HTTP_HID_CLIENT_DATE;
+                    break;
+                case 'f':
+                    id = YMO_HTTP_HID_RETRY_AFTER;
+                    break;
+                case 'p':
+                    id = YMO_HTTP_HID_CLIENT_PEER;
+                    break;
+                default:
+                    return YMO_HTTP_HID_NONE;
+            }
+            break;
+        case 12:
+            switch( YMO_HTTP_HDR_FOLD(hdr[10]) ) {
+                case 'a':
+                    id = YMO_HTTP_HID_X_ROBOTS_TAG;
+                    break;
+                case 'b':
+                    id = YMO_HTTP_HID_X_POWERED_BY;
+                    break;
+                case 'c':
+                    id = YMO_HTTP_HID_ACCEPT_PATCH;
+                    break;
+                case 'd':
+                    id = YMO_HTTP_HID_MAX_FORWARDS;
+                    break;
+                case 'e':
+                    id = YMO_HTTP_HID_X_CSRF_TOKEN;
+                    break;
+                case 'i':
+                    id = YMO_HTTP_HID_X_REQUEST_ID;
+                    break;
+                case 'p':
+                    id = YMO_HTTP_HID_CONTENT_TYPE;
+                    break;
+                case 's':
+                    id = YMO_HTTP_HID_X_WEBKIT_CSP;
+                    break;
+                default:
+                    return YMO_HTTP_HID_NONE;
+            }
+            break;
+        case 13:
+            switch( YMO_HTTP_HDR_FOLD(hdr[6]) ) {
+                case '-':
+                    id = YMO_HTTP_HID_ACCEPT_RANGES;
+                    break;
+                case 'c':
+                    id = YMO_HTTP_HID_CACHE_CONTROL;
+                    break;
+                case 'e':
+                    id = YMO_HTTP_HID_IF_NONE_MATCH;
+                    break;
+                case 'i':
+                    id = YMO_HTTP_HID_AUTHORIZATION;
+                    break;
+                case 'o':
+                    id = YMO_HTTP_HID_LAST_MODIFIED;
+                    break;
+                case 'p':
+                    id = YMO_HTTP_HID_X_WAP_PROFILE;
+                    break;
+                case 'r':
+                    id = YMO_HTTP_HID_X_REDIRECT_BY;
+                    break;
+                case 't':
+                    id = YMO_HTTP_HID_CONTENT_RANGE;
+                    break;
+                default:
+                    return YMO_HTTP_HID_NONE;
+            }
+            break;
+        case 14:
+            switch( YMO_HTTP_HDR_FOLD(hdr[0]) ) {
+                case 'a':
+                    id = YMO_HTTP_HID_ACCEPT_CHARSET;
+                    break;
+                case 'c':
+                    id = YMO_HTTP_HID_CONTENT_LENGTH;
+                    break;
+                case 'h':
+                    id = YMO_HTTP_HID_HTTP2_SETTINGS;
+                    break;
+                case 'x':
+                    id = YMO_HTTP_HID_X_ATT_DEVICEID;
+                    break;
+                default:
+                    return YMO_HTTP_HID_NONE;
+            }
+            break;
+        case 15:
+            switch( YMO_HTTP_HDR_FOLD(hdr[7]) ) {
+                case '-':
+                    id = YMO_HTTP_HID_X_FRAME_OPTIONS;
+                    break;
+                case 'd':
+                    id = YMO_HTTP_HID_ACCEPT_DATETIME;
+                    break;
+                case 'e':
+                    id = YMO_HTTP_HID_ACCEPT_ENCODING;
+                    break;
+                case 'k':
+                    id = YMO_HTTP_HID_PUBLIC_KEY_PINS;
+                    break;
+                case 'l':
+                    id = YMO_HTTP_HID_ACCEPT_LANGUAGE;
+                    break;
+                case 'm':
+                    id = YMO_HTTP_HID_X_UA_COMPATIBLE;
+                    break;
+                case 'n':
+                    id = YMO_HTTP_HID_FRONT_END_HTTPS;
+                    break;
+                case 'r':
+                    id = YMO_HTTP_HID_X_FORWARDED_FOR;
+                    break;
+                default:
+                    return YMO_HTTP_HID_NONE;
+            }
+            break;
+        case 16:
+            switch( YMO_HTTP_HDR_FOLD(hdr[2]) ) {
+                case 'a':
+                    id = YMO_HTTP_HID_X_ASPNET_VERSION;
+                    break;
+                case 'c':
+                    id = YMO_HTTP_HID_X_CORRELATION_ID;
+                    break;
+                case 'f':
+                    id = YMO_HTTP_HID_X_FORWARDED_HOST;
+                    break;
+                case 'n':
+                    switch( YMO_HTTP_HDR_FOLD(hdr[9]) ) {
+                        case 'a':
+                            id = YMO_HTTP_HID_CONTENT_LANGUAGE;
+                            break;
+                        case 'n':
+                            id = YMO_HTTP_HID_CONTENT_ENCODING;
+                            break;
+                        case 'o':
+                            id = YMO_HTTP_HID_CONTENT_LOCATION;
+                            break;
+                        default:
+                            return YMO_HTTP_HID_NONE;
+                    }
+                    break;
+                case 'o':
+                    id = YMO_HTTP_HID_PROXY_CONNECTION;
+                    break;
+                case 'r':
+                    id = YMO_HTTP_HID_X_REQUESTED_WITH;
+                    break;
+                case 'w':
+                    id = YMO_HTTP_HID_WWW_AUTHENTICATE;
+                    break;
+                case 'x':
+                    id = YMO_HTTP_HID_X_XSS_PROTECTION;
+                    break;
+                default:
+                    return YMO_HTTP_HID_NONE;
+            }
+            break;
+        case 17:
+            switch( YMO_HTTP_HDR_FOLD(hdr[0]) ) {
+                case 'i':
+                    id = YMO_HTTP_HID_IF_MODIFIED_SINCE;
+                    break;
+                case 's':
+                    id = YMO_HTTP_HID_SEC_WEBSOCKET_KEY;
+                    break;
+                case 't':
+                    id = YMO_HTTP_HID_TRANSFER_ENCODING;
+                    break;
+                case 'x':
+                    id = YMO_HTTP_HID_X_FORWARDED_PROTO;
+                    break;
+                default:
+                    return YMO_HTTP_HID_NONE;
+            }
+            break;
+        case 18:
+            switch( YMO_HTTP_HDR_FOLD(hdr[2]) ) {
+                case 'c':
+                    id = YMO_HTTP_HID_X_CONTENT_DURATION;
+                    break;
+                case 'e':
+                    id = YMO_HTTP_HID_PREFERENCE_APPLIED;
+                    break;
+                case 'o':
+                    id = YMO_HTTP_HID_PROXY_AUTHENTICATE;
+                    break;
+                case 'r':
+                    id = YMO_HTTP_HID_PERMISSIONS_POLICY;
+                    break;
+                case 't':
+                    id = YMO_HTTP_HID_ALTERNATE_PROTOCOL;
+                    break;
+                default:
+                    return YMO_HTTP_HID_NONE;
+            }
+            break;
+        case 19:
+            switch( YMO_HTTP_HDR_FOLD(hdr[1]) ) {
+                case 'f':
+                    id = YMO_HTTP_HID_IF_UNMODIFIED_SINCE;
+                    break;
+                case 'i':
+                    id = YMO_HTTP_HID_TIMING_ALLOW_ORIGIN;
+                    break;
+                case 'l':
+                    id = YMO_HTTP_HID_CLIENT_RESPONSE_NUM;
+                    break;
+                case 'o':
+                    id = YMO_HTTP_HID_CONTENT_DISPOSITION;
+                    break;
+                case 'r':
+                    id = YMO_HTTP_HID_PROXY_AUTHORIZATION;
+                    break;
+                default:
+                    return YMO_HTTP_HID_NONE;
+            }
+            break;
+        case 21:
+            id = YMO_HTTP_HID_SEC_WEBSOCKET_VERSION;
+            break;
+        case 22:
+            switch( YMO_HTTP_HDR_FOLD(hdr[3]) ) {
+                case '-':
+                    id = YMO_HTTP_HID_SEC_WEBSOCKET_PROTOCOL;
+                    break;
+                case 'e':
+                    id = YMO_HTTP_HID_ACCESS_CONTROL_MAX_AGE;
+                    break;
+                case 'o':
+                    id = YMO_HTTP_HID_X_CONTENT_TYPE_OPTIONS;
+                    break;
+                case 't':
+                    id = YMO_HTTP_HID_X_HTTP_METHOD_OVERRIDE;
+                    break;
+                default:
+                    return YMO_HTTP_HID_NONE;
+            }
+            break;
+        case 23:
+            id = YMO_HTTP_HID_CONTENT_SECURITY_POLICY;
+            break;
+        case 24:
+            id = YMO_HTTP_HID_SEC_WEBSOCKET_EXTENSIONS;
+            break;
+        case 25:
+            switch( YMO_HTTP_HDR_FOLD(hdr[0]) ) {
+                case 's':
+                    id = YMO_HTTP_HID_STRICT_TRANSPORT_SECURITY;
+                    break;
+                case 'u':
+                    id = YMO_HTTP_HID_UPGRADE_INSECURE_REQUESTS;
+                    break;
+                case 'x':
+                    id = YMO_HTTP_HID_X_CONTENT_SECURITY_POLICY;
+                    break;
+                default:
+                    return YMO_HTTP_HID_NONE;
+            }
+            break;
+        case 27:
+            id = YMO_HTTP_HID_ACCESS_CONTROL_ALLOW_ORIGIN;
+            break;
+        case 28:
+            switch( YMO_HTTP_HDR_FOLD(hdr[21]) ) {
+                case 'h':
+                    id = YMO_HTTP_HID_ACCESS_CONTROL_ALLOW_HEADERS;
+                    break;
+                case 'm':
+                    id = YMO_HTTP_HID_ACCESS_CONTROL_ALLOW_METHODS;
+                    break;
+                default:
+                    return YMO_HTTP_HID_NONE;
+            }
+            break;
+        case 29:
+            switch( YMO_HTTP_HDR_FOLD(hdr[15]) ) {
+                case 'e':
+                    id = YMO_HTTP_HID_ACCESS_CONTROL_EXPOSE_HEADERS;
+                    break;
+                case 'r':
+                    id = YMO_HTTP_HID_ACCESS_CONTROL_REQUEST_METHOD;
+                    break;
+                default:
+                    return YMO_HTTP_HID_NONE;
+            }
+            break;
+        case 30:
+            id = YMO_HTTP_HID_ACCESS_CONTROL_REQUEST_HEADERS;
+            break;
+        case 32:
+            id = YMO_HTTP_HID_ACCESS_CONTROL_ALLOW_CREDENTIALS;
+            break;
+        case 33:
+            id = YMO_HTTP_HID_X_PERMITTED_CROSS_DOMAIN_POLICIES;
+            break;
+        case 35:
+            id = YMO_HTTP_HID_CONTENT_SECURITY_POLICY_REPORT_ONLY;
+            break;
+        default:
+            return YMO_HTTP_HID_NONE;
+    }
+
+    /* Only a few characters were inspected to get here: */
+    if( !strncasecmp(hdr, ymo_http_hdr_std[id].name, len) ) {
+        return id;
+    }
+    return YMO_HTTP_HID_NONE;
+}
+
+
@@ -0,0 +1,146 @@
+/*=============================================================================
+ * libyimmo: ymo_http_hdr_ids.h
+ *
+ * GENERATED by ymo_http_hdr_gen from extra/ymo_std_http.c — DO NOT EDIT.
+ *
+ * To add a standard header, add it to ymo_common_http_headers in
+ * extra/ymo_std_http.c and rebuild.
+ *
+ *===========================================================================*/
+
+#ifndef YMO_HTTP_HDR_IDS_H
+#define YMO_HTTP_HDR_IDS_H
+
+#define YMO_HTTP_HID_A_IM                                        1  /* "A-IM" */
+#define YMO_HTTP_HID_ACCEPT                                      2  /* "Accept" */
+#define YMO_HTTP_HID_ACCEPT_CH                                   3  /* "Accept-CH" */
+#define YMO_HTTP_HID_ACCEPT_CHARSET                              4  /* "Accept-Charset" */
+#define YMO_HTTP_HID_ACCEPT_DATETIME                             5  /* "Accept-Datetime" */
+#define YMO_HTTP_HID_ACCEPT_ENCODING                             6  /* "Accept-Encoding" */
+#define YMO_HTTP_HID_ACCEPT_LANGUAGE                             7  /* "Accept-Language" */
+#define YMO_HTTP_HID_ACCEPT_PATCH                                8  /* "Accept-Patch" */
+#define YMO_HTTP_HID_ACCEPT_RANGES                               9  /* "Accept-Ranges" */
+#define YMO_HTTP_HID_ACCESS_CONTROL_ALLOW_CREDENTIALS           10  /* "Access-Control-Allow-Credentials" */
+#define YMO_HTTP_HID_ACCESS_CONTROL_ALLOW_HEADERS               11  /* "Access-Control-Allow-Headers" */
+#define YMO_HTTP_HID_ACCESS_CONTROL_ALLOW_METHODS               12  /* "Access-Control-Allow-Methods" */
+#define YMO_HTTP_HID_ACCESS_CONTROL_ALLOW_ORIGIN                13  /* "Access-Control-Allow-Origin" */
+#define YMO_HTTP_HID_ACCESS_CONTROL_EXPOSE_HEADERS              14  /* "Access-Control-Expose-Headers" */
+#define YMO_HTTP_HID_ACCESS_CONTROL_MAX_AGE                     15  /* "Access-Control-Max-Age" */
+#define YMO_HTTP_HID_ACCESS_CONTROL_REQUEST_HEADERS             16  /* "Access-Control-Request-Headers" */
+#define YMO_HTTP_HID_ACCESS_CONTROL_REQUEST_METHOD              17  /* "Access-Control-Request-Method" */
+#define YMO_HTTP_HID_AGE                                        18  /* "Age" */
+#define YMO_HTTP_HID_ALLOW                                      19  /* "Allow" */
+#define YMO_HTTP_HID_ALT_SVC                                    20  /* "Alt-Svc" */
+#define YMO_HTTP_HID_ALTERNATE_PROTOCOL                         21  /* "Alternate-Protocol" */
+#define YMO_HTTP_HID_AUTHORIZATION                              22  /* "Authorization" */
+#define YMO_HTTP_HID_CACHE_CONTROL                              23  /* "Cache-Control" */
+#define YMO_HTTP_HID_CLIENT_DATE                                24  /* "Client-Date" */
+#define YMO_HTTP_HID_CLIENT_PEER                                25  /* "Client-Peer" */
+#define YMO_HTTP_HID_CLIENT_RESPONSE_NUM                        26  /* "Client-Response-Num" */
+#define YMO_HTTP_HID_CONNECTION                                 27  /* "Connection" */
+#define YMO_HTTP_HID_CONTENT_DISPOSITION                        28  /* "Content-Disposition" */
+#define YMO_HTTP_HID_CONTENT_ENCODING                           29  /* "Content-Encoding" */
+#define YMO_HTTP_HID_CONTENT_LANGUAGE                           30  /* "Content-Language" */
+#define YMO_HTTP_HID_CONTENT_LENGTH                             31  /* "Content-Length" */
+#define YMO_HTTP_HID_CONTENT_LOCATION                           32  /* "Content-Location" */
+#define YMO_HTTP_HID_CONTENT_MD5                                33  /* "Content-MD5" */
+#define YMO_HTTP_HID_CONTENT_RANGE                              34  /* "Content-Range" */
+#define YMO_HTTP_HID_CONTENT_SECURITY_POLICY                    35  /* "Content-Security-Policy" */
+#define YMO_HTTP_HID_CONTENT_SECURITY_POLICY_REPORT_ONLY        36  /* "Content-Security-Policy-Report-Only" */
+#define YMO_HTTP_HID_CONTENT_TYPE                               37  /* "Content-Type" */
+#define YMO_HTTP_HID_COOKIE                                     38  /* "Cookie" */
+#define YMO_HTTP_HID_DNT                                        39  /* "DNT" */
+#define YMO_HTTP_HID_DATE                                       40  /* "Date" */
+#define YMO_HTTP_HID_DELTA_BASE                                 41  /* "Delta-Base" */
+#define YMO_HTTP_HID_ETAG                                       42  /* "ETag" */
+#define YMO_HTTP_HID_EXPECT                                     43  /* "Expect" */
+#define YMO_HTTP_HID_EXPECT_CT                                  44  /* "Expect-CT" */
+#define YMO_HTTP_HID_EXPIRES                                    45  /* "Expires" */
+#define YMO_HTTP_HID_FIELD                                      46  /* "Field" */
+#define YMO_HTTP_HID_FORWARDED                                  47  /* "Forwarded" */
+#define YMO_HTTP_HID_FROM                                       48  /* "From" */
+#define YMO_HTTP_HID_FRONT_END_HTTPS                            49  /* "Front-End-Https" */
+#define YMO_HTTP_HID_HTTP                                       50  /* "HTTP" */
+#define YMO_HTTP_HID_HTTP2_SETTINGS                             51  /* "HTTP2-Settings" */
+#define YMO_HTTP_HID_HOST                                       52  /* "Host" */
+#define YMO_HTTP_HID_IM                                         53  /* "IM" */
+#define YMO_HTTP_HID_IF_MATCH                                   54  /* "If-Match" */
+#define YMO_HTTP_HID_IF_MODIFIED_SINCE                          55  /* "If-Modified-Since" */
+#define YMO_HTTP_HID_IF_NONE_MATCH                              56  /* "If-None-Match" */
+#define YMO_HTTP_HID_IF_RANGE                                   57  /* "If-Range" */
+#define YMO_HTTP_HID_IF_UNMODIFIED_SINCE                        58  /* "If-Unmodified-Since" */
+#define YMO_HTTP_HID_KEEP_ALIVE                                 59  /* "Keep-Alive" */
+#define YMO_HTTP_HID_LAST_MODIFIED                              60  /* "Last-Modified" */
+#define YMO_HTTP_HID_LINK                                       61  /* "Link" */
+#define YMO_HTTP_HID_LOCATION                                   62  /* "Location" */
+#define YMO_HTTP_HID_MAX_FORWARDS                               63  /* "Max-Forwards" */
+#define YMO_HTTP_HID_NEL                                        64  /* "NEL" */
+#define YMO_HTTP_HID_ORIGIN                                     65  /* "Origin" */
+#define YMO_HTTP_HID_P3P                                        66  /* "P3P" */
+#define YMO_HTTP_HID_PERMISSIONS_POLICY                         67  /* "Permissions-Policy" */
+#define YMO_HTTP_HID_PRAGMA                                     68  /* "Pragma" */
+#define YMO_HTTP_HID_PREFER                                     69  /* "Prefer" */
+#define YMO_HTTP_HID_PREFERENCE_APPLIED                         70  /* "Preference-Applied" */
+#define YMO_HTTP_HID_PROXY_AUTHENTICATE                         71  /* "Proxy-Authenticate" */
+#define YMO_HTTP_HID_PROXY_AUTHORIZATION                        72  /* "Proxy-Authorization" */
+#define YMO_HTTP_HID_PROXY_CONNECTION                           73  /* "Proxy-Connection" */
+#define YMO_HTTP_HID_PUBLIC_KEY_PINS                            74  /* "Public-Key-Pins" */
+#define YMO_HTTP_HID_RANGE                                      75  /* "Range" */
+#define YMO_HTTP_HID_REFERER                                    76  /* "Referer" */
+#define YMO_HTTP_HID_REFRESH                                    77  /* "Refresh" */
+#define YMO_HTTP_HID_REPORT_TO                                  78  /* "Report-To" */
+#define YMO_HTTP_HID_RETRY_AFTER                                79  /* "Retry-After" */
+#define YMO_HTTP_HID_SAVE_DATA                                  80  /* "Save-Data" */
+#define YMO_HTTP_HID_SEC_WEBSOCKET_EXTENSIONS                   81  /* "Sec-WebSocket-Extensions" */
+#define YMO_HTTP_HID_SEC_WEBSOCKET_KEY                          82  /* "Sec-WebSocket-Key" */
+#define YMO_HTTP_HID_SEC_WEBSOCKET_PROTOCOL                     83  /* "Sec-WebSocket-Protocol" */
+#define YMO_HTTP_HID_SEC_WEBSOCKET_VERSION                      84  /* "Sec-WebSocket-Version" */
+#define YMO_HTTP_HID_SERVER                                     85  /* "Server" */
+#define YMO_HTTP_HID_SET_COOKIE                                 86  /* "Set-Cookie" */
+#define YMO_HTTP_HID_STATUS                                     87  /* "Status" */
+#define YMO_HTTP_HID_STRICT_TRANSPORT_SECURITY                  88  /* "Strict-Transport-Security" */
+#define YMO_HTTP_HID_TE                                         89  /* "TE" */
+#define YMO_HTTP_HID_TIMING_ALLOW_ORIGIN                        90  /* "Timing-Allow-Origin" */
+#define YMO_HTTP_HID_TK                                         91  /* "Tk" */
+#define YMO_HTTP_HID_TRAILER                                    92  /* "Trailer" */
+#define YMO_HTTP_HID_TRANSFER_ENCODING                          93  /* "Transfer-Encoding" */
+#define YMO_HTTP_HID_UPGRADE                                    94  /* "Upgrade" */
+#define YMO_HTTP_HID_UPGRADE_INSECURE_REQUESTS                  95  /* "Upgrade-Insecure-Requests" */
+#define YMO_HTTP_HID_USER_AGENT                                 96  /* "User-Agent" */
+#define YMO_HTTP_HID_VARY                                       97  /* "Vary" */
+#define YMO_HTTP_HID_VIA                                        98  /* "Via" */
+#define YMO_HTTP_HID_WWW_AUTHENTICATE                           99  /* "WWW-Authenticate" */
+#define YMO_HTTP_HID_WARNING                                   100  /* "Warning" */
+#define YMO_HTTP_HID_X_ATT_DEVICEID                            101  /* "X-ATT-DeviceId" */
+#define YMO_HTTP_HID_X_ASPNET_VERSION                          102  /* "X-Aspnet-Version" */
+#define YMO_HTTP_HID_X_CONTENT_DURATION                        103  /* "X-Content-Duration" */
+#define YMO_HTTP_HID_X_CONTENT_SECURITY_POLICY                 104  /* "X-Content-Security-Policy" */
+#define YMO_HTTP_HID_X_CONTENT_TYPE_OPTIONS                    105  /* "X-Content-Type-Options" */
+#define YMO_HTTP_HID_X_CORRELATION_ID                          106  /* "X-Correlation-ID" */
+#define YMO_HTTP_HID_X_CSRF_TOKEN                              107  /* "X-Csrf-Token" */
+#define YMO_HTTP_HID_X_FORWARDED_FOR                           108  /* "X-Forwarded-For" */
+#define YMO_HTTP_HID_X_FORWARDED_HOST                          109  /* "X-Forwarded-Host" */
+#define YMO_HTTP_HID_X_FORWARDED_PROTO                         110  /* "X-Forwarded-Proto" */
+#define YMO_HTTP_HID_X_FRAME_OPTIONS                           111  /* "X-Frame-Options" */
+#define YMO_HTTP_HID_X_HTTP_METHOD_OVERRIDE                    112  /* "X-Http-Method-Override" */
+#define YMO_HTTP_HID_X_PERMITTED_CROSS_DOMAIN_POLICIES         113  /* "X-Permitted-Cross-Domain-Policies" */
+#define YMO_HTTP_HID_X_PINGBACK                                114  /* "X-Pingback" */
+#define YMO_HTTP_HID_X_POWERED_BY                              115  /* "X-Powered-By" */
+#define YMO_HTTP_HID_X_REDIRECT_BY                             116  /* "X-Redirect-By" */
+#define YMO_HTTP_HID_X_REQUEST_ID                              117  /* "X-Request-ID" */
+#define YMO_HTTP_HID_X_REQUESTED_WITH                          118  /* "X-Requested-With" */
+#define YMO_HTTP_HID_X_ROBOTS_TAG                              119  /* "X-Robots-Tag" */
+#define YMO_HTTP_HID_X_UA_COMPATIBLE                           120  /* "X-UA-Compatible" */
+#define YMO_HTTP_HID_X_UIDH                                    121  /* "X-UIDH" */
+#define YMO_HTTP_HID_X_WAP_PROFILE                             122  /* "X-Wap-Profile" */
+#define YMO_HTTP_HID_X_WEBKIT_CSP                              123  /* "X-WebKit-CSP" */
+#define YMO_HTTP_HID_X_XSS_PROTECTION                          124  /* "X-XSS-Protection" */
+
+/** Number of standard header ids (i.e. largest standard id). */
+#define YMO_HTTP_HID_STD_MAX 124
+
+/** Length of the longest standard header name. */
+#define YMO_HTTP_HDR_STD_LEN_MAX 35
+
+#endif /* YMO_HTTP_HDR_IDS_H */
+
@@ -92,12 +92,17 @@ int ymo_http_hdr_cmp(
         const char*hdr,
         ymo_http_hdr_id_t h_id)
 {
-    return current->h_id == h_id;
+    return current->h_id == h_id
+        && (!(h_id & YMO_HTTP_HID_HASHED)
+            || !hdr || !strcasecmp(current->hdr, hdr));
 }
 
 
 #endif /* HAVE_FUNC_ATTRIBUTE_WEAK */
 
+/* Index slots are 16 bits wide (and 0 means "empty"): */
+#define HDR_TABLE_CAPACITY_MAX 0x8000
+
 ymo_http_hdr_table_t* ymo_http_hdr_table_create()
 {
     ymo_http_hdr_table_t* table = YMO_NEW0(ymo_http_hdr_table_t);
@@ -110,185 +115,241 @@ ymo_http_hdr_table_t* ymo_http_hdr_table_create()
 
 void ymo_http_hdr_table_init(ymo_http_hdr_table_t* table)
 {
-#if YMO_HDR_TABLE_POOL_SIZE
-    for( size_t i = 0; i < YMO_HDR_TABLE_POOL_SIZE-1; i++ ) {
-        table->pool.items[i].next = &(table->pool.items[i+1]);
-    }
-    table->pool.head = &(table->pool.items[0]);
-#endif /* YMO_HDR_TABLE_POOL_SIZE */
+    table->items = table->inline_items;
+    table->index = table->inline_index;
+    table->count = 0;
+    table->capacity = YMO_HDR_TABLE_INLINE_SIZE;
+    memset(table->inline_index, 0, sizeof(table->inline_index));
     return;
 }
 
 
-static inline ymo_http_hdr_table_node_t* ymo_http_hdr_table_node_create(
-        ymo_http_hdr_table_t* table)
+void ymo_http_hdr_table_free(ymo_http_hdr_table_t* table)
 {
-    ymo_http_hdr_table_node_t* node = NULL;
-#if YMO_HDR_TABLE_POOL_SIZE
-    if( table->pool.head ) {
-        node = table->pool.head;
-        table->pool.head = node->next;
-        node->flags = YMO_HDR_FLAG_DEFAULT;
-    } else {
-        node = YMO_NEW(ymo_http_hdr_table_node_t);
-        if( node ) {
-            node->flags |= YMO_HDR_FLAG_DEFAULT | YMO_HDR_FLAG_NOPOOL;
-        }
-    }
-#else
-    node = YMO_NEW(ymo_http_hdr_table_node_t);
-#endif /* YMO_HDR_TABLE_POOL_SIZE */
-    return node;
+    ymo_http_hdr_table_clear(table);
+    YMO_DELETE(ymo_http_hdr_table_t, table);
 }
 
 
-static void ymo_http_hdr_table_node_free(
-        ymo_http_hdr_table_t* table, ymo_http_hdr_table_node_t* node)
+/*---------------------------------------------------------------*
+ *  Internals:
+ *---------------------------------------------------------------*/
+/* Find the first entry for the given header. If idx_out is non-NULL, it's set
+ * to the index position of the match or, failing that, the empty position
+ * where it would go.
+ */
+static ymo_http_hdr_table_node_t* table_find(
+        const ymo_http_hdr_table_t* table,
+        ymo_http_hdr_id_t h_id,
+        const char* hdr,
+        size_t* idx_out)
 {
-    if( node->buffer ) {
-        free(node->buffer);
-        node->buffer = NULL;
+    ymo_http_hdr_table_node_t* found = NULL;
+    size_t mask = (table->capacity << 1) - 1;
+    size_t idx = h_id & mask;
+    ymo_http_hdr_slot_t slot;
+
+    while( (slot = table->index[idx]) ) {
+        ymo_http_hdr_table_node_t* current = &table->items[slot-1];
+        if( YMO_HTTP_HDR_CMP(current, hdr, h_id) ) {
+            found = current;
+            break;
+        }
+        idx = (idx + 1) & mask;
     }
 
-#if YMO_HDR_TABLE_POOL_SIZE
-    if( node->flags & YMO_HDR_FLAG_NOPOOL ) {
-        YMO_DELETE(ymo_http_hdr_table_node_t, node);
-    } else {
-        node->next = table->pool.head;
-        table->pool.head = node;
+    if( idx_out ) {
+        *idx_out = idx;
     }
-#else
-    YMO_DELETE(ymo_http_hdr_table_node_t, node);
-#endif /* YMO_HDR_TABLE_POOL_SIZE */
-    return;
+    return found;
 }
 
 
-void ymo_http_hdr_table_free(ymo_http_hdr_table_t* table)
+/* Make sure there's room for at least one more entry, moving the table to
+ * the heap (or a bigger heap allocation) if there isn't.
+ */
+static ymo_status_t table_reserve(ymo_http_hdr_table_t* table)
 {
-    ymo_http_hdr_table_clear(table);
-    YMO_DELETE(ymo_http_hdr_table_t, table);
+    if( table->count < table->capacity ) {
+        return YMO_OKAY;
+    }
+
+    size_t capacity = table->capacity << 1;
+    if( capacity > HDR_TABLE_CAPACITY_MAX ) {
+        return ENOMEM;
+    }
+
+    ymo_http_hdr_table_node_t* items = YMO_ALLOC(
+            capacity * sizeof(ymo_http_hdr_table_node_t));
+    ymo_http_hdr_slot_t* index = YMO_ALLOC0(
+            (capacity << 1) * sizeof(ymo_http_hdr_slot_t));
+    if( !items || !index ) {
+        YMO_FREE(items);
+        YMO_FREE(index);
+        return ENOMEM;
+    }
+
+    memcpy(items, table->items,
+            table->count * sizeof(ymo_http_hdr_table_node_t));
+    if( table->items != table->inline_items ) {
+        YMO_FREE(table->items);
+        YMO_FREE(table->index);
+    }
+    table->items = items;
+    table->index = index;
+    table->capacity = capacity;
+
+    /* Re-index the first entry for each header: */
+    size_t mask = (capacity << 1) - 1;
+    for( size_t i = 0; i < table->count; i++ ) {
+        if( !(items[i].flags & YMO_HDR_FLAG_DUP) ) {
+            size_t idx = items[i].h_id & mask;
+            while( index[idx] ) {
+                idx = (idx + 1) & mask;
+            }
+            index[idx] = (ymo_http_hdr_slot_t)(i+1);
+        }
+    }
+
+    YMO_HDR_TABLE_TRACE("Grew header table %p to %zu entries",
+            (void*)table, capacity);
+    return YMO_OKAY;
 }
 
 
-static ymo_http_hdr_id_t table_insert_first(
+/* Append a new entry (the caller has already reserved space): */
+static ymo_http_hdr_table_node_t* table_append(
         ymo_http_hdr_table_t* table,
         ymo_http_hdr_id_t h_id,
-        ymo_http_hdr_id_t index,
-        size_t hdr_len,
         const char* hdr,
+        size_t hdr_len,
         const char* value)
 {
-    ymo_http_hdr_table_node_t* node = ymo_http_hdr_table_node_create(table);
-    if( node ) {
-        node->h_id = h_id;
-        node->hdr = hdr;
-        node->hdr_len = hdr_len;
-        node->value = value;
-        node->next = table->bucket[index];
-        node->buffer = NULL;
-        table->bucket[index] = node;
-    } else {
-        errno = ENOMEM;
-        h_id = 0;
+    ymo_http_hdr_table_node_t* node = &table->items[table->count++];
+    node->h_id = h_id;
+    node->flags = YMO_HDR_FLAG_DEFAULT;
+    node->hdr = hdr;
+    node->value = value;
+    node->hdr_len = hdr_len;
+    node->buffer = NULL;
+    node->next = 0;
+
+    /* Set-Cookie values can't be comma-joined (RFC 6265 §3): */
+    if( h_id == YMO_HTTP_HID_SET_COOKIE ) {
+        node->flags |= YMO_HDR_FLAG_MULTI;
     }
+    return node;
+}
 
-    return h_id;
+
+/* Join value onto the combined value for the header at first: */
+static ymo_status_t table_join(
+        ymo_http_hdr_table_node_t* first, const char* value)
+{
+    const char* prev = first->buffer ? first->buffer : first->value;
+    size_t prev_len = strlen(prev);
+    size_t value_len = strlen(value);
+    char* buffer = realloc(first->buffer, prev_len + value_len + sizeof(","));
+    if( !buffer ) {
+        return ENOMEM;
+    }
+
+    if( !first->buffer ) {
+        memcpy(buffer, prev, prev_len);
+    }
+    buffer[prev_len] = ',';
+    memcpy(buffer + prev_len + 1, value, value_len + 1);
+    first->buffer = buffer;
+    return YMO_OKAY;
 }
 
 
-ymo_http_hdr_id_t ymo_http_hdr_table_insert_precompute(
+static ymo_http_hdr_id_t table_add(
         ymo_http_hdr_table_t* table,
         ymo_http_hdr_id_t h_id,
         const char* hdr,
         size_t hdr_len,
-        const char* value)
+        const char* value,
+        int replace)
 {
-    ymo_http_hdr_id_t index = h_id % YMO_HDR_TABLE_BUCKET_SIZE;
-    ymo_http_hdr_table_node_t* current = table->bucket[index];
-    while( current ) {
-        if( YMO_HTTP_HDR_CMP(current, hdr, h_id) ) {
-            if( current->buffer ) {
-                free(current->buffer);
-            }
+    ymo_status_t status;
+    ymo_http_hdr_table_node_t* first;
+    ymo_http_hdr_table_node_t* node;
+    size_t idx;
+
+    if( (status = table_reserve(table)) != YMO_OKAY ) {
+        goto add_bail;
+    }
 
-            current->hdr = hdr;
-            current->value = value;
-            current->hdr_len = hdr_len;
-            return h_id;
+    first = table_find(table, h_id, hdr, &idx);
+    if( !first ) {
+        table_append(table, h_id, hdr, hdr_len, value);
+        table->index[idx] = (ymo_http_hdr_slot_t)table->count;
+        return h_id;
+    }
+
+    if( replace && !(first->flags & YMO_HDR_FLAG_MULTI) ) {
+        if( first->buffer ) {
+            free(first->buffer);
+            first->buffer = NULL;
         }
-        current = current->next;
+        first->hdr = hdr;
+        first->hdr_len = hdr_len;
+        first->value = value;
+
+        /* Unlink any later values (they stay in the array as dead entries
+         * until the table is cleared): */
+        ymo_http_hdr_slot_t slot = first->next;
+        first->next = 0;
+        while( slot ) {
+            node = &table->items[slot-1];
+            slot = node->next;
+            node->next = 0;
+        }
+        return h_id;
     }
 
-    return table_insert_first(table, h_id, index, hdr_len, hdr, value);
+    if( !(first->flags & YMO_HDR_FLAG_MULTI)
+            && (status = table_join(first, value)) != YMO_OKAY ) {
+        goto add_bail;
+    }
+
+    /* Link the new value onto the end of the chain for this header: */
+    node = first;
+    while( node->next ) {
+        node = &table->items[node->next-1];
+    }
+    node->next = (ymo_http_hdr_slot_t)(table->count + 1);
+    node = table_append(table, h_id, hdr, hdr_len, value);
+    node->flags |= YMO_HDR_FLAG_DUP;
+    return h_id;
+
+add_bail:
+    errno = status;
+    return 0;
 }
 
 
-ymo_http_hdr_id_t ymo_http_hdr_table_insert(
-        ymo_http_hdr_table_t* table, const char* hdr, const char* value)
+/*---------------------------------------------------------------*
+ *  Public API:
+ *---------------------------------------------------------------*/
+ymo_http_hdr_id_t ymo_http_hdr_table_insert_precompute(
+        ymo_http_hdr_table_t* table,
+        ymo_http_hdr_id_t h_id,
+        const char* hdr,
+        size_t hdr_len,
+        const char* value)
 {
-    size_t hdr_len;
-    ymo_http_hdr_id_t h_id = YMO_HDR_HASH_FN(hdr, &hdr_len);
-    return ymo_http_hdr_table_insert_precompute(
-            table, h_id, hdr, hdr_len, value);
+    return table_add(table, h_id, hdr, hdr_len, value, 1);
 }
 
 
-ymo_http_hdr_id_t ymo_http_hdr_table_add(
+ymo_http_hdr_id_t ymo_http_hdr_table_insert(
         ymo_http_hdr_table_t* table, const char* hdr, const char* value)
 {
-    size_t hdr_len;
-    ymo_http_hdr_id_t h_id = YMO_HDR_HASH_FN(hdr, &hdr_len);
-    ymo_http_hdr_id_t index = h_id % YMO_HDR_TABLE_BUCKET_SIZE;
-    ymo_http_hdr_table_node_t* current = table->bucket[index];
-    while( current ) {
-        if( YMO_HTTP_HDR_CMP(current, hdr, h_id) ) {
-#define YMO_HTTP_HDR_SET_COOKIE_HACK 1
-#if defined(YMO_HTTP_HDR_SET_COOKIE_HACK) && YMO_HTTP_HDR_SET_COOKIE_HACK
-            /* HACK HACK HACK: This will break if the hash function is
-             * overridden! */
-            if( current->h_id == YMO_HTTP_HID_SET_COOKIE ) {
-                return table_insert_first(
-                        table, YMO_HTTP_HID_SET_COOKIE, index,
-                        hdr_len, hdr, value);
-            }
-#endif /* YMO_HTTP_HDR_SET_COOKIE_HACK */
-
-            /* TODO: tidy this up! */
-            size_t value_len = strlen(value);
-            if( !current->buffer ) {
-                size_t buff_size =
-                    strlen(current->value) + value_len + sizeof(",");
-                current->buffer = malloc(buff_size);
-                if( !current->buffer ) {
-                    goto add_nomem;
-                }
-                snprintf(current->buffer, buff_size,
-                        "%s,%s", current->value, value);
-            } else {
-                size_t buff_len = strlen(current->buffer);
-                size_t buff_size = buff_len + value_len + sizeof(",");
-                current->buffer = realloc(current->buffer, buff_size);
-                if( !current->buffer ) {
-                    goto add_nomem;
-                }
-                char* buff_end = current->buffer + buff_len;
-                (*buff_end++) = ',';
-                strncpy(buff_end, value, value_len);
-            }
-            goto add_done;
-        }
-        current = current->next;
-    }
-
-    return table_insert_first(table, h_id, index, hdr_len, hdr, value);
-
-add_done:
-    return h_id;
-
-add_nomem:
-    errno = ENOMEM;
-    return 0;
+    size_t hdr_len = strlen(hdr);
+    ymo_http_hdr_id_t h_id = ymo_http_hdr_id(hdr, hdr_len);
+    return table_add(table, h_id, hdr, hdr_len, value, 1);
 }
 
 
@@ -299,96 +360,78 @@ ymo_http_hdr_id_t ymo_http_hdr_table_add_precompute(
         size_t hdr_len,
         const char* value)
 {
-    ymo_http_hdr_id_t index = h_id % YMO_HDR_TABLE_BUCKET_SIZE;
-    ymo_http_hdr_table_node_t* current = table->bucket[index];
-    while( current ) {
-        if( YMO_HTTP_HDR_CMP(current, hdr, h_id) ) {
-            /* HACK HACK HACK HACK: tidy up all of this... */
-            size_t value_len = strlen(value);
-            if( !current->buffer ) {
-                size_t buff_size =
-                    strlen(current->value) + value_len + sizeof(",");
-                current->buffer = malloc(buff_size);
-                if( !current->buffer ) {
-                    goto add_nomem;
-                }
-                snprintf(current->buffer, buff_size,
-                        "%s,%s", current->value, value);
-            } else {
-                size_t buff_len = strlen(current->buffer);
-                size_t buff_size = buff_len + value_len + sizeof(",");
-                current->buffer = realloc(current->buffer, buff_size);
-                if( !current->buffer ) {
-                    goto add_nomem;
-                }
-                char* buff_end = current->buffer + buff_len;
-                (*buff_end++) = ',';
-                strncpy(buff_end, value, value_len);
-            }
-            goto add_done;
-        }
-        current = current->next;
-    }
-
-    return table_insert_first(table, h_id, index, hdr_len, hdr, value);
+    return table_add(table, h_id, hdr, hdr_len, value, 0);
+}
 
-add_done:
-    return h_id;
 
-add_nomem:
-    errno = ENOMEM;
-    return 0;
+ymo_http_hdr_id_t ymo_http_hdr_table_add(
+        ymo_http_hdr_table_t* table, const char* hdr, const char* value)
+{
+    size_t hdr_len = strlen(hdr);
+    ymo_http_hdr_id_t h_id = ymo_http_hdr_id(hdr, hdr_len);
+    return table_add(table, h_id, hdr, hdr_len, value, 0);
 }
 
 
 const char* ymo_http_hdr_table_get(
         const ymo_http_hdr_table_t* table, const char* hdr)
 {
-    ymo_http_hdr_id_t h_id = YMO_HDR_HASH_FN(hdr, NULL);
-    return ymo_http_hdr_table_get_id(table, h_id);
+    ymo_http_hdr_id_t h_id = ymo_http_hdr_id(hdr, strlen(hdr));
+    ymo_http_hdr_table_node_t* first = table_find(table, h_id, hdr, NULL);
+    if( first ) {
+        return first->buffer ? first->buffer : first->value;
+    }
+    return NULL;
 }
 
 
 const char* ymo_http_hdr_table_get_id(
         const ymo_http_hdr_table_t* table, ymo_http_hdr_id_t h_id)
 {
-    const char* data = NULL;
-    ymo_http_hdr_id_t index = h_id % YMO_HDR_TABLE_BUCKET_SIZE;
-    ymo_http_hdr_table_node_t* current = table->bucket[index];
-    while( current ) {
-        /* TODO: compare strings to ensure it's not just hash collision.
-         *
-         * NOTE: this means we probably need to pass in the const char* anyway.
-         */
-        if( YMO_HTTP_HDR_CMP(current, NULL, h_id) ) {
-            if( !current->buffer ) {
-                data = current->value;
-            } else {
-                data = current->buffer;
-            }
-            break;
-        }
-        current = current->next;
+    ymo_http_hdr_table_node_t* first = table_find(table, h_id, NULL, NULL);
+    if( first ) {
+        return first->buffer ? first->buffer : first->value;
     }
-    return data;
+    return NULL;
+}
+
+
+ymo_http_hdr_ptr_t ymo_http_hdr_table_next_value(
+        const ymo_http_hdr_table_t* table,
+        const char* hdr,
+        ymo_http_hdr_ptr_t cur,
+        const char** value)
+{
+    if( !cur ) {
+        ymo_http_hdr_id_t h_id = ymo_http_hdr_id(hdr, strlen(hdr));
+        cur = table_find(table, h_id, hdr, NULL);
+    } else if( cur->next ) {
+        cur = &table->items[cur->next-1];
+    } else {
+        cur = NULL;
+    }
+
+    if( cur ) {
+        *value = cur->value;
+    }
+    return cur;
 }
 
 
 void ymo_http_hdr_table_clear(ymo_http_hdr_table_t* table)
 {
-    ymo_http_hdr_table_node_t* current = NULL;
-    for( ymo_http_hdr_id_t index = 0;
-         index < YMO_HDR_TABLE_BUCKET_SIZE; index++ ) {
-
-        current = table->bucket[index];
-        while( current ) {
-            ymo_http_hdr_table_node_t* dnode = current;
-            current = current->next;
-            ymo_http_hdr_table_node_free(table, dnode);
+    for( size_t i = 0; i < table->count; i++ ) {
+        if( table->items[i].buffer ) {
+            free(table->items[i].buffer);
         }
-        table->bucket[index] = NULL;
     }
 
+    if( table->items && table->items != table->inline_items ) {
+        YMO_FREE(table->items);
+        YMO_FREE(table->index);
+    }
+    ymo_http_hdr_table_init(table);
+    return;
 }
 
 
@@ -400,48 +443,22 @@ ymo_http_hdr_ptr_t ymo_http_hdr_table_next(
         const char** value
         )
 {
-    /* If we've already started, jump right to finding: */
-    if( cur ) {
-        /* If we've got another in this bucket, use that! */
-        if( cur->next ) {
-            cur = cur->next;
-            goto found_next;
-        }
-
-        /* Otherwise, we'll have to jump bucket-to-bucket: */
-        ymo_http_hdr_id_t h_id = cur->h_id;
-        size_t h_start = (h_id % YMO_HDR_TABLE_BUCKET_SIZE)+1;
-        for( size_t i = h_start; i < YMO_HDR_TABLE_BUCKET_SIZE; i++ ) {
-            cur = table->bucket[i];
-            if( cur ) {
-                goto found_next;
-            }
-        }
-
-        return NULL;
-
-found_next:
-        {
+    ymo_http_hdr_table_node_t* end = table->items + table->count;
+
+    /* Entries are in arrival order. Repeated headers are reported once (at
+     * the position of the first) with their values joined — except for those
+     * which can't be joined (i.e. Set-Cookie), which are reported as-is:
+     */
+    for( cur = cur ? cur+1 : table->items; cur < end; cur++ ) {
+        if( !(cur->flags & YMO_HDR_FLAG_DUP)
+                || (cur->flags & YMO_HDR_FLAG_MULTI) ) {
             *hdr = cur->hdr;
             *hdr_len = cur->hdr_len;
-            if( !cur->buffer ) {
-                *value = cur->value;
-            } else {
-                *value = cur->buffer;
-            }
-
+            *value = cur->buffer ? cur->buffer : cur->value;
             return cur;
         }
-    } else {
-        for( size_t i = 0; i < YMO_HDR_TABLE_BUCKET_SIZE; i++ ) {
-            cur = table->bucket[i];
-            if( cur ) {
-                goto found_next;
-            }
-        }
     }
 
-    /* If we make it here, the header table is empty. */
-    return cur;
+    return NULL;
 }
 
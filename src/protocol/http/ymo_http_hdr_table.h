@@ -24,6 +24,7 @@
 #ifndef YMO_HTTP_HDR_TABLE_H
 #define YMO_HTTP_HDR_TABLE_H
 #include <stdint.h>
+#include <strings.h>
 #include "yimmo.h"
 #include "ymo_http.h"
 
@@ -31,8 +32,53 @@
  * ====================
  *
  * HTTP header hash table.
+ *
+ * Header ids come in two flavors:
+ *
+ * - **Standard headers** (those listed in ``extra/ymo_std_http.c``) are
+ *   assigned small, dense, collision-free ids at build time by
+ *   ``ymo_http_hdr_gen`` (see ``ymo_http_hdr_ids.h``). These are stable and
+ *   safe to switch on, e.g. ``YMO_HTTP_HID_CONTENT_LENGTH``.
+ * - **Everything else** gets the (masked) hash of its name, tagged with
+ *   :c:macro:`YMO_HTTP_HID_HASHED`. Hashed ids may collide, so table lookups
+ *   by name fall back to a full, case-insensitive string compare.
  */
 
+/*---------------------------------------------------------------------------*
+ * Standard header IDs:
+ *--------------------------------------------------------------------------*/
+#include "ymo_http_hdr_ids.h"
+
+/** Not a header / not a standard header. */
+#define YMO_HTTP_HID_NONE   0
+
+/** Flag set on the ids of non-standard headers, whose low bits are a hash of
+ * the header name (and therefore *not* unique). */
+#define YMO_HTTP_HID_HASHED 0x8000
+
+/** Case-fold a header name character the way the generated lookup does
+ * (only meaningful for ``[0-9A-Za-z-]``). */
+#define YMO_HTTP_HDR_FOLD(c) ((unsigned char)((c) | 0x20))
+
+/** Entry in the table of standard header names, indexed by id. */
+typedef struct ymo_http_hdr_std {
+    const char*  name;
+    size_t       len;
+} ymo_http_hdr_std_t;
+
+/** Standard header names, indexed by id (entry 0 is ``{ NULL, 0 }``). */
+extern const ymo_http_hdr_std_t ymo_http_hdr_std[YMO_HTTP_HID_STD_MAX+1];
+
+/** Look up the id of a standard header name (generated).
+ *
+ * :param hdr: header name (need not be ``NUL``-terminated)
+ * :param len: length of ``hdr``
+ * :returns: the ``YMO_HTTP_HID_*`` id for ``hdr`` (matched
+ *     case-insensitively) or ``YMO_HTTP_HID_NONE``.
+ */
+YMO_FUNC_PURE ymo_http_hdr_id_t ymo_http_hdr_std_id(
+        const char* hdr, size_t len);
+
 #if defined(HAVE_FUNC_ATTRIBUTE_WEAK) \
     && (HAVE_FUNC_ATTRIBUTE_WEAK == 1) \
     && defined(YMO_HTTP_HDR_HASH_ALLOW_WEAK) \
@@ -117,18 +163,43 @@ static inline int ymo_http_hdr_cmp(
         const char*hdr,
         ymo_http_hdr_id_t h_id)
 {
-    return current->h_id == h_id;
+    return current->h_id == h_id
+        && (!(h_id & YMO_HTTP_HID_HASHED)
+            || !hdr || !strcasecmp(current->hdr, hdr));
 }
 
 
 #endif /* HAVE_FUNC_ATTRIBUTE_WEAK && YMO_HTTP_HDR_HASH_ALLOW_WEAK */
 
 
+/** Get the table id for a header name: the standard id, if there is one,
+ * or else the hashed id.
+ *
+ * :param hdr: header name (need not be ``NUL``-terminated)
+ * :param len: length of ``hdr``
+ */
+__attribute__((YMO_FUNC_PURE_P, YMO_FUNC_UNUSED_A))
+static inline ymo_http_hdr_id_t ymo_http_hdr_id(const char* hdr, size_t len)
+{
+    ymo_http_hdr_id_t h_id = ymo_http_hdr_std_id(hdr, len);
+    if( !h_id ) {
+        /* Same as YMO_HDR_HASH_FN, but over exactly len bytes: */
+        ymo_http_hdr_id_t h = YMO_HTTP_HDR_HASH_INIT();
+        for( size_t i = 0; i < len; i++ ) {
+            h = YMO_HDR_HASH_CH(h, hdr[i]);
+        }
+        h_id = YMO_HTTP_HID_HASHED
+            | ((h & YMO_HDR_TABLE_MASK) & (YMO_HTTP_HID_HASHED-1));
+    }
+    return h_id;
+}
+
+
 
 /* Flags */
 #define YMO_HDR_FLAG_DEFAULT      0x00
-#define YMO_HDR_FLAG_NOPOOL       0x01
-#define YMO_HDR_FLAG_MULTI        0x02
+#define YMO_HDR_FLAG_DUP          0x01 /* Repeat of an earlier header */
+#define YMO_HDR_FLAG_MULTI        0x02 /* Values can't be joined */
 
 
 /** */
@@ -150,148 +221,15 @@ ymo_http_hdr_id_t ymo_http_hdr_table_add_precompute(
         size_t hdr_len,
         const char* value);
 
-/** */
-const char* ymo_http_hdr_table_get_id(
-        const ymo_http_hdr_table_t* table, ymo_http_hdr_id_t h_id);
-
-
-/*----------------------------------------------------------------------------
- * IDs for common headers:
- *----------------------------------------------------------------------------*/
-
-/*
- * .. warning::
- *    Don't rely on these.
+/** Get a header value by id.
  *
- * .. todo::
- *    Compute these at build/runtime or something. These are the keys for
- *    the 283/5 algorithm on uint16_t == not gonna work everywhere.
+ * .. note::
+ *    Intended for standard ids (``YMO_HTTP_HID_*``). Hashed ids aren't
+ *    unique — use :c:func:`ymo_http_hdr_table_get` for anything else.
  */
+const char* ymo_http_hdr_table_get_id(
+        const ymo_http_hdr_table_t* table, ymo_http_hdr_id_t h_id);
 
-#define YMO_HTTP_HID_A_IM                                   19549  /* "A-IM" */
-#define YMO_HTTP_HID_ACCEPT                                   597  /* "Accept" */
-#define YMO_HTTP_HID_ACCEPT_CH                               8637  /* "Accept-CH" */
-#define YMO_HTTP_HID_ACCEPT_CHARSET                         27356  /* "Accept-Charset" */
-#define YMO_HTTP_HID_ACCEPT_DATETIME                         1387  /* "Accept-Datetime" */
-#define YMO_HTTP_HID_ACCEPT_ENCODING                        17935  /* "Accept-Encoding" */
-#define YMO_HTTP_HID_ACCEPT_LANGUAGE                          220  /* "Accept-Language" */
-#define YMO_HTTP_HID_ACCEPT_PATCH                           14124  /* "Accept-Patch" */
-#define YMO_HTTP_HID_ACCEPT_RANGES                           7566  /* "Accept-Ranges" */
-#define YMO_HTTP_HID_ACCESS_CONTROL_ALLOW_CREDENTIALS       24108  /* "Access-Control-Allow-Credentials" */
-#define YMO_HTTP_HID_ACCESS_CONTROL_ALLOW_HEADERS           26806  /* "Access-Control-Allow-Headers" */
-#define YMO_HTTP_HID_ACCESS_CONTROL_ALLOW_METHODS           18578  /* "Access-Control-Allow-Methods" */
-#define YMO_HTTP_HID_ACCESS_CONTROL_ALLOW_ORIGIN            31630  /* "Access-Control-Allow-Origin" */
-#define YMO_HTTP_HID_ACCESS_CONTROL_EXPOSE_HEADERS          12101  /* "Access-Control-Expose-Headers" */
-#define YMO_HTTP_HID_ACCESS_CONTROL_MAX_AGE                 17818  /* "Access-Control-Max-Age" */
-#define YMO_HTTP_HID_ACCESS_CONTROL_REQUEST_HEADERS         14004  /* "Access-Control-Request-Headers" */
-#define YMO_HTTP_HID_ACCESS_CONTROL_REQUEST_METHOD           4999  /* "Access-Control-Request-Method" */
-#define YMO_HTTP_HID_AGE                                    30026  /* "Age" */
-#define YMO_HTTP_HID_ALLOW                                  14532  /* "Allow" */
-#define YMO_HTTP_HID_ALT_SVC                                 4375  /* "Alt-Svc" */
-#define YMO_HTTP_HID_ALTERNATE_PROTOCOL                      9616  /* "Alternate-Protocol" */
-#define YMO_HTTP_HID_AUTHORIZATION                          10104  /* "Authorization" */
-#define YMO_HTTP_HID_CACHE_CONTROL                          23577  /* "Cache-Control" */
-#define YMO_HTTP_HID_CLIENT_DATE                             4867  /* "Client-Date" */
-#define YMO_HTTP_HID_CLIENT_PEER                             1155  /* "Client-Peer" */
-#define YMO_HTTP_HID_CLIENT_RESPONSE_NUM                     9643  /* "Client-Response-Num" */
-#define YMO_HTTP_HID_CONNECTION                             31919  /* "Connection" */
-#define YMO_HTTP_HID_CONTENT_DISPOSITION                    20678  /* "Content-Disposition" */
-#define YMO_HTTP_HID_CONTENT_ENCODING                       30996  /* "Content-Encoding" */
-#define YMO_HTTP_HID_CONTENT_LANGUAGE                       13281  /* "Content-Language" */
-#define YMO_HTTP_HID_CONTENT_LENGTH                         12647  /* "Content-Length" */
-#define YMO_HTTP_HID_CONTENT_LOCATION                        6246  /* "Content-Location" */
-#define YMO_HTTP_HID_CONTENT_MD5                            23393  /* "Content-MD5" */
-#define YMO_HTTP_HID_CONTENT_RANGE                          25688  /* "Content-Range" */
-#define YMO_HTTP_HID_CONTENT_SECURITY_POLICY                15382  /* "Content-Security-Policy" */
-#define YMO_HTTP_HID_CONTENT_SECURITY_POLICY_REPORT_ONLY    19990  /* "Content-Security-Policy-Report-Only" */
-#define YMO_HTTP_HID_CONTENT_TYPE                           22203  /* "Content-Type" */
-#define YMO_HTTP_HID_COOKIE                                  7269  /* "Cookie" */
-#define YMO_HTTP_HID_DNT                                    10145  /* "DNT" */
-#define YMO_HTTP_HID_DATE                                   27707  /* "Date" */
-#define YMO_HTTP_HID_DELTA_BASE                              4627  /* "Delta-Base" */
-#define YMO_HTTP_HID_ETAG                                   26426  /* "ETag" */
-#define YMO_HTTP_HID_EXPECT                                 20206  /* "Expect" */
-#define YMO_HTTP_HID_EXPECT_CT                               3188  /* "Expect-CT" */
-#define YMO_HTTP_HID_EXPIRES                                25883  /* "Expires" */
-#define YMO_HTTP_HID_FIELD                                  26493  /* "Field" */
-#define YMO_HTTP_HID_FORWARDED                               9023  /* "Forwarded" */
-#define YMO_HTTP_HID_FROM                                   23787  /* "From" */
-#define YMO_HTTP_HID_FRONT_END_HTTPS                        24116  /* "Front-End-Https" */
-#define YMO_HTTP_HID_HTTP                                    1005  /* "HTTP" */
-#define YMO_HTTP_HID_HTTP2_SETTINGS                          1895  /* "HTTP2-Settings" */
-#define YMO_HTTP_HID_HOST                                   26265  /* "Host" */
-#define YMO_HTTP_HID_IM                                     27965  /* "IM" */
-#define YMO_HTTP_HID_IF_MATCH                               27778  /* "If-Match" */
-#define YMO_HTTP_HID_IF_MODIFIED_SINCE                      11681  /* "If-Modified-Since" */
-#define YMO_HTTP_HID_IF_NONE_MATCH                          27075  /* "If-None-Match" */
-#define YMO_HTTP_HID_IF_RANGE                               25482  /* "If-Range" */
-#define YMO_HTTP_HID_IF_UNMODIFIED_SINCE                     5398  /* "If-Unmodified-Since" */
-#define YMO_HTTP_HID_KEEP_ALIVE                             14934  /* "Keep-Alive" */
-#define YMO_HTTP_HID_LAST_MODIFIED                          16971  /* "Last-Modified" */
-#define YMO_HTTP_HID_LINK                                   27519  /* "Link" */
-#define YMO_HTTP_HID_LOCATION                                8770  /* "Location" */
-#define YMO_HTTP_HID_MAX_FORWARDS                           29556  /* "Max-Forwards" */
-#define YMO_HTTP_HID_NEL                                    22048  /* "NEL" */
-#define YMO_HTTP_HID_ORIGIN                                 31375  /* "Origin" */
-#define YMO_HTTP_HID_P3P                                     4240  /* "P3P" */
-#define YMO_HTTP_HID_PERMISSIONS_POLICY                     23036  /* "Permissions-Policy" */
-#define YMO_HTTP_HID_PRAGMA                                 26433  /* "Pragma" */
-#define YMO_HTTP_HID_PREFER                                  1325  /* "Prefer" */
-#define YMO_HTTP_HID_PREFERENCE_APPLIED                      6448  /* "Preference-Applied" */
-#define YMO_HTTP_HID_PROXY_AUTHENTICATE                     19117  /* "Proxy-Authenticate" */
-#define YMO_HTTP_HID_PROXY_AUTHORIZATION                     5837  /* "Proxy-Authorization" */
-#define YMO_HTTP_HID_PROXY_CONNECTION                        3606  /* "Proxy-Connection" */
-#define YMO_HTTP_HID_PUBLIC_KEY_PINS                         6631  /* "Public-Key-Pins" */
-#define YMO_HTTP_HID_RANGE                                    460  /* "Range" */
-#define YMO_HTTP_HID_REFERER                                 1000  /* "Referer" */
-#define YMO_HTTP_HID_REFRESH                                 9946  /* "Refresh" */
-#define YMO_HTTP_HID_REPORT_TO                               2987  /* "Report-To" */
-#define YMO_HTTP_HID_RETRY_AFTER                            21570  /* "Retry-After" */
-#define YMO_HTTP_HID_SAVE_DATA                              18729  /* "Save-Data" */
-#define YMO_HTTP_HID_SEC_WEBSOCKET_EXTENSIONS               11183  /* "Sec-WebSocket-Extensions" */
-#define YMO_HTTP_HID_SEC_WEBSOCKET_KEY                       1788  /* "Sec-WebSocket-Key" */
-#define YMO_HTTP_HID_SEC_WEBSOCKET_PROTOCOL                 19175  /* "Sec-WebSocket-Protocol" */
-#define YMO_HTTP_HID_SEC_WEBSOCKET_VERSION                  16357  /* "Sec-WebSocket-Version" */
-#define YMO_HTTP_HID_SERVER                                 30792  /* "Server" */
-#define YMO_HTTP_HID_SET_COOKIE                             10316  /* "Set-Cookie" */
-#define YMO_HTTP_HID_STATUS                                  6483  /* "Status" */
-#define YMO_HTTP_HID_STRICT_TRANSPORT_SECURITY               3375  /* "Strict-Transport-Security" */
-#define YMO_HTTP_HID_TE                                     31070  /* "TE" */
-#define YMO_HTTP_HID_TIMING_ALLOW_ORIGIN                    27524  /* "Timing-Allow-Origin" */
-#define YMO_HTTP_HID_TK                                     31076  /* "Tk" */
-#define YMO_HTTP_HID_TRAILER                                28074  /* "Trailer" */
-#define YMO_HTTP_HID_TRANSFER_ENCODING                      15812  /* "Transfer-Encoding" */
-#define YMO_HTTP_HID_UPGRADE                                17987  /* "Upgrade" */
-#define YMO_HTTP_HID_UPGRADE_INSECURE_REQUESTS               8995  /* "Upgrade-Insecure-Requests" */
-#define YMO_HTTP_HID_USER_AGENT                             16616  /* "User-Agent" */
-#define YMO_HTTP_HID_VARY                                    6159  /* "Vary" */
-#define YMO_HTTP_HID_VIA                                     8521  /* "Via" */
-#define YMO_HTTP_HID_WWW_AUTHENTICATE                       32140  /* "WWW-Authenticate" */
-#define YMO_HTTP_HID_WARNING                                18231  /* "Warning" */
-#define YMO_HTTP_HID_X_ATT_DEVICEID                          8371  /* "X-ATT-DeviceId" */
-#define YMO_HTTP_HID_X_ASPNET_VERSION                       15676  /* "X-Aspnet-Version" */
-#define YMO_HTTP_HID_X_CONTENT_DURATION                      5654  /* "X-Content-Duration" */
-#define YMO_HTTP_HID_X_CONTENT_SECURITY_POLICY               9965  /* "X-Content-Security-Policy" */
-#define YMO_HTTP_HID_X_CONTENT_TYPE_OPTIONS                 27961  /* "X-Content-Type-Options" */
-#define YMO_HTTP_HID_X_CORRELATION_ID                       13212  /* "X-Correlation-ID" */
-#define YMO_HTTP_HID_X_CSRF_TOKEN                           27754  /* "X-Csrf-Token" */
-#define YMO_HTTP_HID_X_FORWARDED_FOR                         5858  /* "X-Forwarded-For" */
-#define YMO_HTTP_HID_X_FORWARDED_HOST                       32011  /* "X-Forwarded-Host" */
-#define YMO_HTTP_HID_X_FORWARDED_PROTO                       8005  /* "X-Forwarded-Proto" */
-#define YMO_HTTP_HID_X_FRAME_OPTIONS                        13216  /* "X-Frame-Options" */
-#define YMO_HTTP_HID_X_HTTP_METHOD_OVERRIDE                 28957  /* "X-Http-Method-Override" */
-#define YMO_HTTP_HID_X_PERMITTED_CROSS_DOMAIN_POLICIES      30637  /* "X-Permitted-Cross-Domain-Policies" */
-#define YMO_HTTP_HID_X_PINGBACK                             32127  /* "X-Pingback" */
-#define YMO_HTTP_HID_X_POWERED_BY                           14782  /* "X-Powered-By" */
-#define YMO_HTTP_HID_X_REDIRECT_BY                          27466  /* "X-Redirect-By" */
-#define YMO_HTTP_HID_X_REQUEST_ID                           24927  /* "X-Request-ID" */
-#define YMO_HTTP_HID_X_REQUESTED_WITH                       29363  /* "X-Requested-With" */
-#define YMO_HTTP_HID_X_ROBOTS_TAG                           30624  /* "X-Robots-Tag" */
-#define YMO_HTTP_HID_X_UA_COMPATIBLE                        24207  /* "X-UA-Compatible" */
-#define YMO_HTTP_HID_X_UIDH                                  9254  /* "X-UIDH" */
-#define YMO_HTTP_HID_X_WAP_PROFILE                           5928  /* "X-Wap-Profile" */
-#define YMO_HTTP_HID_X_WEBKIT_CSP                           20791  /* "X-WebKit-CSP" */
-#define YMO_HTTP_HID_X_XSS_PROTECTION                         104  /* "X-XSS-Protection" */
 
 #endif /* YMO_HTTP_HDR_TABLE_H */
 
@@ -0,0 +1,554 @@
+/*=============================================================================
+ *
+ * Copyright (c) 2014 Andrew Canaday
+ *
+ * This file is part of libyimmo (sometimes referred to as "yimmo" or "ymo").
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *===========================================================================*/
+
+#include "yimmo_config.h"
+
+#include <errno.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+#include "yimmo.h"
+#include "ymo_log.h"
+#include "ymo_alloc.h"
+#include "ymo_util.h"
+#include "ymo_http.h"
+#include "ymo_http_hdr_ids.h"
+#include "ymo_http_hdr_table.h"
+#include "ymo_http_multipart.h"
+
+/*---------------------------------------------------------------*
+ *  Declarations
+ *---------------------------------------------------------------*/
+
+#define MP_OWS(c) ((c) == ' ' || (c) == '\t')
+
+
+static inline char* skip_ows(char* p)
+{
+    while( MP_OWS(*p) ) {
+        ++p;
+    }
+    return p;
+}
+
+
+/* NUL-terminate [start, end), less trailing whitespace: */
+static inline void trim_end(char* start, char* end)
+{
+    while( end > start && MP_OWS(end[-1]) ) {
+        --end;
+    }
+    *end = '\0';
+}
+
+
+/*---------------------------------------------------------------*
+ *  Headers:
+ *---------------------------------------------------------------*/
+
+/* Find the boundary parameter of a multipart content type: */
+static ymo_status_t mp_boundary(
+        const char* content_type, const char** boundary, size_t* len)
+{
+    if( !content_type || strncasecmp(content_type, "multipart/", 10) ) {
+        return EINVAL;
+    }
+
+    const char* p = strchr(content_type, ';');
+    while( p ) {
+        ++p;
+        while( MP_OWS(*p) ) {
+            ++p;
+        }
+
+        if( !strncasecmp(p, "boundary=", 9) ) {
+            p += 9;
+            if( *p == '"' ) {
+                ++p;
+                *len = strcspn(p, "\"");
+                if( p[*len] != '"' ) {
+                    return EINVAL;
+                }
+            } else {
+                *len = strcspn(p, "; \t");
+            }
+            *boundary = p;
+            return (*len && *len <= YMO_HTTP_MULTIPART_BOUNDARY_MAX)
+                ? YMO_OKAY : EINVAL;
+        }
+        p = strchr(p, ';');
+    }
+    return EINVAL;
+}
+
+
+/* Pick the name and filename out of a Content-Disposition value (in
+ * place):
+ */
+static void mp_disposition(ymo_http_part_t* part, char* p)
+{
+    p = strchr(p, ';');
+    while( p ) {
+        char* key = skip_ows(p + 1);
+        p = key + strcspn(key, "=;");
+        if( *p != '=' ) {
+            p = (*p == ';') ? p : NULL;
+            continue;
+        }
+        trim_end(key, p);
+
+        char* value = skip_ows(p + 1);
+        char* next;
+        if( *value == '"' ) {
+            /* quoted-string (with quoted-pairs unescaped): */
+            char* out = ++value;
+            p = value;
+            while( *p && *p != '"' ) {
+                if( *p == '\\' && p[1] ) {
+                    ++p;
+                }
+                *out++ = *p++;
+            }
+            next = strchr(p + (*p == '"'), ';');
+            *out = '\0';
+        } else {
+            p = value + strcspn(value, ";");
+            next = *p ? p : NULL;
+            trim_end(value, p);
+        }
+
+        if( !strcasecmp(key, "name") ) {
+            part->name = value;
+        } else if( !strcasecmp(key, "filename") ) {
+            part->filename = value;
+        }
+        p = next;
+    }
+}
+
+
+/* Parse the header line ending at mp->hdr_len: */
+static ymo_status_t mp_header_line(ymo_http_multipart_t* mp)
+{
+    char* line = mp->hdr + mp->line_start;
+    char* end = mp->hdr + mp->hdr_len;
+    if( end > line && end[-1] == '\r' ) {
+        --end;
+    }
+
+    /* Blank line: the part begins. */
+    if( end == line ) {
+        mp->state = YMO_HTTP_MULTIPART_BODY;
+        mp->in_part = 1;
+        return mp->cb.begin_cb
+            ? mp->cb.begin_cb(mp->data, &mp->part) : YMO_OKAY;
+    }
+
+    /* (No obs-fold or empty names): */
+    char* colon = memchr(line, ':', end - line);
+    if( !colon || colon == line || MP_OWS(*line) ) {
+        return EBADMSG;
+    }
+
+    *end = '\0';
+    mp->hdr_len = mp->line_start = (end - mp->hdr) + 1;
+
+    trim_end(line, colon);
+    char* value = skip_ows(colon + 1);
+    trim_end(value, end);
+
+    ymo_status_t status = YMO_OKAY;
+    if( mp->cb.header_cb ) {
+        status = mp->cb.header_cb(mp->data, &mp->part, line, value);
+    }
+
+    if( !strcasecmp(line, "content-type") ) {
+        mp->part.content_type = value;
+    } else if( !strcasecmp(line, "content-disposition") ) {
+        mp_disposition(&mp->part, value);
+    }
+    return status;
+}
+
+
+static ymo_status_t mp_headers(
+        ymo_http_multipart_t* mp, const char** pp, const char* end)
+{
+    const char* p = *pp;
+    const char* nl = memchr(p, '\n', end - p);
+    size_t len = (nl ? nl : end) - p;
+
+    /* (Leave room to NUL-terminate the line): */
+    if( mp->hdr_len + len + 1 > YMO_HTTP_MULTIPART_HDR_MAX ) {
+        return EFBIG;
+    }
+    memcpy(mp->hdr + mp->hdr_len, p, len);
+    mp->hdr_len += len;
+
+    if( !nl ) {
+        *pp = end;
+        return YMO_OKAY;
+    }
+    *pp = nl + 1;
+    return mp_header_line(mp);
+}
+
+
+/*---------------------------------------------------------------*
+ *  Part Data:
+ *---------------------------------------------------------------*/
+static ymo_status_t mp_emit(
+        ymo_http_multipart_t* mp, const char* buf, size_t len)
+{
+    if( mp->state != YMO_HTTP_MULTIPART_BODY || !len ) {
+        return YMO_OKAY;
+    }
+    mp->part.len += len;
+
+    if( mp->part.fd >= 0 ) {
+        while( len ) {
+            ssize_t n = write(mp->part.fd, buf, len);
+            if( n < 0 ) {
+                if( errno == EINTR ) {
+                    continue;
+                }
+                return errno;
+            }
+            buf += n;
+            len -= n;
+        }
+        return YMO_OKAY;
+    }
+
+    return mp->cb.data_cb
+        ? mp->cb.data_cb(mp->data, &mp->part, buf, len) : YMO_OKAY;
+}
+
+
+/* Boyer-Moore-Horspool. On failure, *tail is set to the first position at
+ * which a (truncated) delimiter could still begin:
+ */
+static const char* mp_find(
+        const ymo_http_multipart_t* mp,
+        const char* p,
+        const char* end,
+        const char** tail)
+{
+    size_t m = mp->delim_len;
+    uint8_t last = (uint8_t)mp->delim[m-1];
+
+    while( (size_t)(end - p) >= m ) {
+        uint8_t c = (uint8_t)p[m-1];
+        if( c == last && !memcmp(p, mp->delim, m - 1) ) {
+            return p;
+        }
+        p += mp->skip[c];
+    }
+    *tail = p;
+    return NULL;
+}
+
+
+/* Resolve a delimiter prefix held back from the previous chunk: */
+static ymo_status_t mp_held(
+        ymo_http_multipart_t* mp,
+        const char** pp,
+        const char* end,
+        int* found)
+{
+    const char* p = *pp;
+    ymo_status_t status = YMO_OKAY;
+
+    while( mp->lb_len && status == YMO_OKAY ) {
+        size_t need = mp->delim_len - mp->lb_len;
+        size_t n = YMO_MIN(need, (size_t)(end - p));
+
+        if( !memcmp(p, mp->delim + mp->lb_len, n) ) {
+            if( n == need ) {
+                *found = 1;
+                *pp = p + n;
+                mp->lb_len = 0;
+            } else {
+                *pp = end;
+                mp->lb_len += n;
+            }
+            return YMO_OKAY;
+        }
+
+        /* Not a delimiter after all: release bytes up to the next position
+         * which could still start one: */
+        size_t k;
+        for( k = 1; k < mp->lb_len; k++ ) {
+            if( !memcmp(mp->delim + k, mp->delim, mp->lb_len - k) ) {
+                break;
+            }
+        }
+        status = mp_emit(mp, mp->delim, k);
+        mp->lb_len -= k;
+    }
+    return status;
+}
+
+
+/* Pass data along up to the next delimiter: */
+static ymo_status_t mp_search(
+        ymo_http_multipart_t* mp,
+        const char** pp,
+        const char* end,
+        int* found)
+{
+    ymo_status_t status;
+    const char* tail;
+
+    *found = 0;
+    if( (status = mp_held(mp, pp, end, found)) || *found || *pp == end ) {
+        return status;
+    }
+
+    const char* p = *pp;
+    const char* hit = mp_find(mp, p, end, &tail);
+    if( hit ) {
+        *found = 1;
+        *pp = hit + mp->delim_len;
+        return mp_emit(mp, p, hit - p);
+    }
+
+    /* Hold back a trailing delimiter prefix (which begins with CR): */
+    while( (tail = memchr(tail, '\r', end - tail)) ) {
+        if( !memcmp(tail, mp->delim, end - tail) ) {
+            break;
+        }
+        ++tail;
+    }
+    if( !tail ) {
+        tail = end;
+    }
+
+    *pp = end;
+    mp->lb_len = end - tail;
+    return mp_emit(mp, p, tail - p);
+}
+
+
+/* Found a delimiter: */
+static ymo_status_t mp_delimiter(ymo_http_multipart_t* mp)
+{
+    if( mp->in_part ) {
+        mp->in_part = 0;
+        if( mp->cb.end_cb ) {
+            mp->cb.end_cb(mp->data, &mp->part, YMO_OKAY);
+        }
+    }
+    mp->state = YMO_HTTP_MULTIPART_DELIM;
+    return YMO_OKAY;
+}
+
+
+/* Start a new part (i.e. on the CRLF after a delimiter): */
+static void mp_part_reset(ymo_http_multipart_t* mp)
+{
+    memset(&mp->part, 0, sizeof(mp->part));
+    mp->part.fd = -1;
+    mp->hdr_len = mp->line_start = 0;
+    mp->state = YMO_HTTP_MULTIPART_HEADERS;
+}
+
+
+/* Whatever follows a delimiter: "--" (close), or padding + CRLF: */
+static ymo_status_t mp_after_delim(ymo_http_multipart_t* mp, char c)
+{
+    switch( mp->state ) {
+        case YMO_HTTP_MULTIPART_DELIM:
+            if( c == '-' ) {
+                mp->state = YMO_HTTP_MULTIPART_CLOSE_DASH;
+                return YMO_OKAY;
+            }
+            /* fall through */
+        case YMO_HTTP_MULTIPART_DELIM_LWSP:
+            if( MP_OWS(c) ) {
+                mp->state = YMO_HTTP_MULTIPART_DELIM_LWSP;
+                return YMO_OKAY;
+            }
+            if( c == '\r' ) {
+                mp->state = YMO_HTTP_MULTIPART_DELIM_CR;
+                return YMO_OKAY;
+            }
+            /* fall through */
+        case YMO_HTTP_MULTIPART_DELIM_CR:
+            if( c == '\n' ) {
+                mp_part_reset(mp);
+                return YMO_OKAY;
+            }
+            return EBADMSG;
+        case YMO_HTTP_MULTIPART_CLOSE_DASH:
+            if( c == '-' ) {
+                mp->state = YMO_HTTP_MULTIPART_EPILOGUE;
+                return YMO_OKAY;
+            }
+            return EBADMSG;
+        default:
+            return EBADMSG;
+    }
+}
+
+
+static ymo_status_t mp_fail(ymo_http_multipart_t* mp, ymo_status_t status)
+{
+    mp->status = status;
+    if( mp->in_part ) {
+        mp->in_part = 0;
+        if( mp->cb.end_cb ) {
+            mp->cb.end_cb(mp->data, &mp->part, status);
+        }
+    }
+    return status;
+}
+
+
+/*---------------------------------------------------------------*
+ *  Public API:
+ *---------------------------------------------------------------*/
+ymo_http_multipart_t* ymo_http_multipart_create(
+        const char* content_type,
+        const ymo_http_multipart_cb_t* cb,
+        void* data)
+{
+    const char* boundary = NULL;
+    size_t b_len = 0;
+    ymo_status_t status = mp_boundary(content_type, &boundary, &b_len);
+    if( status != YMO_OKAY ) {
+        ymo_log_debug("Bad multipart content type: %s",
+                content_type ? content_type : "(none)");
+        errno = status;
+        return NULL;
+    }
+
+    ymo_http_multipart_t* mp = YMO_NEW(ymo_http_multipart_t);
+    if( !mp ) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    if( cb ) {
+        mp->cb = *cb;
+    } else {
+        memset(&mp->cb, 0, sizeof(mp->cb));
+    }
+    mp->data = data;
+    memset(&mp->part, 0, sizeof(mp->part));
+    mp->part.fd = -1;
+    mp->state = YMO_HTTP_MULTIPART_PREAMBLE;
+    mp->status = YMO_OKAY;
+    mp->in_part = 0;
+    mp->hdr_len = mp->line_start = 0;
+
+    memcpy(mp->delim, "\r\n--", 4);
+    memcpy(mp->delim + 4, boundary, b_len);
+    mp->delim_len = 4 + b_len;
+
+    /* Shift table: */
+    memset(mp->skip, (int)mp->delim_len, sizeof(mp->skip));
+    for( size_t i = 0; i < mp->delim_len - 1; i++ ) {
+        mp->skip[(uint8_t)mp->delim[i]] = (uint8_t)(mp->delim_len - 1 - i);
+    }
+
+    /* The body begins with a delimiter sans CRLF; pretend we've seen it: */
+    mp->lb_len = 2;
+    return mp;
+}
+
+
+ymo_status_t ymo_http_multipart_feed(
+        ymo_http_multipart_t* mp, const char* data, size_t len)
+{
+    const char* p = data;
+    const char* end = data + len;
+    ymo_status_t status = mp->status;
+    int found;
+
+    while( p < end && status == YMO_OKAY )
+    {
+        switch( mp->state ) {
+            case YMO_HTTP_MULTIPART_PREAMBLE:
+            case YMO_HTTP_MULTIPART_BODY:
+                status = mp_search(mp, &p, end, &found);
+                if( status == YMO_OKAY && found ) {
+                    status = mp_delimiter(mp);
+                }
+                break;
+            case YMO_HTTP_MULTIPART_HEADERS:
+                status = mp_headers(mp, &p, end);
+                break;
+            case YMO_HTTP_MULTIPART_EPILOGUE:
+                p = end;
+                break;
+            default:
+                status = mp_after_delim(mp, *p++);
+                break;
+        }
+    }
+
+    if( status != YMO_OKAY && status != mp->status ) {
+        return mp_fail(mp, status);
+    }
+    return status;
+}
+
+
+ymo_status_t ymo_http_multipart_finish(ymo_http_multipart_t* mp)
+{
+    if( mp->status != YMO_OKAY ) {
+        return mp->status;
+    }
+
+    if( mp->state != YMO_HTTP_MULTIPART_EPILOGUE ) {
+        ymo_log_debug("Multipart body ended without a closing boundary");
+        return mp_fail(mp, EBADMSG);
+    }
+    return YMO_OKAY;
+}
+
+
+void ymo_http_multipart_free(ymo_http_multipart_t* mp)
+{
+    if( mp ) {
+        mp_fail(mp, ECONNABORTED);
+        YMO_DELETE(ymo_http_multipart_t, mp);
+    }
+}
+
+
+ymo_status_t ymo_http_request_multipart(
+        ymo_http_request_t* request,
+        const ymo_http_multipart_cb_t* cb,
+        void* data)
+{
+    if( request->multipart ) {
+        return EBUSY;
+    }
+
+    request->multipart = ymo_http_multipart_create(
+            ymo_http_hdr_table_get_id(
+                &request->headers, YMO_HTTP_HID_CONTENT_TYPE),
+            cb, data);
+    return request->multipart ? YMO_OKAY : errno;
+}
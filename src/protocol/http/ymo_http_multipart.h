@@ -0,0 +1,99 @@
+/*=============================================================================
+ *
+ * Copyright (c) 2014 Andrew Canaday
+ *
+ * This file is part of libyimmo (sometimes referred to as "yimmo" or "ymo").
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *===========================================================================*/
+
+
+
+#ifndef YMO_HTTP_MULTIPART_H
+#define YMO_HTTP_MULTIPART_H
+#include "yimmo_config.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#include "yimmo.h"
+#include "ymo_http.h"
+
+/** Multipart
+ * ==========
+ *
+ * Internals for the streaming multipart parser (see
+ * :c:func:`ymo_http_multipart_create`).
+ *
+ * The parser searches for the delimiter (``CRLF "--" boundary``) with
+ * Boyer-Moore-Horspool, which inspects one byte per delimiter-length
+ * window of ordinary part data. The body is treated as if it were preceded
+ * by a ``CRLF``, so the first boundary (which has no ``CRLF`` of its own)
+ * is found the same way as the rest.
+ *
+ * A delimiter may straddle two chunks: when a chunk ends with a prefix of
+ * the delimiter, the prefix is held back (as a length; its bytes are, by
+ * definition, the first bytes of the delimiter) until the next chunk shows
+ * whether it's part data or a boundary.
+ *
+ * Part headers are accumulated in a fixed buffer and split in place, so the
+ * strings handed to the callbacks live until the next part begins.
+ */
+
+/**---------------------------------------------------------------
+ * Definitions
+ *---------------------------------------------------------------*/
+
+/** Maximum boundary length (RFC 2046). */
+#define YMO_HTTP_MULTIPART_BOUNDARY_MAX 70
+
+/** Maximum size of the header block of a single part. */
+#define YMO_HTTP_MULTIPART_HDR_MAX 2048
+
+
+/**---------------------------------------------------------------
+ * Types
+ *---------------------------------------------------------------*/
+
+typedef enum ymo_http_multipart_state {
+    YMO_HTTP_MULTIPART_PREAMBLE,
+    YMO_HTTP_MULTIPART_DELIM,        /* After a delimiter */
+    YMO_HTTP_MULTIPART_DELIM_LWSP,   /* Transport padding */
+    YMO_HTTP_MULTIPART_DELIM_CR,
+    YMO_HTTP_MULTIPART_CLOSE_DASH,   /* Got the first '-' of "--" */
+    YMO_HTTP_MULTIPART_HEADERS,
+    YMO_HTTP_MULTIPART_BODY,
+    YMO_HTTP_MULTIPART_EPILOGUE,
+} ymo_http_multipart_state_t;
+
+/** Multipart parser. */
+struct ymo_http_multipart {
+    ymo_http_multipart_cb_t     cb;
+    void*                       data;
+    ymo_http_part_t             part;
+    ymo_http_multipart_state_t  state;
+    ymo_status_t                status;     /* Sticky error */
+    int                         in_part;    /* begin_cb called; end_cb not */
+    size_t                      delim_len;
+    size_t                      lb_len;     /* Held-back delimiter prefix */
+    size_t                      hdr_len;
+    size_t                      line_start; /* Start of the current line */
+    uint8_t                     skip[256];  /* Horspool shift table */
+    char  delim[4 + YMO_HTTP_MULTIPART_BOUNDARY_MAX];
+    char  hdr[YMO_HTTP_MULTIPART_HDR_MAX];
+};
+
+#endif /* YMO_HTTP_MULTIPART_H */
+
+
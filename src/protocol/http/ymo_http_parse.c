@@ -31,6 +31,7 @@
 #include "ymo_util.h"
 #include "ymo_http_hdr_table.h"
 #include "ymo_http_parse.h"
+#include "ymo_http_scan.h"
 #include "ymo_http_exchange.h"
 #include "ymo_http_response.h"
 #include "ymo_http_session.h"
@@ -106,6 +107,64 @@ static inline ssize_t parser_saw_cr(
 }
 
 
+/** Used by parsing functions when header storage fills up: chain on a new
+ * block (see ymo_http_exchange_grow), taking the token being parsed along
+ * with it. */
+static ymo_status_t parser_grow(
+        ymo_http_exchange_t* exchange, char* recv_current)
+{
+    const char** token = NULL;
+    exchange->recv_current = recv_current;
+    exchange->remain = 0;
+
+    switch( exchange->state ) {
+        case HTTP_STATE_REQUEST_METHOD:
+            token = &exchange->request.method;
+            break;
+        case HTTP_STATE_REQUEST_URI_PATH:
+            token = &exchange->request.uri;
+            break;
+        case HTTP_STATE_REQUEST_QUERY:
+            token = &exchange->request.query;
+            break;
+        case HTTP_STATE_REQUEST_FRAGMENT:
+            token = &exchange->request.fragment;
+            break;
+        case HTTP_STATE_REQUEST_VERSION:
+            token = &exchange->request.version;
+            break;
+        case HTTP_STATE_HEADER_NAME:
+        case HTTP_STATE_HEADER_VALUE_LEADING_SPACE:
+        case HTTP_STATE_HEADER_VALUE:
+        {
+            /* Name and value are contiguous; move them together: */
+            char* name = exchange->hdr_name;
+            char* moved = ymo_http_exchange_grow(exchange, name, 1);
+            if( !moved ) {
+                return errno;
+            }
+            if( exchange->state == HTTP_STATE_HEADER_VALUE ) {
+                exchange->hdr_value = moved + (exchange->hdr_value - name);
+            }
+            exchange->hdr_name = moved;
+            return YMO_OKAY;
+        }
+        default:
+            break;
+    }
+
+    const char* moved = ymo_http_exchange_grow(
+            exchange, token ? *token : NULL, 1);
+    if( !moved ) {
+        return errno;
+    }
+    if( token ) {
+        *token = moved;
+    }
+    return YMO_OKAY;
+}
+
+
 /** Called by ymo_parse_request when the exchange line has been parsed.
  *
  * - validate method
@@ -165,9 +224,26 @@ static ssize_t parse_http_header_name(
 {
     char c;
     const char* buff_rd = buff_rd_start;
+    size_t n;
     HTTP_PARSE_TRACE("parsing headers (%p); state: %s",
             (void*)exchange, HTTP_PARSE_STATE_NAME(exchange->state));
 
+    /* Fast path: copy up to the first non-tchar in bulk. Whatever stopped
+     * the scan is handled by the state machine below.
+     */
+    n = ymo_http_scan_hdr_name(
+            buff_rd, YMO_MIN((size_t)(buff_rd_end - buff_rd), remain));
+    if( n ) {
+        memcpy(buff_wr, buff_rd, n);
+        buff_wr += n;
+        buff_rd += n;
+        remain -= n;
+
+        if( buff_rd == buff_rd_end || !remain ) {
+            goto header_name_done;
+        }
+    }
+
     do {
         c = *buff_rd;
         /* Most of the time it's not ':' */
@@ -175,7 +251,6 @@ static ssize_t parse_http_header_name(
             /* When it's not ':', most of the time it's not '\r'. */
             if( c != '\r' ) {
                 if( IS_HTTP_HDR_FIELD_TOKEN(c) ) {
-                    exchange->h_id = YMO_HDR_HASH_CH(exchange->h_id, c);
                     *(buff_wr++) = c;
                     --remain;
                 } else {
@@ -199,13 +274,17 @@ static ssize_t parse_http_header_name(
         }
     } while( ++buff_rd < buff_rd_end && remain );
 
+header_name_done:
     if( remain ) {
         exchange->recv_current = buff_wr;
         exchange->remain = remain;
-        return (buff_rd - buff_rd_start);
+    } else {
+        ymo_status_t status = parser_grow(exchange, buff_wr);
+        if( status != YMO_OKAY ) {
+            return YMO_ERROR_SSIZE_T(status);
+        }
     }
-
-    return YMO_ERROR_SSIZE_T(EFBIG);
+    return (buff_rd - buff_rd_start);
 }
 
 
@@ -216,7 +295,9 @@ static void http_header_got_value(
         const char* hdr_value, size_t value_len
         )
 {
-    exchange->h_id = exchange->h_id & YMO_HDR_TABLE_MASK;
+    /* Standard headers get their id from the generated lookup; only
+     * unrecognized names are hashed: */
+    exchange->h_id = ymo_http_hdr_id(hdr_name, name_len);
     ymo_http_hdr_table_add_precompute(
             &exchange->request.headers,
             exchange->h_id,
@@ -281,7 +362,7 @@ static void http_header_got_value(
         default:
             break;
     }
-    exchange->h_id = YMO_HTTP_HDR_HASH_INIT();
+    exchange->h_id = YMO_HTTP_HID_NONE;
     return;
 }
 
@@ -295,8 +376,24 @@ static ssize_t parse_http_header_value(
 {
     char c;
     const char* buff_rd = buff_rd_start;
+    size_t n;
     HTTP_PARSE_TRACE("parsing headers (%p); state: %s",
             (void*)exchange, HTTP_PARSE_STATE_NAME(exchange->state));
+
+    /* Fast path: bulk copy up to the first CTL (hopefully '\r'): */
+    n = ymo_http_scan_hdr_value(
+            buff_rd, YMO_MIN((size_t)(buff_rd_end - buff_rd), remain));
+    if( n ) {
+        memcpy(buff_wr, buff_rd, n);
+        buff_wr += n;
+        buff_rd += n;
+        remain -= n;
+
+        if( buff_rd == buff_rd_end || !remain ) {
+            goto header_value_done;
+        }
+    }
+
     do {
         c = *buff_rd;
         if( c != '\r' ) {
@@ -320,15 +417,19 @@ static ssize_t parse_http_header_value(
                     exchange, HTTP_STATE_HEADER_NAME);
             break;
         }
-    } while( ++buff_rd < buff_rd_end && --remain );
+    } while( ++buff_rd < buff_rd_end && remain );
 
+header_value_done:
     if( remain ) {
         exchange->recv_current = buff_wr;
         exchange->remain = remain;
-        return (buff_rd - buff_rd_start);
+    } else {
+        ymo_status_t status = parser_grow(exchange, buff_wr);
+        if( status != YMO_OKAY ) {
+            return YMO_ERROR_SSIZE_T(status);
+        }
     }
-
-    return YMO_ERROR_SSIZE_T(EFBIG);
+    return (buff_rd - buff_rd_start);
 }
 
 
@@ -351,6 +452,25 @@ ssize_t ymo_parse_http_request_line(
     http_state_t state = exchange->state;
     const char** up_ptr = NULL;
     do {
+        /* Fast path: bulk copy the request target and version up to the
+         * next delimiter. The method is too short to bother.
+         */
+        if( state > HTTP_STATE_REQUEST_METHOD
+                && state <= HTTP_STATE_REQUEST_VERSION ) {
+            size_t n = ymo_http_scan_uri(
+                    current, YMO_MIN((size_t)(buff_end - current), remain));
+            if( n ) {
+                memcpy(recv_current, current, n);
+                recv_current += n;
+                current += n;
+                remain -= n;
+
+                if( current == buff_end || !remain ) {
+                    goto http_request_parse_done;
+                }
+            }
+        }
+
         c = *current;
 
         switch( state ) {
@@ -431,6 +551,7 @@ ssize_t ymo_parse_http_request_line(
                         check_request(&next_state, exchange, v_len);
                     if( line_status == YMO_OKAY ) {
                         *(recv_current++) = '\0';
+                        --remain;
                         current += parser_saw_cr(
                                 exchange, HTTP_STATE_HEADER_NAME);
                         goto http_request_parse_done;
@@ -462,10 +583,13 @@ http_request_parse_done:
     if( remain ) {
         exchange->recv_current = recv_current;
         exchange->remain = remain;
-        return (current - buffer);
+    } else {
+        ymo_status_t status = parser_grow(exchange, recv_current);
+        if( status != YMO_OKAY ) {
+            return YMO_ERROR_SSIZE_T(status);
+        }
     }
-
-    return YMO_ERROR_SSIZE_T(EFBIG);
+    return (current - buffer);
 }
 
 
@@ -490,12 +614,6 @@ ssize_t ymo_parse_http_crlf(
             break;
         case HTTP_STATE_HEADERS_COMPLETE:
             break;
-        case HTTP_STATE_BODY_CHUNK_HEADER:
-            /* NOTE: this is to check for the last chunk.
-             *       Else, we'll bounce back to HTTP_STATE_BODY.
-             */
-            exchange->next_state = HTTP_STATE_BODY_CHUNK_TRAILER;
-            break;
         case HTTP_STATE_BODY:
             exchange->next_state = HTTP_STATE_COMPLETE;
             break;
@@ -575,13 +693,41 @@ ssize_t ymo_parse_http_headers(
     } while( buff_rd < buff_rd_end && remain );
 
 http_header_parse_done:
-    if( remain ) {
-        exchange->recv_current = buff_wr;
-        exchange->remain = remain;
-        return (buff_rd - buffer);
+    exchange->recv_current = buff_wr;
+    exchange->remain = remain;
+    return (buff_rd - buffer);
+}
+
+
+/* Value of a hex digit, or -1: */
+static inline int chunk_hex(char c)
+{
+    if( (unsigned char)(c - '0') < 10 ) {
+        return c - '0';
     }
+    c |= 0x20;
+    if( (unsigned char)(c - 'a') < 6 ) {
+        return c - 'a' + 10;
+    }
+    return -1;
+}
+
+
+/* Skip to the CR ending a chunk extension or trailer line, charging the
+ * bytes to exchange->remain. Returns a pointer past the CR, end if it
+ * hasn't arrived yet, or NULL (errno set) if the line is too long:
+ */
+static inline const char* chunk_skip_line(
+        ymo_http_exchange_t* exchange, const char* current, const char* end)
+{
+    const char* cr = memchr(current, '\r', end - current);
+    size_t n = (size_t)((cr ? cr + 1 : end) - current);
 
-    return YMO_ERROR_SSIZE_T(EFBIG);
+    if( n >= exchange->remain ) {
+        return YMO_ERROR_PTR(EFBIG);
+    }
+    exchange->remain -= n;
+    return cr ? cr + 1 : end;
 }
 
 
@@ -593,36 +739,76 @@ ssize_t ymo_parse_http_body(
         size_t len)
 {
     const char* current = buffer;
+    const char* end = buffer + len;
 
-    do {
+    while( current < end ) {
         switch( exchange->state ) {
             case HTTP_STATE_BODY_CHUNK_HEADER:
-                do {
-                    char c = *current++;
-                    switch( c ) {
-                        case '\r':
-                            break;
-                        case '\n':
-                            if( exchange->body_remain ) {
-                                exchange->state = HTTP_STATE_BODY;
-                                exchange->next_state = HTTP_STATE_BODY_CHUNK_TRAILER;
-                            } else {
-                                exchange->state = HTTP_STATE_BODY_CHUNK_TRAILER;
-                                exchange->next_state = HTTP_STATE_COMPLETE;
-                            }
-                            HTTP_PARSE_TRACE(
-                                    "Jumping to state: %s",
-                                    ymo_http_state_names[exchange->state]);
-                            goto body_hdr_done;
-                            break;
-                        default:
-                            exchange->body_remain =
-                                (exchange->body_remain << 4)
-                                | (c & 0xF) + (c >> 6) | ((c >> 3) & 0x8);
-                            break;
+            {
+                /* chunk-size: exchange->remain counts down from
+                 * YMO_HTTP_RECV_BUF_SIZE for each byte of the line, so
+                 * a chunk-size with no digits is easy to spot:
+                 */
+                size_t size = exchange->body_remain;
+                int d;
+                while( current < end && (d = chunk_hex(*current)) >= 0 ) {
+                    if( (size >> (sizeof(size_t) * 8 - 4))
+                        || !--exchange->remain ) {
+                        return YMO_ERROR_SSIZE_T(EFBIG);
                     }
-                } while( --len );
-body_hdr_done:
+                    size = (size << 4) | (size_t)d;
+                    ++current;
+                }
+                exchange->body_remain = size;
+                if( current == end ) {
+                    break;
+                }
+
+                char c = *current++;
+                if( exchange->remain == YMO_HTTP_RECV_BUF_SIZE ) {
+                    ymo_log_debug("Malformed chunk size: 0x%x", (int)c);
+                    return YMO_ERROR_SSIZE_T(EBADMSG);
+                }
+
+                switch( c ) {
+                    case '\r':
+                        /* Usually, the LF is right here, too: */
+                        if( current < end && *current == '\n' ) {
+                            ++current;
+                            exchange->state = size
+                                ? HTTP_STATE_BODY
+                                : HTTP_STATE_BODY_CHUNK_TRAILER;
+                        } else {
+                            exchange->state = HTTP_STATE_BODY_CHUNK_LF;
+                        }
+                        break;
+                    case ';':
+                    case ' ':
+                    case '\t':
+                        exchange->state = HTTP_STATE_BODY_CHUNK_EXT;
+                        break;
+                    default:
+                        ymo_log_debug("Malformed chunk size: 0x%x", (int)c);
+                        return YMO_ERROR_SSIZE_T(EBADMSG);
+                }
+
+                /* The last chunk is followed by the trailer section: */
+                if( size ) {
+                    exchange->next_state = HTTP_STATE_BODY;
+                } else {
+                    exchange->next_state = HTTP_STATE_BODY_CHUNK_TRAILER;
+                    exchange->remain = YMO_HTTP_RECV_BUF_SIZE;
+                }
+            }
+            break;
+            case HTTP_STATE_BODY_CHUNK_EXT:
+                /* Extensions are ignored: */
+                if( !(current = chunk_skip_line(exchange, current, end)) ) {
+                    return YMO_ERROR_SSIZE_T(errno);
+                }
+                if( current[-1] == '\r' ) {
+                    exchange->state = HTTP_STATE_BODY_CHUNK_LF;
+                }
                 break;
             case HTTP_STATE_BODY:
             {
@@ -632,56 +818,89 @@ body_hdr_done:
                     break;
                 }
 
-                size_t body_available = YMO_MIN(len, exchange->body_remain);
+                /* Chunk data is handed straight to body_cb: */
+                size_t body_available = YMO_MIN(
+                        (size_t)(end - current), exchange->body_remain);
 
                 ymo_status_t cb_status = body_cb(
                         session,
                         &exchange->request,
-                        exchange->response,
+                        &exchange->response,
                         current,
                         body_available,
                         session->user_data);
 
-                if( cb_status == YMO_OKAY ) {
-                    len -= body_available;
-                    exchange->body_remain -= body_available;
-                    current += body_available;
+                if( cb_status != YMO_OKAY ) {
+                    return YMO_ERROR_SSIZE_T(cb_status);
+                }
 
-                    if( !exchange->body_remain ) {
-                        if( exchange->request.flags & YMO_HTTP_REQUEST_CHUNKED ) {
-                            exchange->state = HTTP_STATE_BODY_CHUNK_TRAILER;
-                            exchange->next_state = HTTP_STATE_BODY_CHUNK_HEADER;
-                        } else {
-                            exchange->state = exchange->next_state;
-                        }
-                        HTTP_PARSE_TRACE(
-                                "Jumping to state: %s",
-                                ymo_http_state_names[exchange->state]);
+                exchange->body_remain -= body_available;
+                current += body_available;
+
+                if( !exchange->body_remain ) {
+                    if( !(exchange->request.flags & YMO_HTTP_REQUEST_CHUNKED) ) {
+                        exchange->state = exchange->next_state;
+                    } else if( end - current >= 2
+                            && current[0] == '\r' && current[1] == '\n' ) {
+                        /* Straight on to the next chunk-size: */
+                        current += 2;
+                        exchange->state = HTTP_STATE_BODY_CHUNK_HEADER;
+                        exchange->remain = YMO_HTTP_RECV_BUF_SIZE;
+                    } else {
+                        exchange->state = HTTP_STATE_BODY_CHUNK_CR;
                     }
-                } else {
-                    return YMO_ERROR_SSIZE_T(cb_status);
+                    HTTP_PARSE_TRACE(
+                            "Jumping to state: %s",
+                            ymo_http_state_names[exchange->state]);
                 }
             }
             break;
+            case HTTP_STATE_BODY_CHUNK_CR:
+                if( *current++ != '\r' ) {
+                    ymo_log_debug("%s", "Malformed chunk: missing CRLF");
+                    return YMO_ERROR_SSIZE_T(EBADMSG);
+                }
+                exchange->state = HTTP_STATE_BODY_CHUNK_LF;
+                exchange->next_state = HTTP_STATE_BODY_CHUNK_HEADER;
+                exchange->remain = YMO_HTTP_RECV_BUF_SIZE;
+                break;
+            case HTTP_STATE_BODY_CHUNK_LF:
+                if( *current++ != '\n' ) {
+                    ymo_log_debug("%s", "Malformed chunk: missing LF");
+                    return YMO_ERROR_SSIZE_T(EBADMSG);
+                }
+                exchange->state = exchange->next_state;
+                HTTP_PARSE_TRACE(
+                        "Jumping to state: %s",
+                        ymo_http_state_names[exchange->state]);
+                break;
             case HTTP_STATE_BODY_CHUNK_TRAILER:
-                do {
-                    /* HACK: just loop until newline (this is sloppy...) */
-                    if( *current++ == '\n' ) {
-                        exchange->state = exchange->next_state;
-                        HTTP_PARSE_TRACE(
-                                "Jumping to state: %s",
-                                ymo_http_state_names[exchange->state]);
-                        break;
-                    }
-                } while( --len );
+                /* Trailer fields are consumed, but not stored. An empty
+                 * line ends the trailer section (and the request):
+                 */
+                exchange->next_state = HTTP_STATE_BODY_CHUNK_TRAILER;
+                if( *current == '\r' ) {
+                    exchange->state = HTTP_STATE_BODY_CHUNK_LF;
+                    exchange->next_state = HTTP_STATE_COMPLETE;
+                    ++current;
+                } else {
+                    exchange->state = HTTP_STATE_BODY_TRAILER_FIELD;
+                }
+                break;
+            case HTTP_STATE_BODY_TRAILER_FIELD:
+                if( !(current = chunk_skip_line(exchange, current, end)) ) {
+                    return YMO_ERROR_SSIZE_T(errno);
+                }
+                if( current[-1] == '\r' ) {
+                    exchange->state = HTTP_STATE_BODY_CHUNK_LF;
+                }
                 break;
             default:
                 goto body_parse_done;
                 break;
         }
-    } while( len );
+    }
 
 body_parse_done:
     return (current-buffer);
 }
-
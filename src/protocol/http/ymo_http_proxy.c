@@ -0,0 +1,1518 @@
+/*=============================================================================
+ *
+ * Copyright (c) 2014 Andrew Canaday
+ *
+ * This file is part of libyimmo (sometimes referred to as "yimmo" or "ymo").
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *===========================================================================*/
+
+#include "yimmo_config.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include "yimmo.h"
+#include "ymo_log.h"
+#include "ymo_alloc.h"
+#include "core/ymo_net.h"
+#include "core/ymo_conn.h"
+#include "core/ymo_pipe.h"
+#include "ymo_http_body.h"
+#include "ymo_http_exchange.h"
+#include "ymo_http_hdr_table.h"
+#include "ymo_http_response.h"
+#include "ymo_http_session.h"
+#include "ymo_http_proxy.h"
+
+/*---------------------------------------------------------------*
+ *  Declarations
+ *---------------------------------------------------------------*/
+
+#define PROXY_LIT_LEN(s) (sizeof(s) - 1)
+
+#define PROXY_VERSION " HTTP/1.1\r\n"
+#define PROXY_HOST    "Host: "
+#define PROXY_XFF     "X-Forwarded-For: "
+
+/* Longest "Content-Length: <n>\r\n" line: */
+#define PROXY_CL_MAX  48
+
+/* A response head field, split in place: */
+typedef struct proxy_hdr {
+    ymo_http_hdr_id_t  h_id;
+    const char*        hdr;
+    size_t             hdr_len;
+    const char*        value;
+} proxy_hdr_t;
+
+static void conn_read_cb(struct ev_loop* loop, ev_io* w, int revents);
+static void conn_write_cb(struct ev_loop* loop, ev_io* w, int revents);
+static void conn_pipe_cb(struct ev_loop* loop, ev_io* w, int revents);
+static void conn_timer_cb(struct ev_loop* loop, ev_timer* w, int revents);
+
+static ymo_status_t proxy_send(
+        ymo_http_proxy_upstream_t* upstream,
+        ymo_http_request_t* request,
+        ymo_http_response_t* response,
+        int fresh);
+
+
+/*---------------------------------------------------------------*
+ *  Read buffers:
+ *---------------------------------------------------------------*/
+static ymo_http_proxy_buf_t* buf_create(void)
+{
+    ymo_http_proxy_buf_t* buf = YMO_ALLOC(sizeof(ymo_http_proxy_buf_t));
+    if( buf ) {
+        buf->refs = 1;
+        buf->len = 0;
+    }
+    return buf;
+}
+
+
+static void buf_unref(ymo_http_proxy_buf_t* buf)
+{
+    if( buf && !--buf->refs ) {
+        YMO_FREE(buf);
+    }
+}
+
+
+/* Body buckets keep a reference to their buffer in buf (cleared before the
+ * bucket is freed, so the buffer isn't):
+ */
+static void buf_bucket_free(ymo_bucket_t* bucket)
+{
+    buf_unref((ymo_http_proxy_buf_t*)bucket->buf);
+    bucket->buf = NULL;
+}
+
+
+static ymo_bucket_t* buf_bucket(
+        ymo_http_proxy_buf_t* buf, const char* data, size_t len)
+{
+    ymo_bucket_t* bucket = YMO_BUCKET_FROM_REF(data, len);
+    if( bucket ) {
+        bucket->buf = (char*)buf;
+        bucket->cleanup_cb = &buf_bucket_free;
+        buf->refs++;
+    }
+    return bucket;
+}
+
+
+/*---------------------------------------------------------------*
+ *  Connection lists:
+ *---------------------------------------------------------------*/
+static void list_push(
+        ymo_http_proxy_conn_t** head, ymo_http_proxy_conn_t* conn)
+{
+    conn->prev = NULL;
+    conn->next = *head;
+    if( *head ) {
+        (*head)->prev = conn;
+    }
+    *head = conn;
+}
+
+
+static void list_remove(
+        ymo_http_proxy_conn_t** head, ymo_http_proxy_conn_t* conn)
+{
+    if( conn->prev ) {
+        conn->prev->next = conn->next;
+    } else {
+        *head = conn->next;
+    }
+    if( conn->next ) {
+        conn->next->prev = conn->prev;
+    }
+    conn->prev = conn->next = NULL;
+}
+
+
+/*---------------------------------------------------------------*
+ *  Upstream connections:
+ *---------------------------------------------------------------*/
+static ymo_http_proxy_conn_t* conn_open(ymo_http_proxy_upstream_t* upstream)
+{
+    int fd = socket(upstream->addr.ss_family, SOCK_STREAM, 0);
+    if( fd < 0 ) {
+        return NULL;
+    }
+
+    ymo_http_proxy_conn_t* conn = YMO_NEW0(ymo_http_proxy_conn_t);
+    if( !conn ) {
+        close(fd);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    /* Request heads and bodies go out in separate writes: */
+    int flag = 1;
+    if( upstream->addr.ss_family != AF_UNIX ) {
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+    }
+    ymo_sock_nonblocking(fd);
+
+    conn->upstream = upstream;
+    conn->fd = fd;
+    ev_io_init(&conn->w_read, &conn_read_cb, fd, EV_READ);
+    ev_io_init(&conn->w_write, &conn_write_cb, fd, EV_WRITE);
+    ev_init(&conn->w_pipe, &conn_pipe_cb);
+    ev_init(&conn->timer, &conn_timer_cb);
+    conn->w_read.data = conn->w_write.data = conn->timer.data = conn;
+    conn->w_pipe.data = conn;
+
+    conn->state = YMO_HTTP_PROXY_HEAD;
+    if( connect(fd, (struct sockaddr*)&upstream->addr, upstream->addr_len) ) {
+        if( errno != EINPROGRESS ) {
+            int c_err = errno;
+            close(fd);
+            YMO_DELETE(ymo_http_proxy_conn_t, conn);
+            errno = c_err;
+            return NULL;
+        }
+        conn->state = YMO_HTTP_PROXY_CONNECTING;
+    }
+
+    upstream->stats.connects++;
+    return conn;
+}
+
+
+static void conn_close(ymo_http_proxy_conn_t* conn)
+{
+    struct ev_loop* loop = conn->upstream->proxy->loop;
+    ev_io_stop(loop, &conn->w_read);
+    ev_io_stop(loop, &conn->w_write);
+    ev_io_stop(loop, &conn->w_pipe);
+    ev_timer_stop(loop, &conn->timer);
+    close(conn->fd);
+    ymo_bucket_free_all(conn->send);
+    buf_unref(conn->rbuf);
+    ymo_pipe_free(conn->pipe);
+    YMO_DELETE(ymo_http_proxy_conn_t, conn);
+}
+
+
+/* (Re)start the inactivity timer: */
+static void conn_touch(ymo_http_proxy_conn_t* conn)
+{
+    ymo_http_proxy_t* proxy = conn->upstream->proxy;
+    conn->timer.repeat = proxy->timeout;
+    ev_timer_again(proxy->loop, &conn->timer);
+}
+
+
+/* Unhook a connection from its client response: */
+static void conn_detach(ymo_http_proxy_conn_t* conn)
+{
+    if( !conn->response ) {
+        return;
+    }
+
+    conn->response->proxy_conn = NULL;
+    conn->response = NULL;
+    conn->request = NULL;
+    conn->upstream->stats.outstanding--;
+    list_remove(&conn->upstream->proxy->active, conn);
+}
+
+
+/* Return a connection to its upstream's pool (or close it, if full): */
+static void conn_pool(ymo_http_proxy_conn_t* conn)
+{
+    ymo_http_proxy_upstream_t* upstream = conn->upstream;
+    struct ev_loop* loop = upstream->proxy->loop;
+
+    if( upstream->stats.idle >= upstream->max_idle ) {
+        conn_close(conn);
+        return;
+    }
+
+    /* Idle connections don't hold on to read buffers: */
+    buf_unref(conn->rbuf);
+    conn->rbuf = NULL;
+    conn->rpos = 0;
+
+    /* ...but can keep their pipe, once it's been emptied out: */
+    if( conn->pipe
+        && (conn->pipe->refs > 1 || ymo_pipe_len(conn->pipe)) ) {
+        ymo_pipe_free(conn->pipe);
+        conn->pipe = NULL;
+    }
+
+    /* Watch for the upstream closing it, or it sitting idle too long: */
+    conn->state = YMO_HTTP_PROXY_IDLE;
+    ev_io_stop(loop, &conn->w_write);
+    ev_io_start(loop, &conn->w_read);
+    conn_touch(conn);
+    list_push(&upstream->idle, conn);
+    upstream->stats.idle++;
+}
+
+
+static void conn_unpool(ymo_http_proxy_conn_t* conn)
+{
+    list_remove(&conn->upstream->idle, conn);
+    conn->upstream->stats.idle--;
+}
+
+
+/* Retrying is only safe for idempotent methods (RFC 9110 §9.2.2): */
+static int method_idempotent(const char* method)
+{
+    static const char* idempotent[] = {
+        "GET", "HEAD", "PUT", "DELETE", "OPTIONS", "TRACE", NULL,
+    };
+    for( const char** m = idempotent; *m; m++ ) {
+        if( !strcmp(method, *m) ) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+static void conn_fail(ymo_http_proxy_conn_t* conn, ymo_status_t err)
+{
+    ymo_http_proxy_upstream_t* upstream = conn->upstream;
+    ymo_http_request_t* request = conn->request;
+    ymo_http_response_t* response = conn->response;
+
+    /* A pooled connection which fails before any response arrives was most
+     * likely closed by the upstream while idle:
+     */
+    int retry = conn->reused && !conn->received && err != ETIMEDOUT
+        && request && method_idempotent(request->method);
+
+    ymo_log_debug("Upstream request to %s failed: %s",
+            upstream->host, strerror(err));
+    conn_detach(conn);
+    conn_close(conn);
+    if( !response ) {
+        return;
+    }
+
+    if( retry ) {
+        upstream->stats.retries++;
+        if( proxy_send(upstream, request, response, 1) == YMO_WOULDBLOCK ) {
+            return;
+        }
+    }
+
+    upstream->stats.errors++;
+    ymo_http_response_abort(response, (err == ETIMEDOUT)
+            ? YMO_HTTP_GATEWAY_TIMEOUT : YMO_HTTP_BAD_GATEWAY);
+}
+
+
+/* The upstream response has been read in full: */
+static void conn_done(ymo_http_proxy_conn_t* conn)
+{
+    ymo_http_response_t* response = conn->response;
+    conn_detach(conn);
+    ymo_http_response_finish(response);
+
+    /* Reusable, unless the request is still going out or the upstream sent
+     * more than it said it would:
+     */
+    if( conn->keepalive && !conn->send
+            && conn->rbuf && conn->rpos == conn->rbuf->len ) {
+        conn_pool(conn);
+    } else {
+        conn_close(conn);
+    }
+}
+
+
+/*---------------------------------------------------------------*
+ *  Upstream requests:
+ *---------------------------------------------------------------*/
+
+/* Hop-by-hop fields (RFC 9110 §7.6.1), which aren't forwarded in either
+ * direction:
+ */
+static int hdr_hop_by_hop(ymo_http_hdr_id_t h_id)
+{
+    switch( h_id ) {
+        case YMO_HTTP_HID_CONNECTION:
+        case YMO_HTTP_HID_KEEP_ALIVE:
+        case YMO_HTTP_HID_PROXY_CONNECTION:
+        case YMO_HTTP_HID_PROXY_AUTHENTICATE:
+        case YMO_HTTP_HID_PROXY_AUTHORIZATION:
+        case YMO_HTTP_HID_TE:
+        case YMO_HTTP_HID_TRAILER:
+        case YMO_HTTP_HID_TRANSFER_ENCODING:
+        case YMO_HTTP_HID_UPGRADE:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+
+/* Whether the token, tok, appears in a comma-separated list: */
+static int hdr_list_has(const char* list, const char* tok, size_t tok_len)
+{
+    const char* p = list;
+    while( p && *p ) {
+        p += strspn(p, " \t,");
+        size_t len = strcspn(p, " \t,");
+        if( len == tok_len && !strncasecmp(p, tok, len) ) {
+            return 1;
+        }
+        p += len;
+    }
+    return 0;
+}
+
+
+/* Fields named by the Connection header are hop-by-hop, too: */
+static int hdr_skip(
+        ymo_http_hdr_id_t h_id,
+        const char* hdr,
+        size_t hdr_len,
+        const char* conn_hdr)
+{
+    return hdr_hop_by_hop(h_id)
+        || (conn_hdr && hdr_list_has(conn_hdr, hdr, hdr_len));
+}
+
+
+/* Client address, as text (0, if it's not an IP address): */
+static size_t client_addr(ymo_http_response_t* response, char* dst)
+{
+    struct sockaddr_storage addr;
+    socklen_t addr_len = sizeof(addr);
+    ymo_conn_t* conn = response->session ? response->session->conn : NULL;
+    const void* src;
+
+    if( !conn
+        || getpeername(conn->fd, (struct sockaddr*)&addr, &addr_len) ) {
+        return 0;
+    }
+
+    switch( addr.ss_family ) {
+        case AF_INET:
+            src = &((struct sockaddr_in*)&addr)->sin_addr;
+            break;
+        case AF_INET6:
+            src = &((struct sockaddr_in6*)&addr)->sin6_addr;
+            break;
+        default:
+            return 0;
+    }
+
+    if( !inet_ntop(addr.ss_family, src, dst, INET6_ADDRSTRLEN) ) {
+        return 0;
+    }
+    return strlen(dst);
+}
+
+
+static char* put(char* dst, const char* src, size_t len)
+{
+    memcpy(dst, src, len);
+    return dst + len;
+}
+
+
+/* Serialize the upstream request head straight from the parsed request: */
+static ymo_bucket_t* request_head(
+        ymo_http_proxy_upstream_t* upstream,
+        ymo_http_request_t* request,
+        ymo_http_response_t* response)
+{
+    const char* key;
+    size_t key_len;
+    const char* value;
+    ymo_http_hdr_ptr_t iter;
+
+    const char* conn_hdr = ymo_http_hdr_table_get_id(
+            &request->headers, YMO_HTTP_HID_CONNECTION);
+    const char* xff = NULL;
+    int has_host = 0;
+
+    char addr[INET6_ADDRSTRLEN];
+    size_t addr_len = client_addr(response, addr);
+
+    /* The body, as received (i.e. de-chunked), always has a length: */
+    char cl[PROXY_CL_MAX];
+    size_t cl_len = 0;
+    if( request->body_received
+        || (request->flags & YMO_HTTP_REQUEST_CHUNKED)
+        || ymo_http_hdr_table_get_id(
+            &request->headers, YMO_HTTP_HID_CONTENT_LENGTH) ) {
+        cl_len = snprintf(cl, sizeof(cl),
+                "Content-Length: %zu\r\n", request->body_received);
+    }
+
+    /* Measure: */
+    size_t method_len = strlen(request->method);
+    size_t uri_len = strlen(request->uri);
+    size_t query_len = request->query ? strlen(request->query) : 0;
+    size_t len = method_len + 1 + uri_len
+        + (request->query ? query_len + 1 : 0)
+        + PROXY_LIT_LEN(PROXY_VERSION);
+
+    iter = ymo_http_hdr_table_next(
+            &request->headers, NULL, &key, &key_len, &value);
+    while( iter ) {
+        switch( iter->h_id ) {
+            case YMO_HTTP_HID_CONTENT_LENGTH:
+            case YMO_HTTP_HID_EXPECT:
+                break;
+            case YMO_HTTP_HID_X_FORWARDED_FOR:
+                xff = value;
+                break;
+            case YMO_HTTP_HID_HOST:
+                has_host = 1;
+                YMO_STMT_ATTR_FALLTHROUGH();
+            default:
+                if( !hdr_skip(iter->h_id, key, key_len, conn_hdr) ) {
+                    len += key_len + strlen(value) + 4;
+                }
+                break;
+        }
+        iter = ymo_http_hdr_table_next(
+                &request->headers, iter, &key, &key_len, &value);
+    }
+
+    size_t host_len = has_host ? 0 : strlen(upstream->host);
+    size_t xff_len = xff ? strlen(xff) : 0;
+    if( !has_host ) {
+        len += PROXY_LIT_LEN(PROXY_HOST) + host_len + 2;
+    }
+    if( xff || addr_len ) {
+        len += PROXY_LIT_LEN(PROXY_XFF) + xff_len + addr_len + 2;
+        if( xff && addr_len ) {
+            len += 2;
+        }
+    }
+    len += cl_len + 2;
+
+    char* head = YMO_ALLOC(len);
+    if( !head ) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    /* Request line: */
+    char* out = put(head, request->method, method_len);
+    *out++ = ' ';
+    out = put(out, request->uri, uri_len);
+    if( request->query ) {
+        *out++ = '?';
+        out = put(out, request->query, query_len);
+    }
+    out = put(out, PROXY_VERSION, PROXY_LIT_LEN(PROXY_VERSION));
+
+    /* Headers: */
+    iter = ymo_http_hdr_table_next(
+            &request->headers, NULL, &key, &key_len, &value);
+    while( iter ) {
+        switch( iter->h_id ) {
+            case YMO_HTTP_HID_CONTENT_LENGTH:
+            case YMO_HTTP_HID_EXPECT:
+            case YMO_HTTP_HID_X_FORWARDED_FOR:
+                break;
+            default:
+                if( !hdr_skip(iter->h_id, key, key_len, conn_hdr) ) {
+                    out = put(out, key, key_len);
+                    *out++ = ':';
+                    *out++ = ' ';
+                    out = put(out, value, strlen(value));
+                    *out++ = '\r';
+                    *out++ = '\n';
+                }
+                break;
+        }
+        iter = ymo_http_hdr_table_next(
+                &request->headers, iter, &key, &key_len, &value);
+    }
+
+    if( !has_host ) {
+        out = put(out, PROXY_HOST, PROXY_LIT_LEN(PROXY_HOST));
+        out = put(out, upstream->host, host_len);
+        *out++ = '\r';
+        *out++ = '\n';
+    }
+
+    if( xff || addr_len ) {
+        out = put(out, PROXY_XFF, PROXY_LIT_LEN(PROXY_XFF));
+        if( xff ) {
+            out = put(out, xff, xff_len);
+            if( addr_len ) {
+                *out++ = ',';
+                *out++ = ' ';
+            }
+        }
+        out = put(out, addr, addr_len);
+        *out++ = '\r';
+        *out++ = '\n';
+    }
+
+    out = put(out, cl, cl_len);
+    *out++ = '\r';
+    *out++ = '\n';
+
+    ymo_bucket_t* bucket = ymo_bucket_create(NULL, NULL, head, len, head, len);
+    if( !bucket ) {
+        YMO_FREE(head);
+        errno = ENOMEM;
+    }
+    return bucket;
+}
+
+
+/* The request head, followed by the body wherever it was received to: */
+static ymo_bucket_t* request_buckets(
+        ymo_http_proxy_upstream_t* upstream,
+        ymo_http_request_t* request,
+        ymo_http_response_t* response)
+{
+    ymo_bucket_t* head = request_head(upstream, request, response);
+    size_t body_len = request->body_received;
+    if( !head || !body_len ) {
+        return head;
+    }
+
+    ymo_http_body_t* spool = request->body_spool;
+    if( spool && spool->fd >= 0 ) {
+        head->next = ymo_bucket_create_file(
+                NULL, NULL, spool->fd, 0, body_len, NULL);
+    } else if( spool ) {
+        head->next = YMO_BUCKET_FROM_REF(spool->mem, body_len);
+    } else {
+        head->next = YMO_BUCKET_FROM_REF(request->body, body_len);
+    }
+
+    if( !head->next ) {
+        ymo_bucket_free(head);
+        errno = ENOMEM;
+        return NULL;
+    }
+    return head;
+}
+
+
+static ymo_status_t proxy_send(
+        ymo_http_proxy_upstream_t* upstream,
+        ymo_http_request_t* request,
+        ymo_http_response_t* response,
+        int fresh)
+{
+    ymo_http_proxy_t* proxy = upstream->proxy;
+    ymo_http_proxy_conn_t* conn = fresh ? NULL : upstream->idle;
+
+    if( conn ) {
+        conn_unpool(conn);
+        ev_io_stop(proxy->loop, &conn->w_read);
+        conn->state = YMO_HTTP_PROXY_HEAD;
+        conn->reused = 1;
+        upstream->stats.reused++;
+    } else if( !(conn = conn_open(upstream)) ) {
+        ymo_log_debug("Unable to connect to %s: %s",
+                upstream->host, strerror(errno));
+        return errno;
+    } else {
+        conn->reused = 0;
+    }
+
+    if( !(conn->send = request_buckets(upstream, request, response)) ) {
+        conn_close(conn);
+        return ENOMEM;
+    }
+
+    conn->request = request;
+    conn->response = response;
+    conn->received = 0;
+    conn->paused = 0;
+    response->proxy_conn = conn;
+    list_push(&proxy->active, conn);
+    upstream->stats.requests++;
+    upstream->stats.outstanding++;
+
+    /* Reading starts right away, too, in case the upstream answers before
+     * it's had the whole request (e.g. with an error):
+     */
+    ev_io_start(proxy->loop, &conn->w_write);
+    ev_io_start(proxy->loop, &conn->w_read);
+    conn_touch(conn);
+    return YMO_WOULDBLOCK;
+}
+
+
+static void conn_write_cb(struct ev_loop* loop, ev_io* w, int revents)
+{
+    ymo_http_proxy_conn_t* conn = w->data;
+
+    if( conn->state == YMO_HTTP_PROXY_CONNECTING ) {
+        int c_err = 0;
+        socklen_t err_len = sizeof(c_err);
+        if( getsockopt(conn->fd, SOL_SOCKET, SO_ERROR, &c_err, &err_len) ) {
+            c_err = errno;
+        }
+        if( c_err ) {
+            conn_fail(conn, c_err);
+            return;
+        }
+        conn->state = YMO_HTTP_PROXY_HEAD;
+    }
+
+    ymo_status_t status = YMO_OKAY;
+    if( conn->send ) {
+        status = ymo_net_send_buckets(conn->fd, &conn->send);
+    }
+
+    if( status == YMO_OKAY ) {
+        ev_io_stop(loop, w);
+    } else if( YMO_IS_BLOCKED(status) ) {
+        conn_touch(conn);
+    } else {
+        conn_fail(conn, status);
+    }
+}
+
+
+/*---------------------------------------------------------------*
+ *  Upstream responses:
+ *---------------------------------------------------------------*/
+
+/* Offset just past the end of the head (the empty line), or 0: */
+static size_t head_end(const char* data, size_t len)
+{
+    for( size_t i = 0; i + 1 < len; i++ ) {
+        if( data[i] != '\n' ) {
+            continue;
+        }
+        if( data[i+1] == '\n' ) {
+            return i + 2;
+        }
+        if( data[i+1] == '\r' && i + 2 < len && data[i+2] == '\n' ) {
+            return i + 3;
+        }
+    }
+    return 0;
+}
+
+
+/* Split header lines in place (NUL-terminating names and values), from
+ * p up to end:
+ */
+static ymo_status_t head_fields(
+        char* p, char* end, proxy_hdr_t* hdrs, size_t* no_hdrs)
+{
+    size_t n = 0;
+    while( p < end ) {
+        char* eol = memchr(p, '\n', end - p);
+        char* line_end = (eol > p && eol[-1] == '\r') ? eol - 1 : eol;
+        if( line_end == p ) {
+            break; /* Empty line: end of head */
+        }
+
+        /* No obsolete line folding, or whitespace before the colon: */
+        char* colon = memchr(p, ':', line_end - p);
+        if( !colon || colon == p || *p == ' ' || *p == '\t'
+            || colon[-1] == ' ' || colon[-1] == '\t' ) {
+            return EBADMSG;
+        }
+        if( n == YMO_HTTP_PROXY_MAX_HDRS ) {
+            return EMSGSIZE;
+        }
+
+        char* value = colon + 1;
+        while( value < line_end && (*value == ' ' || *value == '\t') ) {
+            value++;
+        }
+        char* value_end = line_end;
+        while( value_end > value
+                && (value_end[-1] == ' ' || value_end[-1] == '\t') ) {
+            value_end--;
+        }
+
+        *colon = '\0';
+        *value_end = '\0';
+        hdrs[n].hdr = p;
+        hdrs[n].hdr_len = (size_t)(colon - p);
+        hdrs[n].h_id = ymo_http_hdr_id(p, hdrs[n].hdr_len);
+        hdrs[n].value = value;
+        n++;
+        p = eol + 1;
+    }
+    *no_hdrs = n;
+    return YMO_OKAY;
+}
+
+
+/* Work out the body framing from the response head (RFC 9112 §6.3): */
+static ymo_status_t head_framing(
+        ymo_http_proxy_conn_t* conn,
+        int minor,
+        ymo_http_status_t status,
+        const proxy_hdr_t* hdrs,
+        size_t no_hdrs,
+        const char** conn_hdr)
+{
+    const char* te = NULL;
+    int has_cl = 0;
+    size_t cl = 0;
+
+    *conn_hdr = NULL;
+    for( size_t i = 0; i < no_hdrs; i++ ) {
+        switch( hdrs[i].h_id ) {
+            case YMO_HTTP_HID_CONNECTION:
+                *conn_hdr = hdrs[i].value;
+                break;
+            case YMO_HTTP_HID_TRANSFER_ENCODING:
+                te = hdrs[i].value;
+                break;
+            case YMO_HTTP_HID_CONTENT_LENGTH: {
+                char* cl_end = NULL;
+                errno = 0;
+                unsigned long long v = strtoull(hdrs[i].value, &cl_end, 10);
+                if( errno || cl_end == hdrs[i].value || *cl_end
+                    || *hdrs[i].value == '-' || (has_cl && v != cl) ) {
+                    return EBADMSG;
+                }
+                cl = (size_t)v;
+                has_cl = 1;
+                break;
+            }
+            default:
+                break;
+        }
+    }
+
+    conn->keepalive = (minor >= 1)
+        ? !(*conn_hdr && hdr_list_has(*conn_hdr, "close", 5))
+        : (*conn_hdr && hdr_list_has(*conn_hdr, "keep-alive", 10));
+
+    if( !strcmp(conn->request->method, "HEAD")
+        || status == YMO_HTTP_NO_CONTENT
+        || status == YMO_HTTP_NOT_MODIFIED ) {
+        conn->body = YMO_HTTP_PROXY_BODY_LENGTH;
+        conn->remain = 0;
+    } else if( te ) {
+        /* Chunked is always the last coding, if it's there at all: */
+        size_t te_len = strlen(te);
+        if( te_len >= 7 && !strcasecmp(te + te_len - 7, "chunked")
+            && (te_len == 7 || te[te_len-8] == ' '
+                || te[te_len-8] == ',' || te[te_len-8] == '\t') ) {
+            conn->body = YMO_HTTP_PROXY_CHUNK_SIZE;
+        } else {
+            conn->body = YMO_HTTP_PROXY_BODY_CLOSE;
+            conn->keepalive = 0;
+        }
+    } else if( has_cl ) {
+        conn->body = YMO_HTTP_PROXY_BODY_LENGTH;
+        conn->remain = cl;
+    } else {
+        conn->body = YMO_HTTP_PROXY_BODY_CLOSE;
+        conn->keepalive = 0;
+    }
+    return YMO_OKAY;
+}
+
+
+static ymo_status_t proxy_drain(
+        ymo_http_session_t* session,
+        ymo_http_response_t* response,
+        void* user_data)
+{
+    ymo_http_proxy_conn_t* conn = user_data;
+    if( response->proxy_conn != conn || !conn->paused ) {
+        return YMO_OKAY;
+    }
+
+    conn->paused = 0;
+    if( !conn->pipe_wait ) {
+        ev_io_start(conn->upstream->proxy->loop, &conn->w_read);
+        conn_touch(conn);
+    }
+    return YMO_OKAY;
+}
+
+
+/* Parse the response head (skipping interim responses) and pass it along
+ * to the client. Returns YMO_WOULDBLOCK until the head is complete:
+ */
+static ymo_status_t conn_head(ymo_http_proxy_conn_t* conn)
+{
+    ymo_http_proxy_buf_t* buf = conn->rbuf;
+    proxy_hdr_t hdrs[YMO_HTTP_PROXY_MAX_HDRS];
+    size_t no_hdrs;
+    size_t head_len;
+    char* head;
+    int minor;
+    ymo_http_status_t status;
+
+    do {
+        head = buf->data + conn->rpos;
+        head_len = head_end(head, buf->len - conn->rpos);
+        if( !head_len ) {
+            return YMO_WOULDBLOCK;
+        }
+
+        /* Status line: */
+        if( head_len < 13 || memcmp(head, "HTTP/1.", 7)
+            || head[7] < '0' || head[7] > '9' || head[8] != ' '
+            || head[9] < '1' || head[9] > '5'
+            || head[10] < '0' || head[10] > '9'
+            || head[11] < '0' || head[11] > '9'
+            || (head[12] != ' ' && head[12] != '\r' && head[12] != '\n') ) {
+            return EBADMSG;
+        }
+        minor = head[7] - '0';
+        status = (head[9] - '0') * 100 + (head[10] - '0') * 10
+            + (head[11] - '0');
+        conn->rpos += head_len;
+
+        /* We never ask to switch protocols: */
+        if( status == YMO_HTTP_SWITCHING_PROTOCOLS ) {
+            return EBADMSG;
+        }
+    } while( status < 200 );
+
+    char* fields = memchr(head, '\n', head_len) + 1;
+    ymo_status_t r_val = head_fields(
+            fields, head + head_len, hdrs, &no_hdrs);
+    if( r_val != YMO_OKAY ) {
+        return r_val;
+    }
+
+    const char* conn_hdr;
+    r_val = head_framing(conn, minor, status, hdrs, no_hdrs, &conn_hdr);
+    if( r_val != YMO_OKAY ) {
+        return r_val;
+    }
+
+    /* Pass the fields through, pointing into the buffer: */
+    ymo_http_response_t* response = conn->response;
+    ymo_http_response_set_status(response, status);
+    for( size_t i = 0; i < no_hdrs; i++ ) {
+        if( hdr_skip(hdrs[i].h_id, hdrs[i].hdr, hdrs[i].hdr_len, conn_hdr)
+            || (hdrs[i].h_id == YMO_HTTP_HID_CONTENT_LENGTH
+                && conn->body != YMO_HTTP_PROXY_BODY_LENGTH) ) {
+            continue;
+        }
+        if( !ymo_http_hdr_table_add_precompute(&response->headers,
+                    hdrs[i].h_id, hdrs[i].hdr, hdrs[i].hdr_len,
+                    hdrs[i].value) ) {
+            return ENOMEM;
+        }
+    }
+    response->proxy_head = buf;
+    buf->refs++;
+
+    conn->state = YMO_HTTP_PROXY_BODY;
+    ymo_http_response_on_drain(response, &proxy_drain, conn);
+
+    /* Get the head to streaming clients right away: */
+    if( response->flags & YMO_HTTP_FLAG_SUPPORTS_CHUNKED ) {
+        ymo_http_response_ready(response);
+    }
+    return YMO_OKAY;
+}
+
+
+/* Length of the line at p, including its LF (0, if it's incomplete): */
+static size_t body_line(const char* p, size_t len)
+{
+    const char* eol = memchr(p, '\n', len);
+    return eol ? (size_t)(eol - p) + 1 : 0;
+}
+
+
+/* Relay whatever body data has been read. Returns 1 once the body is
+ * complete; 0 if there's more to come; -1 (with errno set) on error:
+ */
+static int conn_body(ymo_http_proxy_conn_t* conn)
+{
+    ymo_http_proxy_buf_t* buf = conn->rbuf;
+    ymo_bucket_t* head = NULL;
+    ymo_bucket_t* tail = NULL;
+    int done = 0;
+    int r_val = 0;
+
+    while( !done ) {
+        char* p = buf->data + conn->rpos;
+        size_t avail = buf->len - conn->rpos;
+        size_t n = 0;
+        ymo_bucket_t* bucket = NULL;
+
+        switch( conn->body ) {
+            case YMO_HTTP_PROXY_BODY_LENGTH:
+            case YMO_HTTP_PROXY_BODY_SPLICE:
+            case YMO_HTTP_PROXY_CHUNK_DATA:
+                if( !conn->remain ) {
+                    if( conn->body != YMO_HTTP_PROXY_CHUNK_DATA ) {
+                        done = 1;
+                    } else {
+                        conn->body = YMO_HTTP_PROXY_CHUNK_CRLF;
+                    }
+                    continue;
+                }
+                n = YMO_MIN(avail, conn->remain);
+                conn->remain -= n;
+                break;
+            case YMO_HTTP_PROXY_BODY_CLOSE:
+                n = avail;
+                break;
+            case YMO_HTTP_PROXY_CHUNK_SIZE: {
+                size_t line_len = body_line(p, avail);
+                if( !line_len ) {
+                    goto body_flush;
+                }
+
+                size_t size = 0;
+                size_t digits = 0;
+                for( ; digits < line_len; digits++ ) {
+                    int c = p[digits];
+                    int v = (c >= '0' && c <= '9') ? c - '0'
+                        : (c >= 'a' && c <= 'f') ? c - 'a' + 10
+                        : (c >= 'A' && c <= 'F') ? c - 'A' + 10 : -1;
+                    if( v < 0 ) {
+                        break;
+                    }
+                    if( size > (SIZE_MAX >> 4) ) {
+                        errno = EBADMSG;
+                        r_val = -1;
+                        goto body_flush;
+                    }
+                    size = (size << 4) | (size_t)v;
+                }
+                if( !digits ) {
+                    errno = EBADMSG;
+                    r_val = -1;
+                    goto body_flush;
+                }
+
+                /* (Chunk extensions are ignored.) */
+                conn->rpos += line_len;
+                conn->remain = size;
+                conn->body = size
+                    ? YMO_HTTP_PROXY_CHUNK_DATA : YMO_HTTP_PROXY_CHUNK_TRAILER;
+                continue;
+            }
+            case YMO_HTTP_PROXY_CHUNK_CRLF: {
+                size_t line_len = body_line(p, avail);
+                if( !line_len ) {
+                    goto body_flush;
+                }
+                if( line_len > 2 || (line_len == 2 && p[0] != '\r') ) {
+                    errno = EBADMSG;
+                    r_val = -1;
+                    goto body_flush;
+                }
+                conn->rpos += line_len;
+                conn->body = YMO_HTTP_PROXY_CHUNK_SIZE;
+                continue;
+            }
+            case YMO_HTTP_PROXY_CHUNK_TRAILER: {
+                /* Trailer fields are dropped, up to the empty line: */
+                size_t line_len = body_line(p, avail);
+                if( !line_len ) {
+                    goto body_flush;
+                }
+                conn->rpos += line_len;
+                if( line_len == 1 || (line_len == 2 && p[0] == '\r') ) {
+                    done = 1;
+                }
+                continue;
+            }
+        }
+
+        if( !n ) {
+            break;
+        }
+
+        if( !(bucket = buf_bucket(buf, p, n)) ) {
+            errno = ENOMEM;
+            r_val = -1;
+            goto body_flush;
+        }
+        conn->rpos += n;
+        if( tail ) {
+            tail->next = bucket;
+        } else {
+            head = bucket;
+        }
+        tail = bucket;
+    }
+
+body_flush:
+    /* Everything read goes to the client in one go: */
+    if( head ) {
+        ymo_http_response_body_append(conn->response, head);
+    }
+    return r_val ? r_val : done;
+}
+
+
+/* Let the client catch up before reading any more (the drain callback
+ * starts us up again):
+ */
+static void conn_pause(ymo_http_proxy_conn_t* conn)
+{
+    struct ev_loop* loop = conn->upstream->proxy->loop;
+    conn->paused = 1;
+    ev_io_stop(loop, &conn->w_read);
+    ev_timer_stop(loop, &conn->timer);
+}
+
+
+static void conn_process(ymo_http_proxy_conn_t* conn)
+{
+    if( conn->state == YMO_HTTP_PROXY_HEAD ) {
+        ymo_status_t status = conn_head(conn);
+        if( status == YMO_WOULDBLOCK ) {
+            return;
+        } else if( status != YMO_OKAY ) {
+            conn_fail(conn, status);
+            return;
+        }
+    }
+
+    int r_val = conn_body(conn);
+    if( r_val < 0 ) {
+        conn_fail(conn, errno);
+    } else if( r_val ) {
+        conn_done(conn);
+    } else if( !ymo_http_response_writable(conn->response) ) {
+        conn_pause(conn);
+    }
+}
+
+
+/*---------------------------------------------------------------*
+ *  Spliced bodies:
+ *---------------------------------------------------------------*/
+
+/* Whether to splice the rest of the body: it has to be big enough to be
+ * worth it, with nothing left in the read buffer, and the client has to be
+ * able to take pipe buckets as-is (i.e. streaming HTTP/1.1, without TLS):
+ */
+static int conn_splice(ymo_http_proxy_conn_t* conn)
+{
+    ymo_http_response_t* response = conn->response;
+    size_t splice_min = conn->upstream->proxy->splice_min;
+
+    if( conn->body == YMO_HTTP_PROXY_BODY_SPLICE ) {
+        return 1;
+    }
+    if( !splice_min
+        || conn->body != YMO_HTTP_PROXY_BODY_LENGTH
+        || conn->remain < splice_min
+        || (conn->rbuf && conn->rpos < conn->rbuf->len)
+        || !(response->flags & YMO_HTTP_FLAG_SUPPORTS_CHUNKED)
+        || strncmp(conn->request->version, "HTTP/1.", 7)
+        || !response->session ) {
+        return 0;
+    }
+#if YMO_ENABLE_TLS
+    if( response->session->conn->ssl ) {
+        return 0;
+    }
+#endif /* YMO_ENABLE_TLS */
+
+    if( !conn->pipe ) {
+        conn->pipe = ymo_pipe_create(YMO_HTTP_PROXY_PIPE_SIZE);
+        if( !conn->pipe ) {
+            /* Stick to copying (for good, if there's no splice): */
+            if( errno == ENOTSUP ) {
+                conn->upstream->proxy->splice_min = 0;
+            }
+            return 0;
+        }
+        ev_io_set(&conn->w_pipe, ymo_pipe_write_fd(conn->pipe), EV_WRITE);
+    }
+    conn->body = YMO_HTTP_PROXY_BODY_SPLICE;
+    return 1;
+}
+
+
+static void conn_splice_read(ymo_http_proxy_conn_t* conn)
+{
+    struct ev_loop* loop = conn->upstream->proxy->loop;
+    ssize_t n = ymo_pipe_fill(conn->pipe, conn->fd, conn->remain);
+
+    if( n < 0 ) {
+        if( errno == ENOBUFS ) {
+            /* The client hasn't taken what's in the pipe yet: */
+            conn->pipe_wait = 1;
+            ev_io_stop(loop, &conn->w_read);
+            ev_timer_stop(loop, &conn->timer);
+            ev_io_start(loop, &conn->w_pipe);
+        } else if( !YMO_IS_BLOCKED(errno) ) {
+            conn_fail(conn, errno);
+        }
+        return;
+    }
+
+    if( !n ) {
+        conn_fail(conn, ECONNRESET);
+        return;
+    }
+
+    ymo_bucket_t* bucket = ymo_bucket_create_pipe(
+            NULL, NULL, conn->pipe, (size_t)n);
+    if( !bucket ) {
+        conn_fail(conn, ENOMEM);
+        return;
+    }
+
+    conn->remain -= (size_t)n;
+    conn->received += (size_t)n;
+    conn->upstream->stats.spliced += (size_t)n;
+    conn_touch(conn);
+    ymo_http_response_body_append(conn->response, bucket);
+
+    if( !conn->remain ) {
+        conn_done(conn);
+    } else if( !ymo_http_response_writable(conn->response) ) {
+        conn_pause(conn);
+    }
+}
+
+
+static void conn_pipe_cb(struct ev_loop* loop, ev_io* w, int revents)
+{
+    ymo_http_proxy_conn_t* conn = w->data;
+    conn->pipe_wait = 0;
+    ev_io_stop(loop, &conn->w_pipe);
+    if( !conn->paused ) {
+        ev_io_start(loop, &conn->w_read);
+        conn_touch(conn);
+    }
+}
+
+
+/* Make room to read into, keeping whatever hasn't been parsed yet: */
+static ymo_http_proxy_buf_t* conn_rbuf(ymo_http_proxy_conn_t* conn)
+{
+    ymo_http_proxy_buf_t* buf = conn->rbuf;
+    size_t keep = buf ? buf->len - conn->rpos : 0;
+
+    if( buf && buf->refs == 1 && !keep ) {
+        buf->len = conn->rpos = 0;
+    }
+    if( buf && buf->len < YMO_HTTP_PROXY_BUF_SIZE ) {
+        return buf;
+    }
+
+    /* A head (or chunk line) which doesn't fit in a buffer: */
+    if( keep == YMO_HTTP_PROXY_BUF_SIZE ) {
+        errno = EMSGSIZE;
+        return NULL;
+    }
+
+    ymo_http_proxy_buf_t* fresh = buf_create();
+    if( !fresh ) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    if( keep ) {
+        memcpy(fresh->data, buf->data + conn->rpos, keep);
+        fresh->len = keep;
+    }
+    buf_unref(buf);
+    conn->rbuf = fresh;
+    conn->rpos = 0;
+    return fresh;
+}
+
+
+static void conn_read_cb(struct ev_loop* loop, ev_io* w, int revents)
+{
+    ymo_http_proxy_conn_t* conn = w->data;
+
+    switch( conn->state ) {
+        case YMO_HTTP_PROXY_CONNECTING:
+            /* Connection errors are picked up by the write callback: */
+            return;
+        case YMO_HTTP_PROXY_IDLE:
+            /* Nothing is expected from an idle upstream but a close: */
+            conn_unpool(conn);
+            conn_close(conn);
+            return;
+        case YMO_HTTP_PROXY_BODY:
+            if( conn_splice(conn) ) {
+                conn_splice_read(conn);
+                return;
+            }
+            break;
+        default:
+            break;
+    }
+
+    ymo_http_proxy_buf_t* buf = conn_rbuf(conn);
+    if( !buf ) {
+        conn_fail(conn, errno);
+        return;
+    }
+
+    ssize_t n = read(conn->fd, buf->data + buf->len,
+            YMO_HTTP_PROXY_BUF_SIZE - buf->len);
+    if( n < 0 ) {
+        if( !YMO_IS_BLOCKED(errno) && errno != EINTR ) {
+            conn_fail(conn, errno);
+        }
+        return;
+    }
+
+    if( !n ) {
+        /* Close-delimited bodies end here; anything else was cut short: */
+        if( conn->state == YMO_HTTP_PROXY_BODY
+            && conn->body == YMO_HTTP_PROXY_BODY_CLOSE ) {
+            conn_done(conn);
+        } else {
+            conn_fail(conn, ECONNRESET);
+        }
+        return;
+    }
+
+    buf->len += n;
+    conn->received += n;
+    conn_touch(conn);
+    conn_process(conn);
+}
+
+
+static void conn_timer_cb(struct ev_loop* loop, ev_timer* w, int revents)
+{
+    ymo_http_proxy_conn_t* conn = w->data;
+    if( conn->state == YMO_HTTP_PROXY_IDLE ) {
+        conn_unpool(conn);
+        conn_close(conn);
+        return;
+    }
+    conn_fail(conn, ETIMEDOUT);
+}
+
+
+/*---------------------------------------------------------------*
+ *  Public API:
+ *---------------------------------------------------------------*/
+ymo_http_proxy_t* ymo_http_proxy_create(struct ev_loop* loop)
+{
+    ymo_http_proxy_t* proxy = YMO_NEW0(ymo_http_proxy_t);
+    if( !proxy ) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    proxy->loop = loop;
+    proxy->timeout = YMO_HTTP_PROXY_TIMEOUT_DEFAULT;
+    proxy->splice_min = YMO_HTTP_PROXY_SPLICE_DEFAULT;
+    return proxy;
+}
+
+
+ymo_status_t ymo_http_proxy_add_upstream(
+        ymo_http_proxy_t* proxy,
+        const char* host,
+        int port,
+        size_t max_idle)
+{
+    char port_str[8];
+    struct addrinfo hints;
+    struct addrinfo* res = NULL;
+
+    if( port <= 0 || port > 65535 ) {
+        return EINVAL;
+    }
+    snprintf(port_str, sizeof(port_str), "%i", port);
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_NUMERICSERV;
+    if( getaddrinfo(host, port_str, &hints, &res) || !res ) {
+        ymo_log_warning("Unable to resolve upstream %s", host);
+        return EINVAL;
+    }
+
+    ymo_http_proxy_upstream_t* upstream = YMO_NEW0(ymo_http_proxy_upstream_t);
+    if( !upstream ) {
+        freeaddrinfo(res);
+        return ENOMEM;
+    }
+    memcpy(&upstream->addr, res->ai_addr, res->ai_addrlen);
+    upstream->addr_len = res->ai_addrlen;
+    freeaddrinfo(res);
+
+    /* For the Host header, when the client didn't send one: */
+    size_t host_max = strlen(host) + sizeof("[]:65535");
+    upstream->host = YMO_ALLOC(host_max);
+    if( !upstream->host ) {
+        YMO_DELETE(ymo_http_proxy_upstream_t, upstream);
+        return ENOMEM;
+    }
+    snprintf(upstream->host, host_max,
+            strchr(host, ':') ? "[%s]:%s" : "%s:%s", host, port_str);
+
+    ymo_http_proxy_upstream_t** upstreams = realloc(proxy->upstreams,
+            (proxy->no_upstreams + 1) * sizeof(ymo_http_proxy_upstream_t*));
+    if( !upstreams ) {
+        YMO_FREE(upstream->host);
+        YMO_DELETE(ymo_http_proxy_upstream_t, upstream);
+        return ENOMEM;
+    }
+    proxy->upstreams = upstreams;
+
+    upstream->proxy = proxy;
+    upstream->max_idle = max_idle;
+    proxy->upstreams[proxy->no_upstreams++] = upstream;
+    return YMO_OKAY;
+}
+
+
+void ymo_http_proxy_set_timeout(ymo_http_proxy_t* proxy, double timeout)
+{
+    proxy->timeout = timeout;
+}
+
+
+void ymo_http_proxy_set_splice(ymo_http_proxy_t* proxy, size_t min_len)
+{
+    proxy->splice_min = min_len;
+}
+
+
+ymo_status_t ymo_http_proxy_stats(
+        const ymo_http_proxy_t* proxy,
+        size_t upstream,
+        ymo_http_proxy_stats_t* stats)
+{
+    if( upstream >= proxy->no_upstreams ) {
+        return EINVAL;
+    }
+    *stats = proxy->upstreams[upstream]->stats;
+    return YMO_OKAY;
+}
+
+
+/* Least outstanding requests, starting the search one further along each
+ * time, so ties go round-robin:
+ */
+static ymo_http_proxy_upstream_t* upstream_pick(ymo_http_proxy_t* proxy)
+{
+    size_t no_upstreams = proxy->no_upstreams;
+    ymo_http_proxy_upstream_t* best = NULL;
+
+    for( size_t i = 0; i < no_upstreams; i++ ) {
+        ymo_http_proxy_upstream_t* upstream =
+            proxy->upstreams[(proxy->rr + i) % no_upstreams];
+        if( !best
+            || upstream->stats.outstanding < best->stats.outstanding ) {
+            best = upstream;
+        }
+    }
+    proxy->rr = (proxy->rr + 1) % no_upstreams;
+    return best;
+}
+
+
+ymo_status_t ymo_http_proxy_serve(
+        ymo_http_proxy_t* proxy,
+        ymo_http_request_t* request,
+        ymo_http_response_t* response)
+{
+    if( !proxy->no_upstreams ) {
+        return ymo_http_response_issue(response, YMO_HTTP_BAD_GATEWAY);
+    }
+
+    /* Whatever content-coding the upstream applied is passed along: */
+    ymo_http_response_set_compression(response, 0);
+
+    ymo_http_proxy_upstream_t* upstream = upstream_pick(proxy);
+    ymo_status_t status = proxy_send(upstream, request, response, 0);
+    if( status == YMO_WOULDBLOCK || status == ENOMEM ) {
+        return status;
+    }
+
+    upstream->stats.errors++;
+    return ymo_http_response_issue(response, YMO_HTTP_BAD_GATEWAY);
+}
+
+
+ymo_status_t ymo_http_proxy_cb(
+        ymo_http_session_t* session,
+        ymo_http_request_t* request,
+        ymo_http_response_t* response,
+        void* user_data)
+{
+    return ymo_http_proxy_serve(user_data, request, response);
+}
+
+
+void ymo_http_proxy_release(ymo_http_response_t* response)
+{
+    /* The client went away mid-response, so the connection can't be
+     * reused:
+     */
+    ymo_http_proxy_conn_t* conn = response->proxy_conn;
+    if( conn ) {
+        conn_detach(conn);
+        conn_close(conn);
+    }
+
+    buf_unref(response->proxy_head);
+    response->proxy_head = NULL;
+}
+
+
+void ymo_http_proxy_free(ymo_http_proxy_t* proxy)
+{
+    if( !proxy ) {
+        return;
+    }
+
+    while( proxy->active ) {
+        ymo_http_proxy_conn_t* conn = proxy->active;
+        ymo_http_response_t* response = conn->response;
+        conn->upstream->stats.errors++;
+        conn_detach(conn);
+        conn_close(conn);
+        ymo_http_response_abort(response, YMO_HTTP_BAD_GATEWAY);
+    }
+
+    for( size_t i = 0; i < proxy->no_upstreams; i++ ) {
+        ymo_http_proxy_upstream_t* upstream = proxy->upstreams[i];
+        while( upstream->idle ) {
+            ymo_http_proxy_conn_t* conn = upstream->idle;
+            conn_unpool(conn);
+            conn_close(conn);
+        }
+        YMO_FREE(upstream->host);
+        YMO_DELETE(ymo_http_proxy_upstream_t, upstream);
+    }
+    free(proxy->upstreams);
+    YMO_DELETE(ymo_http_proxy_t, proxy);
+}
@@ -0,0 +1,175 @@
+/*=============================================================================
+ *
+ * Copyright (c) 2014 Andrew Canaday
+ *
+ * This file is part of libyimmo (sometimes referred to as "yimmo" or "ymo").
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *===========================================================================*/
+
+
+
+#ifndef YMO_HTTP_PROXY_H
+#define YMO_HTTP_PROXY_H
+#include "yimmo_config.h"
+#include <stddef.h>
+#include <sys/socket.h>
+#include <ev.h>
+
+#include "yimmo.h"
+#include "ymo_http.h"
+
+/** Reverse Proxy
+ * ===============
+ *
+ * Internals for reverse proxies (see :c:func:`ymo_http_proxy_create`).
+ *
+ * Each upstream connection is a small HTTP/1.1 client state machine, driven
+ * by its own read/write watchers and timer on the proxy's loop. Connections
+ * are pooled per upstream: an exchange takes the most recently used idle
+ * connection (or opens a new one), and gives it back once the upstream
+ * response has been read in full, if the upstream allows it.
+ *
+ * The upstream request is a bucket chain: the request head (serialized
+ * straight from the parsed header table) followed by references to the
+ * client's body — in memory, or a file bucket on its spool.
+ *
+ * Upstream data is read into reference counted buffers. The response head
+ * is split up in place — the response's header table points into the
+ * buffer, which the response holds on to until it's cleared — and body
+ * data goes to the client as buckets which reference the buffer, too.
+ *
+ * Large bodies (by Content-Length) skip the read buffer, once it's been
+ * used up: they're spliced from the upstream socket into a per-connection
+ * pipe, and go to the client as pipe buckets, which the client connection
+ * splices straight back out (see :c:func:`ymo_pipe_create`). While the
+ * pipe is full, the connection watches its write end instead of the
+ * upstream socket.
+ */
+
+/**---------------------------------------------------------------
+ * Definitions
+ *---------------------------------------------------------------*/
+
+/** Upstream read buffer size (also the largest response head). */
+#ifndef YMO_HTTP_PROXY_BUF_SIZE
+#define YMO_HTTP_PROXY_BUF_SIZE 16384
+#endif /* YMO_HTTP_PROXY_BUF_SIZE */
+
+/** Most header fields accepted in an upstream response head. */
+#ifndef YMO_HTTP_PROXY_MAX_HDRS
+#define YMO_HTTP_PROXY_MAX_HDRS 128
+#endif /* YMO_HTTP_PROXY_MAX_HDRS */
+
+/** Capacity requested for splice pipes. */
+#ifndef YMO_HTTP_PROXY_PIPE_SIZE
+#define YMO_HTTP_PROXY_PIPE_SIZE 65536
+#endif /* YMO_HTTP_PROXY_PIPE_SIZE */
+
+
+/**---------------------------------------------------------------
+ * Types
+ *---------------------------------------------------------------*/
+
+typedef struct ymo_http_proxy_buf ymo_http_proxy_buf_t;
+typedef struct ymo_http_proxy_conn ymo_http_proxy_conn_t;
+typedef struct ymo_http_proxy_upstream ymo_http_proxy_upstream_t;
+
+/** Upstream connection states. */
+typedef enum ymo_http_proxy_state {
+    YMO_HTTP_PROXY_CONNECTING,  /* Nonblocking connect in progress */
+    YMO_HTTP_PROXY_HEAD,        /* Awaiting the response head */
+    YMO_HTTP_PROXY_BODY,        /* Relaying the response body */
+    YMO_HTTP_PROXY_IDLE,        /* In the pool */
+} ymo_http_proxy_state_t;
+
+/** Upstream response body framing (and chunked decoder states). */
+typedef enum ymo_http_proxy_body {
+    YMO_HTTP_PROXY_BODY_LENGTH,     /* Content-Length */
+    YMO_HTTP_PROXY_BODY_SPLICE,     /* Content-Length, via the pipe */
+    YMO_HTTP_PROXY_BODY_CLOSE,      /* Until the upstream closes */
+    YMO_HTTP_PROXY_CHUNK_SIZE,      /* Chunk size line */
+    YMO_HTTP_PROXY_CHUNK_DATA,
+    YMO_HTTP_PROXY_CHUNK_CRLF,      /* After chunk data */
+    YMO_HTTP_PROXY_CHUNK_TRAILER,   /* Trailer fields, up to an empty line */
+} ymo_http_proxy_body_t;
+
+/** Reference counted upstream read buffer. */
+struct ymo_http_proxy_buf {
+    int                         refs;
+    size_t                      len;        /* Bytes read into data */
+    char                        data[YMO_HTTP_PROXY_BUF_SIZE];
+};
+
+/** Upstream connection. */
+struct ymo_http_proxy_conn {
+    ymo_http_proxy_upstream_t*  upstream;
+    int                         fd;
+    ev_io                       w_read;
+    ev_io                       w_write;
+    ev_timer                    timer;      /* Upstream inactivity */
+    ymo_http_proxy_state_t      state;
+    ymo_http_proxy_body_t       body;
+    size_t                      remain;     /* Of the body, or chunk */
+    int                         reused;     /* Taken from the pool */
+    int                         keepalive;  /* Upstream allows reuse */
+    int                         paused;     /* Client isn't writable */
+    ymo_pipe_t*                 pipe;       /* For spliced bodies */
+    ev_io                       w_pipe;     /* Pipe has room */
+    int                         pipe_wait;  /* Pipe is full */
+    size_t                      received;   /* Response bytes, so far */
+    ymo_bucket_t*               send;       /* Request data, still to send */
+    ymo_http_proxy_buf_t*       rbuf;
+    size_t                      rpos;       /* Parsed up to here */
+    ymo_http_request_t*         request;
+    ymo_http_response_t*        response;
+    ymo_http_proxy_conn_t*      prev;       /* Pool, or active list */
+    ymo_http_proxy_conn_t*      next;
+};
+
+/** Upstream server. */
+struct ymo_http_proxy_upstream {
+    ymo_http_proxy_t*           proxy;
+    char*                       host;       /* "host:port", for Host */
+    struct sockaddr_storage     addr;
+    socklen_t                   addr_len;
+    size_t                      max_idle;
+    ymo_http_proxy_conn_t*      idle;       /* Most recently used first */
+    ymo_http_proxy_stats_t      stats;
+};
+
+/** Reverse proxy. */
+struct ymo_http_proxy {
+    struct ev_loop*             loop;
+    double                      timeout;
+    size_t                      splice_min; /* Or 0, for no splicing */
+    ymo_http_proxy_upstream_t** upstreams;
+    size_t                      no_upstreams;
+    size_t                      rr;         /* Tie-breaker */
+    ymo_http_proxy_conn_t*      active;     /* Busy connections */
+};
+
+
+/**---------------------------------------------------------------
+ * Functions
+ *---------------------------------------------------------------*/
+
+/** Detach a response from the proxy: close its upstream connection, if the
+ * upstream response is still in progress (e.g. the client disconnected),
+ * and drop its reference to the upstream response head.
+ */
+void ymo_http_proxy_release(ymo_http_response_t* response);
+
+#endif /* YMO_HTTP_PROXY_H */
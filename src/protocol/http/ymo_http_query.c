@@ -0,0 +1,397 @@
+/*=============================================================================
+ *
+ * Copyright (c) 2014 Andrew Canaday
+ *
+ * This file is part of libyimmo (sometimes referred to as "yimmo" or "ymo").
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *===========================================================================*/
+
+#include "yimmo_config.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "yimmo.h"
+#include "ymo_blalloc.h"
+#include "ymo_http.h"
+#include "ymo_http_scan.h"
+
+/*---------------------------------------------------------------*
+ *  Declarations
+ *---------------------------------------------------------------*/
+
+#define FORM_NO_KEY SIZE_MAX
+
+/* Value of each hex digit, or -1: */
+static const int8_t hex_tbl[256] = {
+    ['0'] = 1, ['1'] = 2, ['2'] = 3, ['3'] = 4, ['4'] = 5,
+    ['5'] = 6, ['6'] = 7, ['7'] = 8, ['8'] = 9, ['9'] = 10,
+    ['A'] = 11, ['B'] = 12, ['C'] = 13, ['D'] = 14, ['E'] = 15, ['F'] = 16,
+    ['a'] = 11, ['b'] = 12, ['c'] = 13, ['d'] = 14, ['e'] = 15, ['f'] = 16,
+};
+
+/* (The table is offset by one so the rest of it can be zero-filled): */
+#define HEX_VAL(c) (hex_tbl[(uint8_t)(c)] - 1)
+
+/* Bytes which don't decode to themselves (cf. ymo_http_scan_query): */
+static const uint8_t query_special[256] = {
+    ['\0'] = 1, ['%'] = 1, ['&'] = 1, ['+'] = 1, ['='] = 1,
+};
+
+/* Most runs in real query strings are only a few bytes long — too short
+ * to be worth a vector scan — so the first few bytes of each are checked
+ * inline:
+ */
+#define QUERY_SHORT_RUN 16
+
+
+/* Length of the leading run of bytes in p which decode to themselves: */
+static inline size_t query_run(const char* p, size_t len)
+{
+    size_t short_len = (len < QUERY_SHORT_RUN) ? len : QUERY_SHORT_RUN;
+    size_t i;
+
+    for( i = 0; i < short_len; i++ ) {
+        if( query_special[(uint8_t)p[i]] ) {
+            return i;
+        }
+    }
+    return i + ymo_http_scan_query(p + i, len - i);
+}
+
+
+/* Decode the escape or special character at src[*i] (which the query
+ * scanner stopped at), advancing *i past it:
+ */
+static inline char decode_one(const char* src, size_t len, size_t* i, int form)
+{
+    char c = src[*i];
+    if( c == '%' && len - *i >= 3 ) {
+        int hi = HEX_VAL(src[*i+1]);
+        int lo = HEX_VAL(src[*i+2]);
+        if( hi >= 0 && lo >= 0 ) {
+            *i += 3;
+            return (char)((hi << 4) | lo);
+        }
+    } else if( c == '+' && form ) {
+        c = ' ';
+    }
+    ++(*i);
+    return c;
+}
+
+
+/* Compare an encoded key with a (decoded) name, without decoding the key
+ * anywhere:
+ */
+static int key_eq(const char* enc, size_t len, const char* name)
+{
+    size_t i = 0;
+    while( i < len )
+    {
+        size_t run = query_run(enc + i, len - i);
+        if( run ) {
+            if( strncmp(name, enc + i, run) ) {
+                return 0;
+            }
+            name += run;
+            i += run;
+            continue;
+        }
+
+        char c = decode_one(enc, len, &i, 1);
+        if( !*name || *name != c ) {
+            return 0;
+        }
+        ++name;
+    }
+    return *name == '\0';
+}
+
+
+/* Decode src into ws, NUL-terminated: */
+static char* decode_ws(ymo_blalloc_t* ws, const char* src, size_t len)
+{
+    char* dst = ymo_blalloc(ws, 1, len + 1);
+    if( dst ) {
+        dst[ymo_http_url_decode(dst, src, len, 1)] = '\0';
+    }
+    return dst;
+}
+
+
+/*---------------------------------------------------------------*
+ *  Query Strings:
+ *---------------------------------------------------------------*/
+size_t ymo_http_url_decode(char* dst, const char* src, size_t len, int form)
+{
+    size_t out = 0;
+    size_t i = 0;
+    size_t plain = 0;
+
+    while( i < len )
+    {
+        char c = src[i];
+        if( !query_special[(uint8_t)c] ) {
+            dst[out++] = c;
+            ++i;
+
+            /* Long runs which decode to themselves are copied as-is: */
+            if( ++plain == QUERY_SHORT_RUN ) {
+                size_t run = ymo_http_scan_query(src + i, len - i);
+                memmove(dst + out, src + i, run);
+                out += run;
+                i += run;
+                plain = 0;
+            }
+            continue;
+        }
+        plain = 0;
+        dst[out++] = decode_one(src, len, &i, form);
+    }
+    return out;
+}
+
+
+void ymo_http_query_iter_init(ymo_http_query_iter_t* iter, const char* query)
+{
+    iter->p = query;
+    iter->end = query ? query + strlen(query) : NULL;
+}
+
+
+int ymo_http_query_next(
+        ymo_http_query_iter_t* iter,
+        ymo_blalloc_t* ws,
+        const char** key,
+        const char** value)
+{
+    while( iter->p < iter->end )
+    {
+        const char* pair = iter->p;
+        const char* amp = memchr(pair, '&', iter->end - pair);
+        const char* pair_end = amp ? amp : iter->end;
+        iter->p = amp ? amp + 1 : iter->end;
+
+        if( pair_end == pair ) {
+            continue;
+        }
+
+        const char* eq = memchr(pair, '=', pair_end - pair);
+        const char* key_end = eq ? eq : pair_end;
+        const char* val = eq ? eq + 1 : pair_end;
+
+        /* Decoding never grows the input, so one allocation holds both: */
+        char* out = ymo_blalloc(ws, 1, (pair_end - pair) + 2);
+        if( !out ) {
+            errno = ENOMEM;
+            return -1;
+        }
+
+        size_t key_len = ymo_http_url_decode(out, pair, key_end - pair, 1);
+        out[key_len] = '\0';
+        char* out_val = out + key_len + 1;
+        out_val[ymo_http_url_decode(out_val, val, pair_end - val, 1)] = '\0';
+
+        *key = out;
+        *value = out_val;
+        return 1;
+    }
+    return 0;
+}
+
+
+const char* ymo_http_request_query(
+        ymo_http_request_t* request, const char* name)
+{
+    const char* p = request->query;
+    const char* end = p ? p + strlen(p) : NULL;
+
+    while( p < end )
+    {
+        const char* amp = memchr(p, '&', end - p);
+        const char* pair_end = amp ? amp : end;
+        const char* eq = memchr(p, '=', pair_end - p);
+        const char* key_end = eq ? eq : pair_end;
+
+        if( key_eq(p, key_end - p, name) ) {
+            const char* val = eq ? eq + 1 : pair_end;
+            char* value = decode_ws(request->ws, val, pair_end - val);
+            if( !value ) {
+                errno = ENOMEM;
+            }
+            return value;
+        }
+        p = amp ? amp + 1 : end;
+    }
+
+    errno = ENOENT;
+    return NULL;
+}
+
+
+/*---------------------------------------------------------------*
+ *  Forms:
+ *---------------------------------------------------------------*/
+static inline ymo_status_t form_append(
+        ymo_http_form_t* form, const char* data, size_t len)
+{
+    /* Leave room for the terminators (the key's may already be there): */
+    size_t reserve = (form->key_len == FORM_NO_KEY) ? 2 : 1;
+    if( form->len + len + reserve > form->buf_len ) {
+        return EFBIG;
+    }
+    memcpy(form->buf + form->len, data, len);
+    form->len += len;
+    return YMO_OKAY;
+}
+
+
+static ymo_status_t form_emit(ymo_http_form_t* form)
+{
+    if( form->key_len == FORM_NO_KEY ) {
+        /* Empty fields (e.g. "a=1&&b=2") are skipped: */
+        if( !form->len ) {
+            return YMO_OKAY;
+        }
+        form->key_len = form->len;
+        form->buf[form->len++] = '\0';
+    }
+
+    char* value = form->buf + form->key_len + 1;
+    size_t value_len = form->len - form->key_len - 1;
+    form->buf[form->len] = '\0';
+
+    form->len = 0;
+    form->key_len = FORM_NO_KEY;
+    return form->cb(form->data, form->buf, value, value_len);
+}
+
+
+/* Flush a partial escape as literal text: */
+static ymo_status_t form_pct_flush(ymo_http_form_t* form)
+{
+    char lit[2] = { '%', form->pct_hi };
+    size_t n = form->pct;
+    form->pct = 0;
+    return form_append(form, lit, n);
+}
+
+
+void ymo_http_form_init(
+        ymo_http_form_t* form,
+        char* buf,
+        size_t buf_len,
+        ymo_http_form_cb_t cb,
+        void* data)
+{
+    form->cb = cb;
+    form->data = data;
+    form->buf = buf;
+    form->buf_len = buf_len;
+    form->len = 0;
+    form->key_len = FORM_NO_KEY;
+    form->pct = 0;
+    form->pct_hi = '\0';
+}
+
+
+ymo_status_t ymo_http_form_feed(
+        ymo_http_form_t* form, const char* data, size_t len)
+{
+    const char* p = data;
+    const char* end = data + len;
+    ymo_status_t status = YMO_OKAY;
+
+    while( p < end && status == YMO_OKAY )
+    {
+        /* Escapes may be split across chunks: */
+        if( form->pct ) {
+            int v = HEX_VAL(*p);
+            if( v < 0 ) {
+                /* Not an escape; the current byte is handled below: */
+                status = form_pct_flush(form);
+                continue;
+            }
+
+            if( form->pct == 1 ) {
+                form->pct_hi = *p++;
+                form->pct = 2;
+            } else {
+                char c = (char)((HEX_VAL(form->pct_hi) << 4) | v);
+                form->pct = 0;
+                ++p;
+                status = form_append(form, &c, 1);
+            }
+            continue;
+        }
+
+        size_t run = query_run(p, end - p);
+        if( run ) {
+            status = form_append(form, p, run);
+            p += run;
+            continue;
+        }
+
+        char c = *p++;
+        switch( c ) {
+            case '&':
+                status = form_emit(form);
+                break;
+            case '=':
+                if( form->key_len == FORM_NO_KEY ) {
+                    if( form->len + 2 > form->buf_len ) {
+                        status = EFBIG;
+                        break;
+                    }
+                    form->key_len = form->len;
+                    form->buf[form->len++] = '\0';
+                } else {
+                    status = form_append(form, &c, 1);
+                }
+                break;
+            case '+':
+                status = form_append(form, " ", 1);
+                break;
+            case '%':
+                form->pct = 1;
+                break;
+            default:
+                status = form_append(form, &c, 1);
+                break;
+        }
+    }
+    return status;
+}
+
+
+ymo_status_t ymo_http_form_finish(ymo_http_form_t* form)
+{
+    ymo_status_t status = YMO_OKAY;
+    if( form->pct ) {
+        status = form_pct_flush(form);
+    }
+
+    if( status == YMO_OKAY ) {
+        status = form_emit(form);
+    }
+
+    form->len = 0;
+    form->key_len = FORM_NO_KEY;
+    form->pct = 0;
+    return status;
+}
@@ -20,6 +20,7 @@
 
 #include "yimmo_config.h"
 
+#include <errno.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -31,136 +32,166 @@
 #include "core/ymo_bucket.h"
 #include "core/ymo_server.h"
 #include "core/ymo_conn.h"
+#include "ymo_http_exchange.h"
 #include "ymo_http_response.h"
+#include "ymo_http_session.h"
+#include "ymo_http_sse.h"
+#include "ymo_http_proxy.h"
+
+/* Response head buffers are allocated in multiples of this: */
+#define YMO_HTTP_HEAD_BUF_ALIGN 256
+
+/*---------------------------------------------------------------*
+ *  Status lines:
+ *---------------------------------------------------------------*/
+#define YMO_HTTP_STATUS_MIN 100
+#define YMO_HTTP_STATUS_MAX 599
+
+typedef struct ymo_http_status_line {
+    const char* line;
+    size_t      len;
+} ymo_http_status_line_t;
+
+#define YMO_STATUS_LINE(status, status_str) \
+    [(status) - YMO_HTTP_STATUS_MIN] = { \
+        "HTTP/1.1 " status_str "\r\n", \
+        sizeof("HTTP/1.1 " status_str "\r\n")-1 \
+    }
 
-static const char* get_http_reason(ymo_http_status_t status)
+/* Complete, precomputed status lines for every status code we know about,
+ * indexed by status - YMO_HTTP_STATUS_MIN:
+ */
+static const ymo_http_status_line_t status_lines[
+        YMO_HTTP_STATUS_MAX - YMO_HTTP_STATUS_MIN + 1] = {
+    YMO_STATUS_LINE(YMO_HTTP_CONTINUE, "100 Continue"),
+    YMO_STATUS_LINE(YMO_HTTP_SWITCHING_PROTOCOLS, "101 Switching Protocols"),
+    YMO_STATUS_LINE(YMO_HTTP_OK, "200 OK"),
+    YMO_STATUS_LINE(YMO_HTTP_CREATED, "201 Created"),
+    YMO_STATUS_LINE(YMO_HTTP_ACCEPTED, "202 Accepted"),
+    YMO_STATUS_LINE(YMO_HTTP_NON_AUTHORITATIVE_INFORMATION, "203 Non-Authoritative Information"),
+    YMO_STATUS_LINE(YMO_HTTP_NO_CONTENT, "204 No Content"),
+    YMO_STATUS_LINE(YMO_HTTP_RESET_CONTENT, "205 Reset Content"),
+    YMO_STATUS_LINE(YMO_HTTP_PARTIAL_CONTENT, "206 Partial Content"),
+    YMO_STATUS_LINE(YMO_HTTP_MULTIPLE_CHOICES, "300 Multiple Choices"),
+    YMO_STATUS_LINE(YMO_HTTP_MOVED_PERMANENTLY, "301 Moved Permanently"),
+    YMO_STATUS_LINE(YMO_HTTP_FOUND, "302 Found"),
+    YMO_STATUS_LINE(YMO_HTTP_SEE_OTHER, "303 See Other"),
+    YMO_STATUS_LINE(YMO_HTTP_NOT_MODIFIED, "304 Not Modified"),
+    YMO_STATUS_LINE(YMO_HTTP_USE_PROXY, "305 Use Proxy"),
+    YMO_STATUS_LINE(YMO_HTTP_TEMPORARY_REDIRECT, "307 Temporary Redirect"),
+    YMO_STATUS_LINE(YMO_HTTP_BAD_REQUEST, "400 Bad Request"),
+    YMO_STATUS_LINE(YMO_HTTP_UNAUTHORIZED, "401 Unauthorized"),
+    YMO_STATUS_LINE(YMO_HTTP_PAYMENT_REQUIRED, "402 Payment Required"),
+    YMO_STATUS_LINE(YMO_HTTP_FORBIDDEN, "403 Forbidden"),
+    YMO_STATUS_LINE(YMO_HTTP_NOT_FOUND, "404 Not Found"),
+    YMO_STATUS_LINE(YMO_HTTP_METHOD_NOT_ALLOWED, "405 Method Not Allowed"),
+    YMO_STATUS_LINE(YMO_HTTP_NOT_ACCEPTABLE, "406 Not Acceptable"),
+    YMO_STATUS_LINE(YMO_HTTP_PROXY_AUTHENTICATION_REQUIRED, "407 Proxy Authentication Required"),
+    YMO_STATUS_LINE(YMO_HTTP_REQUEST_TIMEOUT, "408 Request Timeout"),
+    YMO_STATUS_LINE(YMO_HTTP_CONFLICT, "409 Conflict"),
+    YMO_STATUS_LINE(YMO_HTTP_GONE, "410 Gone"),
+    YMO_STATUS_LINE(YMO_HTTP_LENGTH_REQUIRED, "411 Length Required"),
+    YMO_STATUS_LINE(YMO_HTTP_PRECONDITION_FAILED, "412 Precondition Failed"),
+    YMO_STATUS_LINE(YMO_HTTP_REQUEST_ENTITY_TOO_LARGE, "413 Request Entity Too Large"),
+    YMO_STATUS_LINE(YMO_HTTP_REQUEST_URI_TOO_LONG, "414 Request URI Too long"),
+    YMO_STATUS_LINE(YMO_HTTP_UNSUPPORTED_MEDIA_TYPE, "415 Unsupported Media Type"),
+    YMO_STATUS_LINE(YMO_HTTP_REQUESTED_RANGE_NOT_SATISFIABLE, "416 Requested Range Not Satisfiable"),
+    YMO_STATUS_LINE(YMO_HTTP_EXPECTATION_FAILED, "417 Expectation Failed"),
+    YMO_STATUS_LINE(YMO_HTTP_INTERNAL_SERVER_ERROR, "500 Internal Server Error"),
+    YMO_STATUS_LINE(YMO_HTTP_NOT_IMPLEMENTED, "501 Not Implemented"),
+    YMO_STATUS_LINE(YMO_HTTP_BAD_GATEWAY, "502 Bad Gateway"),
+    YMO_STATUS_LINE(YMO_HTTP_SERVICE_UNAVAILABLE, "503 Service Unavailable"),
+    YMO_STATUS_LINE(YMO_HTTP_GATEWAY_TIMEOUT, "504 Gateway Timeout"),
+    YMO_STATUS_LINE(YMO_HTTP_HTTP_VERSION_NOT_SUPPORTED, "505 HTTP Version Not Supported"),
+};
+
+
+static const ymo_http_status_line_t* get_status_line(ymo_http_status_t status)
 {
-    const char* reason = NULL;
-    switch( status ) {
-        case YMO_HTTP_CONTINUE:
-            reason = "Continue";
-            break;
-        case YMO_HTTP_SWITCHING_PROTOCOLS:
-            reason = "Switching Protocols";
-            break;
-        case YMO_HTTP_OK:
-            reason = "OK";
-            break;
-        case YMO_HTTP_CREATED:
-            reason = "Created";
-            break;
-        case YMO_HTTP_ACCEPTED:
-            reason = "Accepted";
-            break;
-        case YMO_HTTP_NON_AUTHORITATIVE_INFORMATION:
-            reason = "Non-Authoritative Information";
-            break;
-        case YMO_HTTP_NO_CONTENT:
-            reason = "No Content";
-            break;
-        case YMO_HTTP_RESET_CONTENT:
-            reason = "Reset Content";
-            break;
-        case YMO_HTTP_PARTIAL_CONTENT:
-            reason = "Partial Content";
-            break;
-        case YMO_HTTP_MULTIPLE_CHOICES:
-            reason = "Multiple Choices";
-            break;
-        case YMO_HTTP_MOVED_PERMANENTLY:
-            reason = "Moved Permanently";
-            break;
-        case YMO_HTTP_FOUND:
-            reason = "Found";
-            break;
-        case YMO_HTTP_SEE_OTHER:
-            reason = "See Other";
-            break;
-        case YMO_HTTP_NOT_MODIFIED:
-            reason = "Not Modified";
-            break;
-        case YMO_HTTP_USE_PROXY:
-            reason = "Use Proxy";
-            break;
-        case YMO_HTTP_TEMPORARY_REDIRECT:
-            reason = "Temporary Redirect";
-            break;
-        case YMO_HTTP_BAD_REQUEST:
-            reason = "Bad Request";
-            break;
-        case YMO_HTTP_UNAUTHORIZED:
-            reason = "Unauthorized";
-            break;
-        case YMO_HTTP_PAYMENT_REQUIRED:
-            reason = "Payment Required";
-            break;
-        case YMO_HTTP_FORBIDDEN:
-            reason = "Forbidden";
-            break;
-        case YMO_HTTP_NOT_FOUND:
-            reason = "Not Found";
-            break;
-        case YMO_HTTP_METHOD_NOT_ALLOWED:
-            reason = "Method Not Allowed";
-            break;
-        case YMO_HTTP_NOT_ACCEPTABLE:
-            reason = "Not Acceptable";
-            break;
-        case YMO_HTTP_PROXY_AUTHENTICATION_REQUIRED:
-            reason = "Proxy Authentication Required";
-            break;
-        case YMO_HTTP_REQUEST_TIMEOUT:
-            reason = "Request Timeout";
-            break;
-        case YMO_HTTP_CONFLICT:
-            reason = "Conflict";
-            break;
-        case YMO_HTTP_GONE:
-            reason = "Gone";
-            break;
-        case YMO_HTTP_LENGTH_REQUIRED:
-            reason = "Length Required";
-            break;
-        case YMO_HTTP_PRECONDITION_FAILED:
-            reason = "Precondition Failed";
-            break;
-        case YMO_HTTP_REQUEST_ENTITY_TOO_LARGE:
-            reason = "Request Entity Too Large";
-            break;
-        case YMO_HTTP_REQUEST_URI_TOO_LONG:
-            reason = "Request URI Too long";
-            break;
-        case YMO_HTTP_UNSUPPORTED_MEDIA_TYPE:
-            reason = "Unsupported Media Type";
-            break;
-        case YMO_HTTP_REQUESTED_RANGE_NOT_SATISFIABLE:
-            reason = "Requested Range Not Satisfiable";
-            break;
-        case YMO_HTTP_EXPECTATION_FAILED:
-            reason = "Expectation Failed";
-            break;
-        case YMO_HTTP_INTERNAL_SERVER_ERROR:
-            reason = "Internal Server Error";
-            break;
-        case YMO_HTTP_NOT_IMPLEMENTED:
-            reason = "Not Implemented";
-            break;
-        case YMO_HTTP_BAD_GATEWAY:
-            reason = "Bad Gateway";
-            break;
-        case YMO_HTTP_SERVICE_UNAVAILABLE:
-            reason = "Service Unavailable";
-            break;
-        case YMO_HTTP_GATEWAY_TIMEOUT:
-            reason = "Gateway Timeout";
-            break;
-        case YMO_HTTP_HTTP_VERSION_NOT_SUPPORTED:
-            reason = "HTTP Version Not Supported";
-            break;
-        default:
-            break;
+    if( status >= YMO_HTTP_STATUS_MIN && status <= YMO_HTTP_STATUS_MAX ) {
+        const ymo_http_status_line_t* status_line =
+            &status_lines[status - YMO_HTTP_STATUS_MIN];
+        if( status_line->line ) {
+            return status_line;
+        }
     }
-    return reason;
+    return NULL;
+}
+
+
+/*---------------------------------------------------------------*
+ *  Automatic headers:
+ *---------------------------------------------------------------*/
+static const char* const wkday_names[] = {
+    "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat",
+};
+
+static const char* const month_names[] = {
+    "Jan", "Feb", "Mar", "Apr", "May", "Jun",
+    "Jul", "Aug", "Sep", "Oct", "Nov", "Dec",
+};
+
+static inline char* put_2digit(char* p, int n)
+{
+    *p++ = (char)('0' + n / 10);
+    *p++ = (char)('0' + n % 10);
+    return p;
+}
+
+
+size_t ymo_http_date_format(char* dst, time_t t)
+{
+    struct tm tm;
+    char* p = dst;
+
+    if( !gmtime_r(&t, &tm) || tm.tm_year + 1900 > 9999 ) {
+        *dst = '\0';
+        return 0;
+    }
+
+    /* "Sun, 06 Nov 1994 08:49:37 GMT" (strftime would honor the current
+     * locale for the day and month names):
+     */
+    memcpy(p, wkday_names[tm.tm_wday], 3);
+    p += 3;
+    *p++ = ',';
+    *p++ = ' ';
+    p = put_2digit(p, tm.tm_mday);
+    *p++ = ' ';
+    memcpy(p, month_names[tm.tm_mon], 3);
+    p += 3;
+    *p++ = ' ';
+    p = put_2digit(p, (tm.tm_year + 1900) / 100);
+    p = put_2digit(p, (tm.tm_year + 1900) % 100);
+    *p++ = ' ';
+    p = put_2digit(p, tm.tm_hour);
+    *p++ = ':';
+    p = put_2digit(p, tm.tm_min);
+    *p++ = ':';
+    p = put_2digit(p, tm.tm_sec);
+    memcpy(p, " GMT", 4);
+    p += 4;
+    *p = '\0';
+    return (size_t)(p - dst);
+}
+
+
+void ymo_http_auto_hdrs_set_date(
+        ymo_http_auto_hdrs_t* auto_hdrs, time_t now)
+{
+    char* p = auto_hdrs->date;
+
+    /* "Date: Sun, 06 Nov 1994 08:49:37 GMT\r\n": */
+    memcpy(p, "Date: ", 6);
+    p += 6;
+    size_t len = ymo_http_date_format(p, now);
+    if( !len ) {
+        auto_hdrs->date_len = 0;
+        return;
+    }
+    p += len;
+    memcpy(p, "\r\n", 3);
+    auto_hdrs->date_len = (size_t)(p + 2 - auto_hdrs->date);
 }
 
 
@@ -169,15 +200,33 @@ ymo_http_response_t* ymo_http_response_create(ymo_http_session_t* session)
     ymo_http_response_t* response = NULL;
     response = YMO_NEW0(ymo_http_response_t);
     if( response ) {
-        response->session = session;
-        response->status = 200;
-
-        ymo_http_hdr_table_init(&response->headers);
+        ymo_http_response_init(response, session);
     }
     return response;
 }
 
 
+void ymo_http_response_init(
+        ymo_http_response_t* response, ymo_http_session_t* session)
+{
+    char* head_buf = response->head_buf;
+    size_t head_cap = response->head_cap;
+    int embedded = response->embedded;
+
+    memset(response, 0, sizeof(ymo_http_response_t));
+    response->session = session;
+    response->status = 200;
+    response->compress_level = YMO_HTTP_COMPRESS_DEFAULT;
+    response->high_water = YMO_HTTP_HIGH_WATER_DEFAULT;
+    response->low_water = YMO_HTTP_LOW_WATER_DEFAULT;
+    response->head_buf = head_buf;
+    response->head_cap = head_cap;
+    response->embedded = embedded;
+
+    ymo_http_hdr_table_init(&response->headers);
+}
+
+
 ymo_http_hdr_table_t* ymo_http_response_get_headers(
         ymo_http_response_t* response)
 {
@@ -211,7 +260,15 @@ ymo_status_t ymo_http_response_insert_header(
 void ymo_http_response_body_append(
         ymo_http_response_t* response, ymo_bucket_t* body_data)
 {
-    if( !response->body_head ) {
+    response->body_queued += ymo_bucket_len_all(body_data);
+    if( !ymo_http_response_writable(response) ) {
+        response->drain_armed = 1;
+    }
+
+    if( response->compressor ) {
+        /* Compressed on the way out (see ymo_http_compress_flush): */
+        ymo_http_compress_queue(response->compressor, body_data);
+    } else if( !response->body_head ) {
         response->body_head = response->body_tail = body_data;
     } else {
         response->body_tail = ymo_bucket_append(response->body_tail, body_data);
@@ -229,13 +286,28 @@ void ymo_http_response_body_append(
 }
 
 
+void ymo_http_response_set_compression(
+        ymo_http_response_t* response, int level)
+{
+    response->compress_level = level;
+}
+
+
 void ymo_http_response_set_status(
         ymo_http_response_t* response, ymo_http_status_t status)
 {
+    const ymo_http_status_line_t* status_line = get_status_line(status);
+
     response->status = status;
-    response->status_len = snprintf(
-            response->status_str, STATUS_STR_MAX_LEN, "%i %s",
-            response->status, get_http_reason(response->status));
+    if( status_line ) {
+        response->status_line = status_line->line;
+        response->status_line_len = status_line->len;
+    } else {
+        /* Unknown status: the reason phrase is optional (RFC 9112 §4): */
+        response->status_line = NULL;
+        response->status_len = snprintf(
+                response->status_str, STATUS_STR_MAX_LEN, "%i ", status);
+    }
 }
 
 
@@ -244,6 +316,7 @@ void ymo_http_response_set_status(
 int ymo_http_response_set_status_str(
         ymo_http_response_t* response, const char* status_str)
 {
+    response->status_line = NULL;
     char* write_end = memccpy(
             response->status_str, status_str, '\0', STATUS_STR_MAX_LEN);
     response->status_len = (write_end - response->status_str)-1;
@@ -275,6 +348,28 @@ ymo_status_t ymo_http_response_issue(
 }
 
 
+void ymo_http_response_abort(
+        ymo_http_response_t* response, ymo_http_status_t status)
+{
+    ymo_bucket_free_all(response->body_head);
+    response->body_head = response->body_tail = NULL;
+    response->body_queued = 0;
+    ymo_http_compress_release(response->compressor);
+    response->compressor = NULL;
+
+    if( !(response->flags & YMO_HTTP_RESPONSE_STARTED) ) {
+        ymo_http_hdr_table_clear(&response->headers);
+        ymo_http_response_issue(response, status);
+        return;
+    }
+
+    /* No terminal chunk: the client sees the body end early: */
+    response->flags &= ~YMO_HTTP_RESPONSE_CHUNKED;
+    response->session->state = YMO_HTTP_SESSION_ERROR;
+    ymo_http_response_finish(response);
+}
+
+
 ymo_http_flags_t ymo_http_response_flags(const ymo_http_response_t* response)
 {
     return response->flags;
@@ -326,6 +421,358 @@ int ymo_http_response_finished(const ymo_http_response_t* response)
 }
 
 
+/*---------------------------------------------------------------*
+ *  Flow control:
+ *---------------------------------------------------------------*/
+void ymo_http_response_set_watermarks(
+        ymo_http_response_t* response, size_t high, size_t low)
+{
+    response->high_water = high;
+    response->low_water = YMO_MIN(low, high);
+}
+
+
+size_t ymo_http_response_queued(const ymo_http_response_t* response)
+{
+    /* Output from this (and earlier) responses on the session: */
+    size_t send_len = response->session ? response->session->send_len : 0;
+    return response->body_queued + send_len;
+}
+
+
+int ymo_http_response_writable(const ymo_http_response_t* response)
+{
+    /* Nothing goes out until finish() if the body can't be streamed (e.g.
+     * HTTP/1.0), so holding back would only stall the response:
+     */
+    if( !(response->flags & YMO_HTTP_FLAG_SUPPORTS_CHUNKED) ) {
+        return 1;
+    }
+    return ymo_http_response_queued(response) < response->high_water;
+}
+
+
+void ymo_http_response_on_drain(
+        ymo_http_response_t* response,
+        ymo_http_drain_cb_t drain_cb,
+        void* user_data)
+{
+    response->drain_cb = drain_cb;
+    response->drain_data = user_data;
+}
+
+
+int ymo_http_response_drained(const ymo_http_response_t* response)
+{
+    return response->drain_armed
+        && !(response->flags & YMO_HTTP_RESPONSE_COMPLETE)
+        && ymo_http_response_queued(response) <= response->low_water;
+}
+
+
+ymo_status_t ymo_http_response_drain_check(ymo_http_response_t* response)
+{
+    if( !ymo_http_response_drained(response) ) {
+        return YMO_OKAY;
+    }
+
+    response->drain_armed = 0;
+    if( !response->drain_cb ) {
+        return YMO_OKAY;
+    }
+    return response->drain_cb(
+            response->session, response, response->drain_data);
+}
+
+
+/*---------------------------------------------------------------*
+ *  Canned responses:
+ *---------------------------------------------------------------*/
+static const struct {
+    const char* hdr;
+    size_t      len;
+} canned_conn_hdrs[YMO_HTTP_CANNED_NO_VARIANTS] = {
+    [YMO_HTTP_CANNED_CONN_NONE] = { "", 0 },
+    [YMO_HTTP_CANNED_CONN_KEEPALIVE] = {
+        "Connection: Keep-alive\r\n",
+        sizeof("Connection: Keep-alive\r\n")-1
+    },
+    [YMO_HTTP_CANNED_CONN_CLOSE] = {
+        "Connection: close\r\n",
+        sizeof("Connection: close\r\n")-1
+    },
+};
+
+
+ymo_http_canned_t* ymo_http_canned_create(
+        ymo_http_status_t status,
+        ymo_http_hdr_table_t* headers,
+        const char* body,
+        size_t body_len)
+{
+    char status_buf[STATUS_STR_BUFF_SIZE + sizeof("HTTP/1.1 \r\n")];
+    char cl_buf[sizeof("Content-Length: \r\n") + 20];
+    const char* status_line;
+    size_t status_line_len;
+    const char* key;
+    size_t key_len;
+    const char* value;
+    ymo_http_hdr_ptr_t iter = NULL;
+    size_t hdrs_len = 0;
+    int has_date = 0;
+    int has_server = 0;
+
+    if( body_len && !body ) {
+        return YMO_ERROR_PTR(EINVAL);
+    }
+
+    const ymo_http_status_line_t* known = get_status_line(status);
+    if( known ) {
+        status_line = known->line;
+        status_line_len = known->len;
+    } else if( status >= YMO_HTTP_STATUS_MIN && status <= YMO_HTTP_STATUS_MAX ) {
+        status_line = status_buf;
+        status_line_len = snprintf(
+                status_buf, sizeof(status_buf), "HTTP/1.1 %i \r\n", status);
+    } else {
+        return YMO_ERROR_PTR(EINVAL);
+    }
+
+    /* Size the headers, rejecting any we'd generate ourselves: */
+    if( headers ) {
+        iter = ymo_http_hdr_table_next(headers, NULL, &key, &key_len, &value);
+    }
+    while( iter ) {
+        switch( ymo_http_hdr_id(key, key_len) ) {
+            case YMO_HTTP_HID_CONTENT_LENGTH:
+            case YMO_HTTP_HID_TRANSFER_ENCODING:
+            case YMO_HTTP_HID_CONNECTION:
+                return YMO_ERROR_PTR(EINVAL);
+            case YMO_HTTP_HID_DATE:
+                has_date = 1;
+                break;
+            case YMO_HTTP_HID_SERVER:
+                has_server = 1;
+                break;
+            default:
+                break;
+        }
+        hdrs_len += key_len + strlen(value) + 4; /* ": " and CRLF */
+        iter = ymo_http_hdr_table_next(headers, iter, &key, &key_len, &value);
+    }
+
+    /* 1xx, 204, and 304 responses have neither a body nor a length: */
+    size_t cl_len = 0;
+    if( status < 200
+            || status == YMO_HTTP_NO_CONTENT
+            || status == YMO_HTTP_NOT_MODIFIED ) {
+        body_len = 0;
+    } else {
+        cl_len = snprintf(
+                cl_buf, sizeof(cl_buf), "Content-Length: %zu\r\n", body_len);
+    }
+    size_t common_len = status_line_len + hdrs_len + cl_len;
+    size_t blob_len = 0;
+    for( int v = 0; v < YMO_HTTP_CANNED_NO_VARIANTS; v++ ) {
+        blob_len += common_len + canned_conn_hdrs[v].len + 2 + body_len;
+    }
+
+    ymo_http_canned_t* canned = YMO_NEW0(ymo_http_canned_t);
+    if( !canned ) {
+        return YMO_ERROR_PTR(ENOMEM);
+    }
+
+    canned->blob = YMO_ALLOC(blob_len);
+    if( !canned->blob ) {
+        YMO_DELETE(ymo_http_canned_t, canned);
+        return YMO_ERROR_PTR(ENOMEM);
+    }
+    canned->status = status;
+    canned->has_date = has_date;
+    canned->has_server = has_server;
+
+    /* Serialize each variant, back to back: */
+    char* insert = canned->blob;
+    for( int v = 0; v < YMO_HTTP_CANNED_NO_VARIANTS; v++ ) {
+        const char* start = insert;
+
+        memcpy(insert, status_line, status_line_len);
+        insert += status_line_len;
+
+        if( headers ) {
+            iter = ymo_http_hdr_table_next(
+                    headers, NULL, &key, &key_len, &value);
+        }
+        while( iter ) {
+            size_t value_len = strlen(value);
+            memcpy(insert, key, key_len);
+            insert += key_len;
+            *insert++ = ':';
+            *insert++ = ' ';
+            memcpy(insert, value, value_len);
+            insert += value_len;
+            *insert++ = '\r';
+            *insert++ = '\n';
+            iter = ymo_http_hdr_table_next(
+                    headers, iter, &key, &key_len, &value);
+        }
+
+        memcpy(insert, cl_buf, cl_len);
+        insert += cl_len;
+        memcpy(insert, canned_conn_hdrs[v].hdr, canned_conn_hdrs[v].len);
+        insert += canned_conn_hdrs[v].len;
+        canned->variant[v].head_len = (size_t)(insert - start);
+
+        *insert++ = '\r';
+        *insert++ = '\n';
+        if( body_len ) {
+            memcpy(insert, body, body_len);
+            insert += body_len;
+        }
+        canned->variant[v].data = start;
+        canned->variant[v].len = (size_t)(insert - start);
+    }
+    return canned;
+}
+
+
+void ymo_http_canned_free(ymo_http_canned_t* canned)
+{
+    if( canned ) {
+        YMO_FREE(canned->blob);
+    }
+    YMO_DELETE(ymo_http_canned_t, canned);
+    return;
+}
+
+
+ymo_status_t ymo_http_response_send_canned(
+        ymo_http_response_t* response, const ymo_http_canned_t* canned)
+{
+    if( !canned ) {
+        return EINVAL;
+    }
+
+    /* Anything the handler queued up is superseded: */
+    ymo_bucket_free_all(response->body_head);
+    response->body_head = response->body_tail = NULL;
+    response->body_queued = 0;
+
+    response->canned = canned;
+    response->status = canned->status;
+    ymo_http_response_finish(response);
+    return YMO_OKAY;
+}
+
+
+/* Same Connection header semantics as ymo_http_session_init_response: */
+static inline int canned_variant(ymo_http_flags_t flags)
+{
+    if( flags & YMO_HTTP_FLAG_REQUEST_KEEPALIVE ) {
+        return (flags & YMO_HTTP_FLAG_VERSION_1_1)
+            ? YMO_HTTP_CANNED_CONN_NONE : YMO_HTTP_CANNED_CONN_KEEPALIVE;
+    }
+    return (flags & YMO_HTTP_FLAG_VERSION_1_1)
+        ? YMO_HTTP_CANNED_CONN_CLOSE : YMO_HTTP_CANNED_CONN_NONE;
+}
+
+
+/* The serialized head goes in a buffer owned by the response, which is
+ * reused if it's big enough. An embedded response keeps it across requests:
+ * it's only overwritten by the next response using the same exchange, which
+ * can't be started until this one has been sent. A standalone response
+ * hands it over to the bucket instead (see head_bucket).
+ */
+static char* head_buf_reserve(ymo_http_response_t* response, size_t len)
+{
+    if( len > response->head_cap ) {
+        size_t cap = (len + YMO_HTTP_HEAD_BUF_ALIGN - 1)
+            & ~((size_t)YMO_HTTP_HEAD_BUF_ALIGN - 1);
+        YMO_FREE(response->head_buf);
+        response->head_cap = 0;
+        response->head_buf = YMO_ALLOC(cap);
+        if( response->head_buf ) {
+            response->head_cap = cap;
+        }
+    }
+    return response->head_buf;
+}
+
+
+/* Wrap len bytes of the head buffer in a bucket: */
+static ymo_bucket_t* head_bucket(ymo_http_response_t* response, size_t len)
+{
+    if( response->embedded ) {
+        return YMO_BUCKET_FROM_REF(response->head_buf, len);
+    }
+
+    ymo_bucket_t* bucket = ymo_bucket_create(NULL, NULL,
+            response->head_buf, response->head_cap, response->head_buf, len);
+    if( bucket ) {
+        response->head_buf = NULL;
+        response->head_cap = 0;
+    }
+    return bucket;
+}
+
+
+static ymo_bucket_t* canned_start(
+        ymo_conn_t* conn,
+        ymo_http_response_t* response,
+        const ymo_http_auto_hdrs_t* auto_hdrs)
+{
+    const ymo_http_canned_t* canned = response->canned;
+    int v = canned_variant(response->flags);
+    const char* data = canned->variant[v].data;
+    size_t head_len = canned->variant[v].head_len;
+    size_t len = canned->variant[v].len;
+    size_t date_len = 0;
+    size_t server_len = 0;
+
+    /* HEAD: everything up to (and including) the final CRLF: */
+    if( response->flags & YMO_HTTP_RESPONSE_NO_BODY ) {
+        len = head_len + 2;
+    }
+
+    if( auto_hdrs && canned->status >= 200 ) {
+        date_len = canned->has_date ? 0 : auto_hdrs->date_len;
+        server_len = canned->has_server ? 0 : auto_hdrs->server_len;
+    }
+
+    /* Common case: the whole message, by reference. */
+    if( !date_len && !server_len ) {
+        ymo_bucket_t* bucket_out = YMO_BUCKET_FROM_REF(data, len);
+        return bucket_out ? bucket_out : YMO_ERROR_PTR(ENOMEM);
+    }
+
+    /* Otherwise, splice a copy of the server headers in between the head and
+     * the final CRLF (a copy, since the date may change before it's sent):
+     */
+    char* auto_buf = head_buf_reserve(response, date_len + server_len);
+    ymo_bucket_t* head = YMO_BUCKET_FROM_REF(data, head_len);
+    ymo_bucket_t* tail = YMO_BUCKET_FROM_REF(data + head_len, len - head_len);
+    ymo_bucket_t* mid = NULL;
+    if( auto_buf ) {
+        memcpy(auto_buf, auto_hdrs->date, date_len);
+        memcpy(auto_buf + date_len, auto_hdrs->server, server_len);
+        mid = head_bucket(response, date_len + server_len);
+    }
+
+    if( !head || !mid || !tail ) {
+        ymo_log_debug("Out of memory starting canned response (%p)",
+                (void*)conn);
+        ymo_bucket_free(head);
+        ymo_bucket_free(mid);
+        ymo_bucket_free(tail);
+        return YMO_ERROR_PTR(ENOMEM);
+    }
+
+    head->next = mid;
+    mid->next = tail;
+    return head;
+}
+
+
 static int should_buffer_body(ymo_http_response_t* response)
 {
     const char* app_hdr_cl = ymo_http_hdr_table_get_id(
@@ -386,10 +833,17 @@ static int should_buffer_body(ymo_http_response_t* response)
 
 
 ymo_bucket_t* ymo_http_response_start(
-        ymo_conn_t* conn, ymo_http_response_t* response)
+        ymo_conn_t* conn,
+        ymo_http_response_t* response,
+        const ymo_http_auto_hdrs_t* auto_hdrs)
 {
+    if( response->canned ) {
+        return canned_start(conn, response, auto_hdrs);
+    }
+
     /* If we don't have an HTTP status, bail with invalid. */
-    if( response->status_str[0] == '\0' || !response->status_len ) {
+    if( !response->status_line
+            && (response->status_str[0] == '\0' || !response->status_len) ) {
         return YMO_ERROR_PTR(EINVAL);
     }
 
@@ -402,88 +856,99 @@ ymo_bucket_t* ymo_http_response_start(
         return YMO_ERROR_PTR(YMO_OKAY); /* tx disabled */
     }
 
-    /* TODO: we can do better than this. */
-    ymo_bucket_t* bucket_out = NULL;
-    ssize_t remain = YMO_HTTP_SEND_BUF_SIZE;
-    char* response_buf = YMO_ALLOC(sizeof(char)*remain);
-    if( !response_buf ) {
-        ymo_log_debug("Unable to allocate response buffer of size %zu", remain);
-        goto serialize_nomem;
-    }
-    char* insert = response_buf;
-
-    /* Add status line: */
-    if( remain < (ssize_t)(response->status_len + 11) ) {
-        goto serialize_nomem;
-    }
-
-    /* Copy over the status string: */
-    memcpy(insert, "HTTP/1.1 ", 9);
-    insert += 9;
-    memcpy(insert, response->status_str, response->status_len);
-    insert += response->status_len;
-    (*insert++) = '\r';
-    (*insert++) = '\n';
-    remain -= (11 + response->status_len);
-
     const char* key;
     size_t key_len;
     const char* value;
-    ymo_http_hdr_ptr_t iter = ymo_http_hdr_table_next(
+    ymo_http_hdr_ptr_t iter;
+
+    /* Headers live in a flat array, so we can size the serialized head
+     * exactly in one pass and write it in a second — no fixed cap:
+     */
+    size_t head_len = response->status_line
+        ? response->status_line_len
+        : (sizeof("HTTP/1.1 ")-1) + response->status_len + 2;
+    iter = ymo_http_hdr_table_next(
             &response->headers, NULL, &key, &key_len, &value);
-    while( iter )
-    {
-        /* Header name and ':' */
-        if( (ssize_t)key_len < remain+2 ) {
-            memcpy(insert, key, key_len);
-            insert += key_len;
-            remain -= key_len;
+    while( iter ) {
+        head_len += key_len + strlen(value) + 4; /* ": " and CRLF */
+        iter = ymo_http_hdr_table_next(
+                &response->headers, iter, &key, &key_len, &value);
+    }
 
-            (*insert++) = ':';
-            (*insert++) = ' ';
-            remain -= 2;
-        } else {
-            goto serialize_nomem;
+    /* Server-generated headers (not for interim responses, or where the
+     * response has already set them):
+     */
+    size_t date_len = 0;
+    size_t server_len = 0;
+    if( auto_hdrs && response->status >= 200 ) {
+        if( auto_hdrs->date_len && !ymo_http_hdr_table_get_id(
+                    &response->headers, YMO_HTTP_HID_DATE) ) {
+            date_len = auto_hdrs->date_len;
         }
-
-        /* Header value */
-        char* terminal = memccpy(insert, value, '\0', remain);
-        if( !terminal ) {
-            goto serialize_nomem;
+        if( auto_hdrs->server_len && !ymo_http_hdr_table_get_id(
+                    &response->headers, YMO_HTTP_HID_SERVER) ) {
+            server_len = auto_hdrs->server_len;
         }
+    }
+    head_len += date_len + server_len;
+    head_len += 2; /* End of headers */
 
-        ssize_t copied = (--terminal - insert);
-        insert += copied;
-        remain -= copied;
+    char* response_buf = head_buf_reserve(response, head_len);
+    if( !response_buf ) {
+        ymo_log_debug("Unable to allocate response buffer of size %zu",
+                head_len);
+        goto serialize_nomem;
+    }
+    char* insert = response_buf;
 
-        /* CRLF */
-        if( remain >= 2 ) {
-            *insert++ = '\r';
-            *insert++ = '\n';
-            remain -= 2;
-        } else {
-            goto serialize_nomem;
-        }
+    /* Status line: */
+    if( response->status_line ) {
+        memcpy(insert, response->status_line, response->status_line_len);
+        insert += response->status_line_len;
+    } else {
+        memcpy(insert, "HTTP/1.1 ", sizeof("HTTP/1.1 ")-1);
+        insert += sizeof("HTTP/1.1 ")-1;
+        memcpy(insert, response->status_str, response->status_len);
+        insert += response->status_len;
+        *insert++ = '\r';
+        *insert++ = '\n';
+    }
 
+    /* Headers: */
+    iter = ymo_http_hdr_table_next(
+            &response->headers, NULL, &key, &key_len, &value);
+    while( iter ) {
+        size_t value_len = strlen(value);
+        memcpy(insert, key, key_len);
+        insert += key_len;
+        *insert++ = ':';
+        *insert++ = ' ';
+        memcpy(insert, value, value_len);
+        insert += value_len;
+        *insert++ = '\r';
+        *insert++ = '\n';
         iter = ymo_http_hdr_table_next(
                 &response->headers, iter, &key, &key_len, &value);
     }
 
-    /* End of headers */
-    if( remain < 2 ) {
-        goto serialize_nomem;
+    if( date_len ) {
+        memcpy(insert, auto_hdrs->date, date_len);
+        insert += date_len;
+    }
+    if( server_len ) {
+        memcpy(insert, auto_hdrs->server, server_len);
+        insert += server_len;
     }
 
+    /* End of headers */
     *insert++ = '\r';
     *insert++ = '\n';
-    remain -= 2;
 
     /* Attach the serialized HTTP exchange response and headers to the outgoing
      * bucket list:
      */
-    bucket_out = ymo_bucket_create(NULL, NULL,
-            response_buf, YMO_HTTP_SEND_BUF_SIZE,
-            response_buf, insert-response_buf);
+    ymo_bucket_t* bucket_out = head_bucket(
+            response, (size_t)(insert - response_buf));
     if( bucket_out ) {
         return bucket_out;
     }
@@ -492,68 +957,140 @@ serialize_nomem:
     ymo_log_debug(
             "Out of memory serializing headers (%p)",
             (void*)conn);
-    if( response_buf ) {
-        YMO_FREE(response_buf);
-    }
     return YMO_ERROR_PTR(ENOMEM);
 }
 
 
+/* Format a chunk-size line ("<hex>\r\n") into buf; returns its length: */
+static size_t chunk_size_line(char* buf, size_t chunk_len)
+{
+    static const char* hex = "0123456789abcdef";
+    char* p = buf + YMO_HTTP_CHUNK_HDR_MAX;
+
+    *--p = '\n';
+    *--p = '\r';
+    do {
+        *--p = hex[chunk_len & 0xF];
+        chunk_len >>= 4;
+    } while( chunk_len );
+
+    size_t len = (size_t)(buf + YMO_HTTP_CHUNK_HDR_MAX - p);
+    memmove(buf, p, len);
+    return len;
+}
+
+
 ymo_bucket_t* ymo_http_response_body_get(
         ymo_conn_t* conn, ymo_http_response_t* response)
 {
-    static char chunk_hdr_buf[8];
-    static const char* chunk_term = "\r\n";
+    /* Chunk terminators; the last one also closes the body: */
+    static const char* chunk_crlf = "\r\n";
+    static const char* chunk_crlf_last = "\r\n0\r\n\r\n";
     ymo_bucket_t* bucket_out = NULL;
 
-    /* TODO: memory allocation/checking! */
-    /* If the response isn't done, we're using transfer encoding chunked: */
-    if( response->body_head ) {
-        /* Move the body onto the outgoing bufer and set pointers to NULL. */
-        int no_chars;
-        if( response->flags & YMO_HTTP_RESPONSE_CHUNKED ) {
-            ymo_log_trace("Chunked response for %p",
-                    (void*)response);
-            ymo_bucket_t* current = response->body_head;
-            while( current ) {
-                ymo_bucket_t* body_data = current;
-                current = current->next;
-                no_chars = snprintf(
-                        chunk_hdr_buf, 7, "%zx\r\n", body_data->len);
-                ymo_bucket_t* chunk_hdr = YMO_BUCKET_FROM_CPY(
-                        chunk_hdr_buf, no_chars);
-                chunk_hdr->next = body_data;
-                body_data->next = YMO_BUCKET_FROM_CPY(
-                        chunk_term, 2);
-                if( bucket_out ) {
-                    ymo_bucket_append(bucket_out, chunk_hdr);
-                } else {
-                    bucket_out = chunk_hdr;
-                }
-            }
-        } else {
-            ymo_log_trace("Unchunked response for %p",
-                    (void*)response);
-            bucket_out = response->body_head;
+    if( !response->body_head ) {
+        return NULL;
+    }
+
+    /* HEAD: the body only ever counts toward the Content-Length: */
+    if( response->flags & YMO_HTTP_RESPONSE_NO_BODY ) {
+        ymo_bucket_free_all(response->body_head);
+        response->body_head = response->body_tail = NULL;
+        response->body_queued = 0;
+        return NULL;
+    }
+
+    if( !(response->flags & YMO_HTTP_RESPONSE_CHUNKED) ) {
+        ymo_log_trace("Unchunked response for %p", (void*)response);
+        bucket_out = response->body_head;
+        response->body_head = response->body_tail = NULL;
+        response->body_queued = 0;
+        return bucket_out;
+    }
+
+    /* Everything queued since the last call goes out as a single chunk,
+     * framed by one header and one trailing CRLF bucket (rather than
+     * framing each bucket on its own):
+     */
+    ymo_log_trace("Chunked response for %p", (void*)response);
+    size_t chunk_len = 0;
+    ymo_bucket_t* tail = response->body_head;
+    for( ;; ) {
+        chunk_len += tail->len;
+        if( !tail->next ) {
+            break;
         }
+        tail = tail->next;
+    }
+
+    if( !chunk_len ) {
+        /* A zero-length chunk would end the body: */
+        ymo_bucket_free_all(response->body_head);
         response->body_head = response->body_tail = NULL;
+        response->body_queued = 0;
+        return NULL;
     }
 
-    return bucket_out;
+    char hdr[YMO_HTTP_CHUNK_HDR_MAX];
+    size_t hdr_len = chunk_size_line(hdr, chunk_len);
+    ymo_bucket_t* chunk_hdr = YMO_BUCKET_FROM_CPY(hdr, hdr_len);
+    if( !chunk_hdr ) {
+        return YMO_ERROR_PTR(ENOMEM);
+    }
+
+    int last = !!(response->flags & YMO_HTTP_RESPONSE_COMPLETE);
+    ymo_bucket_t* chunk_end = last
+        ? YMO_BUCKET_FROM_REF(chunk_crlf_last, 7)
+        : YMO_BUCKET_FROM_REF(chunk_crlf, 2);
+    if( !chunk_end ) {
+        ymo_bucket_free(chunk_hdr);
+        return YMO_ERROR_PTR(ENOMEM);
+    }
+
+    chunk_hdr->next = response->body_head;
+    tail->next = chunk_end;
+    response->body_head = response->body_tail = NULL;
+    response->body_queued = 0;
+    if( last ) {
+        response->flags |= YMO_HTTP_RESPONSE_CHUNK_TERM;
+    }
+    return chunk_hdr;
+}
+
+
+void ymo_http_response_clear(ymo_http_response_t* response)
+{
+    ymo_http_hdr_table_clear(&response->headers);
+    ymo_http_compress_release(response->compressor);
+    response->compressor = NULL;
+    ymo_http_cache_release(response);
+    ymo_http_sse_release(response);
+    ymo_http_proxy_release(response);
+    return;
 }
 
 
 void ymo_http_response_free(ymo_http_response_t* response)
 {
-    if( response ) {
-        ymo_http_hdr_table_clear(&response->headers);
+    if( !response ) {
+        return;
+    }
 
-        /* TODO: doc this + handler EAGAIN behavior! */
-        if( response->exchange ) {
-            ymo_http_exchange_free(response->exchange);
-        }
+    /* The response owns the exchange once it's been handed to the
+     * session (see ymo_http_handler), even if that's where it lives:
+     */
+    ymo_http_exchange_t* exchange = response->exchange;
+    response->exchange = NULL;
+    ymo_http_response_clear(response);
+
+    if( !response->embedded ) {
+        YMO_FREE(response->head_buf);
+        YMO_DELETE(ymo_http_response_t, response);
+    }
+
+    if( exchange ) {
+        ymo_http_exchange_free(exchange);
     }
-    YMO_DELETE(ymo_http_response_t, response);
     return;
 }
 
@@ -26,17 +26,29 @@
 #define YMO_HTTP_RESPONSE_H
 #include "yimmo_config.h"
 
+#include <time.h>
+
 #include "yimmo.h"
 #include "core/ymo_bucket.h"
 #include "ymo_http_session.h"
 #include "core/ymo_conn.h"
 #include "ymo_http.h"
-#include "ymo_http_exchange.h"
 #include "ymo_http_hdr_table.h"
+#include "ymo_http_compress.h"
+#include "ymo_http_cache.h"
 
 #define STATUS_STR_BUFF_SIZE 32
 #define STATUS_STR_MAX_LEN   (STATUS_STR_BUFF_SIZE-1)
 
+/** Length of ``"Sun, 06 Nov 1994 08:49:37 GMT"``. */
+#define YMO_HTTP_DATE_LEN 29
+
+/** Length of ``"Date: Sun, 06 Nov 1994 08:49:37 GMT\r\n"``. */
+#define YMO_HTTP_DATE_HDR_LEN 37
+
+/** Longest chunk-size line: hex digits for a ``size_t``, plus CRLF. */
+#define YMO_HTTP_CHUNK_HDR_MAX (2 * sizeof(size_t) + 2)
+
 /** Response
  * ==========
  *
@@ -59,38 +71,172 @@ struct ymo_http_response {
     ymo_http_hdr_table_t      headers;
     size_t                    content_len;
     char                      content_len_str[21];
+    const char*               status_line;     /* Precomputed, if known */
+    size_t                    status_line_len;
     size_t                    status_len;
     char                      status_str[STATUS_STR_BUFF_SIZE];
     ymo_bucket_t*             body_head;
     ymo_bucket_t*             body_tail;
     ymo_proto_t*              proto_new;
+    const ymo_http_canned_t*  canned;          /* Pre-serialized, if set */
+    ymo_http_compressor_t*    compressor;      /* Active body compressor */
+    int                       compress_level;  /* Level override, or default */
+    uint8_t                   compress_coding; /* Negotiated content-coding */
+    uint8_t                   compress_pending;/* Not yet evaluated */
+    ymo_http_cache_entry_t*   cache_entry;     /* Entry filled/waited on */
+    ymo_http_cache_obj_t*     cache_obj;       /* Cached object being sent */
+    ymo_http_request_t*       cache_request;   /* Request, while waiting */
+    struct ymo_http_response* cache_next;      /* Next waiter */
+    struct ymo_http_sse_sub*  sse_sub;         /* SSE subscription */
+    struct ymo_http_proxy_conn* proxy_conn;    /* Upstream, while relaying */
+    struct ymo_http_proxy_buf*  proxy_head;    /* Upstream head (headers) */
     ymo_http_status_t         status;
     ymo_http_flags_t          flags;
+    size_t                    body_queued;     /* Appended, not yet sent */
+    size_t                    high_water;      /* Writable below this */
+    size_t                    low_water;       /* Drain at or below this */
+    ymo_http_drain_cb_t       drain_cb;
+    void*                     drain_data;
+    int                       drain_armed;     /* High water reached */
+    char*                     head_buf;        /* Serialized head (kept) */
+    size_t                    head_cap;
+    int                       embedded;        /* Part of an exchange */
+};
 
+/** Server-generated headers, appended to each response head by
+ * :c:func:`ymo_http_response_start`, unless the response has set them
+ * itself.
+ */
+typedef struct ymo_http_auto_hdrs {
+    char         date[YMO_HTTP_DATE_HDR_LEN+1]; /* Serialized "Date" header */
+    size_t       date_len;                      /* 0, if disabled */
+    const char*  server;                        /* Serialized "Server" header */
+    size_t       server_len;                    /* 0, if disabled */
+} ymo_http_auto_hdrs_t;
+
+/** Canned response ``Connection`` header variants: */
+#define YMO_HTTP_CANNED_CONN_NONE      0
+#define YMO_HTTP_CANNED_CONN_KEEPALIVE 1
+#define YMO_HTTP_CANNED_CONN_CLOSE     2
+#define YMO_HTTP_CANNED_NO_VARIANTS    3
+
+/** Pre-serialized response. Each variant is a complete message (head and
+ * body), differing only in the ``Connection`` header. All of them live in
+ * the one ``blob`` allocation.
+ */
+struct ymo_http_canned {
+    ymo_http_status_t  status;
+    int                has_date;   /* Headers include Date */
+    int                has_server; /* Headers include Server */
+    struct {
+        const char*    data;       /* Complete message */
+        size_t         len;
+        size_t         head_len;   /* Up to (not including) the final CRLF */
+    } variant[YMO_HTTP_CANNED_NO_VARIANTS];
+    char*              blob;
 };
 
 /**---------------------------------------------------------------
  * Functions
  *---------------------------------------------------------------*/
 
+/** Format ``t`` as an HTTP-date (IMF-fixdate; independent of the current
+ * locale), e.g. ``Sun, 06 Nov 1994 08:49:37 GMT``.
+ *
+ * :param dst: destination buffer (at least ``YMO_HTTP_DATE_LEN+1`` bytes)
+ * :param t: time, in seconds since the epoch
+ * :returns: the formatted length (``YMO_HTTP_DATE_LEN``); 0 on failure
+ */
+size_t ymo_http_date_format(char* dst, time_t t);
+
+/** Format the serialized ``Date`` header for the given time (IMF-fixdate;
+ * independent of the current locale).
+ *
+ * :param auto_hdrs: auto header block to update
+ * :param now: current time, in seconds since the epoch
+ */
+void ymo_http_auto_hdrs_set_date(
+        ymo_http_auto_hdrs_t* auto_hdrs, time_t now);
+
 /** Create a new http response object.
  *
  * :returns: pointer to new instance on success; NULL on failure
  */
 ymo_http_response_t* ymo_http_response_create(ymo_http_session_t* session);
 
+/** Prepare the response embedded in an exchange for a new request.
+ *
+ * The head buffer from any previous use is kept for reuse.
+ *
+ * :param response: response storage (cleared, or zero-filled)
+ * :param session: session the response belongs to
+ */
+void ymo_http_response_init(
+        ymo_http_response_t* response, ymo_http_session_t* session);
+
+/** Release whatever a response holds, short of its storage and head
+ * buffer (i.e. headers, compressor, and cache references).
+ *
+ * :param response: response to clear
+ */
+void ymo_http_response_clear(ymo_http_response_t* response);
+
+/** Abandon a response which can't be completed (e.g. its data source
+ * failed partway through).
+ *
+ * If the response head hasn't been sent, the response is replaced by an
+ * error response with the given status. Otherwise, whatever body data is
+ * still queued is dropped and the response ends without a terminal chunk,
+ * and the connection is closed once what's been queued for it is out, so
+ * the client can tell the body was cut short.
+ *
+ * :param response: response to abort
+ * :param status: error status, if the head is still unsent
+ */
+void ymo_http_response_abort(
+        ymo_http_response_t* response, ymo_http_status_t status);
+
 /** Serialize an http response headers into a send-able string.
  *
+ * :param conn: connection the response is destined for (may be NULL)
+ * :param response: response to serialize
+ * :param auto_hdrs: server-generated headers to append, or NULL for none
  */
 ymo_bucket_t* ymo_http_response_start(
-        ymo_conn_t* conn, ymo_http_response_t* response);
+        ymo_conn_t* conn,
+        ymo_http_response_t* response,
+        const ymo_http_auto_hdrs_t* auto_hdrs);
 
-/** Retrieve whatever body data we have, adding chunk headers, if need be.
+/** Retrieve whatever body data we have, adding chunk framing, if need be.
+ *
+ * For chunked responses, all of the pending body buckets are sent as a
+ * single chunk. Once the response is complete, the terminal chunk is
+ * appended as well (and ``YMO_HTTP_RESPONSE_CHUNK_TERM`` set).
+ *
+ * :returns: a bucket chain, or NULL with errno set to ``ENOMEM`` on
+ *     allocation failure (or 0, if there's nothing to send).
  */
 ymo_bucket_t* ymo_http_response_body_get(
         ymo_conn_t* conn, ymo_http_response_t* response);
 
+/** :returns: true if the response's drain callback is due, i.e. it's been
+ * armed and queued output has since fallen to the low-water mark (see
+ * :c:type:`ymo_http_drain_cb_t`).
+ */
+int ymo_http_response_drained(const ymo_http_response_t* response);
+
+/** Invoke the response's drain callback, if it's due (see
+ * :c:func:`ymo_http_response_drained`).
+ *
+ * :param response: response to check
+ * :returns: ``YMO_OKAY``, or the callback's return value
+ */
+ymo_status_t ymo_http_response_drain_check(ymo_http_response_t* response);
+
 /** Free an http response object.
+ *
+ * A response embedded in an exchange is cleared, rather than freed, and the
+ * exchange it owns (if any) is handed to :c:func:`ymo_http_exchange_free`.
  *
  * :param response: HTTP response to free.
  */
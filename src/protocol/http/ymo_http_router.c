@@ -0,0 +1,746 @@
+/*=============================================================================
+ *
+ * Copyright (c) 2014 Andrew Canaday
+ *
+ * This file is part of libyimmo (sometimes referred to as "yimmo" or "ymo").
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *===========================================================================*/
+
+#include "yimmo_config.h"
+
+#include <errno.h>
+#include <stdalign.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "yimmo.h"
+#include "ymo_log.h"
+#include "ymo_alloc.h"
+#include "ymo_blalloc.h"
+#include "ymo_http_router.h"
+#include "ymo_http_session.h"
+
+/*---------------------------------------------------------------*
+ *  Declarations
+ *---------------------------------------------------------------*/
+
+/* Route, as added: */
+typedef struct route_entry {
+    unsigned int         methods;
+    ymo_http_cb_t        cb;
+    size_t               no_params;
+    char*                names[YMO_HTTP_ROUTE_MAX_PARAMS];
+    struct route_entry*  next;
+} route_entry_t;
+
+/* Radix tree node, as added: */
+struct ymo_http_route_build {
+    char*                    label;
+    size_t                   len;
+    ymo_http_route_build_t*  children;   /* Static; sorted by first byte */
+    ymo_http_route_build_t*  next;       /* Next sibling */
+    ymo_http_route_build_t*  param;
+    ymo_http_route_build_t*  wild;
+    route_entry_t*           routes;
+    size_t                   no_routes;
+};
+
+/* Match state: */
+typedef struct route_match {
+    const ymo_http_route_t*  route;
+    unsigned int             method;
+    unsigned int             allow;     /* Methods for a matched path */
+    struct {
+        const char*          value;
+        size_t               len;
+    } caps[YMO_HTTP_ROUTE_MAX_PARAMS];
+} route_match_t;
+
+/* Method names, by ymo_http_method_t (for Allow): */
+static const char* route_method_names[] = {
+    "OPTIONS", "GET", "HEAD", "POST", "PUT", "DELETE", "TRACE", "CONNECT",
+};
+
+#define ROUTE_NO_METHOD_NAMES \
+    (sizeof(route_method_names)/sizeof(route_method_names[0]))
+
+/* True if p starts a :param or * segment: */
+#define ROUTE_IS_SPECIAL(p) \
+    (((p)[0] == ':' || (p)[0] == '*') && (p)[-1] == '/')
+
+
+/*---------------------------------------------------------------*
+ *  Building:
+ *---------------------------------------------------------------*/
+static ymo_http_route_build_t* build_node_create(const char* label, size_t len)
+{
+    ymo_http_route_build_t* node = YMO_NEW0(ymo_http_route_build_t);
+    if( !node ) {
+        return NULL;
+    }
+
+    node->label = YMO_ALLOC(len + 1);
+    if( !node->label ) {
+        YMO_DELETE(ymo_http_route_build_t, node);
+        return NULL;
+    }
+    memcpy(node->label, label, len);
+    node->label[len] = '\0';
+    node->len = len;
+    return node;
+}
+
+
+static void build_node_free(ymo_http_route_build_t* node, int names)
+{
+    while( node->children ) {
+        ymo_http_route_build_t* child = node->children;
+        node->children = child->next;
+        build_node_free(child, names);
+    }
+    if( node->param ) {
+        build_node_free(node->param, names);
+    }
+    if( node->wild ) {
+        build_node_free(node->wild, names);
+    }
+
+    while( node->routes ) {
+        route_entry_t* route = node->routes;
+        node->routes = route->next;
+
+        /* Once compiled, the names belong to the router: */
+        for( size_t i = 0; names && i < route->no_params; i++ ) {
+            YMO_FREE(route->names[i]);
+        }
+        YMO_DELETE(route_entry_t, route);
+    }
+
+    YMO_FREE(node->label);
+    YMO_DELETE(ymo_http_route_build_t, node);
+}
+
+
+/* Split a node's label at len, moving everything below it to a new child: */
+static ymo_status_t build_node_split(
+        ymo_http_router_t* router, ymo_http_route_build_t* node, size_t len)
+{
+    ymo_http_route_build_t* tail = build_node_create(
+            node->label + len, node->len - len);
+    if( !tail ) {
+        return ENOMEM;
+    }
+
+    tail->children = node->children;
+    tail->param = node->param;
+    tail->wild = node->wild;
+    tail->routes = node->routes;
+    tail->no_routes = node->no_routes;
+
+    node->children = tail;
+    node->param = node->wild = NULL;
+    node->routes = NULL;
+    node->no_routes = 0;
+    node->len = len;
+    router->no_build_nodes++;
+    return YMO_OKAY;
+}
+
+
+/* Add static path text below node, splitting labels as required: */
+static ymo_status_t build_static(
+        ymo_http_router_t* router,
+        ymo_http_route_build_t** node_out,
+        const char* s,
+        size_t n)
+{
+    ymo_http_route_build_t* node = *node_out;
+
+    while( n ) {
+        ymo_http_route_build_t** link = &node->children;
+        while( *link
+               && (unsigned char)(*link)->label[0] < (unsigned char)s[0] ) {
+            link = &(*link)->next;
+        }
+
+        /* No child shares a prefix with s: add one for the rest: */
+        ymo_http_route_build_t* child = *link;
+        if( !child || child->label[0] != s[0] ) {
+            if( n > UINT16_MAX ) {
+                return EINVAL;
+            }
+
+            ymo_http_route_build_t* leaf = build_node_create(s, n);
+            if( !leaf ) {
+                return ENOMEM;
+            }
+            leaf->next = child;
+            *link = leaf;
+            router->no_build_nodes++;
+            router->label_bytes += n;
+            *node_out = leaf;
+            return YMO_OKAY;
+        }
+
+        size_t common = 1;
+        while( common < n && common < child->len
+               && child->label[common] == s[common] ) {
+            common++;
+        }
+
+        if( common < child->len ) {
+            ymo_status_t status = build_node_split(router, child, common);
+            if( status != YMO_OKAY ) {
+                return status;
+            }
+        }
+        node = child;
+        s += common;
+        n -= common;
+    }
+
+    *node_out = node;
+    return YMO_OKAY;
+}
+
+
+/* Get (or create) a node's :param or * child: */
+static ymo_status_t build_special(
+        ymo_http_router_t* router,
+        ymo_http_route_build_t** node_out,
+        char kind)
+{
+    ymo_http_route_build_t* node = *node_out;
+    ymo_http_route_build_t** link = (kind == ':') ? &node->param : &node->wild;
+    if( !*link ) {
+        if( !(*link = build_node_create("", 0)) ) {
+            return ENOMEM;
+        }
+        router->no_build_nodes++;
+    }
+    *node_out = *link;
+    return YMO_OKAY;
+}
+
+
+static ymo_status_t build_route(
+        ymo_http_router_t* router,
+        ymo_http_route_build_t* node,
+        route_entry_t* route)
+{
+    route_entry_t** link = &node->routes;
+    while( *link ) {
+        if( (*link)->methods & route->methods ) {
+            return EEXIST;
+        }
+        link = &(*link)->next;
+    }
+    *link = route;
+    node->no_routes++;
+    router->no_routes++;
+    router->names_len += route->no_params;
+    return YMO_OKAY;
+}
+
+
+static void route_entry_free(route_entry_t* route)
+{
+    for( size_t i = 0; i < route->no_params; i++ ) {
+        YMO_FREE(route->names[i]);
+    }
+    YMO_DELETE(route_entry_t, route);
+}
+
+
+/*---------------------------------------------------------------*
+ *  Matching:
+ *---------------------------------------------------------------*/
+static unsigned int route_method(const char* method)
+{
+    switch( method[0] ) {
+        case 'G':
+            if( !strcmp(method, "GET") ) {
+                return YMO_HTTP_ROUTE_GET;
+            }
+            break;
+        case 'H':
+            if( !strcmp(method, "HEAD") ) {
+                return YMO_HTTP_ROUTE_HEAD;
+            }
+            break;
+        case 'P':
+            if( !strcmp(method, "POST") ) {
+                return YMO_HTTP_ROUTE_POST;
+            }
+            if( !strcmp(method, "PUT") ) {
+                return YMO_HTTP_ROUTE_PUT;
+            }
+            break;
+        case 'D':
+            if( !strcmp(method, "DELETE") ) {
+                return YMO_HTTP_ROUTE_DELETE;
+            }
+            break;
+        case 'O':
+            if( !strcmp(method, "OPTIONS") ) {
+                return YMO_HTTP_ROUTE_OPTIONS;
+            }
+            break;
+        case 'T':
+            if( !strcmp(method, "TRACE") ) {
+                return YMO_HTTP_ROUTE_TRACE;
+            }
+            break;
+        case 'C':
+            if( !strcmp(method, "CONNECT") ) {
+                return YMO_HTTP_ROUTE_CONNECT;
+            }
+            break;
+        default:
+            break;
+    }
+    return YMO_HTTP_ROUTE_OTHER;
+}
+
+
+/* Pick the route for the request method at a terminal node (HEAD falls back
+ * on GET):
+ */
+static const ymo_http_route_t* node_route(
+        const ymo_http_router_t* router,
+        const ymo_http_route_node_t* node,
+        route_match_t* m)
+{
+    const ymo_http_route_t* route = router->routes + node->routes;
+    const ymo_http_route_t* end = route + node->no_routes;
+    for( ; route < end; route++ ) {
+        if( route->methods & m->method ) {
+            return route;
+        }
+        m->allow |= route->methods;
+    }
+
+    if( m->method == YMO_HTTP_ROUTE_HEAD ) {
+        for( route = router->routes + node->routes; route < end; route++ ) {
+            if( route->methods & YMO_HTTP_ROUTE_GET ) {
+                return route;
+            }
+        }
+    }
+    return NULL;
+}
+
+
+/* Binary search a node's static children for the one starting with c: */
+static const ymo_http_route_node_t* node_child(
+        const ymo_http_router_t* router,
+        const ymo_http_route_node_t* node,
+        unsigned char c)
+{
+    const ymo_http_route_node_t* lo = router->nodes + node->children;
+    const ymo_http_route_node_t* hi = lo + node->no_children;
+    while( lo < hi ) {
+        const ymo_http_route_node_t* mid = lo + (hi - lo) / 2;
+        if( mid->first < c ) {
+            lo = mid + 1;
+        } else if( mid->first > c ) {
+            hi = mid;
+        } else {
+            return mid;
+        }
+    }
+    return NULL;
+}
+
+
+/* Match p against everything below node (whose label has been consumed).
+ * Static children are tried first, then :param, then *:
+ */
+static int route_match(
+        const ymo_http_router_t* router,
+        const ymo_http_route_node_t* node,
+        const char* p,
+        size_t depth,
+        route_match_t* m)
+{
+    if( *p == '\0' && node->no_routes ) {
+        if( (m->route = node_route(router, node, m)) ) {
+            return 1;
+        }
+    }
+
+    if( *p && node->no_children ) {
+        const ymo_http_route_node_t* child = node_child(
+                router, node, (unsigned char)*p);
+        if( child
+            && !strncmp(router->pool + child->label, p, child->label_len)
+            && route_match(router, child, p + child->label_len, depth, m) ) {
+            return 1;
+        }
+    }
+
+    if( node->param && *p && *p != '/' ) {
+        const char* end = p;
+        while( *end && *end != '/' ) {
+            end++;
+        }
+        m->caps[depth].value = p;
+        m->caps[depth].len = end - p;
+        if( route_match(
+                    router, router->nodes + node->param, end, depth+1, m) ) {
+            return 1;
+        }
+    }
+
+    if( node->wild ) {
+        m->caps[depth].value = p;
+        m->caps[depth].len = strlen(p);
+        if( (m->route = node_route(router, router->nodes + node->wild, m)) ) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+/* Copy the captures for a match into the request workspace: */
+static ymo_status_t route_params(
+        const ymo_http_router_t* router,
+        ymo_http_request_t* request,
+        const route_match_t* m)
+{
+    size_t no_params = m->route->no_params;
+    if( !no_params ) {
+        return YMO_OKAY;
+    }
+
+    ymo_http_param_t* params = ymo_blalloc(request->ws,
+            alignof(ymo_http_param_t), no_params * sizeof(ymo_http_param_t));
+    if( !params ) {
+        return ENOMEM;
+    }
+
+    for( size_t i = 0; i < no_params; i++ ) {
+        char* value = ymo_blalloc(
+                request->ws, alignof(char), m->caps[i].len + 1);
+        if( !value ) {
+            return ENOMEM;
+        }
+        memcpy(value, m->caps[i].value, m->caps[i].len);
+        value[m->caps[i].len] = '\0';
+        params[i].name = router->names[m->route->names + i];
+        params[i].value = value;
+    }
+
+    request->params = params;
+    request->no_params = no_params;
+    return YMO_OKAY;
+}
+
+
+/* The path matched, but not the method: */
+static ymo_status_t route_not_allowed(
+        ymo_http_request_t* request,
+        ymo_http_response_t* response,
+        unsigned int allow)
+{
+    char buf[128];
+    size_t len = 0;
+    buf[0] = '\0';
+
+    if( allow & YMO_HTTP_ROUTE_GET ) {
+        allow |= YMO_HTTP_ROUTE_HEAD;
+    }
+    for( size_t i = 0; i < ROUTE_NO_METHOD_NAMES; i++ ) {
+        if( allow & (1 << i) ) {
+            len += snprintf(buf + len, sizeof(buf) - len, "%s%s",
+                    len ? ", " : "", route_method_names[i]);
+        }
+    }
+
+    const char* value = ymo_blalloc_strdup(request->ws, buf);
+    if( value ) {
+        ymo_http_response_insert_header(response, "Allow", value);
+    }
+    ymo_http_response_set_status(response, YMO_HTTP_METHOD_NOT_ALLOWED);
+    ymo_http_response_finish(response);
+    return YMO_OKAY;
+}
+
+
+/*---------------------------------------------------------------*
+ *  Functions:
+ *---------------------------------------------------------------*/
+ymo_http_router_t* ymo_http_router_create(void)
+{
+    ymo_http_router_t* router = YMO_NEW0(ymo_http_router_t);
+    if( !router ) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    router->build = build_node_create("", 0);
+    if( !router->build ) {
+        YMO_DELETE(ymo_http_router_t, router);
+        errno = ENOMEM;
+        return NULL;
+    }
+    router->no_build_nodes = 1;
+    return router;
+}
+
+
+ymo_status_t ymo_http_router_add(
+        ymo_http_router_t* router,
+        unsigned int methods,
+        const char* pattern,
+        ymo_http_cb_t cb)
+{
+    if( !router->build ) {
+        return EBUSY;
+    }
+
+    if( !pattern || pattern[0] != '/' || !cb
+        || !(methods & YMO_HTTP_ROUTE_ANY) ) {
+        return EINVAL;
+    }
+
+    route_entry_t* route = YMO_NEW0(route_entry_t);
+    if( !route ) {
+        return ENOMEM;
+    }
+    route->methods = methods & YMO_HTTP_ROUTE_ANY;
+    route->cb = cb;
+
+    ymo_status_t status = YMO_OKAY;
+    ymo_http_route_build_t* node = router->build;
+    const char* p = pattern;
+    while( *p && status == YMO_OKAY ) {
+        const char* start = p;
+
+        /* Static text, up to the next :param or *: */
+        if( !ROUTE_IS_SPECIAL(p) ) {
+            while( *p && !ROUTE_IS_SPECIAL(p) ) {
+                p++;
+            }
+            status = build_static(router, &node, start, p - start);
+            continue;
+        }
+
+        char kind = *p++;
+        start = p;
+        while( *p && *p != '/' ) {
+            p++;
+        }
+
+        /* Params have names; wildcards have to come last: */
+        if( (kind == ':' && p == start) || (kind == '*' && *p)
+            || route->no_params == YMO_HTTP_ROUTE_MAX_PARAMS ) {
+            status = EINVAL;
+            break;
+        }
+
+        size_t len = p - start;
+        if( !len ) {
+            start = "*";
+            len = 1;
+        }
+
+        char* name = YMO_ALLOC(len + 1);
+        if( !name ) {
+            status = ENOMEM;
+            break;
+        }
+        memcpy(name, start, len);
+        name[len] = '\0';
+        route->names[route->no_params++] = name;
+        status = build_special(router, &node, kind);
+    }
+
+    if( status == YMO_OKAY ) {
+        status = build_route(router, node, route);
+    }
+
+    if( status != YMO_OKAY ) {
+        route_entry_free(route);
+    }
+    return status;
+}
+
+
+ymo_status_t ymo_http_router_compile(ymo_http_router_t* router)
+{
+    if( !router->build ) {
+        return YMO_OKAY;
+    }
+
+    size_t no_nodes = router->no_build_nodes;
+    ymo_http_route_build_t** queue = YMO_ALLOC(
+            no_nodes * sizeof(ymo_http_route_build_t*));
+    router->nodes = YMO_ALLOC0(no_nodes * sizeof(ymo_http_route_node_t));
+    router->pool = YMO_ALLOC(router->label_bytes + 1);
+    router->routes = YMO_ALLOC0(
+            (router->no_routes + 1) * sizeof(ymo_http_route_t));
+    router->names = YMO_ALLOC0((router->names_len + 1) * sizeof(char*));
+
+    if( !queue || !router->nodes || !router->pool
+        || !router->routes || !router->names ) {
+        YMO_FREE(queue);
+        YMO_FREE(router->nodes);
+        YMO_FREE(router->pool);
+        YMO_FREE(router->routes);
+        YMO_FREE(router->names);
+        router->nodes = NULL;
+        router->pool = NULL;
+        router->routes = NULL;
+        router->names = NULL;
+        return ENOMEM;
+    }
+
+    /* Lay the nodes out breadth-first, so each one's children are
+     * contiguous:
+     */
+    size_t head = 0;
+    size_t tail = 1;
+    uint32_t pool_len = 0;
+    uint32_t no_routes = 0;
+    uint32_t names_len = 0;
+    queue[0] = router->build;
+    while( head < tail ) {
+        ymo_http_route_build_t* b = queue[head];
+        ymo_http_route_node_t* n = router->nodes + head++;
+
+        n->label = pool_len;
+        n->label_len = b->len;
+        n->first = (unsigned char)b->label[0];
+        memcpy(router->pool + pool_len, b->label, b->len);
+        pool_len += b->len;
+
+        n->children = tail;
+        for( ymo_http_route_build_t* c = b->children; c; c = c->next ) {
+            queue[tail++] = c;
+            n->no_children++;
+        }
+        if( !n->no_children ) {
+            n->children = YMO_HTTP_ROUTE_NONE;
+        }
+        if( b->param ) {
+            n->param = tail;
+            queue[tail++] = b->param;
+        }
+        if( b->wild ) {
+            n->wild = tail;
+            queue[tail++] = b->wild;
+        }
+
+        n->routes = no_routes;
+        for( route_entry_t* r = b->routes; r; r = r->next ) {
+            ymo_http_route_t* route = router->routes + no_routes++;
+            route->methods = r->methods;
+            route->cb = r->cb;
+            route->names = names_len;
+            route->no_params = r->no_params;
+            for( size_t i = 0; i < r->no_params; i++ ) {
+                router->names[names_len++] = r->names[i];
+            }
+            n->no_routes++;
+        }
+    }
+    router->pool[pool_len] = '\0';
+    router->no_nodes = tail;
+
+    ymo_log_debug("Compiled %zu routes into %zu nodes (%zu bytes)",
+            router->no_routes, router->no_nodes,
+            router->no_nodes * sizeof(ymo_http_route_node_t)
+            + pool_len + router->no_routes * sizeof(ymo_http_route_t));
+
+    YMO_FREE(queue);
+    build_node_free(router->build, 0);
+    router->build = NULL;
+    return YMO_OKAY;
+}
+
+
+void ymo_http_router_free(ymo_http_router_t* router)
+{
+    if( !router ) {
+        return;
+    }
+
+    if( router->build ) {
+        build_node_free(router->build, 1);
+    }
+
+    if( router->names ) {
+        for( size_t i = 0; i < router->names_len; i++ ) {
+            YMO_FREE((char*)router->names[i]);
+        }
+        YMO_FREE(router->names);
+    }
+    YMO_FREE(router->nodes);
+    YMO_FREE(router->pool);
+    YMO_FREE(router->routes);
+    YMO_DELETE(ymo_http_router_t, router);
+}
+
+
+ymo_status_t ymo_http_router_dispatch(
+        const ymo_http_router_t* router,
+        ymo_http_cb_t fallback_cb,
+        ymo_http_session_t* session,
+        ymo_http_request_t* request,
+        ymo_http_response_t* response)
+{
+    route_match_t m;
+    m.route = NULL;
+    m.allow = 0;
+    m.method = route_method(request->method);
+
+    if( request->uri && router->no_nodes
+        && route_match(router, router->nodes, request->uri, 0, &m) ) {
+        ymo_status_t status = route_params(router, request, &m);
+        if( status != YMO_OKAY ) {
+            return status;
+        }
+        return m.route->cb(session, request, response, session->user_data);
+    }
+
+    if( m.allow ) {
+        return route_not_allowed(request, response, m.allow);
+    }
+
+    if( fallback_cb ) {
+        return fallback_cb(session, request, response, session->user_data);
+    }
+
+    ymo_http_response_set_status(response, YMO_HTTP_NOT_FOUND);
+    ymo_http_response_finish(response);
+    return YMO_OKAY;
+}
+
+
+const char* ymo_http_request_param(
+        const ymo_http_request_t* request, const char* name)
+{
+    for( size_t i = 0; i < request->no_params; i++ ) {
+        if( !strcmp(request->params[i].name, name) ) {
+            return request->params[i].value;
+        }
+    }
+    return NULL;
+}
+
@@ -0,0 +1,135 @@
+/*=============================================================================
+ *
+ * Copyright (c) 2014 Andrew Canaday
+ *
+ * This file is part of libyimmo (sometimes referred to as "yimmo" or "ymo").
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *===========================================================================*/
+
+
+
+#ifndef YMO_HTTP_ROUTER_H
+#define YMO_HTTP_ROUTER_H
+#include "yimmo_config.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#include "yimmo.h"
+#include "ymo_http.h"
+
+/** Router
+ * ========
+ *
+ * Internals for the URL router (see :c:func:`ymo_http_router_create`).
+ *
+ * Routes are added to a radix tree of heap nodes — static path text is
+ * shared between routes and split where they diverge; ``:param`` and ``*``
+ * segments hang off their parent as dedicated children. Compiling flattens
+ * the tree, in the manner of :c:type:`ymo_oitrie_t`, into:
+ *
+ * - one array of fixed-size nodes, laid out breadth-first so that each
+ *   node's static children are contiguous and sorted by first byte;
+ * - one pool holding every node label;
+ * - one array of route entries (method mask, callback, param names).
+ *
+ * Matching walks the arrays directly: static children are binary-searched
+ * by first byte and compared with ``memcmp``; the walk backtracks to
+ * ``:param`` and then ``*`` children, so static segments take precedence.
+ * Captures are recorded as offsets into the URI on the stack; only a
+ * successful match touches the request workspace.
+ */
+
+/**---------------------------------------------------------------
+ * Definitions
+ *---------------------------------------------------------------*/
+
+/** Maximum number of ``:param``/``*`` captures in one route. */
+#define YMO_HTTP_ROUTE_MAX_PARAMS 16
+
+/** Value of node link fields which don't point anywhere. (The root is
+ * never anyone's child, so index 0 doubles as "none").
+ */
+#define YMO_HTTP_ROUTE_NONE 0
+
+
+/**---------------------------------------------------------------
+ * Types
+ *---------------------------------------------------------------*/
+
+typedef struct ymo_http_route_build ymo_http_route_build_t;
+
+/** Compiled route. */
+typedef struct ymo_http_route {
+    unsigned int   methods;     /* Bitwise-or of ymo_http_route_method_t */
+    ymo_http_cb_t  cb;
+    uint32_t       names;       /* Index of the first param name */
+    uint32_t       no_params;
+} ymo_http_route_t;
+
+/** Compiled node. */
+typedef struct ymo_http_route_node {
+    uint32_t  label;        /* Offset of the label in the pool */
+    uint16_t  label_len;
+    uint16_t  no_children;  /* Number of static children */
+    uint32_t  children;     /* Index of the first static child */
+    uint32_t  param;        /* Index of the :param child */
+    uint32_t  wild;         /* Index of the * child */
+    uint32_t  routes;       /* Index of the first route */
+    uint16_t  no_routes;
+    uint8_t   first;        /* First byte of the label */
+} ymo_http_route_node_t;
+
+/** Router. */
+struct ymo_http_router {
+    /* Build state (released on compile): */
+    ymo_http_route_build_t*  build;
+    size_t                   no_build_nodes;
+    size_t                   label_bytes;
+    size_t                   names_len;
+
+    /* Compiled: */
+    ymo_http_route_node_t*   nodes;
+    size_t                   no_nodes;
+    char*                    pool;
+    ymo_http_route_t*        routes;
+    size_t                   no_routes;
+    const char**             names;
+};
+
+
+/**---------------------------------------------------------------
+ * Functions
+ *---------------------------------------------------------------*/
+
+/** Route a request: on a match, fill in ``request->params`` and invoke the
+ * route callback. Otherwise, invoke ``fallback_cb`` (if there is one) or
+ * answer ``404``; if the path matched, but not the method, answer ``405``
+ * (with ``Allow``).
+ *
+ * :returns: the status returned by the callback; ``ENOMEM`` if the request
+ *     workspace can't hold the params.
+ */
+ymo_status_t ymo_http_router_dispatch(
+        const ymo_http_router_t* router,
+        ymo_http_cb_t fallback_cb,
+        ymo_http_session_t* session,
+        ymo_http_request_t* request,
+        ymo_http_response_t* response);
+
+#endif /* YMO_HTTP_ROUTER_H */
+
+
+
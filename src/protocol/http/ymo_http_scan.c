@@ -0,0 +1,494 @@
+/*=============================================================================
+ * libyimmo: Lightweight socket server framework
+ *
+ *  Copyright (c) 2014 Andrew Canaday
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *===========================================================================*/
+
+#include "yimmo_config.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include "yimmo.h"
+#include "ymo_log.h"
+#include "ymo_http_scan.h"
+
+/*---------------------------------------------------------------*
+ *  Declarations
+ *---------------------------------------------------------------*/
+#ifndef YMO_HTTP_SIMD
+#  define YMO_HTTP_SIMD 1
+#endif /* YMO_HTTP_SIMD */
+
+#if YMO_HTTP_SIMD \
+    && defined(HAVE_IMMINTRIN_H) && HAVE_IMMINTRIN_H \
+    && defined(HAVE_BUILTIN_CPU_SUPPORTS) && HAVE_BUILTIN_CPU_SUPPORTS \
+    && (defined(__x86_64__) || defined(__i386__))
+#  define YMO_HTTP_SCAN_X86 1
+#  include <immintrin.h>
+#else
+#  define YMO_HTTP_SCAN_X86 0
+#endif /* x86 */
+
+#if YMO_HTTP_SIMD \
+    && defined(HAVE_ARM_NEON_H) && HAVE_ARM_NEON_H \
+    && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+#  define YMO_HTTP_SCAN_NEON 1
+#  include <arm_neon.h>
+#else
+#  define YMO_HTTP_SCAN_NEON 0
+#endif /* ARM NEON */
+
+/* Stop bytes, as inclusive [lo, hi] range pairs. These are padded out to
+ * 16 bytes so they can be loaded directly as the pcmpestri needle.
+ */
+
+/* SP and CTL, '#', '?', DEL: */
+#define URI_STOP_LEN 8
+static const uint8_t uri_stop[16] YMO_ATTR_ALIGNED(16) = {
+    0x00, 0x20, '#', '#', '?', '?', 0x7f, 0x7f,
+};
+
+/* Anything but [0-9A-Za-z-]: */
+#define HDR_NAME_STOP_LEN 10
+static const uint8_t hdr_name_stop[16] YMO_ATTR_ALIGNED(16) = {
+    0x00, ',', '.', '/', ':', '@', '[', '`', '{', 0xff,
+};
+
+/* CTL (except HTAB) and DEL: */
+#define HDR_VALUE_STOP_LEN 6
+static const uint8_t hdr_value_stop[16] YMO_ATTR_ALIGNED(16) = {
+    0x00, 0x08, 0x0a, 0x1f, 0x7f, 0x7f,
+};
+
+/* NUL, '%', '&', '+', '=': */
+#define QUERY_STOP_LEN 8
+static const uint8_t query_stop[16] YMO_ATTR_ALIGNED(16) = {
+    0x00, 0x00, '%', '&', '+', '+', '=', '=',
+};
+
+/* NUL, '%', '/': */
+#define PATH_STOP_LEN 6
+static const uint8_t path_stop[16] YMO_ATTR_ALIGNED(16) = {
+    0x00, 0x00, '%', '%', '/', '/',
+};
+
+typedef struct ymo_http_scan_entry {
+    ymo_http_scanner_t  scanner;
+    int                 (*supported)(void);
+} ymo_http_scan_entry_t;
+
+
+/*---------------------------------------------------------------*
+ *  Scalar:
+ *---------------------------------------------------------------*/
+/* No fast path: leave everything to the state machine. */
+static size_t scan_scalar(const char* buf, size_t len)
+{
+    return 0;
+}
+
+
+static int scalar_supported(void)
+{
+    return 1;
+}
+
+
+#if YMO_HTTP_SCAN_X86
+/*---------------------------------------------------------------*
+ *  SSE4.2:
+ *---------------------------------------------------------------*/
+#define YMO_SSE42_MODE \
+    (_SIDD_UBYTE_OPS | _SIDD_CMP_RANGES | _SIDD_LEAST_SIGNIFICANT)
+
+__attribute__((target("sse4.2")))
+static inline size_t scan_sse42(
+        const char* buf, size_t len, const uint8_t* stop, int stop_len)
+{
+    const __m128i needle = _mm_loadu_si128((const __m128i*)stop);
+    size_t off = 0;
+    int idx;
+
+    while( len - off >= 16 ) {
+        __m128i b = _mm_loadu_si128((const __m128i*)(buf + off));
+        idx = _mm_cmpestri(needle, stop_len, b, 16, YMO_SSE42_MODE);
+        if( idx != 16 ) {
+            return off + idx;
+        }
+        off += 16;
+    }
+
+    if( off < len ) {
+        /* Explicit length means the pad bytes are never matched: */
+        uint8_t tail[16] = { 0 };
+        int tail_len = (int)(len - off);
+        memcpy(tail, buf + off, tail_len);
+        idx = _mm_cmpestri(needle, stop_len,
+                _mm_loadu_si128((const __m128i*)tail), tail_len,
+                YMO_SSE42_MODE);
+        return off + (idx < tail_len ? idx : tail_len);
+    }
+    return off;
+}
+
+
+__attribute__((target("sse4.2")))
+static size_t scan_sse42_uri(const char* buf, size_t len)
+{
+    return scan_sse42(buf, len, uri_stop, URI_STOP_LEN);
+}
+
+
+__attribute__((target("sse4.2")))
+static size_t scan_sse42_hdr_name(const char* buf, size_t len)
+{
+    return scan_sse42(buf, len, hdr_name_stop, HDR_NAME_STOP_LEN);
+}
+
+
+__attribute__((target("sse4.2")))
+static size_t scan_sse42_hdr_value(const char* buf, size_t len)
+{
+    return scan_sse42(buf, len, hdr_value_stop, HDR_VALUE_STOP_LEN);
+}
+
+
+__attribute__((target("sse4.2")))
+static size_t scan_sse42_query(const char* buf, size_t len)
+{
+    return scan_sse42(buf, len, query_stop, QUERY_STOP_LEN);
+}
+
+
+__attribute__((target("sse4.2")))
+static size_t scan_sse42_path(const char* buf, size_t len)
+{
+    return scan_sse42(buf, len, path_stop, PATH_STOP_LEN);
+}
+
+
+static int sse42_supported(void)
+{
+    return __builtin_cpu_supports("sse4.2");
+}
+
+
+/*---------------------------------------------------------------*
+ *  AVX2:
+ *---------------------------------------------------------------*/
+/* Bitmask of bytes in b which fall within any of the stop ranges.
+ * (Unsigned range check: lo <= x  <=>  max(x, lo) == x).
+ */
+__attribute__((target("avx2")))
+static inline uint32_t avx2_stop_mask(
+        __m256i b, const uint8_t* stop, int stop_len)
+{
+    __m256i m = _mm256_setzero_si256();
+    int i;
+    for( i = 0; i < stop_len; i += 2 )
+    {
+        __m256i lo = _mm256_set1_epi8((char)stop[i]);
+        __m256i hi = _mm256_set1_epi8((char)stop[i+1]);
+        __m256i ge = _mm256_cmpeq_epi8(_mm256_max_epu8(b, lo), b);
+        __m256i le = _mm256_cmpeq_epi8(_mm256_min_epu8(b, hi), b);
+        m = _mm256_or_si256(m, _mm256_and_si256(ge, le));
+    }
+    return (uint32_t)_mm256_movemask_epi8(m);
+}
+
+
+/* NOTE: most header names and values are shorter than 32 bytes, so anything
+ * under a full vector is handed to the SSE4.2 scanner (AVX2 implies SSE4.2).
+ */
+__attribute__((target("avx2,sse4.2")))
+static inline size_t scan_avx2(
+        const char* buf, size_t len, const uint8_t* stop, int stop_len)
+{
+    size_t off = 0;
+    uint32_t mask;
+
+    while( len - off >= 32 ) {
+        __m256i b = _mm256_loadu_si256((const __m256i*)(buf + off));
+        mask = avx2_stop_mask(b, stop, stop_len);
+        if( mask ) {
+            return off + __builtin_ctz(mask);
+        }
+        off += 32;
+    }
+
+    if( off < len ) {
+        return off + scan_sse42(buf + off, len - off, stop, stop_len);
+    }
+    return off;
+}
+
+
+__attribute__((target("avx2,sse4.2")))
+static size_t scan_avx2_uri(const char* buf, size_t len)
+{
+    return scan_avx2(buf, len, uri_stop, URI_STOP_LEN);
+}
+
+
+__attribute__((target("avx2,sse4.2")))
+static size_t scan_avx2_hdr_name(const char* buf, size_t len)
+{
+    return scan_avx2(buf, len, hdr_name_stop, HDR_NAME_STOP_LEN);
+}
+
+
+__attribute__((target("avx2,sse4.2")))
+static size_t scan_avx2_hdr_value(const char* buf, size_t len)
+{
+    return scan_avx2(buf, len, hdr_value_stop, HDR_VALUE_STOP_LEN);
+}
+
+
+__attribute__((target("avx2,sse4.2")))
+static size_t scan_avx2_query(const char* buf, size_t len)
+{
+    return scan_avx2(buf, len, query_stop, QUERY_STOP_LEN);
+}
+
+
+__attribute__((target("avx2,sse4.2")))
+static size_t scan_avx2_path(const char* buf, size_t len)
+{
+    return scan_avx2(buf, len, path_stop, PATH_STOP_LEN);
+}
+
+
+static int avx2_supported(void)
+{
+    return __builtin_cpu_supports("avx2");
+}
+#endif /* YMO_HTTP_SCAN_X86 */
+
+
+#if YMO_HTTP_SCAN_NEON
+/*---------------------------------------------------------------*
+ *  NEON:
+ *---------------------------------------------------------------*/
+/* Nibble mask of bytes in b which fall within any of the stop ranges
+ * (4 bits per input byte; NEON has no movemask).
+ */
+static inline uint64_t neon_stop_mask(
+        uint8x16_t b, const uint8_t* stop, int stop_len)
+{
+    uint8x16_t m = vdupq_n_u8(0);
+    int i;
+    for( i = 0; i < stop_len; i += 2 )
+    {
+        uint8x16_t in_range = vandq_u8(
+                vcgeq_u8(b, vdupq_n_u8(stop[i])),
+                vcleq_u8(b, vdupq_n_u8(stop[i+1])));
+        m = vorrq_u8(m, in_range);
+    }
+    return vget_lane_u64(vreinterpret_u64_u8(
+                vshrn_n_u16(vreinterpretq_u16_u8(m), 4)), 0);
+}
+
+
+static inline size_t scan_neon(
+        const char* buf, size_t len, const uint8_t* stop, int stop_len)
+{
+    size_t off = 0;
+    uint64_t mask;
+
+    while( len - off >= 16 ) {
+        mask = neon_stop_mask(
+                vld1q_u8((const uint8_t*)buf + off), stop, stop_len);
+        if( mask ) {
+            return off + (__builtin_ctzll(mask) >> 2);
+        }
+        off += 16;
+    }
+
+    if( off < len ) {
+        uint8_t tail[16] = { 0 };
+        size_t tail_len = len - off;
+        memcpy(tail, buf + off, tail_len);
+        mask = neon_stop_mask(vld1q_u8(tail), stop, stop_len);
+        if( mask ) {
+            size_t idx = __builtin_ctzll(mask) >> 2;
+            return off + (idx < tail_len ? idx : tail_len);
+        }
+        return len;
+    }
+    return off;
+}
+
+
+static size_t scan_neon_uri(const char* buf, size_t len)
+{
+    return scan_neon(buf, len, uri_stop, URI_STOP_LEN);
+}
+
+
+static size_t scan_neon_hdr_name(const char* buf, size_t len)
+{
+    return scan_neon(buf, len, hdr_name_stop, HDR_NAME_STOP_LEN);
+}
+
+
+static size_t scan_neon_hdr_value(const char* buf, size_t len)
+{
+    return scan_neon(buf, len, hdr_value_stop, HDR_VALUE_STOP_LEN);
+}
+
+
+static size_t scan_neon_query(const char* buf, size_t len)
+{
+    return scan_neon(buf, len, query_stop, QUERY_STOP_LEN);
+}
+
+
+static size_t scan_neon_path(const char* buf, size_t len)
+{
+    return scan_neon(buf, len, path_stop, PATH_STOP_LEN);
+}
+#endif /* YMO_HTTP_SCAN_NEON */
+
+
+/*---------------------------------------------------------------*
+ *  Dispatch:
+ *---------------------------------------------------------------*/
+/* In order of preference: */
+static const ymo_http_scan_entry_t scan_impls[] = {
+#if YMO_HTTP_SCAN_X86
+    {
+        { "avx2",
+          scan_avx2_uri, scan_avx2_hdr_name, scan_avx2_hdr_value,
+          scan_avx2_query, scan_avx2_path },
+        avx2_supported
+    },
+    {
+        { "sse4.2",
+          scan_sse42_uri, scan_sse42_hdr_name, scan_sse42_hdr_value,
+          scan_sse42_query, scan_sse42_path },
+        sse42_supported
+    },
+#endif /* YMO_HTTP_SCAN_X86 */
+#if YMO_HTTP_SCAN_NEON
+    {
+        { "neon",
+          scan_neon_uri, scan_neon_hdr_name, scan_neon_hdr_value,
+          scan_neon_query, scan_neon_path },
+        scalar_supported
+    },
+#endif /* YMO_HTTP_SCAN_NEON */
+    {
+        { "scalar",
+          scan_scalar, scan_scalar, scan_scalar, scan_scalar, scan_scalar },
+        scalar_supported
+    },
+};
+
+#define NO_SCAN_IMPLS (sizeof(scan_impls)/sizeof(scan_impls[0]))
+
+
+/* The initial scanner set resolves the best implementation on first use.
+ *
+ * NOTE: if multiple threads race here, they'll all select and store the
+ *       same pointer, so there's no harm done.
+ */
+static size_t scan_resolve_uri(const char* buf, size_t len)
+{
+    ymo_http_scan_select(NULL);
+    return ymo_http_scanner->uri(buf, len);
+}
+
+
+static size_t scan_resolve_hdr_name(const char* buf, size_t len)
+{
+    ymo_http_scan_select(NULL);
+    return ymo_http_scanner->hdr_name(buf, len);
+}
+
+
+static size_t scan_resolve_hdr_value(const char* buf, size_t len)
+{
+    ymo_http_scan_select(NULL);
+    return ymo_http_scanner->hdr_value(buf, len);
+}
+
+
+static size_t scan_resolve_query(const char* buf, size_t len)
+{
+    ymo_http_scan_select(NULL);
+    return ymo_http_scanner->query(buf, len);
+}
+
+
+static size_t scan_resolve_path(const char* buf, size_t len)
+{
+    ymo_http_scan_select(NULL);
+    return ymo_http_scanner->path(buf, len);
+}
+
+
+static const ymo_http_scanner_t scan_resolve = {
+    NULL, scan_resolve_uri, scan_resolve_hdr_name, scan_resolve_hdr_value,
+    scan_resolve_query, scan_resolve_path
+};
+
+const ymo_http_scanner_t* ymo_http_scanner = &scan_resolve;
+
+
+ymo_status_t ymo_http_scan_select(const char* name)
+{
+    size_t i;
+    for( i = 0; i < NO_SCAN_IMPLS; i++ )
+    {
+        const ymo_http_scan_entry_t* entry = &scan_impls[i];
+        if( name && strcmp(name, entry->scanner.name) ) {
+            continue;
+        }
+
+        if( entry->supported() ) {
+            ymo_log_debug("Using \"%s\" HTTP scanner", entry->scanner.name);
+            ymo_http_scanner = &entry->scanner;
+            return YMO_OKAY;
+        }
+    }
+    return ENOTSUP;
+}
+
+
+const char* ymo_http_scan_name(void)
+{
+    if( ymo_http_scanner == &scan_resolve ) {
+        ymo_http_scan_select(NULL);
+    }
+    return ymo_http_scanner->name;
+}
+
+
+const ymo_http_scanner_t* ymo_http_scan_impl(size_t idx)
+{
+    size_t i;
+    for( i = 0; i < NO_SCAN_IMPLS; i++ )
+    {
+        if( scan_impls[i].supported() && !idx-- ) {
+            return &scan_impls[i].scanner;
+        }
+    }
+    return NULL;
+}
+
+
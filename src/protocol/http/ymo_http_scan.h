@@ -0,0 +1,136 @@
+/*=============================================================================
+ *
+ * Copyright (c) 2014 Andrew Canaday
+ *
+ * This file is part of libyimmo (sometimes referred to as "yimmo" or "ymo").
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *===========================================================================*/
+
+
+
+#ifndef YMO_HTTP_SCAN_H
+#define YMO_HTTP_SCAN_H
+#include "yimmo_config.h"
+#include <stddef.h>
+#include "yimmo.h"
+
+/** HTTP Scanners
+ * ===============
+ *
+ * Vectorized fast paths for the :ref:`HTTP Parser` (and for URL decoding and
+ * path normalization; see :c:func:`ymo_http_url_decode`).
+ *
+ * Each scanner returns the length of the longest prefix of ``buf`` which
+ * contains *only* bytes the parser would copy verbatim — i.e. it stops at
+ * the first delimiter (``' '``, ``'?'``, ``'#'``, ``':'``, ``'\r'``) or
+ * suspicious byte (CTL, DEL, non-token). The byte at the returned offset (if
+ * any) is left to the byte-at-a-time state machine in ``ymo_http_parse.c``,
+ * which remains the sole authority on what is and isn't valid.
+ *
+ * The implementation is selected at runtime, the first time a scanner is
+ * invoked:
+ *
+ * - ``avx2``: x86, 32 bytes at a time (if the CPU supports it)
+ * - ``sse4.2``: x86, 16 bytes at a time using ``pcmpestri``
+ * - ``neon``: ARM, 16 bytes at a time
+ * - ``scalar``: no-op — everything falls through to the state machine
+ *
+ * Setting ``YMO_HTTP_SIMD=0`` at configure time compiles the vector
+ * implementations out altogether.
+ */
+
+/**---------------------------------------------------------------
+ * Types
+ *---------------------------------------------------------------*/
+
+/** Scanner callback type: given a buffer and its length, return the number
+ * of leading bytes which may be copied without further inspection.
+ */
+typedef size_t (*ymo_http_scan_fn_t)(const char* buf, size_t len);
+
+/** Set of scanners for a given instruction set. */
+typedef struct ymo_http_scanner {
+    const char*         name;      /* Implementation name (e.g. "sse4.2") */
+    ymo_http_scan_fn_t  uri;       /* Request target and version */
+    ymo_http_scan_fn_t  hdr_name;  /* Header field-name tchars */
+    ymo_http_scan_fn_t  hdr_value; /* Header field-value (VCHAR/obs-text) */
+    ymo_http_scan_fn_t  query;     /* URL-encoded query/form data */
+    ymo_http_scan_fn_t  path;      /* URL path segment bytes */
+} ymo_http_scanner_t;
+
+/** Scanner set currently in use by the parser. */
+extern const ymo_http_scanner_t* ymo_http_scanner;
+
+/**---------------------------------------------------------------
+ * Functions
+ *---------------------------------------------------------------*/
+
+/** Select the scanner implementation used by the parser.
+ *
+ * :param name: implementation name, or ``NULL`` for the best available.
+ * :returns: ``YMO_OKAY`` on success; ``ENOTSUP`` if the named implementation
+ *     is not compiled in or not supported by this CPU.
+ */
+ymo_status_t ymo_http_scan_select(const char* name);
+
+/** Get the name of the scanner implementation currently in use (resolving
+ * the default, if it hasn't been already).
+ */
+const char* ymo_http_scan_name(void);
+
+/** Return the scanner implementation at the given index or ``NULL`` once
+ * the list has been exhausted. Only implementations supported by the host
+ * CPU are returned (used by tests and benchmarks to cover each one).
+ */
+const ymo_http_scanner_t* ymo_http_scan_impl(size_t idx);
+
+/** Length of the leading run of request-target/version bytes in ``buf``
+ * (stops at SP, ``'?'``, ``'#'``, CTL, or DEL). */
+static inline size_t ymo_http_scan_uri(const char* buf, size_t len)
+{
+    return ymo_http_scanner->uri(buf, len);
+}
+
+/** Length of the leading run of ``[0-9A-Za-z-]`` in ``buf``. */
+static inline size_t ymo_http_scan_hdr_name(const char* buf, size_t len)
+{
+    return ymo_http_scanner->hdr_name(buf, len);
+}
+
+/** Length of the leading run of header value bytes in ``buf`` (stops at
+ * CTL other than HTAB, or DEL). */
+static inline size_t ymo_http_scan_hdr_value(const char* buf, size_t len)
+{
+    return ymo_http_scanner->hdr_value(buf, len);
+}
+
+/** Length of the leading run of URL-encoded bytes in ``buf`` which decode
+ * to themselves (stops at NUL, ``'%'``, ``'&'``, ``'+'``, or ``'='``). */
+static inline size_t ymo_http_scan_query(const char* buf, size_t len)
+{
+    return ymo_http_scanner->query(buf, len);
+}
+
+/** Length of the leading run of path bytes in ``buf`` which don't end a
+ * segment or need decoding (stops at NUL, ``'%'``, or ``'/'``). */
+static inline size_t ymo_http_scan_path(const char* buf, size_t len)
+{
+    return ymo_http_scanner->path(buf, len);
+}
+
+#endif /* YMO_HTTP_SCAN_H */
+
+
@@ -43,9 +43,15 @@ ymo_http_session_create(ymo_conn_t* conn)
     http_session = YMO_NEW(ymo_http_session_t);
     if( http_session ) {
         http_session->conn = conn;
+        http_session->state = YMO_HTTP_SESSION_OPEN;
+        http_session->user_data = NULL;
         http_session->exchange = NULL;
+        http_session->pool = NULL;
         http_session->response = NULL;
+        http_session->response_tail = NULL;
         http_session->send_buffer = NULL;
+        http_session->send_tail = NULL;
+        http_session->send_len = 0;
     }
     return http_session;
 }
@@ -75,13 +81,13 @@ ymo_status_t
 ymo_http_session_add_new_http_request(ymo_http_session_t* http_session)
 {
     ymo_http_exchange_t* exchange = NULL;
-    exchange = ymo_http_exchange_create();
+    exchange = ymo_http_exchange_acquire(http_session->pool);
     if( !exchange ) {
         return errno;
     }
 
     /* Initialize it: */
-    ymo_log_trace("Creating exchange (%p)", (void*)exchange);
+    ymo_log_trace("Acquired exchange (%p)", (void*)exchange);
     http_session->exchange = exchange;
     return YMO_OKAY;
 }
@@ -111,16 +117,15 @@ ymo_status_t ymo_http_session_init_response(
     ymo_status_t status = YMO_OKAY;
 
     /* Else, start prepping the app-facing response: */
-    ymo_http_response_t* response = ymo_http_response_create(session);
+    ymo_http_response_t* response = &exchange->response;
+    ymo_http_response_init(response, session);
+    response->flags = exchange->request.flags;
 
-    if( !response ) {
-        ymo_log_error("Unable to create HTTP response object: %s",
-                strerror(errno));
-        status = ENOMEM;
+    /* Responses to HEAD keep their headers, but not the body: */
+    if( !strcmp(exchange->request.method, "HEAD") ) {
+        response->flags |= YMO_HTTP_RESPONSE_NO_BODY;
     }
 
-    exchange->response = response;
-    response->flags = exchange->request.flags;
     if( exchange->request.flags & YMO_HTTP_FLAG_REQUEST_KEEPALIVE ) {
         if( !(exchange->request.flags & YMO_HTTP_FLAG_VERSION_1_1) ) {
             ymo_http_hdr_table_insert_precompute(
@@ -145,15 +150,11 @@ ymo_status_t ymo_http_session_add_response(
     ymo_log_trace(
             "Adding new response to HTTP session (%p)", (void*)http_session);
     if( http_session->response ) {
-        ymo_http_response_t* last = http_session->response;
-        while( last->next ) {
-            last = last->next;
-        }
-
-        last->next = response_in;
+        http_session->response_tail->next = response_in;
     } else {
         http_session->response = response_in;
     }
+    http_session->response_tail = response_in;
     return YMO_OKAY;
 }
 
@@ -175,6 +176,9 @@ ymo_status_t ymo_http_session_complete_response(
     if( response_out ) {
         ymo_log_trace("Freeing response_out (%p)", (void*)response_out);
         http_session->response = response_out->next;
+        if( !http_session->response ) {
+            http_session->response_tail = NULL;
+        }
         ymo_log_trace("New response_out: (%p)", (void*)http_session->response);
         ymo_http_response_free(response_out);
         return YMO_OKAY;
@@ -205,3 +209,17 @@ void* ymo_http_session_get_userdata(const ymo_http_session_t* session)
     return session->user_data;
 }
 
+
+void ymo_http_session_pause(ymo_http_session_t* session)
+{
+    ymo_log_trace("Pausing session: %p", (void*)session);
+    ymo_conn_rx_enable(session->conn, 0);
+}
+
+
+void ymo_http_session_resume(ymo_http_session_t* session)
+{
+    ymo_log_trace("Resuming session: %p", (void*)session);
+    ymo_conn_rx_enable(session->conn, 1);
+}
+
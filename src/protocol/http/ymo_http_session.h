@@ -49,9 +49,13 @@ typedef enum ymo_http_session_state {
 struct ymo_http_session {
     ymo_http_session_state_t  state;
     ymo_conn_t*               conn;
-    ymo_http_exchange_t*      exchange;
-    ymo_http_response_t*      response;
+    ymo_http_exchange_t*      exchange;      /* Request being received */
+    struct ymo_http_exchange_pool* pool;     /* Source of new exchanges */
+    ymo_http_response_t*      response;      /* Head of the response queue */
+    ymo_http_response_t*      response_tail; /* Tail of the response queue */
     ymo_bucket_t*             send_buffer;
+    ymo_bucket_t*             send_tail;     /* Last bucket in send_buffer */
+    size_t                    send_len;      /* Bytes on send_buffer */
     void*                     user_data;
 };
 
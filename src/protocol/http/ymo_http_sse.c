@@ -0,0 +1,546 @@
+/*=============================================================================
+ *
+ * Copyright (c) 2014 Andrew Canaday
+ *
+ * This file is part of libyimmo (sometimes referred to as "yimmo" or "ymo").
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *===========================================================================*/
+
+#include "yimmo_config.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "yimmo.h"
+#include "ymo_log.h"
+#include "ymo_alloc.h"
+#include "core/ymo_net.h"
+#include "ymo_http_exchange.h"
+#include "ymo_http_hdr_table.h"
+#include "ymo_http_response.h"
+#include "ymo_http_sse.h"
+
+/*---------------------------------------------------------------*
+ *  Declarations
+ *---------------------------------------------------------------*/
+
+#define SSE_ID     "id: "
+#define SSE_EVENT  "event: "
+#define SSE_DATA   "data: "
+#define SSE_RETRY  "retry: "
+
+/* Longest "id: <n>\n" or "retry: <n>\n\n" line: */
+#define SSE_FIELD_MAX 32
+
+#define SSE_LIT_LEN(s) (sizeof(s) - 1)
+
+
+/*---------------------------------------------------------------*
+ *  Events:
+ *---------------------------------------------------------------*/
+static void event_unref(ymo_http_sse_event_t* event)
+{
+    if( event && !--event->refs ) {
+        YMO_FREE(event);
+    }
+}
+
+
+/* Length of the line starting at data, and of the line break after it: */
+static size_t event_line(const char* data, size_t len, size_t* brk)
+{
+    size_t i = 0;
+    while( i < len && data[i] != '\n' && data[i] != '\r' ) {
+        i++;
+    }
+
+    *brk = 0;
+    if( i < len ) {
+        *brk = (data[i] == '\r' && i + 1 < len && data[i+1] == '\n') ? 2 : 1;
+    }
+    return i;
+}
+
+
+static ymo_http_sse_event_t* event_create(
+        uint64_t id, const char* event, const char* data, size_t len)
+{
+    char id_line[SSE_FIELD_MAX];
+    int id_len = snprintf(
+            id_line, sizeof(id_line), SSE_ID "%" PRIu64 "\n", id);
+    size_t event_len = event ? strlen(event) : 0;
+
+    /* Measure: */
+    size_t total = id_len + 1;
+    if( event ) {
+        total += SSE_LIT_LEN(SSE_EVENT) + event_len + 1;
+    }
+
+    const char* p = data;
+    size_t remain = len;
+    size_t brk;
+    do {
+        size_t line_len = event_line(p, remain, &brk);
+        total += SSE_LIT_LEN(SSE_DATA) + line_len + 1;
+        p += line_len + brk;
+        remain -= line_len + brk;
+    } while( brk );
+
+    ymo_http_sse_event_t* sse_event = YMO_ALLOC(
+            sizeof(ymo_http_sse_event_t) + total);
+    if( !sse_event ) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    sse_event->id = id;
+    sse_event->len = total;
+    sse_event->refs = 1;
+
+    /* Format: */
+    char* out = sse_event->data;
+    memcpy(out, id_line, id_len);
+    out += id_len;
+    if( event ) {
+        memcpy(out, SSE_EVENT, SSE_LIT_LEN(SSE_EVENT));
+        out += SSE_LIT_LEN(SSE_EVENT);
+        memcpy(out, event, event_len);
+        out += event_len;
+        *out++ = '\n';
+    }
+
+    p = data;
+    remain = len;
+    do {
+        size_t line_len = event_line(p, remain, &brk);
+        memcpy(out, SSE_DATA, SSE_LIT_LEN(SSE_DATA));
+        out += SSE_LIT_LEN(SSE_DATA);
+        memcpy(out, p, line_len);
+        out += line_len;
+        *out++ = '\n';
+        p += line_len + brk;
+        remain -= line_len + brk;
+    } while( brk );
+    *out = '\n';
+    return sse_event;
+}
+
+
+/* Event buckets keep a reference to the event in buf (cleared before the
+ * bucket is freed, so the event isn't):
+ */
+static void event_bucket_free(ymo_bucket_t* bucket)
+{
+    event_unref((ymo_http_sse_event_t*)bucket->buf);
+    bucket->buf = NULL;
+}
+
+
+static ymo_bucket_t* event_bucket(ymo_http_sse_event_t* event)
+{
+    ymo_bucket_t* bucket = YMO_BUCKET_FROM_REF(event->data, event->len);
+    if( bucket ) {
+        bucket->buf = (char*)event;
+        bucket->cleanup_cb = &event_bucket_free;
+        event->refs++;
+    }
+    return bucket;
+}
+
+
+/*---------------------------------------------------------------*
+ *  Subscribers:
+ *---------------------------------------------------------------*/
+
+/* Move a subscriber to the back of the hub's keep-alive list: */
+static void sub_touch(ymo_http_sse_hub_t* hub, ymo_http_sse_sub_t* sub)
+{
+    sub->tick = hub->tick;
+    if( hub->k_tail == sub ) {
+        return;
+    }
+
+    /* Unlink (if linked): */
+    if( sub->k_prev ) {
+        sub->k_prev->k_next = sub->k_next;
+    } else if( hub->k_head == sub ) {
+        hub->k_head = sub->k_next;
+    }
+    if( sub->k_next ) {
+        sub->k_next->k_prev = sub->k_prev;
+    }
+
+    /* Append: */
+    sub->k_next = NULL;
+    sub->k_prev = hub->k_tail;
+    if( hub->k_tail ) {
+        hub->k_tail->k_next = sub;
+    } else {
+        hub->k_head = sub;
+    }
+    hub->k_tail = sub;
+}
+
+
+static void sub_unlink(ymo_http_sse_sub_t* sub)
+{
+    ymo_http_sse_channel_t* channel = sub->channel;
+    ymo_http_sse_hub_t* hub = channel->hub;
+
+    if( sub->c_prev ) {
+        sub->c_prev->c_next = sub->c_next;
+    } else {
+        channel->subs = sub->c_next;
+    }
+    if( sub->c_next ) {
+        sub->c_next->c_prev = sub->c_prev;
+    }
+    channel->no_subs--;
+
+    if( sub->k_prev ) {
+        sub->k_prev->k_next = sub->k_next;
+    } else {
+        hub->k_head = sub->k_next;
+    }
+    if( sub->k_next ) {
+        sub->k_next->k_prev = sub->k_prev;
+    } else {
+        hub->k_tail = sub->k_prev;
+    }
+}
+
+
+/* End a subscription and finish its response: */
+static void sub_close(ymo_http_sse_sub_t* sub)
+{
+    ymo_http_response_t* response = sub->response;
+    sub_unlink(sub);
+    response->sse_sub = NULL;
+    YMO_DELETE(ymo_http_sse_sub_t, sub);
+    ymo_http_response_finish(response);
+}
+
+
+static ymo_status_t sub_write(
+        ymo_http_sse_sub_t* sub, ymo_bucket_t* bucket)
+{
+    if( !bucket ) {
+        return ENOMEM;
+    }
+    ymo_http_response_body_append(sub->response, bucket);
+    sub_touch(sub->channel->hub, sub);
+    return YMO_OKAY;
+}
+
+
+/*---------------------------------------------------------------*
+ *  Hub:
+ *---------------------------------------------------------------*/
+static void hub_timer_cb(struct ev_loop* loop, ev_timer* w, int revents)
+{
+    ymo_http_sse_hub_tick(w->data);
+}
+
+
+ymo_http_sse_hub_t* ymo_http_sse_hub_create(
+        struct ev_loop* loop, double keepalive)
+{
+    ymo_http_sse_hub_t* hub = YMO_NEW0(ymo_http_sse_hub_t);
+    if( !hub ) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    hub->loop = loop;
+    ev_timer_init(&hub->timer, &hub_timer_cb, keepalive, keepalive);
+    hub->timer.data = hub;
+    if( loop && keepalive > 0 ) {
+        ev_timer_start(loop, &hub->timer);
+    }
+    return hub;
+}
+
+
+size_t ymo_http_sse_hub_tick(ymo_http_sse_hub_t* hub)
+{
+    static const char* comment = YMO_HTTP_SSE_KEEPALIVE;
+    size_t no_sent = 0;
+
+    /* Idle since the last tick, in order, until we hit a busy one: */
+    ymo_http_sse_sub_t* sub;
+    while( (sub = hub->k_head) && sub->tick < hub->tick ) {
+        if( sub_write(sub, YMO_BUCKET_FROM_REF(
+                        comment, SSE_LIT_LEN(YMO_HTTP_SSE_KEEPALIVE))) ) {
+            break;
+        }
+        no_sent++;
+    }
+    hub->tick++;
+    return no_sent;
+}
+
+
+void ymo_http_sse_hub_free(ymo_http_sse_hub_t* hub)
+{
+    if( !hub ) {
+        return;
+    }
+
+    if( hub->loop ) {
+        ev_timer_stop(hub->loop, &hub->timer);
+    }
+    while( hub->channels ) {
+        ymo_http_sse_channel_free(hub->channels);
+    }
+    YMO_DELETE(ymo_http_sse_hub_t, hub);
+}
+
+
+/*---------------------------------------------------------------*
+ *  Channels:
+ *---------------------------------------------------------------*/
+ymo_http_sse_channel_t* ymo_http_sse_channel_create(
+        ymo_http_sse_hub_t* hub, size_t replay)
+{
+    ymo_http_sse_channel_t* channel = YMO_NEW0(ymo_http_sse_channel_t);
+    if( !channel ) {
+        goto channel_create_fail;
+    }
+
+    if( replay ) {
+        channel->ring = calloc(replay, sizeof(ymo_http_sse_event_t*));
+        if( !channel->ring ) {
+            YMO_DELETE(ymo_http_sse_channel_t, channel);
+            goto channel_create_fail;
+        }
+        channel->ring_max = replay;
+    }
+
+    channel->hub = hub;
+    channel->next = hub->channels;
+    if( hub->channels ) {
+        hub->channels->prev = channel;
+    }
+    hub->channels = channel;
+    return channel;
+
+channel_create_fail:
+    errno = ENOMEM;
+    return NULL;
+}
+
+
+void ymo_http_sse_channel_set_retry(
+        ymo_http_sse_channel_t* channel, unsigned int retry_ms)
+{
+    channel->retry = retry_ms;
+}
+
+
+size_t ymo_http_sse_channel_subscribers(
+        const ymo_http_sse_channel_t* channel)
+{
+    return channel->no_subs;
+}
+
+
+void ymo_http_sse_channel_free(ymo_http_sse_channel_t* channel)
+{
+    if( !channel ) {
+        return;
+    }
+
+    while( channel->subs ) {
+        sub_close(channel->subs);
+    }
+
+    for( size_t i = 0; i < channel->ring_len; i++ ) {
+        event_unref(channel->ring[
+                (channel->ring_head + i) % channel->ring_max]);
+    }
+    free(channel->ring);
+
+    ymo_http_sse_hub_t* hub = channel->hub;
+    if( channel->prev ) {
+        channel->prev->next = channel->next;
+    } else {
+        hub->channels = channel->next;
+    }
+    if( channel->next ) {
+        channel->next->prev = channel->prev;
+    }
+    YMO_DELETE(ymo_http_sse_channel_t, channel);
+}
+
+
+/* Keep an event for replay, dropping the oldest if the ring is full: */
+static void channel_keep(
+        ymo_http_sse_channel_t* channel, ymo_http_sse_event_t* event)
+{
+    if( !channel->ring_max ) {
+        return;
+    }
+
+    event->refs++;
+    if( channel->ring_len < channel->ring_max ) {
+        channel->ring[(channel->ring_head + channel->ring_len++)
+            % channel->ring_max] = event;
+    } else {
+        event_unref(channel->ring[channel->ring_head]);
+        channel->ring[channel->ring_head] = event;
+        channel->ring_head = (channel->ring_head + 1) % channel->ring_max;
+    }
+}
+
+
+/* Send the events after last_id which are still in the ring: */
+static ymo_status_t channel_replay(
+        ymo_http_sse_channel_t* channel,
+        ymo_http_sse_sub_t* sub,
+        uint64_t last_id)
+{
+    for( size_t i = 0; i < channel->ring_len; i++ ) {
+        ymo_http_sse_event_t* event = channel->ring[
+            (channel->ring_head + i) % channel->ring_max];
+        if( event->id > last_id ) {
+            ymo_status_t status = sub_write(sub, event_bucket(event));
+            if( status != YMO_OKAY ) {
+                return status;
+            }
+        }
+    }
+    return YMO_OKAY;
+}
+
+
+/*---------------------------------------------------------------*
+ *  Subscribe/Publish:
+ *---------------------------------------------------------------*/
+ymo_status_t ymo_http_sse_subscribe(
+        ymo_http_sse_channel_t* channel,
+        ymo_http_request_t* request,
+        ymo_http_response_t* response)
+{
+    /* Without chunked encoding, nothing would be sent until we finish: */
+    if( !(response->flags & YMO_HTTP_FLAG_SUPPORTS_CHUNKED) ) {
+        return ymo_http_response_issue(
+                response, YMO_HTTP_HTTP_VERSION_NOT_SUPPORTED);
+    }
+
+    ymo_http_sse_sub_t* sub = YMO_NEW0(ymo_http_sse_sub_t);
+    if( !sub ) {
+        return ENOMEM;
+    }
+
+    ymo_http_response_set_status(response, YMO_HTTP_OK);
+    ymo_http_response_insert_header(
+            response, "Content-Type", "text/event-stream");
+    ymo_http_response_insert_header(response, "Cache-Control", "no-cache");
+    ymo_http_response_set_compression(response, 0);
+
+    sub->channel = channel;
+    sub->response = response;
+    response->sse_sub = sub;
+    sub->c_next = channel->subs;
+    if( channel->subs ) {
+        channel->subs->c_prev = sub;
+    }
+    channel->subs = sub;
+    channel->no_subs++;
+
+    /* Something goes out right away, so the client sees the headers: */
+    ymo_bucket_t* first;
+    if( channel->retry ) {
+        char retry[SSE_FIELD_MAX];
+        int len = snprintf(retry, sizeof(retry),
+                SSE_RETRY "%u\n\n", channel->retry);
+        first = YMO_BUCKET_FROM_CPY(retry, len);
+    } else {
+        first = YMO_BUCKET_FROM_REF(
+                YMO_HTTP_SSE_KEEPALIVE, SSE_LIT_LEN(YMO_HTTP_SSE_KEEPALIVE));
+    }
+    ymo_status_t status = sub_write(sub, first);
+
+    const char* last_event_id = ymo_http_hdr_table_get(
+            &request->headers, "Last-Event-ID");
+    if( status == YMO_OKAY && last_event_id && *last_event_id ) {
+        char* end = NULL;
+        errno = 0;
+        uint64_t last_id = strtoull(last_event_id, &end, 10);
+        if( !errno && !*end ) {
+            status = channel_replay(channel, sub, last_id);
+        }
+    }
+
+    if( status != YMO_OKAY ) {
+        ymo_http_sse_release(response);
+        return status;
+    }
+    return YMO_WOULDBLOCK;
+}
+
+
+ymo_status_t ymo_http_sse_publish(
+        ymo_http_sse_channel_t* channel,
+        const char* event,
+        const char* data,
+        size_t len)
+{
+    if( event && strpbrk(event, "\r\n") ) {
+        return EINVAL;
+    }
+
+    ymo_http_sse_event_t* sse_event = event_create(
+            channel->last_id + 1, event, data, len);
+    if( !sse_event ) {
+        return ENOMEM;
+    }
+    channel->last_id++;
+    channel_keep(channel, sse_event);
+
+    ymo_status_t status = YMO_OKAY;
+    ymo_http_sse_sub_t* sub = channel->subs;
+    while( sub ) {
+        ymo_http_sse_sub_t* next = sub->c_next;
+
+        /* Cut off anyone too far behind (they'll reconnect and replay): */
+        if( !ymo_http_response_writable(sub->response) ) {
+            ymo_log_debug("SSE: closing stream for slow subscriber %p",
+                    (void*)sub->response);
+            sub_close(sub);
+        } else if( sub_write(sub, event_bucket(sse_event)) ) {
+            status = ENOMEM;
+            break;
+        }
+        sub = next;
+    }
+
+    event_unref(sse_event);
+    return status;
+}
+
+
+void ymo_http_sse_release(ymo_http_response_t* response)
+{
+    ymo_http_sse_sub_t* sub = response->sse_sub;
+    if( sub ) {
+        sub_unlink(sub);
+        response->sse_sub = NULL;
+        YMO_DELETE(ymo_http_sse_sub_t, sub);
+    }
+}
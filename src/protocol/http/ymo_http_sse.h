@@ -0,0 +1,128 @@
+/*=============================================================================
+ *
+ * Copyright (c) 2014 Andrew Canaday
+ *
+ * This file is part of libyimmo (sometimes referred to as "yimmo" or "ymo").
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *===========================================================================*/
+
+
+
+#ifndef YMO_HTTP_SSE_H
+#define YMO_HTTP_SSE_H
+#include "yimmo_config.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#include "yimmo.h"
+#include "ymo_http.h"
+
+/** Server-Sent Events
+ * ====================
+ *
+ * Internals for SSE hubs (see :c:func:`ymo_http_sse_hub_create`).
+ *
+ * Published events are formatted once, into a reference counted
+ * :c:type:`ymo_http_sse_event_t`. Each subscriber's response gets a bucket
+ * which points at the event's data and drops a reference when it's freed
+ * (i.e. once it's been sent); the channel's replay ring holds one more.
+ *
+ * Every subscriber is on two lists: its channel's (for publishing) and the
+ * hub's keep-alive list, which is kept in order of last write. On each
+ * keep-alive tick, the hub walks the list from the front — least recently
+ * written — sending comments until it reaches a subscriber which has been
+ * written to since the previous tick, so a tick only costs as much as the
+ * number of idle subscribers.
+ */
+
+/**---------------------------------------------------------------
+ * Definitions
+ *---------------------------------------------------------------*/
+
+/** Comment sent to idle subscribers. */
+#define YMO_HTTP_SSE_KEEPALIVE ":\n\n"
+
+
+/**---------------------------------------------------------------
+ * Types
+ *---------------------------------------------------------------*/
+
+typedef struct ymo_http_sse_event ymo_http_sse_event_t;
+typedef struct ymo_http_sse_sub ymo_http_sse_sub_t;
+
+/** Formatted event (shared by every subscriber it's sent to). */
+struct ymo_http_sse_event {
+    uint64_t                 id;
+    size_t                   len;
+    int                      refs;
+    char                     data[];
+};
+
+/** Subscriber: a response streaming a channel. */
+struct ymo_http_sse_sub {
+    ymo_http_sse_channel_t*  channel;
+    ymo_http_response_t*     response;
+    uint64_t                 tick;       /* Hub tick of the last write */
+    ymo_http_sse_sub_t*      c_prev;     /* Channel subscribers */
+    ymo_http_sse_sub_t*      c_next;
+    ymo_http_sse_sub_t*      k_prev;     /* Written to less recently */
+    ymo_http_sse_sub_t*      k_next;     /* Written to more recently */
+};
+
+/** Channel. */
+struct ymo_http_sse_channel {
+    ymo_http_sse_hub_t*      hub;
+    uint64_t                 last_id;
+    unsigned int             retry;      /* ms, or 0 */
+    size_t                   no_subs;
+    ymo_http_sse_sub_t*      subs;
+    size_t                   ring_max;   /* Replay capacity */
+    size_t                   ring_len;
+    size_t                   ring_head;  /* Index of the oldest event */
+    ymo_http_sse_event_t**   ring;
+    ymo_http_sse_channel_t*  prev;       /* Hub channels */
+    ymo_http_sse_channel_t*  next;
+};
+
+/** Hub. */
+struct ymo_http_sse_hub {
+    struct ev_loop*          loop;
+    ev_timer                 timer;      /* Keep-alive ticks */
+    uint64_t                 tick;
+    ymo_http_sse_sub_t*      k_head;     /* Least recently written */
+    ymo_http_sse_sub_t*      k_tail;     /* Most recently written */
+    ymo_http_sse_channel_t*  channels;
+};
+
+
+/**---------------------------------------------------------------
+ * Functions
+ *---------------------------------------------------------------*/
+
+/** Send keep-alive comments to every subscriber which hasn't been written
+ * to since the last tick, then start the next tick. Invoked by the hub's
+ * timer.
+ *
+ * :returns: the number of comments sent
+ */
+size_t ymo_http_sse_hub_tick(ymo_http_sse_hub_t* hub);
+
+/** End a response's subscription, if it has one (the response is freed, or
+ * being recycled).
+ */
+void ymo_http_sse_release(ymo_http_response_t* response);
+
+#endif /* YMO_HTTP_SSE_H */
@@ -0,0 +1,1127 @@
+/*=============================================================================
+ *
+ * Copyright (c) 2014 Andrew Canaday
+ *
+ * This file is part of libyimmo (sometimes referred to as "yimmo" or "ymo").
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *===========================================================================*/
+
+#include "yimmo_config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "yimmo.h"
+#include "ymo_log.h"
+#include "ymo_alloc.h"
+#include "ymo_util.h"
+#include "ymo_blalloc.h"
+#include "ymo_http_hdr_table.h"
+#include "ymo_http_response.h"
+#include "ymo_http_scan.h"
+#include "ymo_http_static.h"
+
+/*---------------------------------------------------------------*
+ *  Declarations
+ *---------------------------------------------------------------*/
+
+#define STATIC_OWS(c) ((c) == ' ' || (c) == '\t')
+
+#define STATIC_INDEX "index.html"
+
+/* Content types, by file extension: */
+static const struct {
+    const char* ext;
+    const char* type;
+} static_types[] = {
+    { "html",  "text/html; charset=utf-8" },
+    { "htm",   "text/html; charset=utf-8" },
+    { "css",   "text/css; charset=utf-8" },
+    { "js",    "text/javascript; charset=utf-8" },
+    { "mjs",   "text/javascript; charset=utf-8" },
+    { "json",  "application/json" },
+    { "map",   "application/json" },
+    { "txt",   "text/plain; charset=utf-8" },
+    { "csv",   "text/csv; charset=utf-8" },
+    { "md",    "text/markdown; charset=utf-8" },
+    { "xml",   "application/xml" },
+    { "svg",   "image/svg+xml" },
+    { "png",   "image/png" },
+    { "jpg",   "image/jpeg" },
+    { "jpeg",  "image/jpeg" },
+    { "gif",   "image/gif" },
+    { "webp",  "image/webp" },
+    { "avif",  "image/avif" },
+    { "ico",   "image/x-icon" },
+    { "woff",  "font/woff" },
+    { "woff2", "font/woff2" },
+    { "ttf",   "font/ttf" },
+    { "otf",   "font/otf" },
+    { "wasm",  "application/wasm" },
+    { "pdf",   "application/pdf" },
+    { "zip",   "application/zip" },
+    { "gz",    "application/gzip" },
+    { "mp3",   "audio/mpeg" },
+    { "ogg",   "audio/ogg" },
+    { "wav",   "audio/wav" },
+    { "mp4",   "video/mp4" },
+    { "webm",  "video/webm" },
+};
+
+#define STATIC_NO_TYPES (sizeof(static_types)/sizeof(static_types[0]))
+#define STATIC_DEFAULT_TYPE "application/octet-stream"
+
+/* Precompressed siblings, in order of preference: */
+static const struct {
+    const char* coding;
+    const char* ext;
+    size_t      ext_len;
+} static_encodings[] = {
+    { "br",   ".br",  3 },
+    { "zstd", ".zst", 4 },
+    { "gzip", ".gz",  3 },
+};
+
+#define STATIC_NO_ENCODINGS \
+    (sizeof(static_encodings)/sizeof(static_encodings[0]))
+
+
+/*---------------------------------------------------------------*
+ *  Parsing:
+ *---------------------------------------------------------------*/
+static int hex_val(char c)
+{
+    if( c >= '0' && c <= '9' ) {
+        return c - '0';
+    }
+    c = ymo_tolower(c);
+    if( c >= 'a' && c <= 'f' ) {
+        return c - 'a' + 10;
+    }
+    return -1;
+}
+
+
+ssize_t ymo_http_static_path(char* dst, size_t dst_len, const char* path)
+{
+    size_t len = 0;
+    size_t seg = 0;
+    const char* p = path;
+    const char* path_end = path + strlen(path);
+
+    for( ;; )
+    {
+        /* Copy runs of plain segment bytes in one go: */
+        size_t run = ymo_http_scan_path(p, path_end - p);
+        if( run ) {
+            if( len + run >= dst_len ) {
+                errno = ENAMETOOLONG;
+                return -1;
+            }
+            memcpy(dst + len, p, run);
+            len += run;
+            p += run;
+        }
+
+        int end = (*p == '\0');
+        char c = *p;
+
+        if( c == '%' ) {
+            int hi = hex_val(p[1]);
+            int lo = (hi < 0) ? -1 : hex_val(p[2]);
+            if( lo < 0 ) {
+                errno = EINVAL;
+                return -1;
+            }
+            c = (char)((hi << 4) | lo);
+            if( c == '\0' ) {
+                errno = EINVAL;
+                return -1;
+            }
+            p += 3;
+        } else if( !end ) {
+            ++p;
+        }
+
+        /* End of a segment (a decoded "%2F" is a separator, too): */
+        if( end || c == '/' ) {
+            size_t seg_len = len - seg;
+            if( seg_len == 2 && dst[seg] == '.' && dst[seg+1] == '.' ) {
+                errno = EINVAL;
+                return -1;
+            }
+
+            if( !seg_len || (seg_len == 1 && dst[seg] == '.') ) {
+                len = seg;
+            } else if( !end ) {
+                if( len + 1 >= dst_len ) {
+                    errno = ENAMETOOLONG;
+                    return -1;
+                }
+                dst[len++] = '/';
+            }
+
+            if( end ) {
+                break;
+            }
+            seg = len;
+            continue;
+        }
+
+        if( len + 1 >= dst_len ) {
+            errno = ENAMETOOLONG;
+            return -1;
+        }
+        dst[len++] = c;
+    }
+
+    if( len && dst[len-1] == '/' ) {
+        --len;
+    }
+    dst[len] = '\0';
+    return (ssize_t)len;
+}
+
+
+/* Parse a run of digits, saturating at INT64_MAX. Returns the number of
+ * digits consumed:
+ */
+static size_t parse_digits(const char* p, int64_t* n)
+{
+    const char* start = p;
+    int64_t v = 0;
+    while( *p >= '0' && *p <= '9' ) {
+        int d = *p++ - '0';
+        v = (v > (INT64_MAX - d) / 10) ? INT64_MAX : (v * 10) + d;
+    }
+    *n = v;
+    return (size_t)(p - start);
+}
+
+
+int ymo_http_static_ranges(
+        ymo_http_static_range_t* ranges, const char* value, off_t size)
+{
+    const char* p = value;
+    int no_specs = 0;
+    int n = 0;
+
+    while( STATIC_OWS(*p) ) {
+        ++p;
+    }
+    if( strncasecmp(p, "bytes", 5) ) {
+        return -1;
+    }
+    p += 5;
+    while( STATIC_OWS(*p) ) {
+        ++p;
+    }
+    if( *p++ != '=' ) {
+        return -1;
+    }
+
+    for( ;; )
+    {
+        while( STATIC_OWS(*p) || *p == ',' ) {
+            ++p;
+        }
+        if( !*p ) {
+            break;
+        }
+
+        if( ++no_specs > YMO_HTTP_STATIC_MAX_RANGES ) {
+            return -1;
+        }
+
+        int64_t first, last;
+        int satisfiable = 1;
+        if( *p == '-' ) {
+            /* Suffix range: the last N bytes. */
+            size_t d = parse_digits(++p, &last);
+            if( !d ) {
+                return -1;
+            }
+            p += d;
+            if( !last || !size ) {
+                satisfiable = 0;
+            } else {
+                first = (last < size) ? size - last : 0;
+                last = size - 1;
+            }
+        } else {
+            size_t d = parse_digits(p, &first);
+            if( !d || p[d] != '-' ) {
+                return -1;
+            }
+            p += d + 1;
+
+            d = parse_digits(p, &last);
+            if( d ) {
+                if( last < first ) {
+                    return -1;
+                }
+                p += d;
+            } else {
+                last = INT64_MAX;
+            }
+
+            if( first >= size ) {
+                satisfiable = 0;
+            } else if( last >= size ) {
+                last = size - 1;
+            }
+        }
+
+        while( STATIC_OWS(*p) ) {
+            ++p;
+        }
+        if( *p && *p != ',' ) {
+            return -1;
+        }
+
+        if( satisfiable ) {
+            ranges[n].first = (off_t)first;
+            ranges[n].last = (off_t)last;
+            ++n;
+        }
+    }
+
+    return no_specs ? n : -1;
+}
+
+
+static int month_no(const char* m)
+{
+    static const char* const months = "JanFebMarAprMayJunJulAugSepOctNovDec";
+    for( int i = 0; i < 12; i++ ) {
+        if( !strncmp(m, months + (i * 3), 3) ) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+
+static int parse_2digit(const char* p)
+{
+    if( p[0] < '0' || p[0] > '9' || p[1] < '0' || p[1] > '9' ) {
+        return -1;
+    }
+    return (p[0] - '0') * 10 + (p[1] - '0');
+}
+
+
+ymo_status_t ymo_http_static_parse_date(const char* value, time_t* t)
+{
+    /* "Sun, 06 Nov 1994 08:49:37 GMT": */
+    if( strlen(value) != YMO_HTTP_DATE_LEN
+            || value[3] != ',' || value[4] != ' ' || value[7] != ' '
+            || value[11] != ' ' || value[16] != ' ' || value[19] != ':'
+            || value[22] != ':' || strcmp(value + 25, " GMT") ) {
+        return EINVAL;
+    }
+
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    int century = parse_2digit(value + 12);
+    int year = parse_2digit(value + 14);
+    tm.tm_mday = parse_2digit(value + 5);
+    tm.tm_mon = month_no(value + 8);
+    tm.tm_hour = parse_2digit(value + 17);
+    tm.tm_min = parse_2digit(value + 20);
+    tm.tm_sec = parse_2digit(value + 23);
+    if( century < 0 || year < 0 || tm.tm_mday < 1 || tm.tm_mon < 0
+            || tm.tm_hour < 0 || tm.tm_min < 0 || tm.tm_sec < 0 ) {
+        return EINVAL;
+    }
+    tm.tm_year = (century * 100) + year - 1900;
+
+    *t = timegm(&tm);
+    return YMO_OKAY;
+}
+
+
+/* If-None-Match (weak comparison): */
+static int static_etag_match(const char* value, const char* etag)
+{
+    size_t etag_len = strlen(etag);
+    const char* p = value;
+
+    while( *p )
+    {
+        while( STATIC_OWS(*p) || *p == ',' ) {
+            ++p;
+        }
+        if( !*p ) {
+            break;
+        }
+        if( *p == '*' ) {
+            return 1;
+        }
+        if( p[0] == 'W' && p[1] == '/' ) {
+            p += 2;
+        }
+        if( *p != '"' ) {
+            return 0;
+        }
+
+        const char* close = strchr(p + 1, '"');
+        if( !close ) {
+            return 0;
+        }
+        if( (size_t)(close + 1 - p) == etag_len
+                && !memcmp(p, etag, etag_len) ) {
+            return 1;
+        }
+        p = close + 1;
+    }
+    return 0;
+}
+
+
+/* If-Range (strong comparison, or an exact date match): */
+static int static_if_range(
+        const char* value, const ymo_http_static_file_t* file)
+{
+    while( STATIC_OWS(*value) ) {
+        ++value;
+    }
+    if( *value == '"' || *value == 'W' ) {
+        return !strcmp(value, file->etag);
+    }
+
+    time_t t;
+    return ymo_http_static_parse_date(value, &t) == YMO_OKAY
+           && t == file->mtime;
+}
+
+
+/*---------------------------------------------------------------*
+ *  File Cache:
+ *---------------------------------------------------------------*/
+static uint32_t static_hash(const char* path, size_t len)
+{
+    /* FNV-1a: */
+    uint32_t hash = 2166136261u;
+    for( size_t i = 0; i < len; i++ ) {
+        hash = (hash ^ (uint8_t)path[i]) * 16777619u;
+    }
+    return hash;
+}
+
+
+static const char* static_content_type(const char* path, size_t len)
+{
+    const char* ext = NULL;
+    for( size_t i = len; i > 0; i-- ) {
+        if( path[i-1] == '/' ) {
+            break;
+        }
+        if( path[i-1] == '.' ) {
+            ext = path + i;
+            break;
+        }
+    }
+
+    if( ext ) {
+        for( size_t i = 0; i < STATIC_NO_TYPES; i++ ) {
+            if( !strcasecmp(ext, static_types[i].ext) ) {
+                return static_types[i].type;
+            }
+        }
+    }
+    return STATIC_DEFAULT_TYPE;
+}
+
+
+static void lru_unlink(ymo_http_static_t* handler, ymo_http_static_file_t* file)
+{
+    if( file->lru_prev ) {
+        file->lru_prev->lru_next = file->lru_next;
+    } else {
+        handler->lru_head = file->lru_next;
+    }
+
+    if( file->lru_next ) {
+        file->lru_next->lru_prev = file->lru_prev;
+    } else {
+        handler->lru_tail = file->lru_prev;
+    }
+    file->lru_prev = file->lru_next = NULL;
+}
+
+
+static void lru_push(ymo_http_static_t* handler, ymo_http_static_file_t* file)
+{
+    file->lru_prev = NULL;
+    file->lru_next = handler->lru_head;
+    if( handler->lru_head ) {
+        handler->lru_head->lru_prev = file;
+    } else {
+        handler->lru_tail = file;
+    }
+    handler->lru_head = file;
+}
+
+
+static void file_close(ymo_http_static_file_t* file)
+{
+    if( file->fd >= 0 ) {
+        close(file->fd);
+        file->fd = -1;
+    }
+}
+
+
+static void file_free(ymo_http_static_t* handler, ymo_http_static_file_t* file)
+{
+    ymo_http_static_file_t** slot =
+        &handler->table[file->hash & handler->table_mask];
+    while( *slot != file ) {
+        slot = &(*slot)->h_next;
+    }
+    *slot = file->h_next;
+
+    lru_unlink(handler, file);
+    file_close(file);
+    --handler->no_files;
+    YMO_FREE(file->path);
+    YMO_DELETE(ymo_http_static_file_t, file);
+}
+
+
+/* (Re)open a cache entry: */
+static void file_load(
+        ymo_http_static_t* handler, ymo_http_static_file_t* file, time_t now)
+{
+    struct stat f_info;
+
+    file_close(file);
+    file->checked = now;
+    file->is_dir = 0;
+    file->err = 0;
+
+    /* O_NONBLOCK, so that opening a FIFO doesn't block (it's rejected): */
+    int fd = openat(handler->root_fd, file->path_len ? file->path : ".",
+            O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if( fd < 0 || fstat(fd, &f_info) < 0 ) {
+        file->err = errno;
+        if( fd >= 0 ) {
+            close(fd);
+        }
+        return;
+    }
+
+    file->dev = f_info.st_dev;
+    file->ino = f_info.st_ino;
+    file->size = f_info.st_size;
+    file->mtime = f_info.st_mtime;
+
+    if( S_ISDIR(f_info.st_mode) ) {
+        file->is_dir = 1;
+        close(fd);
+        return;
+    }
+
+    if( !S_ISREG(f_info.st_mode) ) {
+        file->err = ENOENT;
+        close(fd);
+        return;
+    }
+
+    file->fd = fd;
+    snprintf(file->etag, sizeof(file->etag), "\"%" PRIx64 "-%" PRIx64 "\"",
+            (uint64_t)file->mtime, (uint64_t)file->size);
+    ymo_http_date_format(file->last_modified, file->mtime);
+}
+
+
+/* Check a cache entry against the filesystem, reopening it if the file has
+ * been modified or replaced:
+ */
+static void file_revalidate(
+        ymo_http_static_t* handler, ymo_http_static_file_t* file, time_t now)
+{
+    struct stat f_info;
+    file->checked = now;
+
+    if( fstatat(handler->root_fd, file->path_len ? file->path : ".",
+                &f_info, 0) < 0 ) {
+        file_close(file);
+        file->is_dir = 0;
+        file->err = errno;
+        return;
+    }
+
+    if( (file->fd >= 0 || file->is_dir)
+            && f_info.st_dev == file->dev && f_info.st_ino == file->ino
+            && f_info.st_size == file->size
+            && f_info.st_mtime == file->mtime ) {
+        return;
+    }
+
+    ymo_log_debug("Reloading static file: %s", file->path);
+    file_load(handler, file, now);
+}
+
+
+static ymo_http_static_file_t* static_file_get(
+        ymo_http_static_t* handler, const char* path, size_t len, time_t now)
+{
+    uint32_t hash = static_hash(path, len);
+    ymo_http_static_file_t* file = handler->table[hash & handler->table_mask];
+
+    while( file ) {
+        if( file->hash == hash && file->path_len == len
+                && !memcmp(file->path, path, len) ) {
+            if( now - file->checked >= handler->revalidate ) {
+                file_revalidate(handler, file, now);
+            }
+            lru_unlink(handler, file);
+            lru_push(handler, file);
+            return file;
+        }
+        file = file->h_next;
+    }
+
+    /* Miss: */
+    if( handler->no_files >= handler->max_files ) {
+        file_free(handler, handler->lru_tail);
+    }
+
+    file = YMO_NEW0(ymo_http_static_file_t);
+    if( !file ) {
+        return NULL;
+    }
+
+    file->path = YMO_ALLOC(len + 1);
+    if( !file->path ) {
+        YMO_DELETE(ymo_http_static_file_t, file);
+        return NULL;
+    }
+    memcpy(file->path, path, len);
+    file->path[len] = '\0';
+    file->path_len = len;
+    file->hash = hash;
+    file->fd = -1;
+    file->type = static_content_type(file->path, len);
+
+    ymo_http_static_file_t** slot = &handler->table[hash & handler->table_mask];
+    file->h_next = *slot;
+    *slot = file;
+    lru_push(handler, file);
+    ++handler->no_files;
+
+    file_load(handler, file, now);
+    return file;
+}
+
+
+static void static_cache_clear(ymo_http_static_t* handler)
+{
+    while( handler->lru_tail ) {
+        file_free(handler, handler->lru_tail);
+    }
+}
+
+
+/*---------------------------------------------------------------*
+ *  Responses:
+ *---------------------------------------------------------------*/
+static ymo_status_t static_status(
+        ymo_http_response_t* response, ymo_http_status_t status)
+{
+    ymo_http_response_set_status(response, status);
+    ymo_http_response_finish(response);
+    return YMO_OKAY;
+}
+
+
+/* Format a header value in the request workspace: */
+static const char* static_hdr_fmt(
+        ymo_http_request_t* request, const char* fmt, ...)
+{
+    char buf[256];
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+    if( len < 0 || (size_t)len >= sizeof(buf) ) {
+        return NULL;
+    }
+    return ymo_blalloc_strdup(request->ws, buf);
+}
+
+
+/* Redirect a directory request to the same path, with a trailing '/': */
+static ymo_status_t static_redirect(
+        ymo_http_request_t* request, ymo_http_response_t* response)
+{
+    const char* location = request->query
+        ? static_hdr_fmt(request, "%s/?%s", request->uri, request->query)
+        : static_hdr_fmt(request, "%s/", request->uri);
+    if( !location ) {
+        return static_status(response, YMO_HTTP_REQUEST_URI_TOO_LONG);
+    }
+
+    ymo_http_response_insert_header(response, "Location", location);
+    return static_status(response, YMO_HTTP_MOVED_PERMANENTLY);
+}
+
+
+/* Bucket for a range of the file (on a descriptor of its own): */
+static ymo_bucket_t* static_file_bucket(
+        int fd, off_t offset, size_t len, int owner)
+{
+    ymo_bucket_t* bucket = ymo_bucket_create_file(NULL, NULL,
+            fd, offset, len, owner ? &ymo_bucket_close_fd : NULL);
+    if( !bucket && owner ) {
+        close(fd);
+    }
+    return bucket;
+}
+
+
+static ymo_status_t static_send_ranges(
+        ymo_http_static_t* handler,
+        ymo_http_request_t* request,
+        ymo_http_response_t* response,
+        const ymo_http_static_file_t* file,
+        const char* type,
+        const ymo_http_static_range_t* ranges,
+        int no_ranges)
+{
+    const char* boundary = static_hdr_fmt(request, "%08" PRIx32 "%016" PRIx64,
+            (uint32_t)time(NULL), ++handler->boundary_no);
+    const char* content_type = boundary
+        ? static_hdr_fmt(request, "multipart/byteranges; boundary=%s", boundary)
+        : NULL;
+    if( !content_type ) {
+        return static_status(response, YMO_HTTP_INTERNAL_SERVER_ERROR);
+    }
+
+    int fd = fcntl(file->fd, F_DUPFD_CLOEXEC, 0);
+    if( fd < 0 ) {
+        ymo_log_warning("Failed to dup static file descriptor: %s",
+                strerror(errno));
+        return static_status(response, YMO_HTTP_INTERNAL_SERVER_ERROR);
+    }
+
+    /* Each part is a header bucket and a file bucket. The file buckets share
+     * a descriptor, owned (and closed) by the last, since buckets are sent
+     * and freed in order:
+     */
+    ymo_bucket_t* head = NULL;
+    ymo_bucket_t* tail = NULL;
+    char part_hdr[512];
+    for( int i = 0; i < no_ranges; i++ )
+    {
+        int len = snprintf(part_hdr, sizeof(part_hdr),
+                "\r\n--%s\r\n"
+                "Content-Type: %s\r\n"
+                "Content-Range: bytes %" PRId64 "-%" PRId64 "/%" PRId64 "\r\n"
+                "\r\n",
+                boundary, type, (int64_t)ranges[i].first,
+                (int64_t)ranges[i].last, (int64_t)file->size);
+
+        ymo_bucket_t* part = YMO_BUCKET_FROM_CPY(part_hdr, (size_t)len);
+        ymo_bucket_t* data = part ? static_file_bucket(fd, ranges[i].first,
+                    (size_t)(ranges[i].last - ranges[i].first + 1),
+                    i == no_ranges - 1) : NULL;
+        if( !data ) {
+            ymo_bucket_free(part);
+            ymo_bucket_free_all(head);
+            if( i < no_ranges - 1 || !part ) {
+                close(fd);
+            }
+            return static_status(response, YMO_HTTP_INTERNAL_SERVER_ERROR);
+        }
+
+        part->next = data;
+        if( tail ) {
+            tail->next = part;
+        } else {
+            head = part;
+        }
+        tail = data;
+    }
+
+    int len = snprintf(part_hdr, sizeof(part_hdr), "\r\n--%s--\r\n", boundary);
+    ymo_bucket_t* end = YMO_BUCKET_FROM_CPY(part_hdr, (size_t)len);
+    if( !end ) {
+        ymo_bucket_free_all(head);
+        return static_status(response, YMO_HTTP_INTERNAL_SERVER_ERROR);
+    }
+    tail->next = end;
+
+    ymo_http_response_insert_header(response, "Content-Type", content_type);
+    ymo_http_response_set_status(response, YMO_HTTP_PARTIAL_CONTENT);
+    ymo_http_response_body_append(response, head);
+    ymo_http_response_finish(response);
+    return YMO_OKAY;
+}
+
+
+static ymo_status_t static_send(
+        ymo_http_static_t* handler,
+        ymo_http_request_t* request,
+        ymo_http_response_t* response,
+        const ymo_http_static_file_t* file,
+        const char* type,
+        const char* encoding,
+        int head)
+{
+    const ymo_http_hdr_table_t* headers = &request->headers;
+
+    /* The cache entry may be reloaded or evicted before the response head is
+     * serialized, so header values are copied into the request workspace:
+     */
+    const char* etag = ymo_blalloc_strdup(request->ws, file->etag);
+    const char* last_modified = ymo_blalloc_strdup(
+            request->ws, file->last_modified);
+    const char* size = static_hdr_fmt(request, "%" PRId64, (int64_t)file->size);
+    if( !etag || !last_modified || !size ) {
+        return static_status(response, YMO_HTTP_INTERNAL_SERVER_ERROR);
+    }
+
+    ymo_http_response_insert_header(response, "ETag", etag);
+    ymo_http_response_insert_header(response, "Last-Modified", last_modified);
+
+    /* Conditional requests (If-Modified-Since is ignored when If-None-Match
+     * is present). A 304 only carries the Content-Length a 200 would have:
+     */
+    const char* inm = ymo_http_hdr_table_get_id(
+            headers, YMO_HTTP_HID_IF_NONE_MATCH);
+    const char* ims = ymo_http_hdr_table_get_id(
+            headers, YMO_HTTP_HID_IF_MODIFIED_SINCE);
+    time_t ims_time;
+    if( inm ? static_etag_match(inm, file->etag)
+            : (ims && ymo_http_static_parse_date(ims, &ims_time) == YMO_OKAY
+               && file->mtime <= ims_time) ) {
+        ymo_http_response_insert_header(response, "Content-Length", size);
+        return static_status(response, YMO_HTTP_NOT_MODIFIED);
+    }
+
+    ymo_http_response_insert_header(response, "Accept-Ranges", "bytes");
+    if( encoding ) {
+        ymo_http_response_insert_header(response, "Content-Encoding", encoding);
+    }
+
+    /* Ranges (GET only): */
+    const char* range = head ? NULL : ymo_http_hdr_table_get_id(
+            headers, YMO_HTTP_HID_RANGE);
+    const char* if_range = ymo_http_hdr_table_get_id(
+            headers, YMO_HTTP_HID_IF_RANGE);
+    if( range && (!if_range || static_if_range(if_range, file)) ) {
+        ymo_http_static_range_t ranges[YMO_HTTP_STATIC_MAX_RANGES];
+        int no_ranges = ymo_http_static_ranges(ranges, range, file->size);
+
+        if( no_ranges == 0 ) {
+            const char* content_range = static_hdr_fmt(
+                    request, "bytes */%s", size);
+            if( content_range ) {
+                ymo_http_response_insert_header(
+                        response, "Content-Range", content_range);
+            }
+            return static_status(
+                    response, YMO_HTTP_REQUESTED_RANGE_NOT_SATISFIABLE);
+        }
+
+        /* Content-Encoding would apply to the whole multipart body, so
+         * multiple ranges of an encoded file get the whole thing:
+         */
+        if( no_ranges > 1 && !encoding ) {
+            return static_send_ranges(handler, request, response,
+                    file, type, ranges, no_ranges);
+        }
+
+        if( no_ranges == 1 ) {
+            const char* content_range = static_hdr_fmt(request,
+                    "bytes %" PRId64 "-%" PRId64 "/%s",
+                    (int64_t)ranges[0].first, (int64_t)ranges[0].last, size);
+            int fd = content_range ? fcntl(file->fd, F_DUPFD_CLOEXEC, 0) : -1;
+            ymo_bucket_t* body = (fd >= 0)
+                ? static_file_bucket(fd, ranges[0].first,
+                        (size_t)(ranges[0].last - ranges[0].first + 1), 1)
+                : NULL;
+            if( !body ) {
+                return static_status(
+                        response, YMO_HTTP_INTERNAL_SERVER_ERROR);
+            }
+
+            ymo_http_response_insert_header(response, "Content-Type", type);
+            ymo_http_response_insert_header(
+                    response, "Content-Range", content_range);
+            ymo_http_response_set_status(response, YMO_HTTP_PARTIAL_CONTENT);
+            ymo_http_response_body_append(response, body);
+            ymo_http_response_finish(response);
+            return YMO_OKAY;
+        }
+    }
+
+    /* The whole thing: */
+    ymo_http_response_insert_header(response, "Content-Type", type);
+    ymo_http_response_set_status(response, YMO_HTTP_OK);
+    if( head || !file->size ) {
+        ymo_http_response_insert_header(response, "Content-Length", size);
+    } else {
+        int fd = fcntl(file->fd, F_DUPFD_CLOEXEC, 0);
+        ymo_bucket_t* body = (fd >= 0)
+            ? static_file_bucket(fd, 0, (size_t)file->size, 1) : NULL;
+        if( !body ) {
+            ymo_log_warning("Failed to create static file bucket: %s",
+                    strerror(errno));
+            return static_status(response, YMO_HTTP_INTERNAL_SERVER_ERROR);
+        }
+        ymo_http_response_body_append(response, body);
+    }
+    ymo_http_response_finish(response);
+    return YMO_OKAY;
+}
+
+
+/*---------------------------------------------------------------*
+ *  Static File Handler:
+ *---------------------------------------------------------------*/
+ymo_http_static_t* ymo_http_static_create(const char* prefix, const char* root)
+{
+    if( !prefix || *prefix != '/' || !root ) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    ymo_http_static_t* handler = YMO_NEW0(ymo_http_static_t);
+    if( !handler ) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    handler->root_fd = -1;
+
+    /* Store the prefix without a trailing slash ("/" matches everything): */
+    size_t prefix_len = strlen(prefix);
+    while( prefix_len && prefix[prefix_len-1] == '/' ) {
+        --prefix_len;
+    }
+    handler->prefix = YMO_ALLOC(prefix_len + 1);
+    if( !handler->prefix ) {
+        errno = ENOMEM;
+        goto static_create_fail;
+    }
+    memcpy(handler->prefix, prefix, prefix_len);
+    handler->prefix[prefix_len] = '\0';
+    handler->prefix_len = prefix_len;
+
+    handler->root_fd = open(root, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if( handler->root_fd < 0 ) {
+        ymo_log_warning("Unable to open static root \"%s\": %s",
+                root, strerror(errno));
+        goto static_create_fail;
+    }
+
+    handler->precompressed = 1;
+    if( ymo_http_static_set_cache(handler, YMO_HTTP_STATIC_CACHE_SIZE,
+                YMO_HTTP_STATIC_REVALIDATE) != YMO_OKAY ) {
+        errno = ENOMEM;
+        goto static_create_fail;
+    }
+    return handler;
+
+static_create_fail:
+    {
+        int f_err = errno;
+        ymo_http_static_free(handler);
+        errno = f_err;
+    }
+    return NULL;
+}
+
+
+ymo_status_t ymo_http_static_set_cache(
+        ymo_http_static_t* handler, size_t max_files, unsigned int revalidate)
+{
+    if( !max_files ) {
+        return EINVAL;
+    }
+
+    size_t no_slots = 16;
+    while( no_slots < max_files ) {
+        no_slots <<= 1;
+    }
+
+    ymo_http_static_file_t** table = YMO_ALLOC0(
+            no_slots * sizeof(ymo_http_static_file_t*));
+    if( !table ) {
+        return ENOMEM;
+    }
+
+    static_cache_clear(handler);
+    if( handler->table ) {
+        YMO_FREE(handler->table);
+    }
+    handler->table = table;
+    handler->table_mask = no_slots - 1;
+    handler->max_files = max_files;
+    handler->revalidate = (time_t)revalidate;
+    return YMO_OKAY;
+}
+
+
+void ymo_http_static_set_precompressed(ymo_http_static_t* handler, int flag)
+{
+    handler->precompressed = flag;
+}
+
+
+ymo_status_t ymo_http_static_serve(
+        ymo_http_static_t* handler,
+        ymo_http_request_t* request,
+        ymo_http_response_t* response)
+{
+    const char* uri = request->uri;
+    if( !uri || strncmp(uri, handler->prefix, handler->prefix_len)
+            || (uri[handler->prefix_len] != '/'
+                && uri[handler->prefix_len] != '\0') ) {
+        return ENOENT;
+    }
+
+    int head = !strcmp(request->method, "HEAD");
+    if( !head && strcmp(request->method, "GET") ) {
+        ymo_http_response_insert_header(response, "Allow", "GET, HEAD");
+        return static_status(response, YMO_HTTP_METHOD_NOT_ALLOWED);
+    }
+
+    /* Leave room for "/index.html" and an encoding extension: */
+    char path[PATH_MAX];
+    ssize_t path_len = ymo_http_static_path(
+            path, sizeof(path) - sizeof("/" STATIC_INDEX ".zst"),
+            uri + handler->prefix_len);
+    if( path_len < 0 ) {
+        return static_status(response, (errno == ENAMETOOLONG)
+                ? YMO_HTTP_REQUEST_URI_TOO_LONG : YMO_HTTP_BAD_REQUEST);
+    }
+
+    time_t now = time(NULL);
+    ymo_http_static_file_t* file = static_file_get(
+            handler, path, (size_t)path_len, now);
+    if( file && file->is_dir ) {
+        size_t uri_len = strlen(uri);
+        if( !uri_len || uri[uri_len-1] != '/' ) {
+            return static_redirect(request, response);
+        }
+
+        if( path_len ) {
+            path[path_len++] = '/';
+        }
+        memcpy(path + path_len, STATIC_INDEX, sizeof(STATIC_INDEX));
+        path_len += sizeof(STATIC_INDEX) - 1;
+        file = static_file_get(handler, path, (size_t)path_len, now);
+    }
+
+    if( !file ) {
+        return static_status(response, YMO_HTTP_INTERNAL_SERVER_ERROR);
+    }
+
+    if( file->fd < 0 ) {
+        return static_status(response, (file->err == EACCES)
+                ? YMO_HTTP_FORBIDDEN : YMO_HTTP_NOT_FOUND);
+    }
+
+    /* Precompressed sibling? (Sibling lookups may evict file from the cache,
+     * so we're done with it once we have its type):
+     */
+    const char* type = file->type;
+    const char* encoding = NULL;
+    if( handler->precompressed ) {
+        ymo_http_response_insert_header(response, "Vary", "Accept-Encoding");
+
+        const char* accept = ymo_http_hdr_table_get_id(
+                &request->headers, YMO_HTTP_HID_ACCEPT_ENCODING);
+        for( size_t i = 0; accept && i < STATIC_NO_ENCODINGS; i++ )
+        {
+            if( ymo_http_accept_q(accept, static_encodings[i].coding) <= 0 ) {
+                continue;
+            }
+
+            memcpy(path + path_len, static_encodings[i].ext,
+                    static_encodings[i].ext_len + 1);
+            ymo_http_static_file_t* sibling = static_file_get(handler, path,
+                    (size_t)path_len + static_encodings[i].ext_len, now);
+            path[path_len] = '\0';
+
+            if( sibling && sibling->fd >= 0 ) {
+                file = sibling;
+                encoding = static_encodings[i].coding;
+                break;
+            }
+        }
+
+        /* Re-fetch the original, in case a sibling lookup displaced it: */
+        if( !encoding ) {
+            file = static_file_get(handler, path, (size_t)path_len, now);
+            if( !file || file->fd < 0 ) {
+                return static_status(response, YMO_HTTP_NOT_FOUND);
+            }
+        }
+    }
+
+    return static_send(handler, request, response, file, type, encoding, head);
+}
+
+
+ymo_status_t ymo_http_static_cb(
+        ymo_http_session_t* session,
+        ymo_http_request_t* request,
+        ymo_http_response_t* response,
+        void* user_data)
+{
+    ymo_status_t status = ymo_http_static_serve(
+            (ymo_http_static_t*)user_data, request, response);
+    if( status == ENOENT ) {
+        return static_status(response, YMO_HTTP_NOT_FOUND);
+    }
+    return status;
+}
+
+
+void ymo_http_static_free(ymo_http_static_t* handler)
+{
+    if( !handler ) {
+        return;
+    }
+
+    if( handler->table ) {
+        static_cache_clear(handler);
+        YMO_FREE(handler->table);
+    }
+    if( handler->root_fd >= 0 ) {
+        close(handler->root_fd);
+    }
+    if( handler->prefix ) {
+        YMO_FREE(handler->prefix);
+    }
+    YMO_DELETE(ymo_http_static_t, handler);
+}
+
+
@@ -0,0 +1,160 @@
+/*=============================================================================
+ *
+ * Copyright (c) 2014 Andrew Canaday
+ *
+ * This file is part of libyimmo (sometimes referred to as "yimmo" or "ymo").
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *===========================================================================*/
+
+
+
+#ifndef YMO_HTTP_STATIC_H
+#define YMO_HTTP_STATIC_H
+#include "yimmo_config.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/types.h>
+#include "yimmo.h"
+#include "ymo_http.h"
+#include "ymo_http_response.h"
+
+/** Static Files
+ * ==============
+ *
+ * Internals for :c:type:`ymo_http_static_t` (see :ref:`Static Files`).
+ *
+ * Each handler keeps a cache of open file descriptors and ``stat`` data,
+ * keyed by path (relative to the document root). Entries are:
+ *
+ * - kept in a chained hash table for lookup and an LRU list for eviction,
+ * - *negative* if the file couldn't be opened (``fd < 0``; ``err`` is set),
+ *   so repeat misses (e.g. for absent precompressed siblings) don't hit the
+ *   filesystem,
+ * - revalidated with ``fstatat`` (by path, to catch replaced files) once
+ *   they're older than the handler's revalidation interval.
+ *
+ * Responses are sent from a ``dup`` of the cached descriptor, so entries can
+ * be evicted or reopened while responses are in flight.
+ */
+
+/**---------------------------------------------------------------
+ * Definitions
+ *---------------------------------------------------------------*/
+
+/** Default maximum number of cached files. */
+#define YMO_HTTP_STATIC_CACHE_SIZE 1024
+
+/** Default revalidation interval, in seconds. */
+#define YMO_HTTP_STATIC_REVALIDATE 2
+
+/** Maximum number of ranges honored in a single request. Requests for more
+ * get the whole file.
+ */
+#define YMO_HTTP_STATIC_MAX_RANGES 16
+
+/** ``"`` + 16 hex digits + ``-`` + 16 hex digits + ``"``. */
+#define YMO_HTTP_STATIC_ETAG_LEN 36
+
+
+/**---------------------------------------------------------------
+ * Types
+ *---------------------------------------------------------------*/
+
+typedef struct ymo_http_static_file ymo_http_static_file_t;
+
+/** Cached file info. */
+struct ymo_http_static_file {
+    char*                    path;      /* Path, relative to the root */
+    size_t                   path_len;
+    uint32_t                 hash;
+    int                      fd;        /* Open file, or -1 */
+    int                      err;       /* Open/stat errno, if fd < 0 */
+    int                      is_dir;    /* Path is a directory */
+    dev_t                    dev;
+    ino_t                    ino;
+    off_t                    size;
+    time_t                   mtime;
+    time_t                   checked;   /* Time of last (re)validation */
+    const char*              type;      /* Content-Type */
+    char                     etag[YMO_HTTP_STATIC_ETAG_LEN+1];
+    char                     last_modified[YMO_HTTP_DATE_LEN+1];
+    ymo_http_static_file_t*  h_next;    /* Hash chain */
+    ymo_http_static_file_t*  lru_prev;  /* More recently used */
+    ymo_http_static_file_t*  lru_next;  /* Less recently used */
+};
+
+struct ymo_http_static {
+    char*                    prefix;       /* URL prefix (no trailing '/') */
+    size_t                   prefix_len;
+    int                      root_fd;      /* Document root directory */
+    int                      precompressed;
+    size_t                   max_files;
+    time_t                   revalidate;
+    size_t                   no_files;
+    size_t                   table_mask;   /* No. hash buckets - 1 */
+    ymo_http_static_file_t** table;
+    ymo_http_static_file_t*  lru_head;
+    ymo_http_static_file_t*  lru_tail;
+    uint64_t                 boundary_no;  /* multipart/byteranges counter */
+};
+
+/** A single, resolved byte range (inclusive). */
+typedef struct ymo_http_static_range {
+    off_t first;
+    off_t last;
+} ymo_http_static_range_t;
+
+
+/**---------------------------------------------------------------
+ * Functions
+ *---------------------------------------------------------------*/
+
+/** Map a URL path (as received) to a normalized path relative to the
+ * document root: percent-decoded, with empty and ``.`` segments removed.
+ *
+ * :param dst: destination buffer
+ * :param dst_len: size of ``dst``
+ * :param path: URL path, after the handler prefix
+ * :returns: the length of the normalized path (0 for the root itself); -1
+ *     with ``errno`` set to ``EINVAL`` if the path contains a ``..``
+ *     segment, a NUL, or bad percent-encoding, or to ``ENAMETOOLONG``.
+ */
+ssize_t ymo_http_static_path(char* dst, size_t dst_len, const char* path);
+
+/** Parse a ``Range`` header value against a representation of ``size``
+ * bytes.
+ *
+ * :param ranges: destination for up to ``YMO_HTTP_STATIC_MAX_RANGES``
+ *     ranges
+ * :param value: the ``Range`` header value
+ * :param size: size of the representation
+ * :returns: the number of satisfiable ranges; 0 if none are satisfiable
+ *     (i.e. 416); -1 if the header should be ignored (malformed, not
+ *     ``bytes``, or too many ranges).
+ */
+int ymo_http_static_ranges(
+        ymo_http_static_range_t* ranges, const char* value, off_t size);
+
+/** Parse an HTTP-date (IMF-fixdate only).
+ *
+ * :returns: ``YMO_OKAY`` on success; ``EINVAL`` otherwise.
+ */
+ymo_status_t ymo_http_static_parse_date(const char* value, time_t* t);
+
+#endif /* YMO_HTTP_STATIC_H */
+
+
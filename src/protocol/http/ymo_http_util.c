@@ -61,7 +61,8 @@ ymo_server_t* ymo_http_simple_init(
             NULL,
             NULL,
             NULL,
-            data
+            data,
+            YMO_HTTP_PROTO_DATE
             );
     if( !http_proto ) {
         goto http_bail;
@@ -25,18 +25,23 @@
 #include <strings.h>
 #include <assert.h>
 #include <errno.h>
+#include <time.h>
 
 #include "yimmo.h"
 #include "ymo_log.h"
+#include "ymo_util.h"
 #include "core/ymo_net.h"
 #include "core/ymo_server.h"
 #include "core/ymo_conn.h"
 #include "ymo_alloc.h"
 #include "ymo_proto_http.h"
+#include "ymo_proto_http2.h"
 #include "ymo_http_session.h"
 #include "ymo_http_parse.h"
 #include "ymo_http_exchange.h"
 #include "ymo_http_response.h"
+#include "ymo_http_body.h"
+#include "ymo_http_router.h"
 
 #define YMO_HTTP_TRACE_PROTO 0
 #if defined(YMO_HTTP_TRACE_PROTO) && YMO_HTTP_TRACE_PROTO == 1
@@ -61,6 +66,8 @@ static ymo_proto_vt_t ymo_default_http_proto = {
     .conn_cleanup_cb = &ymo_proto_http_conn_cleanup,
 };
 
+static const char server_hdr[] = "Server: " YMO_HTTP_SERVER_NAME "\r\n";
+
 static ymo_status_t buffer_body_cb(
         ymo_http_session_t* session,
         ymo_http_request_t* request,
@@ -111,13 +118,48 @@ static ymo_status_t buffer_body_cb(
 }
 
 
+/* Body callback used when spooling is enabled (see ymo_http_set_body_spool).
+ * The spool itself is created by ymo_proto_http_body_init, once the headers
+ * are in.
+ */
+static ymo_status_t spool_body_cb(
+        ymo_http_session_t* session,
+        ymo_http_request_t* request,
+        ymo_http_response_t* response,
+        const char* data,
+        size_t len,
+        void* user)
+{
+    ymo_http_body_t* body = request->body_spool;
+    if( !body ) {
+        return EINVAL;
+    }
+
+    /* As with buffer_body_cb, content_length tracks what we've stored: */
+    if( !request->body_received ) {
+        request->content_length = 0;
+    }
+
+    ymo_status_t status = ymo_http_body_write(body, data, len);
+    if( status != YMO_OKAY ) {
+        return status;
+    }
+
+    request->body_received += len;
+    request->content_length += len;
+    request->body = ymo_http_body_spilled(body) ? NULL : body->mem;
+    return YMO_OKAY;
+}
+
+
 ymo_proto_t* ymo_proto_http_create(
         ymo_http_session_init_cb_t session_init,
         ymo_http_cb_t http_callback,
         ymo_http_header_cb_t header_callback,
         ymo_http_body_cb_t body_callback,
         ymo_http_session_cleanup_cb_t session_cleanup,
-        void* data)
+        void* data,
+        ymo_http_proto_flags_t flags)
 {
     /* Allocate and initialize the protocol object: */
     ymo_proto_t* http_proto = YMO_NEW0(ymo_proto_t);
@@ -146,6 +188,28 @@ ymo_proto_t* ymo_proto_http_create(
     }
     http_data->session_cleanup = session_cleanup;
     http_data->upgrade_handler = NULL;
+    http_data->h2_proto = NULL;
+    http_data->body_mem_max = 0;
+    http_data->body_max = 0;
+    http_data->hdr_max = YMO_HTTP_HDR_MAX_DEFAULT;
+    http_data->compress = NULL;
+    http_data->cache = NULL;
+    http_data->router = NULL;
+    memset(&http_data->exchange_pool, 0, sizeof(ymo_http_exchange_pool_t));
+    ymo_http_exchange_pool_init(
+            &http_data->exchange_pool, YMO_HTTP_EXCHANGE_POOL_MAX);
+
+    /* Automatic headers (the date is kept current by ymo_proto_http_init): */
+    http_data->flags = flags;
+    http_data->loop = NULL;
+    memset(&http_data->auto_hdrs, 0, sizeof(ymo_http_auto_hdrs_t));
+    if( flags & YMO_HTTP_PROTO_DATE ) {
+        ymo_http_auto_hdrs_set_date(&http_data->auto_hdrs, time(NULL));
+    }
+    if( flags & YMO_HTTP_PROTO_SERVER ) {
+        http_data->auto_hdrs.server = server_hdr;
+        http_data->auto_hdrs.server_len = sizeof(server_hdr)-1;
+    }
     return http_proto;
 
 proto_free_and_bail:
@@ -155,6 +219,179 @@ proto_bail:
 }
 
 
+ymo_status_t ymo_http_set_body_spool(
+        ymo_proto_t* http_proto, size_t mem_max, size_t body_max)
+{
+    ymo_http_proto_data_t* http_data = \
+        (ymo_http_proto_data_t*)http_proto->data;
+
+    if( !body_max
+        || (http_data->body_cb != &buffer_body_cb
+            && http_data->body_cb != &spool_body_cb) ) {
+        return EINVAL;
+    }
+
+    http_data->body_mem_max = mem_max;
+    http_data->body_max = body_max;
+    http_data->body_cb = &spool_body_cb;
+    return YMO_OKAY;
+}
+
+
+ymo_status_t ymo_http_set_max_header_size(
+        ymo_proto_t* http_proto, size_t hdr_max)
+{
+    ymo_http_proto_data_t* http_data = \
+        (ymo_http_proto_data_t*)http_proto->data;
+
+    if( hdr_max < YMO_HTTP_RECV_BUF_SIZE ) {
+        return EINVAL;
+    }
+
+    http_data->hdr_max = hdr_max;
+    return YMO_OKAY;
+}
+
+
+ymo_status_t ymo_http_set_compression(
+        ymo_proto_t* http_proto, int level, size_t min_size)
+{
+    ymo_http_proto_data_t* http_data = \
+        (ymo_http_proto_data_t*)http_proto->data;
+
+    if( level < 0 || level > 9 ) {
+        return EINVAL;
+    }
+
+    /* Responses in flight may hold pooled compressors, so the settings
+     * stay put once created:
+     */
+    if( http_data->compress ) {
+        http_data->compress->level = level;
+        http_data->compress->min_size = min_size;
+        return YMO_OKAY;
+    }
+
+    if( !level ) {
+        return YMO_OKAY;
+    }
+
+    http_data->compress = ymo_http_compress_create(level, min_size);
+    return http_data->compress ? YMO_OKAY : errno;
+}
+
+
+ymo_status_t ymo_http_set_cache(
+        ymo_proto_t* http_proto,
+        size_t max_bytes,
+        unsigned int ttl,
+        const char* vary)
+{
+    ymo_http_proto_data_t* http_data = \
+        (ymo_http_proto_data_t*)http_proto->data;
+
+    /* As with compression, responses in flight may refer to the cache, so
+     * it stays put once created:
+     */
+    if( http_data->cache ) {
+        return ymo_http_cache_configure(http_data->cache, max_bytes, ttl, vary);
+    }
+
+    if( !max_bytes ) {
+        return YMO_OKAY;
+    }
+
+    http_data->cache = ymo_http_cache_create(max_bytes, ttl, vary, http_data);
+    return http_data->cache ? YMO_OKAY : errno;
+}
+
+
+ymo_status_t ymo_http_cache_stats(
+        ymo_proto_t* http_proto, ymo_http_cache_stats_t* stats)
+{
+    ymo_http_proto_data_t* http_data = \
+        (ymo_http_proto_data_t*)http_proto->data;
+
+    if( !http_data->cache ) {
+        return EINVAL;
+    }
+
+    *stats = http_data->cache->stats;
+    return YMO_OKAY;
+}
+
+
+ymo_status_t ymo_http_set_router(
+        ymo_proto_t* http_proto, ymo_http_router_t* router)
+{
+    ymo_http_proto_data_t* http_data = \
+        (ymo_http_proto_data_t*)http_proto->data;
+
+    if( http_data->router ) {
+        return EBUSY;
+    }
+
+    ymo_status_t status = ymo_http_router_compile(router);
+    if( status == YMO_OKAY ) {
+        http_data->router = router;
+    }
+    return status;
+}
+
+
+ymo_status_t ymo_proto_http_dispatch(
+        const ymo_http_proto_data_t* http_data,
+        ymo_http_session_t* session,
+        ymo_http_request_t* request,
+        ymo_http_response_t* response)
+{
+    if( http_data->router ) {
+        return ymo_http_router_dispatch(http_data->router,
+                http_data->http_cb, session, request, response);
+    }
+    return http_data->http_cb(session, request, response, session->user_data);
+}
+
+
+ymo_status_t ymo_proto_http_body_init(
+        const ymo_http_proto_data_t* http_data, ymo_http_request_t* request)
+{
+    if( http_data->body_cb != &spool_body_cb || request->body_spool ) {
+        return YMO_OKAY;
+    }
+
+    if( request->content_length > http_data->body_max ) {
+        ymo_log_debug("Content-length %zu exceeds max body size (%zu)",
+                request->content_length, http_data->body_max);
+        return EFBIG;
+    }
+
+    request->body_spool = ymo_http_body_create(
+            http_data->body_mem_max, http_data->body_max,
+            request->content_length);
+    return request->body_spool ? YMO_OKAY : errno;
+}
+
+
+ssize_t ymo_http_request_body_pread(
+        const ymo_http_request_t* request,
+        void* buf,
+        size_t len,
+        size_t offset)
+{
+    if( request->body_spool ) {
+        return ymo_http_body_pread(request->body_spool, buf, len, offset);
+    }
+
+    if( offset >= request->body_received ) {
+        return 0;
+    }
+    len = YMO_MIN(len, request->body_received - offset);
+    memcpy(buf, request->body + offset, len);
+    return (ssize_t)len;
+}
+
+
 ymo_status_t
 ymo_http_add_upgrade_handler(
         ymo_proto_t* proto, ymo_http_upgrade_handler_t* upgrade_handler)
@@ -193,10 +430,10 @@ ymo_http_add_upgrade_handler(
 /*---------------------------------------------------------------*
  *  HTTP 2.0:
  *---------------------------------------------------------------*/
-/** For the time being: indicate lack of HTTP/2.0 support by
- * responding with HTTP/1.1.
+/** For servers without an HTTP/2 protocol object: indicate lack of
+ * HTTP/2.0 support by responding with HTTP/1.1.
  *
- * TODO HTTP 2.0 support!
+ * (See ymo_proto_http2.c for h2c upgrades and prior knowledge).
  */
 ymo_http_upgrade_status_t ymo_http2_not_available_upgrade_cb(
         const char* hdr_upgrade,
@@ -284,7 +521,7 @@ static ymo_status_t ymo_http_handler(
 {
     ymo_log_debug("Handling exchange for %s", exchange->request.uri);
     ymo_status_t status = YMO_OKAY;
-    ymo_http_response_t* response = exchange->response;
+    ymo_http_response_t* response = &exchange->response;
 
     /* Is this an upgrade exchange? */
     ymo_http_upgrade_status_t upgrade_status = YMO_HTTP_UPGRADE_IGNORE;
@@ -324,27 +561,42 @@ static ymo_status_t ymo_http_handler(
 
 issue_standard_callback:
     /* Issue standard HTTP callback: */
-    status = proto_data->http_cb(
-            http_session, &(exchange->request),
-            response, http_session->user_data);
+    ymo_http_compress_negotiate(
+            proto_data->compress, &exchange->request, response);
+    switch( ymo_http_cache_lookup(
+                proto_data->cache, &exchange->request, response) ) {
+        case YMO_HTTP_CACHE_HIT:
+            status = YMO_OKAY;
+            break;
+        case YMO_HTTP_CACHE_WAIT:
+            status = YMO_WOULDBLOCK;
+            break;
+        default:
+            status = ymo_proto_http_dispatch(
+                    proto_data, http_session, &(exchange->request), response);
+            break;
+    }
 
 handle_callback_result:
-    if( status == YMO_OKAY ) {
-        ymo_http_session_add_response(http_session, response);
-
-        if( response->flags & YMO_HTTP_FLAG_REQUEST_KEEPALIVE ) {
-            HTTP_PROTO_TRACE("Resetting http exchange: %p", (void*)exchange);
-            ymo_http_exchange_reset(exchange);
-        }
-    } else if( YMO_IS_BLOCKED(status) ) {
-        /* Okay, they held onto the exchange, so don't reuse it: */
-        response->exchange = http_session->exchange;
-        http_session->exchange = NULL;
-        ymo_http_session_add_response(http_session, response);
-    } else {
+    if( status != YMO_OKAY && !YMO_IS_BLOCKED(status) ) {
         goto bail_free_response;
     }
 
+    /* The response (which lives in the exchange) owns the exchange from here
+     * until it's been sent — or, for h2c, until the request carries over to
+     * HTTP/2 as stream 1. The next request gets an exchange of its own:
+     */
+    HTTP_PROTO_TRACE("Handing exchange %p to its response", (void*)exchange);
+    response->exchange = exchange;
+    http_session->exchange = NULL;
+    ymo_http_session_add_response(http_session, response);
+
+    /* Nothing after this request is ours to read: */
+    if( response->proto_new
+        || !(response->flags & YMO_HTTP_FLAG_REQUEST_KEEPALIVE) ) {
+        http_session->state = YMO_HTTP_SESSION_CLOSING;
+    }
+
     /* All good: */
     return status;
 
@@ -358,8 +610,34 @@ bail_free_response:
 /*---------------------------------------------------------------*
  *  Yimmo HTTP Protocol Init Callback:
  *---------------------------------------------------------------*/
+static void date_periodic_cb(
+        struct ev_loop* loop, ev_periodic* w, int revents)
+{
+    ymo_http_proto_data_t* http_data = w->data;
+    ymo_http_auto_hdrs_set_date(&http_data->auto_hdrs, (time_t)ev_now(loop));
+}
+
+
 ymo_status_t ymo_proto_http_init(ymo_proto_t* proto, ymo_server_t* server)
 {
+    ymo_http_proto_data_t* http_data = proto->data;
+    ymo_http_exchange_pool_init(
+            &http_data->exchange_pool, YMO_HTTP_EXCHANGE_POOL_MAX);
+
+    /* Regenerate the Date header on each second boundary. A given protocol
+     * object only ever services one loop, so the cache lives here:
+     */
+    if( (http_data->flags & YMO_HTTP_PROTO_DATE) && !http_data->loop ) {
+        http_data->loop = server->config.loop;
+        ymo_http_auto_hdrs_set_date(
+                &http_data->auto_hdrs, (time_t)ev_now(http_data->loop));
+        ev_periodic_init(&http_data->w_date, &date_periodic_cb, 0., 1., 0);
+        http_data->w_date.data = http_data;
+        ev_periodic_start(http_data->loop, &http_data->w_date);
+
+        /* Don't keep the loop alive just to tell the time: */
+        ev_unref(http_data->loop);
+    }
     return YMO_OKAY;
 }
 
@@ -369,6 +647,17 @@ ymo_status_t ymo_proto_http_init(ymo_proto_t* proto, ymo_server_t* server)
  *---------------------------------------------------------------*/
 void ymo_proto_http_cleanup(ymo_proto_t* proto, ymo_server_t* server)
 {
+    ymo_http_proto_data_t* http_data = proto->data;
+    if( http_data->loop && http_data->loop == server->config.loop ) {
+        ev_ref(http_data->loop);
+        ev_periodic_stop(http_data->loop, &http_data->w_date);
+        http_data->loop = NULL;
+    }
+    ymo_http_compress_drain(http_data->compress);
+    ymo_http_cache_purge(http_data->cache);
+    ymo_http_router_free(http_data->router);
+    http_data->router = NULL;
+    ymo_http_exchange_pool_drain(&http_data->exchange_pool);
     return;
 }
 
@@ -380,6 +669,10 @@ void* ymo_proto_http_conn_init(void* proto_data, ymo_conn_t* conn)
 {
     ymo_http_proto_data_t* http_proto_data = proto_data;
     ymo_http_session_t* session = ymo_http_session_create(conn);
+    if( session ) {
+        session->pool = &http_proto_data->exchange_pool;
+    }
+
     if( session && http_proto_data->session_init ) {
         ymo_status_t rc_init = http_proto_data->session_init(
                 http_proto_data->data, session);
@@ -461,8 +754,10 @@ ssize_t ymo_proto_http_read(
     const char* parse_buf = recv_buf;
     ymo_http_exchange_t* exchange = NULL;
 
-    /* If we're already in an error state, just ignore additional reads: */
-    if( http_session->state == YMO_HTTP_SESSION_ERROR ) {
+    /* If we're already in an error state (or the last request closes the
+     * connection), just ignore additional reads:
+     */
+    if( http_session->state != YMO_HTTP_SESSION_OPEN ) {
         return len;
     }
 
@@ -475,6 +770,24 @@ ssize_t ymo_proto_http_read(
     }
 
     exchange = http_session->exchange;
+    exchange->hdr_max = http_proto_data->hdr_max;
+
+    /* HTTP/2 with prior knowledge: hand the connection over if the client
+     * opens with the connection preface. NOTE: the whole preface has to
+     * arrive in a single read for this to be recognized.
+     */
+    if( http_proto_data->h2_proto
+        && exchange->state == HTTP_STATE_CONNECTED
+        && !http_session->response
+        && len >= YMO_HTTP2_PREFACE_LEN
+        && !memcmp(recv_buf, YMO_HTTP2_PREFACE, YMO_HTTP2_PREFACE_LEN) ) {
+        HTTP_PROTO_TRACE("HTTP/2 preface on %p", (void*)conn);
+        status = ymo_conn_transition_proto(conn, http_proto_data->h2_proto);
+        if( status != YMO_OKAY ) {
+            return YMO_ERROR_SSIZE_T(status);
+        }
+        return 0;
+    }
 
 http_parse_resume:
     do {
@@ -491,6 +804,10 @@ http_parse_resume:
                 YMO_STMT_ATTR_FALLTHROUGH();
             case HTTP_STATE_REQUEST_URI_PATH:
                 YMO_STMT_ATTR_FALLTHROUGH();
+            case HTTP_STATE_REQUEST_QUERY:
+                YMO_STMT_ATTR_FALLTHROUGH();
+            case HTTP_STATE_REQUEST_FRAGMENT:
+                YMO_STMT_ATTR_FALLTHROUGH();
             case HTTP_STATE_REQUEST_VERSION:
                 n = ymo_parse_http_request_line(
                         exchange, parse_buf, len);
@@ -515,9 +832,17 @@ http_parse_resume:
                 break;
             case HTTP_STATE_BODY_CHUNK_HEADER:
                 YMO_STMT_ATTR_FALLTHROUGH();
+            case HTTP_STATE_BODY_CHUNK_EXT:
+                YMO_STMT_ATTR_FALLTHROUGH();
             case HTTP_STATE_BODY:
                 YMO_STMT_ATTR_FALLTHROUGH();
+            case HTTP_STATE_BODY_CHUNK_CR:
+                YMO_STMT_ATTR_FALLTHROUGH();
+            case HTTP_STATE_BODY_CHUNK_LF:
+                YMO_STMT_ATTR_FALLTHROUGH();
             case HTTP_STATE_BODY_CHUNK_TRAILER:
+                YMO_STMT_ATTR_FALLTHROUGH();
+            case HTTP_STATE_BODY_TRAILER_FIELD:
                 n = ymo_parse_http_body(
                         http_proto_data->body_cb,
                         http_session,
@@ -602,6 +927,13 @@ http_headers_complete:
                 exchange->state = exchange->state = HTTP_STATE_BODY;
                 exchange->body_remain = exchange->request.content_length;
 
+                hdr_status = ymo_proto_http_body_init(
+                        http_proto_data, &exchange->request);
+                if( hdr_status != YMO_OKAY ) {
+                    return ymo_proto_http_handle_error(
+                            http_session, exchange, conn, hdr_status);
+                }
+
                 if( exchange->request.flags & YMO_HTTP_FLAG_EXPECT ) {
                     HTTP_PROTO_TRACE(
                             "Expect with content-length: %zu",
@@ -611,9 +943,17 @@ http_headers_complete:
 
             } else if( exchange->request.flags & YMO_HTTP_REQUEST_CHUNKED ) {
                 exchange->body_remain = 0;
+                exchange->remain = YMO_HTTP_RECV_BUF_SIZE;
                 exchange->state = exchange->next_state = HTTP_STATE_BODY;
                 exchange->state = exchange->state = HTTP_STATE_BODY_CHUNK_HEADER;
 
+                hdr_status = ymo_proto_http_body_init(
+                        http_proto_data, &exchange->request);
+                if( hdr_status != YMO_OKAY ) {
+                    return ymo_proto_http_handle_error(
+                            http_session, exchange, conn, hdr_status);
+                }
+
                 if( exchange->request.flags & YMO_HTTP_FLAG_EXPECT ) {
                     HTTP_PROTO_TRACE(
                             "Expect with content-length: %zu (chunked)",
@@ -631,7 +971,7 @@ http_headers_complete:
                 hdr_status = http_proto_data->header_cb(
                         http_session,
                         &exchange->request,
-                        exchange->response,
+                        &exchange->response,
                         http_session->user_data);
             }
 
@@ -661,86 +1001,209 @@ http_headers_complete:
 /*---------------------------------------------------------------*
  *  Yimmo HTTP Protocol Write Callback:
  *---------------------------------------------------------------*/
-ymo_status_t ymo_proto_http_write(
-        void* proto_data,
-        ymo_conn_t* conn,
-        void* conn_data,
-        int socket)
+
+/* Append buckets to the session send buffer (O(1) in the buffer length): */
+static inline void queue_buckets(
+        ymo_http_session_t* http_session, ymo_bucket_t* buckets)
 {
-    static const char* chunk_term = "0\r\n\r\n";
-    ymo_status_t status;
-    ymo_http_session_t* http_session = conn_data;
-    ymo_http_response_t* response = ymo_http_session_next_response(http_session);
+    http_session->send_len += ymo_bucket_len_all(buckets);
+    if( http_session->send_buffer ) {
+        http_session->send_tail = ymo_bucket_append(
+                http_session->send_tail, buckets);
+    } else {
+        http_session->send_buffer = buckets;
+        http_session->send_tail = ymo_bucket_append(NULL, buckets);
+    }
+}
 
-    if( !response ) {
-        ymo_log_debug("Got writable callback, but nothing to send on %i",
-                socket);
-        return YMO_OKAY;
+
+/* Bytes left on the send buffer after a partial write: */
+static size_t send_backlog(const ymo_bucket_t* bucket)
+{
+    size_t len = 0;
+    for( ; bucket; bucket = bucket->next ) {
+        len += bucket->len - bucket->bytes_sent;
     }
+    return len;
+}
 
-    ymo_http_flags_t r_flags = response->flags;
 
-    if( !(r_flags & YMO_HTTP_RESPONSE_READY) ) {
-        ymo_log_debug("Got writable callback, but response not ready on %i",
-                socket);
+/* Give a streaming response at the head of the queue a chance to produce
+ * more output, if its backlog has drained (see ymo_http_drain_cb_t):
+ */
+static ymo_status_t drain_check(ymo_http_session_t* http_session)
+{
+    ymo_http_response_t* response =
+        ymo_http_session_next_response(http_session);
+    if( !response || (response->flags & YMO_HTTP_RESPONSE_QUEUED) ) {
         return YMO_OKAY;
     }
+    return ymo_http_response_drain_check(response);
+}
+
+
+/* Move whatever data we have for response onto the send buffer. Once the
+ * complete response is on the send buffer, it's flagged as QUEUED.
+ */
+static ymo_status_t queue_response(
+        ymo_conn_t* conn,
+        ymo_http_proto_data_t* http_proto_data,
+        ymo_http_session_t* http_session,
+        ymo_http_response_t* response)
+{
+    static const char* chunk_term = "0\r\n\r\n";
+    ymo_http_flags_t r_flags = response->flags;
+    ymo_bucket_t* data;
 
     if( !(r_flags & YMO_HTTP_RESPONSE_STARTED) ) {
+        ymo_status_t c_status = ymo_http_compress_start(
+                http_proto_data->compress, response);
+        if( c_status == YMO_OKAY ) {
+            c_status = ymo_http_compress_flush(response);
+        }
+        if( c_status != YMO_OKAY ) {
+            return c_status;
+        }
+        ymo_http_cache_store(response);
+
         errno = 0;
-        http_session->send_buffer = ymo_http_response_start(conn, response);
-        if( !http_session->send_buffer ) {
+        data = ymo_http_response_start(
+                conn, response, &http_proto_data->auto_hdrs);
+        if( !data ) {
+            /* NOTE: errno is 0 if the body is still being buffered. */
             int s_err = errno;
             ymo_log_debug("Unable to serialize response: %s", strerror(s_err));
             return s_err;
         }
 
-        HTTP_PROTO_TRACE("Response started on %i", socket);
+        queue_buckets(http_session, data);
+        HTTP_PROTO_TRACE("Response started on %i", conn->fd);
         response->flags |= YMO_HTTP_RESPONSE_STARTED;
     }
 
+    ymo_status_t c_status = ymo_http_compress_flush(response);
+    if( c_status != YMO_OKAY ) {
+        return c_status;
+    }
+
     errno = 0;
-    ymo_bucket_t* body_data = ymo_http_response_body_get(conn, response);
-    if( body_data ) {
-        if( http_session->send_buffer ) {
-            ymo_bucket_append(http_session->send_buffer, body_data);
-        } else {
-            http_session->send_buffer = body_data;
-        }
+    data = ymo_http_response_body_get(conn, response);
+    if( data ) {
+        queue_buckets(http_session, data);
     } else if( errno ) {
         ymo_log_debug("Error retrieving body data: %s", strerror(errno));
         return errno;
     }
 
-    /* HACK: add terminal chunk: */
-    if( (response->flags & YMO_HTTP_RESPONSE_COMPLETE)
+    /* Add the terminal chunk, if body_get didn't (i.e. if there was no
+     * body data left to send along with it, and there's a body at all):
+     */
+    if( (r_flags & YMO_HTTP_RESPONSE_COMPLETE)
         && (response->flags & YMO_HTTP_RESPONSE_CHUNKED)
-        && !(response->flags & YMO_HTTP_RESPONSE_CHUNK_TERM) ) {
-        HTTP_PROTO_TRACE("Appending terminal chunk for %i", socket);
-        body_data = YMO_BUCKET_FROM_REF(chunk_term, 5);
-        if( http_session->send_buffer ) {
-            ymo_bucket_append(http_session->send_buffer, body_data);
-        } else {
-            http_session->send_buffer = body_data;
+        && !(response->flags & (YMO_HTTP_RESPONSE_CHUNK_TERM
+                | YMO_HTTP_RESPONSE_NO_BODY)) ) {
+        HTTP_PROTO_TRACE("Appending terminal chunk for %i", conn->fd);
+        queue_buckets(http_session, YMO_BUCKET_FROM_REF(chunk_term, 5));
+        response->flags |= YMO_HTTP_RESPONSE_CHUNK_TERM;
+    }
+
+    if( r_flags & YMO_HTTP_RESPONSE_COMPLETE ) {
+        response->flags |= YMO_HTTP_RESPONSE_QUEUED;
+    }
+    return YMO_OKAY;
+}
+
+
+ymo_status_t ymo_proto_http_write(
+        void* proto_data,
+        ymo_conn_t* conn,
+        void* conn_data,
+        int socket)
+{
+    ymo_status_t status;
+    ymo_http_proto_data_t* http_proto_data = proto_data;
+    ymo_http_session_t* http_session = conn_data;
+    ymo_http_response_t* response = ymo_http_session_next_response(http_session);
+    size_t no_sent = 0;
+
+    if( !response ) {
+        ymo_log_debug("Got writable callback, but nothing to send on %i",
+                socket);
+        return YMO_OKAY;
+    }
+
+    if( !(response->flags & YMO_HTTP_RESPONSE_READY) ) {
+        ymo_log_debug("Got writable callback, but response not ready on %i",
+                socket);
+        return YMO_OKAY;
+    }
+
+    /* Queue up every ready response we can, in order, so that pipelined
+     * responses go out as one bucket chain. Stop at the first response that
+     * isn't complete, or after one which closes or switches protocols:
+     */
+    while( response && (response->flags & YMO_HTTP_RESPONSE_READY) )
+    {
+        if( !(response->flags & YMO_HTTP_RESPONSE_QUEUED) ) {
+            status = queue_response(
+                    conn, http_proto_data, http_session, response);
+            if( status != YMO_OKAY ) {
+                return status;
+            }
         }
 
-        response->flags |= YMO_HTTP_RESPONSE_CHUNK_TERM;
+        if( !(response->flags & YMO_HTTP_RESPONSE_QUEUED)
+            || response->proto_new
+            || !(response->flags & YMO_HTTP_FLAG_REQUEST_KEEPALIVE) ) {
+            break;
+        }
+        response = response->next;
     }
 
     /* We're good to write: */
-    status = ymo_conn_send_buckets(
-            conn, &http_session->send_buffer);
+    status = YMO_OKAY;
+    if( http_session->send_buffer ) {
+        status = ymo_conn_send_buckets(
+                conn, &http_session->send_buffer);
+    }
 
-    /* This response has been fully sent: */
-    if( status == YMO_OKAY && (r_flags & YMO_HTTP_RESPONSE_COMPLETE) ) {
-        http_session->send_buffer = NULL;
+    if( status != YMO_OKAY ) {
+        if( YMO_IS_BLOCKED(status) ) {
+            http_session->send_len = send_backlog(http_session->send_buffer);
+            ymo_status_t d_status = drain_check(http_session);
+            if( d_status != YMO_OKAY ) {
+                return d_status;
+            }
+        }
+        return status;
+    }
+
+    /* Everything on the send buffer has been sent, so every queued response
+     * has been fully sent:
+     */
+    http_session->send_tail = NULL;
+    http_session->send_len = 0;
+    while( (response = ymo_http_session_next_response(http_session))
+           && (response->flags & YMO_HTTP_RESPONSE_QUEUED) )
+    {
         ymo_http_flags_t response_flags = response->flags;
-        int http_status = response->status;
+        ymo_proto_t* proto_new = response->proto_new;
+        ymo_http_exchange_t* upgrade_exchange = NULL;
+        HTTP_PROTO_TRACE("Sent HTTP %i on %i", response->status, socket);
+
+        /* An h2c upgrade keeps the request for stream 1: */
+        if( proto_new && proto_new == http_proto_data->h2_proto ) {
+            upgrade_exchange = response->exchange;
+            response->exchange = NULL;
+        }
         ymo_http_session_complete_response(http_session);
+        ++no_sent;
 
         /* If this was an upgrade response, we can transition protocols now. */
-        if( response->proto_new ) {
-            return ymo_conn_transition_proto(conn, response->proto_new);
+        if( upgrade_exchange ) {
+            return ymo_proto_http2_upgrade(conn, proto_new, upgrade_exchange);
+        } else if( proto_new ) {
+            return ymo_conn_transition_proto(conn, proto_new);
         }
 
         /* Close after response complete if keep-alive not set: */
@@ -749,7 +1212,11 @@ ymo_status_t ymo_proto_http_write(
                     response_flags, YMO_HTTP_FLAG_REQUEST_KEEPALIVE,
                     response_flags & YMO_HTTP_FLAG_REQUEST_KEEPALIVE);
             ymo_conn_shutdown(conn);
+            break;
         }
+    }
+
+    if( no_sent ) {
         /* If there are more ready responses, return YMO_WOULDBLOCK to keep the
          * write watcher enabled: */
         ymo_http_response_t* next =
@@ -759,11 +1226,26 @@ ymo_status_t ymo_proto_http_write(
         } else if( http_session->state == YMO_HTTP_SESSION_ERROR ) {
             /* If the last response was sent and we're in an error
              * state, let's close the thing down: */
-            HTTP_PROTO_TRACE("Closing due to HTTP %i", http_status);
+            HTTP_PROTO_TRACE("Closing after HTTP error on %i", socket);
             ymo_conn_shutdown(conn);
         }
     }
 
+    /* Let a streaming response refill the send buffer. If it does, keep the
+     * write watcher going:
+     */
+    if( status == YMO_OKAY ) {
+        if( (status = drain_check(http_session)) != YMO_OKAY ) {
+            return status;
+        }
+
+        response = ymo_http_session_next_response(http_session);
+        if( response && (response->flags & YMO_HTTP_RESPONSE_READY)
+                && (response->body_queued
+                    || (response->flags & YMO_HTTP_RESPONSE_COMPLETE)) ) {
+            status = YMO_WOULDBLOCK;
+        }
+    }
     return status;
 }
 
@@ -787,12 +1269,24 @@ ssize_t ymo_proto_http_handle_error(
         return YMO_ERROR_SSIZE_T(EPIPE);
     }
 
-    ymo_http_status_t r_status;
     ymo_http_response_t* resp_err = ymo_http_response_create(session);
     if( !resp_err ) {
         return YMO_ERROR_SSIZE_T(ENOMEM);
     }
 
+    ymo_http_status_t r_status = ymo_proto_http_error_status(
+            &exchange->request, status);
+    ymo_log_trace("Failing HTTP request with status: %i", r_status);
+    ymo_http_session_add_response(session, resp_err);
+    ymo_http_response_issue(resp_err, r_status);
+    return YMO_OKAY;
+}
+
+
+ymo_http_status_t ymo_proto_http_error_status(
+        const ymo_http_request_t* request, ymo_status_t status)
+{
+    ymo_http_status_t r_status;
     switch( status ) {
         case EPROTO:
         case EBADMSG:
@@ -803,7 +1297,7 @@ ssize_t ymo_proto_http_handle_error(
             r_status = YMO_HTTP_INTERNAL_SERVER_ERROR;
             break;
         case EFBIG:
-            if( !(exchange->request.flags & YMO_HTTP_FLAG_EXPECT) ) {
+            if( !(request->flags & YMO_HTTP_FLAG_EXPECT) ) {
                 r_status = YMO_HTTP_REQUEST_ENTITY_TOO_LARGE;
             } else {
                 r_status = YMO_HTTP_EXPECTATION_FAILED;
@@ -825,10 +1319,6 @@ ssize_t ymo_proto_http_handle_error(
             r_status = YMO_HTTP_INTERNAL_SERVER_ERROR;
             break;
     }
-
-    ymo_log_trace("Failing HTTP request with status: %i", r_status);
-    ymo_http_session_add_response(session, resp_err);
-    ymo_http_response_issue(resp_err, r_status);
-    return YMO_OKAY;
+    return r_status;
 }
 
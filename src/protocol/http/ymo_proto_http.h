@@ -29,6 +29,15 @@
 #include "ymo_http.h"
 #include "core/ymo_net.h"
 #include "core/ymo_bucket.h"
+#include "ymo_http_response.h"
+#include "ymo_http_exchange.h"
+
+/** Value used for the ``Server`` header, if :c:macro:`YMO_HTTP_PROTO_SERVER`
+ * is set.
+ */
+#ifndef YMO_HTTP_SERVER_NAME
+#define YMO_HTTP_SERVER_NAME "yimmo"
+#endif /* YMO_HTTP_SERVER_NAME */
 
 /** Protocol
  * ==========
@@ -59,7 +68,19 @@ typedef struct ymo_http_proto_data {
     ymo_http_cb_t                  http_cb;
     ymo_http_session_cleanup_cb_t  session_cleanup;
     ymo_http_upgrade_chain_t*      upgrade_handler;
+    ymo_proto_t*                   h2_proto;   /* Prior knowledge/h2c */
     void*                          data;
+    ymo_http_proto_flags_t         flags;
+    size_t                         body_mem_max; /* Spool: in-memory limit */
+    size_t                         body_max;     /* Spool: body limit */
+    size_t                         hdr_max;      /* Header storage limit */
+    ymo_http_compress_t*           compress;     /* Compression, if enabled */
+    ymo_http_cache_t*              cache;        /* Microcache, if enabled */
+    ymo_http_router_t*             router;       /* URL router, if set */
+    ymo_http_exchange_pool_t       exchange_pool; /* Idle exchanges */
+    ymo_http_auto_hdrs_t           auto_hdrs;  /* Cached Date/Server */
+    struct ev_loop*                loop;       /* Loop running w_date */
+    ev_periodic                    w_date;     /* Refreshes auto_hdrs.date */
 } ymo_http_proto_data_t;
 
 
@@ -114,6 +135,29 @@ ssize_t ymo_proto_http_handle_error(
         ymo_conn_t* conn,
         ymo_status_t status);
 
+/** Set up body storage for a request whose headers are complete and which
+ * has a body to follow. This is a no-op unless body spooling is enabled.
+ *
+ * :returns: ``YMO_OKAY`` on success; ``EFBIG`` if the declared
+ *           content-length exceeds the limit; ``ENOMEM``, otherwise.
+ */
+ymo_status_t ymo_proto_http_body_init(
+        const ymo_http_proto_data_t* http_data, ymo_http_request_t* request);
+
+/** Hand a request to the user: to the router, if there is one, else to
+ * ``http_cb``.
+ */
+ymo_status_t ymo_proto_http_dispatch(
+        const ymo_http_proto_data_t* http_data,
+        ymo_http_session_t* session,
+        ymo_http_request_t* request,
+        ymo_http_response_t* response);
+
+/** Map an errno-style status to the HTTP status used to fail a request.
+ */
+ymo_http_status_t ymo_proto_http_error_status(
+        const ymo_http_request_t* request, ymo_status_t status);
+
 
 #endif /* YMO_HTTP_PROTO_HTTP_H */
 
@@ -0,0 +1,2328 @@
+/*=============================================================================
+ * libyimmo: Lightweight socket server framework
+ *
+ *  Copyright (c) 2014 Andrew Canaday
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *===========================================================================*/
+
+#include "yimmo_config.h"
+
+#include "ymo_alloc.h"
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "yimmo.h"
+#include "ymo_log.h"
+#include "core/ymo_net.h"
+#include "core/ymo_server.h"
+#include "core/ymo_conn.h"
+#include "core/ymo_bucket.h"
+#include "ymo_proto_http.h"
+#include "ymo_proto_http2.h"
+#include "ymo_http_session.h"
+#include "ymo_http_exchange.h"
+#include "ymo_http_response.h"
+#include "ymo_http_hdr_table.h"
+#include "ymo_http2_hpack.h"
+
+#define YMO_HTTP2_TRACE_PROTO 0
+#if defined(YMO_HTTP2_TRACE_PROTO) && YMO_HTTP2_TRACE_PROTO == 1
+#define HTTP2_TRACE(fmt, ...) ymo_log_trace(fmt, __VA_ARGS__);
+#else
+#define HTTP2_TRACE(fmt, ...)
+#endif /* YMO_HTTP2_TRACE_PROTO */
+
+/* Default stream weight (RFC 9113 §5.3.5): */
+#define HTTP2_DEFAULT_WEIGHT 16
+
+/* Streams are presented to handlers as HTTP/1.1 requests which support
+ * streamed ("chunked") responses and never close the connection:
+ */
+#define HTTP2_REQUEST_FLAGS \
+    (YMO_HTTP_FLAG_VERSION_1_1 \
+     | YMO_HTTP_FLAG_REQUEST_KEEPALIVE \
+     | YMO_HTTP_FLAG_SUPPORTS_CHUNKED)
+
+static const char* http2_version = "HTTP/2";
+
+/*---------------------------------------------------------------*
+ *  Yimmo HTTP/2 Protocol:
+ *---------------------------------------------------------------*/
+static ymo_proto_vt_t ymo_default_http2_proto = {
+    .init_cb = &ymo_proto_http2_init,
+    .cleanup_cb = &ymo_proto_http2_cleanup,
+    .conn_init_cb = &ymo_proto_http2_conn_init,
+    .conn_ready_cb = &ymo_proto_http2_conn_ready,
+    .read_cb = &ymo_proto_http2_read,
+    .write_cb = &ymo_proto_http2_write,
+    .conn_cleanup_cb = &ymo_proto_http2_conn_cleanup,
+};
+
+
+ymo_proto_t* ymo_proto_http2_create(ymo_proto_t* http_proto)
+{
+    if( !http_proto || !http_proto->data ) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    ymo_proto_t* h2_proto = YMO_NEW0(ymo_proto_t);
+    if( !h2_proto ) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    h2_proto->name = "HTTP/2";
+    h2_proto->vtable = ymo_default_http2_proto;
+
+    /* Share the callbacks and settings of the HTTP/1.x protocol object (which
+     * also accepts HTTP/2 with prior knowledge from here on):
+     */
+    ymo_http_proto_data_t* http_data = http_proto->data;
+    h2_proto->data = http_data;
+    http_data->h2_proto = h2_proto;
+    return h2_proto;
+}
+
+
+/* The protocol data is shared with HTTP/1.x, and init/cleanup there are
+ * idempotent, so either may run first:
+ */
+ymo_status_t ymo_proto_http2_init(ymo_proto_t* proto, ymo_server_t* server)
+{
+    return ymo_proto_http_init(proto, server);
+}
+
+
+void ymo_proto_http2_cleanup(ymo_proto_t* proto, ymo_server_t* server)
+{
+    ymo_proto_http_cleanup(proto, server);
+    return;
+}
+
+
+/*---------------------------------------------------------------*
+ *  Frame Output:
+ *---------------------------------------------------------------*/
+static inline uint32_t get_u32(const uint8_t* p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16)
+        | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+
+static inline void put_u32(uint8_t* p, uint32_t v)
+{
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+}
+
+
+static inline void put_frame_hdr(
+        uint8_t* p, size_t len, uint8_t type, uint8_t flags, uint32_t id)
+{
+    p[0] = (uint8_t)(len >> 16);
+    p[1] = (uint8_t)(len >> 8);
+    p[2] = (uint8_t)len;
+    p[3] = type;
+    p[4] = flags;
+    put_u32(p + 5, id & 0x7fffffff);
+}
+
+
+/* Append buckets to the connection send buffer: */
+static inline void h2_queue(ymo_http2_session_t* s, ymo_bucket_t* buckets)
+{
+    if( s->send_buffer ) {
+        s->send_tail = ymo_bucket_append(s->send_tail, buckets);
+    } else {
+        s->send_buffer = buckets;
+        s->send_tail = ymo_bucket_append(NULL, buckets);
+    }
+    ymo_conn_tx_enable(s->conn, 1);
+}
+
+
+/* Create a bucket holding a frame header for a len byte payload, followed by
+ * buf_len bytes of space for the payload itself:
+ */
+static ymo_bucket_t* h2_frame_bucket(
+        size_t buf_len, size_t len, uint8_t type, uint8_t flags, uint32_t id)
+{
+    size_t frame_len = YMO_HTTP2_FRAME_HDR_LEN + buf_len;
+    char* buf = YMO_ALLOC(frame_len);
+    if( !buf ) {
+        return NULL;
+    }
+
+    ymo_bucket_t* bucket = ymo_bucket_create(
+            NULL, NULL, buf, frame_len, buf, frame_len);
+    if( !bucket ) {
+        YMO_FREE(buf);
+        return NULL;
+    }
+
+    put_frame_hdr((uint8_t*)buf, len, type, flags, id);
+    return bucket;
+}
+
+
+/* Queue a frame with a len byte payload, returning a pointer to the payload
+ * for the caller to fill in (or NULL, if we're out of memory):
+ */
+static uint8_t* h2_frame_alloc(
+        ymo_http2_session_t* s,
+        size_t len, uint8_t type, uint8_t flags, uint32_t id)
+{
+    ymo_bucket_t* bucket = h2_frame_bucket(len, len, type, flags, id);
+    if( !bucket ) {
+        return NULL;
+    }
+
+    h2_queue(s, bucket);
+    return (uint8_t*)bucket->buf + YMO_HTTP2_FRAME_HDR_LEN;
+}
+
+
+static uint32_t h2_send_rst(
+        ymo_http2_session_t* s, uint32_t id, uint32_t code)
+{
+    HTTP2_TRACE("RST_STREAM %" PRIu32 " (%" PRIu32 ")", id, code);
+    uint8_t* p = h2_frame_alloc(s, 4, YMO_HTTP2_RST_STREAM, 0, id);
+    if( !p ) {
+        return YMO_HTTP2_INTERNAL_ERROR;
+    }
+    put_u32(p, code);
+    return YMO_HTTP2_NO_ERROR;
+}
+
+
+static uint32_t h2_send_window_update(
+        ymo_http2_session_t* s, uint32_t id, uint32_t increment)
+{
+    uint8_t* p = h2_frame_alloc(s, 4, YMO_HTTP2_WINDOW_UPDATE, 0, id);
+    if( !p ) {
+        return YMO_HTTP2_INTERNAL_ERROR;
+    }
+    put_u32(p, increment);
+    return YMO_HTTP2_NO_ERROR;
+}
+
+
+/* Connection error: queue a GOAWAY and shut down once it's been sent. */
+static void h2_conn_error(ymo_http2_session_t* s, uint32_t code)
+{
+    if( s->closing ) {
+        return;
+    }
+
+    ymo_log_debug("HTTP/2 connection error %" PRIu32 " on %p",
+            code, (void*)s->conn);
+    uint8_t* p = h2_frame_alloc(s, 8, YMO_HTTP2_GOAWAY, 0, 0);
+    if( p ) {
+        put_u32(p, s->last_stream_id);
+        put_u32(p + 4, code);
+    }
+    s->closing = 1;
+    ymo_conn_tx_enable(s->conn, 1);
+    return;
+}
+
+
+/*---------------------------------------------------------------*
+ *  Streams:
+ *---------------------------------------------------------------*/
+static ymo_http2_stream_t* h2_stream_find(
+        ymo_http2_session_t* s, uint32_t id)
+{
+    ymo_http2_stream_t* st = s->streams;
+    while( st && st->id != id ) {
+        st = st->next;
+    }
+    return st;
+}
+
+
+/* Create a stream for the given exchange (or a new one, if NULL): */
+static ymo_http2_stream_t* h2_stream_create(
+        ymo_http2_session_t* s, uint32_t id, ymo_http_exchange_t* exchange)
+{
+    ymo_http2_stream_t* st = YMO_NEW0(ymo_http2_stream_t);
+    if( !st ) {
+        return NULL;
+    }
+
+    if( !exchange ) {
+        exchange = ymo_http_exchange_acquire(&s->http_data->exchange_pool);
+        if( !exchange ) {
+            YMO_DELETE(ymo_http2_stream_t, st);
+            return NULL;
+        }
+        exchange->hdr_max = s->http_data->hdr_max;
+    }
+
+    st->id = id;
+    st->state = YMO_HTTP2_STATE_OPEN;
+    st->weight = HTTP2_DEFAULT_WEIGHT;
+    st->body_remain = SIZE_MAX;
+    st->send_window = s->peer_initial_window;
+    st->recv_window = YMO_HTTP2_DEFAULT_WINDOW;
+    st->exchange = exchange;
+
+    if( s->streams_tail ) {
+        s->streams_tail->next = st;
+    } else {
+        s->streams = st;
+    }
+    s->streams_tail = st;
+    s->no_streams++;
+    if( id > s->last_stream_id ) {
+        s->last_stream_id = id;
+    }
+    return st;
+}
+
+
+static void h2_stream_close(ymo_http2_session_t* s, ymo_http2_stream_t* st)
+{
+    if( st->state != YMO_HTTP2_STATE_CLOSED ) {
+        st->state = YMO_HTTP2_STATE_CLOSED;
+        s->no_streams--;
+    }
+    return;
+}
+
+
+static void h2_stream_free(ymo_http2_stream_t* st)
+{
+    if( st->response ) {
+        ymo_bucket_free_all(st->response->body_head);
+        ymo_http_response_free(st->response);
+    }
+    ymo_http_exchange_free(st->exchange);
+    YMO_DELETE(ymo_http2_stream_t, st);
+    return;
+}
+
+
+/* Free closed streams (this is only safe once the send buffer is empty,
+ * since DATA frames can reference the response body). A response which has
+ * been handed to http_cb stays put until it's complete:
+ */
+static void h2_stream_sweep(ymo_http2_session_t* s)
+{
+    ymo_http2_stream_t** st_p = &s->streams;
+    ymo_http2_stream_t* prev = NULL;
+
+    while( *st_p )
+    {
+        ymo_http2_stream_t* st = *st_p;
+        if( st->state == YMO_HTTP2_STATE_CLOSED
+            && (!st->dispatched || !st->response
+                || (st->response->flags & YMO_HTTP_RESPONSE_COMPLETE)) ) {
+            *st_p = st->next;
+            h2_stream_free(st);
+        } else {
+            prev = st;
+            st_p = &st->next;
+        }
+    }
+    s->streams_tail = prev;
+    return;
+}
+
+
+/* Stream error: reset the stream and stop sending on it. */
+static uint32_t h2_stream_reset(
+        ymo_http2_session_t* s, ymo_http2_stream_t* st, uint32_t code)
+{
+    st->headers_sent = st->end_sent = 1;
+    h2_stream_close(s, st);
+    return h2_send_rst(s, st->id, code);
+}
+
+
+/* Respond to the stream with an error status, if we still can, and ignore
+ * the rest of the request; else reset it:
+ */
+static uint32_t h2_stream_fail(
+        ymo_http2_session_t* s,
+        ymo_http2_stream_t* st,
+        ymo_http_status_t status)
+{
+    ymo_http_response_t* response = st->response;
+    if( st->headers_sent || st->dispatched || !response ) {
+        return h2_stream_reset(s, st, YMO_HTTP2_INTERNAL_ERROR);
+    }
+
+    ymo_log_debug("Failing HTTP/2 stream %" PRIu32 " with %i",
+            st->id, status);
+    ymo_bucket_free_all(response->body_head);
+    response->body_head = response->body_tail = NULL;
+    response->canned = NULL;
+    ymo_http_hdr_table_clear(&response->headers);
+    ymo_http_response_set_status(response, status);
+    ymo_http_response_finish(response);
+    st->discard = 1;
+    return YMO_HTTP2_NO_ERROR;
+}
+
+
+/* END_STREAM has been queued for the response: */
+static uint32_t h2_stream_end(ymo_http2_session_t* s, ymo_http2_stream_t* st)
+{
+    uint32_t err = YMO_HTTP2_NO_ERROR;
+    st->end_sent = 1;
+
+    /* Responded before the request was complete; tell the client to stop
+     * sending (RFC 9113 §8.1):
+     */
+    if( st->state == YMO_HTTP2_STATE_OPEN ) {
+        err = h2_send_rst(s, st->id, YMO_HTTP2_NO_ERROR);
+    }
+    h2_stream_close(s, st);
+    return err;
+}
+
+
+/* The request on st is complete; hand it to the user: */
+static uint32_t h2_request_end(ymo_http2_session_t* s, ymo_http2_stream_t* st)
+{
+    ymo_http_proto_data_t* http_data = s->http_data;
+    ymo_http_request_t* request = &st->exchange->request;
+
+    st->state = YMO_HTTP2_STATE_HALF_CLOSED_REMOTE;
+    if( st->discard ) {
+        return YMO_HTTP2_NO_ERROR;
+    }
+
+    HTTP2_TRACE("Dispatching stream %" PRIu32 ": %s %s",
+            st->id, request->method, request->uri);
+    ymo_http_compress_negotiate(http_data->compress, request, st->response);
+    ymo_status_t status;
+    switch( ymo_http_cache_lookup(http_data->cache, request, st->response) ) {
+        case YMO_HTTP_CACHE_HIT:
+            status = YMO_OKAY;
+            break;
+        case YMO_HTTP_CACHE_WAIT:
+            status = YMO_WOULDBLOCK;
+            break;
+        default:
+            status = ymo_proto_http_dispatch(
+                    http_data, s->http_session, request, st->response);
+            break;
+    }
+
+    if( status == YMO_OKAY || YMO_IS_BLOCKED(status) ) {
+        st->dispatched = 1;
+        return YMO_HTTP2_NO_ERROR;
+    }
+    return h2_stream_fail(s, st, ymo_proto_http_error_status(request, status));
+}
+
+
+/* Content-length check, at END_STREAM: */
+static uint32_t h2_request_complete(
+        ymo_http2_session_t* s, ymo_http2_stream_t* st)
+{
+    if( st->body_remain && st->body_remain != SIZE_MAX ) {
+        return h2_stream_reset(s, st, YMO_HTTP2_PROTOCOL_ERROR);
+    }
+    return h2_request_end(s, st);
+}
+
+
+/*---------------------------------------------------------------*
+ *  Request Headers:
+ *---------------------------------------------------------------*/
+typedef struct h2_request_ctx {
+    ymo_http2_stream_t*   stream;
+    ymo_http_exchange_t*  exchange;
+    const char*           authority;
+    const char*           scheme;
+    int                   regular;   /* Seen a regular header */
+    int                   malformed;
+    int                   too_large;
+} h2_request_ctx_t;
+
+
+/* Allocate len bytes from the exchange header storage (which is where the
+ * HTTP/1.x parser keeps the request line and headers, too):
+ */
+static char* h2_request_alloc(ymo_http_exchange_t* exchange, size_t len)
+{
+    if( len > exchange->remain
+        && !ymo_http_exchange_grow(exchange, NULL, len) ) {
+        return NULL;
+    }
+
+    char* out = exchange->recv_current;
+    exchange->recv_current += len;
+    exchange->remain -= len;
+    return out;
+}
+
+
+static char* h2_request_strdup(
+        ymo_http_exchange_t* exchange, const char* str, size_t len)
+{
+    char* out = h2_request_alloc(exchange, len + 1);
+    if( out ) {
+        memcpy(out, str, len);
+        out[len] = '\0';
+    }
+    return out;
+}
+
+
+/* RFC 9113 §8.2.1: no uppercase names; no NUL, CR, or LF anywhere. */
+static int h2_field_valid(
+        const char* name, size_t name_len,
+        const char* value, size_t value_len)
+{
+    if( !name_len ) {
+        return 0;
+    }
+
+    for( size_t i = 0; i < name_len; i++ ) {
+        char c = name[i];
+        if( (c >= 'A' && c <= 'Z') || c == '\0' || c == '\r' || c == '\n' ) {
+            return 0;
+        }
+    }
+
+    for( size_t i = 0; i < value_len; i++ ) {
+        char c = value[i];
+        if( c == '\0' || c == '\r' || c == '\n' ) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+
+static ymo_status_t h2_request_pseudo(
+        h2_request_ctx_t* ctx,
+        const char* name,
+        size_t name_len,
+        const char* value,
+        size_t value_len)
+{
+    ymo_http_request_t* request = &ctx->exchange->request;
+    const char** target;
+
+#define H2_PSEUDO_IS(n) \
+    (name_len == sizeof(n)-1 && !memcmp(name, n, sizeof(n)-1))
+
+    if( H2_PSEUDO_IS(":method") ) {
+        target = &request->method;
+    } else if( H2_PSEUDO_IS(":path") ) {
+        target = &request->uri;
+    } else if( H2_PSEUDO_IS(":authority") ) {
+        target = &ctx->authority;
+    } else if( H2_PSEUDO_IS(":scheme") ) {
+        target = &ctx->scheme;
+    } else {
+        ctx->malformed = 1;
+        return YMO_OKAY;
+    }
+#undef H2_PSEUDO_IS
+
+    /* Pseudo-headers come first, once each, and aren't empty: */
+    if( ctx->regular || *target || !value_len
+        || !h2_field_valid(name + 1, name_len - 1, value, value_len) ) {
+        ctx->malformed = 1;
+        return YMO_OKAY;
+    }
+
+    if( !(*target = h2_request_strdup(ctx->exchange, value, value_len)) ) {
+        ctx->too_large = 1;
+    }
+    return YMO_OKAY;
+}
+
+
+/* HPACK field callback used to build the request. This always returns
+ * YMO_OKAY, since the decoder has to see the whole block either way.
+ */
+static ymo_status_t h2_request_field_cb(
+        void* data,
+        ymo_http_hdr_id_t h_id,
+        const char* name,
+        size_t name_len,
+        const char* value,
+        size_t value_len)
+{
+    h2_request_ctx_t* ctx = data;
+    ymo_http_exchange_t* exchange = ctx->exchange;
+    ymo_http_request_t* request = &exchange->request;
+
+    if( ctx->malformed || ctx->too_large ) {
+        return YMO_OKAY;
+    }
+
+    if( name_len && name[0] == ':' ) {
+        return h2_request_pseudo(ctx, name, name_len, value, value_len);
+    }
+
+    ctx->regular = 1;
+    if( !h2_field_valid(name, name_len, value, value_len) ) {
+        ctx->malformed = 1;
+        return YMO_OKAY;
+    }
+
+    switch( h_id ) {
+        /* Connection-specific headers are malformed (RFC 9113 §8.2.2): */
+        case YMO_HTTP_HID_CONNECTION:
+        case YMO_HTTP_HID_KEEP_ALIVE:
+        case YMO_HTTP_HID_PROXY_CONNECTION:
+        case YMO_HTTP_HID_TRANSFER_ENCODING:
+        case YMO_HTTP_HID_UPGRADE:
+            ctx->malformed = 1;
+            return YMO_OKAY;
+        case YMO_HTTP_HID_TE:
+            if( value_len != sizeof("trailers")-1
+                || memcmp(value, "trailers", value_len) ) {
+                ctx->malformed = 1;
+                return YMO_OKAY;
+            }
+            break;
+        case YMO_HTTP_HID_CONTENT_LENGTH:
+        {
+            size_t content_length = 0;
+            for( size_t i = 0; i < value_len; i++ ) {
+                if( value[i] < '0' || value[i] > '9'
+                    || content_length > (SIZE_MAX - 9) / 10 ) {
+                    ctx->malformed = 1;
+                    return YMO_OKAY;
+                }
+                content_length = content_length * 10 + (value[i] - '0');
+            }
+
+            if( !value_len || ctx->stream->body_remain != SIZE_MAX ) {
+                ctx->malformed = 1;
+                return YMO_OKAY;
+            }
+            request->content_length = content_length;
+            ctx->stream->body_remain = content_length;
+        }
+        break;
+        default:
+            break;
+    }
+
+    char* hdr_name = h2_request_strdup(exchange, name, name_len);
+    if( !hdr_name ) {
+        ctx->too_large = 1;
+        return YMO_OKAY;
+    }
+
+    if( h_id == YMO_HTTP_HID_NONE ) {
+        h_id = ymo_http_hdr_id(hdr_name, name_len);
+    }
+
+    /* Cookies may be split across fields; rejoin them with "; " rather
+     * than the usual "," (RFC 9113 §8.2.3):
+     */
+    const char* cookie = NULL;
+    if( h_id == YMO_HTTP_HID_COOKIE
+        && (cookie = ymo_http_hdr_table_get_id(&request->headers, h_id)) ) {
+        size_t cookie_len = strlen(cookie);
+        char* joined = h2_request_alloc(
+                exchange, cookie_len + 2 + value_len + 1);
+        if( !joined ) {
+            ctx->too_large = 1;
+            return YMO_OKAY;
+        }
+        memcpy(joined, cookie, cookie_len);
+        memcpy(joined + cookie_len, "; ", 2);
+        memcpy(joined + cookie_len + 2, value, value_len);
+        joined[cookie_len + 2 + value_len] = '\0';
+        ymo_http_hdr_table_insert_precompute(
+                &request->headers, h_id, hdr_name, name_len, joined);
+        return YMO_OKAY;
+    }
+
+    char* hdr_value = h2_request_strdup(exchange, value, value_len);
+    if( !hdr_value ) {
+        ctx->too_large = 1;
+        return YMO_OKAY;
+    }
+
+    ymo_http_hdr_table_add_precompute(
+            &request->headers, h_id, hdr_name, name_len, hdr_value);
+    return YMO_OKAY;
+}
+
+
+/* HPACK field callback for blocks we're ignoring: */
+static ymo_status_t h2_discard_field_cb(
+        void* data,
+        ymo_http_hdr_id_t h_id,
+        const char* name,
+        size_t name_len,
+        const char* value,
+        size_t value_len)
+{
+    return YMO_OKAY;
+}
+
+
+static uint32_t h2_hpack_error(ymo_status_t status)
+{
+    return (status == ENOMEM)
+        ? YMO_HTTP2_INTERNAL_ERROR : YMO_HTTP2_COMPRESSION_ERROR;
+}
+
+
+/* Build the request for a new stream from its header block: */
+static uint32_t h2_request_headers(
+        ymo_http2_session_t* s,
+        ymo_http2_stream_t* st,
+        const uint8_t* block,
+        size_t len,
+        int end_stream)
+{
+    ymo_http_proto_data_t* http_data = s->http_data;
+    ymo_http_exchange_t* exchange = st->exchange;
+    ymo_http_request_t* request = &exchange->request;
+    h2_request_ctx_t ctx = {
+        .stream = st,
+        .exchange = exchange,
+    };
+
+    request->method = NULL;
+    ymo_status_t status = ymo_hpack_decode(
+            &s->hpack, block, len, &h2_request_field_cb, &ctx);
+    if( status == E2BIG ) {
+        ctx.too_large = 1;
+    } else if( status != YMO_OKAY ) {
+        return h2_hpack_error(status);
+    }
+
+    if( !ctx.too_large
+        && (ctx.malformed || !request->method
+            || !request->uri || !ctx.scheme) ) {
+        ymo_log_debug("Malformed request on HTTP/2 stream %" PRIu32, st->id);
+        return h2_stream_reset(s, st, YMO_HTTP2_PROTOCOL_ERROR);
+    }
+
+    request->version = http2_version;
+    request->flags = HTTP2_REQUEST_FLAGS;
+    st->no_body = request->method && !strcmp(request->method, "HEAD");
+
+    /* Split the query and fragment off of the path, as the HTTP/1.x
+     * parser does:
+     */
+    if( request->uri ) {
+        char* uri = (char*)request->uri;
+        char* mark;
+        if( (mark = strchr(uri, '#')) ) {
+            *mark++ = '\0';
+            request->fragment = mark;
+        }
+        if( (mark = strchr(uri, '?')) ) {
+            *mark++ = '\0';
+            request->query = mark;
+        }
+    }
+
+    /* :authority stands in for Host (RFC 9113 §8.3.1): */
+    if( ctx.authority && !ymo_http_hdr_table_get_id(
+                &request->headers, YMO_HTTP_HID_HOST) ) {
+        ymo_http_hdr_table_add_precompute(
+                &request->headers, YMO_HTTP_HID_HOST,
+                "host", sizeof("host")-1, ctx.authority);
+    }
+
+    ymo_http_response_t* response = &exchange->response;
+    ymo_http_response_init(response, s->http_session);
+    response->flags = request->flags;
+    st->response = response;
+
+    if( ctx.too_large ) {
+        /* 431 Request Header Fields Too Large (RFC 6585 §5): */
+        return h2_stream_fail(s, st, 431);
+    }
+
+    if( !end_stream ) {
+        status = ymo_proto_http_body_init(http_data, request);
+        if( status != YMO_OKAY ) {
+            return h2_stream_fail(
+                    s, st, ymo_proto_http_error_status(request, status));
+        }
+    }
+
+    if( http_data->header_cb ) {
+        status = http_data->header_cb(
+                s->http_session, request, response,
+                s->http_session->user_data);
+        if( status != YMO_OKAY ) {
+            uint32_t err = h2_stream_fail(
+                    s, st, ymo_proto_http_error_status(request, status));
+            if( err ) {
+                return err;
+            }
+        }
+    }
+
+    if( end_stream ) {
+        return h2_request_end(s, st);
+    }
+    return YMO_HTTP2_NO_ERROR;
+}
+
+
+/* A complete header block has been received for stream id: */
+static uint32_t h2_header_block(
+        ymo_http2_session_t* s,
+        uint32_t id,
+        uint8_t flags,
+        const uint8_t* block,
+        size_t len)
+{
+    ymo_http2_stream_t* st = h2_stream_find(s, id);
+    int end_stream = (flags & YMO_HTTP2_FLAG_END_STREAM);
+    ymo_status_t status;
+
+    if( st && st->state == YMO_HTTP2_STATE_OPEN ) {
+        if( !st->response ) {
+            return h2_request_headers(s, st, block, len, end_stream);
+        }
+
+        /* Trailers: these must end the stream. We don't pass them on. */
+        status = ymo_hpack_decode(
+                &s->hpack, block, len, &h2_discard_field_cb, NULL);
+        if( status != YMO_OKAY && status != E2BIG ) {
+            return h2_hpack_error(status);
+        }
+
+        if( !end_stream ) {
+            return h2_stream_reset(s, st, YMO_HTTP2_PROTOCOL_ERROR);
+        }
+        return h2_request_complete(s, st);
+    }
+
+    /* Refused or reset stream: the block still has to be decoded, to keep
+     * the HPACK table in sync:
+     */
+    status = ymo_hpack_decode(
+            &s->hpack, block, len, &h2_discard_field_cb, NULL);
+    if( status != YMO_OKAY && status != E2BIG ) {
+        return h2_hpack_error(status);
+    }
+    return YMO_HTTP2_NO_ERROR;
+}
+
+
+/* Append a HEADERS/CONTINUATION fragment to the pending header block: */
+static uint32_t h2_header_fragment(
+        ymo_http2_session_t* s, const uint8_t* p, size_t len)
+{
+    if( s->hdr_len + len > YMO_HTTP2_HDR_BLOCK_MAX ) {
+        return YMO_HTTP2_ENHANCE_YOUR_CALM;
+    }
+
+    if( s->hdr_len + len > s->hdr_cap ) {
+        size_t cap = s->hdr_cap ? s->hdr_cap : YMO_HTTP2_DEFAULT_FRAME_SIZE;
+        while( cap < s->hdr_len + len ) {
+            cap *= 2;
+        }
+
+        uint8_t* hdr_block = YMO_ALLOC(cap);
+        if( !hdr_block ) {
+            return YMO_HTTP2_INTERNAL_ERROR;
+        }
+        if( s->hdr_len ) {
+            memcpy(hdr_block, s->hdr_block, s->hdr_len);
+        }
+        YMO_FREE(s->hdr_block);
+        s->hdr_block = hdr_block;
+        s->hdr_cap = cap;
+    }
+
+    if( len ) {
+        memcpy(s->hdr_block + s->hdr_len, p, len);
+        s->hdr_len += len;
+    }
+    return YMO_HTTP2_NO_ERROR;
+}
+
+
+/*---------------------------------------------------------------*
+ *  Frame Handlers:
+ *
+ *  Each returns an HTTP/2 error code for connection errors (or
+ *  YMO_HTTP2_NO_ERROR); stream errors are handled in place.
+ *---------------------------------------------------------------*/
+
+/* Strip frame padding (RFC 9113 §6.1): */
+static uint32_t h2_unpad(
+        uint8_t flags, const uint8_t** p, size_t* len)
+{
+    if( flags & YMO_HTTP2_FLAG_PADDED ) {
+        if( !*len ) {
+            return YMO_HTTP2_FRAME_SIZE_ERROR;
+        }
+
+        size_t pad_len = (*p)[0];
+        (*p)++;
+        (*len)--;
+        if( pad_len > *len ) {
+            return YMO_HTTP2_PROTOCOL_ERROR;
+        }
+        *len -= pad_len;
+    }
+    return YMO_HTTP2_NO_ERROR;
+}
+
+
+static uint32_t h2_on_data(
+        ymo_http2_session_t* s,
+        uint8_t flags,
+        uint32_t id,
+        const uint8_t* p,
+        size_t len)
+{
+    ymo_http_proto_data_t* http_data = s->http_data;
+    size_t flow_len = len; /* Padding counts, too */
+    uint32_t err;
+
+    if( !id ) {
+        return YMO_HTTP2_PROTOCOL_ERROR;
+    }
+
+    if( (err = h2_unpad(flags, &p, &len)) ) {
+        return err;
+    }
+
+    /* Connection flow control: */
+    s->recv_window -= flow_len;
+    if( s->recv_window < 0 ) {
+        return YMO_HTTP2_FLOW_CONTROL_ERROR;
+    }
+
+    if( s->recv_window < YMO_HTTP2_DEFAULT_WINDOW / 2 ) {
+        err = h2_send_window_update(
+                s, 0, (uint32_t)(YMO_HTTP2_DEFAULT_WINDOW - s->recv_window));
+        if( err ) {
+            return err;
+        }
+        s->recv_window = YMO_HTTP2_DEFAULT_WINDOW;
+    }
+
+    ymo_http2_stream_t* st = h2_stream_find(s, id);
+    if( !st ) {
+        if( id > s->last_stream_id ) {
+            return YMO_HTTP2_PROTOCOL_ERROR; /* Idle */
+        }
+        return h2_send_rst(s, id, YMO_HTTP2_STREAM_CLOSED);
+    }
+
+    switch( st->state ) {
+        case YMO_HTTP2_STATE_HALF_CLOSED_REMOTE:
+            return h2_stream_reset(s, st, YMO_HTTP2_STREAM_CLOSED);
+        case YMO_HTTP2_STATE_CLOSED:
+            return YMO_HTTP2_NO_ERROR;
+        default:
+            break;
+    }
+
+    /* Stream flow control: */
+    st->recv_window -= flow_len;
+    if( st->recv_window < 0 ) {
+        return h2_stream_reset(s, st, YMO_HTTP2_FLOW_CONTROL_ERROR);
+    }
+
+    if( len ) {
+        if( len > st->body_remain ) {
+            /* More data than the content-length (RFC 9113 §8.1.1): */
+            return h2_stream_reset(s, st, YMO_HTTP2_PROTOCOL_ERROR);
+        }
+
+        if( st->body_remain != SIZE_MAX ) {
+            st->body_remain -= len;
+        }
+
+        if( !st->discard ) {
+            ymo_http_request_t* request = &st->exchange->request;
+            ymo_status_t status = http_data->body_cb(
+                    s->http_session, request, st->response,
+                    (const char*)p, len, s->http_session->user_data);
+            if( status != YMO_OKAY ) {
+                err = h2_stream_fail(
+                        s, st, ymo_proto_http_error_status(request, status));
+                if( err ) {
+                    return err;
+                }
+            }
+        }
+    }
+
+    if( flags & YMO_HTTP2_FLAG_END_STREAM ) {
+        return h2_request_complete(s, st);
+    }
+
+    if( st->recv_window < YMO_HTTP2_DEFAULT_WINDOW / 2 ) {
+        err = h2_send_window_update(
+                s, id, (uint32_t)(YMO_HTTP2_DEFAULT_WINDOW - st->recv_window));
+        st->recv_window = YMO_HTTP2_DEFAULT_WINDOW;
+    }
+    return err;
+}
+
+
+static uint32_t h2_on_headers(
+        ymo_http2_session_t* s,
+        uint8_t flags,
+        uint32_t id,
+        const uint8_t* p,
+        size_t len)
+{
+    uint32_t depends_on = 0;
+    uint16_t weight = 0;
+    uint32_t err;
+
+    /* Client streams are odd-numbered: */
+    if( !id || !(id & 1) ) {
+        return YMO_HTTP2_PROTOCOL_ERROR;
+    }
+
+    if( (err = h2_unpad(flags, &p, &len)) ) {
+        return err;
+    }
+
+    if( flags & YMO_HTTP2_FLAG_PRIORITY ) {
+        if( len < 5 ) {
+            return YMO_HTTP2_FRAME_SIZE_ERROR;
+        }
+        depends_on = get_u32(p) & 0x7fffffff;
+        weight = (uint16_t)p[4] + 1;
+        p += 5;
+        len -= 5;
+    }
+
+    ymo_http2_stream_t* st = h2_stream_find(s, id);
+    if( !st ) {
+        if( id <= s->last_stream_id ) {
+            return YMO_HTTP2_STREAM_CLOSED;
+        }
+
+        if( s->no_streams >= YMO_HTTP2_MAX_STREAMS ) {
+            s->last_stream_id = id;
+            err = h2_send_rst(s, id, YMO_HTTP2_REFUSED_STREAM);
+        } else if( !(st = h2_stream_create(s, id, NULL)) ) {
+            return YMO_HTTP2_INTERNAL_ERROR;
+        }
+    } else if( st->state == YMO_HTTP2_STATE_HALF_CLOSED_REMOTE ) {
+        err = h2_stream_reset(s, st, YMO_HTTP2_STREAM_CLOSED);
+    }
+
+    if( err ) {
+        return err;
+    }
+
+    if( st && weight && st->state != YMO_HTTP2_STATE_CLOSED ) {
+        if( depends_on == id ) {
+            if( (err = h2_stream_reset(s, st, YMO_HTTP2_PROTOCOL_ERROR)) ) {
+                return err;
+            }
+        } else {
+            st->depends_on = depends_on;
+            st->weight = weight;
+        }
+    }
+
+    /* Common case: the whole block is right here. */
+    if( flags & YMO_HTTP2_FLAG_END_HEADERS ) {
+        return h2_header_block(s, id, flags, p, len);
+    }
+
+    s->hdr_stream = id;
+    s->hdr_flags = flags;
+    s->hdr_len = 0;
+    return h2_header_fragment(s, p, len);
+}
+
+
+static uint32_t h2_on_continuation(
+        ymo_http2_session_t* s,
+        uint8_t flags,
+        uint32_t id,
+        const uint8_t* p,
+        size_t len)
+{
+    uint32_t err;
+    if( !s->hdr_stream || id != s->hdr_stream ) {
+        return YMO_HTTP2_PROTOCOL_ERROR;
+    }
+
+    if( (err = h2_header_fragment(s, p, len)) ) {
+        return err;
+    }
+
+    if( flags & YMO_HTTP2_FLAG_END_HEADERS ) {
+        s->hdr_stream = 0;
+        err = h2_header_block(s, id, s->hdr_flags, s->hdr_block, s->hdr_len);
+        s->hdr_len = 0;
+    }
+    return err;
+}
+
+
+static uint32_t h2_on_priority(
+        ymo_http2_session_t* s,
+        uint32_t id,
+        const uint8_t* p,
+        size_t len)
+{
+    if( !id ) {
+        return YMO_HTTP2_PROTOCOL_ERROR;
+    }
+
+    /* RST_STREAM is never sent for idle streams (RFC 9113 §6.4), so
+     * errors on those are connection errors:
+     */
+    ymo_http2_stream_t* st = h2_stream_find(s, id);
+    if( len != 5 ) {
+        if( st ) {
+            return h2_stream_reset(s, st, YMO_HTTP2_FRAME_SIZE_ERROR);
+        }
+        return (id > s->last_stream_id)
+            ? YMO_HTTP2_FRAME_SIZE_ERROR
+            : h2_send_rst(s, id, YMO_HTTP2_FRAME_SIZE_ERROR);
+    }
+
+    uint32_t depends_on = get_u32(p) & 0x7fffffff;
+    if( depends_on == id ) {
+        if( st ) {
+            return h2_stream_reset(s, st, YMO_HTTP2_PROTOCOL_ERROR);
+        }
+        return (id > s->last_stream_id)
+            ? YMO_HTTP2_PROTOCOL_ERROR
+            : h2_send_rst(s, id, YMO_HTTP2_PROTOCOL_ERROR);
+    }
+
+    /* We don't keep priority state for idle streams: */
+    if( st ) {
+        st->depends_on = depends_on;
+        st->weight = (uint16_t)p[4] + 1;
+    }
+    return YMO_HTTP2_NO_ERROR;
+}
+
+
+static uint32_t h2_on_rst_stream(
+        ymo_http2_session_t* s,
+        uint32_t id,
+        const uint8_t* p,
+        size_t len)
+{
+    if( len != 4 ) {
+        return YMO_HTTP2_FRAME_SIZE_ERROR;
+    }
+
+    if( !id ) {
+        return YMO_HTTP2_PROTOCOL_ERROR;
+    }
+
+    ymo_http2_stream_t* st = h2_stream_find(s, id);
+    if( !st ) {
+        return (id > s->last_stream_id)
+            ? YMO_HTTP2_PROTOCOL_ERROR : YMO_HTTP2_NO_ERROR;
+    }
+
+    HTTP2_TRACE("Stream %" PRIu32 " reset by peer (%" PRIu32 ")",
+            id, get_u32(p));
+    st->headers_sent = st->end_sent = 1;
+    h2_stream_close(s, st);
+    return YMO_HTTP2_NO_ERROR;
+}
+
+
+/* Apply a SETTINGS payload from the peer (len is a multiple of 6): */
+static uint32_t h2_apply_settings(
+        ymo_http2_session_t* s, const uint8_t* p, size_t len)
+{
+    for( ; len >= 6; p += 6, len -= 6 )
+    {
+        uint16_t setting = (uint16_t)((p[0] << 8) | p[1]);
+        uint32_t value = get_u32(p + 2);
+
+        switch( setting ) {
+            case YMO_HTTP2_SETTINGS_ENABLE_PUSH:
+                if( value > 1 ) {
+                    return YMO_HTTP2_PROTOCOL_ERROR;
+                }
+                break;
+            case YMO_HTTP2_SETTINGS_INITIAL_WINDOW_SIZE:
+            {
+                if( value > YMO_HTTP2_MAX_WINDOW ) {
+                    return YMO_HTTP2_FLOW_CONTROL_ERROR;
+                }
+
+                /* Adjust every stream window by the difference
+                 * (RFC 9113 §6.9.2):
+                 */
+                int64_t delta = (int64_t)value - s->peer_initial_window;
+                ymo_http2_stream_t* st = s->streams;
+                while( st ) {
+                    st->send_window += delta;
+                    if( st->send_window > YMO_HTTP2_MAX_WINDOW ) {
+                        return YMO_HTTP2_FLOW_CONTROL_ERROR;
+                    }
+                    st = st->next;
+                }
+                s->peer_initial_window = value;
+            }
+            break;
+            case YMO_HTTP2_SETTINGS_MAX_FRAME_SIZE:
+                if( value < YMO_HTTP2_DEFAULT_FRAME_SIZE
+                    || value > YMO_HTTP2_MAX_FRAME_SIZE ) {
+                    return YMO_HTTP2_PROTOCOL_ERROR;
+                }
+                s->peer_max_frame = value;
+                break;
+            /* We never index or push, and the rest are advisory: */
+            default:
+                break;
+        }
+    }
+
+    ymo_conn_tx_enable(s->conn, 1);
+    return YMO_HTTP2_NO_ERROR;
+}
+
+
+static uint32_t h2_on_settings(
+        ymo_http2_session_t* s,
+        uint8_t flags,
+        uint32_t id,
+        const uint8_t* p,
+        size_t len)
+{
+    if( id ) {
+        return YMO_HTTP2_PROTOCOL_ERROR;
+    }
+
+    if( flags & YMO_HTTP2_FLAG_ACK ) {
+        return len ? YMO_HTTP2_FRAME_SIZE_ERROR : YMO_HTTP2_NO_ERROR;
+    }
+
+    if( len % 6 ) {
+        return YMO_HTTP2_FRAME_SIZE_ERROR;
+    }
+
+    uint32_t err = h2_apply_settings(s, p, len);
+    if( err ) {
+        return err;
+    }
+
+    if( !h2_frame_alloc(s, 0, YMO_HTTP2_SETTINGS, YMO_HTTP2_FLAG_ACK, 0) ) {
+        return YMO_HTTP2_INTERNAL_ERROR;
+    }
+    return YMO_HTTP2_NO_ERROR;
+}
+
+
+static uint32_t h2_on_ping(
+        ymo_http2_session_t* s,
+        uint8_t flags,
+        uint32_t id,
+        const uint8_t* p,
+        size_t len)
+{
+    if( len != 8 ) {
+        return YMO_HTTP2_FRAME_SIZE_ERROR;
+    }
+
+    if( id ) {
+        return YMO_HTTP2_PROTOCOL_ERROR;
+    }
+
+    if( !(flags & YMO_HTTP2_FLAG_ACK) ) {
+        uint8_t* pong = h2_frame_alloc(
+                s, 8, YMO_HTTP2_PING, YMO_HTTP2_FLAG_ACK, 0);
+        if( !pong ) {
+            return YMO_HTTP2_INTERNAL_ERROR;
+        }
+        memcpy(pong, p, 8);
+    }
+    return YMO_HTTP2_NO_ERROR;
+}
+
+
+static uint32_t h2_on_goaway(
+        ymo_http2_session_t* s,
+        uint32_t id,
+        const uint8_t* p,
+        size_t len)
+{
+    if( id ) {
+        return YMO_HTTP2_PROTOCOL_ERROR;
+    }
+
+    if( len < 8 ) {
+        return YMO_HTTP2_FRAME_SIZE_ERROR;
+    }
+
+    /* The peer won't open any more streams; finish the ones we have: */
+    ymo_log_debug("GOAWAY from peer on %p (last stream: %" PRIu32
+            "; error: %" PRIu32 ")",
+            (void*)s->conn, get_u32(p) & 0x7fffffff, get_u32(p + 4));
+    return YMO_HTTP2_NO_ERROR;
+}
+
+
+static uint32_t h2_on_window_update(
+        ymo_http2_session_t* s,
+        uint32_t id,
+        const uint8_t* p,
+        size_t len)
+{
+    if( len != 4 ) {
+        return YMO_HTTP2_FRAME_SIZE_ERROR;
+    }
+
+    uint32_t increment = get_u32(p) & 0x7fffffff;
+    if( !id ) {
+        if( !increment ) {
+            return YMO_HTTP2_PROTOCOL_ERROR;
+        }
+
+        s->send_window += increment;
+        if( s->send_window > YMO_HTTP2_MAX_WINDOW ) {
+            return YMO_HTTP2_FLOW_CONTROL_ERROR;
+        }
+        ymo_conn_tx_enable(s->conn, 1);
+        return YMO_HTTP2_NO_ERROR;
+    }
+
+    ymo_http2_stream_t* st = h2_stream_find(s, id);
+    if( !st ) {
+        return (id > s->last_stream_id)
+            ? YMO_HTTP2_PROTOCOL_ERROR : YMO_HTTP2_NO_ERROR;
+    }
+
+    if( st->state == YMO_HTTP2_STATE_CLOSED ) {
+        return YMO_HTTP2_NO_ERROR;
+    }
+
+    if( !increment ) {
+        return h2_stream_reset(s, st, YMO_HTTP2_PROTOCOL_ERROR);
+    }
+
+    st->send_window += increment;
+    if( st->send_window > YMO_HTTP2_MAX_WINDOW ) {
+        return h2_stream_reset(s, st, YMO_HTTP2_FLOW_CONTROL_ERROR);
+    }
+    ymo_conn_tx_enable(s->conn, 1);
+    return YMO_HTTP2_NO_ERROR;
+}
+
+
+static uint32_t h2_frame(
+        ymo_http2_session_t* s,
+        uint8_t type,
+        uint8_t flags,
+        uint32_t id,
+        const uint8_t* p,
+        size_t len)
+{
+    HTTP2_TRACE("Frame: type %i; flags 0x%02x; stream %" PRIu32 "; len %zu",
+            (int)type, (int)flags, id, len);
+
+    /* Nothing may interrupt a header block (RFC 9113 §6.10): */
+    if( s->hdr_stream && type != YMO_HTTP2_CONTINUATION ) {
+        return YMO_HTTP2_PROTOCOL_ERROR;
+    }
+
+    switch( type ) {
+        case YMO_HTTP2_DATA:
+            return h2_on_data(s, flags, id, p, len);
+        case YMO_HTTP2_HEADERS:
+            return h2_on_headers(s, flags, id, p, len);
+        case YMO_HTTP2_PRIORITY:
+            return h2_on_priority(s, id, p, len);
+        case YMO_HTTP2_RST_STREAM:
+            return h2_on_rst_stream(s, id, p, len);
+        case YMO_HTTP2_SETTINGS:
+            return h2_on_settings(s, flags, id, p, len);
+        case YMO_HTTP2_PUSH_PROMISE:
+            return YMO_HTTP2_PROTOCOL_ERROR;
+        case YMO_HTTP2_PING:
+            return h2_on_ping(s, flags, id, p, len);
+        case YMO_HTTP2_GOAWAY:
+            return h2_on_goaway(s, id, p, len);
+        case YMO_HTTP2_WINDOW_UPDATE:
+            return h2_on_window_update(s, id, p, len);
+        case YMO_HTTP2_CONTINUATION:
+            return h2_on_continuation(s, flags, id, p, len);
+        default:
+            /* Unknown frame types are ignored (RFC 9113 §4.1): */
+            return YMO_HTTP2_NO_ERROR;
+    }
+}
+
+
+/*---------------------------------------------------------------*
+ *  Yimmo HTTP/2 Protocol Client Init/Cleanup Callbacks:
+ *---------------------------------------------------------------*/
+void* ymo_proto_http2_conn_init(void* proto_data, ymo_conn_t* conn)
+{
+    ymo_http_session_t* http_session = ymo_proto_http_conn_init(
+            proto_data, conn);
+    if( !http_session ) {
+        return NULL;
+    }
+
+    ymo_http2_session_t* s = YMO_NEW0(ymo_http2_session_t);
+    if( !s ) {
+        ymo_proto_http_conn_cleanup(proto_data, conn, http_session);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    s->http_data = proto_data;
+    s->http_session = http_session;
+    s->conn = conn;
+    s->r_state = YMO_HTTP2_READ_PREFACE;
+    s->send_window = YMO_HTTP2_DEFAULT_WINDOW;
+    s->recv_window = YMO_HTTP2_DEFAULT_WINDOW;
+    s->peer_initial_window = YMO_HTTP2_DEFAULT_WINDOW;
+    s->peer_max_frame = YMO_HTTP2_DEFAULT_FRAME_SIZE;
+    ymo_hpack_decoder_init(&s->hpack);
+    return s;
+}
+
+
+ymo_status_t ymo_proto_http2_conn_ready(
+        void* proto_data, ymo_conn_t* conn, void* conn_data)
+{
+    ymo_http2_session_t* s = conn_data;
+
+    /* Server connection preface: */
+    uint8_t* p = h2_frame_alloc(s, 18, YMO_HTTP2_SETTINGS, 0, 0);
+    if( !p ) {
+        return ENOMEM;
+    }
+
+    p[0] = 0;
+    p[1] = YMO_HTTP2_SETTINGS_HEADER_TABLE_SIZE;
+    put_u32(p + 2, YMO_HTTP2_HPACK_TABLE_SIZE);
+    p[6] = 0;
+    p[7] = YMO_HTTP2_SETTINGS_MAX_CONCURRENT_STREAMS;
+    put_u32(p + 8, YMO_HTTP2_MAX_STREAMS);
+    p[12] = 0;
+    p[13] = YMO_HTTP2_SETTINGS_MAX_HEADER_LIST_SIZE;
+    put_u32(p + 14, s->http_data->hdr_max);
+
+    ymo_conn_rx_enable(conn, 1);
+    return YMO_OKAY;
+}
+
+
+void ymo_proto_http2_conn_cleanup(
+        void* proto_data, ymo_conn_t* conn, void* conn_data)
+{
+    ymo_http2_session_t* s = conn_data;
+
+    ymo_http2_stream_t* st = s->streams;
+    while( st ) {
+        ymo_http2_stream_t* next = st->next;
+        h2_stream_free(st);
+        st = next;
+    }
+
+    ymo_bucket_free_all(s->send_buffer);
+    YMO_FREE(s->f_buf);
+    YMO_FREE(s->hdr_block);
+    ymo_hpack_decoder_clear(&s->hpack);
+    ymo_proto_http_conn_cleanup(proto_data, conn, s->http_session);
+    YMO_DELETE(ymo_http2_session_t, s);
+    return;
+}
+
+
+/*---------------------------------------------------------------*
+ *  Yimmo HTTP/2 Protocol Read Callback:
+ *---------------------------------------------------------------*/
+static uint32_t h2_frame_hdr(ymo_http2_session_t* s, const uint8_t* hdr)
+{
+    s->f_len = ((uint32_t)hdr[0] << 16) | ((uint32_t)hdr[1] << 8) | hdr[2];
+    s->f_type = hdr[3];
+    s->f_flags = hdr[4];
+    s->f_stream = get_u32(hdr + 5) & 0x7fffffff;
+
+    /* We never advertise a larger SETTINGS_MAX_FRAME_SIZE: */
+    if( s->f_len > YMO_HTTP2_DEFAULT_FRAME_SIZE ) {
+        return YMO_HTTP2_FRAME_SIZE_ERROR;
+    }
+
+    /* RFC 9113 §3.4: the client preface ends with a (non-ACK) SETTINGS: */
+    if( !s->peer_settings ) {
+        if( s->f_type != YMO_HTTP2_SETTINGS
+                || (s->f_flags & YMO_HTTP2_FLAG_ACK) ) {
+            return YMO_HTTP2_PROTOCOL_ERROR;
+        }
+        s->peer_settings = 1;
+    }
+    return YMO_HTTP2_NO_ERROR;
+}
+
+
+/* Between frames, the reassembly buffers aren't needed; drop them so an
+ * idle connection holds only its session and HPACK state:
+ */
+static void h2_release_idle(ymo_http2_session_t* s)
+{
+    if( s->f_buf
+            && s->r_state == YMO_HTTP2_READ_FRAME_HDR && !s->r_have ) {
+        YMO_FREE(s->f_buf);
+        s->f_buf = NULL;
+    }
+
+    if( s->hdr_block && !s->hdr_stream ) {
+        YMO_FREE(s->hdr_block);
+        s->hdr_block = NULL;
+        s->hdr_cap = 0;
+    }
+    return;
+}
+
+
+ssize_t ymo_proto_http2_read(
+        void* proto_data,
+        ymo_conn_t* conn,
+        void* conn_data,
+        char* recv_buf,
+        size_t len)
+{
+    ymo_http2_session_t* s = conn_data;
+    const uint8_t* in = (const uint8_t*)recv_buf;
+    size_t remain = len;
+    uint32_t err = YMO_HTTP2_NO_ERROR;
+
+    while( remain && !s->closing )
+    {
+        size_t n;
+        switch( s->r_state ) {
+            case YMO_HTTP2_READ_PREFACE:
+                n = YMO_MIN(remain, YMO_HTTP2_PREFACE_LEN - s->r_have);
+                if( memcmp(in, YMO_HTTP2_PREFACE + s->r_have, n) ) {
+                    err = YMO_HTTP2_PROTOCOL_ERROR;
+                    goto h2_read_error;
+                }
+                in += n;
+                remain -= n;
+                s->r_have += n;
+                if( s->r_have == YMO_HTTP2_PREFACE_LEN ) {
+                    s->r_state = YMO_HTTP2_READ_FRAME_HDR;
+                    s->r_have = 0;
+                }
+                break;
+
+            case YMO_HTTP2_READ_FRAME_HDR:
+                /* Fast path: dispatch complete frames in place. */
+                if( !s->r_have && remain >= YMO_HTTP2_FRAME_HDR_LEN ) {
+                    if( (err = h2_frame_hdr(s, in)) ) {
+                        goto h2_read_error;
+                    }
+                    in += YMO_HTTP2_FRAME_HDR_LEN;
+                    remain -= YMO_HTTP2_FRAME_HDR_LEN;
+                } else {
+                    n = YMO_MIN(remain, YMO_HTTP2_FRAME_HDR_LEN - s->r_have);
+                    memcpy(s->f_hdr + s->r_have, in, n);
+                    in += n;
+                    remain -= n;
+                    s->r_have += n;
+                    if( s->r_have < YMO_HTTP2_FRAME_HDR_LEN ) {
+                        break;
+                    }
+                    if( (err = h2_frame_hdr(s, s->f_hdr)) ) {
+                        goto h2_read_error;
+                    }
+                }
+
+                s->r_have = 0;
+                if( remain >= s->f_len ) {
+                    err = h2_frame(s, s->f_type, s->f_flags, s->f_stream,
+                            in, s->f_len);
+                    in += s->f_len;
+                    remain -= s->f_len;
+                    if( err ) {
+                        goto h2_read_error;
+                    }
+                } else {
+                    s->r_state = YMO_HTTP2_READ_PAYLOAD;
+                }
+                break;
+
+            case YMO_HTTP2_READ_PAYLOAD:
+                if( !s->f_buf ) {
+                    s->f_buf = YMO_ALLOC(YMO_HTTP2_DEFAULT_FRAME_SIZE);
+                    if( !s->f_buf ) {
+                        err = YMO_HTTP2_INTERNAL_ERROR;
+                        goto h2_read_error;
+                    }
+                }
+
+                n = YMO_MIN(remain, s->f_len - s->r_have);
+                memcpy(s->f_buf + s->r_have, in, n);
+                in += n;
+                remain -= n;
+                s->r_have += n;
+                if( s->r_have == s->f_len ) {
+                    s->r_state = YMO_HTTP2_READ_FRAME_HDR;
+                    s->r_have = 0;
+                    err = h2_frame(s, s->f_type, s->f_flags, s->f_stream,
+                            s->f_buf, s->f_len);
+                    if( err ) {
+                        goto h2_read_error;
+                    }
+                }
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    h2_release_idle(s);
+    return len;
+
+h2_read_error:
+    h2_conn_error(s, err);
+    return len;
+}
+
+
+/*---------------------------------------------------------------*
+ *  Yimmo HTTP/2 Protocol Write Callback:
+ *---------------------------------------------------------------*/
+
+/* Total body length, dropping any empty buckets along the way: */
+static size_t h2_body_len(ymo_http_response_t* response)
+{
+    ymo_bucket_t** b_p = &response->body_head;
+    ymo_bucket_t* prev = NULL;
+    size_t body_len = 0;
+
+    while( *b_p )
+    {
+        ymo_bucket_t* bucket = *b_p;
+        if( !bucket->len ) {
+            *b_p = bucket->next;
+            bucket->next = NULL;
+            ymo_bucket_free(bucket);
+        } else {
+            body_len += bucket->len;
+            prev = bucket;
+            b_p = &bucket->next;
+        }
+    }
+    response->body_tail = prev;
+    return body_len;
+}
+
+
+/* Queue the HEADERS (and CONTINUATION) frames for a response: */
+static ymo_status_t h2_send_headers(
+        ymo_http2_session_t* s, ymo_http2_stream_t* st)
+{
+    ymo_http_response_t* response = st->response;
+    const ymo_http_auto_hdrs_t* auto_hdrs = &s->http_data->auto_hdrs;
+    const ymo_http_canned_t* canned = response->canned;
+    int complete = (response->flags & YMO_HTTP_RESPONSE_COMPLETE);
+    const char* canned_hdrs = NULL;
+    size_t canned_len = 0;
+    const char* canned_body = NULL;
+    size_t canned_body_len = 0;
+    int has_date;
+    int has_server;
+    int has_cl;
+    const char* key;
+    size_t key_len;
+    const char* value;
+    ymo_http_hdr_ptr_t iter;
+
+    /* Compression may change the headers and body: */
+    ymo_status_t status = ymo_http_compress_start(
+            s->http_data->compress, response);
+    if( status == YMO_OKAY ) {
+        status = ymo_http_compress_flush(response);
+    }
+    if( status != YMO_OKAY ) {
+        return status;
+    }
+    ymo_http_cache_store(response);
+
+    /* Size the header block: */
+    size_t bound = 5; /* :status */
+    if( canned ) {
+        /* Skip the status line; the rest are "Name: value\r\n" lines: */
+        const char* data = canned->variant[YMO_HTTP_CANNED_CONN_NONE].data;
+        size_t head_len = canned->variant[YMO_HTTP_CANNED_CONN_NONE].head_len;
+        const char* eol = memchr(data, '\n', head_len);
+        canned_hdrs = eol + 1;
+        canned_len = (size_t)(data + head_len - canned_hdrs);
+        canned_body = data + head_len + 2;
+        canned_body_len =
+            canned->variant[YMO_HTTP_CANNED_CONN_NONE].len - head_len - 2;
+        for( size_t i = 0; i < canned_len; i++ ) {
+            if( canned_hdrs[i] == '\n' ) {
+                bound += YMO_HPACK_FIELD_MAX(0, 0);
+            }
+        }
+        bound += canned_len;
+        has_date = canned->has_date;
+        has_server = canned->has_server;
+        has_cl = 1;
+    } else {
+        iter = ymo_http_hdr_table_next(
+                &response->headers, NULL, &key, &key_len, &value);
+        while( iter ) {
+            bound += YMO_HPACK_FIELD_MAX(key_len, strlen(value));
+            iter = ymo_http_hdr_table_next(
+                    &response->headers, iter, &key, &key_len, &value);
+        }
+        has_date = !!ymo_http_hdr_table_get_id(
+                &response->headers, YMO_HTTP_HID_DATE);
+        has_server = !!ymo_http_hdr_table_get_id(
+                &response->headers, YMO_HTTP_HID_SERVER);
+        has_cl = !!ymo_http_hdr_table_get_id(
+                &response->headers, YMO_HTTP_HID_CONTENT_LENGTH);
+    }
+
+    size_t body_len = 0;
+    if( complete ) {
+        body_len = h2_body_len(response) + canned_body_len;
+        if( !has_cl ) {
+            response->content_len = body_len;
+            sprintf(response->content_len_str, "%zu", body_len);
+            bound += YMO_HPACK_FIELD_MAX(
+                    sizeof("content-length")-1, strlen(response->content_len_str));
+        }
+    }
+
+    size_t date_len = 0;
+    size_t server_len = 0;
+    if( response->status >= 200 ) {
+        if( auto_hdrs->date_len && !has_date ) {
+            date_len = auto_hdrs->date_len - 8; /* "Date: " + CRLF */
+            bound += YMO_HPACK_FIELD_MAX(sizeof("date")-1, date_len);
+        }
+        if( auto_hdrs->server_len && !has_server ) {
+            server_len = auto_hdrs->server_len - 10; /* "Server: " + CRLF */
+            bound += YMO_HPACK_FIELD_MAX(sizeof("server")-1, server_len);
+        }
+    }
+
+    uint8_t* buf = YMO_ALLOC(YMO_HTTP2_FRAME_HDR_LEN + bound);
+    if( !buf ) {
+        return ENOMEM;
+    }
+
+    /* Encode: */
+    uint8_t* insert = buf + YMO_HTTP2_FRAME_HDR_LEN;
+    insert += ymo_hpack_encode_status(insert, response->status);
+    if( canned ) {
+        const char* line = canned_hdrs;
+        const char* end = canned_hdrs + canned_len;
+        while( line < end ) {
+            const char* eol = memchr(line, '\r', (size_t)(end - line));
+            const char* colon = memchr(line, ':', (size_t)(eol - line));
+            const char* val = colon + 1;
+            while( val < eol && *val == ' ' ) {
+                val++;
+            }
+
+            ymo_http_hdr_id_t h_id = ymo_http_hdr_std_id(
+                    line, (size_t)(colon - line));
+            if( h_id != YMO_HTTP_HID_CONNECTION ) {
+                insert += ymo_hpack_encode_field(insert, h_id,
+                        line, (size_t)(colon - line),
+                        val, (size_t)(eol - val));
+            }
+            line = eol + 2;
+        }
+    } else {
+        iter = ymo_http_hdr_table_next(
+                &response->headers, NULL, &key, &key_len, &value);
+        while( iter ) {
+            ymo_http_hdr_id_t h_id = ymo_http_hdr_std_id(key, key_len);
+            switch( h_id ) {
+                /* Connection-specific headers (RFC 9113 §8.2.2): */
+                case YMO_HTTP_HID_CONNECTION:
+                case YMO_HTTP_HID_KEEP_ALIVE:
+                case YMO_HTTP_HID_PROXY_CONNECTION:
+                case YMO_HTTP_HID_TRANSFER_ENCODING:
+                case YMO_HTTP_HID_UPGRADE:
+                    break;
+                default:
+                    insert += ymo_hpack_encode_field(insert, h_id,
+                            key, key_len, value, strlen(value));
+                    break;
+            }
+            iter = ymo_http_hdr_table_next(
+                    &response->headers, iter, &key, &key_len, &value);
+        }
+    }
+
+    if( complete && !has_cl ) {
+        insert += ymo_hpack_encode_field(insert,
+                YMO_HTTP_HID_CONTENT_LENGTH,
+                "content-length", sizeof("content-length")-1,
+                response->content_len_str,
+                strlen(response->content_len_str));
+    }
+
+    if( date_len ) {
+        insert += ymo_hpack_encode_field(insert, YMO_HTTP_HID_DATE,
+                "date", sizeof("date")-1, auto_hdrs->date + 6, date_len);
+    }
+
+    if( server_len ) {
+        insert += ymo_hpack_encode_field(insert, YMO_HTTP_HID_SERVER,
+                "server", sizeof("server")-1, auto_hdrs->server + 8, server_len);
+    }
+
+    size_t block_len = (size_t)(insert - buf) - YMO_HTTP2_FRAME_HDR_LEN;
+    /* Responses to HEAD keep their content-length, but not the body: */
+    if( st->no_body ) {
+        ymo_bucket_free_all(response->body_head);
+        response->body_head = response->body_tail = NULL;
+        body_len = canned_body_len = 0;
+    }
+
+    uint8_t end_stream = (complete && !body_len)
+        ? YMO_HTTP2_FLAG_END_STREAM : 0;
+
+    /* Canned body data goes out by reference, like any other body: */
+    if( canned_body_len ) {
+        ymo_bucket_t* canned_data = YMO_BUCKET_FROM_REF(
+                canned_body, canned_body_len);
+        if( !canned_data ) {
+            YMO_FREE(buf);
+            return ENOMEM;
+        }
+        ymo_http_response_body_append(response, canned_data);
+    }
+
+    ymo_bucket_t* bucket_out;
+    if( block_len <= s->peer_max_frame ) {
+        put_frame_hdr(buf, block_len, YMO_HTTP2_HEADERS,
+                YMO_HTTP2_FLAG_END_HEADERS | end_stream, st->id);
+        bucket_out = ymo_bucket_create(NULL, NULL,
+                (char*)buf, YMO_HTTP2_FRAME_HDR_LEN + bound,
+                (const char*)buf, YMO_HTTP2_FRAME_HDR_LEN + block_len);
+    } else {
+        /* Split the block into HEADERS + CONTINUATION frames: */
+        size_t no_frames = (block_len + s->peer_max_frame - 1)
+            / s->peer_max_frame;
+        size_t split_len = block_len + no_frames * YMO_HTTP2_FRAME_HDR_LEN;
+        uint8_t* split = YMO_ALLOC(split_len);
+        if( !split ) {
+            YMO_FREE(buf);
+            return ENOMEM;
+        }
+
+        const uint8_t* block = buf + YMO_HTTP2_FRAME_HDR_LEN;
+        uint8_t* out = split;
+        for( size_t i = 0; i < no_frames; i++ ) {
+            size_t frag_len = YMO_MIN(block_len, s->peer_max_frame);
+            uint8_t frame_type = i ? YMO_HTTP2_CONTINUATION : YMO_HTTP2_HEADERS;
+            uint8_t frame_flags = i ? 0 : end_stream;
+            if( i == no_frames - 1 ) {
+                frame_flags |= YMO_HTTP2_FLAG_END_HEADERS;
+            }
+            put_frame_hdr(out, frag_len, frame_type, frame_flags, st->id);
+            memcpy(out + YMO_HTTP2_FRAME_HDR_LEN, block, frag_len);
+            out += YMO_HTTP2_FRAME_HDR_LEN + frag_len;
+            block += frag_len;
+            block_len -= frag_len;
+        }
+        YMO_FREE(buf);
+        buf = split;
+        bucket_out = ymo_bucket_create(NULL, NULL,
+                (char*)split, split_len, (const char*)split, split_len);
+    }
+
+    if( !bucket_out ) {
+        YMO_FREE(buf);
+        return ENOMEM;
+    }
+
+    HTTP2_TRACE("HEADERS %i on stream %" PRIu32, response->status, st->id);
+    h2_queue(s, bucket_out);
+    st->headers_sent = 1;
+    response->flags |= YMO_HTTP_RESPONSE_STARTED;
+    if( end_stream ) {
+        h2_stream_end(s, st);
+    }
+    return YMO_OKAY;
+}
+
+
+static inline int h2_stream_pending(const ymo_http2_stream_t* st)
+{
+    const ymo_http_response_t* response = st->response;
+    return st->headers_sent && !st->end_sent
+        && (response->body_head
+            || (response->compressor && response->compressor->in_head)
+            || (response->flags & YMO_HTTP_RESPONSE_COMPLETE));
+}
+
+
+/* Read the first len bytes of a file bucket into a new bucket. (File
+ * bucket pieces are copied, rather than referenced, since a reference
+ * wouldn't keep the file open if the stream were reset mid-send):
+ */
+static ymo_bucket_t* h2_file_piece(const ymo_bucket_t* bucket, size_t len)
+{
+    char* buf = YMO_ALLOC(len);
+    if( !buf ) {
+        return NULL;
+    }
+
+    size_t done = 0;
+    while( done < len ) {
+        ssize_t n = pread(bucket->fd, buf + done, len - done,
+                bucket->offset + (off_t)done);
+        if( n <= 0 ) {
+            if( n < 0 && errno == EINTR ) {
+                continue;
+            }
+            ymo_log_warning("Failed to read file bucket (fd %i): %s",
+                    bucket->fd, n < 0 ? strerror(errno) : "EOF");
+            YMO_FREE(buf);
+            return NULL;
+        }
+        done += (size_t)n;
+    }
+
+    ymo_bucket_t* piece = ymo_bucket_create(NULL, NULL, buf, len, buf, len);
+    if( !piece ) {
+        YMO_FREE(buf);
+    }
+    return piece;
+}
+
+
+/* Queue up to quantum bytes of DATA frames for st, directly from the
+ * response body (partial buckets are referenced, rather than copied).
+ *
+ * :returns: the number of frames queued; -1 on ENOMEM, compression, or file
+ *     read error.
+ */
+static ssize_t h2_stream_data(
+        ymo_http2_session_t* s, ymo_http2_stream_t* st, size_t quantum)
+{
+    ymo_http_response_t* response = st->response;
+    int complete = (response->flags & YMO_HTTP_RESPONSE_COMPLETE);
+    ssize_t no_frames = 0;
+
+    if( st->no_body ) {
+        ymo_bucket_free_all(response->body_head);
+        response->body_head = response->body_tail = NULL;
+    }
+
+    if( ymo_http_compress_flush(response) != YMO_OKAY ) {
+        return -1;
+    }
+
+    /* Queued output is what's left to frame (compressed, if it is): */
+    response->body_queued = h2_body_len(response);
+    if( !response->body_head ) {
+        if( !complete ) {
+            return 0;
+        }
+
+        if( !h2_frame_alloc(s, 0, YMO_HTTP2_DATA,
+                    YMO_HTTP2_FLAG_END_STREAM, st->id) ) {
+            return -1;
+        }
+        h2_stream_end(s, st);
+        return 1;
+    }
+
+    int64_t window = YMO_MIN(s->send_window, st->send_window);
+    if( window <= 0 ) {
+        return 0;
+    }
+
+    size_t allowed = YMO_MIN((size_t)window, quantum);
+    while( allowed && response->body_head )
+    {
+        size_t frame_max = YMO_MIN(allowed, s->peer_max_frame);
+        ymo_bucket_t* frame_data = NULL;
+        ymo_bucket_t* frame_tail = NULL;
+        size_t frame_len = 0;
+
+        while( response->body_head && frame_len < frame_max )
+        {
+            ymo_bucket_t* bucket = response->body_head;
+            ymo_bucket_t* piece;
+            if( frame_len + bucket->len <= frame_max ) {
+                response->body_head = bucket->next;
+                bucket->next = NULL;
+                piece = bucket;
+            } else {
+                size_t part = frame_max - frame_len;
+                piece = (bucket->fd >= 0)
+                    ? h2_file_piece(bucket, part)
+                    : YMO_BUCKET_FROM_REF(bucket->data, part);
+                if( !piece ) {
+                    ymo_bucket_free_all(frame_data);
+                    return -1;
+                }
+                if( bucket->fd >= 0 ) {
+                    bucket->offset += part;
+                } else {
+                    bucket->data += part;
+                }
+                bucket->len -= part;
+            }
+
+            if( frame_tail ) {
+                frame_tail->next = piece;
+            } else {
+                frame_data = piece;
+            }
+            frame_tail = piece;
+            frame_len += piece->len;
+        }
+
+        if( !response->body_head ) {
+            response->body_tail = NULL;
+        }
+
+        int last = complete && !response->body_head;
+        ymo_bucket_t* frame = h2_frame_bucket(0, frame_len, YMO_HTTP2_DATA,
+                last ? YMO_HTTP2_FLAG_END_STREAM : 0, st->id);
+        if( !frame ) {
+            ymo_bucket_free_all(frame_data);
+            return -1;
+        }
+        frame->next = frame_data;
+        h2_queue(s, frame);
+
+        s->send_window -= frame_len;
+        st->send_window -= frame_len;
+        response->body_queued -= frame_len;
+        allowed -= frame_len;
+        ++no_frames;
+
+        if( last ) {
+            h2_stream_end(s, st);
+        }
+    }
+    return no_frames;
+}
+
+
+/* Is there data pending on stream id (or any of its ancestors)? */
+static int h2_parent_pending(ymo_http2_session_t* s, uint32_t id)
+{
+    /* Bounded, in case of dependency cycles: */
+    for( size_t depth = 0; id && depth < YMO_HTTP2_MAX_STREAMS; depth++ ) {
+        ymo_http2_stream_t* parent = h2_stream_find(s, id);
+        if( !parent ) {
+            break;
+        }
+
+        if( parent->state != YMO_HTTP2_STATE_CLOSED
+            && parent->response && h2_stream_pending(parent) ) {
+            return 1;
+        }
+        id = parent->depends_on;
+    }
+    return 0;
+}
+
+
+/* Weighted round-robin over the streams with DATA to send: each gets up to
+ * weight/16 max-size frames per round. Streams whose ancestors have data
+ * pending wait, unless nothing else could be sent.
+ */
+static ssize_t h2_schedule_data(ymo_http2_session_t* s)
+{
+    ssize_t produced = 0;
+
+    for( int pass = 0; pass < 2 && !produced; pass++ )
+    {
+        ymo_http2_stream_t* st;
+        for( st = s->streams; st; st = st->next ) {
+            if( st->state == YMO_HTTP2_STATE_CLOSED && st->end_sent ) {
+                continue;
+            }
+
+            if( !st->response || !h2_stream_pending(st) ) {
+                continue;
+            }
+
+            if( !pass && st->depends_on
+                && h2_parent_pending(s, st->depends_on) ) {
+                continue;
+            }
+
+            size_t quantum = (size_t)s->peer_max_frame * st->weight
+                / HTTP2_DEFAULT_WEIGHT;
+            ssize_t n = h2_stream_data(s, st, quantum);
+            if( n < 0 ) {
+                return -1;
+            }
+            produced += n;
+        }
+    }
+    return produced;
+}
+
+
+/* Queue whatever output the streams have ready. Returns nonzero if any
+ * frames were queued.
+ */
+static int h2_produce(ymo_http2_session_t* s)
+{
+    int produced = 0;
+    ymo_http2_stream_t* st;
+
+    for( st = s->streams; st; st = st->next ) {
+        if( st->headers_sent || !st->response
+            || !(st->response->flags & YMO_HTTP_RESPONSE_READY) ) {
+            continue;
+        }
+
+        if( h2_send_headers(s, st) != YMO_OKAY ) {
+            h2_conn_error(s, YMO_HTTP2_INTERNAL_ERROR);
+            return 0;
+        }
+        produced = 1;
+    }
+
+    ssize_t n = h2_schedule_data(s);
+    if( n < 0 ) {
+        h2_conn_error(s, YMO_HTTP2_INTERNAL_ERROR);
+        return 0;
+    }
+    return produced || n;
+}
+
+
+/* Invoke the drain callbacks of streams whose output has been framed.
+ * Returns nonzero if any were invoked (i.e. there may be more to produce).
+ */
+static int h2_drain(ymo_http2_session_t* s)
+{
+    int drained = 0;
+    ymo_http2_stream_t* st;
+
+    for( st = s->streams; st; st = st->next ) {
+        if( st->state == YMO_HTTP2_STATE_CLOSED || !st->response
+                || !ymo_http_response_drained(st->response) ) {
+            continue;
+        }
+
+        drained = 1;
+        if( ymo_http_response_drain_check(st->response) != YMO_OKAY
+                && h2_stream_reset(s, st, YMO_HTTP2_INTERNAL_ERROR) ) {
+            h2_conn_error(s, YMO_HTTP2_INTERNAL_ERROR);
+            break;
+        }
+    }
+    return drained;
+}
+
+
+ymo_status_t ymo_proto_http2_write(
+        void* proto_data,
+        ymo_conn_t* conn,
+        void* conn_data,
+        int socket)
+{
+    ymo_http2_session_t* s = conn_data;
+    ymo_status_t status;
+
+    do {
+        if( s->send_buffer ) {
+            status = ymo_conn_send_buckets(conn, &s->send_buffer);
+            if( status != YMO_OKAY ) {
+                return status;
+            }
+        }
+        s->send_tail = NULL;
+        h2_stream_sweep(s);
+
+        if( s->closing ) {
+            HTTP2_TRACE("GOAWAY sent; shutting down %i", socket);
+            ymo_conn_shutdown(conn);
+            return YMO_OKAY;
+        }
+    } while( h2_produce(s) || h2_drain(s) );
+
+    return YMO_OKAY;
+}
+
+
+/*---------------------------------------------------------------*
+ *  h2c Upgrade:
+ *---------------------------------------------------------------*/
+
+/* Decode the (base64url) HTTP2-Settings header value, returning the decoded
+ * length, or -1 if it's invalid. If dst is NULL, just validate.
+ */
+static ssize_t h2_settings_decode(uint8_t* dst, const char* src)
+{
+    uint32_t acc = 0;
+    int bits = 0;
+    ssize_t len = 0;
+
+    for( ; *src && *src != '='; src++ ) {
+        char c = *src;
+        uint32_t v;
+        if( c >= 'A' && c <= 'Z' ) {
+            v = (uint32_t)(c - 'A');
+        } else if( c >= 'a' && c <= 'z' ) {
+            v = (uint32_t)(c - 'a') + 26;
+        } else if( c >= '0' && c <= '9' ) {
+            v = (uint32_t)(c - '0') + 52;
+        } else if( c == '-' || c == '+' ) {
+            v = 62;
+        } else if( c == '_' || c == '/' ) {
+            v = 63;
+        } else {
+            return -1;
+        }
+
+        acc = (acc << 6) | v;
+        bits += 6;
+        if( bits >= 8 ) {
+            bits -= 8;
+            if( dst ) {
+                dst[len] = (uint8_t)(acc >> bits);
+            }
+            ++len;
+        }
+    }
+
+    return (len % 6) ? -1 : len;
+}
+
+
+static ymo_http_upgrade_status_t ymo_http2_upgrade_cb(
+        const char* hdr_upgrade,
+        ymo_http_request_t* request,
+        ymo_http_response_t* response)
+{
+    if( strcasecmp(hdr_upgrade, "h2c") ) {
+        errno = EPROTONOSUPPORT;
+        return YMO_HTTP_UPGRADE_NOPROTO;
+    }
+
+    /* RFC 7540 §3.2: exactly one HTTP2-Settings header. We only upgrade
+     * requests without bodies, rather than buffer the body for stream 1;
+     * everything else gets an HTTP/1.1 response:
+     */
+    const char* settings = ymo_http_hdr_table_get_id(
+            &request->headers, YMO_HTTP_HID_HTTP2_SETTINGS);
+    if( !settings
+        || h2_settings_decode(NULL, settings) < 0
+        || !(request->flags & YMO_HTTP_FLAG_VERSION_1_1)
+        || request->content_length
+        || request->body_received
+        || (request->flags & YMO_HTTP_REQUEST_CHUNKED) ) {
+        ymo_log_debug("Not upgrading \"%s %s\" to HTTP/2",
+                request->method, request->uri);
+        return YMO_HTTP_UPGRADE_IGNORE;
+    }
+
+    ymo_http_response_set_status(response, YMO_HTTP_SWITCHING_PROTOCOLS);
+    ymo_http_response_insert_header(response, "Connection", "Upgrade");
+    ymo_http_response_insert_header(response, "Upgrade", "h2c");
+    ymo_http_response_finish(response);
+    return YMO_HTTP_UPGRADE_HANDLED;
+}
+
+
+ymo_http_upgrade_handler_t* ymo_http2_upgrade_handler(ymo_proto_t* h2_proto)
+{
+    ymo_http_upgrade_handler_t* upgrade_handler =
+        YMO_NEW(ymo_http_upgrade_handler_t);
+    if( upgrade_handler ) {
+        upgrade_handler->cb = &ymo_http2_upgrade_cb;
+        upgrade_handler->proto_new = h2_proto;
+    }
+    return upgrade_handler;
+}
+
+
+ymo_status_t ymo_proto_http2_upgrade(
+        ymo_conn_t* conn,
+        ymo_proto_t* h2_proto,
+        ymo_http_exchange_t* exchange)
+{
+    ymo_http_request_t* request = &exchange->request;
+    uint8_t settings[YMO_HTTP_RECV_BUF_SIZE];
+    ssize_t settings_len = -1;
+
+    const char* settings_hdr = ymo_http_hdr_table_get_id(
+            &request->headers, YMO_HTTP_HID_HTTP2_SETTINGS);
+    if( settings_hdr && strlen(settings_hdr) * 3 / 4 <= sizeof(settings) ) {
+        settings_len = h2_settings_decode(settings, settings_hdr);
+    }
+
+    ymo_status_t status = ymo_conn_transition_proto(conn, h2_proto);
+    if( status != YMO_OKAY ) {
+        ymo_http_exchange_free(exchange);
+        return status;
+    }
+
+    /* The upgrade request is stream 1, half-closed (RFC 7540 §3.2): */
+    ymo_http2_session_t* s = conn->proto_data;
+    ymo_http2_stream_t* st = h2_stream_create(s, 1, exchange);
+    if( !st ) {
+        ymo_http_exchange_free(exchange);
+        return ENOMEM;
+    }
+
+    uint32_t err = YMO_HTTP2_PROTOCOL_ERROR;
+    if( settings_len >= 0 ) {
+        err = h2_apply_settings(s, settings, (size_t)settings_len);
+    }
+    if( err ) {
+        h2_conn_error(s, err);
+        return YMO_WOULDBLOCK;
+    }
+
+    ymo_http_response_t* response = &exchange->response;
+    ymo_http_response_init(response, s->http_session);
+    request->version = http2_version;
+    request->flags = HTTP2_REQUEST_FLAGS;
+    response->flags = request->flags;
+    st->response = response;
+
+    err = h2_request_end(s, st);
+    if( err ) {
+        h2_conn_error(s, err);
+    }
+    return YMO_WOULDBLOCK;
+}
@@ -0,0 +1,265 @@
+/*=============================================================================
+ *
+ * Copyright (c) 2014 Andrew Canaday
+ *
+ * This file is part of libyimmo (sometimes referred to as "yimmo" or "ymo").
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *===========================================================================*/
+
+
+
+
+#ifndef YMO_HTTP_PROTO_HTTP2_H
+#define YMO_HTTP_PROTO_HTTP2_H
+#include "yimmo_config.h"
+#include <stdint.h>
+#include "yimmo.h"
+#include "ymo_http.h"
+#include "core/ymo_bucket.h"
+#include "ymo_http_session.h"
+#include "ymo_http_exchange.h"
+#include "ymo_http_response.h"
+#include "ymo_proto_http.h"
+#include "ymo_http2_hpack.h"
+
+/** HTTP/2
+ * ========
+ *
+ * HTTP/2 (RFC 9113) on top of the HTTP/1.x request and response types: each
+ * stream gets its own :c:type:`ymo_http_exchange_t` and
+ * :c:type:`ymo_http_response_t`, and the usual ``header_cb``, ``body_cb``,
+ * and ``http_cb`` callbacks are invoked for it, so handlers don't need to
+ * know which version of the protocol they're serving.
+ *
+ * - Response bodies go out as ``DATA`` frames directly from the response's
+ *   bucket chain (no copy), subject to the stream and connection flow control
+ *   windows and the peer's maximum frame size.
+ * - Streams with data to send are serviced weighted round-robin, by their
+ *   ``PRIORITY`` weight. A stream waits while the stream it depends on has
+ *   data pending, unless that would stall the connection.
+ * - Server push is not supported.
+ */
+
+/**---------------------------------------------------------------
+ * Definitions
+ *---------------------------------------------------------------*/
+
+/** Client connection preface (RFC 9113 §3.4). */
+#define YMO_HTTP2_PREFACE     "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n"
+#define YMO_HTTP2_PREFACE_LEN (sizeof(YMO_HTTP2_PREFACE)-1)
+
+/** Frame header length. */
+#define YMO_HTTP2_FRAME_HDR_LEN 9
+
+/** Initial flow control window size. */
+#define YMO_HTTP2_DEFAULT_WINDOW 65535
+
+/** Maximum flow control window size. */
+#define YMO_HTTP2_MAX_WINDOW 0x7fffffff
+
+/** Initial (and minimum) ``SETTINGS_MAX_FRAME_SIZE``. We never advertise
+ * more than this, so it's also the largest frame we accept. */
+#define YMO_HTTP2_DEFAULT_FRAME_SIZE 16384
+
+/** Largest allowed ``SETTINGS_MAX_FRAME_SIZE``. */
+#define YMO_HTTP2_MAX_FRAME_SIZE 0xffffff
+
+/** Largest (compressed) header block we'll reassemble from ``HEADERS`` and
+ * ``CONTINUATION`` frames. */
+#ifndef YMO_HTTP2_HDR_BLOCK_MAX
+#define YMO_HTTP2_HDR_BLOCK_MAX (4*YMO_HTTP2_DEFAULT_FRAME_SIZE)
+#endif /* YMO_HTTP2_HDR_BLOCK_MAX */
+
+/** Frame types. */
+YMO_ENUM8_TYPEDEF(ymo_http2_frame_type) {
+    YMO_HTTP2_DATA          = 0x0,
+    YMO_HTTP2_HEADERS       = 0x1,
+    YMO_HTTP2_PRIORITY      = 0x2,
+    YMO_HTTP2_RST_STREAM    = 0x3,
+    YMO_HTTP2_SETTINGS      = 0x4,
+    YMO_HTTP2_PUSH_PROMISE  = 0x5,
+    YMO_HTTP2_PING          = 0x6,
+    YMO_HTTP2_GOAWAY        = 0x7,
+    YMO_HTTP2_WINDOW_UPDATE = 0x8,
+    YMO_HTTP2_CONTINUATION  = 0x9,
+} YMO_ENUM8_AS(ymo_http2_frame_type_t);
+
+/* Frame flags: */
+#define YMO_HTTP2_FLAG_END_STREAM  0x01
+#define YMO_HTTP2_FLAG_ACK         0x01
+#define YMO_HTTP2_FLAG_END_HEADERS 0x04
+#define YMO_HTTP2_FLAG_PADDED      0x08
+#define YMO_HTTP2_FLAG_PRIORITY    0x20
+
+/* Settings identifiers: */
+#define YMO_HTTP2_SETTINGS_HEADER_TABLE_SIZE      0x1
+#define YMO_HTTP2_SETTINGS_ENABLE_PUSH            0x2
+#define YMO_HTTP2_SETTINGS_MAX_CONCURRENT_STREAMS 0x3
+#define YMO_HTTP2_SETTINGS_INITIAL_WINDOW_SIZE    0x4
+#define YMO_HTTP2_SETTINGS_MAX_FRAME_SIZE         0x5
+#define YMO_HTTP2_SETTINGS_MAX_HEADER_LIST_SIZE   0x6
+
+/* Error codes: */
+#define YMO_HTTP2_NO_ERROR            0x0
+#define YMO_HTTP2_PROTOCOL_ERROR      0x1
+#define YMO_HTTP2_INTERNAL_ERROR      0x2
+#define YMO_HTTP2_FLOW_CONTROL_ERROR  0x3
+#define YMO_HTTP2_SETTINGS_TIMEOUT    0x4
+#define YMO_HTTP2_STREAM_CLOSED       0x5
+#define YMO_HTTP2_FRAME_SIZE_ERROR    0x6
+#define YMO_HTTP2_REFUSED_STREAM      0x7
+#define YMO_HTTP2_CANCEL              0x8
+#define YMO_HTTP2_COMPRESSION_ERROR   0x9
+#define YMO_HTTP2_CONNECT_ERROR       0xa
+#define YMO_HTTP2_ENHANCE_YOUR_CALM   0xb
+#define YMO_HTTP2_INADEQUATE_SECURITY 0xc
+#define YMO_HTTP2_HTTP_1_1_REQUIRED   0xd
+
+/**---------------------------------------------------------------
+ * Types
+ *---------------------------------------------------------------*/
+
+/** Stream state (from the server's point of view; "idle" and "reserved"
+ * streams are never materialized). */
+YMO_ENUM8_TYPEDEF(ymo_http2_stream_state) {
+    YMO_HTTP2_STATE_OPEN,               /* Client is still sending */
+    YMO_HTTP2_STATE_HALF_CLOSED_REMOTE, /* Request is complete */
+    YMO_HTTP2_STATE_CLOSED,             /* Done or reset */
+} YMO_ENUM8_AS(ymo_http2_stream_state_t);
+
+/** HTTP/2 stream: one exchange. */
+typedef struct ymo_http2_stream {
+    uint32_t                  id;
+    ymo_http2_stream_state_t  state;
+    uint8_t                   headers_sent; /* HEADERS queued */
+    uint8_t                   end_sent;     /* END_STREAM queued */
+    uint8_t                   discard;      /* Ignore further request data */
+    uint8_t                   dispatched;   /* Response handed to http_cb */
+    uint8_t                   no_body;      /* HEAD: drop the response body */
+    uint16_t                  weight;       /* 1-256 */
+    uint32_t                  depends_on;
+    size_t                    body_remain;  /* Per content-length, if any */
+    int64_t                   send_window;
+    int64_t                   recv_window;
+    ymo_http_exchange_t*      exchange;
+    ymo_http_response_t*      response;
+    struct ymo_http2_stream*  next;
+} ymo_http2_stream_t;
+
+/** Read state. */
+YMO_ENUM8_TYPEDEF(ymo_http2_read_state) {
+    YMO_HTTP2_READ_PREFACE,
+    YMO_HTTP2_READ_FRAME_HDR,
+    YMO_HTTP2_READ_PAYLOAD,
+} YMO_ENUM8_AS(ymo_http2_read_state_t);
+
+/** HTTP/2 connection. */
+typedef struct ymo_http2_session {
+    ymo_http_proto_data_t*  http_data;
+    ymo_http_session_t*     http_session; /* Passed to user callbacks */
+    ymo_conn_t*             conn;
+
+    /* Frame input: */
+    ymo_http2_read_state_t  r_state;
+    size_t                  r_have;      /* Bytes of preface/header/payload */
+    uint8_t                 f_hdr[YMO_HTTP2_FRAME_HDR_LEN];
+    uint32_t                f_len;
+    uint8_t                 f_type;
+    uint8_t                 f_flags;
+    uint32_t                f_stream;
+    uint8_t*                f_buf;       /* Partial frame payloads */
+
+    /* Header block reassembly (HEADERS + CONTINUATION): */
+    uint32_t                hdr_stream;  /* Nonzero while incomplete */
+    uint8_t                 hdr_flags;   /* Flags from the HEADERS frame */
+    uint8_t*                hdr_block;
+    size_t                  hdr_len;
+    size_t                  hdr_cap;
+    ymo_hpack_decoder_t     hpack;
+
+    /* Streams: */
+    ymo_http2_stream_t*     streams;     /* In order of creation */
+    ymo_http2_stream_t*     streams_tail;
+    size_t                  no_streams;  /* Not yet closed */
+    uint32_t                last_stream_id;
+
+    /* Flow control and peer settings: */
+    int64_t                 send_window;
+    int64_t                 recv_window;
+    uint32_t                peer_initial_window;
+    uint32_t                peer_max_frame;
+    int                     peer_settings; /* Client preface SETTINGS seen */
+
+    /* Output: */
+    ymo_bucket_t*           send_buffer;
+    ymo_bucket_t*           send_tail;
+    int                     closing;     /* GOAWAY queued; shut down */
+} ymo_http2_session_t;
+
+/**---------------------------------------------------------------
+ * Functions
+ *---------------------------------------------------------------*/
+
+/** */
+ymo_status_t ymo_proto_http2_init(ymo_proto_t* proto, ymo_server_t* server);
+
+/** */
+void ymo_proto_http2_cleanup(ymo_proto_t* proto, ymo_server_t* server);
+
+/** */
+void* ymo_proto_http2_conn_init(void* proto_data, ymo_conn_t* conn);
+
+/** Queue the server connection preface (``SETTINGS``). */
+ymo_status_t ymo_proto_http2_conn_ready(
+        void* proto_data, ymo_conn_t* conn, void* conn_data);
+
+/** */
+void ymo_proto_http2_conn_cleanup(
+        void* proto_data, ymo_conn_t* conn, void* conn_data);
+
+/** HTTP/2 read callback. All of ``recv_buf`` is always consumed (partial
+ * frames are buffered).
+ *
+ * :returns: ``len`` on success; -1 with ``errno`` set on fatal error.
+ */
+ssize_t ymo_proto_http2_read(
+        void* proto_data,
+        ymo_conn_t* conn,
+        void* conn_data,
+        char* recv_buf,
+        size_t len);
+
+/** HTTP/2 write callback. */
+ymo_status_t ymo_proto_http2_write(
+        void* proto_data,
+        ymo_conn_t* conn,
+        void* conn_data,
+        int socket);
+
+/** Complete an ``h2c`` upgrade, once the ``101`` has been sent: switch
+ * ``conn`` to ``h2_proto``, apply the client's ``HTTP2-Settings``, and
+ * replay the upgrade request as stream 1.
+ *
+ * :param exchange: the upgrade request (ownership is transferred)
+ * :returns: ``YMO_WOULDBLOCK`` on success (there is output pending); an
+ *     ``errno`` value on failure.
+ */
+ymo_status_t ymo_proto_http2_upgrade(
+        ymo_conn_t* conn,
+        ymo_proto_t* h2_proto,
+        ymo_http_exchange_t* exchange);
+
+#endif /* YMO_HTTP_PROTO_HTTP2_H */
@@ -366,6 +366,11 @@ ws_parse_complete:
                 memset(&(session->frame_in), 0, sizeof(ymo_ws_frame_t));
                 session->frame_in.buffer = buffer;
                 session->frame_in.buf_len = buf_len;
+
+                /* Nothing else to parse? Don't sit on buffers while idle: */
+                if( !len ) {
+                    ymo_ws_session_release_buffers(session);
+                }
             } else {
                 ws_err_close(
                         "Callback returned an error",
@@ -534,6 +539,7 @@ static ymo_status_t ws_buffer_msg(
 
     memcpy(session->msg_end, msg, len);
     session->msg_end += len;
+    session->msg_len += len;
 
     /* If this was the last of the message, go ahead and deliver it to the
      * msg callback and reset the buffer:
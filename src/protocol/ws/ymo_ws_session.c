@@ -87,6 +87,24 @@ ymo_status_t ymo_ws_session_alloc_frame(
 }
 
 
+void ymo_ws_session_release_buffers(ymo_ws_session_t* session)
+{
+    if( session->frame_in.buffer ) {
+        SESSION_MEM_WS_TRACE("Releasing idle frame (%zu)",
+                session->frame_in.buf_len);
+        YMO_FREE(session->frame_in.buffer);
+        session->frame_in.buffer = NULL;
+        session->frame_in.buf_len = 0;
+    }
+
+    if( session->msg && !session->msg_len ) {
+        YMO_FREE(session->msg);
+        session->msg = session->msg_end = NULL;
+    }
+    return;
+}
+
+
 void ymo_ws_session_free(ymo_ws_session_t* session)
 {
     if( session ) {
@@ -151,6 +151,13 @@ ymo_ws_session_t* ymo_ws_session_create(
 ymo_status_t ymo_ws_session_alloc_frame(
         ymo_ws_session_t* session, size_t len);
 
+/** Used internally by WS protocol to release the frame and message buffers
+ * when a session goes idle between frames. The message buffer is kept if
+ * a fragmented message is still being buffered. Both are reallocated on
+ * demand when the next frame arrives.
+ */
+void ymo_ws_session_release_buffers(ymo_ws_session_t* session);
+
 /** Clear and free the given ws session object, including any nested data
  * which has been dynamically allocated. */
 void ymo_ws_session_free(ymo_ws_session_t* session);
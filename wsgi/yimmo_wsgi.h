@@ -70,6 +70,31 @@
 # define YIMMO_WSGI_NO_THREADS 1
 #endif /* YIMMO_WSGI_NO_THREADS */
 
+/** Largest request body held in memory (larger bodies are spilled to an
+ * unlinked temporary file).
+ */
+#ifndef YIMMO_WSGI_BODY_MEM_MAX
+# define YIMMO_WSGI_BODY_MEM_MAX 65536
+#endif /* YIMMO_WSGI_BODY_MEM_MAX */
+
+/** Largest request body accepted (larger bodies get a 413).
+ */
+#ifndef YIMMO_WSGI_MAX_BODY
+# define YIMMO_WSGI_MAX_BODY (64 * 1024 * 1024)
+#endif /* YIMMO_WSGI_MAX_BODY */
+
+/** Most memory a request line and headers may use (larger get a 413).
+ */
+#ifndef YIMMO_WSGI_MAX_HEADER
+# define YIMMO_WSGI_MAX_HEADER (16 * 1024)
+#endif /* YIMMO_WSGI_MAX_HEADER */
+
+/** Max bytes returned per iteration over ``wsgi.input``.
+ */
+#ifndef YIMMO_WSGI_INPUT_CHUNK
+# define YIMMO_WSGI_INPUT_CHUNK 65536
+#endif /* YIMMO_WSGI_INPUT_CHUNK */
+
 /** Default max (fs) path length: */
 #ifndef YIMMO_WSGI_MAX_PATH
 # define YIMMO_WSGI_MAX_PATH 1024
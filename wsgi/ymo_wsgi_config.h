@@ -96,8 +96,13 @@ void usage(FILE* usage_out, char* bin_name)
     fputs("  YIMMO_WSGI_NO_THREADS     : number of worker threads per process\n", usage_out);
     fputs("  YIMMO_WSGI_MODULE         : WSGI module (if not provided as arg)\n", usage_out);
     fputs("  YIMMO_WSGI_APP            : WSGI app (if not provided as arg)\n", usage_out);
+    fputs("  YIMMO_WSGI_BODY_MEM_MAX   : request body bytes held in memory\n", usage_out);
+    fputs("  YIMMO_WSGI_MAX_BODY       : max request body size\n", usage_out);
+    fputs("  YIMMO_WSGI_MAX_HEADER     : max request header size\n", usage_out);
     fputs("  YIMMO_TLS_CERT_PATH       : TLS certificate path\n", usage_out);
     fputs("  YIMMO_TLS_KEY_PATH        : TLS private key path\n", usage_out);
+    fputs("  YIMMO_TLS_ECDSA_CERT_PATH : TLS ECDSA certificate path\n", usage_out);
+    fputs("  YIMMO_TLS_ECDSA_KEY_PATH  : TLS ECDSA private key path\n", usage_out);
 
     fputs("\nConfiguration precedence (greatest to least):\n", usage_out);
     fputs("  - command line parameters\n", usage_out);
@@ -114,8 +119,16 @@ void usage(FILE* usage_out, char* bin_name)
             "  tls:\n"
             "    cert: /path/to/site.crt\n"
             "    key: /path/to/cert.pem\n"
+            "    ecdsa_cert: /path/to/site-ecdsa.crt\n"
+            "    ecdsa_key: /path/to/site-ecdsa.pem\n"
+            "    ocsp: /path/to/site.ocsp.der\n"
+            "    groups: X25519:P-256\n"
+            "    alpn: [http/1.1]\n"
             "  no_proc: 2\n"
             "  no_threads: 2\n"
+            "  body_mem_max: 65536\n"
+            "  max_body: 67108864\n"
+            "  max_header: 16384\n"
             , stderr);
     return;
 }
@@ -239,12 +252,20 @@ static void ymo_wsgi_config(ymo_wsgi_config_t* w_config)
  *         cert: /path/to/site.crt
  *         key: /path/to/cert.pem
  *
+ * TLS keys (all optional, under ``wsgi.tls``):
+ *  - cert, key:             RSA (or sole) certificate chain and private key
+ *  - ecdsa_cert, ecdsa_key: ECDSA certificate chain and key (preferred)
+ *  - ocsp, ecdsa_ocsp:      DER-encoded OCSP responses to staple
+ *  - groups:                key exchange groups (default X25519:P-256:P-384)
+ *  - alpn:                  list of ALPN ids to negotiate (e.g. [http/1.1])
+ *  - watch:                 reload TLS when the files above change (SIGHUP
+ *                           always triggers a reload)
+ *
  * TODO:
  *  - YMO_LOG_LEVEL_MAX        Compile-time log-level max                                   NOTICE
  *  - YMO_LOG_LEVEL_DEFAULT    Compile-time log-level default.                              WARNING
  *  - YMO_SERVER_IDLE_TIMEOUT  Default connection idle-disconnect timeout.                  5
  *  - YMO_HTTP_RECV_BUF_SIZE   maximum number of bytes allocated for headers, per-request.  1024
- *  - YMO_HTTP_SEND_BUF_SIZE   maximum number of bytes allocated for headers, per-response. 1024
  *  - YMO_SERVER_RECV_BUF_SIZE the server read buffer.                                      8192
  *  - YMO_HTTP_REQ_WS_SIZE     maximum WebSocket message chunk size.                        1024
  *  - YMO_MQTT_RECV_BUF_SIZE   maximum MQTT received payload size                           4096
@@ -53,9 +53,105 @@ struct yimmo_context {
     ymo_wsgi_exchange_t* exchange;
 };
 
-/* TEMPORARY HACK: */
-#define BODY_PTR self->exchange->request->body
-#define BODY_LEN self->exchange->request->content_length
+/* Body data received (the body is complete by the time the app runs): */
+#define BODY_LEN self->exchange->request->body_received
+
+/* Bytes to scan at a time, looking for newlines in spilled bodies: */
+#define BODY_SCAN_SIZE 512
+
+
+/* Read len bytes of body data, from the current offset, into a new bytes
+ * object. The body may be in memory or spilled to a file, so we read through
+ * ymo_http_request_body_pread rather than slicing request->body.
+ */
+static PyObject* context_body_read(yimmo_context_t* self, size_t len)
+{
+    PyObject* pData = PyBytes_FromStringAndSize(NULL, len);
+    if( !pData ) {
+        return NULL;
+    }
+
+    const ymo_http_request_t* request = self->exchange->request;
+    char* dst = PyBytes_AS_STRING(pData);
+    size_t offset = self->exchange->body_read;
+    size_t remain = len;
+    ssize_t n = 0;
+
+    Py_BEGIN_ALLOW_THREADS
+    while( remain ) {
+        n = ymo_http_request_body_pread(request, dst, remain, offset);
+        if( n <= 0 ) {
+            break;
+        }
+        dst += n;
+        offset += n;
+        remain -= n;
+    }
+    Py_END_ALLOW_THREADS
+
+    if( remain ) {
+        Py_DECREF(pData);
+        if( n < 0 ) {
+            PyErr_SetFromErrno(PyExc_OSError);
+        } else {
+            PyErr_SetString(PyExc_EOFError, "Request body truncated");
+        }
+        return NULL;
+    }
+
+    self->exchange->body_read = offset;
+    YMO_WSGI_TRACE("Read %zu bytes (total: %zu)", len, offset);
+    return pData;
+}
+
+
+/* Length of the next line (including the newline), up to limit bytes: */
+static size_t context_body_line_len(yimmo_context_t* self, size_t limit)
+{
+    const ymo_http_request_t* request = self->exchange->request;
+    size_t offset = self->exchange->body_read;
+
+    if( request->body ) {
+        const char* start = request->body + offset;
+        const char* nl = memchr(start, '\n', limit);
+        return nl ? (size_t)(nl - start) + 1 : limit;
+    }
+
+    char scan[BODY_SCAN_SIZE];
+    size_t line_len = 0;
+    while( line_len < limit ) {
+        ssize_t n = ymo_http_request_body_pread(request, scan,
+                YMO_MIN(sizeof(scan), limit - line_len), offset + line_len);
+        if( n <= 0 ) {
+            /* Let context_body_read report it: */
+            return limit;
+        }
+
+        const char* nl = memchr(scan, '\n', n);
+        if( nl ) {
+            return line_len + (size_t)(nl - scan) + 1;
+        }
+        line_len += n;
+    }
+    return line_len;
+}
+
+
+/* Clamp the remaining body length by an optional size argument: */
+static int context_size_arg(
+        PyObject* const* args, Py_ssize_t nargs, size_t* len)
+{
+    if( nargs && args[0] != Py_None ) {
+        Py_ssize_t size = PyLong_AsSsize_t(args[0]);
+        if( size == -1 && PyErr_Occurred() ) {
+            return -1;
+        }
+        if( size >= 0 ) {
+            *len = YMO_MIN((size_t)size, *len);
+        }
+    }
+    return 0;
+}
 
 
 /*---------------------------------------------------------------------------*
@@ -159,24 +255,19 @@ PyObject* yimmo_Context_read(
 
     size_t body_read = self->exchange->body_read;
     size_t content_length = BODY_LEN;
-    if( !content_length || body_read >= content_length ) {
+    if( body_read >= content_length ) {
         YMO_WSGI_TRACE("Done (read %zu bytes)", body_read);
         return PyBytes_FromString("");
     }
 
-    size_t body_remain = content_length - body_read;
-    size_t chunk_length = body_remain;
-    if( nargs ) {
-        chunk_length = YMO_MIN(PyLong_AsSize_t(args[0]), body_remain);
-        YMO_WSGI_TRACE("%p.read() returning %zu bytes",
-                (void*)self, chunk_length);
+    size_t chunk_length = content_length - body_read;
+    if( context_size_arg(args, nargs, &chunk_length) ) {
+        return NULL;
     }
 
-    const char* chunk_start = BODY_PTR + body_read;
-    body_read += chunk_length;
-    self->exchange->body_read = body_read;
-    YMO_WSGI_TRACE("Read %zu bytes", body_read);
-    return PyBytes_FromStringAndSize(chunk_start, chunk_length);
+    YMO_WSGI_TRACE("%p.read() returning %zu bytes",
+            (void*)self, chunk_length);
+    return context_body_read(self, chunk_length);
 }
 
 
@@ -189,38 +280,20 @@ PyObject* yimmo_Context_readline(
 
     size_t body_read = self->exchange->body_read;
     size_t content_length = BODY_LEN;
-    if( !content_length || body_read >= content_length ) {
+    if( body_read >= content_length ) {
         return PyBytes_FromString("");
     }
 
-    size_t body_remain = content_length - body_read;
-    size_t chunk_length = body_remain;
-    if( nargs ) {
-        chunk_length = YMO_MIN(PyLong_AsSize_t(args[0]), body_remain);
-        YMO_WSGI_TRACE("%p.readline() returning %zu bytes",
-                (void*)self, chunk_length);
-    }
-
-    const char* chunk_start = BODY_PTR + body_read;
-
-    /* Look for a newline within the bounds of chunk_start, returning only
-     * a single line, if possible.
-     */
-    for( size_t i = 0; i < chunk_length; i++ ) {
-        if( chunk_start[i] == '\n' ) {
-            chunk_length = i+1;
-            break;
-        }
+    size_t chunk_length = content_length - body_read;
+    if( context_size_arg(args, nargs, &chunk_length) ) {
+        return NULL;
     }
 
-    body_read += chunk_length;
-    self->exchange->body_read = body_read;
-    PyObject* pLine = PyBytes_FromStringAndSize(chunk_start, chunk_length);
-    if( !pLine ) {
-        PyErr_SetString(PyExc_MemoryError,
-                "Failed to allocate memory for body data");
-    }
-    return pLine;
+    /* Return only a single line, if possible: */
+    chunk_length = context_body_line_len(self, chunk_length);
+    YMO_WSGI_TRACE("%p.readline() returning %zu bytes",
+            (void*)self, chunk_length);
+    return context_body_read(self, chunk_length);
 }
 
 
@@ -295,14 +368,10 @@ PyObject* yimmo_Context_iternext(yimmo_context_t* self)
     size_t content_length = BODY_LEN;
 
     if( body_read < content_length ) {
-        size_t remain = content_length - body_read;
-        char* start = BODY_PTR + body_read;
+        size_t remain = YMO_MIN(
+                content_length - body_read, YIMMO_WSGI_INPUT_CHUNK);
         YMO_WSGI_TRACE("Issuing %zu bytes", remain);
-        pData = PyBytes_FromStringAndSize(start, remain);
-
-        if( pData ) {
-            self->exchange->body_read += remain;
-        }
+        pData = context_body_read(self, remain);
     } else {
         YMO_WSGI_TRACE("Stop iteration (%zu bytes read)", content_length);
         PyErr_SetNone(PyExc_StopIteration);
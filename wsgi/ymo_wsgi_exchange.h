@@ -52,6 +52,7 @@ struct ymo_wsgi_exchange {
     struct ymo_wsgi_exchange* next;
     int                       done;
     int                       sent;
+    int                       blocked;   /* Guarded by worker lock_out */
     int                       no_pool;   /* Gross */
     size_t                    body_read;
     atomic_int_least16_t      refcnt;
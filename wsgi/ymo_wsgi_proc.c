@@ -272,3 +272,18 @@ void ymo_wsgi_proc_sigterm(struct ev_loop* loop, ev_signal* w, int revents)
     return;
 }
 
+
+void ymo_wsgi_proc_sighup(struct ev_loop* loop, ev_signal* w, int revents)
+{
+    ymo_wsgi_proc_t* w_proc = w->data;
+    int my_pid = (int)getpid();
+    for( int i = 0; i < w_proc->no_wsgi_proc; i++ ) {
+        ymo_log_notice(
+                "%i sending SIGHUP to %i", my_pid, (int)w_proc->children[i]);
+        kill(w_proc->children[i], SIGHUP);
+    }
+    return;
+}
+
+
+
@@ -81,6 +81,7 @@ struct ymo_wsgi_proc {
     ev_signal  sigint_watcher;
     ev_signal  sigchld_watcher;
     ev_signal  sigterm_watcher;
+    ev_signal  sighup_watcher;
     ev_timer   pkill_timer;
     ev_timer   tkill_timer;
 
@@ -124,6 +125,11 @@ void ymo_wsgi_proc_sigchld(struct ev_loop* loop, ev_signal* w, int revents);
  */
 void ymo_wsgi_proc_sigterm(struct ev_loop* loop, ev_signal* w, int revents);
 
+/** SIGHUP handler (main process, multi-proc mode): forward to workers, which
+ * reload their TLS context.
+ */
+void ymo_wsgi_proc_sighup(struct ev_loop* loop, ev_signal* w, int revents);
+
 
 /** Spawn ``no_wsgi_threads`` worker threads.
  *
@@ -50,6 +50,7 @@ static int main_proc_teardown(ymo_wsgi_proc_t* w_proc);
  *
  * - ``SIGINT`` (being shutdown)
  * - ``SIGCHLD`` (restart child process)
+ * - ``SIGHUP`` (forwarded to child processes to reload TLS)
  *
  */
 static void main_proc_init(ymo_wsgi_proc_t* w_proc)
@@ -61,6 +62,13 @@ static void main_proc_init(ymo_wsgi_proc_t* w_proc)
     w_proc->sigchld_watcher.data = w_proc;
     ev_signal_start(w_proc->loop, &(w_proc->sigint_watcher));
     ev_signal_start(w_proc->loop, &(w_proc->sigchld_watcher));
+
+    /* In single-proc mode, the server handles SIGHUP itself: */
+    if( w_proc->children ) {
+        ev_signal_init(&(w_proc->sighup_watcher), ymo_wsgi_proc_sighup, SIGHUP);
+        w_proc->sighup_watcher.data = w_proc;
+        ev_signal_start(w_proc->loop, &(w_proc->sighup_watcher));
+    }
     return;
 }
 
@@ -31,6 +31,7 @@
 #define HTTP_DEFAULT_LISTEN_BACKLOG 256
 
 #include "ymo_log.h"
+#include "ymo_env.h"
 #include "ymo_http.h"
 #include "ymo_ws.h"
 #include "ymo_http.h"
@@ -49,6 +50,51 @@
 /*---------------------------------*
  *        Server Functions:
  *---------------------------------*/
+/* Register the ALPN ids listed in the tls.alpn config sequence.
+ *
+ * At the moment, HTTP/1.1 is the only protocol served over ALPN. */
+static ymo_status_t ymo_wsgi_server_alpn(
+        ymo_server_t* http_srv,
+        ymo_proto_t* http_proto,
+        const ymo_yaml_node_t* tls_cfg)
+{
+    const ymo_yaml_node_t* alpn_cfg = ymo_yaml_object_get(tls_cfg, "alpn");
+    if( !alpn_cfg ) {
+        return YMO_OKAY;
+    }
+
+    if( ymo_yaml_node_type(alpn_cfg) != YMO_YAML_SEQUENCE ) {
+        ymo_log_error("%s", "WSGI Config: tls.alpn must be a list");
+        return EINVAL;
+    }
+
+    const ymo_yaml_node_t* item = NULL;
+    while( (item = ymo_yaml_item_next(alpn_cfg, item)) ) {
+        const char* alpn_id = ymo_yaml_node_as_str(item);
+        ymo_proto_t* alpn_proto = NULL;
+
+        if( alpn_id && !strcmp(alpn_id, "http/1.1") ) {
+            alpn_proto = http_proto;
+        }
+
+        if( !alpn_proto ) {
+            ymo_log_error("WSGI Config: unsupported ALPN protocol: %s",
+                    alpn_id ? alpn_id : "(null)");
+            return EINVAL;
+        }
+
+        ymo_status_t status = ymo_server_add_alpn(
+                http_srv, alpn_id, alpn_proto);
+        if( status ) {
+            ymo_log_error("WSGI Config: unable to add ALPN %s: %s",
+                    alpn_id, strerror(status));
+            return status;
+        }
+    }
+    return YMO_OKAY;
+}
+
+
 /* libyimmo_http receive callback */
 ymo_status_t ymo_wsgi_server_request_cb(
         ymo_http_session_t* http_session,
@@ -110,6 +156,62 @@ ymo_status_t ymo_wsgi_server_header_cb(
 }
 
 
+/* Spool request bodies to memory/disk, per wsgi.body_mem_max and
+ * wsgi.max_body (env overrides file if present).
+ */
+static ymo_status_t ymo_wsgi_server_body_spool(
+        ymo_proto_t* http_proto, ymo_wsgi_proc_t* proc)
+{
+    long mem_max = YIMMO_WSGI_BODY_MEM_MAX;
+    long body_max = YIMMO_WSGI_MAX_BODY;
+
+    if( proc->cfg ) {
+        ymo_yaml_node_as_long(ymo_yaml_doc_get(
+                    proc->cfg, "wsgi", "body_mem_max", NULL), &mem_max);
+        ymo_yaml_node_as_long(ymo_yaml_doc_get(
+                    proc->cfg, "wsgi", "max_body", NULL), &body_max);
+    }
+    ymo_env_as_long("YIMMO_WSGI_BODY_MEM_MAX", &mem_max, &mem_max);
+    ymo_env_as_long("YIMMO_WSGI_MAX_BODY", &body_max, &body_max);
+
+    if( mem_max < 0 || body_max <= 0 ) {
+        ymo_log_error("Invalid WSGI body limits (memory: %li; max: %li)",
+                mem_max, body_max);
+        return EINVAL;
+    }
+
+    ymo_log_debug("WSGI request bodies: %li bytes in memory; %li max",
+            mem_max, body_max);
+    return ymo_http_set_body_spool(
+            http_proto, (size_t)mem_max, (size_t)body_max);
+}
+
+
+/* Limit request header storage, per wsgi.max_header (env overrides file if
+ * present).
+ */
+static ymo_status_t ymo_wsgi_server_max_header(
+        ymo_proto_t* http_proto, ymo_wsgi_proc_t* proc)
+{
+    long hdr_max = YIMMO_WSGI_MAX_HEADER;
+
+    if( proc->cfg ) {
+        ymo_yaml_node_as_long(ymo_yaml_doc_get(
+                    proc->cfg, "wsgi", "max_header", NULL), &hdr_max);
+    }
+    ymo_env_as_long("YIMMO_WSGI_MAX_HEADER", &hdr_max, &hdr_max);
+
+    if( hdr_max <= 0
+        || ymo_http_set_max_header_size(http_proto, (size_t)hdr_max) ) {
+        ymo_log_error("Invalid WSGI header limit: %li", hdr_max);
+        return EINVAL;
+    }
+
+    ymo_log_debug("WSGI request headers: %li max", hdr_max);
+    return YMO_OKAY;
+}
+
+
 ymo_server_t* ymo_wsgi_server_init(
         struct ev_loop* loop, in_port_t http_port, ymo_wsgi_proc_t* proc)
 {
@@ -122,13 +224,33 @@ ymo_server_t* ymo_wsgi_server_init(
     http_cfg.flags = (YMO_SERVER_REUSE_ADDR | YMO_SERVER_REUSE_PORT);
     http_cfg.listen_backlog = HTTP_DEFAULT_LISTEN_BACKLOG;
 
+    /* TLS config lives under wsgi.tls (or, for backwards compat, tls): */
+    const ymo_yaml_node_t* tls_cfg = NULL;
     if( proc->cfg ) {
-        const ymo_yaml_node_t* tls_cfg = ymo_yaml_object_get(
-                ymo_yaml_doc_root(proc->cfg), "tls");
+        tls_cfg = ymo_yaml_doc_get(proc->cfg, "wsgi", "tls", NULL);
+        if( !tls_cfg ) {
+            tls_cfg = ymo_yaml_object_get(ymo_yaml_doc_root(proc->cfg), "tls");
+        }
+    }
+
+    if( tls_cfg ) {
         http_cfg.cert_path = ymo_yaml_node_as_str(ymo_yaml_object_get(tls_cfg, "cert"));
         http_cfg.key_path = ymo_yaml_node_as_str(ymo_yaml_object_get(tls_cfg, "key"));
+        http_cfg.ecdsa_cert_path = ymo_yaml_node_as_str(ymo_yaml_object_get(tls_cfg, "ecdsa_cert"));
+        http_cfg.ecdsa_key_path = ymo_yaml_node_as_str(ymo_yaml_object_get(tls_cfg, "ecdsa_key"));
+        http_cfg.ocsp_path = ymo_yaml_node_as_str(ymo_yaml_object_get(tls_cfg, "ocsp"));
+        http_cfg.ecdsa_ocsp_path = ymo_yaml_node_as_str(ymo_yaml_object_get(tls_cfg, "ecdsa_ocsp"));
+        http_cfg.tls_groups = ymo_yaml_node_as_str(ymo_yaml_object_get(tls_cfg, "groups"));
+
+        const char* watch = ymo_yaml_node_as_str(ymo_yaml_object_get(tls_cfg, "watch"));
+        if( watch && (!strcasecmp(watch, "true") || !strcasecmp(watch, "yes")) ) {
+            http_cfg.flags |= YMO_SERVER_TLS_WATCH;
+        }
     }
 
+    /* SIGHUP reloads the TLS certs/keys (forwarded to workers by main): */
+    http_cfg.tls_reload_signal = SIGHUP;
+
     /* Env overrides file if present: */
     if( getenv("YIMMO_TLS_CERT_PATH") ) {
         http_cfg.cert_path = getenv("YIMMO_TLS_CERT_PATH");
@@ -139,6 +261,16 @@ ymo_server_t* ymo_wsgi_server_init(
         http_cfg.key_path = getenv("YIMMO_TLS_KEY_PATH");
     }
 
+    /* Env overrides file if present: */
+    if( getenv("YIMMO_TLS_ECDSA_CERT_PATH") ) {
+        http_cfg.ecdsa_cert_path = getenv("YIMMO_TLS_ECDSA_CERT_PATH");
+    }
+
+    /* Env overrides file if present: */
+    if( getenv("YIMMO_TLS_ECDSA_KEY_PATH") ) {
+        http_cfg.ecdsa_key_path = getenv("YIMMO_TLS_ECDSA_KEY_PATH");
+    }
+
     int n = 0;
     ymo_proto_t* http_proto = NULL;
     ymo_server_t* http_srv = NULL;
@@ -161,7 +293,8 @@ ymo_server_t* ymo_wsgi_server_init(
             &ymo_wsgi_server_header_cb,
             NULL,
             &ymo_wsgi_session_cleanup,
-            proc
+            proc,
+            YMO_HTTP_PROTO_DATE
             );
 
 #if (YIMMO_PY_WEBSOCKETS == 1)
@@ -173,13 +306,20 @@ ymo_server_t* ymo_wsgi_server_init(
             http_proto, ymo_http2_no_upgrade_handler());
 #endif /* YIMMO_PY_WEBSOCKETS */
 
-    if( !http_proto ) {
+    if( !http_proto || ymo_wsgi_server_body_spool(http_proto, proc)
+        || ymo_wsgi_server_max_header(http_proto, proc) ) {
         goto http_init_bail;
     }
 
     /* Set up the yimmo http_srv: */
     http_srv = ymo_server_create(&http_cfg, http_proto);
     if( http_srv ) {
+        /* Map any configured ALPN ids onto the available protocols: */
+        if( ymo_wsgi_server_alpn(http_srv, http_proto, tls_cfg) ) {
+            ymo_server_free(http_srv);
+            return NULL;
+        }
+
         /* If we're going to fork, give libyimmo a heads up: */
         if( proc->no_wsgi_proc > 1 ) {
             ymo_status_t mp_ok = ymo_server_pre_fork(http_srv);
@@ -209,6 +349,26 @@ ymo_status_t ymo_wsgi_server_start(struct ev_loop* loop)
 }
 
 
+/** Invoked from the HTTP write path once a blocked response has drained
+ * below its low water mark: wake the worker thread producing it.
+ */
+static ymo_status_t ymo_wsgi_server_drain(
+        ymo_http_session_t* http_session,
+        ymo_http_response_t* response,
+        void* user_data)
+{
+    ymo_wsgi_exchange_t* exchange = user_data;
+    ymo_wsgi_worker_t* worker = exchange->session->worker;
+
+    ymo_wsgi_worker_lock_out(worker);
+    YMO_WSGI_TRACE("Response drained for exchange: %p", (void*)exchange);
+    exchange->blocked = 0;
+    pthread_cond_broadcast(&(worker->drained_out));
+    ymo_wsgi_worker_unlock_out(worker);
+    return YMO_OKAY;
+}
+
+
 /** Invoked during check, prepare, and (if enabled) idle loop watchers. */
 static void ymo_wsgi_server_queue_responses(
         struct ev_loop* loop, ymo_wsgi_worker_t* worker)
@@ -236,6 +396,16 @@ static void ymo_wsgi_server_queue_responses(
             YMO_WSGI_TRACE("Appending body data for exchange: %p", (void*)exchange);
             ymo_http_response_body_append(exchange->response, exchange->body_data);
             exchange->body_data = NULL;
+
+            /* Hold the worker until the client catches up: */
+            if( !exchange->done
+                    && !ymo_http_response_writable(exchange->response) ) {
+                YMO_WSGI_TRACE("Blocking producer for exchange: %p",
+                        (void*)exchange);
+                exchange->blocked = 1;
+                ymo_http_response_on_drain(exchange->response,
+                        &ymo_wsgi_server_drain, exchange);
+            }
         }
 
         if( exchange->done && !exchange->sent ) {
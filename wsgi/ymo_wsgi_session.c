@@ -173,6 +173,14 @@ size_t ymo_wsgi_session_decref(ymo_wsgi_session_t* session)
 void ymo_wsgi_session_close(ymo_wsgi_session_t* session)
 {
     atomic_fetch_add(&(session->closed), 1);
+
+    /* Wake any worker blocked waiting for this session to drain: */
+    ymo_wsgi_worker_t* worker = session->worker;
+    if( worker ) {
+        ymo_wsgi_worker_lock_out(worker);
+        pthread_cond_broadcast(&(worker->drained_out));
+        ymo_wsgi_worker_unlock_out(worker);
+    }
     return;
 }
 
@@ -100,6 +100,12 @@ ymo_status_t ymo_wsgi_worker_init(
         goto worker_init_bail;
     }
 
+    init_fail = pthread_cond_init(&(worker->drained_out), NULL);
+    if( init_fail ) {
+        status = init_fail;
+        goto worker_init_bail;
+    }
+
     ev_async_init(&worker->event_out, ymo_wsgi_server_async);
     ev_prepare_init(&worker->prepare_watcher, ymo_wsgi_server_prepare);
     ev_check_init(&worker->check_watcher, ymo_wsgi_server_check);
@@ -179,8 +185,21 @@ ymo_status_t ymo_wsgi_worker_response_body_append(
     }
 
     ymo_wsgi_worker_t* worker = exchange->session->worker;
+    int closed = 0;
     Py_BEGIN_ALLOW_THREADS
     pthread_mutex_lock(&worker->lock_out);
+
+    /* If the client isn't keeping up, wait for the response to drain: */
+    while( !done && exchange->blocked
+            && !(closed = ymo_wsgi_session_is_closed(exchange->session)) ) {
+        pthread_cond_wait(&worker->drained_out, &worker->lock_out);
+    }
+
+    if( closed ) {
+        pthread_mutex_unlock(&worker->lock_out);
+        goto body_append_closed;
+    }
+
     WSGI_EXCHANGE_INCREF(exchange); /* +1 for queue */
     YMO_WSGI_TRACE("Queuing body data for %p", (void*)exchange);
     if( exchange->body_data ) {
@@ -196,8 +215,14 @@ ymo_status_t ymo_wsgi_worker_response_body_append(
     ymo_queue_append(&worker->queue_out, exchange);
     ev_async_send(EV_DEFAULT_ &worker->event_out);
     pthread_mutex_unlock(&worker->lock_out);
+body_append_closed:
     Py_END_ALLOW_THREADS
 
+    if( closed ) {
+        ymo_bucket_free(body_item);
+        return EPIPE;
+    }
+
     if( done ) {
         WSGI_EXCHANGE_DECREF(exchange); /* -1 for worker */
     }
@@ -60,6 +60,9 @@ struct ymo_wsgi_worker {
     ev_async         event_out;
     pthread_mutex_t  lock_out;
 
+    /* Producers blocked on a slow client wait here (using lock_out): */
+    pthread_cond_t   drained_out;
+
     /* Inbound data is signalled using a condition var: */
     pthread_mutex_t  lock_in;
     pthread_cond_t   ready_in;